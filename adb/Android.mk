@@ -54,6 +54,7 @@ LIBADB_SRC_FILES := \
     adb_trace.cpp \
     adb_utils.cpp \
     fdevent.cpp \
+    framebuffer_stream.cpp \
     sockets.cpp \
     socket_spec.cpp \
     sysdeps/errno.cpp \
@@ -66,11 +67,13 @@ LIBADB_TEST_SRCS := \
     adb_listeners_test.cpp \
     adb_utils_test.cpp \
     fdevent_test.cpp \
+    framebuffer_stream_test.cpp \
     socket_spec_test.cpp \
     socket_test.cpp \
     sysdeps_test.cpp \
     sysdeps/stat_test.cpp \
     transport_test.cpp \
+    types_test.cpp \
 
 LIBADB_CFLAGS := \
     $(ADB_COMMON_CFLAGS) \
@@ -137,7 +140,7 @@ LOCAL_SANITIZE := $(adb_target_sanitize)
 
 # Even though we're building a static library (and thus there's no link step for
 # this to take effect), this adds the includes to our path.
-LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libqemu_pipe libbase
+LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libqemu_pipe libbase liblz4
 
 LOCAL_WHOLE_STATIC_LIBRARIES := libadbd_usb
 
@@ -163,7 +166,7 @@ LOCAL_SANITIZE := $(adb_host_sanitize)
 
 # Even though we're building a static library (and thus there's no link step for
 # this to take effect), this adds the includes to our path.
-LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libbase libmdnssd libusb
+LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libbase libmdnssd libusb liblz4
 
 LOCAL_C_INCLUDES_windows := development/host/windows/usb/api/
 LOCAL_MULTILIB := first
@@ -182,10 +185,24 @@ LOCAL_SRC_FILES := \
     shell_service_test.cpp \
 
 LOCAL_SANITIZE := $(adb_target_sanitize)
-LOCAL_STATIC_LIBRARIES := libadbd libcrypto_utils libcrypto libusb libmdnssd
+LOCAL_STATIC_LIBRARIES := libadbd libcrypto_utils libcrypto liblz4 libusb libmdnssd
 LOCAL_SHARED_LIBRARIES := liblog libbase libcutils
 include $(BUILD_NATIVE_TEST)
 
+# adbd_benchmark
+# =========================================================
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := adbd_benchmark
+LOCAL_CFLAGS := -DADB_HOST=0 $(LIBADB_CFLAGS)
+LOCAL_SRC_FILES := \
+    adbd_benchmark.cpp \
+    shell_service_protocol.cpp \
+
+LOCAL_STATIC_LIBRARIES := libadbd libcrypto_utils libcrypto liblz4 libusb libmdnssd
+LOCAL_SHARED_LIBRARIES := liblog libbase libcutils
+include $(BUILD_NATIVE_BENCHMARK)
+
 # libdiagnose_usb
 # =========================================================
 
@@ -230,6 +247,7 @@ LOCAL_STATIC_LIBRARIES := \
     libcrypto \
     libcutils \
     libdiagnose_usb \
+    liblz4 \
     libmdnssd \
     libgmock_host \
     libusb \
@@ -297,6 +315,7 @@ LOCAL_STATIC_LIBRARIES := \
     libcrypto \
     libdiagnose_usb \
     liblog \
+    liblz4 \
     libmdnssd \
     libusb \
 
@@ -368,6 +387,7 @@ LOCAL_STATIC_LIBRARIES := \
     libfec_rs \
     libselinux \
     liblog \
+    liblz4 \
     libext4_utils \
     libsquashfs_utils \
     libcutils \
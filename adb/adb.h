@@ -28,6 +28,7 @@
 #include "adb_trace.h"
 #include "fdevent.h"
 #include "socket.h"
+#include "types.h"
 #include "usb.h"
 
 constexpr size_t MAX_PAYLOAD_V1 = 4 * 1024;
@@ -58,7 +59,7 @@ constexpr size_t LINUX_MAX_SOCKET_SIZE = 4194304;
 std::string adb_version();
 
 // Increment this when we want to force users to start a new adb server.
-#define ADB_SERVER_VERSION 40
+#define ADB_SERVER_VERSION 43
 
 using TransportId = uint64_t;
 class atransport;
@@ -74,7 +75,7 @@ struct amessage {
 
 struct apacket {
     amessage msg;
-    std::string payload;
+    Block payload;
 };
 
 uint32_t calculate_apacket_checksum(const apacket* packet);
@@ -157,6 +158,7 @@ int handle_forward_request(const char* service, atransport* transport, int reply
 
 #if !ADB_HOST
 void framebuffer_service(int fd, void* cookie);
+void framebuffer_stream_service(int fd, void* cookie);
 void set_verity_enabled_state_service(int fd, void* cookie);
 #endif
 
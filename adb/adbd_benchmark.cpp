@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// In-process benchmarks of the paths every adb transfer goes through: local
+// sockets on the fdevent loop, shell protocol framing, and the per-chunk work
+// of file sync. Run on the device under test with:
+//   adb shell /data/benchmarktest/adbd_benchmark/adbd_benchmark --benchmark_format=json
+// benchmark_device.py measures the whole path end to end against a device.
+
+#include <signal.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "adb_io.h"
+#include "fdevent.h"
+#include "file_sync_service.h"
+#include "shell_service.h"
+#include "socket.h"
+#include "sysdeps.h"
+
+namespace {
+
+// Log-like data, so compression has something realistic to work with.
+std::string MakeData(size_t size) {
+    std::string data;
+    for (size_t i = 0; data.size() < size; ++i) {
+        data += "I/ActivityManager( 1234): Start proc " + std::to_string(i) +
+                ":com.example/u0a42 for service\n";
+    }
+    data.resize(size);
+    return data;
+}
+
+// Runs the fdevent loop on a thread for as long as it's in scope.
+class FdeventThread {
+  public:
+    FdeventThread() {
+        int wake_fds[2];
+        adb_socketpair(wake_fds);
+        asocket* wake_socket = create_local_socket(wake_fds[1]);
+        wake_socket->ready(wake_socket);
+        wake_fd_ = wake_fds[0];
+        thread_ = std::thread(fdevent_loop);
+    }
+
+    // Waits for the loop to destroy sockets whose fds were closed, leaving
+    // only its own two: the wake socket, and fdevent_run_on_main_thread's.
+    void WaitForIdle() {
+        while (fdevent_installed_count() > 2) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    ~FdeventThread() {
+        fdevent_terminate_loop();
+        WriteFdExactly(wake_fd_, "", 1);
+        thread_.join();
+        adb_close(wake_fd_);
+        fdevent_reset();
+    }
+
+  private:
+    int wake_fd_;
+    std::thread thread_;
+};
+
+// A message in one end of a pair of connected local sockets and out the
+// other, as a service's data passes through adbd.
+void BM_local_socket_round_trip(benchmark::State& state) {
+    int in[2], out[2];
+    adb_socketpair(in);
+    adb_socketpair(out);
+    asocket* head = create_local_socket(in[1]);
+    asocket* tail = create_local_socket(out[0]);
+    head->peer = tail;
+    tail->peer = head;
+    head->ready(head);
+    tail->ready(tail);
+
+    std::string message = MakeData(state.range(0));
+    std::string received(message.size(), '\0');
+    {
+        FdeventThread fdevent_thread;
+        while (state.KeepRunning()) {
+            if (!WriteFdExactly(in[0], message.data(), message.size()) ||
+                !ReadFdExactly(out[1], &received[0], received.size())) {
+                state.SkipWithError("transfer failed");
+                break;
+            }
+        }
+        adb_close(in[0]);
+        adb_close(out[1]);
+        fdevent_thread.WaitForIdle();
+    }
+    state.SetBytesProcessed(state.iterations() * message.size());
+}
+BENCHMARK(BM_local_socket_round_trip)->Arg(1)->Arg(4096)->Arg(65536)->Arg(1024 * 1024);
+
+// Shell protocol packets of a given size, and so what `adb shell` output
+// costs to frame and unframe.
+void BM_shell_protocol_throughput(benchmark::State& state) {
+    int fds[2];
+    adb_socketpair(fds);
+    size_t size = state.range(0);
+    size_t total = 0;
+
+    std::thread reader([fd = fds[1]]() {
+        ShellProtocol protocol(fd);
+        while (protocol.Read()) {
+        }
+    });
+    {
+        std::unique_ptr<ShellProtocol> protocol(new ShellProtocol(fds[0]));
+        memset(protocol->data(), 'x', size);
+        while (state.KeepRunning()) {
+            if (!protocol->Write(ShellProtocol::kIdStdout, size)) {
+                state.SkipWithError("write failed");
+                break;
+            }
+            total += size;
+        }
+    }
+    adb_close(fds[0]);
+    reader.join();
+    adb_close(fds[1]);
+    state.SetBytesProcessed(total);
+}
+BENCHMARK(BM_shell_protocol_throughput)->Arg(64)->Arg(4096)->Arg(65536)->Arg(MAX_PAYLOAD - 5);
+
+void BM_sync_compress(benchmark::State& state) {
+    std::string data = MakeData(state.range(0));
+    std::vector<char> out(SYNC_DATA_MAX);
+    size_t compressed = 0;
+    while (state.KeepRunning()) {
+        compressed = SyncCompress(data.data(), data.size(), &out[0]);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(android::base::StringPrintf(
+        "ratio %.2f", compressed ? static_cast<double>(data.size()) / compressed : 1.0));
+}
+BENCHMARK(BM_sync_compress)->Arg(4096)->Arg(SYNC_DATA_MAX);
+
+void BM_sync_decompress(benchmark::State& state) {
+    std::string data = MakeData(state.range(0));
+    std::vector<char> compressed(SYNC_DATA_MAX), out(SYNC_DATA_MAX);
+    size_t length = SyncCompress(data.data(), data.size(), &compressed[0]);
+    if (!length) {
+        state.SkipWithError("incompressible");
+        return;
+    }
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(SyncDecompress(&compressed[0], length, &out[0]));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_sync_decompress)->Arg(4096)->Arg(SYNC_DATA_MAX);
+
+// The client's per-byte cost of looking for unchanged blocks in a delta sync.
+void BM_sync_delta_roll(benchmark::State& state) {
+    const size_t block_size = 4096;
+    std::string data = MakeData(1024 * 1024);
+    uint32_t sum = SyncWeakChecksum(data.data(), block_size);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i + block_size < data.size(); ++i) {
+            sum = SyncRollChecksum(sum, block_size, data[i], data[i + block_size]);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * (data.size() - block_size));
+}
+BENCHMARK(BM_sync_delta_roll);
+
+// The device's cost of signing the file a delta sync replaces.
+void BM_sync_delta_signature(benchmark::State& state) {
+    const size_t block_size = 4096;
+    std::string data = MakeData(block_size);
+    SyncBlockSignature signature;
+    while (state.KeepRunning()) {
+        signature.weak = SyncWeakChecksum(data.data(), block_size);
+        SyncStrongChecksum(data.data(), block_size, signature.strong);
+        benchmark::DoNotOptimize(signature);
+    }
+    state.SetBytesProcessed(state.iterations() * block_size);
+}
+BENCHMARK(BM_sync_delta_signature);
+
+}  // namespace
+
+int main(int argc, char** argv) {
+#if !defined(_WIN32)
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
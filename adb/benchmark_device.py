@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2017 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Measures adb latency and throughput against a device.
+
+Runs the adb on $PATH (or --adb) against one device and prints the results as
+JSON, one object per measurement, so that runs over different transports,
+hosts or adb builds can be compared mechanically:
+
+    ./benchmark_device.py -s SERIAL --repeat 5 > usb3.json
+
+Every measurement is repeated and reported as the median, minimum and maximum
+of the runs. The in-process costs underneath these numbers are measured by
+the adbd_benchmark native benchmark.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+
+DEVICE_DIR = '/data/local/tmp/adb_benchmark'
+DEFAULT_SIZES = [4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024,
+                 128 * 1024 * 1024]
+
+
+class Device(object):
+    def __init__(self, adb, serial):
+        self.adb = [adb]
+        if serial:
+            self.adb += ['-s', serial]
+
+    def run(self, *args, **kwargs):
+        devnull = open(os.devnull, 'wb')
+        try:
+            subprocess.check_call(self.adb + list(args), stdout=devnull,
+                                  stderr=devnull, **kwargs)
+        finally:
+            devnull.close()
+
+    def timed(self, *args):
+        start = time.time()
+        self.run(*args)
+        return time.time() - start
+
+
+def summarize(name, times, size=None):
+    times = sorted(times)
+    result = {
+        'name': name,
+        'runs': len(times),
+        'median_s': times[len(times) // 2],
+        'min_s': times[0],
+        'max_s': times[-1],
+    }
+    if size is not None:
+        result['bytes'] = size
+        result['median_mb_per_s'] = size / result['median_s'] / (1024 * 1024)
+    return result
+
+
+def benchmark_latency(device, repeat):
+    # exec: skips the shell protocol and the pty, so this is close to the
+    # cost of opening a service stream and waiting for it to close.
+    yield summarize('exec_round_trip',
+                    [device.timed('exec-out', 'true') for _ in range(repeat)])
+    yield summarize('shell_round_trip',
+                    [device.timed('shell', 'true') for _ in range(repeat)])
+
+
+def benchmark_sync(device, sizes, repeat, tmp_dir):
+    device.run('shell', 'rm -rf {0} && mkdir -p {0}'.format(DEVICE_DIR))
+    for size in sizes:
+        local = os.path.join(tmp_dir, 'push.{}'.format(size))
+        with open(local, 'wb') as f:
+            f.write(os.urandom(size))
+        remote = '{}/file.{}'.format(DEVICE_DIR, size)
+        pulled = os.path.join(tmp_dir, 'pull.{}'.format(size))
+
+        yield summarize('push', [device.timed('push', local, remote)
+                                 for _ in range(repeat)], size)
+        yield summarize('pull', [device.timed('pull', remote, pulled)
+                                 for _ in range(repeat)], size)
+        os.remove(local)
+        os.remove(pulled)
+    device.run('shell', 'rm -rf ' + DEVICE_DIR)
+
+
+def benchmark_shell_output(device, sizes, repeat):
+    for size in sizes:
+        command = 'head -c {} /dev/zero'.format(size)
+        yield summarize('exec_output', [device.timed('exec-out', command)
+                                        for _ in range(repeat)], size)
+        yield summarize('shell_output', [device.timed('shell', '-T', command)
+                                         for _ in range(repeat)], size)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-s', '--serial', help='device to use')
+    parser.add_argument('--adb', default='adb', help='adb binary to test')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='runs of each measurement')
+    parser.add_argument('--size', type=int, action='append', dest='sizes',
+                        help='transfer size in bytes, may be repeated')
+    parser.add_argument('--skip', action='append', default=[],
+                        choices=['latency', 'sync', 'shell'],
+                        help='measurements to leave out')
+    args = parser.parse_args()
+    sizes = args.sizes or DEFAULT_SIZES
+
+    device = Device(args.adb, args.serial)
+    device.run('wait-for-device')
+
+    tmp_dir = tempfile.mkdtemp()
+    results = []
+    try:
+        if 'latency' not in args.skip:
+            results += benchmark_latency(device, args.repeat)
+        if 'sync' not in args.skip:
+            results += benchmark_sync(device, sizes, args.repeat, tmp_dir)
+        if 'shell' not in args.skip:
+            results += benchmark_shell_output(device, sizes, args.repeat)
+    finally:
+        shutil.rmtree(tmp_dir)
+
+    json.dump(results, sys.stdout, indent=2, sort_keys=True)
+    print()
+
+
+if __name__ == '__main__':
+    main()
@@ -18,6 +18,8 @@
 
 #include "bugreport.h"
 
+#include <stdio.h>
+
 #include <string>
 #include <vector>
 
@@ -25,6 +27,7 @@
 #include <android-base/strings.h>
 
 #include "sysdeps.h"
+#include "adb_io.h"
 #include "adb_utils.h"
 #include "file_sync_service.h"
 
@@ -34,6 +37,13 @@ static constexpr char BUGZ_PROGRESS_SEPARATOR[] = "/";
 static constexpr char BUGZ_OK_PREFIX[] = "OK:";
 static constexpr char BUGZ_FAIL_PREFIX[] = "FAIL:";
 
+// bugreportz -s, which writes the zip to stdout as it is generated, was added in 1.2.
+static constexpr int BUGZ_STREAM_MAJOR = 1;
+static constexpr int BUGZ_STREAM_MINOR = 2;
+
+// Bytes written between updates of the streaming progress.
+static constexpr uint64_t STREAM_PROGRESS_INTERVAL = 1024 * 1024;
+
 // Custom callback used to handle the output of zipped bugreports.
 class BugreportStandardStreamsCallback : public StandardStreamsCallbackInterface {
   public:
@@ -195,8 +205,81 @@ class BugreportStandardStreamsCallback : public StandardStreamsCallbackInterface
     DISALLOW_COPY_AND_ASSIGN(BugreportStandardStreamsCallback);
 };
 
+// Custom callback used to write the zip streamed by 'bugreportz -s' as it arrives.
+class BugreportStreamingCallback : public StandardStreamsCallbackInterface {
+  public:
+    BugreportStreamingCallback(int fd, const std::string& dest_path, Bugreport* br)
+        : br_(br),
+          fd_(fd),
+          dest_path_(dest_path),
+          line_message_("streaming " + android::base::Basename(dest_path)),
+          bytes_(0),
+          last_progress_bytes_(0),
+          write_failed_(false) {
+    }
+
+    void OnStdout(const char* buffer, int length) {
+        if (write_failed_) return;
+        if (!WriteFdExactly(fd_, buffer, length)) {
+            fprintf(stderr, "adb: cannot write '%s': %s\n", dest_path_.c_str(),
+                    strerror(errno));
+            write_failed_ = true;
+            return;
+        }
+        bytes_ += length;
+        if (bytes_ - last_progress_bytes_ >= STREAM_PROGRESS_INTERVAL) {
+            last_progress_bytes_ = bytes_;
+            br_->UpdateStreamProgress(line_message_, bytes_);
+        }
+    }
+
+    void OnStderr(const char* buffer, int length) {
+        OnStream(nullptr, stderr, buffer, length);
+    }
+
+    int Done(int status) {
+        adb_close(fd_);
+        if (status == 0 && write_failed_) {
+            status = 1;
+        } else if (status == 0 && bytes_ == 0) {
+            fprintf(stderr, "adb: bugreportz did not stream any data\n");
+            status = -1;
+        }
+        if (status != 0) {
+            adb_unlink(dest_path_.c_str());
+            return status;
+        }
+        br_->UpdateStreamProgress(line_message_, bytes_);
+        return 0;
+    }
+
+  private:
+    Bugreport* br_;
+
+    // Destination of the bugreport on host, opened before the command is sent.
+    int fd_;
+    std::string dest_path_;
+
+    // Message displayed on LinePrinter.
+    std::string line_message_;
+
+    // Bytes written so far, and when the progress was last displayed.
+    uint64_t bytes_;
+    uint64_t last_progress_bytes_;
+
+    // Whether writing to the destination failed; the rest of the stream is then dropped.
+    bool write_failed_;
+
+    DISALLOW_COPY_AND_ASSIGN(BugreportStreamingCallback);
+};
+
 int Bugreport::DoIt(int argc, const char** argv) {
-    if (argc > 2) return syntax_error("adb bugreport [PATH]");
+    bool stream = argc > 1 && !strcmp(argv[1], "--stream");
+    if (stream) {
+        argc--;
+        argv++;
+    }
+    if (argc > 2) return syntax_error("adb bugreport [--stream] [PATH]");
 
     // Gets bugreportz version.
     std::string bugz_stdout, bugz_stderr;
@@ -208,7 +291,7 @@ int Bugreport::DoIt(int argc, const char** argv) {
     if (status != 0 || bugz_version.empty()) {
         D("'bugreportz' -v results: status=%d, stdout='%s', stderr='%s'", status,
           bugz_output.c_str(), bugz_version.c_str());
-        if (argc == 1) {
+        if (argc == 1 && !stream) {
             // Device does not support bugreportz: if called as 'adb bugreport', just falls out to
             // the flat-file version.
             fprintf(stderr,
@@ -252,6 +335,8 @@ int Bugreport::DoIt(int argc, const char** argv) {
         }
     }
 
+    if (stream) return DoStream(bugz_version, dest_dir, dest_file);
+
     bool show_progress = true;
     std::string bugz_command = "bugreportz -p";
     if (bugz_version == "1.0") {
@@ -268,6 +353,43 @@ int Bugreport::DoIt(int argc, const char** argv) {
     return SendShellCommand(bugz_command, false, &bugz_callback);
 }
 
+int Bugreport::DoStream(const std::string& bugz_version, const std::string& dest_dir,
+                        const std::string& dest_file) {
+    int major = 0, minor = 0;
+    if (sscanf(bugz_version.c_str(), "%d.%d", &major, &minor) != 2 ||
+        major < BUGZ_STREAM_MAJOR || (major == BUGZ_STREAM_MAJOR && minor < BUGZ_STREAM_MINOR)) {
+        fprintf(stderr,
+                "adb: bugreportz %s does not support streaming; "
+                "try 'adb bugreport' without --stream instead.\n",
+                bugz_version.c_str());
+        return -1;
+    }
+
+    // The device doesn't name a streamed bugreport, so the default name is kept for directories.
+    std::string destination = dest_file;
+    if (!dest_dir.empty()) {
+        destination = android::base::StringPrintf("%s%c%s", dest_dir.c_str(), OS_PATH_SEPARATOR,
+                                                  dest_file.c_str());
+    }
+
+    // Fail before the device starts generating the bugreport if it can't be saved.
+    adb_unlink(destination.c_str());
+    int fd = adb_creat(destination.c_str(), 0644);
+    if (fd < 0) {
+        fprintf(stderr, "adb: cannot create '%s': %s\n", destination.c_str(), strerror(errno));
+        return 1;
+    }
+
+    BugreportStreamingCallback stream_callback(fd, destination, this);
+    return SendShellCommand("bugreportz -s", false, &stream_callback);
+}
+
+void Bugreport::UpdateStreamProgress(const std::string& message, uint64_t bytes) {
+    line_printer_.Print(android::base::StringPrintf("[%6.1f MB] %s", bytes / (1024.0 * 1024.0),
+                                                    message.c_str()),
+                        LinePrinter::INFO);
+}
+
 void Bugreport::UpdateProgress(const std::string& message, int progress_percentage) {
     line_printer_.Print(
         android::base::StringPrintf("[%3d%%] %s", progress_percentage, message.c_str()),
@@ -25,6 +25,7 @@
 
 class Bugreport {
     friend class BugreportStandardStreamsCallback;
+    friend class BugreportStreamingCallback;
 
   public:
     Bugreport() : line_printer_() {
@@ -43,6 +44,9 @@ class Bugreport {
 
   private:
     virtual void UpdateProgress(const std::string& file_name, int progress_percentage);
+    virtual void UpdateStreamProgress(const std::string& message, uint64_t bytes);
+    int DoStream(const std::string& bugz_version, const std::string& dest_dir,
+                 const std::string& dest_file);
     LinePrinter line_printer_;
     DISALLOW_COPY_AND_ASSIGN(Bugreport);
 };
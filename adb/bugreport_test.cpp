@@ -19,6 +19,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <android-base/file.h>
 #include <android-base/strings.h>
 #include <android-base/test_utils.h>
 
@@ -123,6 +124,7 @@ class BugreportMock : public Bugreport {
     MOCK_METHOD4(DoSyncPull, bool(const std::vector<const char*>& srcs, const char* dst,
                                   bool copy_attrs, const char* name));
     MOCK_METHOD2(UpdateProgress, void(const std::string&, int));
+    MOCK_METHOD2(UpdateStreamProgress, void(const std::string&, uint64_t));
 };
 
 class BugreportTest : public ::testing::Test {
@@ -464,3 +466,68 @@ TEST_F(BugreportTest, PullFails) {
     const char* args[] = {"bugreport", "file.zip"};
     ASSERT_EQ(1, br_.DoIt(2, args));
 }
+
+// Tests 'adb bugreport --stream file.zip' when it succeeds, writing the zip as it's streamed.
+TEST_F(BugreportTest, StreamOk) {
+    ExpectBugreportzVersion("1.2");
+    TemporaryDir td;
+    std::string dest_file =
+        android::base::StringPrintf("%s%cfile.zip", td.path, OS_PATH_SEPARATOR);
+
+    EXPECT_CALL(br_, SendShellCommand("bugreportz -s", false, _))
+        .WillOnce(DoAll(WithArg<2>(WriteOnStdout("PK\x03\x04")),
+                        WithArg<2>(WriteOnStdout("zip entries")),
+                        WithArg<2>(ReturnCallbackDone(0))));
+    EXPECT_CALL(br_, UpdateStreamProgress(StrEq("streaming file.zip"), 15U));
+
+    const char* args[] = {"bugreport", "--stream", dest_file.c_str()};
+    ASSERT_EQ(0, br_.DoIt(3, args));
+
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(dest_file, &content));
+    ASSERT_EQ(std::string("PK\x03\x04zip entries"), content);
+}
+
+// Tests 'adb bugreport --stream dir' when it succeeds and destination is a directory.
+TEST_F(BugreportTest, StreamOkDirectory) {
+    ExpectBugreportzVersion("1.2");
+    TemporaryDir td;
+    std::string dest_file =
+        android::base::StringPrintf("%s%cbugreport.zip", td.path, OS_PATH_SEPARATOR);
+
+    EXPECT_CALL(br_, SendShellCommand("bugreportz -s", false, _))
+        .WillOnce(DoAll(WithArg<2>(WriteOnStdout("PK")), WithArg<2>(ReturnCallbackDone(0))));
+    EXPECT_CALL(br_, UpdateStreamProgress(StrEq("streaming bugreport.zip"), 2U));
+
+    const char* args[] = {"bugreport", "--stream", td.path};
+    ASSERT_EQ(0, br_.DoIt(3, args));
+
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(dest_file, &content));
+    ASSERT_EQ("PK", content);
+}
+
+// Tests 'adb bugreport --stream file.zip' when bugreportz is too old to stream.
+TEST_F(BugreportTest, StreamUnsupported) {
+    ExpectBugreportzVersion("1.1");
+
+    CaptureStderr();
+    const char* args[] = {"bugreport", "--stream", "file.zip"};
+    ASSERT_EQ(-1, br_.DoIt(3, args));
+    ASSERT_THAT(GetCapturedStderr(), HasSubstr("does not support streaming"));
+}
+
+// Tests 'adb bugreport --stream file.zip' when bugreportz failed mid-stream.
+TEST_F(BugreportTest, StreamFails) {
+    ExpectBugreportzVersion("1.2");
+    TemporaryDir td;
+    std::string dest_file =
+        android::base::StringPrintf("%s%cfile.zip", td.path, OS_PATH_SEPARATOR);
+
+    EXPECT_CALL(br_, SendShellCommand("bugreportz -s", false, _))
+        .WillOnce(DoAll(WithArg<2>(WriteOnStdout("PK")), WithArg<2>(ReturnCallbackDone(1))));
+
+    const char* args[] = {"bugreport", "--stream", dest_file.c_str()};
+    ASSERT_EQ(1, br_.DoIt(3, args));
+    ASSERT_NE(0, access(dest_file.c_str(), F_OK));
+}
@@ -31,6 +31,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <thread>
@@ -168,10 +170,12 @@ static void help() {
         "   to show usage run \"adb shell bu help\"\n"
         "\n"
         "debugging:\n"
-        " bugreport [PATH]\n"
+        " bugreport [--stream] [PATH]\n"
         "     write bugreport to given PATH [default=bugreport.zip];\n"
         "     if PATH is a directory, the bug report is saved in that directory.\n"
         "     devices that don't support zipped bug reports output to stdout.\n"
+        "     --stream: write the zip as the device generates it, rather than\n"
+        "               pulling it once done (requires bugreportz 1.2 or later)\n"
         " jdwp                     list pids of processes hosting a JDWP transport\n"
         " logcat                   show device log (logcat --help for more)\n"
         "\n"
@@ -1934,6 +1938,51 @@ static int install_app(int argc, const char** argv) {
     return 1;
 }
 
+// How many APKs install-multiple streams into the session at once.
+static constexpr size_t kMaxConcurrentInstallWrites = 4;
+
+// Streams one APK into an install session. Safe to call from several threads
+// at once; failures are described in *error rather than printed, so that
+// concurrent writers don't interleave their output.
+static bool install_write_apk(const std::string& install_cmd, int session_id, const char* file,
+                              std::string* error) {
+    struct stat sb;
+    if (stat(file, &sb) == -1) {
+        *error = android::base::StringPrintf("adb: failed to stat %s: %s\n", file,
+                                             strerror(errno));
+        return false;
+    }
+
+    std::string cmd = android::base::StringPrintf(
+        "%s install-write -S %" PRIu64 " %d %s -", install_cmd.c_str(),
+        static_cast<uint64_t>(sb.st_size), session_id, android::base::Basename(file).c_str());
+
+    unique_fd localFd(adb_open(file, O_RDONLY));
+    if (localFd < 0) {
+        *error = android::base::StringPrintf("adb: failed to open %s: %s\n", file,
+                                             strerror(errno));
+        return false;
+    }
+
+    std::string connect_error;
+    unique_fd remoteFd(adb_connect(cmd, &connect_error));
+    if (remoteFd < 0) {
+        *error = android::base::StringPrintf("adb: connect error for write: %s\n",
+                                             connect_error.c_str());
+        return false;
+    }
+
+    char buf[BUFSIZ];
+    copy_to_file(localFd, remoteFd);
+    read_status_line(remoteFd, buf, sizeof(buf));
+
+    if (strncmp("Success", buf, 7)) {
+        *error = android::base::StringPrintf("adb: failed to write %s\n%s", file, buf);
+        return false;
+    }
+    return true;
+}
+
 static int install_multiple_app(int argc, const char** argv) {
     // Find all APK arguments starting at end.
     // All other arguments passed through verbatim.
@@ -1992,52 +2041,35 @@ static int install_multiple_app(int argc, const char** argv) {
         return EXIT_FAILURE;
     }
 
-    // Valid session, now stream the APKs
-    int success = 1;
-    for (int i = first_apk; i < argc; i++) {
-        const char* file = argv[i];
-        struct stat sb;
-        if (stat(file, &sb) == -1) {
-            fprintf(stderr, "adb: failed to stat %s: %s\n", file, strerror(errno));
-            success = 0;
-            goto finalize_session;
-        }
-
-        std::string cmd = android::base::StringPrintf(
-            "%s install-write -S %" PRIu64 " %d %s -", install_cmd.c_str(),
-            static_cast<uint64_t>(sb.st_size), session_id, android::base::Basename(file).c_str());
-
-        int localFd = adb_open(file, O_RDONLY);
-        if (localFd < 0) {
-            fprintf(stderr, "adb: failed to open %s: %s\n", file, strerror(errno));
-            success = 0;
-            goto finalize_session;
-        }
-
-        std::string error;
-        int remoteFd = adb_connect(cmd, &error);
-        if (remoteFd < 0) {
-            fprintf(stderr, "adb: connect error for write: %s\n", error.c_str());
-            adb_close(localFd);
-            success = 0;
-            goto finalize_session;
-        }
-
-        copy_to_file(localFd, remoteFd);
-        read_status_line(remoteFd, buf, sizeof(buf));
-
-        adb_close(localFd);
-        adb_close(remoteFd);
-
-        if (strncmp("Success", buf, 7)) {
-            fprintf(stderr, "adb: failed to write %s\n", file);
-            fputs(buf, stderr);
-            success = 0;
-            goto finalize_session;
+    // Valid session, now stream the APKs. Each goes over its own connection,
+    // a few at a time, since the session takes writes to different names
+    // concurrently and one stream rarely fills the link.
+    std::vector<const char*> files(argv + first_apk, argv + argc);
+    std::vector<std::string> errors(files.size());
+    std::atomic<size_t> next_file(0);
+    std::atomic<bool> failed(false);
+    auto write_apks = [&]() {
+        size_t i;
+        while (!failed && (i = next_file++) < files.size()) {
+            if (!install_write_apk(install_cmd, session_id, files[i], &errors[i])) {
+                failed = true;
+            }
         }
+    };
+    std::vector<std::thread> writers;
+    size_t writer_count = std::min(files.size(), kMaxConcurrentInstallWrites);
+    for (size_t i = 1; i < writer_count; ++i) {
+        writers.emplace_back(write_apks);
+    }
+    write_apks();
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    for (const std::string& message : errors) {
+        fputs(message.c_str(), stderr);
     }
+    int success = !failed;
 
-finalize_session:
     // Commit session if we streamed everything okay; otherwise abandon
     std::string service =
             android::base::StringPrintf("%s install-%s %d",
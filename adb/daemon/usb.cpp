@@ -25,8 +25,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -52,8 +52,9 @@ using namespace std::chrono_literals;
 
 #define USB_FFS_BULK_SIZE 16384
 
-// Number of buffers needed to fit MAX_PAYLOAD, with an extra for ZLPs.
-#define USB_FFS_NUM_BUFS ((MAX_PAYLOAD / USB_FFS_BULK_SIZE) + 1)
+// Transfers kept in flight on each endpoint, sys.usb.ffs.aio_depth overrides.
+#define USB_FFS_AIO_DEPTH 16
+#define USB_FFS_AIO_DEPTH_MAX 256
 
 #define cpu_to_le16(x) htole16(x)
 #define cpu_to_le32(x) htole32(x)
@@ -226,24 +227,50 @@ static const struct {
     },
 };
 
-static void aio_block_init(aio_block* aiob) {
-    aiob->iocb.resize(USB_FFS_NUM_BUFS);
-    aiob->iocbs.resize(USB_FFS_NUM_BUFS);
-    aiob->events.resize(USB_FFS_NUM_BUFS);
-    aiob->num_submitted = 0;
-    for (unsigned i = 0; i < USB_FFS_NUM_BUFS; i++) {
-        aiob->iocbs[i] = &aiob->iocb[i];
+static void aio_block_init(aio_block* aiob, size_t depth) {
+    aiob->iocb.resize(depth);
+    aiob->iocbs.reserve(depth);
+    aiob->events.resize(depth);
+    aiob->transfers.resize(depth);
+    for (auto& transfer : aiob->transfers) {
+        transfer.buf.reset(new char[USB_FFS_BULK_SIZE]);
     }
 }
 
-static int getMaxPacketSize(int ffs_fd) {
-    usb_endpoint_descriptor desc;
-    if (ioctl(ffs_fd, FUNCTIONFS_ENDPOINT_DESC, reinterpret_cast<unsigned long>(&desc))) {
-        D("[ could not get endpoint descriptor! (%d) ]", errno);
-        return MAX_PACKET_SIZE_HS;
-    } else {
-        return desc.wMaxPacketSize;
+static bool aio_block_open(aio_block* aiob, int fd) {
+    aiob->fd = fd;
+    if (aiob->iocb.empty()) {
+        return true;
+    }
+
+    if (io_setup(aiob->iocb.size(), &aiob->ctx)) {
+        D("[ aio: got error on io_setup (%d) ]", errno);
+        return false;
+    }
+    aiob->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (aiob->event_fd < 0) {
+        PLOG(ERROR) << "aio: cannot create eventfd";
+        io_destroy(aiob->ctx);
+        return false;
     }
+    return true;
+}
+
+static void aio_block_close(aio_block* aiob) {
+    if (aiob->iocb.empty()) {
+        return;
+    }
+
+    // Cancels, and waits for, whatever is still in flight.
+    io_destroy(aiob->ctx);
+    adb_close(aiob->event_fd);
+    aiob->event_fd = -1;
+    for (auto& transfer : aiob->transfers) {
+        transfer.pending = false;
+    }
+    aiob->next = 0;
+    aiob->primed = false;
+    aiob->error = 0;
 }
 
 bool init_functionfs(struct usb_handle* h) {
@@ -312,13 +339,13 @@ bool init_functionfs(struct usb_handle* h) {
         goto err;
     }
 
-    if (io_setup(USB_FFS_NUM_BUFS, &h->read_aiob.ctx) ||
-        io_setup(USB_FFS_NUM_BUFS, &h->write_aiob.ctx)) {
-        D("[ aio: got error on io_setup (%d) ]", errno);
+    if (!aio_block_open(&h->read_aiob, h->bulk_out)) {
+        goto err;
+    }
+    if (!aio_block_open(&h->write_aiob, h->bulk_in)) {
+        aio_block_close(&h->read_aiob);
+        goto err;
     }
-
-    h->read_aiob.fd = h->bulk_out;
-    h->write_aiob.fd = h->bulk_in;
     return true;
 
 err:
@@ -405,69 +432,152 @@ static int usb_ffs_read(usb_handle* h, void* data, int len) {
     return 0;
 }
 
-static int usb_ffs_do_aio(usb_handle* h, const void* data, int len, bool read) {
-    aio_block* aiob = read ? &h->read_aiob : &h->write_aiob;
-    bool zero_packet = false;
-
-    int num_bufs = len / USB_FFS_BULK_SIZE + (len % USB_FFS_BULK_SIZE == 0 ? 0 : 1);
-    const char* cur_data = reinterpret_cast<const char*>(data);
-    int packet_size = getMaxPacketSize(aiob->fd);
+static void usb_ffs_aio_prep(aio_block* aiob, size_t i, size_t len, bool read) {
+    struct iocb* iocb = &aiob->iocb[i];
+    io_prep(iocb, aiob->fd, aiob->transfers[i].buf.get(), len, 0, read);
+    iocb->aio_data = i;
+    iocb->aio_flags = IOCB_FLAG_RESFD;
+    iocb->aio_resfd = aiob->event_fd;
+    aiob->transfers[i].pending = true;
+    aiob->transfers[i].offset = 0;
+    aiob->iocbs.push_back(iocb);
+}
 
-    if (posix_madvise(const_cast<void*>(data), len, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED) <
-        0) {
-        D("[ Failed to madvise: %d ]", errno);
+static bool usb_ffs_aio_submit(aio_block* aiob, bool read) {
+    size_t count = aiob->iocbs.size();
+    if (count == 0) {
+        return true;
     }
+    int rc = TEMP_FAILURE_RETRY(io_submit(aiob->ctx, count, aiob->iocbs.data()));
+    aiob->iocbs.clear();
+    if (rc < static_cast<int>(count)) {
+        PLOG(ERROR) << "aio: got error submitting " << (read ? "read" : "write");
+        return false;
+    }
+    return true;
+}
 
-    for (int i = 0; i < num_bufs; i++) {
-        int buf_len = std::min(len, USB_FFS_BULK_SIZE);
-        io_prep(&aiob->iocb[i], aiob->fd, cur_data, buf_len, 0, read);
-
-        len -= buf_len;
-        cur_data += buf_len;
+// Waits for transfer i to complete, reaping every other completion on the way.
+// Fails as soon as the handle is kicked.
+static bool usb_ffs_aio_wait(usb_handle* h, aio_block* aiob, size_t i) {
+    while (aiob->transfers[i].pending) {
+        // Poll first: an eventfd signalled after this returns is caught below.
+        timespec zero = {};
+        int n = TEMP_FAILURE_RETRY(
+            io_getevents(aiob->ctx, 0, aiob->events.size(), aiob->events.data(), &zero));
+        if (n < 0) {
+            PLOG(ERROR) << "aio: got error waiting";
+            return false;
+        }
+        for (int j = 0; j < n; j++) {
+            aio_transfer& transfer = aiob->transfers[aiob->events[j].data];
+            transfer.pending = false;
+            transfer.result = aiob->events[j].res;
+            if (transfer.result < 0 && transfer.result != -EINTR && aiob->error == 0) {
+                aiob->error = -transfer.result;
+            }
+        }
+        if (n > 0) {
+            continue;
+        }
 
-        if (len == 0 && buf_len % packet_size == 0 && read) {
-            // adb does not expect the device to send a zero packet after data transfer,
-            // but the host *does* send a zero packet for the device to read.
-            zero_packet = true;
+        adb_pollfd pfd[2] = {{aiob->event_fd, POLLIN, 0}, {h->kick_fd, POLLIN, 0}};
+        if (adb_poll(pfd, 2, -1) < 0) {
+            PLOG(ERROR) << "aio: poll failed";
+            return false;
         }
+        if (pfd[1].revents) {
+            D("[ aio: kicked while waiting on fd=%d ]", aiob->fd);
+            errno = EPIPE;
+            return false;
+        }
+        uint64_t completions;
+        adb_read(aiob->event_fd, &completions, sizeof(completions));
     }
-    if (zero_packet) {
-        io_prep(&aiob->iocb[num_bufs], aiob->fd, reinterpret_cast<const void*>(cur_data),
-                packet_size, 0, read);
-        num_bufs += 1;
-    }
+    return true;
+}
 
-    while (true) {
-        if (TEMP_FAILURE_RETRY(io_submit(aiob->ctx, num_bufs, aiob->iocbs.data())) < num_bufs) {
-            PLOG(ERROR) << "aio: got error submitting " << (read ? "read" : "write");
+// Every transfer of the read ring stays queued on the endpoint, so the host
+// always has somewhere to put the next packet; reads are served from the
+// oldest completed transfer, which is queued again once consumed.
+static int usb_ffs_aio_read(usb_handle* h, void* data, int len) {
+    aio_block* aiob = &h->read_aiob;
+    size_t depth = aiob->transfers.size();
+
+    if (!aiob->primed) {
+        for (size_t i = 0; i < depth; i++) {
+            usb_ffs_aio_prep(aiob, i, USB_FFS_BULK_SIZE, true);
+        }
+        if (!usb_ffs_aio_submit(aiob, true)) {
             return -1;
         }
-        if (TEMP_FAILURE_RETRY(io_getevents(aiob->ctx, num_bufs, num_bufs, aiob->events.data(),
-                                            nullptr)) < num_bufs) {
-            PLOG(ERROR) << "aio: got error waiting " << (read ? "read" : "write");
+        aiob->primed = true;
+    }
+
+    char* buf = static_cast<char*>(data);
+    while (len > 0) {
+        size_t i = aiob->next;
+        if (!usb_ffs_aio_wait(h, aiob, i)) {
             return -1;
         }
-        if (num_bufs == 1 && aiob->events[0].res == -EINTR) {
-            continue;
+
+        aio_transfer& transfer = aiob->transfers[i];
+        if (transfer.result < 0 && transfer.result != -EINTR) {
+            errno = -transfer.result;
+            PLOG(ERROR) << "aio: got error event on read";
+            return -1;
         }
-        for (int i = 0; i < num_bufs; i++) {
-            if (aiob->events[i].res < 0) {
-                errno = -aiob->events[i].res;
-                PLOG(ERROR) << "aio: got error event on " << (read ? "read" : "write")
-                            << " total bufs " << num_bufs;
-                return -1;
+        if (transfer.result > 0) {
+            size_t n = std::min(static_cast<size_t>(len),
+                                static_cast<size_t>(transfer.result) - transfer.offset);
+            memcpy(buf, transfer.buf.get() + transfer.offset, n);
+            transfer.offset += n;
+            buf += n;
+            len -= n;
+            if (transfer.offset < static_cast<size_t>(transfer.result)) {
+                continue;
             }
         }
-        return 0;
-    }
-}
 
-static int usb_ffs_aio_read(usb_handle* h, void* data, int len) {
-    return usb_ffs_do_aio(h, data, len, true);
+        // Consumed, a zero length packet, or interrupted: back to the end of the ring.
+        usb_ffs_aio_prep(aiob, i, USB_FFS_BULK_SIZE, true);
+        if (!usb_ffs_aio_submit(aiob, true)) {
+            return -1;
+        }
+        aiob->next = (i + 1) % depth;
+    }
+    return 0;
 }
 
+// Writes are copied into the ring and return as soon as they are queued,
+// only blocking once every transfer is in flight. A failed write is
+// reported by the next call.
 static int usb_ffs_aio_write(usb_handle* h, const void* data, int len) {
-    return usb_ffs_do_aio(h, data, len, false);
+    aio_block* aiob = &h->write_aiob;
+    size_t depth = aiob->transfers.size();
+
+    const char* buf = static_cast<const char*>(data);
+    while (len > 0) {
+        size_t i = aiob->next;
+        if (aiob->transfers[i].pending) {
+            if (!usb_ffs_aio_submit(aiob, false) || !usb_ffs_aio_wait(h, aiob, i)) {
+                return -1;
+            }
+        }
+        if (aiob->error) {
+            errno = aiob->error;
+            PLOG(ERROR) << "aio: got error event on write";
+            return -1;
+        }
+
+        size_t n = std::min(len, USB_FFS_BULK_SIZE);
+        memcpy(aiob->transfers[i].buf.get(), buf, n);
+        usb_ffs_aio_prep(aiob, i, n, false);
+        buf += n;
+        len -= n;
+        aiob->next = (i + 1) % depth;
+    }
+    return usb_ffs_aio_submit(aiob, false) ? 0 : -1;
 }
 
 static void usb_ffs_kick(usb_handle* h) {
@@ -490,6 +600,10 @@ static void usb_ffs_kick(usb_handle* h) {
     h->kicked = true;
     TEMP_FAILURE_RETRY(dup2(dummy_fd, h->bulk_out));
     TEMP_FAILURE_RETRY(dup2(dummy_fd, h->bulk_in));
+
+    // Wake the transport threads, their transfers may never complete now.
+    uint64_t kick = 1;
+    adb_write(h->kick_fd, &kick, sizeof(kick));
 }
 
 static void usb_ffs_close(usb_handle* h) {
@@ -498,8 +612,11 @@ static void usb_ffs_close(usb_handle* h) {
     h->kicked = false;
     adb_close(h->bulk_out);
     adb_close(h->bulk_in);
-    io_destroy(h->read_aiob.ctx);
-    io_destroy(h->write_aiob.ctx);
+    aio_block_close(&h->read_aiob);
+    aio_block_close(&h->write_aiob);
+
+    uint64_t kicks;
+    adb_read(h->kick_fd, &kicks, sizeof(kicks));
 
     // Notify usb_adb_open_thread to open a new connection.
     h->lock.lock();
@@ -512,6 +629,8 @@ static void usb_ffs_init() {
     D("[ usb_init - using FunctionFS ]");
 
     usb_handle* h = new usb_handle();
+    h->kick_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    CHECK_NE(h->kick_fd, -1);
 
     if (android::base::GetBoolProperty("sys.usb.ffs.aio_compat", false)) {
         // Devices on older kernels (< 3.18) will not have aio support for ffs
@@ -519,10 +638,13 @@ static void usb_ffs_init() {
         h->write = usb_ffs_write;
         h->read = usb_ffs_read;
     } else {
+        size_t depth = android::base::GetUintProperty<size_t>(
+            "sys.usb.ffs.aio_depth", USB_FFS_AIO_DEPTH, USB_FFS_AIO_DEPTH_MAX);
+        depth = std::max<size_t>(depth, 1);
         h->write = usb_ffs_aio_write;
         h->read = usb_ffs_aio_read;
-        aio_block_init(&h->read_aiob);
-        aio_block_init(&h->write_aiob);
+        aio_block_init(&h->read_aiob, depth);
+        aio_block_init(&h->write_aiob, depth);
     }
     h->kick = usb_ffs_kick;
     h->close = usb_ffs_close;
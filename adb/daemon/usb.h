@@ -18,17 +18,34 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include <asyncio/AsyncIO.h>
 
+// One USB_FFS_BULK_SIZE transfer of an aio_block ring.
+struct aio_transfer {
+    std::unique_ptr<char[]> buf;
+    bool pending = false;  // submitted and not yet reaped
+    long long result = 0;  // bytes transferred or -errno, once reaped
+    size_t offset = 0;     // bytes of a completed read already consumed
+};
+
+// A ring of transfers kept in flight on one endpoint. Transfers are submitted
+// and complete in ring order; the kernel signals event_fd for each completion.
 struct aio_block {
     std::vector<struct iocb> iocb;
-    std::vector<struct iocb*> iocbs;
+    std::vector<struct iocb*> iocbs;  // batch being submitted
     std::vector<struct io_event> events;
-    aio_context_t ctx;
-    int num_submitted;
-    int fd;
+    std::vector<aio_transfer> transfers;
+    aio_context_t ctx = 0;
+    int fd = -1;
+    int event_fd = -1;
+
+    size_t next = 0;      // oldest read or next write slot
+    bool primed = false;  // whether the read ring has been queued
+    int error = 0;        // first failed write, reported by the next write
 };
 
 struct usb_handle {
@@ -50,8 +67,11 @@ struct usb_handle {
     int bulk_out = -1; /* "out" from the host's perspective => source for adbd */
     int bulk_in = -1;  /* "in" from the host's perspective => sink for adbd */
 
-    // Access to these blocks is very not thread safe. Have one block for both the
-    // read and write threads.
+    // Signalled by kick to wake the threads waiting on aio completions.
+    int kick_fd = -1;
+
+    // Access to these blocks is very not thread safe. Have one block for each of
+    // the read and write threads.
     struct aio_block read_aiob;
     struct aio_block write_aiob;
 };
@@ -25,12 +25,17 @@
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
 #include <atomic>
 #include <deque>
 #include <functional>
 #include <list>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -49,9 +54,20 @@
 #define FDE_PENDING    0x0200
 #define FDE_CREATED    0x0400
 
+// Linux hosts and devices wait with epoll, so that an iteration costs the
+// number of ready fds rather than the number installed. Everything else uses
+// poll over every installed fd.
+#if defined(__linux__)
+#define FDEVENT_EPOLL 1
+#endif
+
 struct PollNode {
   fdevent* fde;
   adb_pollfd pollfd;
+#if defined(FDEVENT_EPOLL)
+  uint32_t epoll_events = 0;  // as registered with epoll_ctl
+  int epoll_errno = 0;        // why epoll_ctl refused the fd, if it did
+#endif
 
   explicit PollNode(fdevent* fde) : fde(fde) {
       memset(&pollfd, 0, sizeof(pollfd));
@@ -73,6 +89,12 @@ static std::atomic<bool> terminate_loop(false);
 static bool main_thread_valid;
 static unsigned long main_thread_id;
 
+#if defined(FDEVENT_EPOLL)
+static auto& g_epoll_fd = *new unique_fd();
+// Fds epoll won't watch, see fdevent_backend_install().
+static auto& g_unpollable_set = *new std::unordered_set<PollNode*>();
+#endif
+
 static auto& run_queue_notify_fd = *new unique_fd();
 static auto& run_queue_mutex = *new std::mutex();
 static auto& run_queue GUARDED_BY(run_queue_mutex) = *new std::deque<std::function<void()>>();
@@ -111,9 +133,80 @@ static std::string dump_fde(const fdevent* fde) {
     if (fde->state & FDE_DONT_CLOSE) {
         state += "D";
     }
+    if (fde->state & FDE_EDGE) {
+        state += "T";
+    }
     return android::base::StringPrintf("(fdevent %d %s)", fde->fd, state.c_str());
 }
 
+#if defined(FDEVENT_EPOLL)
+
+static int fdevent_epoll_fd() {
+    if (g_epoll_fd == -1) {
+        g_epoll_fd.reset(epoll_create1(EPOLL_CLOEXEC));
+        if (g_epoll_fd == -1) {
+            PLOG(FATAL) << "failed to create epoll fd";
+        }
+    }
+    return g_epoll_fd.get();
+}
+
+static uint32_t fdevent_epoll_events(const PollNode& node) {
+    uint32_t events = EPOLLRDHUP;
+    if (node.pollfd.events & POLLIN) {
+        events |= EPOLLIN;
+    }
+    if (node.pollfd.events & POLLOUT) {
+        events |= EPOLLOUT;
+    }
+    if (node.fde->state & FDE_EDGE) {
+        events |= EPOLLET;
+    }
+    return events;
+}
+
+static void fdevent_backend_install(PollNode* node) {
+    epoll_event ev = {};
+    ev.events = node->epoll_events = fdevent_epoll_events(*node);
+    ev.data.ptr = node;
+    if (epoll_ctl(fdevent_epoll_fd(), EPOLL_CTL_ADD, node->pollfd.fd, &ev) == -1) {
+        // epoll refuses regular files, which poll() always reports as ready,
+        // and bad fds, which poll() reports as POLLNVAL. Keep doing the same
+        // for those by checking them on every iteration.
+        node->epoll_errno = errno;
+        g_unpollable_set.insert(node);
+    }
+}
+
+static void fdevent_backend_update(PollNode* node) {
+    uint32_t events = fdevent_epoll_events(*node);
+    if (node->epoll_errno != 0 || events == node->epoll_events) {
+        return;
+    }
+    epoll_event ev = {};
+    ev.events = node->epoll_events = events;
+    ev.data.ptr = node;
+    if (epoll_ctl(fdevent_epoll_fd(), EPOLL_CTL_MOD, node->pollfd.fd, &ev) == -1) {
+        PLOG(ERROR) << "failed to update epoll events for fd " << node->pollfd.fd;
+    }
+}
+
+static void fdevent_backend_remove(PollNode* node) {
+    if (node->epoll_errno != 0) {
+        g_unpollable_set.erase(node);
+    } else if (epoll_ctl(fdevent_epoll_fd(), EPOLL_CTL_DEL, node->pollfd.fd, nullptr) == -1) {
+        D("failed to remove fd %d from epoll: %s", node->pollfd.fd, strerror(errno));
+    }
+}
+
+#else
+
+static void fdevent_backend_install(PollNode*) {}
+static void fdevent_backend_update(PollNode*) {}
+static void fdevent_backend_remove(PollNode*) {}
+
+#endif
+
 fdevent* fdevent_create(int fd, fd_func func, void* arg) {
     check_main_thread();
     fdevent *fde = (fdevent*) malloc(sizeof(fdevent));
@@ -149,6 +242,7 @@ void fdevent_install(fdevent* fde, int fd, fd_func func, void* arg) {
     }
     auto pair = g_poll_node_map.emplace(fde->fd, PollNode(fde));
     CHECK(pair.second) << "install existing fd " << fd;
+    fdevent_backend_install(&pair.first->second);
     D("fdevent_install %s", dump_fde(fde).c_str());
 }
 
@@ -156,7 +250,10 @@ void fdevent_remove(fdevent* fde) {
     check_main_thread();
     D("fdevent_remove %s", dump_fde(fde).c_str());
     if (fde->state & FDE_ACTIVE) {
-        g_poll_node_map.erase(fde->fd);
+        auto it = g_poll_node_map.find(fde->fd);
+        CHECK(it != g_poll_node_map.end());
+        fdevent_backend_remove(&it->second);
+        g_poll_node_map.erase(it);
         if (fde->state & FDE_PENDING) {
             g_pending_list.remove(fde);
         }
@@ -185,6 +282,7 @@ static void fdevent_update(fdevent* fde, unsigned events) {
         node.pollfd.events &= ~POLLOUT;
     }
     fde->state = (fde->state & FDE_STATEMASK) | events;
+    fdevent_backend_update(&node);
 }
 
 void fdevent_set(fdevent* fde, unsigned events) {
@@ -217,6 +315,79 @@ void fdevent_del(fdevent* fde, unsigned events) {
     fdevent_set(fde, (fde->state & FDE_EVENTMASK) & ~events);
 }
 
+static void fdevent_pend(fdevent* fde, unsigned events) {
+    fde->events |= events;
+    D("%s got events %x", dump_fde(fde).c_str(), events);
+    fde->state |= FDE_PENDING;
+    g_pending_list.push_back(fde);
+}
+
+#if defined(FDEVENT_EPOLL)
+
+static void fdevent_process() {
+    static auto& epoll_events = *new std::vector<epoll_event>(256);
+
+    // Don't sleep while an unpollable fd has something to report.
+    int timeout = g_unpollable_set.empty() ? -1 : 0;
+    D("epoll_wait(), %zu fds, %zu unpollable", g_poll_node_map.size(), g_unpollable_set.size());
+    int ret = epoll_wait(fdevent_epoll_fd(), epoll_events.data(), epoll_events.size(), timeout);
+    if (ret == -1) {
+        if (errno != EINTR) {
+            PLOG(ERROR) << "epoll_wait(), ret = " << ret;
+        }
+        return;
+    }
+    for (int i = 0; i < ret; ++i) {
+        PollNode* node = static_cast<PollNode*>(epoll_events[i].data.ptr);
+        uint32_t revents = epoll_events[i].events;
+        D("for fd %d, revents = %x", node->pollfd.fd, revents);
+        unsigned events = 0;
+        if (revents & EPOLLIN) {
+            events |= FDE_READ;
+        }
+        if (revents & EPOLLOUT) {
+            events |= FDE_WRITE;
+        }
+        if (revents & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+            events |= FDE_READ | FDE_ERROR;
+        }
+        if (events != 0) {
+            fdevent_pend(node->fde, events);
+        }
+    }
+    for (PollNode* node : g_unpollable_set) {
+        unsigned events = (node->epoll_errno == EBADF)
+                              ? (FDE_READ | FDE_ERROR)
+                              : (node->fde->state & (FDE_READ | FDE_WRITE));
+        if (events != 0) {
+            fdevent_pend(node->fde, events);
+        }
+    }
+}
+
+#else
+
+static unsigned fdevent_poll_events(short revents) {
+    unsigned events = 0;
+    if (revents & POLLIN) {
+        events |= FDE_READ;
+    }
+    if (revents & POLLOUT) {
+        events |= FDE_WRITE;
+    }
+    if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        // We fake a read, as the rest of the code assumes that errors will
+        // be detected at that point.
+        events |= FDE_READ | FDE_ERROR;
+    }
+#if defined(__linux__)
+    if (revents & POLLRDHUP) {
+        events |= FDE_READ | FDE_ERROR;
+    }
+#endif
+    return events;
+}
+
 static std::string dump_pollfds(const std::vector<adb_pollfd>& pollfds) {
     std::string result;
     for (const auto& pollfd : pollfds) {
@@ -248,36 +419,19 @@ static void fdevent_process() {
         if (pollfd.revents != 0) {
             D("for fd %d, revents = %x", pollfd.fd, pollfd.revents);
         }
-        unsigned events = 0;
-        if (pollfd.revents & POLLIN) {
-            events |= FDE_READ;
-        }
-        if (pollfd.revents & POLLOUT) {
-            events |= FDE_WRITE;
-        }
-        if (pollfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
-            // We fake a read, as the rest of the code assumes that errors will
-            // be detected at that point.
-            events |= FDE_READ | FDE_ERROR;
-        }
-#if defined(__linux__)
-        if (pollfd.revents & POLLRDHUP) {
-            events |= FDE_READ | FDE_ERROR;
-        }
-#endif
+        unsigned events = fdevent_poll_events(pollfd.revents);
         if (events != 0) {
             auto it = g_poll_node_map.find(pollfd.fd);
             CHECK(it != g_poll_node_map.end());
             fdevent* fde = it->second.fde;
             CHECK_EQ(fde->fd, pollfd.fd);
-            fde->events |= events;
-            D("%s got events %x", dump_fde(fde).c_str(), events);
-            fde->state |= FDE_PENDING;
-            g_pending_list.push_back(fde);
+            fdevent_pend(fde, events);
         }
     }
 }
 
+#endif
+
 static void fdevent_call_fdfunc(fdevent* fde) {
     unsigned events = fde->events;
     fde->events = 0;
@@ -390,6 +544,10 @@ size_t fdevent_installed_count() {
 void fdevent_reset() {
     g_poll_node_map.clear();
     g_pending_list.clear();
+#if defined(FDEVENT_EPOLL)
+    g_unpollable_set.clear();
+    g_epoll_fd.reset();
+#endif
 
     std::lock_guard<std::mutex> lock(run_queue_mutex);
     run_queue_notify_fd.reset();
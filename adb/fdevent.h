@@ -30,6 +30,13 @@
 /* features that may be set (via the events set/add/del interface) */
 #define FDE_DONT_CLOSE        0x0080
 
+/* Only notify when the fd becomes readable or writable, rather than for as
+** long as it stays so. The handler must then read or write until EAGAIN.
+** Backends without edge triggering (poll) ignore this, which is harmless
+** for a handler written that way.
+*/
+#define FDE_EDGE              0x0040
+
 typedef void (*fd_func)(int fd, unsigned events, void *userdata);
 
 struct fdevent {
@@ -18,6 +18,7 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <limits>
 #include <queue>
 #include <string>
@@ -229,3 +230,71 @@ TEST_F(FdeventTest, run_on_main_thread_reentrant) {
         ASSERT_EQ(i, vec[i]);
     }
 }
+
+static void IdleFdsThreadFunc(ThreadArg* arg, std::vector<int>* idle_fds) {
+    std::vector<std::unique_ptr<fdevent>> idle_fdes;
+    for (int fd : *idle_fds) {
+        idle_fdes.push_back(std::make_unique<fdevent>());
+        fdevent_install(idle_fdes.back().get(), fd, [](int, unsigned, void*) { FAIL(); }, nullptr);
+        fdevent_add(idle_fdes.back().get(), FDE_READ);
+    }
+
+    FdHandler handler(arg->first_read_fd, arg->last_write_fd);
+    fdevent_loop();
+
+    for (auto& fde : idle_fdes) {
+        fdevent_remove(fde.get());
+    }
+}
+
+// Not a pass/fail test: reports the cost of a round trip through the loop
+// while it also watches many idle sockets, which is what an adb server
+// with lots of devices, forwards and shells looks like.
+TEST_F(FdeventTest, benchmark_round_trip_idle_fds) {
+    const size_t IDLE_FD_COUNT = 400;
+    const size_t ROUND_TRIP_COUNT = 10000;
+
+    std::vector<int> idle_fds;
+    std::vector<int> idle_peers;
+    for (size_t i = 0; i < IDLE_FD_COUNT; ++i) {
+        int fds[2];
+        ASSERT_EQ(0, adb_socketpair(fds));
+        idle_fds.push_back(fds[0]);
+        idle_peers.push_back(fds[1]);
+    }
+
+    int fd_pair1[2];
+    int fd_pair2[2];
+    ASSERT_EQ(0, adb_socketpair(fd_pair1));
+    ASSERT_EQ(0, adb_socketpair(fd_pair2));
+    ThreadArg thread_arg;
+    thread_arg.first_read_fd = fd_pair1[0];
+    thread_arg.last_write_fd = fd_pair2[1];
+    thread_arg.middle_pipe_count = 0;
+    int writer = fd_pair1[1];
+    int reader = fd_pair2[0];
+
+    PrepareThread();
+    std::thread thread(IdleFdsThreadFunc, &thread_arg, &idle_fds);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+        char c = static_cast<char>(i);
+        ASSERT_TRUE(WriteFdExactly(writer, &c, 1));
+        ASSERT_TRUE(ReadFdExactly(reader, &c, 1));
+        ASSERT_EQ(static_cast<char>(i), c);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    TerminateThread(thread);
+    printf("%zu round trips with %zu idle fds: %lld ns each\n", ROUND_TRIP_COUNT, IDLE_FD_COUNT,
+           static_cast<long long>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+               ROUND_TRIP_COUNT));
+
+    ASSERT_EQ(0, adb_close(writer));
+    ASSERT_EQ(0, adb_close(reader));
+    for (int fd : idle_peers) {
+        ASSERT_EQ(0, adb_close(fd));
+    }
+}
@@ -27,10 +27,12 @@
 #include <utime.h>
 
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "sysdeps.h"
@@ -78,6 +80,7 @@ struct copyinfo {
     uint32_t mode;
     uint64_t size = 0;
     bool skip = false;
+    bool delta = false;  // A regular file is already at rpath.
 
     copyinfo(const std::string& local_path,
              const std::string& remote_path,
@@ -198,7 +201,7 @@ struct TransferLedger {
 
 class SyncConnection {
   public:
-    SyncConnection() : expect_done_(false) {
+    SyncConnection() {
         max = SYNC_DATA_MAX; // TODO: decide at runtime.
 
         std::string error;
@@ -208,6 +211,10 @@ class SyncConnection {
             Error("failed to get feature set: %s", error.c_str());
         } else {
             have_stat_v2_ = CanUseFeature(features, kFeatureStat2);
+            have_delta_ = CanUseFeature(features, kFeatureSyncDelta);
+            if (CanUseFeature(features, kFeatureSyncLz4)) {
+                lz4_buffer_.resize(SYNC_DATA_MAX);
+            }
             fd = adb_connect("sync:", &error);
             if (fd < 0) {
                 Error("connect failed: %s", error.c_str());
@@ -234,6 +241,11 @@ class SyncConnection {
 
     bool IsValid() { return fd >= 0; }
 
+    bool HaveDelta() { return have_delta_; }
+
+    // Scratch space for ID_CDAT payloads, null unless the device takes them.
+    char* Lz4Buffer() { return lz4_buffer_.empty() ? nullptr : &lz4_buffer_[0]; }
+
     bool ReceivedError(const char* from, const char* to) {
         adb_pollfd pfd = {.fd = fd, .events = POLLIN};
         int rc = adb_poll(&pfd, 1, 0);
@@ -303,10 +315,13 @@ class SyncConnection {
             errno = ENOTSUP;
             return false;
         }
+        // Responses come back in order, so collect the outstanding ID_OKAYs first.
+        if (!ReadAcknowledgements()) return false;
         return SendRequest(ID_STAT_V2, path_and_mode);
     }
 
     bool SendLstat(const char* path_and_mode) {
+        if (!ReadAcknowledgements()) return false;
         if (have_stat_v2_) {
             return SendRequest(ID_LSTAT_V2, path_and_mode);
         } else {
@@ -374,7 +389,7 @@ class SyncConnection {
     bool SendSmallFile(const char* path_and_mode,
                        const char* lpath, const char* rpath,
                        unsigned mtime,
-                       const char* data, size_t data_length) {
+                       const char* data, size_t data_length, bool compress) {
         size_t path_length = strlen(path_and_mode);
         if (path_length > 1024) {
             Error("SendSmallFile failed: path too long: %zu", path_length);
@@ -382,8 +397,21 @@ class SyncConnection {
             return false;
         }
 
+        // Symlink targets always go out as ID_DATA.
+        uint32_t data_id = ID_DATA;
+        const char* payload = data;
+        size_t payload_length = data_length;
+        if (compress && Lz4Buffer()) {
+            size_t compressed = SyncCompress(data, data_length, Lz4Buffer());
+            if (compressed) {
+                data_id = ID_CDAT;
+                payload = Lz4Buffer();
+                payload_length = compressed;
+            }
+        }
+
         std::vector<char> buf(sizeof(SyncRequest) + path_length +
-                              sizeof(SyncRequest) + data_length +
+                              sizeof(SyncRequest) + payload_length +
                               sizeof(SyncRequest));
         char* p = &buf[0];
 
@@ -395,11 +423,11 @@ class SyncConnection {
         p += path_length;
 
         SyncRequest* req_data = reinterpret_cast<SyncRequest*>(p);
-        req_data->id = ID_DATA;
-        req_data->path_length = data_length;
+        req_data->id = data_id;
+        req_data->path_length = payload_length;
         p += sizeof(SyncRequest);
-        memcpy(p, data, data_length);
-        p += data_length;
+        memcpy(p, payload, payload_length);
+        p += payload_length;
 
         SyncRequest* req_done = reinterpret_cast<SyncRequest*>(p);
         req_done->id = ID_DONE;
@@ -407,7 +435,7 @@ class SyncConnection {
         p += sizeof(SyncRequest);
 
         WriteOrDie(lpath, rpath, &buf[0], (p - &buf[0]));
-        expect_done_ = true;
+        deferred_acknowledgements_.emplace_back(lpath, rpath);
 
         // RecordFilesTransferred gets called in CopyDone.
         RecordBytesTransferred(data_length);
@@ -418,6 +446,10 @@ class SyncConnection {
     bool SendLargeFile(const char* path_and_mode,
                        const char* lpath, const char* rpath,
                        unsigned mtime) {
+        // ReceivedError() below would mistake an earlier file's ID_OKAY for
+        // a failure, and nothing is gained from pipelining a large file.
+        if (!ReadAcknowledgements()) return false;
+
         if (!SendRequest(ID_SEND, path_and_mode)) {
             Error("failed to send ID_SEND message '%s': %s", path_and_mode, strerror(errno));
             return false;
@@ -439,7 +471,6 @@ class SyncConnection {
         }
 
         syncsendbuf sbuf;
-        sbuf.id = ID_DATA;
         while (true) {
             int bytes_read = adb_read(lfd, sbuf.data, max - sizeof(SyncRequest));
             if (bytes_read == -1) {
@@ -450,8 +481,7 @@ class SyncConnection {
                 break;
             }
 
-            sbuf.size = bytes_read;
-            WriteOrDie(lpath, rpath, &sbuf, sizeof(SyncRequest) + bytes_read);
+            SendDataChunk(lpath, rpath, &sbuf, bytes_read);
 
             RecordBytesTransferred(bytes_read);
             bytes_copied += bytes_read;
@@ -469,10 +499,221 @@ class SyncConnection {
         syncmsg msg;
         msg.data.id = ID_DONE;
         msg.data.size = mtime;
-        expect_done_ = true;
+        WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+        deferred_acknowledgements_.emplace_back(lpath, rpath);
+
+        // RecordFilesTransferred gets called in CopyDone.
+        return true;
+    }
+
+    // Replaces a file the device already has by sending only the parts of
+    // lpath that aren't whole blocks of the old file, see ID_SEND_DELTA.
+    bool SendDeltaFile(const char* path_and_mode,
+                       const char* lpath, const char* rpath,
+                       unsigned mtime) {
+        // The ID_SIGS reply has to be next on the wire.
+        if (!ReadAcknowledgements()) return false;
+
+        if (!SendRequest(ID_SEND_DELTA, path_and_mode)) {
+            Error("failed to send ID_SEND_DELTA message '%s': %s", path_and_mode, strerror(errno));
+            return false;
+        }
+
+        // ID_FAIL is shorter than ID_SIGS, so only read the part they share first.
+        syncmsg msg;
+        if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
+            Error("failed to copy '%s' to '%s': couldn't read signatures", lpath, rpath);
+            return false;
+        }
+        if (msg.status.id == ID_FAIL) return ReportCopyFailure(lpath, rpath, msg);
+        if (msg.sigs.id != ID_SIGS ||
+            !ReadFdExactly(fd, &msg.sigs.count, sizeof(msg.sigs.count))) {
+            Error("failed to copy '%s' to '%s': bad signatures", lpath, rpath);
+            return false;
+        }
+
+        size_t block_size = msg.sigs.block_size;
+        if (msg.sigs.count != 0 && (block_size == 0 || block_size > SYNC_DATA_MAX)) {
+            Error("failed to copy '%s' to '%s': bad block size %zu", lpath, rpath, block_size);
+            return false;
+        }
+        std::vector<SyncBlockSignature> signatures(msg.sigs.count);
+        if (!ReadFdExactly(fd, signatures.data(),
+                           signatures.size() * sizeof(SyncBlockSignature))) {
+            Error("failed to copy '%s' to '%s': couldn't read signatures", lpath, rpath);
+            return false;
+        }
+
+        std::unordered_multimap<uint32_t, uint32_t> blocks(signatures.size());
+        for (uint32_t i = 0; i < signatures.size(); ++i) {
+            uint32_t weak = signatures[i].weak;
+            blocks.emplace(weak, i);
+        }
+
+        struct stat st;
+        if (stat(lpath, &st) == -1) {
+            Error("cannot stat '%s': %s", lpath, strerror(errno));
+            return false;
+        }
+
+        int lfd = adb_open(lpath, O_RDONLY);
+        if (lfd < 0) {
+            Error("opening '%s' locally failed: %s", lpath, strerror(errno));
+            return false;
+        }
+
+        // buffer[literal, window) has matched nothing and still has to be sent,
+        // buffer[window, end) is read but not yet looked at. Literal runs are
+        // flushed before they reach a full data message, so a block's worth of
+        // lookahead plus one read always fit behind them.
+        size_t max_literal = max - sizeof(SyncRequest);
+        std::vector<char> buffer(max_literal + block_size + max);
+        size_t literal = 0, window = 0, end = 0;
+        bool eof = false;
+        uint32_t weak = 0;
+        bool have_weak = false;
+        SyncCopy run = {0, 0};
+        syncsendbuf sbuf;
+        uint64_t total_size = st.st_size;
+        uint64_t bytes_copied = 0;
+
+        auto flush_run = [&]() {
+            if (run.count == 0) return;
+            char copy[sizeof(SyncRequest) + sizeof(SyncCopy)];
+            SyncRequest* req = reinterpret_cast<SyncRequest*>(copy);
+            req->id = ID_COPY;
+            req->path_length = sizeof(SyncCopy);
+            memcpy(req + 1, &run, sizeof(run));
+            WriteOrDie(lpath, rpath, copy, sizeof(copy));
+            run.count = 0;
+        };
+        auto flush_literal = [&](size_t to) {
+            if (to == literal) return;
+            flush_run();
+            memcpy(sbuf.data, &buffer[literal], to - literal);
+            SendDataChunk(lpath, rpath, &sbuf, to - literal);
+            literal = to;
+        };
+
+        bool failed = false;
+        while (true) {
+            if (!eof && end - window <= block_size) {
+                memmove(&buffer[0], &buffer[literal], end - literal);
+                window -= literal;
+                end -= literal;
+                literal = 0;
+                while (!eof && end - window <= block_size) {
+                    int bytes_read = adb_read(lfd, &buffer[end], buffer.size() - end);
+                    if (bytes_read == -1) {
+                        Error("reading '%s' locally failed: %s", lpath, strerror(errno));
+                        adb_close(lfd);
+                        return false;
+                    }
+                    eof = (bytes_read == 0);
+                    end += bytes_read;
+                }
+            }
+
+            if (signatures.empty() || end - window < block_size) {
+                // Too little left to match a block: the remainder is literal.
+                size_t before = window;
+                window = std::min(end, literal + max_literal);
+                RecordBytesTransferred(window - before);
+                bytes_copied += window - before;
+                flush_literal(window);
+                if (window == end && eof) break;
+            } else {
+                if (!have_weak) {
+                    weak = SyncWeakChecksum(&buffer[window], block_size);
+                    have_weak = true;
+                }
+
+                bool matched = false;
+                uint32_t index = 0;
+                uint8_t strong[sizeof(SyncBlockSignature::strong)];
+                bool have_strong = false;
+                auto candidates = blocks.equal_range(weak);
+                for (auto it = candidates.first; it != candidates.second; ++it) {
+                    if (!have_strong) {
+                        SyncStrongChecksum(&buffer[window], block_size, strong);
+                        have_strong = true;
+                    }
+                    if (memcmp(strong, signatures[it->second].strong, sizeof(strong)) == 0) {
+                        matched = true;
+                        index = it->second;
+                        break;
+                    }
+                }
+
+                if (matched) {
+                    flush_literal(window);
+                    if (run.count != 0 && run.index + run.count != index) flush_run();
+                    if (run.count == 0) run.index = index;
+                    ++run.count;
+                    window += block_size;
+                    literal = window;
+                    have_weak = false;
+                    RecordBytesTransferred(block_size);
+                    bytes_copied += block_size;
+                    // Check in with the device only now and then during a long run of matches.
+                    if (run.count % 16 != 0) continue;
+                } else {
+                    if (window + block_size < end) {
+                        weak = SyncRollChecksum(weak, block_size, buffer[window],
+                                                buffer[window + block_size]);
+                    } else {
+                        have_weak = false;
+                    }
+                    ++window;
+                    RecordBytesTransferred(1);
+                    ++bytes_copied;
+                    if (window - literal < max_literal) continue;
+                    flush_literal(window);
+                }
+            }
+
+            // Check to see if we've received an error from the other side.
+            if (ReceivedError(lpath, rpath)) {
+                failed = true;
+                break;
+            }
+
+            ReportProgress(rpath, bytes_copied, total_size);
+        }
+        if (!failed) flush_run();
+
+        adb_close(lfd);
+
+        msg.data.id = ID_DONE;
+        msg.data.size = mtime;
+        WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+        deferred_acknowledgements_.emplace_back(lpath, rpath);
 
         // RecordFilesTransferred gets called in CopyDone.
-        return WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+        return true;
+    }
+
+    // The device handles sync requests in order, so files can be sent without
+    // waiting for each to be acknowledged. Reads acknowledgements until no
+    // more than 'keep' files are outstanding; on failure the device closes
+    // the connection and the rest are abandoned.
+    bool ReadAcknowledgements(size_t keep = 0) {
+        while (deferred_acknowledgements_.size() > keep) {
+            std::pair<std::string, std::string> files =
+                std::move(deferred_acknowledgements_.front());
+            deferred_acknowledgements_.pop_front();
+            if (!CopyDone(files.first.c_str(), files.second.c_str())) {
+                deferred_acknowledgements_.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Called after each file, bounding how many ID_OKAYs the device may have
+    // to buffer while we are busy writing.
+    bool ReadExcessAcknowledgements() {
+        return ReadAcknowledgements(kMaxDeferredAcknowledgements);
     }
 
     bool CopyDone(const char* from, const char* to) {
@@ -482,14 +723,8 @@ class SyncConnection {
             return false;
         }
         if (msg.status.id == ID_OKAY) {
-            if (expect_done_) {
-                expect_done_ = false;
-                RecordFilesTransferred(1);
-                return true;
-            } else {
-                Error("failed to copy '%s' to '%s': received premature success", from, to);
-                return true;
-            }
+            RecordFilesTransferred(1);
+            return true;
         }
         if (msg.status.id != ID_FAIL) {
             Error("failed to copy '%s' to '%s': unknown reason %d", from, to, msg.status.id);
@@ -576,8 +811,32 @@ class SyncConnection {
     size_t max;
 
   private:
-    bool expect_done_;
+    static constexpr size_t kMaxDeferredAcknowledgements = 64;
+
+    // Sends sbuf's first length bytes as ID_CDAT if that's smaller, else ID_DATA.
+    void SendDataChunk(const char* lpath, const char* rpath, syncsendbuf* sbuf, size_t length) {
+        size_t compressed = 0;
+        if (Lz4Buffer()) {
+            compressed = SyncCompress(sbuf->data, length, Lz4Buffer());
+        }
+        if (compressed) {
+            syncmsg msg;
+            msg.data.id = ID_CDAT;
+            msg.data.size = compressed;
+            WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+            WriteOrDie(lpath, rpath, Lz4Buffer(), compressed);
+        } else {
+            sbuf->id = ID_DATA;
+            sbuf->size = length;
+            WriteOrDie(lpath, rpath, sbuf, sizeof(SyncRequest) + length);
+        }
+    }
+
+    // Files sent but not yet acknowledged, as (local, remote), oldest first.
+    std::deque<std::pair<std::string, std::string>> deferred_acknowledgements_;
     bool have_stat_v2_;
+    bool have_delta_;
+    std::vector<char> lz4_buffer_;
 
     TransferLedger global_ledger_;
     TransferLedger current_ledger_;
@@ -591,9 +850,12 @@ class SyncConnection {
         if (!WriteFdExactly(fd, data, data_length)) {
             if (errno == ECONNRESET) {
                 // Assume adbd told us why it was closing the connection, and
-                // try to read failure reason from adbd.
+                // try to read failure reason from adbd. If earlier files are
+                // unacknowledged, the failure is queued behind their ID_OKAYs.
                 syncmsg msg;
-                if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
+                if (!deferred_acknowledgements_.empty()) {
+                    ReadAcknowledgements();
+                } else if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
                     Error("failed to copy '%s' to '%s': no response: %s", from, to, strerror(errno));
                 } else if (msg.status.id != ID_FAIL) {
                     Error("failed to copy '%s' to '%s': not ID_FAIL: %d", from, to, msg.status.id);
@@ -674,8 +936,9 @@ static bool sync_stat_fallback(SyncConnection& sc, const char* path, struct stat
     return true;
 }
 
+// With delta, rpath is known to be a regular file the device can diff against.
 static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath, unsigned mtime,
-                      mode_t mode, bool sync) {
+                      mode_t mode, bool sync, bool delta) {
     std::string path_and_mode = android::base::StringPrintf("%s,%d", rpath, mode);
 
     if (sync) {
@@ -687,6 +950,7 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
                 sc.RecordFilesSkipped(1);
                 return true;
             }
+            delta = S_ISREG(st.st_mode);
         }
     }
 
@@ -700,10 +964,11 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
         }
         buf[data_length++] = '\0';
 
-        if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime, buf, data_length)) {
+        if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime, buf, data_length,
+                              false)) {
             return false;
         }
-        return sc.CopyDone(lpath, rpath);
+        return sc.ReadExcessAcknowledgements();
 #endif
     }
 
@@ -719,7 +984,11 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
             return false;
         }
         if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime,
-                              data.data(), data.size())) {
+                              data.data(), data.size(), true)) {
+            return false;
+        }
+    } else if (delta && S_ISREG(mode) && sc.HaveDelta()) {
+        if (!sc.SendDeltaFile(path_and_mode.c_str(), lpath, rpath, mtime)) {
             return false;
         }
     } else {
@@ -727,12 +996,12 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
             return false;
         }
     }
-    return sc.CopyDone(lpath, rpath);
+    return sc.ReadExcessAcknowledgements();
 }
 
 static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
                       const char* name, uint64_t expected_size) {
-    if (!sc.SendRequest(ID_RECV, rpath)) return false;
+    if (!sc.SendRequest(sc.Lz4Buffer() ? ID_RECV_LZ4 : ID_RECV, rpath)) return false;
 
     adb_unlink(lpath);
     int lfd = adb_creat(lpath, 0644);
@@ -752,7 +1021,7 @@ static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
 
         if (msg.data.id == ID_DONE) break;
 
-        if (msg.data.id != ID_DATA) {
+        if (msg.data.id != ID_DATA && (msg.data.id != ID_CDAT || !sc.Lz4Buffer())) {
             adb_close(lfd);
             adb_unlink(lpath);
             sc.ReportCopyFailure(rpath, lpath, msg);
@@ -773,16 +1042,29 @@ static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
             return false;
         }
 
-        if (!WriteFdExactly(lfd, buffer, msg.data.size)) {
+        const char* data = buffer;
+        ssize_t size = msg.data.size;
+        if (msg.data.id == ID_CDAT) {
+            size = SyncDecompress(buffer, msg.data.size, sc.Lz4Buffer());
+            if (size < 0) {
+                sc.Error("corrupt compressed data from device");
+                adb_close(lfd);
+                adb_unlink(lpath);
+                return false;
+            }
+            data = sc.Lz4Buffer();
+        }
+
+        if (!WriteFdExactly(lfd, data, size)) {
             sc.Error("cannot write '%s': %s", lpath, strerror(errno));
             adb_close(lfd);
             adb_unlink(lpath);
             return false;
         }
 
-        bytes_copied += msg.data.size;
+        bytes_copied += size;
 
-        sc.RecordBytesTransferred(msg.data.size);
+        sc.RecordBytesTransferred(size);
         sc.ReportProgress(name != nullptr ? name : rpath, bytes_copied, expected_size);
     }
 
@@ -886,13 +1168,18 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
     }
 
     if (check_timestamps) {
-        for (const copyinfo& ci : file_list) {
-            if (!sc.SendLstat(ci.rpath.c_str())) {
-                sc.Error("failed to send lstat");
-                return false;
+        // Keep a bounded window of lstats in flight, so that the device is
+        // never blocked writing responses while we are blocked writing requests.
+        static constexpr size_t kMaxOutstandingStats = 256;
+        size_t sent = 0;
+        for (size_t i = 0; i < file_list.size(); ++i) {
+            for (; sent < file_list.size() && (sent - i) < kMaxOutstandingStats; ++sent) {
+                if (!sc.SendLstat(file_list[sent].rpath.c_str())) {
+                    sc.Error("failed to send lstat");
+                    return false;
+                }
             }
-        }
-        for (copyinfo& ci : file_list) {
+            copyinfo& ci = file_list[i];
             struct stat st;
             if (sc.FinishStat(&st)) {
                 if (st.st_size == static_cast<off_t>(ci.size)) {
@@ -902,6 +1189,7 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
                         ci.skip = true;
                     }
                 }
+                ci.delta = S_ISREG(st.st_mode);
             }
         }
     }
@@ -913,7 +1201,8 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
             if (list_only) {
                 sc.Println("would push: %s -> %s", ci.lpath.c_str(), ci.rpath.c_str());
             } else {
-                if (!sync_send(sc, ci.lpath.c_str(), ci.rpath.c_str(), ci.time, ci.mode, false)) {
+                if (!sync_send(sc, ci.lpath.c_str(), ci.rpath.c_str(), ci.time, ci.mode, false,
+                               ci.delta)) {
                     return false;
                 }
             }
@@ -922,6 +1211,8 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
         }
     }
 
+    if (!sc.ReadAcknowledgements()) return false;
+
     sc.RecordFilesSkipped(skipped);
     sc.ReportTransferRate(lpath, TransferDirection::push);
     return true;
@@ -1013,7 +1304,8 @@ bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sy
 
         sc.NewTransfer();
         sc.SetExpectedTotalBytes(st.st_size);
-        success &= sync_send(sc, src_path, dst_path, st.st_mtime, st.st_mode, sync);
+        success &= sync_send(sc, src_path, dst_path, st.st_mtime, st.st_mode, sync, false);
+        success &= sc.ReadAcknowledgements();
         sc.ReportTransferRate(src_path, TransferDirection::push);
     }
 
@@ -202,8 +202,31 @@ static bool SendSyncFailErrno(int fd, const std::string& reason) {
     return SendSyncFail(fd, StringPrintf("%s: %s", reason.c_str(), strerror(errno)));
 }
 
+// The existing file an ID_SEND_DELTA is assembled against. path is written
+// in its stead and renamed over target once complete.
+struct DeltaBasis {
+    int fd;
+    uint32_t block_size;
+    uint32_t count;
+    std::string target;
+};
+
+static bool copy_basis_blocks(int fd, const DeltaBasis& basis, const SyncCopy& copy,
+                              std::vector<char>& buffer) {
+    for (uint32_t i = 0; i < copy.count; ++i) {
+        off64_t offset = static_cast<off64_t>(copy.index + i) * basis.block_size;
+        if (!android::base::ReadFullyAtOffset(basis.fd, &buffer[0], basis.block_size, offset) ||
+            !WriteFdExactly(fd, &buffer[0], basis.block_size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint64_t capabilities,
-                             mode_t mode, std::vector<char>& buffer, bool do_unlink) {
+                             mode_t mode, std::vector<char>& buffer,
+                             std::vector<char>& lz4_buffer, bool do_unlink,
+                             const DeltaBasis* basis = nullptr) {
     syncmsg msg;
     unsigned int timestamp = 0;
 
@@ -247,7 +270,8 @@ static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint
     while (true) {
         if (!ReadFdExactly(s, &msg.data, sizeof(msg.data))) goto fail;
 
-        if (msg.data.id != ID_DATA) {
+        if (msg.data.id != ID_DATA && msg.data.id != ID_CDAT &&
+            !(basis && msg.data.id == ID_COPY)) {
             if (msg.data.id == ID_DONE) {
                 timestamp = msg.data.size;
                 break;
@@ -263,7 +287,36 @@ static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint
 
         if (!ReadFdExactly(s, &buffer[0], msg.data.size)) goto abort;
 
-        if (!WriteFdExactly(fd, &buffer[0], msg.data.size)) {
+        if (msg.data.id == ID_COPY) {
+            SyncCopy copy;
+            if (msg.data.size != sizeof(copy)) {
+                SendSyncFail(s, "invalid copy message");
+                goto abort;
+            }
+            memcpy(&copy, &buffer[0], sizeof(copy));
+            if (static_cast<uint64_t>(copy.index) + copy.count > basis->count) {
+                SendSyncFail(s, "copy message out of range");
+                goto abort;
+            }
+            if (!copy_basis_blocks(fd, *basis, copy, lz4_buffer)) {
+                SendSyncFailErrno(s, "copy failed");
+                goto fail;
+            }
+            continue;
+        }
+
+        const char* data = &buffer[0];
+        ssize_t size = msg.data.size;
+        if (msg.data.id == ID_CDAT) {
+            size = SyncDecompress(&buffer[0], msg.data.size, &lz4_buffer[0]);
+            if (size < 0) {
+                SendSyncFail(s, "corrupt compressed data message");
+                goto abort;
+            }
+            data = &lz4_buffer[0];
+        }
+
+        if (!WriteFdExactly(fd, data, size)) {
             SendSyncFailErrno(s, "write failed");
             goto fail;
         }
@@ -281,6 +334,15 @@ static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint
     u.modtime = timestamp;
     utime(path, &u);
 
+    if (basis) {
+        if (rename(path, basis->target.c_str()) == -1) {
+            SendSyncFailErrno(s, "rename failed");
+            adb_unlink(path);
+            return false;
+        }
+        selinux_android_restorecon(basis->target.c_str(), 0);
+    }
+
     msg.status.id = ID_OKAY;
     msg.status.msglen = 0;
     return WriteFdExactly(s, &msg.status, sizeof(msg.status));
@@ -297,7 +359,7 @@ fail:
 
         if (msg.data.id == ID_DONE) {
             break;
-        } else if (msg.data.id != ID_DATA) {
+        } else if (msg.data.id != ID_DATA && msg.data.id != ID_CDAT && msg.data.id != ID_COPY) {
             char id[5];
             memcpy(id, &msg.data.id, sizeof(msg.data.id));
             id[4] = '\0';
@@ -370,7 +432,91 @@ static bool handle_send_link(int s, const std::string& path, std::vector<char>&
 }
 #endif
 
-static bool do_send(int s, const std::string& spec, std::vector<char>& buffer) {
+// Sends the ID_SIGS reply to an ID_SEND_DELTA, describing the file at path
+// if there is a regular one there to use as a basis. basis->fd is left open
+// for the caller to close when there is.
+static bool send_signatures(int s, const std::string& path, std::vector<char>& buffer,
+                            DeltaBasis* basis) {
+    basis->fd = -1;
+    basis->block_size = 0;
+    basis->count = 0;
+    basis->target = path;
+
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        basis->fd = adb_open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (basis->fd >= 0) {
+        basis->block_size = SyncDeltaBlockSize(st.st_size);
+        basis->count = st.st_size / basis->block_size;
+        if (posix_fadvise(basis->fd, 0, 0, POSIX_FADV_SEQUENTIAL) < 0) {
+            D("[ Failed to fadvise: %d ]", errno);
+        }
+    }
+
+    std::vector<SyncBlockSignature> signatures(basis->count);
+    for (uint32_t i = 0; i < basis->count; ++i) {
+        if (!android::base::ReadFully(basis->fd, &buffer[0], basis->block_size)) {
+            // Shrunk under us; whatever was signed so far is still usable.
+            D("sync: basis '%s' short after %u blocks", path.c_str(), i);
+            basis->count = i;
+            signatures.resize(i);
+            break;
+        }
+        signatures[i].weak = SyncWeakChecksum(&buffer[0], basis->block_size);
+        SyncStrongChecksum(&buffer[0], basis->block_size, signatures[i].strong);
+    }
+
+    syncmsg msg;
+    msg.sigs.id = ID_SIGS;
+    msg.sigs.block_size = basis->block_size;
+    msg.sigs.count = basis->count;
+    return WriteFdExactly(s, &msg.sigs, sizeof(msg.sigs)) &&
+           WriteFdExactly(s, signatures.data(), signatures.size() * sizeof(SyncBlockSignature));
+}
+
+static void file_send_attributes(const std::string& path, mode_t* mode, uid_t* uid, gid_t* gid,
+                                 uint64_t* capabilities) {
+    // Copy user permission bits to "group" and "other" permissions.
+    *mode &= 0777;
+    *mode |= ((*mode >> 3) & 0070);
+    *mode |= ((*mode >> 3) & 0007);
+
+    *uid = -1;
+    *gid = -1;
+    *capabilities = 0;
+    if (should_use_fs_config(path)) {
+        unsigned int broken_api_hack = *mode;
+        fs_config(path.c_str(), 0, nullptr, uid, gid, &broken_api_hack, capabilities);
+        *mode = broken_api_hack;
+    }
+}
+
+static bool do_send_delta(int s, const std::string& path, mode_t mode, std::vector<char>& buffer,
+                          std::vector<char>& lz4_buffer) {
+    DeltaBasis basis;
+    if (!send_signatures(s, path, buffer, &basis)) {
+        if (basis.fd >= 0) adb_close(basis.fd);
+        return false;
+    }
+
+    // The new file is assembled beside the old one, which must stay readable
+    // until the last ID_COPY.
+    std::string temp_path = StringPrintf("%s.adb-delta-%d", path.c_str(), getpid());
+    adb_unlink(temp_path.c_str());
+
+    uid_t uid;
+    gid_t gid;
+    uint64_t capabilities;
+    file_send_attributes(path, &mode, &uid, &gid, &capabilities);
+    bool result = handle_send_file(s, temp_path.c_str(), uid, gid, capabilities, mode, buffer,
+                                   lz4_buffer, true, &basis);
+    if (basis.fd >= 0) adb_close(basis.fd);
+    return result;
+}
+
+static bool do_send(int s, const std::string& spec, std::vector<char>& buffer,
+                    std::vector<char>& lz4_buffer, bool delta) {
     // 'spec' is of the form "/some/path,0755". Break it up.
     size_t comma = spec.find_last_of(',');
     if (comma == std::string::npos) {
@@ -387,6 +533,14 @@ static bool do_send(int s, const std::string& spec, std::vector<char>& buffer) {
         return false;
     }
 
+    if (delta) {
+        if (!S_ISREG(mode)) {
+            SendSyncFail(s, "ID_SEND_DELTA of a non-regular file");
+            return false;
+        }
+        return do_send_delta(s, path, mode, buffer, lz4_buffer);
+    }
+
     // Don't delete files before copying if they are not "regular" or symlinks.
     struct stat st;
     bool do_unlink = (lstat(path.c_str(), &st) == -1) || S_ISREG(st.st_mode) || S_ISLNK(st.st_mode);
@@ -398,23 +552,16 @@ static bool do_send(int s, const std::string& spec, std::vector<char>& buffer) {
         return handle_send_link(s, path.c_str(), buffer);
     }
 
-    // Copy user permission bits to "group" and "other" permissions.
-    mode &= 0777;
-    mode |= ((mode >> 3) & 0070);
-    mode |= ((mode >> 3) & 0007);
-
-    uid_t uid = -1;
-    gid_t gid = -1;
-    uint64_t capabilities = 0;
-    if (should_use_fs_config(path)) {
-        unsigned int broken_api_hack = mode;
-        fs_config(path.c_str(), 0, nullptr, &uid, &gid, &broken_api_hack, &capabilities);
-        mode = broken_api_hack;
-    }
-    return handle_send_file(s, path.c_str(), uid, gid, capabilities, mode, buffer, do_unlink);
+    uid_t uid;
+    gid_t gid;
+    uint64_t capabilities;
+    file_send_attributes(path, &mode, &uid, &gid, &capabilities);
+    return handle_send_file(s, path.c_str(), uid, gid, capabilities, mode, buffer, lz4_buffer,
+                            do_unlink);
 }
 
-static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
+static bool do_recv(int s, const char* path, std::vector<char>& buffer,
+                    std::vector<char>* lz4_buffer) {
     __android_log_security_bswrite(SEC_TAG_ADB_RECV_FILE, path);
 
     int fd = adb_open(path, O_RDONLY | O_CLOEXEC);
@@ -428,7 +575,6 @@ static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
     }
 
     syncmsg msg;
-    msg.data.id = ID_DATA;
     while (true) {
         int r = adb_read(fd, &buffer[0], buffer.size() - sizeof(msg.data));
         if (r <= 0) {
@@ -437,8 +583,19 @@ static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
             adb_close(fd);
             return false;
         }
+        const char* data = &buffer[0];
+        msg.data.id = ID_DATA;
         msg.data.size = r;
-        if (!WriteFdExactly(s, &msg.data, sizeof(msg.data)) || !WriteFdExactly(s, &buffer[0], r)) {
+        if (lz4_buffer) {
+            size_t compressed = SyncCompress(&buffer[0], r, &(*lz4_buffer)[0]);
+            if (compressed) {
+                data = &(*lz4_buffer)[0];
+                msg.data.id = ID_CDAT;
+                msg.data.size = compressed;
+            }
+        }
+        if (!WriteFdExactly(s, &msg.data, sizeof(msg.data)) ||
+            !WriteFdExactly(s, data, msg.data.size)) {
             adb_close(fd);
             return false;
         }
@@ -463,8 +620,12 @@ static const char* sync_id_to_name(uint32_t id) {
       return "list";
     case ID_SEND:
       return "send";
+    case ID_SEND_DELTA:
+      return "send_delta";
     case ID_RECV:
       return "recv";
+    case ID_RECV_LZ4:
+      return "recv_lz4";
     case ID_QUIT:
         return "quit";
     default:
@@ -472,7 +633,8 @@ static const char* sync_id_to_name(uint32_t id) {
   }
 }
 
-static bool handle_sync_command(int fd, std::vector<char>& buffer) {
+static bool handle_sync_command(int fd, std::vector<char>& buffer,
+                                std::vector<char>& lz4_buffer) {
     D("sync: waiting for request");
 
     ATRACE_CALL();
@@ -510,10 +672,16 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
             if (!do_list(fd, name)) return false;
             break;
         case ID_SEND:
-            if (!do_send(fd, name, buffer)) return false;
+            if (!do_send(fd, name, buffer, lz4_buffer, false)) return false;
+            break;
+        case ID_SEND_DELTA:
+            if (!do_send(fd, name, buffer, lz4_buffer, true)) return false;
             break;
         case ID_RECV:
-            if (!do_recv(fd, name, buffer)) return false;
+            if (!do_recv(fd, name, buffer, nullptr)) return false;
+            break;
+        case ID_RECV_LZ4:
+            if (!do_recv(fd, name, buffer, &lz4_buffer)) return false;
             break;
         case ID_QUIT:
             return false;
@@ -527,8 +695,9 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
 
 void file_sync_service(int fd, void*) {
     std::vector<char> buffer(SYNC_DATA_MAX);
+    std::vector<char> lz4_buffer(SYNC_DATA_MAX);
 
-    while (handle_sync_command(fd, buffer)) {
+    while (handle_sync_command(fd, buffer, lz4_buffer)) {
     }
 
     D("sync: done");
@@ -17,9 +17,15 @@
 #ifndef _FILE_SYNC_SERVICE_H_
 #define _FILE_SYNC_SERVICE_H_
 
+#include <string.h>
+#include <sys/types.h>
+
 #include <string>
 #include <vector>
 
+#include <lz4.h>
+#include <openssl/sha.h>
+
 #define MKID(a,b,c,d) ((a) | ((b) << 8) | ((c) << 16) | ((d) << 24))
 
 #define ID_LSTAT_V1 MKID('S','T','A','T')
@@ -27,10 +33,15 @@
 #define ID_LSTAT_V2 MKID('L','S','T','2')
 #define ID_LIST MKID('L','I','S','T')
 #define ID_SEND MKID('S','E','N','D')
+#define ID_SEND_DELTA MKID('S','N','D','D')
 #define ID_RECV MKID('R','E','C','V')
+#define ID_RECV_LZ4 MKID('R','C','V','Z')
 #define ID_DENT MKID('D','E','N','T')
 #define ID_DONE MKID('D','O','N','E')
 #define ID_DATA MKID('D','A','T','A')
+#define ID_CDAT MKID('C','D','A','T')
+#define ID_SIGS MKID('S','I','G','S')
+#define ID_COPY MKID('C','O','P','Y')
 #define ID_OKAY MKID('O','K','A','Y')
 #define ID_FAIL MKID('F','A','I','L')
 #define ID_QUIT MKID('Q','U','I','T')
@@ -77,6 +88,11 @@ union syncmsg {
         uint32_t id;
         uint32_t msglen;
     } status;
+    struct __attribute__((packed)) {
+        uint32_t id;
+        uint32_t block_size;
+        uint32_t count;
+    } sigs;
 };
 
 void file_sync_service(int fd, void* cookie);
@@ -89,4 +105,91 @@ bool do_sync_sync(const std::string& lpath, const std::string& rpath, bool list_
 
 #define SYNC_DATA_MAX (64*1024)
 
+// With kFeatureSyncLz4, an ID_SEND may carry ID_CDAT packets in place of any
+// ID_DATA packet, and ID_RECV_LZ4 asks for an ID_RECV whose reply may do the
+// same. An ID_CDAT payload is a uint32_t of the decompressed
+// length, at most SYNC_DATA_MAX, followed by one LZ4 block. Chunks that do
+// not shrink are sent as plain ID_DATA.
+struct SyncCompressedHeader {
+    uint32_t size;  // decompressed.
+} __attribute__((packed));
+
+// Returns the length of the ID_CDAT payload written to out, or 0 if the
+// chunk should go out as ID_DATA. out must hold SYNC_DATA_MAX bytes.
+static inline size_t SyncCompress(const char* data, size_t length, char* out) {
+    if (length <= sizeof(SyncCompressedHeader) || length > SYNC_DATA_MAX) return 0;
+    SyncCompressedHeader header = { static_cast<uint32_t>(length) };
+    memcpy(out, &header, sizeof(header));
+    int compressed = LZ4_compress_default(data, out + sizeof(header), length,
+                                          length - sizeof(header));
+    if (compressed <= 0) return 0;
+    return sizeof(header) + compressed;
+}
+
+// Decompresses an ID_CDAT payload into out, which must hold SYNC_DATA_MAX
+// bytes. Returns the decompressed length, or -1 if the payload is corrupt.
+static inline ssize_t SyncDecompress(const char* payload, size_t length, char* out) {
+    SyncCompressedHeader header;
+    if (length < sizeof(header)) return -1;
+    memcpy(&header, payload, sizeof(header));
+    if (header.size > SYNC_DATA_MAX) return -1;
+    int decompressed = LZ4_decompress_safe(payload + sizeof(header), out,
+                                           length - sizeof(header), header.size);
+    if (decompressed < 0 || static_cast<uint32_t>(decompressed) != header.size) return -1;
+    return decompressed;
+}
+
+// With kFeatureSyncDelta, ID_SEND_DELTA asks to replace a file the device
+// already has. The device answers with an ID_SIGS header and one
+// SyncBlockSignature for each whole block_size block of the existing file,
+// then the file follows as for ID_SEND, except that ID_COPY packets may be
+// mixed with the data: each has a SyncCopy payload naming a run of blocks of
+// the old file that reappear next in the new one. The new file is assembled
+// beside the old one and renamed over it, so the old one stays intact until
+// the transfer succeeds.
+struct SyncBlockSignature {
+    uint32_t weak;       // SyncWeakChecksum() of the block.
+    uint8_t strong[16];  // SyncStrongChecksum() of the block.
+} __attribute__((packed));
+
+struct SyncCopy {
+    uint32_t index;  // first block.
+    uint32_t count;  // consecutive blocks.
+} __attribute__((packed));
+
+// The rsync rolling checksum: the byte sum in the low half, and the sum of
+// the running byte sums in the high half, both modulo 2^16.
+static inline uint32_t SyncWeakChecksum(const char* data, size_t length) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < length; ++i) {
+        a += static_cast<uint8_t>(data[i]);
+        b += a;
+    }
+    return (a & 0xffff) | (b << 16);
+}
+
+// Slides the window a checksum covers forward by one byte.
+static inline uint32_t SyncRollChecksum(uint32_t sum, size_t length, uint8_t out, uint8_t in) {
+    uint32_t a = sum & 0xffff, b = sum >> 16;
+    a = (a - out + in) & 0xffff;
+    b = (b - length * out + a) & 0xffff;
+    return a | (b << 16);
+}
+
+static inline void SyncStrongChecksum(const char* data, size_t length, uint8_t* out) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const uint8_t*>(data), length, digest);
+    memcpy(out, digest, sizeof(SyncBlockSignature::strong));
+}
+
+// Blocks of at least 4k, and no more than 64k signatures unless that would
+// mean blocks larger than SYNC_DATA_MAX.
+static inline uint32_t SyncDeltaBlockSize(uint64_t file_size) {
+    uint32_t block_size = 4096;
+    while (block_size < SYNC_DATA_MAX && file_size / block_size > 65536) {
+        block_size *= 2;
+    }
+    return block_size;
+}
+
 #endif
@@ -26,11 +26,17 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include "sysdeps.h"
 
 #include "adb.h"
 #include "adb_io.h"
 #include "fdevent.h"
+#include "framebuffer_stream.h"
 
 /* TODO:
 ** - sync with vsync to avoid tearing
@@ -55,22 +61,20 @@ struct fbinfo {
     unsigned int alpha_length;
 } __attribute__((packed));
 
-void framebuffer_service(int fd, void *cookie)
+// Starts screencap, returning the read end of its output, or -1.
+static int start_screencap(pid_t* pid)
 {
-    struct fbinfo fbinfo;
-    unsigned int i, bsize;
-    char buf[640];
-    int fd_screencap;
-    int w, h, f, c;
     int fds[2];
-    pid_t pid;
-
-    if (pipe2(fds, O_CLOEXEC) < 0) goto pipefail;
+    if (pipe2(fds, O_CLOEXEC) < 0) return -1;
 
-    pid = fork();
-    if (pid < 0) goto done;
+    *pid = fork();
+    if (*pid < 0) {
+        adb_close(fds[0]);
+        adb_close(fds[1]);
+        return -1;
+    }
 
-    if (pid == 0) {
+    if (*pid == 0) {
         dup2(fds[1], STDOUT_FILENO);
         adb_close(fds[0]);
         adb_close(fds[1]);
@@ -81,91 +85,118 @@ void framebuffer_service(int fd, void *cookie)
     }
 
     adb_close(fds[1]);
-    fd_screencap = fds[0];
+    return fds[0];
+}
+
+static void stop_screencap(int fd_screencap, pid_t pid)
+{
+    adb_close(fd_screencap);
+    TEMP_FAILURE_RETRY(waitpid(pid, NULL, 0));
+}
+
+// Reads the screencap header, and describes the frame that follows in |fbinfo|.
+static bool read_fbinfo(int fd_screencap, struct fbinfo* fbinfo)
+{
+    int w, h, f, c;
 
     /* read w, h, format & color space */
-    if(!ReadFdExactly(fd_screencap, &w, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &h, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &f, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &c, 4)) goto done;
+    if(!ReadFdExactly(fd_screencap, &w, 4)) return false;
+    if(!ReadFdExactly(fd_screencap, &h, 4)) return false;
+    if(!ReadFdExactly(fd_screencap, &f, 4)) return false;
+    if(!ReadFdExactly(fd_screencap, &c, 4)) return false;
 
-    fbinfo.version = DDMS_RAWIMAGE_VERSION;
-    fbinfo.colorSpace = c;
+    fbinfo->version = DDMS_RAWIMAGE_VERSION;
+    fbinfo->colorSpace = c;
     /* see hardware/hardware.h */
     switch (f) {
         case 1: /* RGBA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 8;
             break;
         case 2: /* RGBX_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 0;
             break;
         case 3: /* RGB_888 */
-            fbinfo.bpp = 24;
-            fbinfo.size = w * h * 3;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
+            fbinfo->bpp = 24;
+            fbinfo->size = w * h * 3;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 0;
             break;
         case 4: /* RGB_565 */
-            fbinfo.bpp = 16;
-            fbinfo.size = w * h * 2;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 11;
-            fbinfo.red_length = 5;
-            fbinfo.green_offset = 5;
-            fbinfo.green_length = 6;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 5;
-            fbinfo.alpha_offset = 0;
-            fbinfo.alpha_length = 0;
+            fbinfo->bpp = 16;
+            fbinfo->size = w * h * 2;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 11;
+            fbinfo->red_length = 5;
+            fbinfo->green_offset = 5;
+            fbinfo->green_length = 6;
+            fbinfo->blue_offset = 0;
+            fbinfo->blue_length = 5;
+            fbinfo->alpha_offset = 0;
+            fbinfo->alpha_length = 0;
             break;
         case 5: /* BGRA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 16;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 16;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 0;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 8;
            break;
         default:
-            goto done;
+            return false;
     }
+    return true;
+}
+
+void framebuffer_service(int fd, void *cookie)
+{
+    struct fbinfo fbinfo;
+    unsigned int i, bsize;
+    char buf[640];
+    int fd_screencap;
+    pid_t pid;
+
+    fd_screencap = start_screencap(&pid);
+    if (fd_screencap < 0) goto pipefail;
+
+    if (!read_fbinfo(fd_screencap, &fbinfo)) goto done;
 
     /* write header */
     if(!WriteFdExactly(fd, &fbinfo, sizeof(fbinfo))) goto done;
@@ -180,9 +211,49 @@ void framebuffer_service(int fd, void *cookie)
     }
 
 done:
-    adb_close(fds[0]);
-
-    TEMP_FAILURE_RETRY(waitpid(pid, NULL, 0));
+    stop_screencap(fd_screencap, pid);
 pipefail:
     adb_close(fd);
 }
+
+void framebuffer_stream_service(int fd, void* cookie)
+{
+    char* arg = reinterpret_cast<char*>(cookie);
+    std::chrono::milliseconds interval(atoi(arg));
+    free(arg);
+
+    struct fbinfo fbinfo;
+    std::vector<char> frame;
+    std::vector<char> message;
+    std::unique_ptr<FramebufferStreamEncoder> encoder;
+    while (true) {
+        auto next = std::chrono::steady_clock::now() + interval;
+
+        pid_t pid;
+        int fd_screencap = start_screencap(&pid);
+        if (fd_screencap < 0) break;
+
+        struct fbinfo current;
+        bool ok = read_fbinfo(fd_screencap, &current);
+        if (ok && encoder == nullptr) {
+            fbinfo = current;
+            frame.resize(fbinfo.size);
+            encoder.reset(new FramebufferStreamEncoder(
+                fbinfo.size, FramebufferStreamTileSize(fbinfo.width, fbinfo.bpp)));
+            ok = WriteFdExactly(fd, &fbinfo, sizeof(fbinfo));
+        } else if (ok && memcmp(&current, &fbinfo, sizeof(fbinfo)) != 0) {
+            // The client would need a new header, e.g. after a rotation. End the stream, so that
+            // it reconnects.
+            ok = false;
+        }
+        ok = ok && ReadFdExactly(fd_screencap, frame.data(), frame.size());
+        stop_screencap(fd_screencap, pid);
+        if (!ok) break;
+
+        encoder->Encode(frame.data(), &message);
+        if (!WriteFdExactly(fd, message.data(), message.size())) break;
+
+        std::this_thread::sleep_until(next);
+    }
+    adb_close(fd);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "framebuffer_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <lz4.h>
+
+#include "adb_io.h"
+
+FramebufferStreamEncoder::FramebufferStreamEncoder(size_t frame_size, size_t tile_size)
+    : tile_size_(std::max<size_t>(1, tile_size)), previous_(frame_size), delta_(tile_size_) {
+}
+
+void FramebufferStreamEncoder::Encode(const char* frame, std::vector<char>* message) {
+    message->resize(sizeof(FramebufferStreamFrame));
+
+    uint32_t tile_count = 0;
+    uint32_t index = 0;
+    for (size_t offset = 0; offset < previous_.size(); offset += tile_size_, index++) {
+        size_t length = std::min(tile_size_, previous_.size() - offset);
+        const char* tile = frame + offset;
+        char* previous = &previous_[offset];
+        if (memcmp(tile, previous, length) == 0) continue;
+
+        for (size_t i = 0; i < length; i++) {
+            delta_[i] = tile[i] ^ previous[i];
+        }
+        memcpy(previous, tile, length);
+
+        // Mostly unchanged tiles XOR to runs of zeroes, which compress well. Those that don't
+        // shrink go out as they are.
+        size_t header_offset = message->size();
+        message->resize(header_offset + sizeof(FramebufferStreamTile) + length);
+        char* payload = message->data() + header_offset + sizeof(FramebufferStreamTile);
+        int compressed = LZ4_compress_default(delta_.data(), payload, length, length - 1);
+        FramebufferStreamTile header = {index, static_cast<uint32_t>(length)};
+        if (compressed > 0) {
+            header.size = compressed;
+        } else {
+            memcpy(payload, delta_.data(), length);
+        }
+        memcpy(message->data() + header_offset, &header, sizeof(header));
+        message->resize(header_offset + sizeof(header) + header.size);
+        tile_count++;
+    }
+
+    FramebufferStreamFrame header = {tile_count};
+    memcpy(message->data(), &header, sizeof(header));
+}
+
+FramebufferStreamDecoder::FramebufferStreamDecoder(size_t frame_size, size_t tile_size)
+    : tile_size_(std::max<size_t>(1, tile_size)),
+      frame_(frame_size),
+      payload_(tile_size_),
+      delta_(tile_size_) {
+}
+
+bool FramebufferStreamDecoder::ReadFrame(int fd, std::string* error) {
+    FramebufferStreamFrame frame;
+    if (!ReadFdExactly(fd, &frame, sizeof(frame))) {
+        *error = "framebuffer stream ended";
+        return false;
+    }
+
+    size_t tile_count = (frame_.size() + tile_size_ - 1) / tile_size_;
+    if (frame.tile_count > tile_count) {
+        *error = "corrupt framebuffer stream: too many tiles";
+        return false;
+    }
+
+    for (uint32_t i = 0; i < frame.tile_count; i++) {
+        FramebufferStreamTile tile;
+        if (!ReadFdExactly(fd, &tile, sizeof(tile))) {
+            *error = "framebuffer stream ended";
+            return false;
+        }
+        if (tile.index >= tile_count) {
+            *error = "corrupt framebuffer stream: tile out of range";
+            return false;
+        }
+        size_t offset = tile.index * tile_size_;
+        size_t length = std::min(tile_size_, frame_.size() - offset);
+        if (tile.size == 0 || tile.size > length) {
+            *error = "corrupt framebuffer stream: bad tile size";
+            return false;
+        }
+        if (!ReadFdExactly(fd, payload_.data(), tile.size)) {
+            *error = "framebuffer stream ended";
+            return false;
+        }
+
+        const char* delta = payload_.data();
+        if (tile.size < length) {
+            int decompressed = LZ4_decompress_safe(payload_.data(), delta_.data(), tile.size,
+                                                   length);
+            if (decompressed < 0 || static_cast<size_t>(decompressed) != length) {
+                *error = "corrupt framebuffer stream: bad compressed tile";
+                return false;
+            }
+            delta = delta_.data();
+        }
+        for (size_t j = 0; j < length; j++) {
+            frame_[offset + j] ^= delta[j];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEBUFFER_STREAM_H
+#define FRAMEBUFFER_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/macros.h>
+
+// With kFeatureFramebufferStream, "framebuffer-stream:<interval ms>" sends the
+// same fbinfo header as "framebuffer:", then a frame every interval until the
+// connection is closed, or until the screen changes size.
+//
+// Frames are split in tiles of kFramebufferStreamTileRows rows, the last one
+// possibly shorter. Each frame is a FramebufferStreamFrame followed by as many
+// dirty tiles, each a FramebufferStreamTile and its payload: the XOR of the
+// tile with the same tile of the previous frame, LZ4 compressed unless size
+// is the tile's length. The frame before the first is all zeroes, so the
+// first frame sends every tile that isn't blank. A frame without tiles is
+// unchanged from the previous one.
+constexpr size_t kFramebufferStreamTileRows = 16;
+
+// Returns the byte length of a tile of a frame |width| pixels of |bpp| bits wide.
+static inline size_t FramebufferStreamTileSize(uint32_t width, uint32_t bpp) {
+    return static_cast<size_t>(width) * (bpp / 8) * kFramebufferStreamTileRows;
+}
+
+struct FramebufferStreamFrame {
+    uint32_t tile_count;
+} __attribute__((packed));
+
+struct FramebufferStreamTile {
+    uint32_t index;
+    uint32_t size;
+} __attribute__((packed));
+
+class FramebufferStreamEncoder {
+  public:
+    // |tile_size| is as returned by FramebufferStreamTileSize().
+    FramebufferStreamEncoder(size_t frame_size, size_t tile_size);
+
+    // Replaces |message| with the encoding of |frame|, which is frame_size
+    // bytes, against the previous frame.
+    void Encode(const char* frame, std::vector<char>* message);
+
+  private:
+    const size_t tile_size_;
+    std::vector<char> previous_;
+    std::vector<char> delta_;
+
+    DISALLOW_COPY_AND_ASSIGN(FramebufferStreamEncoder);
+};
+
+class FramebufferStreamDecoder {
+  public:
+    FramebufferStreamDecoder(size_t frame_size, size_t tile_size);
+
+    // Reads the next frame from |fd| and applies it to frame(). Returns false,
+    // with |error| set, if the stream ended or is corrupt.
+    bool ReadFrame(int fd, std::string* error);
+
+    const char* frame() const { return frame_.data(); }
+    size_t frame_size() const { return frame_.size(); }
+
+  private:
+    const size_t tile_size_;
+    std::vector<char> frame_;
+    std::vector<char> payload_;
+    std::vector<char> delta_;
+
+    DISALLOW_COPY_AND_ASSIGN(FramebufferStreamDecoder);
+};
+
+#endif  // FRAMEBUFFER_STREAM_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "framebuffer_stream.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+
+// Like adb_io_test.cpp, these use the C Runtime open(), which adb_io doesn't
+// handle on Windows.
+#if defined(_WIN32)
+#define POSIX_TEST(x,y) TEST(DISABLED_ ## x,y)
+#else
+#define POSIX_TEST TEST
+#endif
+
+// 8 RGBA pixels wide and 40 rows high: two whole tiles and a half one.
+static constexpr uint32_t kWidth = 8;
+static constexpr uint32_t kBpp = 32;
+static constexpr size_t kFrameSize = kWidth * 4 * 40;
+
+static uint32_t TileCount(const std::vector<char>& message) {
+    FramebufferStreamFrame frame;
+    memcpy(&frame, message.data(), sizeof(frame));
+    return frame.tile_count;
+}
+
+POSIX_TEST(framebuffer_stream, round_trip) {
+    size_t tile_size = FramebufferStreamTileSize(kWidth, kBpp);
+    ASSERT_EQ(512U, tile_size);
+    FramebufferStreamEncoder encoder(kFrameSize, tile_size);
+    FramebufferStreamDecoder decoder(kFrameSize, tile_size);
+
+    std::vector<std::vector<char>> frames;
+    std::vector<char> frame(kFrameSize);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = i * 7;
+    }
+    frames.push_back(frame);
+    // Only the last, shorter, tile changes.
+    frame[kFrameSize - 1] ^= 0x55;
+    frames.push_back(frame);
+    // Nothing changes.
+    frames.push_back(frame);
+
+    TemporaryFile tf;
+    ASSERT_NE(-1, tf.fd);
+    std::vector<uint32_t> tile_counts;
+    std::vector<char> message;
+    for (const auto& f : frames) {
+        encoder.Encode(f.data(), &message);
+        tile_counts.push_back(TileCount(message));
+        ASSERT_TRUE(android::base::WriteFully(tf.fd, message.data(), message.size()));
+    }
+    EXPECT_EQ((std::vector<uint32_t>{3, 1, 0}), tile_counts);
+    ASSERT_EQ(0, lseek(tf.fd, 0, SEEK_SET));
+
+    std::string error;
+    for (const auto& f : frames) {
+        ASSERT_TRUE(decoder.ReadFrame(tf.fd, &error)) << error;
+        ASSERT_EQ(0, memcmp(f.data(), decoder.frame(), kFrameSize));
+    }
+    ASSERT_FALSE(decoder.ReadFrame(tf.fd, &error));
+    ASSERT_EQ("framebuffer stream ended", error);
+}
+
+POSIX_TEST(framebuffer_stream, blank_first_frame) {
+    FramebufferStreamEncoder encoder(kFrameSize, FramebufferStreamTileSize(kWidth, kBpp));
+
+    std::vector<char> frame(kFrameSize);
+    std::vector<char> message;
+    encoder.Encode(frame.data(), &message);
+    ASSERT_EQ(sizeof(FramebufferStreamFrame), message.size());
+    ASSERT_EQ(0U, TileCount(message));
+}
+
+POSIX_TEST(framebuffer_stream, corrupt_tile) {
+    FramebufferStreamDecoder decoder(kFrameSize, FramebufferStreamTileSize(kWidth, kBpp));
+
+    TemporaryFile tf;
+    ASSERT_NE(-1, tf.fd);
+    FramebufferStreamFrame frame = {1};
+    FramebufferStreamTile tile = {3, 1};
+    ASSERT_TRUE(android::base::WriteFully(tf.fd, &frame, sizeof(frame)));
+    ASSERT_TRUE(android::base::WriteFully(tf.fd, &tile, sizeof(tile)));
+    ASSERT_EQ(0, lseek(tf.fd, 0, SEEK_SET));
+
+    std::string error;
+    ASSERT_FALSE(decoder.ReadFrame(tf.fd, &error));
+    ASSERT_EQ("corrupt framebuffer stream: tile out of range", error);
+}
@@ -457,7 +457,7 @@ static void jdwp_socket_close(asocket* s) {
     delete s;
 }
 
-static int jdwp_socket_enqueue(asocket* s, std::string) {
+static int jdwp_socket_enqueue(asocket* s, Block) {
     /* you can't write to this asocket */
     D("LS(%d): JDWP socket received data?", s->id);
     s->peer->close(s->peer);
@@ -472,10 +472,10 @@ static void jdwp_socket_ready(asocket* s) {
      * on the second one, close the connection
      */
     if (!jdwp->pass) {
-        std::string data;
-        data.resize(s->get_max_payload());
-        size_t len = jdwp_process_list(&data[0], data.size());
+        Block data(s->get_max_payload());
+        size_t len = jdwp_process_list(data.data(), data.size());
         data.resize(len);
+        data.shrink_to_fit();
         peer->enqueue(peer, std::move(data));
         jdwp->pass = true;
     } else {
@@ -512,14 +512,13 @@ struct JdwpTracker : public asocket {
 static std::vector<std::unique_ptr<JdwpTracker>> _jdwp_trackers;
 
 static void jdwp_process_list_updated(void) {
-    std::string data;
-    data.resize(1024);
-    data.resize(jdwp_process_list_msg(&data[0], data.size()));
+    Block data(1024);
+    data.resize(jdwp_process_list_msg(data.data(), data.size()));
 
     for (auto& t : _jdwp_trackers) {
         if (t->peer) {
             // The tracker might not have been connected yet.
-            t->peer->enqueue(t->peer, data);
+            t->peer->enqueue(t->peer, Block(data.begin(), data.end()));
         }
     }
 }
@@ -545,15 +544,15 @@ static void jdwp_tracker_ready(asocket* s) {
     JdwpTracker* t = (JdwpTracker*)s;
 
     if (t->need_initial) {
-        std::string data;
-        data.resize(s->get_max_payload());
-        data.resize(jdwp_process_list_msg(&data[0], data.size()));
+        Block data(s->get_max_payload());
+        data.resize(jdwp_process_list_msg(data.data(), data.size()));
+        data.shrink_to_fit();
         t->need_initial = false;
         s->peer->enqueue(s->peer, std::move(data));
     }
 }
 
-static int jdwp_tracker_enqueue(asocket* s, std::string) {
+static int jdwp_tracker_enqueue(asocket* s, Block) {
     /* you can't write to this socket */
     D("LS(%d): JDWP tracker received data?", s->id);
     s->peer->close(s->peer);
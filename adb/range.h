@@ -16,12 +16,12 @@
  * limitations under the License.
  */
 
-#include <string>
-
 #include <android-base/logging.h>
 
+#include "types.h"
+
 struct Range {
-    explicit Range(std::string data) : data_(std::move(data)) {}
+    explicit Range(Block data) : data_(std::move(data)) {}
 
     Range(const Range& copy) = delete;
     Range& operator=(const Range& copy) = delete;
@@ -48,18 +48,18 @@ struct Range {
     }
 
     char* data() {
-        return &data_[0] + begin_offset_;
+        return data_.data() + begin_offset_;
     }
 
-    std::string::iterator begin() {
+    Block::iterator begin() {
         return data_.begin() + begin_offset_;
     }
 
-    std::string::iterator end() {
+    Block::iterator end() {
         return data_.end() - end_offset_;
     }
 
-    std::string data_;
+    Block data_;
     size_t begin_offset_ = 0;
     size_t end_offset_ = 0;
 };
@@ -289,6 +289,11 @@ int service_to_fd(const char* name, atransport* transport) {
         ret = unix_open(name + 4, O_RDWR | O_CLOEXEC);
     } else if(!strncmp(name, "framebuffer:", 12)) {
         ret = create_service_thread("fb", framebuffer_service, nullptr);
+    } else if (!strncmp(name, "framebuffer-stream:", 19)) {
+        void* arg = strdup(name + 19);
+        if (arg == NULL) return -1;
+        ret = create_service_thread("fb-stream", framebuffer_stream_service, arg);
+        if (ret < 0) free(arg);
     } else if (!strncmp(name, "jdwp:", 5)) {
         ret = create_jdwp_connection_fd(atoi(name+5));
     } else if(!strncmp(name, "shell", 5)) {
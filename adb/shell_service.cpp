@@ -82,6 +82,7 @@
 #include "shell_service.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <paths.h>
 #include <pty.h>
 #include <pwd.h>
@@ -89,6 +90,7 @@
 #include <sys/stat.h>
 #include <termios.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <thread>
@@ -111,6 +113,13 @@
 
 namespace {
 
+// Subprocess output is coalesced into packets of up to kOutputFlushSize,
+// but held back no longer than a latency budget: long enough for a busy
+// writer like dumpsys to fill a packet, too short to notice interactively.
+constexpr size_t kOutputFlushSize = 64 * 1024;
+constexpr auto kRawOutputLatency = std::chrono::milliseconds(10);
+constexpr auto kPtyOutputLatency = std::chrono::milliseconds(1);
+
 static std::string get_sh_path()
 {
     if (recovery_mode) {
@@ -191,6 +200,7 @@ class Subprocess {
     // a pointer to the failed FD.
     unique_fd* PassInput();
     unique_fd* PassOutput(unique_fd* sfd, ShellProtocol::Id id);
+    unique_fd* FlushOutput();
 
     const std::string command_;
     const std::string terminal_type_;
@@ -205,6 +215,12 @@ class Subprocess {
     std::unique_ptr<ShellProtocol> input_, output_;
     size_t input_bytes_left_ = 0;
 
+    // Output read into output_ but not yet sent, all from one stream.
+    size_t output_pending_ = 0;
+    ShellProtocol::Id output_pending_id_ = ShellProtocol::kIdInvalid;
+    std::chrono::steady_clock::time_point output_deadline_;
+    uint64_t output_bytes_ = 0, output_packets_ = 0;
+
     DISALLOW_COPY_AND_ASSIGN(Subprocess);
 };
 
@@ -524,6 +540,9 @@ void Subprocess::PassDataStreams() {
             dead_sfd->reset();
         }
     }
+
+    if (protocol_sfd_ != -1) FlushOutput();
+    D("sent %" PRIu64 " bytes of output in %" PRIu64 " packets", output_bytes_, output_packets_);
 }
 
 namespace {
@@ -544,7 +563,21 @@ unique_fd* Subprocess::SelectLoop(fd_set* master_read_set_ptr,
     while (!dead_sfd) {
         memcpy(&read_set, master_read_set_ptr, sizeof(read_set));
         memcpy(&write_set, master_write_set_ptr, sizeof(write_set));
-        if (select(select_n, &read_set, &write_set, nullptr, nullptr) < 0) {
+
+        // Wake up in time to send held back output.
+        timeval timeout;
+        timeval* timeout_ptr = nullptr;
+        if (output_pending_) {
+            int64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   output_deadline_ - std::chrono::steady_clock::now())
+                                   .count();
+            usec = std::max<int64_t>(usec, 0);
+            timeout.tv_sec = usec / 1000000;
+            timeout.tv_usec = usec % 1000000;
+            timeout_ptr = &timeout;
+        }
+
+        if (select(select_n, &read_set, &write_set, nullptr, timeout_ptr) < 0) {
             if (errno == EINTR) {
                 continue;
             } else {
@@ -555,6 +588,11 @@ unique_fd* Subprocess::SelectLoop(fd_set* master_read_set_ptr,
             }
         }
 
+        if (output_pending_ && std::chrono::steady_clock::now() >= output_deadline_) {
+            dead_sfd = FlushOutput();
+            if (dead_sfd) break;
+        }
+
         // Read stdout, write to protocol FD.
         if (ValidAndInSet(stdinout_sfd_, &read_set)) {
             dead_sfd = PassOutput(&stdinout_sfd_, ShellProtocol::kIdStdout);
@@ -659,23 +697,57 @@ unique_fd* Subprocess::PassInput() {
 }
 
 unique_fd* Subprocess::PassOutput(unique_fd* sfd, ShellProtocol::Id id) {
-    int bytes = adb_read(*sfd, output_->data(), output_->data_capacity());
-    if (bytes == 0 || (bytes < 0 && errno != EAGAIN)) {
-        // read() returns EIO if a PTY closes; don't report this as an error,
-        // it just means the subprocess completed.
-        if (bytes < 0 && !(type_ == SubprocessType::kPty && errno == EIO)) {
-            PLOG(ERROR) << "error reading output FD " << *sfd;
+    // A packet only carries one stream, and stdout and stderr stay in order.
+    if (output_pending_ && output_pending_id_ != id) {
+        unique_fd* dead_sfd = FlushOutput();
+        if (dead_sfd) return dead_sfd;
+    }
+
+    // The FD is non-blocking, so take everything that's there rather than
+    // waking up again for each write the subprocess made.
+    size_t capacity = std::min(output_->data_capacity(), kOutputFlushSize);
+    while (output_pending_ < capacity) {
+        int bytes = adb_read(*sfd, output_->data() + output_pending_, capacity - output_pending_);
+        if (bytes < 0 && errno == EAGAIN) {
+            break;
         }
-        return sfd;
+        if (bytes <= 0) {
+            // read() returns EIO if a PTY closes; don't report this as an error,
+            // it just means the subprocess completed.
+            if (bytes < 0 && !(type_ == SubprocessType::kPty && errno == EIO)) {
+                PLOG(ERROR) << "error reading output FD " << *sfd;
+            }
+            unique_fd* dead_sfd = FlushOutput();
+            return dead_sfd ? dead_sfd : sfd;
+        }
+
+        if (!output_pending_) {
+            output_pending_id_ = id;
+            output_deadline_ = std::chrono::steady_clock::now() +
+                               (type_ == SubprocessType::kPty ? kPtyOutputLatency
+                                                              : kRawOutputLatency);
+        }
+        output_pending_ += bytes;
     }
 
-    if (bytes > 0 && !output_->Write(id, bytes)) {
+    return output_pending_ >= capacity ? FlushOutput() : nullptr;
+}
+
+unique_fd* Subprocess::FlushOutput() {
+    if (!output_pending_) {
+        return nullptr;
+    }
+
+    size_t length = output_pending_;
+    output_pending_ = 0;
+    if (!output_->Write(output_pending_id_, length)) {
         if (errno != 0) {
-            PLOG(ERROR) << "error reading protocol FD " << protocol_sfd_;
+            PLOG(ERROR) << "error writing protocol FD " << protocol_sfd_;
         }
         return &protocol_sfd_;
     }
-
+    output_bytes_ += length;
+    ++output_packets_;
     return nullptr;
 }
 
@@ -185,6 +185,20 @@ TEST_F(ShellServiceTest, RawShellProtocolSubprocess) {
     ExpectLinesEqual(stderr, {"bar"});
 }
 
+// Tests that coalesced output arrives complete and each stream stays in order.
+TEST_F(ShellServiceTest, RawShellProtocolSubprocessBulkOutput) {
+    ASSERT_NO_FATAL_FAILURE(StartTestSubprocess(
+            "head -c 1000000 /dev/zero; for i in 1 2 3; do echo out$i; echo err$i >&2; done",
+            SubprocessType::kRaw, SubprocessProtocol::kShell));
+
+    std::string stdout, stderr;
+    EXPECT_EQ(0, ReadShellProtocol(subprocess_fd_, &stdout, &stderr));
+    ASSERT_LE(1000000u, stdout.size());
+    EXPECT_EQ(std::string(1000000, '\0'), stdout.substr(0, 1000000));
+    ExpectLinesEqual(stdout.substr(1000000), {"out1", "out2", "out3"});
+    ExpectLinesEqual(stderr, {"err1", "err2", "err3"});
+}
+
 // Tests a PTY subprocess with the shell protocol.
 TEST_F(ShellServiceTest, PtyShellProtocolSubprocess) {
     ASSERT_NO_FATAL_FAILURE(StartTestSubprocess(
@@ -25,6 +25,7 @@
 
 #include "fdevent.h"
 #include "range.h"
+#include "types.h"
 
 struct apacket;
 class atransport;
@@ -73,7 +74,7 @@ struct asocket {
      * peer->ready() when we once again are ready to
      * receive data.
      */
-    int (*enqueue)(asocket* s, std::string data) = nullptr;
+    int (*enqueue)(asocket* s, Block data) = nullptr;
 
     /* ready is called by the peer when it is ready for
      * us to send data via enqueue again
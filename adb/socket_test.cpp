@@ -114,8 +114,7 @@ static void CloseWithPacketThreadFunc(CloseWithPacketArg* arg) {
     ASSERT_TRUE(s != nullptr);
     arg->bytes_written = 0;
 
-    std::string data;
-    data.resize(MAX_PAYLOAD);
+    Block data(MAX_PAYLOAD);
     arg->bytes_written += data.size();
     int ret = s->enqueue(s, std::move(data));
     ASSERT_EQ(1, ret);
@@ -147,9 +147,8 @@ static SocketFlushResult local_socket_flush_incoming(asocket* s) {
 // Returns false if the socket has been closed and destroyed as a side-effect of this function.
 static bool local_socket_flush_outgoing(asocket* s) {
     const size_t max_payload = s->get_max_payload();
-    std::string data;
-    data.resize(max_payload);
-    char* x = &data[0];
+    Block data(max_payload);
+    char* x = data.data();
     size_t avail = max_payload;
     int r = 0;
     int is_eof = 0;
@@ -178,6 +177,12 @@ static bool local_socket_flush_outgoing(asocket* s) {
     if (avail != max_payload && s->peer) {
         data.resize(max_payload - avail);
 
+        // Interactive traffic arrives a few bytes at a time, don't let each of
+        // those pin a max_payload allocation while it sits in a queue.
+        if (data.size() < max_payload / 4) {
+            data.shrink_to_fit();
+        }
+
         // s->peer->enqueue() may call s->close() and free s,
         // so save variables for debug printing below.
         unsigned saved_id = s->id;
@@ -214,7 +219,7 @@ static bool local_socket_flush_outgoing(asocket* s) {
     return true;
 }
 
-static int local_socket_enqueue(asocket* s, std::string data) {
+static int local_socket_enqueue(asocket* s, Block data) {
     D("LS(%d): enqueue %zu", s->id, data.size());
 
     Range r(std::move(data));
@@ -394,7 +399,7 @@ static asocket* create_host_service_socket(const char* name, const char* serial,
 }
 #endif /* ADB_HOST */
 
-static int remote_socket_enqueue(asocket* s, std::string data) {
+static int remote_socket_enqueue(asocket* s, Block data) {
     D("entered remote_socket_enqueue RS(%d) WRITE fd=%d peer.fd=%d", s->id, s->fd, s->peer->fd);
     apacket* p = get_apacket();
 
@@ -476,8 +481,7 @@ void connect_to_remote(asocket* s, const char* destination) {
     p->msg.arg0 = s->id;
 
     // adbd expects a null-terminated string.
-    p->payload = destination;
-    p->payload.push_back('\0');
+    p->payload.assign(destination, destination + strlen(destination) + 1);
     p->msg.data_length = p->payload.size();
 
     if (p->msg.data_length > s->get_max_payload()) {
@@ -612,7 +616,7 @@ char* skip_host_serial(char* service) {
 
 #endif  // ADB_HOST
 
-static int smart_socket_enqueue(asocket* s, std::string data) {
+static int smart_socket_enqueue(asocket* s, Block data) {
 #if ADB_HOST
     char* service = nullptr;
     char* serial = nullptr;
@@ -622,11 +626,7 @@ static int smart_socket_enqueue(asocket* s, std::string data) {
 
     D("SS(%d): enqueue %zu", s->id, data.size());
 
-    if (s->smart_socket_data.empty()) {
-        s->smart_socket_data = std::move(data);
-    } else {
-        std::copy(data.begin(), data.end(), std::back_inserter(s->smart_socket_data));
-    }
+    s->smart_socket_data.append(data.begin(), data.end());
 
     /* don't bother if we can't decode the length */
     if (s->smart_socket_data.size() < 4) {
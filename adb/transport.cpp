@@ -27,6 +27,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
+
 #include <algorithm>
 #include <list>
 #include <mutex>
@@ -59,6 +63,9 @@ const char* const kFeatureCmd = "cmd";
 const char* const kFeatureStat2 = "stat_v2";
 const char* const kFeatureLibusb = "libusb";
 const char* const kFeaturePushSync = "push_sync";
+const char* const kFeatureSyncLz4 = "sync_lz4";
+const char* const kFeatureSyncDelta = "sync_delta";
+const char* const kFeatureFramebufferStream = "framebuffer_stream";
 
 TransportId NextTransportId() {
     static std::atomic<TransportId> next(1);
@@ -78,7 +85,7 @@ bool FdConnection::Read(apacket* packet) {
 
     packet->payload.resize(packet->msg.data_length);
 
-    if (!ReadFdExactly(fd_.get(), &packet->payload[0], packet->payload.size())) {
+    if (!ReadFdExactly(fd_.get(), packet->payload.data(), packet->payload.size())) {
         D("remote local: terminated (data)");
         return false;
     }
@@ -87,17 +94,44 @@ bool FdConnection::Read(apacket* packet) {
 }
 
 bool FdConnection::Write(apacket* packet) {
+#if !defined(_WIN32)
+    // With Nagle off, separate writes of the header and the payload would go
+    // out as separate segments, so hand the kernel both at once.
+    iovec iov[2] = {
+        {&packet->msg, sizeof(packet->msg)},
+        {packet->payload.data(), packet->msg.data_length},
+    };
+    iovec* next = iov;
+    int count = packet->msg.data_length ? 2 : 1;
+    while (count > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(writev(fd_.get(), next, count));
+        if (written <= 0) {
+            D("remote local: write terminated");
+            return false;
+        }
+        while (count > 0 && static_cast<size_t>(written) >= next->iov_len) {
+            written -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + written;
+            next->iov_len -= written;
+        }
+    }
+#else
     if (!WriteFdExactly(fd_.get(), &packet->msg, sizeof(packet->msg))) {
         D("remote local: write terminated");
         return false;
     }
 
     if (packet->msg.data_length) {
-        if (!WriteFdExactly(fd_.get(), &packet->payload[0], packet->msg.data_length)) {
+        if (!WriteFdExactly(fd_.get(), packet->payload.data(), packet->msg.data_length)) {
             D("remote local: write terminated");
             return false;
         }
     }
+#endif
 
     return true;
 }
@@ -219,16 +253,16 @@ void send_packet(apacket* p, atransport* t) {
         fatal("Transport is null");
     }
 
-    if (write_packet(t->transport_socket, t->serial, &p)) {
-        fatal_errno("cannot enqueue packet on transport socket");
-    }
+    VLOG(TRANSPORT) << dump_packet(t->serial_name().c_str(), "to remote", p);
+    t->EnqueueWrite(p);
 }
 
 // The transport is opened by transport_register_func before
 // the read_transport and write_transport threads are started.
 //
-// The read_transport thread issues a SYNC(1, token) message to let
-// the write_transport thread know to start things up.  In the event
+// The read_transport thread issues a SYNC(1, token) message, which the main
+// thread echoes back through the transport's write queue, to let the
+// write_transport thread know to start things up.  In the event
 // of transport IO failure, the read_transport thread will post a
 // SYNC(0,0) message to ensure shutdown.
 //
@@ -309,8 +343,9 @@ oops:
     transport_unref(t);
 }
 
-// write_transport thread gets packets sent by the main thread (through send_packet()),
-// and writes to a transport (representing a usb/tcp connection).
+// write_transport thread gets packets queued by the main thread (through send_packet()),
+// and writes to a transport (representing a usb/tcp connection). Each transport
+// drains its own queue, so a device that blocks on writes only holds up itself.
 static void write_transport_thread(void* _t) {
     atransport* t = reinterpret_cast<atransport*>(_t);
     apacket* p;
@@ -318,14 +353,11 @@ static void write_transport_thread(void* _t) {
 
     adb_thread_setname(
         android::base::StringPrintf("->%s", (t->serial != nullptr ? t->serial : "transport")));
-    D("%s: starting write_transport thread, reading from fd %d", t->serial, t->fd);
+    D("%s: starting write_transport thread", t->serial);
 
     for (;;) {
         ATRACE_NAME("write_transport loop");
-        if (read_packet(t->fd, t->serial, &p)) {
-            D("%s: failed to read apacket from transport on fd %d", t->serial, t->fd);
-            break;
-        }
+        p = t->DequeueWrite();
 
         if (p->msg.command == A_SYNC) {
             if (p->msg.arg0 == 0) {
@@ -364,7 +396,7 @@ static void write_transport_thread(void* _t) {
         put_apacket(p);
     }
 
-    D("%s: write_transport thread is exiting, fd %d", t->serial, t->fd);
+    D("%s: write_transport thread is exiting", t->serial);
     kick_transport(t);
     transport_unref(t);
 }
@@ -429,7 +461,7 @@ static void device_tracker_close(asocket* socket) {
     delete tracker;
 }
 
-static int device_tracker_enqueue(asocket* socket, std::string) {
+static int device_tracker_enqueue(asocket* socket, Block) {
     /* you can't read from a device tracker, close immediately */
     device_tracker_close(socket);
     return -1;
@@ -438,8 +470,7 @@ static int device_tracker_enqueue(asocket* socket, std::string) {
 static int device_tracker_send(device_tracker* tracker, const std::string& string) {
     asocket* peer = tracker->socket.peer;
 
-    std::string data;
-    data.resize(4 + string.size());
+    Block data(4 + string.size());
     char buf[5];
     snprintf(buf, sizeof(buf), "%04x", static_cast<int>(string.size()));
     memcpy(&data[0], buf, 4);
@@ -812,6 +843,29 @@ atransport* acquire_one_transport(TransportType type, const char* serial, Transp
     return result;
 }
 
+atransport::~atransport() {
+    // Whatever was sent after the write thread gave up.
+    for (apacket* p : write_queue_) {
+        put_apacket(p);
+    }
+}
+
+void atransport::EnqueueWrite(apacket* p) {
+    {
+        std::lock_guard<std::mutex> lock(write_queue_lock_);
+        write_queue_.push_back(p);
+    }
+    write_queue_cv_.notify_one();
+}
+
+apacket* atransport::DequeueWrite() {
+    std::unique_lock<std::mutex> lock(write_queue_lock_);
+    write_queue_cv_.wait(lock, [this]() { return !write_queue_.empty(); });
+    apacket* p = write_queue_.front();
+    write_queue_.pop_front();
+    return p;
+}
+
 int atransport::Write(apacket* p) {
     return this->connection->Write(p) ? 0 : -1;
 }
@@ -879,7 +933,8 @@ constexpr char kFeatureStringDelimiter = ',';
 const FeatureSet& supported_features() {
     // Local static allocation to avoid global non-POD variables.
     static const FeatureSet* features = new FeatureSet{
-        kFeatureShell2, kFeatureCmd, kFeatureStat2,
+        kFeatureShell2, kFeatureCmd, kFeatureStat2, kFeatureSyncLz4, kFeatureSyncDelta,
+        kFeatureFramebufferStream,
         // Increment ADB_SERVER_VERSION whenever the feature list changes to
         // make sure that the adb client and server features stay in sync
         // (http://b/24370690).
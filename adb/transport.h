@@ -20,6 +20,7 @@
 #include <sys/types.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <functional>
 #include <list>
@@ -54,6 +55,12 @@ extern const char* const kFeatureStat2;
 extern const char* const kFeatureLibusb;
 // The server supports `push --sync`.
 extern const char* const kFeaturePushSync;
+// File sync DATA may be sent LZ4 compressed, see ID_CDAT.
+extern const char* const kFeatureSyncLz4;
+// File sync can replace a file by sending only what changed, see ID_SEND_DELTA.
+extern const char* const kFeatureSyncDelta;
+// The device has "framebuffer-stream:", see framebuffer_stream.h.
+extern const char* const kFeatureFramebufferStream;
 
 TransportId NextTransportId();
 
@@ -116,11 +123,18 @@ class atransport {
         protocol_version = A_VERSION_MIN;
         max_payload = MAX_PAYLOAD;
     }
-    virtual ~atransport() {}
+    virtual ~atransport();
 
     int Write(apacket* p);
     void Kick();
 
+    // Hands a packet from the main thread to this transport's write thread.
+    // Never blocks, so a device that is slow to drain can't stall the others.
+    void EnqueueWrite(apacket* p);
+
+    // Called by the write thread, blocks until a packet is queued.
+    apacket* DequeueWrite();
+
     // ConnectionState can be read by all threads, but can only be written in the main thread.
     ConnectionState GetConnectionState() const;
     void SetConnectionState(ConnectionState state);
@@ -200,6 +214,12 @@ private:
     std::list<adisconnect*> disconnects_;
 
     std::atomic<ConnectionState> connection_state_;
+
+    // Packets sent on this transport and not yet taken by its write thread.
+    // This lock is per transport, it's never held with transport_lock.
+    std::mutex write_queue_lock_;
+    std::condition_variable write_queue_cv_;
+    std::deque<apacket*> write_queue_;
 #if ADB_HOST
     std::deque<std::shared_ptr<RSA>> keys_;
 #endif
@@ -62,6 +62,28 @@ static auto& local_transports GUARDED_BY(local_transports_lock) =
     *new std::unordered_map<int, atransport*>();
 #endif /* ADB_HOST */
 
+// Kernels autotune TCP buffers up to a system limit, and fixing a size turns
+// that off, so transport sockets keep their defaults unless told otherwise.
+// A link whose bandwidth-delay product outgrows the system limit can be given
+// larger buffers with $ADB_TCP_BUFFER_SIZE on the host, or the
+// persist.adb.tcp.buffer_size property on the device, in bytes.
+static void configure_tcp_transport_socket(int fd) {
+    disable_tcp_nagle(fd);
+
+#if ADB_HOST
+    const char* value = getenv("ADB_TCP_BUFFER_SIZE");
+    int size = value ? atoi(value) : 0;
+#else
+    int size = android::base::GetIntProperty("persist.adb.tcp.buffer_size", 0);
+#endif
+    if (size <= 0) return;
+
+    if (adb_setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != 0 ||
+        adb_setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+        D("warning: failed to set TCP buffer size to %d (%s)", size, strerror(errno));
+    }
+}
+
 bool local_connect(int port) {
     std::string dummy;
     return local_connect_arbitrary_ports(port - 1, port, &dummy) == 0;
@@ -90,7 +112,7 @@ void connect_device(const std::string& address, std::string* response) {
 
     D("client: connected %s remote on fd %d", serial.c_str(), fd);
     close_on_exec(fd);
-    disable_tcp_nagle(fd);
+    configure_tcp_transport_socket(fd);
 
     // Send a TCP keepalive ping to the device every second so we can detect disconnects.
     if (!set_tcp_keepalive(fd, 1)) {
@@ -128,7 +150,7 @@ int local_connect_arbitrary_ports(int console_port, int adb_port, std::string* e
     if (fd >= 0) {
         D("client: connected on remote on fd %d", fd);
         close_on_exec(fd);
-        disable_tcp_nagle(fd);
+        configure_tcp_transport_socket(fd);
         std::string serial = getEmulatorSerialString(console_port);
         if (register_socket_transport(fd, serial.c_str(), adb_port, 1) == 0) {
             return 0;
@@ -232,7 +254,7 @@ static void server_socket_thread(int port) {
         if(fd >= 0) {
             D("server: new connection on fd %d", fd);
             close_on_exec(fd);
-            disable_tcp_nagle(fd);
+            configure_tcp_transport_socket(fd);
             std::string serial = android::base::StringPrintf("host-%d", fd);
             if (register_socket_transport(fd, serial.c_str(), port, 1) != 0) {
                 adb_close(fd);
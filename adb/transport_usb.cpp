@@ -78,7 +78,7 @@ static int UsbReadPayload(usb_handle* h, apacket* p) {
     }
 
     p->payload.resize(len);
-    int rc = usb_read(h, &p->payload[0], p->payload.size());
+    int rc = usb_read(h, p->payload.data(), p->payload.size());
     if (rc != static_cast<int>(p->msg.data_length)) {
         return -1;
     }
@@ -87,7 +87,7 @@ static int UsbReadPayload(usb_handle* h, apacket* p) {
     return rc;
 #else
     p->payload.resize(p->msg.data_length);
-    return usb_read(h, &p->payload[0], p->payload.size());
+    return usb_read(h, p->payload.data(), p->payload.size());
 #endif
 }
 
@@ -133,7 +133,7 @@ static int remote_read(apacket* p, usb_handle* usb) {
         }
 
         p->payload.resize(p->msg.data_length);
-        if (usb_read(usb, &p->payload[0], p->payload.size())) {
+        if (usb_read(usb, p->payload.data(), p->payload.size())) {
             PLOG(ERROR) << "remote usb: terminated (data)";
             return -1;
         }
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include <android-base/logging.h>
+
+// A move-only, heap allocated byte buffer for packet payloads.
+//
+// Unlike std::string, allocating or resizing a Block doesn't initialize its
+// contents, so reading into a MAX_PAYLOAD sized Block only touches the pages
+// the read actually fills, and ownership is handed from socket to packet to
+// transport without the contents ever being copied. A Block may shrink, but
+// never grows past the size it was allocated with.
+struct Block {
+    using iterator = char*;
+
+    Block() {}
+
+    explicit Block(size_t size) { allocate(size); }
+
+    template <typename Iterator>
+    Block(Iterator begin, Iterator end) : Block(end - begin) {
+        std::copy(begin, end, data_.get());
+    }
+
+    Block(const Block& copy) = delete;
+    Block& operator=(const Block& copy) = delete;
+
+    Block(Block&& move) noexcept
+        : data_(std::move(move.data_)), capacity_(move.capacity_), size_(move.size_) {
+        move.capacity_ = 0;
+        move.size_ = 0;
+    }
+
+    Block& operator=(Block&& move) noexcept {
+        data_ = std::move(move.data_);
+        capacity_ = move.capacity_;
+        size_ = move.size_;
+        move.capacity_ = 0;
+        move.size_ = 0;
+        return *this;
+    }
+
+    // Allocates on first use, afterwards only shrinks or regrows within capacity().
+    void resize(size_t new_size) {
+        if (!data_) {
+            allocate(new_size);
+        } else {
+            CHECK_GE(capacity_, new_size);
+            size_ = new_size;
+        }
+    }
+
+    template <typename InputIt>
+    void assign(InputIt begin, InputIt end) {
+        clear();
+        allocate(end - begin);
+        std::copy(begin, end, data_.get());
+    }
+
+    // Trades a copy of size() bytes for the release of the unused capacity.
+    void shrink_to_fit() {
+        if (size_ != capacity_) {
+            *this = Block(begin(), end());
+        }
+    }
+
+    void clear() {
+        data_.reset();
+        capacity_ = 0;
+        size_ = 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size() == 0; }
+
+    char* data() { return data_.get(); }
+    const char* data() const { return data_.get(); }
+
+    char* begin() { return data_.get(); }
+    const char* begin() const { return data_.get(); }
+
+    char* end() { return data() + size_; }
+    const char* end() const { return data() + size_; }
+
+    char& operator[](size_t idx) { return data()[idx]; }
+    const char& operator[](size_t idx) const { return data()[idx]; }
+
+    bool operator==(const Block& rhs) const {
+        return size() == rhs.size() && memcmp(data(), rhs.data(), size()) == 0;
+    }
+
+  private:
+    void allocate(size_t size) {
+        CHECK(data_ == nullptr);
+        CHECK_EQ(0U, capacity_);
+        CHECK_EQ(0U, size_);
+        if (size != 0) {
+            data_.reset(new char[size]);
+            capacity_ = size;
+            size_ = size;
+        }
+    }
+
+    std::unique_ptr<char[]> data_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+};
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "types.h"
+
+#include <string>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "range.h"
+
+TEST(types, Block_empty) {
+    Block block;
+    ASSERT_TRUE(block.empty());
+    ASSERT_EQ(0ULL, block.size());
+    ASSERT_EQ(0ULL, block.capacity());
+    ASSERT_EQ(block.begin(), block.end());
+}
+
+TEST(types, Block_resize) {
+    Block block;
+    block.resize(1024);
+    ASSERT_EQ(1024ULL, block.size());
+    ASSERT_EQ(1024ULL, block.capacity());
+
+    char* data = block.data();
+    block.resize(16);
+    ASSERT_EQ(16ULL, block.size());
+    ASSERT_EQ(1024ULL, block.capacity());
+    ASSERT_EQ(data, block.data());
+
+    block.resize(1024);
+    ASSERT_EQ(1024ULL, block.size());
+    ASSERT_EQ(data, block.data());
+}
+
+TEST(types, Block_shrink_to_fit) {
+    std::string str = "hello, world";
+    Block block(1024);
+    std::copy(str.begin(), str.end(), block.begin());
+    block.resize(str.size());
+
+    block.shrink_to_fit();
+    ASSERT_EQ(str.size(), block.size());
+    ASSERT_EQ(str.size(), block.capacity());
+    ASSERT_EQ(str, std::string(block.begin(), block.end()));
+}
+
+TEST(types, Block_move) {
+    std::string str = "foobar";
+    Block block(str.begin(), str.end());
+    char* data = block.data();
+
+    Block moved(std::move(block));
+    ASSERT_TRUE(block.empty());
+    ASSERT_EQ(nullptr, block.data());
+    ASSERT_EQ(data, moved.data());
+    ASSERT_EQ(str, std::string(moved.begin(), moved.end()));
+
+    block = std::move(moved);
+    ASSERT_TRUE(moved.empty());
+    ASSERT_EQ(data, block.data());
+}
+
+TEST(types, Range_drop) {
+    std::string str = "0123456789";
+    Range range(Block(str.begin(), str.end()));
+    range.drop_front(2);
+    range.drop_end(3);
+    ASSERT_EQ(5ULL, range.size());
+    ASSERT_EQ("23456", std::string(range.begin(), range.end()));
+}
@@ -22,6 +22,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
 #include <memory>
 #include <mutex>
@@ -59,14 +62,93 @@ bool ReadFdToString(int fd, std::string* content) {
     content->reserve(sb.st_size);
   }
 
-  char buf[BUFSIZ];
+  // Read straight into the string, so that a string reused from call to call, as
+  // when polling a /proc file, needs neither a copy nor a new allocation.
+  size_t size = 0;
+  content->resize(content->capacity());
   ssize_t n;
-  while ((n = TEMP_FAILURE_RETRY(read(fd, &buf[0], sizeof(buf)))) > 0) {
-    content->append(buf, n);
+  while (true) {
+    if (size < content->size()) {
+      n = TEMP_FAILURE_RETRY(read(fd, &(*content)[size], content->size() - size));
+      if (n <= 0) break;
+      size += n;
+    } else {
+      // Only grow the string once we know there is more to read.
+      char buf[BUFSIZ];
+      n = TEMP_FAILURE_RETRY(read(fd, &buf[0], sizeof(buf)));
+      if (n <= 0) break;
+      content->append(buf, n);
+      size += n;
+      content->resize(content->capacity());
+    }
   }
+  content->resize(size);
   return (n == 0) ? true : false;
 }
 
+#if !defined(_WIN32)
+FileView::FileView() : map_(nullptr), map_size_(0) {}
+
+FileView::~FileView() {
+  Reset();
+}
+
+FileView::FileView(FileView&& other)
+    : map_(other.map_), map_size_(other.map_size_), buffer_(std::move(other.buffer_)) {
+  other.map_ = nullptr;
+  other.map_size_ = 0;
+}
+
+FileView& FileView::operator=(FileView&& other) {
+  if (this != &other) {
+    Reset();
+    map_ = other.map_;
+    map_size_ = other.map_size_;
+    buffer_ = std::move(other.buffer_);
+    other.map_ = nullptr;
+    other.map_size_ = 0;
+  }
+  return *this;
+}
+
+void FileView::Reset() {
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+  }
+  buffer_.clear();
+}
+
+bool ReadFdToView(int fd, FileView* view) {
+  view->Reset();
+
+  // Only regular files have a size to map, /proc files claim to be empty.
+  struct stat sb;
+  if (fstat(fd, &sb) != -1 && S_ISREG(sb.st_mode) &&
+      sb.st_size >= static_cast<off_t>(FileView::kMapThreshold)) {
+    void* map = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+      view->map_ = map;
+      view->map_size_ = sb.st_size;
+      return true;
+    }
+  }
+  return ReadFdToString(fd, &view->buffer_);
+}
+
+bool ReadFileToView(const std::string& path, FileView* view, bool follow_symlinks) {
+  view->Reset();
+
+  int flags = O_RDONLY | O_CLOEXEC | (follow_symlinks ? 0 : O_NOFOLLOW);
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags)));
+  if (fd == -1) {
+    return false;
+  }
+  return ReadFdToView(fd, view);
+}
+#endif
+
 bool ReadFileToString(const std::string& path, std::string* content, bool follow_symlinks) {
   content->clear();
 
@@ -141,6 +223,31 @@ bool WriteStringToFile(const std::string& content, const std::string& path,
   return WriteStringToFd(content, fd) || CleanUpAfterFailedWrite(path);
 }
 
+#if defined(__linux__)
+bool WriteStringToFilePreallocated(const std::string& content, const std::string& path,
+                                   bool sync, bool follow_symlinks) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (follow_symlinks ? 0 : O_NOFOLLOW);
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags, 0666)));
+  if (fd == -1) {
+    return false;
+  }
+
+  // Allocate all the blocks at once, so that the file system can keep them together.
+  // The size is kept, so that a failed write leaves no zeroes behind. This is only
+  // a hint: file systems without fallocate() still get the write.
+  if (!content.empty()) {
+    TEMP_FAILURE_RETRY(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, content.size()));
+  }
+  if (!WriteStringToFd(content, fd)) {
+    return CleanUpAfterFailedWrite(path);
+  }
+  if (sync && TEMP_FAILURE_RETRY(fdatasync(fd)) == -1) {
+    return CleanUpAfterFailedWrite(path);
+  }
+  return true;
+}
+#endif
+
 bool ReadFully(int fd, void* data, size_t byte_count) {
   uint8_t* p = reinterpret_cast<uint8_t*>(data);
   size_t remaining = byte_count;
@@ -257,3 +257,86 @@ TEST(file, ReadFileToString_capacity_0) {
   EXPECT_EQ(0U, s.size());
   EXPECT_EQ(initial_capacity, s.capacity());
 }
+
+TEST(file, ReadFdToString_reuse) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  ASSERT_TRUE(android::base::WriteStringToFile(std::string(100000, 'x'), tf.path));
+
+  // A string read into again keeps its storage.
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFileToString(tf.path, &s));
+  ASSERT_EQ(std::string(100000, 'x'), s);
+  const char* data = s.data();
+  ASSERT_TRUE(android::base::ReadFileToString(tf.path, &s));
+  ASSERT_EQ(std::string(100000, 'x'), s);
+  ASSERT_EQ(data, s.data());
+}
+
+#if !defined(_WIN32)
+TEST(file, ReadFdToString_pipe) {
+  // Pipes have no size to reserve for, so the string has to grow.
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  std::string expected;
+  for (size_t i = 0; i < 40000; i++) {
+    expected += static_cast<char>('a' + i % 26);
+  }
+  ASSERT_TRUE(android::base::WriteStringToFd(expected, fds[1]));
+  close(fds[1]);
+
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFdToString(fds[0], &s));
+  close(fds[0]);
+  ASSERT_EQ(expected, s);
+}
+
+TEST(file, ReadFileToView) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  android::base::FileView view;
+
+  ASSERT_TRUE(android::base::WriteStringToFile("abc", tf.path));
+  ASSERT_TRUE(android::base::ReadFileToView(tf.path, &view));
+  ASSERT_FALSE(view.mapped());
+  ASSERT_EQ("abc", std::string(view.data(), view.size()));
+
+  std::string large(android::base::FileView::kMapThreshold + 12345, 'x');
+  ASSERT_TRUE(android::base::WriteStringToFile(large, tf.path));
+  ASSERT_TRUE(android::base::ReadFileToView(tf.path, &view));
+  ASSERT_TRUE(view.mapped());
+  ASSERT_EQ(large, std::string(view.data(), view.size()));
+
+  android::base::FileView moved(std::move(view));
+  ASSERT_TRUE(moved.mapped());
+  ASSERT_FALSE(view.mapped());
+  ASSERT_EQ(0U, view.size());
+  ASSERT_EQ(large, std::string(moved.data(), moved.size()));
+}
+
+TEST(file, ReadFileToView_ENOENT) {
+  android::base::FileView view;
+  errno = 0;
+  ASSERT_FALSE(android::base::ReadFileToView("/proc/does-not-exist", &view));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(0U, view.size());
+}
+#endif
+
+#if defined(__linux__)
+TEST(file, WriteStringToFilePreallocated) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  std::string large(1024 * 1024, 'x');
+  ASSERT_TRUE(android::base::WriteStringToFilePreallocated(large, tf.path, true))
+      << strerror(errno);
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFileToString(tf.path, &s));
+  ASSERT_EQ(large, s);
+
+  // A shorter file replaces it entirely.
+  ASSERT_TRUE(android::base::WriteStringToFilePreallocated("abc", tf.path, false));
+  ASSERT_TRUE(android::base::ReadFileToString(tf.path, &s));
+  ASSERT_EQ("abc", s);
+}
+#endif
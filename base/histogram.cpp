@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "android-base/histogram.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+#include "android-base/stringprintf.h"
+
+namespace android {
+namespace base {
+
+Histogram::Histogram() {
+  Reset();
+}
+
+size_t Histogram::BucketIndex(uint64_t value) {
+  if (value < kSubBuckets) return value;
+  // The top kSubBucketBits + 1 bits pick the bucket, the rest are dropped.
+  size_t shift = (63 - __builtin_clzll(value)) - kSubBucketBits;
+  return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+}
+
+uint64_t Histogram::BucketLowest(size_t index) {
+  if (index < kSubBuckets) return index;
+  size_t shift = index / kSubBuckets - 1;
+  return static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+}
+
+uint64_t Histogram::BucketHighest(size_t index) {
+  if (index < kSubBuckets) return index;
+  size_t shift = index / kSubBuckets - 1;
+  return BucketLowest(index) + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+void Histogram::Record(uint64_t value) {
+  Shard& shard = shards_[std::hash<std::thread::id>()(std::this_thread::get_id()) % kShards];
+
+  shard.buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  shard.count.fetch_add(1, std::memory_order_relaxed);
+  shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t min = shard.min.load(std::memory_order_relaxed);
+  while (value < min &&
+         !shard.min.compare_exchange_weak(min, value, std::memory_order_relaxed)) {
+  }
+  uint64_t max = shard.max.load(std::memory_order_relaxed);
+  while (value > max &&
+         !shard.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot Histogram::Snapshot() const {
+  HistogramSnapshot snapshot;
+  snapshot.buckets.resize(kBucketCount);
+  uint64_t min = std::numeric_limits<uint64_t>::max();
+  uint64_t max = 0;
+
+  // Not atomic across the shards: a value recorded while this runs may be in
+  // the buckets but not yet in count, or the other way round.
+  for (const auto& shard : shards_) {
+    snapshot.count += shard.count.load(std::memory_order_relaxed);
+    snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    min = std::min(min, shard.min.load(std::memory_order_relaxed));
+    max = std::max(max, shard.max.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+    }
+  }
+  if (snapshot.count) {
+    snapshot.min = min;
+    snapshot.max = max;
+  }
+  return snapshot;
+}
+
+void Histogram::Reset() {
+  for (auto& shard : shards_) {
+    shard.count.store(0, std::memory_order_relaxed);
+    shard.sum.store(0, std::memory_order_relaxed);
+    shard.min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    shard.max.store(0, std::memory_order_relaxed);
+    for (auto& bucket : shard.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+uint64_t HistogramSnapshot::Percentile(double percentile) const {
+  uint64_t total = 0;
+  for (uint64_t n : buckets) total += n;
+  if (total == 0) return 0;
+
+  uint64_t rank = static_cast<uint64_t>(total * percentile / 100.0 + 0.5);
+  rank = std::max<uint64_t>(1, std::min(rank, total));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      // The exact min and max are tighter than the bucket bounds.
+      return std::max(min, std::min(max, Histogram::BucketHighest(i)));
+    }
+  }
+  return max;
+}
+
+Histogram* MetricsRegistry::GetHistogram(const std::string& name) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto& histogram = histograms_[name];
+  if (!histogram) histogram.reset(new Histogram());
+  return histogram.get();
+}
+
+Counter* MetricsRegistry::GetCounter(const std::string& name) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto& counter = counters_[name];
+  if (!counter) counter.reset(new Counter());
+  return counter.get();
+}
+
+std::string MetricsRegistry::Dump() const {
+  std::multimap<std::string, std::string> lines;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (const auto& it : counters_) {
+      lines.emplace(it.first,
+                    StringPrintf("%s %" PRIu64 "\n", it.first.c_str(), it.second->Get()));
+    }
+    for (const auto& it : histograms_) {
+      HistogramSnapshot s = it.second->Snapshot();
+      lines.emplace(it.first,
+                    StringPrintf("%s count=%" PRIu64 " min=%" PRIu64 " mean=%" PRIu64
+                                 " p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64 " max=%" PRIu64
+                                 "\n",
+                                 it.first.c_str(), s.count, s.min, s.Mean(), s.Percentile(50),
+                                 s.Percentile(90), s.Percentile(99), s.max));
+    }
+  }
+
+  std::string output;
+  for (const auto& it : lines) output += it.second;
+  return output;
+}
+
+void MetricsRegistry::Reset() {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (auto& it : counters_) it.second->Reset();
+  for (auto& it : histograms_) it.second->Reset();
+}
+
+MetricsRegistry& DefaultMetricsRegistry() {
+  // Never destroyed, so that threads still recording at exit are safe.
+  static MetricsRegistry* registry = new MetricsRegistry();
+  return *registry;
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "android-base/histogram.h"
+
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace base {
+
+TEST(histogram, bucket_bounds) {
+  for (uint64_t value = 0; value < Histogram::kSubBuckets; ++value) {
+    ASSERT_EQ(value, Histogram::BucketIndex(value));
+  }
+  ASSERT_EQ(Histogram::kBucketCount - 1,
+            Histogram::BucketIndex(std::numeric_limits<uint64_t>::max()));
+
+  for (size_t i = 0; i < Histogram::kBucketCount; ++i) {
+    uint64_t lowest = Histogram::BucketLowest(i);
+    uint64_t highest = Histogram::BucketHighest(i);
+    ASSERT_EQ(i, Histogram::BucketIndex(lowest));
+    ASSERT_EQ(i, Histogram::BucketIndex(highest));
+    if (i + 1 < Histogram::kBucketCount) {
+      ASSERT_EQ(highest + 1, Histogram::BucketLowest(i + 1));
+    }
+    // Every bucket is within 1/kSubBuckets of the values in it.
+    ASSERT_LE((highest - lowest) * Histogram::kSubBuckets, lowest);
+  }
+}
+
+TEST(histogram, empty) {
+  Histogram histogram;
+  HistogramSnapshot s = histogram.Snapshot();
+  ASSERT_EQ(0U, s.count);
+  ASSERT_EQ(0U, s.min);
+  ASSERT_EQ(0U, s.max);
+  ASSERT_EQ(0U, s.Mean());
+  ASSERT_EQ(0U, s.Percentile(50));
+}
+
+TEST(histogram, percentiles) {
+  Histogram histogram;
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value);
+  }
+  HistogramSnapshot s = histogram.Snapshot();
+  ASSERT_EQ(1000U, s.count);
+  ASSERT_EQ(1U, s.min);
+  ASSERT_EQ(1000U, s.max);
+  ASSERT_EQ(500U, s.Mean());
+  ASSERT_EQ(1U, s.Percentile(0));
+  ASSERT_EQ(1000U, s.Percentile(100));
+
+  uint64_t p50 = s.Percentile(50);
+  ASSERT_GE(p50, 500U);
+  ASSERT_LE(p50, 500U + 500U / Histogram::kSubBuckets);
+  uint64_t p99 = s.Percentile(99);
+  ASSERT_GE(p99, 990U);
+  ASSERT_LE(p99, 1000U);
+
+  histogram.Reset();
+  ASSERT_EQ(0U, histogram.Snapshot().count);
+}
+
+TEST(histogram, threads) {
+  Histogram histogram;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&histogram, t]() {
+      for (uint64_t i = 0; i < 10000; ++i) {
+        histogram.Record(t);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  HistogramSnapshot s = histogram.Snapshot();
+  ASSERT_EQ(80000U, s.count);
+  ASSERT_EQ(0U, s.min);
+  ASSERT_EQ(7U, s.max);
+  for (uint64_t t = 0; t < 8; ++t) {
+    ASSERT_EQ(10000U, s.buckets[t]);
+  }
+}
+
+TEST(histogram, registry_dump) {
+  MetricsRegistry registry;
+  Counter* counter = registry.GetCounter("b_counter");
+  ASSERT_EQ(counter, registry.GetCounter("b_counter"));
+  counter->Add();
+  counter->Add(2);
+  Histogram* histogram = registry.GetHistogram("a_latency_us");
+  ASSERT_EQ(histogram, registry.GetHistogram("a_latency_us"));
+  histogram->Record(3);
+  histogram->Record(5);
+
+  ASSERT_EQ(
+      "a_latency_us count=2 min=3 mean=4 p50=3 p90=5 p99=5 max=5\n"
+      "b_counter 3\n",
+      registry.Dump());
+
+  registry.Reset();
+  ASSERT_EQ(
+      "a_latency_us count=0 min=0 mean=0 p50=0 p90=0 p99=0 max=0\n"
+      "b_counter 0\n",
+      registry.Dump());
+}
+
+TEST(histogram, scoped_timer) {
+  Histogram histogram;
+  { ScopedHistogramTimer timer(&histogram); }
+  { ScopedHistogramTimer timer(nullptr); }
+  ASSERT_EQ(1U, histogram.Snapshot().count);
+}
+
+}  // namespace base
+}  // namespace android
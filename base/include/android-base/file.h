@@ -33,10 +33,51 @@ typedef off_t off64_t;
 namespace android {
 namespace base {
 
+// Reads into `content`, reusing its capacity: callers that read the same kind of
+// file over and over, like /proc files, can pass the same string every time.
 bool ReadFdToString(int fd, std::string* content);
 bool ReadFileToString(const std::string& path, std::string* content,
                       bool follow_symlinks = false);
 
+#if !defined(_WIN32)
+// The contents of a file, as read by ReadFdToView() or ReadFileToView(). Regular
+// files of at least kMapThreshold bytes are mapped read-only rather than copied,
+// the others (small files, /proc files, pipes) are read into memory.
+//
+// A mapped file must not be truncated while viewed, which would raise SIGBUS.
+class FileView {
+ public:
+  static constexpr size_t kMapThreshold = 128 * 1024;
+
+  FileView();
+  ~FileView();
+  FileView(FileView&& other);
+  FileView& operator=(FileView&& other);
+
+  const char* data() const {
+    return map_ != nullptr ? static_cast<const char*>(map_) : buffer_.data();
+  }
+  size_t size() const { return map_ != nullptr ? map_size_ : buffer_.size(); }
+  bool mapped() const { return map_ != nullptr; }
+
+  // Unmaps or frees the contents.
+  void Reset();
+
+ private:
+  friend bool ReadFdToView(int fd, FileView* view);
+
+  void* map_;
+  size_t map_size_;
+  std::string buffer_;
+
+  FileView(const FileView&) = delete;
+  FileView& operator=(const FileView&) = delete;
+};
+
+bool ReadFdToView(int fd, FileView* view);
+bool ReadFileToView(const std::string& path, FileView* view, bool follow_symlinks = false);
+#endif
+
 bool WriteStringToFile(const std::string& content, const std::string& path,
                        bool follow_symlinks = false);
 bool WriteStringToFd(const std::string& content, int fd);
@@ -47,6 +88,15 @@ bool WriteStringToFile(const std::string& content, const std::string& path,
                        bool follow_symlinks = false);
 #endif
 
+#if defined(__linux__)
+// Like WriteStringToFile(), for large contents: the blocks of the file are allocated
+// up front, and the contents written with as few write() calls as possible. If `sync`
+// is true, the data is also on storage when this returns. Callers writing many files
+// can pass false and sync them all once done instead.
+bool WriteStringToFilePreallocated(const std::string& content, const std::string& path,
+                                   bool sync, bool follow_symlinks = false);
+#endif
+
 bool ReadFully(int fd, void* data, size_t byte_count);
 
 // Reads `byte_count` bytes from the file descriptor at the specified offset.
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BASE_HISTOGRAM_H
+#define ANDROID_BASE_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "android-base/macros.h"
+
+namespace android {
+namespace base {
+
+// A copy of the counts of a Histogram at one point in time.
+struct HistogramSnapshot {
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = 0;
+  uint64_t max = 0;
+  // Indexed like Histogram::BucketIndex().
+  std::vector<uint64_t> buckets;
+
+  // Returns the value at or below which |percentile| (0 to 100) of the
+  // recorded values fall, to the precision of the buckets.
+  uint64_t Percentile(double percentile) const;
+  uint64_t Mean() const { return count ? sum / count : 0; }
+};
+
+// A fixed size histogram of uint64_t values, typically latencies in
+// microseconds or sizes in bytes. Like HdrHistogram, every power of two is
+// split into kSubBuckets linear buckets, so reported values are within
+// 1/kSubBuckets of what was recorded whatever their magnitude, and values
+// below kSubBuckets are exact.
+//
+// Record() takes no lock and allocates nothing. To keep threads recording at
+// the same time from fighting over the same cache lines, the counts are
+// spread over kShards copies picked by thread id, which Snapshot() merges.
+class Histogram {
+ public:
+  static constexpr size_t kSubBucketBits = 4;
+  static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+  static constexpr size_t kShards = 4;
+
+  Histogram();
+
+  void Record(uint64_t value);
+  HistogramSnapshot Snapshot() const;
+  void Reset();
+
+  static size_t BucketIndex(uint64_t value);
+  // Returns the smallest and largest values that go in bucket |index|.
+  static uint64_t BucketLowest(size_t index);
+  static uint64_t BucketHighest(size_t index);
+
+ private:
+  struct Shard {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[kBucketCount];
+  };
+
+  Shard shards_[kShards];
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+// A monotonic event counter.
+class Counter {
+ public:
+  Counter() : value_(0) {}
+
+  void Add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t Get() const { return value_.load(std::memory_order_relaxed); }
+  void Reset() { value_.store(0, std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_;
+
+  DISALLOW_COPY_AND_ASSIGN(Counter);
+};
+
+// Records the time from construction to destruction, in microseconds, in a
+// Histogram. |histogram| may be null.
+class ScopedHistogramTimer {
+ public:
+  explicit ScopedHistogramTimer(Histogram* histogram)
+      : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+  ~ScopedHistogramTimer() {
+    if (histogram_ == nullptr) return;
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    histogram_->Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+  }
+
+ private:
+  Histogram* histogram_;
+  std::chrono::steady_clock::time_point start_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedHistogramTimer);
+};
+
+// Named histograms and counters, so that a daemon can look them up where
+// it records, and dump them all from its existing statistics command.
+// The pointers returned stay valid as long as the registry.
+class MetricsRegistry {
+ public:
+  MetricsRegistry() = default;
+
+  // Returns the histogram or counter called |name|, creating it if needed.
+  // This takes a lock, so callers on hot paths should keep the pointer.
+  Histogram* GetHistogram(const std::string& name);
+  Counter* GetCounter(const std::string& name);
+
+  // One line per metric, sorted by name:
+  //   <name> <value>
+  //   <name> count=<n> min=<v> mean=<v> p50=<v> p90=<v> p99=<v> max=<v>
+  std::string Dump() const;
+  void Reset();
+
+ private:
+  mutable std::mutex lock_;
+  std::map<std::string, std::unique_ptr<Histogram>> histograms_;
+  std::map<std::string, std::unique_ptr<Counter>> counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsRegistry);
+};
+
+// A process wide registry, for the common case of a daemon with one.
+MetricsRegistry& DefaultMetricsRegistry();
+
+}  // namespace base
+}  // namespace android
+
+#endif  // ANDROID_BASE_HISTOGRAM_H
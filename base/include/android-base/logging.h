@@ -123,6 +123,34 @@ class LogdLogger {
 };
 #endif
 
+#if !defined(_WIN32)
+// A logger that passes the messages on to another logger from a background
+// thread, so that the threads that log only wait for a copy of the message
+// to be queued. FATAL and FATAL_WITHOUT_ABORT messages flush the queue and are
+// logged right away, so that they're out before an abort. After fork(), the
+// child logs synchronously, as the thread isn't there anymore.
+//
+//   SetLogger(AsyncLogger(LogdLogger()));
+//
+// The queue has room for queue_size messages, and logging waits when it's
+// full. Copies share the same queue and thread. Messages still queued when the
+// process exits are lost, unless it calls Flush() first.
+class AsyncLogger {
+ public:
+  explicit AsyncLogger(LogFunction&& logger, size_t queue_size = 256);
+
+  void operator()(LogId, LogSeverity, const char* tag, const char* file,
+                  unsigned int line, const char* message);
+
+  // Waits for the queued messages to be logged.
+  void Flush();
+
+ private:
+  struct State;
+  std::shared_ptr<State> state_;
+};
+#endif
+
 // Configure logging based on ANDROID_LOG_TAGS environment variable.
 // We need to parse a string that looks like
 //
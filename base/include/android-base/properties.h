@@ -17,6 +17,7 @@
 #ifndef ANDROID_BASE_PROPERTIES_H
 #define ANDROID_BASE_PROPERTIES_H
 
+#include <stdint.h>
 #include <sys/cdefs.h>
 
 #if !defined(__BIONIC__)
@@ -27,6 +28,8 @@
 #include <limits>
 #include <string>
 
+struct prop_info;
+
 namespace android {
 namespace base {
 
@@ -53,6 +56,50 @@ template <typename T> T GetUintProperty(const std::string& key,
                                         T default_value,
                                         T max = std::numeric_limits<T>::max());
 
+// A handle on the system property `key` for the callers that read it over and over,
+// such as on every request or in a polling loop. The property is looked up once,
+// and its value only read again once the property changed, which is much cheaper
+// than GetProperty(). A property that doesn't exist yet is picked up once created.
+//
+// Not thread-safe: use one per thread, or a lock.
+class CachedProperty {
+ public:
+  explicit CachedProperty(const std::string& key);
+
+  // Returns the current value of the property, or the empty string if the property
+  // doesn't exist. If `changed` is not null, sets it to whether the value differs from
+  // the one the previous call returned; always true for the first call.
+  //
+  // The reference is valid until the next call.
+  const std::string& Get(bool* changed = nullptr);
+
+ private:
+  std::string key_;
+  const prop_info* prop_info_;
+  uint32_t area_serial_;
+  uint32_t property_serial_;
+  bool read_;
+  std::string value_;
+
+  CachedProperty(const CachedProperty&) = delete;
+  CachedProperty& operator=(const CachedProperty&) = delete;
+};
+
+// A CachedProperty for the callers of GetBoolProperty(), which parses each value once.
+class CachedBoolProperty {
+ public:
+  explicit CachedBoolProperty(const std::string& key);
+
+  // Returns what GetBoolProperty(key, default_value) would.
+  bool Get(bool default_value);
+
+ private:
+  enum State { kUnset, kTrue, kFalse };
+
+  CachedProperty property_;
+  State state_;
+};
+
 // Sets the system property `key` to `value`.
 // Note that system property setting is inherently asynchronous so a return value of `true`
 // isn't particularly meaningful, and immediately reading back the value won't necessarily
@@ -62,6 +109,8 @@ bool SetProperty(const std::string& key, const std::string& value);
 // Waits for the system property `key` to have the value `expected_value`.
 // Times out after `relative_timeout`.
 // Returns true on success, false on timeout.
+// Once `key` exists, this only wakes up when `key` itself changes; until then, it wakes up on
+// every property change to look for it, as WaitForPropertyCreation() does.
 bool WaitForProperty(const std::string& key, const std::string& expected_value,
                      std::chrono::milliseconds relative_timeout = std::chrono::milliseconds::max());
 
@@ -35,11 +35,18 @@
 #include <sys/uio.h>
 #endif
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <limits>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -273,6 +280,143 @@ void LogdLogger::operator()(LogId id, LogSeverity severity, const char* tag,
 }
 #endif
 
+#if !defined(_WIN32)
+// Incremented in the child after fork(), where the threads of the AsyncLoggers
+// of the parent don't exist.
+static std::atomic<unsigned> gForkGeneration(0);
+
+struct AsyncLogger::State {
+  struct Entry {
+    LogId id;
+    LogSeverity severity;
+    unsigned int line;
+    std::string tag;
+    std::string file;
+    std::string message;
+  };
+
+  State(LogFunction&& logger, size_t queue_size);
+  ~State();
+
+  bool Forked() const { return fork_generation != gForkGeneration; }
+  void Wake();
+  void Drain();
+  void Run();
+
+  LogFunction logger;
+  // Loggers are only called with LoggingLock held, so the queue has a single
+  // producer, and a single consumer: the thread. head and tail only grow, and
+  // are each written by one side.
+  std::vector<Entry> entries;
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<bool> sleeping;
+  std::atomic<bool> stopping;
+  std::mutex wake_lock;
+  std::condition_variable wake;
+  const unsigned fork_generation;
+  std::unique_ptr<std::thread> thread;
+};
+
+AsyncLogger::State::State(LogFunction&& logger, size_t queue_size)
+    : logger(std::move(logger)),
+      entries(queue_size > 0 ? queue_size : 1),
+      head(0),
+      tail(0),
+      sleeping(false),
+      stopping(false),
+      fork_generation(gForkGeneration) {
+  static std::once_flag once;
+  std::call_once(once, []() { pthread_atfork(nullptr, nullptr, []() { gForkGeneration++; }); });
+  thread.reset(new std::thread(&State::Run, this));
+}
+
+AsyncLogger::State::~State() {
+  if (Forked()) {
+    // There's no thread to join in the child.
+    thread.release();
+    return;
+  }
+  stopping = true;
+  Wake();
+  thread->join();
+}
+
+void AsyncLogger::State::Wake() {
+  // Taking the lock orders this with the check of the thread before it waits.
+  { std::lock_guard<std::mutex> lock(wake_lock); }
+  wake.notify_one();
+}
+
+void AsyncLogger::State::Drain() {
+  while (head != tail) {
+    std::this_thread::yield();
+  }
+}
+
+void AsyncLogger::State::Run() {
+  while (true) {
+    size_t next = head.load(std::memory_order_relaxed);
+    if (next == tail.load(std::memory_order_acquire)) {
+      std::unique_lock<std::mutex> lock(wake_lock);
+      sleeping = true;
+      wake.wait(lock, [this, next]() { return tail != next || stopping; });
+      sleeping = false;
+      if (tail == next) {
+        return;
+      }
+      continue;
+    }
+
+    const Entry& entry = entries[next % entries.size()];
+    logger(entry.id, entry.severity, entry.tag.c_str(), entry.file.c_str(), entry.line,
+           entry.message.c_str());
+    head.store(next + 1, std::memory_order_release);
+  }
+}
+
+AsyncLogger::AsyncLogger(LogFunction&& logger, size_t queue_size)
+    : state_(std::make_shared<State>(std::move(logger), queue_size)) {}
+
+void AsyncLogger::operator()(LogId id, LogSeverity severity, const char* tag, const char* file,
+                             unsigned int line, const char* message) {
+  State& state = *state_;
+  if (state.Forked()) {
+    state.logger(id, severity, tag, file, line, message);
+    return;
+  }
+  if (severity >= FATAL_WITHOUT_ABORT) {
+    // Once the queue is empty, the thread is done with the logger.
+    state.Drain();
+    state.logger(id, severity, tag, file, line, message);
+    return;
+  }
+
+  size_t next = state.tail.load(std::memory_order_relaxed);
+  while (next - state.head.load(std::memory_order_acquire) == state.entries.size()) {
+    // Rather wait for the thread than drop or reorder messages.
+    std::this_thread::yield();
+  }
+  State::Entry& entry = state.entries[next % state.entries.size()];
+  entry.id = id;
+  entry.severity = severity;
+  entry.line = line;
+  entry.tag.assign(tag);
+  entry.file.assign(file);
+  entry.message.assign(message);
+  state.tail = next + 1;
+  if (state.sleeping) {
+    state.Wake();
+  }
+}
+
+void AsyncLogger::Flush() {
+  if (!state_->Forked()) {
+    state_->Drain();
+  }
+}
+#endif
+
 void InitLogging(char* argv[], LogFunction&& logger, AbortFunction&& aborter) {
   SetLogger(std::forward<LogFunction>(logger));
   SetAborter(std::forward<AbortFunction>(aborter));
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+// Does the formatting and the write(2) that StderrLogger does, to /dev/null.
+static void DevNullLogger(android::base::LogId, android::base::LogSeverity, const char* tag,
+                          const char* file, unsigned int line, const char* message) {
+  static int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  std::string output = android::base::StringPrintf("%s %s:%u] %s\n", tag, file, line, message);
+  android::base::WriteFully(fd, output.data(), output.size());
+}
+
+static void BM_LOG(benchmark::State& state, bool async) {
+  if (state.thread_index == 0) {
+    if (async) {
+      android::base::SetLogger(android::base::AsyncLogger(DevNullLogger));
+    } else {
+      android::base::SetLogger(DevNullLogger);
+    }
+  }
+  while (state.KeepRunning()) {
+    LOG(INFO) << "message " << state.iterations();
+  }
+  if (state.thread_index == 0) {
+    // Replacing the logger waits for the queue to be drained.
+    android::base::SetLogger(DevNullLogger);
+  }
+}
+
+static void BM_LOG_sync(benchmark::State& state) {
+  BM_LOG(state, false);
+}
+BENCHMARK(BM_LOG_sync)->ThreadRange(1, 8);
+
+static void BM_LOG_async(benchmark::State& state) {
+  BM_LOG(state, true);
+}
+BENCHMARK(BM_LOG_async)->ThreadRange(1, 8);
+
+BENCHMARK_MAIN();
@@ -24,6 +24,8 @@
 
 #include <regex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "android-base/file.h"
 #include "android-base/stringprintf.h"
@@ -623,3 +625,43 @@ TEST(logging, SetDefaultTag) {
   }
   CheckMessage(cap, android::base::LogSeverity::INFO, expected_msg, expected_tag);
 }
+
+#if !defined(_WIN32)
+TEST(logging, AsyncLogger) {
+  std::vector<std::string> messages;
+  std::thread::id caller = std::this_thread::get_id();
+  std::thread::id fatal_logger;
+  android::base::AsyncLogger logger(
+      [&messages, &fatal_logger](android::base::LogId, android::base::LogSeverity severity,
+                                 const char* tag, const char*, unsigned int, const char* message) {
+        messages.push_back(android::base::StringPrintf("%s: %s", tag, message));
+        if (severity == android::base::FATAL_WITHOUT_ABORT) {
+          fatal_logger = std::this_thread::get_id();
+        }
+      },
+      4);
+  android::base::SetLogger(android::base::AsyncLogger(logger));
+
+  {
+    android::base::ScopedLogSeverity sls(android::base::INFO);
+    for (int i = 0; i < 10; i++) {
+      LOG(INFO) << "message " << i;
+    }
+    LOG(ERROR) << "two\nlines";
+    LOG(FATAL_WITHOUT_ABORT) << "fatal";
+  }
+
+  // The fatal message is logged by the caller, after all the others.
+  EXPECT_EQ(caller, fatal_logger);
+  ASSERT_EQ(13U, messages.size());
+  std::string tag = android::base::GetDefaultTag();
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(android::base::StringPrintf("%s: message %d", tag.c_str(), i), messages[i]);
+  }
+  EXPECT_EQ(tag + ": two", messages[10]);
+  EXPECT_EQ(tag + ": lines", messages[11]);
+  EXPECT_EQ(tag + ": fatal", messages[12]);
+
+  android::base::SetLogger(android::base::StderrLogger);
+}
+#endif
@@ -49,8 +49,7 @@ std::string GetProperty(const std::string& key, const std::string& default_value
   return property_value.empty() ? default_value : property_value;
 }
 
-bool GetBoolProperty(const std::string& key, bool default_value) {
-  std::string value = GetProperty(key, "");
+static bool ParseBoolProperty(const std::string& value, bool default_value) {
   if (value == "1" || value == "y" || value == "yes" || value == "on" || value == "true") {
     return true;
   } else if (value == "0" || value == "n" || value == "no" || value == "off" || value == "false") {
@@ -59,6 +58,10 @@ bool GetBoolProperty(const std::string& key, bool default_value) {
   return default_value;
 }
 
+bool GetBoolProperty(const std::string& key, bool default_value) {
+  return ParseBoolProperty(GetProperty(key, ""), default_value);
+}
+
 template <typename T>
 T GetIntProperty(const std::string& key, T default_value, T min, T max) {
   T result;
@@ -85,6 +88,68 @@ template uint16_t GetUintProperty(const std::string&, uint16_t, uint16_t);
 template uint32_t GetUintProperty(const std::string&, uint32_t, uint32_t);
 template uint64_t GetUintProperty(const std::string&, uint64_t, uint64_t);
 
+CachedProperty::CachedProperty(const std::string& key)
+    : key_(key), prop_info_(nullptr), area_serial_(0), property_serial_(0), read_(false) {}
+
+const std::string& CachedProperty::Get(bool* changed) {
+  bool updated = false;
+  bool found = false;
+
+  if (prop_info_ == nullptr) {
+    // The property may have been created since the last lookup, but only if the
+    // serial of the whole area changed.
+    uint32_t area_serial = __system_property_area_serial();
+    if (!read_ || area_serial != area_serial_) {
+      area_serial_ = area_serial;
+      prop_info_ = __system_property_find(key_.c_str());
+      found = prop_info_ != nullptr;
+    }
+  }
+
+  if (prop_info_ != nullptr) {
+    // The serial of a property changes with every write, so an unchanged serial
+    // means the value we have is current.
+    if (!read_ || found || __system_property_serial(prop_info_) != property_serial_) {
+      std::string old_value;
+      old_value.swap(value_);
+      __system_property_read_callback(prop_info_,
+                                      [](void* cookie, const char*, const char* value,
+                                         unsigned serial) {
+                                        auto property = reinterpret_cast<CachedProperty*>(cookie);
+                                        property->value_ = value;
+                                        property->property_serial_ = serial;
+                                      },
+                                      this);
+      updated = !read_ || value_ != old_value;
+    }
+  } else if (!read_) {
+    updated = true;
+  }
+
+  read_ = true;
+  if (changed != nullptr) *changed = updated;
+  return value_;
+}
+
+CachedBoolProperty::CachedBoolProperty(const std::string& key)
+    : property_(key), state_(kUnset) {}
+
+bool CachedBoolProperty::Get(bool default_value) {
+  bool changed;
+  const std::string& value = property_.Get(&changed);
+  if (changed) {
+    // Parse the value once per change rather than on every call.
+    if (ParseBoolProperty(value, false)) {
+      state_ = kTrue;
+    } else if (!ParseBoolProperty(value, true)) {
+      state_ = kFalse;
+    } else {
+      state_ = kUnset;
+    }
+  }
+  return state_ == kUnset ? default_value : state_ == kTrue;
+}
+
 bool SetProperty(const std::string& key, const std::string& value) {
   return (__system_property_set(key.c_str(), value.c_str()) == 0);
 }
@@ -135,11 +200,14 @@ static const prop_info* WaitForPropertyCreation(const std::string& key,
                                                 const std::chrono::milliseconds& relative_timeout,
                                                 const AbsTime& start_time) {
   // Find the property's prop_info*.
+  // The area serial is read before looking, so that the first wait only returns once something
+  // changed since then, rather than at once because the serial isn't 0.
   const prop_info* pi;
-  unsigned global_serial = 0;
+  unsigned global_serial = __system_property_area_serial();
   while ((pi = __system_property_find(key.c_str())) == nullptr) {
     // The property doesn't even exist yet.
-    // Wait for a global change and then look again.
+    // Wait for a global change and then look again. Only a property's own serial can tell its
+    // changes apart from the others', so this wakes for every property set until it exists.
     timespec ts;
     UpdateTimeSpec(ts, relative_timeout, start_time);
     if (!__system_property_wait(nullptr, global_serial, &global_serial, &ts)) return nullptr;
@@ -16,6 +16,8 @@
 
 #include "android-base/properties.h"
 
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 #include <atomic>
@@ -204,3 +206,52 @@ TEST(properties, WaitForPropertyCreation_timeout) {
   // Upper bounds on timing are inherently flaky, but let's try...
   ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0), 600ms);
 }
+
+TEST(properties, CachedProperty) {
+  android::base::SetProperty("debug.libbase.CachedProperty_test", "a");
+  android::base::CachedProperty property("debug.libbase.CachedProperty_test");
+
+  bool changed;
+  ASSERT_EQ("a", property.Get(&changed));
+  ASSERT_TRUE(changed);
+  ASSERT_EQ("a", property.Get(&changed));
+  ASSERT_FALSE(changed);
+
+  android::base::SetProperty("debug.libbase.CachedProperty_test", "b");
+  ASSERT_EQ("b", property.Get(&changed));
+  ASSERT_TRUE(changed);
+
+  // Writing the same value again isn't a change.
+  android::base::SetProperty("debug.libbase.CachedProperty_test", "b");
+  ASSERT_EQ("b", property.Get(&changed));
+  ASSERT_FALSE(changed);
+}
+
+TEST(properties, CachedProperty_creation) {
+  // Properties can't be deleted, so use a new one for each run.
+  std::string key = "debug.libbase.CachedProperty_creation_test_" + std::to_string(getpid());
+  android::base::CachedProperty property(key);
+
+  bool changed;
+  ASSERT_EQ("", property.Get(&changed));
+  ASSERT_TRUE(changed);
+  ASSERT_EQ("", property.Get(&changed));
+  ASSERT_FALSE(changed);
+
+  android::base::SetProperty(key, "a");
+  ASSERT_EQ("a", property.Get(&changed));
+  ASSERT_TRUE(changed);
+}
+
+TEST(properties, CachedBoolProperty) {
+  android::base::SetProperty("debug.libbase.CachedProperty_test", "burp");
+  android::base::CachedBoolProperty property("debug.libbase.CachedProperty_test");
+  ASSERT_TRUE(property.Get(true));
+  ASSERT_FALSE(property.Get(false));
+
+  android::base::SetProperty("debug.libbase.CachedProperty_test", "yes");
+  ASSERT_TRUE(property.Get(false));
+
+  android::base::SetProperty("debug.libbase.CachedProperty_test", "off");
+  ASSERT_FALSE(property.Get(true));
+}
@@ -17,9 +17,13 @@
 #include "boot_event_record_store.h"
 
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
-#include <utime.h>
+#include <unistd.h>
 
 #include <chrono>
 #include <cstdlib>
@@ -30,11 +34,19 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/unique_fd.h>
 
 namespace {
 
 const char BOOTSTAT_DATA_DIR[] = "/data/misc/bootstat/";
 
+// The event log in the record store, made of "<event> <value>\n" records.
+const char EVENT_LOG_NAME[] = ".boot_event_log";
+
+// The event log is compacted once an append takes it past this size. A boot
+// appends a few dozen records, of a few dozen bytes each.
+const off_t COMPACT_LOG_SIZE = 16 * 1024;
+
 // Given a boot even record file at |path|, extracts the event's relative time
 // from the record into |uptime|.
 bool ParseRecordEventTime(const std::string& path, int32_t* uptime) {
@@ -51,9 +63,59 @@ bool ParseRecordEventTime(const std::string& path, int32_t* uptime) {
   return true;
 }
 
+// Parses the records of the event |log| into |index|, later records of an
+// event replacing earlier ones. A last record without its newline is being
+// appended, and is skipped.
+void ParseEventLog(const std::string& log, std::map<std::string, int32_t>* index) {
+  size_t start = 0;
+  size_t end;
+  while ((end = log.find('\n', start)) != std::string::npos) {
+    size_t space = log.rfind(' ', end);
+    int32_t value;
+    if (space != std::string::npos && space > start &&
+        android::base::ParseInt(log.substr(space + 1, end - space - 1), &value)) {
+      (*index)[log.substr(start, space - start)] = value;
+    } else {
+      LOG(ERROR) << "Malformed boot event record: " << log.substr(start, end - start);
+    }
+    start = end + 1;
+  }
+}
+
+// Opens the event log at |path| with |flags|, and locks it with |operation|.
+// Appends take a shared lock, so that they don't wait for each other, and a
+// compaction an exclusive one, so that no append is lost to the log it
+// replaces. Returns -1 on failure.
+android::base::unique_fd OpenLockedEventLog(const std::string& path, int flags, int operation) {
+  while (true) {
+    android::base::unique_fd fd(
+        TEMP_FAILURE_RETRY(open(path.c_str(), flags | O_CLOEXEC, S_IRUSR | S_IWUSR)));
+    if (fd == -1) {
+      PLOG(ERROR) << "Failed to open " << path;
+      return fd;
+    }
+    if (TEMP_FAILURE_RETRY(flock(fd, operation)) == -1) {
+      PLOG(ERROR) << "Failed to lock " << path;
+      return android::base::unique_fd();
+    }
+
+    // Retry if the log was compacted, and so replaced, before it was locked.
+    struct stat fd_stat;
+    struct stat path_stat;
+    if (fstat(fd, &fd_stat) == -1) {
+      PLOG(ERROR) << "Failed to read " << path;
+      return android::base::unique_fd();
+    }
+    if (stat(path.c_str(), &path_stat) == 0 && path_stat.st_dev == fd_stat.st_dev &&
+        path_stat.st_ino == fd_stat.st_ino) {
+      return fd;
+    }
+  }
+}
+
 }  // namespace
 
-BootEventRecordStore::BootEventRecordStore() {
+BootEventRecordStore::BootEventRecordStore() : index_loaded_(false) {
   SetStorePath(BOOTSTAT_DATA_DIR);
 }
 
@@ -63,42 +125,48 @@ void BootEventRecordStore::AddBootEvent(const std::string& event) {
   AddBootEventWithValue(event, uptime.count());
 }
 
-// The implementation of AddBootEventValue makes use of the mtime file
-// attribute to store the value associated with a boot event in order to
-// optimize on-disk size requirements and small-file thrashing.
 void BootEventRecordStore::AddBootEventWithValue(const std::string& event, int32_t value) {
-  std::string record_path = GetBootEventPath(event);
-  int record_fd = creat(record_path.c_str(), S_IRUSR | S_IWUSR);
-  if (record_fd == -1) {
-    PLOG(ERROR) << "Failed to create " << record_path;
+  if (event.empty() || event.find('\n') != std::string::npos) {
+    LOG(ERROR) << "Invalid boot event name: " << event;
     return;
   }
 
-  // Fill out the stat structure for |record_path| in order to get the atime to
-  // set in the utime() call.
-  struct stat file_stat;
-  if (stat(record_path.c_str(), &file_stat) == -1) {
-    PLOG(ERROR) << "Failed to read " << record_path;
-    close(record_fd);
+  const std::string log_path = GetLogPath();
+  android::base::unique_fd log_fd =
+      OpenLockedEventLog(log_path, O_WRONLY | O_APPEND | O_CREAT, LOCK_SH);
+  if (log_fd == -1) {
     return;
   }
 
-  // Set the |modtime| of the file to store the value of the boot event while
-  // preserving the |actime| (as read by stat).
-  struct utimbuf times = {/* actime */ file_stat.st_atime, /* modtime */ value};
-  if (utime(record_path.c_str(), &times) == -1) {
-    PLOG(ERROR) << "Failed to set mtime for " << record_path;
-    close(record_fd);
+  // Appending the record in a single write keeps concurrent records whole.
+  const std::string record = event + " " + std::to_string(value) + "\n";
+  if (TEMP_FAILURE_RETRY(write(log_fd, record.data(), record.size())) !=
+      static_cast<ssize_t>(record.size())) {
+    PLOG(ERROR) << "Failed to write " << log_path;
     return;
   }
+  if (index_loaded_) {
+    index_[event] = value;
+  }
 
-  close(record_fd);
+  struct stat log_stat;
+  if (fstat(log_fd, &log_stat) == 0 && log_stat.st_size > COMPACT_LOG_SIZE) {
+    log_fd.reset();
+    CompactLog();
+  }
 }
 
 bool BootEventRecordStore::GetBootEvent(const std::string& event, BootEventRecord* record) const {
   CHECK_NE(static_cast<BootEventRecord*>(nullptr), record);
   CHECK(!event.empty());
 
+  LoadIndex();
+  auto it = index_.find(event);
+  if (it != index_.end()) {
+    *record = *it;
+    return true;
+  }
+
   const std::string record_path = GetBootEventPath(event);
   int32_t uptime;
   if (!ParseRecordEventTime(record_path, &uptime)) {
@@ -113,6 +181,9 @@ bool BootEventRecordStore::GetBootEvent(const std::string& event, BootEventRecor
 std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::GetAllBootEvents() const {
   std::vector<BootEventRecord> events;
 
+  LoadIndex();
+  events.assign(index_.begin(), index_.end());
+
   std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(store_path_.c_str()), closedir);
 
   // This case could happen due to external manipulation of the filesystem,
@@ -126,14 +197,20 @@ std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::GetAllB
       continue;
     }
 
+    // Skip the event log, and events the event log has a newer record of.
     const std::string event = entry->d_name;
-    BootEventRecord record;
-    if (!GetBootEvent(event, &record)) {
+    if (event.compare(0, strlen(EVENT_LOG_NAME), EVENT_LOG_NAME) == 0 ||
+        index_.find(event) != index_.end()) {
+      continue;
+    }
+
+    int32_t uptime;
+    if (!ParseRecordEventTime(GetBootEventPath(event), &uptime)) {
       LOG(ERROR) << "Failed to parse boot time event: " << event;
       continue;
     }
 
-    events.push_back(record);
+    events.push_back(std::make_pair(event, uptime));
   }
 
   return events;
@@ -142,9 +219,78 @@ std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::GetAllB
 void BootEventRecordStore::SetStorePath(const std::string& path) {
   DCHECK_EQ('/', path.back());
   store_path_ = path;
+  index_.clear();
+  index_loaded_ = false;
 }
 
 std::string BootEventRecordStore::GetBootEventPath(const std::string& event) const {
   DCHECK_EQ('/', store_path_.back());
   return store_path_ + event;
 }
+
+std::string BootEventRecordStore::GetLogPath() const {
+  DCHECK_EQ('/', store_path_.back());
+  return store_path_ + EVENT_LOG_NAME;
+}
+
+void BootEventRecordStore::LoadIndex() const {
+  if (index_loaded_) {
+    return;
+  }
+  index_loaded_ = true;
+
+  // Appends and compactions keep the event log whole, so it is read without
+  // locking it.
+  std::string log;
+  const std::string log_path = GetLogPath();
+  if (!android::base::ReadFileToString(log_path, &log)) {
+    if (errno != ENOENT) {
+      PLOG(ERROR) << "Failed to read " << log_path;
+    }
+    return;
+  }
+  ParseEventLog(log, &index_);
+}
+
+void BootEventRecordStore::CompactLog() const {
+  const std::string log_path = GetLogPath();
+  android::base::unique_fd log_fd = OpenLockedEventLog(log_path, O_RDONLY, LOCK_EX);
+  if (log_fd == -1) {
+    return;
+  }
+
+  // Another process may have compacted the log before it was locked.
+  std::string log;
+  if (!android::base::ReadFdToString(log_fd, &log)) {
+    PLOG(ERROR) << "Failed to read " << log_path;
+    return;
+  }
+  if (static_cast<off_t>(log.size()) <= COMPACT_LOG_SIZE) {
+    return;
+  }
+
+  std::map<std::string, int32_t> index;
+  ParseEventLog(log, &index);
+  std::string compacted;
+  for (const auto& record : index) {
+    compacted += record.first + " " + std::to_string(record.second) + "\n";
+  }
+
+  // Replace the log as a whole, so that readers see either log.
+  const std::string tmp_path = log_path + ".tmp";
+  android::base::unique_fd tmp_fd(TEMP_FAILURE_RETRY(
+      open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)));
+  if (tmp_fd == -1) {
+    PLOG(ERROR) << "Failed to create " << tmp_path;
+    return;
+  }
+  if (!android::base::WriteStringToFd(compacted, tmp_fd) || fsync(tmp_fd) == -1 ||
+      rename(tmp_path.c_str(), log_path.c_str()) == -1) {
+    PLOG(ERROR) << "Failed to compact " << log_path;
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  index_ = std::move(index);
+  index_loaded_ = true;
+}
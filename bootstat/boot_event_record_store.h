@@ -20,12 +20,18 @@
 #include <android-base/macros.h>
 #include <gtest/gtest_prod.h>
 #include <cstdint>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
 // BootEventRecordStore manages the persistence of boot events to the record
 // store and the retrieval of all boot event records from the store.
+//
+// Events are appended to a single log file in the store, the last record of
+// an event being its value. Processes add events concurrently without
+// excluding each other, and the log is compacted once it grows large. Events
+// stored as one file each by older versions are still read.
 class BootEventRecordStore {
  public:
   // A BootEventRecord consists of the event name and the timestamp the event
@@ -56,16 +62,33 @@ class BootEventRecordStore {
   FRIEND_TEST(BootEventRecordStoreTest, AddBootEventWithValue);
   FRIEND_TEST(BootEventRecordStoreTest, GetBootEvent);
   FRIEND_TEST(BootEventRecordStoreTest, GetBootEventNoFileContent);
+  FRIEND_TEST(BootEventRecordStoreTest, AddBootEventOverwritesValue);
+  FRIEND_TEST(BootEventRecordStoreTest, LogOverridesEventFiles);
+  FRIEND_TEST(BootEventRecordStoreTest, CompactLog);
 
   // Sets the filesystem path of the record store.
   void SetStorePath(const std::string& path);
 
-  // Constructs the full path of the given boot |event|.
+  // Constructs the full path of the given boot |event|, as stored by older
+  // versions.
   std::string GetBootEventPath(const std::string& event) const;
 
+  // Constructs the full path of the event log.
+  std::string GetLogPath() const;
+
+  // Reads the event log into |index_|, once.
+  void LoadIndex() const;
+
+  // Rewrites the event log with only the last record of each event.
+  void CompactLog() const;
+
   // The filesystem path of the record store.
   std::string store_path_;
 
+  // The value of each event in the event log.
+  mutable std::map<std::string, int32_t> index_;
+  mutable bool index_loaded_;
+
   DISALLOW_COPY_AND_ASSIGN(BootEventRecordStore);
 };
 
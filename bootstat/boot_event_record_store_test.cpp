@@ -224,3 +224,62 @@ TEST_F(BootEventRecordStoreTest, GetBootEventNoFileContent) {
   EXPECT_EQ("devonian", record.first);
   EXPECT_EQ(2718, record.second);
 }
+
+TEST_F(BootEventRecordStoreTest, AddBootEventOverwritesValue) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  store.AddBootEventWithValue("silurian", 1);
+  store.AddBootEventWithValue("ordovician", 2);
+  store.AddBootEventWithValue("silurian", 3);
+
+  // Another store reads the same records back from the event log.
+  BootEventRecordStore other_store;
+  other_store.SetStorePath(GetStorePathForTesting());
+  BootEventRecordStore::BootEventRecord record;
+  ASSERT_TRUE(other_store.GetBootEvent("silurian", &record));
+  EXPECT_EQ(3, record.second);
+
+  auto events = other_store.GetAllBootEvents();
+  EXPECT_THAT(events, UnorderedElementsAreArray({std::make_pair(std::string("silurian"), 3),
+                                                 std::make_pair(std::string("ordovician"), 2)}));
+}
+
+// Tests that events in the event log take precedence over the event files of
+// older versions, which are still returned otherwise.
+TEST_F(BootEventRecordStoreTest, LogOverridesEventFiles) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  EXPECT_TRUE(CreateEmptyBootEventRecord(store.GetBootEventPath("cambrian"), 10));
+  EXPECT_TRUE(CreateEmptyBootEventRecord(store.GetBootEventPath("ediacaran"), 20));
+  store.AddBootEventWithValue("cambrian", 30);
+
+  BootEventRecordStore::BootEventRecord record;
+  ASSERT_TRUE(store.GetBootEvent("cambrian", &record));
+  EXPECT_EQ(30, record.second);
+
+  auto events = store.GetAllBootEvents();
+  EXPECT_THAT(events, UnorderedElementsAreArray({std::make_pair(std::string("cambrian"), 30),
+                                                 std::make_pair(std::string("ediacaran"), 20)}));
+}
+
+TEST_F(BootEventRecordStoreTest, CompactLog) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  for (int32_t i = 0; i < 5000; i++) {
+    store.AddBootEventWithValue(i % 2 ? "neoproterozoic" : "mesoproterozoic", i);
+  }
+
+  struct stat log_stat;
+  ASSERT_EQ(0, stat(store.GetLogPath().c_str(), &log_stat));
+  EXPECT_GT(16 * 1024, log_stat.st_size);
+
+  BootEventRecordStore other_store;
+  other_store.SetStorePath(GetStorePathForTesting());
+  auto events = other_store.GetAllBootEvents();
+  EXPECT_THAT(events,
+              UnorderedElementsAreArray({std::make_pair(std::string("neoproterozoic"), 4999),
+                                         std::make_pair(std::string("mesoproterozoic"), 4998)}));
+}
@@ -26,10 +26,12 @@
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <limits>
 #include <map>
 #include <memory>
 #include <set>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
@@ -64,6 +66,10 @@ using android::base::StringPrintf;
 
 using unwindstack::Regs;
 
+// Threads unwound at the same time, a dump of a process with hundreds of
+// threads is mostly spent unwinding and symbolizing them one after another.
+static constexpr unsigned int kMaxUnwindWorkers = 4;
+
 static bool pid_contains_tid(int pid_proc_fd, pid_t tid) {
   struct stat st;
   std::string task_path = StringPrintf("task/%d", tid);
@@ -127,16 +133,6 @@ static bool wait_for_stop(pid_t tid, int* received_signal) {
   }
 }
 
-// Interrupt a process and wait for it to be interrupted.
-static bool ptrace_interrupt(pid_t tid, int* received_signal) {
-  if (ptrace(PTRACE_INTERRUPT, tid, 0, 0) == 0) {
-    return wait_for_stop(tid, received_signal);
-  }
-
-  PLOG(ERROR) << "failed to interrupt " << tid << " to detach";
-  return false;
-}
-
 static bool activity_manager_notify(pid_t pid, int signal, const std::string& amfd_data) {
   ATRACE_CALL();
   android::base::unique_fd amfd(socket_local_client(
@@ -402,8 +398,19 @@ int main(int argc, char** argv) {
   siginfo_t siginfo;
   std::string error;
 
+  // Read the thread names before anything is stopped: they come from procfs,
+  // so they don't need the threads to be stopped and only add to the pause.
+  std::map<pid_t, std::string> thread_names;
+  for (pid_t thread : threads) {
+    thread_names[thread] = get_thread_name(thread);
+  }
+
   {
     ATRACE_NAME("ptrace");
+    // Interrupt every thread before waiting for any of them, so that they all
+    // stop at once instead of each one staying stopped while the rest of the
+    // threads are attached to one by one.
+    std::vector<pid_t> interrupted;
     for (pid_t thread : threads) {
       // Trace the pseudothread separately, so we can use different options.
       if (thread == pseudothread_tid) {
@@ -413,16 +420,26 @@ int main(int argc, char** argv) {
       if (!ptrace_seize_thread(target_proc_fd, thread, &error)) {
         bool fatal = thread == g_target_thread;
         LOG(fatal ? FATAL : WARNING) << error;
+        continue;
+      }
+
+      if (ptrace(PTRACE_INTERRUPT, thread, 0, 0) != 0) {
+        PLOG(WARNING) << "failed to ptrace interrupt thread " << thread;
+        ptrace(PTRACE_DETACH, thread, 0, 0);
+        continue;
       }
+      interrupted.push_back(thread);
+    }
 
+    for (pid_t thread : interrupted) {
       ThreadInfo info;
       info.pid = target_process;
       info.tid = thread;
       info.process_name = process_name;
-      info.thread_name = get_thread_name(thread);
+      info.thread_name = thread_names[thread];
 
-      if (!ptrace_interrupt(thread, &info.signo)) {
-        PLOG(WARNING) << "failed to ptrace interrupt thread " << thread;
+      if (!wait_for_stop(thread, &info.signo)) {
+        PLOG(WARNING) << "failed to wait for thread " << thread << " to stop";
         ptrace(PTRACE_DETACH, thread, 0, 0);
         continue;
       }
@@ -536,6 +553,14 @@ int main(int argc, char** argv) {
     LOG(FATAL) << "failed to get unwindstack::Memory handle";
   }
 
+  {
+    // The workers read the snapshot with process_vm_readv, which doesn't need
+    // the calling thread to be the one that is tracing it.
+    ATRACE_NAME("unwind");
+    unwind_threads(map.get(), &thread_info,
+                   std::min(std::thread::hardware_concurrency(), kMaxUnwindWorkers));
+  }
+
   std::string amfd_data;
   if (backtrace) {
     ATRACE_NAME("dump_backtrace");
@@ -16,16 +16,34 @@
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sched.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <chrono>
+#include <map>
+#include <memory>
+#include <set>
 #include <thread>
+#include <vector>
 
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <android-base/unique_fd.h>
+#include <backtrace/BacktraceMap.h>
 #include <benchmark/benchmark.h>
 #include <debuggerd/client.h>
+#include <procinfo/process.h>
+#include <unwindstack/Regs.h>
+
+#include "libdebuggerd/backtrace.h"
+#include "libdebuggerd/types.h"
 
 using namespace std::chrono_literals;
 
@@ -125,4 +143,268 @@ static void BM_maximum_pause_debuggerd(benchmark::State& state) {
 BENCHMARK(BM_maximum_pause_noop)->Iterations(128)->UseManualTime();
 BENCHMARK(BM_maximum_pause_debuggerd)->Iterations(128)->UseManualTime();
 
+// The process that is dumped by the benchmarks below: num_threads threads
+// (including the main one) each blocked stack_depth frames deep, and num_maps
+// extra anonymous mappings.
+class Target {
+ public:
+  Target(int num_threads, int stack_depth, int num_maps) {
+    android::base::unique_fd ready_read, ready_write;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      err(1, "pipe2 failed");
+    }
+    ready_read.reset(fds[0]);
+    ready_write.reset(fds[1]);
+
+    pid_ = fork();
+    if (pid_ == -1) {
+      err(1, "fork failed");
+    } else if (pid_ == 0) {
+      ready_read.reset();
+      Run(num_threads, stack_depth, num_maps, std::move(ready_write));
+    }
+
+    ready_write.reset();
+    char ready;
+    if (TEMP_FAILURE_RETRY(read(ready_read.get(), &ready, 1)) != 1) {
+      errx(1, "target failed to start");
+    }
+    if (!android::procinfo::GetProcessTids(pid_, &tids_)) {
+      err(1, "failed to get the target's threads");
+    }
+  }
+
+  ~Target() {
+    kill(pid_, SIGKILL);
+    waitpid(pid_, nullptr, 0);
+  }
+
+  pid_t pid() const { return pid_; }
+  const std::set<pid_t>& tids() const { return tids_; }
+
+ private:
+  static void __attribute__((noinline)) BlockAtDepth(int depth, std::atomic_int* started) {
+    static volatile int sink;
+    if (depth <= 0) {
+      ++*started;
+      while (true) {
+        pause();
+      }
+    }
+    BlockAtDepth(depth - 1, started);
+    // Keeps the call above from being a tail call.
+    sink = depth;
+  }
+
+  [[noreturn]] static void Run(int num_threads, int stack_depth, int num_maps,
+                               android::base::unique_fd ready_fd) {
+    // Alternate the protections, so that the kernel doesn't merge the maps.
+    for (int i = 0; i < num_maps; i++) {
+      int prot = (i % 2) ? PROT_READ : (PROT_READ | PROT_WRITE);
+      if (mmap(nullptr, getpagesize(), prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+        err(1, "mmap failed");
+      }
+    }
+
+    std::atomic_int started(0);
+    for (int i = 1; i < num_threads; i++) {
+      std::thread([&]() { BlockAtDepth(stack_depth, &started); }).detach();
+    }
+    while (started != num_threads - 1) {
+      std::this_thread::sleep_for(1ms);
+    }
+
+    if (TEMP_FAILURE_RETRY(write(ready_fd.get(), "\1", 1)) != 1) {
+      err(1, "failed to signal readiness");
+    }
+    ready_fd.reset();
+    BlockAtDepth(stack_depth, &started);
+    _exit(0);
+  }
+
+  pid_t pid_;
+  std::set<pid_t> tids_;
+};
+
+static void DumpArguments(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"threads", "depth", "maps"});
+  for (int threads : {1, 16, 128}) {
+    benchmark->Args({threads, 16, 0});
+  }
+  for (int depth : {64, 256}) {
+    benchmark->Args({16, depth, 0});
+  }
+  for (int maps : {1000, 10000}) {
+    benchmark->Args({16, 16, maps});
+  }
+}
+
+static std::unique_ptr<Target> CreateTarget(benchmark::State& state) {
+  return std::make_unique<Target>(state.range(0), state.range(1), state.range(2));
+}
+
+// End to end, from the signal to the output being closed.
+static void BM_dump_impl(benchmark::State& state, DebuggerdDumpType dump_type) {
+  std::unique_ptr<Target> target = CreateTarget(state);
+  for (auto _ : state) {
+    android::base::unique_fd output_fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    if (!debuggerd_trigger_dump(target->pid(), dump_type, 10000, std::move(output_fd))) {
+      state.SkipWithError("failed to trigger dump");
+      break;
+    }
+  }
+}
+
+static void BM_dump_backtrace(benchmark::State& state) {
+  BM_dump_impl(state, kDebuggerdNativeBacktrace);
+}
+BENCHMARK(BM_dump_backtrace)->Apply(DumpArguments)->UseRealTime();
+
+static void BM_dump_tombstone(benchmark::State& state) {
+  BM_dump_impl(state, kDebuggerdTombstone);
+}
+BENCHMARK(BM_dump_tombstone)->Apply(DumpArguments)->UseRealTime();
+
+// The phases of a dump, done the way crash_dump does them, against the
+// same targets. The end to end times above are roughly their sum, plus the
+// process snapshot and the round trips through tombstoned.
+
+static bool Attach(const Target& target) {
+  for (pid_t tid : target.tids()) {
+    if (ptrace(PTRACE_SEIZE, tid, 0, 0) != 0 || ptrace(PTRACE_INTERRUPT, tid, 0, 0) != 0) {
+      return false;
+    }
+  }
+  for (pid_t tid : target.tids()) {
+    int status;
+    if (TEMP_FAILURE_RETRY(waitpid(tid, &status, __WALL)) != tid || !WIFSTOPPED(status)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void Detach(const Target& target) {
+  for (pid_t tid : target.tids()) {
+    ptrace(PTRACE_DETACH, tid, 0, 0);
+  }
+}
+
+static void BM_phase_attach(benchmark::State& state) {
+  std::unique_ptr<Target> target = CreateTarget(state);
+  for (auto _ : state) {
+    if (!Attach(*target)) {
+      state.SkipWithError("failed to attach");
+      break;
+    }
+    state.PauseTiming();
+    Detach(*target);
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_phase_attach)->Apply(DumpArguments)->UseRealTime();
+
+static void BM_phase_registers(benchmark::State& state) {
+  std::unique_ptr<Target> target = CreateTarget(state);
+  if (!Attach(*target)) {
+    state.SkipWithError("failed to attach");
+    return;
+  }
+  for (auto _ : state) {
+    for (pid_t tid : target->tids()) {
+      std::unique_ptr<unwindstack::Regs> regs(unwindstack::Regs::RemoteGet(tid));
+      benchmark::DoNotOptimize(regs.get());
+    }
+  }
+  Detach(*target);
+}
+BENCHMARK(BM_phase_registers)->Apply(DumpArguments)->UseRealTime();
+
+static bool GetThreadInfo(const Target& target, std::map<pid_t, ThreadInfo>* thread_info) {
+  for (pid_t tid : target.tids()) {
+    ThreadInfo info;
+    info.registers.reset(unwindstack::Regs::RemoteGet(tid));
+    if (!info.registers) {
+      return false;
+    }
+    info.pid = target.pid();
+    info.tid = tid;
+    info.thread_name = "target";
+    info.process_name = "debuggerd_benchmark";
+    (*thread_info)[tid] = std::move(info);
+  }
+  return true;
+}
+
+// Setting up the maps is counted here too, crash_dump does it for every dump.
+static void BM_phase_unwind_impl(benchmark::State& state, bool resolve_names) {
+  std::unique_ptr<Target> target = CreateTarget(state);
+  std::map<pid_t, ThreadInfo> thread_info;
+  if (!Attach(*target) || !GetThreadInfo(*target, &thread_info)) {
+    state.SkipWithError("failed to attach");
+    return;
+  }
+  for (auto _ : state) {
+    std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(target->pid()));
+    map->SetResolveNames(resolve_names);
+    unwind_threads(map.get(), &thread_info, 1);
+  }
+  Detach(*target);
+}
+
+static void BM_phase_unwind(benchmark::State& state) {
+  BM_phase_unwind_impl(state, false);
+}
+BENCHMARK(BM_phase_unwind)->Apply(DumpArguments)->UseRealTime();
+
+// The difference from BM_phase_unwind is the cost of symbolizing.
+static void BM_phase_unwind_and_symbolize(benchmark::State& state) {
+  BM_phase_unwind_impl(state, true);
+}
+BENCHMARK(BM_phase_unwind_and_symbolize)->Apply(DumpArguments)->UseRealTime();
+
+static void BM_phase_format_impl(benchmark::State& state, bool to_file) {
+  std::unique_ptr<Target> target = CreateTarget(state);
+  std::map<pid_t, ThreadInfo> thread_info;
+  if (!Attach(*target) || !GetThreadInfo(*target, &thread_info)) {
+    state.SkipWithError("failed to attach");
+    return;
+  }
+  std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(target->pid()));
+  unwind_threads(map.get(), &thread_info, 1);
+  Detach(*target);
+
+  TemporaryFile tf;
+  for (auto _ : state) {
+    android::base::unique_fd output_fd;
+    if (to_file) {
+      state.PauseTiming();
+      if (ftruncate(tf.fd, 0) != 0 || lseek(tf.fd, 0, SEEK_SET) != 0) {
+        state.SkipWithError("failed to reset the output file");
+        break;
+      }
+      state.ResumeTiming();
+      output_fd.reset(dup(tf.fd));
+    } else {
+      output_fd.reset(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    }
+    dump_backtrace(std::move(output_fd), map.get(), thread_info, target->pid());
+    if (to_file) {
+      fsync(tf.fd);
+    }
+  }
+}
+
+static void BM_phase_format(benchmark::State& state) {
+  BM_phase_format_impl(state, false);
+}
+BENCHMARK(BM_phase_format)->Apply(DumpArguments)->UseRealTime();
+
+// Formatting into a file that is synced to disk, like a tombstone.
+static void BM_phase_format_and_write(benchmark::State& state) {
+  BM_phase_format_impl(state, true);
+}
+BENCHMARK(BM_phase_format_and_write)->Apply(DumpArguments)->UseRealTime();
+
 BENCHMARK_MAIN();
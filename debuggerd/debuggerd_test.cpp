@@ -25,9 +25,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <regex>
 #include <thread>
+#include <vector>
 
 #include <android/set_abort_message.h>
 
@@ -460,6 +462,46 @@ TEST_F(CrasherTest, backtrace) {
   ASSERT_BACKTRACE_FRAME(result, "abort");
 }
 
+TEST_F(CrasherTest, many_threads) {
+  int intercept_result;
+  unique_fd output_fd;
+  StartProcess([]() {
+    for (int i = 0; i < 32; i++) {
+      std::thread([]() {
+        while (true) {
+          pause();
+        }
+      }).detach();
+    }
+    abort();
+  });
+  StartIntercept(&output_fd);
+  FinishCrasher();
+  AssertDeath(SIGABRT);
+  FinishIntercept(&intercept_result);
+  ASSERT_EQ(1, intercept_result) << "tombstoned reported failure";
+
+  std::string result;
+  ConsumeFd(std::move(output_fd), &result);
+  ASSERT_BACKTRACE_FRAME(result, "abort");
+
+  // Every thread is unwound, and the crashing one is still dumped first.
+  std::regex thread_regex(R"(pid: \d+, tid: (\d+), name: )");
+  std::vector<pid_t> tids;
+  for (auto it = std::sregex_iterator(result.begin(), result.end(), thread_regex);
+       it != std::sregex_iterator(); ++it) {
+    tids.push_back(std::stoi((*it)[1]));
+  }
+  ASSERT_EQ(33U, tids.size()) << result;
+  ASSERT_EQ(crasher_pid, tids[0]);
+  ASSERT_TRUE(std::is_sorted(tids.begin() + 1, tids.end()));
+  size_t backtraces = 0;
+  for (size_t pos = 0; (pos = result.find("\nbacktrace:\n", pos)) != std::string::npos; pos++) {
+    backtraces++;
+  }
+  ASSERT_EQ(33U, backtraces);
+}
+
 TEST_F(CrasherTest, PR_SET_DUMPABLE_0_crash) {
   int intercept_result;
   unique_fd output_fd;
@@ -30,9 +30,13 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <backtrace/Backtrace.h>
@@ -67,7 +71,7 @@ void dump_backtrace_thread(int output_fd, BacktraceMap* map, const ThreadInfo& t
   _LOG(&log, logtype::BACKTRACE, "\n\"%s\" sysTid=%d\n", thread.thread_name.c_str(), thread.tid);
 
   std::vector<backtrace_frame_data_t> frames;
-  if (!Backtrace::Unwind(thread.registers.get(), map, &frames, 0, nullptr)) {
+  if (!unwind_thread(map, thread, &frames)) {
     _LOG(&log, logtype::THREAD, "Unwind failed: tid = %d", thread.tid);
     return;
   }
@@ -77,6 +81,47 @@ void dump_backtrace_thread(int output_fd, BacktraceMap* map, const ThreadInfo& t
   }
 }
 
+bool unwind_thread(BacktraceMap* map, const ThreadInfo& thread,
+                   std::vector<backtrace_frame_data_t>* frames) {
+  if (thread.unwound) {
+    *frames = thread.frames;
+    return true;
+  }
+
+  // Unwind will mutate the registers, so make a copy first.
+  std::unique_ptr<unwindstack::Regs> regs_copy(thread.registers->Clone());
+  return Backtrace::Unwind(regs_copy.get(), map, frames, 0, nullptr);
+}
+
+void unwind_threads(BacktraceMap* map, std::map<pid_t, ThreadInfo>* thread_info,
+                    size_t num_workers) {
+  std::vector<ThreadInfo*> threads;
+  for (auto& [tid, info] : *thread_info) {
+    threads.push_back(&info);
+  }
+  num_workers = std::max<size_t>(1, std::min(num_workers, threads.size()));
+
+  // Hand out the threads one at a time, their stacks vary a lot in depth.
+  std::atomic_size_t next(0);
+  auto work = [&]() {
+    size_t index;
+    while ((index = next++) < threads.size()) {
+      ThreadInfo* thread = threads[index];
+      std::unique_ptr<unwindstack::Regs> regs_copy(thread->registers->Clone());
+      thread->unwound = Backtrace::Unwind(regs_copy.get(), map, &thread->frames, 0, nullptr);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < num_workers; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
 void dump_backtrace(android::base::unique_fd output_fd, BacktraceMap* map,
                     const std::map<pid_t, ThreadInfo>& thread_info, pid_t target_thread) {
   log_t log;
@@ -22,6 +22,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
@@ -35,6 +36,16 @@ class BacktraceMap;
 void dump_backtrace(android::base::unique_fd output_fd, BacktraceMap* map,
                     const std::map<pid_t, ThreadInfo>& thread_info, pid_t target_thread);
 
+// Unwinds and symbolizes every thread ahead of dumping, using up to num_workers
+// threads that share the map and its cached process memory. The frames are
+// stored in each ThreadInfo, so that the dump itself stays in thread order.
+void unwind_threads(BacktraceMap* map, std::map<pid_t, ThreadInfo>* thread_info,
+                    size_t num_workers);
+
+// Returns the frames unwind_threads() found for thread, or unwinds it now.
+bool unwind_thread(BacktraceMap* map, const ThreadInfo& thread,
+                   std::vector<backtrace_frame_data_t>* frames);
+
 void dump_backtrace_header(int output_fd);
 void dump_backtrace_thread(int output_fd, BacktraceMap* map, const ThreadInfo& thread);
 void dump_backtrace_footer(int output_fd);
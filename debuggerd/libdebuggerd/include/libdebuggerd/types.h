@@ -18,7 +18,9 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
+#include <backtrace/Backtrace.h>
 #include <unwindstack/Regs.h>
 
 struct ThreadInfo {
@@ -31,4 +33,8 @@ struct ThreadInfo {
 
   int signo = 0;
   siginfo_t* siginfo = nullptr;
+
+  // Filled in by unwind_threads(), otherwise the thread is unwound when it is dumped.
+  bool unwound = false;
+  std::vector<backtrace_frame_data_t> frames;
 };
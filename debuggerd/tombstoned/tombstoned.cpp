@@ -21,21 +21,27 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <deque>
+#include <limits>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <event2/event.h>
 #include <event2/listener.h>
 #include <event2/thread.h>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
 #include <cutils/sockets.h>
+#include <zlib.h>
 
 #include "debuggerd/handler.h"
 #include "dump_type.h"
@@ -44,7 +50,9 @@
 
 #include "intercept_manager.h"
 
+using android::base::GetBoolProperty;
 using android::base::GetIntProperty;
+using android::base::GetUintProperty;
 using android::base::StringPrintf;
 using android::base::unique_fd;
 
@@ -65,22 +73,31 @@ struct Crash {
   unique_fd crash_tombstone_fd;
   unique_fd crash_socket_fd;
   pid_t crash_pid;
+  uid_t crash_uid;
   event* crash_event = nullptr;
 
+  // When the request arrived, and when the dump was handed an output fd.
+  std::chrono::steady_clock::time_point request_time;
+  std::chrono::steady_clock::time_point start_time;
+
   DebuggerdDumpType crash_type;
 };
 
 class CrashQueue {
  public:
   CrashQueue(const std::string& dir_path, const std::string& file_name_prefix, size_t max_artifacts,
-             size_t max_concurrent_dumps)
+             size_t max_concurrent_dumps, uint64_t max_total_size, size_t max_artifacts_per_uid,
+             bool compress)
       : file_name_prefix_(file_name_prefix),
         dir_path_(dir_path),
         dir_fd_(open(dir_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)),
         max_artifacts_(max_artifacts),
         next_artifact_(0),
         max_concurrent_dumps_(max_concurrent_dumps),
-        num_concurrent_dumps_(0) {
+        num_concurrent_dumps_(0),
+        max_total_size_(max_total_size),
+        max_artifacts_per_uid_(max_artifacts_per_uid),
+        compress_(compress) {
     if (dir_fd_ == -1) {
       PLOG(FATAL) << "failed to open directory: " << dir_path;
     }
@@ -99,14 +116,20 @@ class CrashQueue {
   static CrashQueue* for_tombstones() {
     static CrashQueue queue("/data/tombstones", "tombstone_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_tombstone_count", 10),
-                            1 /* max_concurrent_dumps */);
+                            GetUintProperty<size_t>("tombstoned.max_concurrent_tombstones", 1),
+                            GetUintProperty<uint64_t>("tombstoned.max_tombstone_size", 0),
+                            GetUintProperty<size_t>("tombstoned.max_tombstones_per_uid", 0),
+                            GetBoolProperty("tombstoned.compress_tombstones", false));
     return &queue;
   }
 
   static CrashQueue* for_anrs() {
     static CrashQueue queue("/data/anr", "trace_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_anr_count", 64),
-                            4 /* max_concurrent_dumps */);
+                            GetUintProperty<size_t>("tombstoned.max_concurrent_anrs", 4),
+                            GetUintProperty<uint64_t>("tombstoned.max_anr_size", 0),
+                            GetUintProperty<size_t>("tombstoned.max_anrs_per_uid", 0),
+                            GetBoolProperty("tombstoned.compress_anrs", false));
     return &queue;
   }
 
@@ -129,15 +152,97 @@ class CrashQueue {
   }
 
   std::string get_next_artifact_path() {
-    std::string file_name =
-        StringPrintf("%s/%s%02d", dir_path_.c_str(), file_name_prefix_.c_str(), next_artifact_);
+    std::string file_name = get_artifact_path(next_artifact_, compress_);
     next_artifact_ = (next_artifact_ + 1) % max_artifacts_;
     return file_name;
   }
 
+  // The same slot can hold either kind of file, if compression was switched on or off.
+  std::string get_artifact_path(size_t index, bool compressed) {
+    return StringPrintf("%s/%s%02zu%s", dir_path_.c_str(), file_name_prefix_.c_str(), index,
+                        compressed ? ".gz" : "");
+  }
+
+  bool compress() { return compress_; }
+
+  // Returns whether an artifact for uid may be written to disk. Each uid gets
+  // max_artifacts_per_uid_ artifacts a minute, so that one process in a crash
+  // loop can't keep the storage busy and rotate everyone else's dumps away.
+  bool allow_artifact(uid_t uid) {
+    if (max_artifacts_per_uid_ == 0) {
+      return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::deque<std::chrono::steady_clock::time_point>& times = artifact_times_[uid];
+    while (!times.empty() && now - times.front() >= std::chrono::minutes(1)) {
+      times.pop_front();
+    }
+    if (times.size() >= max_artifacts_per_uid_) {
+      return false;
+    }
+    times.push_back(now);
+    return true;
+  }
+
+  // Deletes the oldest artifacts until all of them fit in max_total_size_,
+  // never deleting the one at keep_path, which was just written.
+  void trim_artifacts(const std::string& keep_path) {
+    if (max_total_size_ == 0) {
+      return;
+    }
+
+    struct Artifact {
+      std::string path;
+      off_t size;
+      time_t mtime;
+    };
+    std::vector<Artifact> artifacts;
+    uint64_t total_size = 0;
+    for (size_t i = 0; i < max_artifacts_; ++i) {
+      for (bool compressed : {false, true}) {
+        std::string path = get_artifact_path(i, compressed);
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+          continue;
+        }
+        total_size += st.st_size;
+        if (path != keep_path) {
+          artifacts.push_back(Artifact{path, st.st_size, st.st_mtime});
+        }
+      }
+    }
+
+    std::sort(artifacts.begin(), artifacts.end(),
+              [](const Artifact& a, const Artifact& b) { return a.mtime < b.mtime; });
+    for (const Artifact& artifact : artifacts) {
+      if (total_size <= max_total_size_) {
+        break;
+      }
+      if (unlink(artifact.path.c_str()) != 0) {
+        PLOG(ERROR) << "failed to unlink " << artifact.path;
+        continue;
+      }
+      LOG(INFO) << "removed " << artifact.path << " to stay within " << max_total_size_
+                << " bytes";
+      total_size -= artifact.size;
+    }
+  }
+
   bool maybe_enqueue_crash(Crash* crash) {
-    if (num_concurrent_dumps_ == max_concurrent_dumps_) {
-      queued_requests_.push_back(crash);
+    if (num_concurrent_dumps_ >= max_concurrent_dumps_) {
+      // Crashes go ahead of the backtraces requested of live processes, a
+      // burst of those (e.g. from a watchdog) mustn't make a crash time out.
+      // Requests of the same kind stay in arrival order.
+      auto it = queued_requests_.end();
+      if (crash->crash_type == kDebuggerdTombstone) {
+        it = std::find_if(queued_requests_.begin(), queued_requests_.end(),
+                          [](const Crash* queued) {
+                            return queued->crash_type != kDebuggerdTombstone;
+                          });
+      }
+      queued_requests_.insert(it, crash);
+      max_queue_depth_ = std::max(max_queue_depth_, queued_requests_.size());
       return true;
     }
 
@@ -148,35 +253,65 @@ class CrashQueue {
     while (!queued_requests_.empty() && num_concurrent_dumps_ < max_concurrent_dumps_) {
       Crash* next_crash = queued_requests_.front();
       queued_requests_.pop_front();
+      LOG(INFO) << "dequeueing crash request for pid " << next_crash->crash_pid << " after "
+                << milliseconds_since(next_crash->request_time) << "ms, "
+                << queued_requests_.size() << " still queued";
       handler(next_crash);
     }
   }
 
-  void on_crash_started() { ++num_concurrent_dumps_; }
+  void on_crash_started(Crash* crash) {
+    ++num_concurrent_dumps_;
+    crash->start_time = std::chrono::steady_clock::now();
+    total_wait_ms_ += milliseconds_since(crash->request_time);
+  }
 
-  void on_crash_completed() { --num_concurrent_dumps_; }
+  void on_crash_completed(Crash* crash) {
+    --num_concurrent_dumps_;
+    ++num_completed_dumps_;
+    LOG(INFO) << "dump of pid " << crash->crash_pid << " took "
+              << milliseconds_since(crash->start_time) << "ms; " << dir_path_ << ": "
+              << num_completed_dumps_ << " dumps, " << (total_wait_ms_ / num_completed_dumps_)
+              << "ms average wait, " << max_queue_depth_ << " most queued";
+  }
 
  private:
+  static uint64_t milliseconds_since(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - time)
+        .count();
+  }
+
   void find_oldest_artifact() {
     size_t oldest_tombstone = 0;
     time_t oldest_time = std::numeric_limits<time_t>::max();
 
     for (size_t i = 0; i < max_artifacts_; ++i) {
-      std::string path = StringPrintf("%s/%s%02zu", dir_path_.c_str(), file_name_prefix_.c_str(), i);
-      struct stat st;
-      if (stat(path.c_str(), &st) != 0) {
-        if (errno == ENOENT) {
-          oldest_tombstone = i;
-          break;
-        } else {
-          PLOG(ERROR) << "failed to stat " << path;
+      bool found = false;
+      time_t mtime = 0;
+      for (bool compressed : {false, true}) {
+        std::string path = get_artifact_path(i, compressed);
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+          if (errno != ENOENT) {
+            PLOG(ERROR) << "failed to stat " << path;
+          }
           continue;
         }
+        if (!found || st.st_mtime > mtime) {
+          mtime = st.st_mtime;
+        }
+        found = true;
+      }
+
+      if (!found) {
+        oldest_tombstone = i;
+        break;
       }
 
-      if (st.st_mtime < oldest_time) {
+      if (mtime < oldest_time) {
         oldest_tombstone = i;
-        oldest_time = st.st_mtime;
+        oldest_time = mtime;
       }
     }
 
@@ -196,6 +331,16 @@ class CrashQueue {
 
   std::deque<Crash*> queued_requests_;
 
+  size_t max_queue_depth_ = 0;
+  uint64_t num_completed_dumps_ = 0;
+  uint64_t total_wait_ms_ = 0;
+
+  const uint64_t max_total_size_;
+  const size_t max_artifacts_per_uid_;
+  std::unordered_map<uid_t, std::deque<std::chrono::steady_clock::time_point>> artifact_times_;
+
+  const bool compress_;
+
   DISALLOW_COPY_AND_ASSIGN(CrashQueue);
 };
 
@@ -207,13 +352,64 @@ static void crash_accept_cb(evconnlistener* listener, evutil_socket_t sockfd, so
 static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg);
 static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg);
 
+// Writes the contents of in_fd to out_fd as gzip, one chunk at a time.
+static bool gzip_artifact(int in_fd, int out_fd) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16 /* gzip header */, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    LOG(ERROR) << "failed to initialize zlib";
+    return false;
+  }
+
+  std::vector<Bytef> in(64 * 1024);
+  std::vector<Bytef> out(64 * 1024);
+  int flush;
+  do {
+    ssize_t rc = TEMP_FAILURE_RETRY(read(in_fd, in.data(), in.size()));
+    if (rc == -1) {
+      PLOG(ERROR) << "failed to read artifact to compress";
+      deflateEnd(&stream);
+      return false;
+    }
+    flush = (rc == 0) ? Z_FINISH : Z_NO_FLUSH;
+    stream.next_in = in.data();
+    stream.avail_in = rc;
+    do {
+      stream.next_out = out.data();
+      stream.avail_out = out.size();
+      deflate(&stream, flush);
+      if (!android::base::WriteFully(out_fd, out.data(), out.size() - stream.avail_out)) {
+        PLOG(ERROR) << "failed to write compressed artifact";
+        deflateEnd(&stream);
+        return false;
+      }
+    } while (stream.avail_out == 0);
+  } while (flush != Z_FINISH);
+
+  deflateEnd(&stream);
+  return true;
+}
+
 static void perform_request(Crash* crash) {
   unique_fd output_fd;
   bool intercepted =
       intercept_manager->GetIntercept(crash->crash_pid, crash->crash_type, &output_fd);
   if (!intercepted) {
-    std::tie(crash->crash_tombstone_path, output_fd) = CrashQueue::for_crash(crash)->get_output();
-    crash->crash_tombstone_fd.reset(dup(output_fd.get()));
+    CrashQueue* queue = CrashQueue::for_crash(crash);
+    if (queue->allow_artifact(crash->crash_uid)) {
+      std::tie(crash->crash_tombstone_path, output_fd) = queue->get_output();
+      crash->crash_tombstone_fd.reset(dup(output_fd.get()));
+    } else {
+      // The dumper still needs somewhere to write to, its output is just not kept.
+      LOG(WARNING) << "too many dumps from uid " << crash->crash_uid
+                   << ", dropping the one for pid " << crash->crash_pid;
+      output_fd.reset(open("/dev/null", O_WRONLY | O_CLOEXEC));
+      if (output_fd == -1) {
+        PLOG(ERROR) << "failed to open /dev/null";
+        delete crash;
+        return;
+      }
+    }
   }
 
   TombstonedCrashPacket response = {
@@ -236,7 +432,7 @@ static void perform_request(Crash* crash) {
     event_add(crash->crash_event, &timeout);
   }
 
-  CrashQueue::for_crash(crash)->on_crash_started();
+  CrashQueue::for_crash(crash)->on_crash_started(crash);
   return;
 
 fail:
@@ -293,12 +489,7 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg) {
     goto fail;
   }
 
-  if (crash->crash_type != kDebuggerdJavaBacktrace) {
-    crash->crash_pid = request.packet.dump_request.pid;
-  } else {
-    // Requests for java traces are sent from untrusted processes, so we
-    // must not trust the PID sent down with the request. Instead, we ask the
-    // kernel.
+  {
     ucred cr = {};
     socklen_t len = sizeof(cr);
     int ret = getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cr, &len);
@@ -307,10 +498,20 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg) {
       goto fail;
     }
 
-    crash->crash_pid = cr.pid;
+    // crash_dump runs as the uid of the process it dumps.
+    crash->crash_uid = cr.uid;
+    if (crash->crash_type != kDebuggerdJavaBacktrace) {
+      crash->crash_pid = request.packet.dump_request.pid;
+    } else {
+      // Requests for java traces are sent from untrusted processes, so we
+      // must not trust the PID sent down with the request. Instead, we ask the
+      // kernel.
+      crash->crash_pid = cr.pid;
+    }
   }
 
   LOG(INFO) << "received crash request for pid " << crash->crash_pid;
+  crash->request_time = std::chrono::steady_clock::now();
 
   if (CrashQueue::for_crash(crash)->maybe_enqueue_crash(crash)) {
     LOG(INFO) << "enqueueing crash request for pid " << crash->crash_pid;
@@ -329,7 +530,7 @@ static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg) {
   Crash* crash = static_cast<Crash*>(arg);
   TombstonedCrashPacket request = {};
 
-  CrashQueue::for_crash(crash)->on_crash_completed();
+  CrashQueue::for_crash(crash)->on_crash_completed(crash);
 
   if ((ev & EV_READ) == 0) {
     goto fail;
@@ -352,20 +553,48 @@ static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg) {
   }
 
   if (crash->crash_tombstone_fd != -1) {
+    CrashQueue* queue = CrashQueue::for_crash(crash);
     std::string fd_path = StringPrintf("/proc/self/fd/%d", crash->crash_tombstone_fd.get());
-    std::string tombstone_path = CrashQueue::for_crash(crash)->get_next_artifact_path();
+    std::string compressed_tmp_path;
+    unique_fd compressed_fd;
+    if (queue->compress()) {
+      // The plain text is never linked, so most of it is dropped from the
+      // page cache with the temporary file instead of being written back.
+      unique_fd plain_fd(open(fd_path.c_str(), O_RDONLY | O_CLOEXEC));
+      if (plain_fd == -1) {
+        PLOG(ERROR) << "failed to reopen tombstone to compress it";
+        goto fail;
+      }
+      std::tie(compressed_tmp_path, compressed_fd) = queue->get_output();
+      if (!gzip_artifact(plain_fd.get(), compressed_fd.get())) {
+        if (!compressed_tmp_path.empty()) {
+          unlink(compressed_tmp_path.c_str());
+        }
+        goto fail;
+      }
+      fd_path = StringPrintf("/proc/self/fd/%d", compressed_fd.get());
+    }
 
-    // linkat doesn't let us replace a file, so we need to unlink first.
-    int rc = unlink(tombstone_path.c_str());
-    if (rc != 0 && errno != ENOENT) {
-      PLOG(ERROR) << "failed to unlink tombstone at " << tombstone_path;
-      goto fail;
+    std::string tombstone_path = queue->get_next_artifact_path();
+
+    // linkat doesn't let us replace a file, so we need to unlink first. The
+    // artifact of the other kind in this slot, if any, goes too.
+    int rc = 0;
+    for (const std::string& path :
+         {tombstone_path, queue->compress() ? tombstone_path.substr(0, tombstone_path.size() - 3)
+                                            : tombstone_path + ".gz"}) {
+      rc = unlink(path.c_str());
+      if (rc != 0 && errno != ENOENT) {
+        PLOG(ERROR) << "failed to unlink tombstone at " << path;
+        goto fail;
+      }
     }
 
     rc = linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, tombstone_path.c_str(), AT_SYMLINK_FOLLOW);
     if (rc != 0) {
       PLOG(ERROR) << "failed to link tombstone";
     } else {
+      queue->trim_artifacts(tombstone_path);
       if (crash->crash_type == kDebuggerdJavaBacktrace) {
         LOG(ERROR) << "Traces for pid " << crash->crash_pid << " written to: " << tombstone_path;
       } else {
@@ -377,10 +606,12 @@ static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg) {
     }
 
     // If we don't have O_TMPFILE, we need to clean up after ourselves.
-    if (!crash->crash_tombstone_path.empty()) {
-      rc = unlink(crash->crash_tombstone_path.c_str());
-      if (rc != 0) {
-        PLOG(ERROR) << "failed to unlink temporary tombstone at " << crash->crash_tombstone_path;
+    for (const std::string& tmp_path : {crash->crash_tombstone_path, compressed_tmp_path}) {
+      if (!tmp_path.empty()) {
+        rc = unlink(tmp_path.c_str());
+        if (rc != 0) {
+          PLOG(ERROR) << "failed to unlink temporary tombstone at " << tmp_path;
+        }
       }
     }
   }
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <demangle.h>
+
+// Names of the kind found in tombstones and profiles.
+static const std::vector<const char*> kNames = {
+  "_ZN7android10VectorImpl19reservedVectorImplEv",
+  "_ZN7android6Thread11_threadLoopEPv",
+  "_ZNSt3__16vectorIiNS_9allocatorIiEEE9push_backERKi",
+  "_ZN3art9ArtMethod6InvokeEPNS_6ThreadEPjjPNS_6JValueEPKc",
+  "_ZN12_GLOBAL__N_15Local7processEPKcmRNSt3__112basic_stringIcNS2_11char_traitsIcEE"
+      "NS2_9allocatorIcEEEE",
+  "_ZNK7android7RefBase9decStrongEPKv",
+  "_Z4funcIiEvT_PKc",
+  "__libc_init",
+};
+
+static void BM_demangle(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    for (const char* name : kNames) {
+      benchmark::DoNotOptimize(demangle(name));
+    }
+  }
+}
+BENCHMARK(BM_demangle);
+
+static void BM_demangle_cache(benchmark::State& state) {
+  DemangleCache cache;
+  while (state.KeepRunning()) {
+    for (const char* name : kNames) {
+      benchmark::DoNotOptimize(cache.Demangle(name));
+    }
+  }
+}
+BENCHMARK(BM_demangle_cache);
+
+BENCHMARK_MAIN();
@@ -553,3 +553,19 @@ TEST(DemangleTest, demangle) {
   str = demangle("Xa");
   ASSERT_EQ("Xa", str);
 }
+
+TEST(DemangleTest, DemangleCache) {
+  DemangleCache cache(2);
+
+  ASSERT_EQ("a::b::c(a::b)", cache.Demangle("_ZN1a1b1cES0_"));
+  ASSERT_EQ("func(char)", cache.Demangle("_ZN4funcEc"));
+  ASSERT_EQ("Xa", cache.Demangle("Xa"));
+  ASSERT_EQ(2U, cache.size());
+
+  // The least recently used name was evicted, and is demangled again.
+  ASSERT_EQ("func(char)", cache.Demangle("_ZN4funcEc"));
+  ASSERT_EQ("a::b::c(a::b)", cache.Demangle("_ZN1a1b1cES0_"));
+  ASSERT_EQ("a::b::c(a::b)", cache.Demangle("_ZN1a1b1cES0_"));
+  ASSERT_EQ("func(char)", cache.Demangle("_ZN4funcEc"));
+  ASSERT_EQ(2U, cache.size());
+}
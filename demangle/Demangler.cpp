@@ -17,10 +17,15 @@
 #include <assert.h>
 
 #include <cctype>
+#include <list>
 #include <stack>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <demangle.h>
+
 #include "Demangler.h"
 
 constexpr const char* Demangler::kTypes[];
@@ -38,7 +43,8 @@ std::string Demangler::GetArgumentsString() {
   if (num_args > 0) {
     arg_str = cur_state_.args[0];
     for (size_t i = 1; i < num_args; i++) {
-      arg_str += ", " + cur_state_.args[i];
+      arg_str += ", ";
+      arg_str += cur_state_.args[i];
     }
   }
   return arg_str;
@@ -270,9 +276,8 @@ const char* Demangler::GetStringFromLength(const char* name, std::string* str) {
     name++;
   }
 
-  std::string read_str;
+  const char* start = name;
   while (*name != '\0' && length != 0) {
-    read_str += *name;
     name++;
     length--;
   }
@@ -280,10 +285,13 @@ const char* Demangler::GetStringFromLength(const char* name, std::string* str) {
     return nullptr;
   }
   // Special replacement of _GLOBAL__N_1 to (anonymous namespace).
-  if (read_str == "_GLOBAL__N_1") {
+  static constexpr char kAnonymousNamespace[] = "_GLOBAL__N_1";
+  size_t read_length = name - start;
+  if (read_length == sizeof(kAnonymousNamespace) - 1 &&
+      std::char_traits<char>::compare(start, kAnonymousNamespace, read_length) == 0) {
     *str += "(anonymous namespace)";
   } else {
-    *str += read_str;
+    str->append(start, read_length);
   }
   return name;
 }
@@ -890,7 +898,7 @@ std::string Demangler::Parse(const char* name, size_t max_length) {
     return name;
   }
 
-  std::string return_type;
+  size_t return_type_args = 0;
   if (template_found_) {
     // Only a single argument with a template is not allowed.
     if (cur_state_.args.size() == 1) {
@@ -900,25 +908,66 @@ std::string Demangler::Parse(const char* name, size_t max_length) {
     // If there are at least two arguments, this template has a return type.
     if (cur_state_.args.size() > 1) {
       // The first argument will be the return value.
-      return_type = cur_state_.args[0] + ' ';
-      cur_state_.args.erase(cur_state_.args.begin());
+      return_type_args = 1;
     }
   }
 
-  std::string arg_str;
-  if (cur_state_.args.size() == 1 && cur_state_.args[0] == "void") {
+  // Build the result in place rather than out of temporaries.
+  const std::vector<std::string>& args = cur_state_.args;
+  std::string result;
+  if (return_type_args != 0) {
+    result += args[0];
+    result += ' ';
+  }
+  result += function_name_;
+  if (args.size() == return_type_args + 1 && args[return_type_args] == "void") {
     // If the only argument is void, then don't print any args.
-    arg_str = "()";
-  } else {
-    arg_str = GetArgumentsString();
-    if (!arg_str.empty()) {
-      arg_str = '(' + arg_str + ')';
+    result += "()";
+  } else if (args.size() > return_type_args) {
+    size_t open = result.size();
+    result += '(';
+    for (size_t i = return_type_args; i < args.size(); i++) {
+      if (i != return_type_args) {
+        result += ", ";
+      }
+      result += args[i];
+    }
+    // No parentheses around nothing.
+    if (result.size() == open + 1) {
+      result.resize(open);
+    } else {
+      result += ')';
     }
   }
-  return return_type + function_name_ + arg_str + function_suffix_;
+  result += function_suffix_;
+  return result;
 }
 
 std::string demangle(const char* name) {
-  Demangler demangler;
+  // Parse() clears the state it keeps from one name to the next but not its
+  // storage, so reusing a Demangler spares most of the allocations.
+  static thread_local Demangler demangler;
   return demangler.Parse(name);
 }
+
+DemangleCache::DemangleCache(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), demangler_(new Demangler) {}
+
+DemangleCache::~DemangleCache() {}
+
+const std::string& DemangleCache::Demangle(const char* name) {
+  auto it = entries_.find(name);
+  if (it != entries_.end()) {
+    // Move it to the front, as the most recently used.
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+
+  if (entries_.size() == capacity_) {
+    entries_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  lru_.emplace_front(name, demangler_->Parse(name));
+  entries_.emplace(lru_.front().first, lru_.begin());
+  return lru_.front().second;
+}
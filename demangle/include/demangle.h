@@ -17,11 +17,49 @@
 #ifndef __LIB_DEMANGLE_H_
 #define __LIB_DEMANGLE_H_
 
+#include <stddef.h>
+
+#include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+
+class Demangler;
 
 // If the name cannot be demangled, the original name will be returned as
 // a std::string. If the name can be demangled, then the demangled name
 // will be returned as a std::string.
 std::string demangle(const char* name);
 
+// Demangles names like demangle(), and remembers the results for the last
+// `capacity` names, for the callers that see the same names over and over,
+// like symbolizers of many stacks or samples.
+//
+// Not thread-safe.
+class DemangleCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 1024;
+
+  explicit DemangleCache(size_t capacity = kDefaultCapacity);
+  ~DemangleCache();
+
+  // The reference is valid until the next call.
+  const std::string& Demangle(const char* name);
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  using Entry = std::pair<std::string, std::string>;
+
+  size_t capacity_;
+  std::unique_ptr<Demangler> demangler_;
+  // Most recently used first.
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+
+  DemangleCache(const DemangleCache&) = delete;
+  DemangleCache& operator=(const DemangleCache&) = delete;
+};
+
 #endif  // __LIB_DEMANGLE_H_
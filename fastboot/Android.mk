@@ -31,8 +31,10 @@ LOCAL_SRC_FILES := \
     fastboot.cpp \
     fs.cpp\
     protocol.cpp \
+    sparse_stream.cpp \
     socket.cpp \
     tcp.cpp \
+    timing.cpp \
     udp.cpp \
     util.cpp \
 
@@ -63,6 +65,7 @@ LOCAL_STATIC_LIBRARIES := \
     libsparse \
     libutils \
     liblog \
+    liblz4 \
     libz \
     libdiagnose_usb \
     libbase \
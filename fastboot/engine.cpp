@@ -42,6 +42,9 @@
 
 #include <android-base/stringprintf.h>
 
+#include "sparse_stream.h"
+#include "timing.h"
+
 enum Op {
     OP_DOWNLOAD,
     OP_COMMAND,
@@ -76,6 +79,26 @@ struct Action {
 
 static std::vector<std::unique_ptr<Action>> action_list;
 
+static TimingReport* g_timing = nullptr;
+
+static const char* op_name(Op op) {
+    switch (op) {
+        case OP_DOWNLOAD: return "download";
+        case OP_COMMAND: return "command";
+        case OP_QUERY: return "query";
+        case OP_NOTICE: return "notice";
+        case OP_DOWNLOAD_SPARSE: return "download_sparse";
+        case OP_WAIT_FOR_DISCONNECT: return "wait_for_disconnect";
+        case OP_DOWNLOAD_FD: return "download_fd";
+        case OP_UPLOAD: return "upload";
+    }
+    return "unknown";
+}
+
+void fb_set_timing_report(TimingReport* report) {
+    g_timing = report;
+}
+
 bool fb_getvar(Transport* transport, const std::string& key, std::string* value) {
     std::string cmd = "getvar:" + key;
 
@@ -307,10 +330,28 @@ void fb_queue_wait_for_disconnect() {
     queue_action(OP_WAIT_FOR_DISCONNECT, "");
 }
 
+// Starts reading the next sparse download after |i|, if any, so that it comes off the disk
+// while the device is busy with the commands in between, typically flashing the previous chunk.
+static std::unique_ptr<SparseStream> prefetch_sparse(size_t i) {
+    for (++i; i < action_list.size(); ++i) {
+        if (action_list[i]->op == OP_DOWNLOAD_SPARSE) {
+            return std::make_unique<SparseStream>(
+                reinterpret_cast<sparse_file*>(action_list[i]->data));
+        }
+    }
+    return nullptr;
+}
+
 int64_t fb_execute_queue(Transport* transport) {
     int64_t status = 0;
-    for (auto& a : action_list) {
+    // Stream of the next OP_DOWNLOAD_SPARSE action, started early by prefetch_sparse(). The
+    // chunks of a resparsed image share its fd, so a new one is only started once the previous
+    // one has been downloaded in full.
+    std::unique_ptr<SparseStream> next_sparse;
+    for (size_t i = 0; i < action_list.size(); ++i) {
+        auto& a = action_list[i];
         a->start = now();
+        if (g_timing) g_timing->Begin(op_name(a->op), a->cmd, a->msg);
         if (!a->msg.empty()) {
             fprintf(stderr, "%s\n", a->msg.c_str());
         }
@@ -334,9 +375,14 @@ int64_t fb_execute_queue(Transport* transport) {
         } else if (a->op == OP_NOTICE) {
             // We already showed the notice because it's in `Action::msg`.
         } else if (a->op == OP_DOWNLOAD_SPARSE) {
-            status = fb_download_data_sparse(transport, reinterpret_cast<sparse_file*>(a->data));
+            std::unique_ptr<SparseStream> stream = std::move(next_sparse);
+            if (!stream) {
+                stream = std::make_unique<SparseStream>(reinterpret_cast<sparse_file*>(a->data));
+            }
+            status = fb_download_data_sparse(transport, stream.get());
             status = a->func(*a, status, status ? fb_get_error().c_str() : "");
             if (status) break;
+            next_sparse = prefetch_sparse(i);
         } else if (a->op == OP_WAIT_FOR_DISCONNECT) {
             transport->WaitForDisconnect();
         } else if (a->op == OP_UPLOAD) {
@@ -345,7 +391,10 @@ int64_t fb_execute_queue(Transport* transport) {
         } else {
             die("unknown action: %d", a->op);
         }
+        if (g_timing) g_timing->End(status);
     }
+    // Also ends the action that failed and broke out of the loop.
+    if (g_timing) g_timing->End(status);
     action_list.clear();
     return status;
 }
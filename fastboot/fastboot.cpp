@@ -41,6 +41,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/wait.h>
+#endif
+
 #include <chrono>
 #include <functional>
 #include <thread>
@@ -63,6 +68,7 @@
 #include "fastboot.h"
 #include "fs.h"
 #include "tcp.h"
+#include "timing.h"
 #include "transport.h"
 #include "udp.h"
 #include "usb.h"
@@ -95,6 +101,8 @@ static unsigned tags_offset    = 0x00000100;
 
 static bool g_disable_verity = false;
 static bool g_disable_verification = false;
+static bool g_disable_compression = false;
+static std::string g_timing_report;
 
 static const std::string convert_fbe_marker_filename("convert_fbe");
 
@@ -312,6 +320,115 @@ static void list_devices() {
     usb_open(list_devices_callback);
 }
 
+#if !defined(_WIN32)
+static std::vector<std::string> all_serials;
+
+static int collect_devices_callback(usb_ifc_info* info) {
+    if (match_fastboot_with_serial(info, nullptr) == 0 && info->writable &&
+        info->serial_number[0]) {
+        all_serials.push_back(info->serial_number);
+    }
+    return -1;
+}
+
+struct DeviceChild {
+    std::string serial;
+    pid_t pid;
+    int fd;
+    std::string output;
+};
+
+// Prints the complete lines buffered for |child|, or everything if |eof|, tagged with its serial.
+static void print_child_output(DeviceChild* child, bool eof) {
+    size_t start = 0;
+    while (start < child->output.size()) {
+        size_t end = child->output.find_first_of("\r\n", start);
+        if (end == std::string::npos) {
+            if (!eof) break;
+            end = child->output.size();
+        }
+        if (end > start) {
+            fprintf(stderr, "%s: %s\n", child->serial.c_str(),
+                    child->output.substr(start, end - start).c_str());
+        }
+        start = end + 1;
+    }
+    child->output.erase(0, std::min(start, child->output.size()));
+}
+
+// Implements -s ALL: forks one child per connected USB device, each of which returns -1 from here
+// with |serial| set and goes on to run the command line against its own device. Images are opened
+// and read by every child, but from the same files, so after the first device they come out of
+// the page cache. The parent relays the children's output line by line, prefixed with their
+// serial numbers, and returns 0 only if every device succeeded.
+static int fork_per_device() {
+    usb_open(collect_devices_callback);
+    if (all_serials.empty()) die("no devices found");
+
+    std::vector<DeviceChild> children;
+    fflush(stdout);
+    fflush(stderr);
+    for (const std::string& device : all_serials) {
+        int fds[2];
+        if (pipe(fds) == -1) die("pipe failed: %s", strerror(errno));
+        pid_t pid = fork();
+        if (pid == -1) die("fork failed: %s", strerror(errno));
+        if (pid == 0) {
+            for (const DeviceChild& child : children) close(child.fd);
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            dup2(fds[1], STDERR_FILENO);
+            close(fds[1]);
+            serial = device.c_str();
+            if (!g_timing_report.empty()) g_timing_report += "." + device;
+            return -1;
+        }
+        close(fds[1]);
+        children.push_back(DeviceChild{device, pid, fds[0], ""});
+    }
+
+    size_t open_pipes = children.size();
+    while (open_pipes > 0) {
+        std::vector<pollfd> pfds;
+        std::vector<DeviceChild*> polled;
+        for (DeviceChild& child : children) {
+            if (child.fd == -1) continue;
+            pfds.push_back(pollfd{child.fd, POLLIN, 0});
+            polled.push_back(&child);
+        }
+        if (TEMP_FAILURE_RETRY(poll(pfds.data(), pfds.size(), -1)) == -1) {
+            die("poll failed: %s", strerror(errno));
+        }
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (pfds[i].revents == 0) continue;
+            DeviceChild* child = polled[i];
+            char buf[4096];
+            ssize_t n = TEMP_FAILURE_RETRY(read(child->fd, buf, sizeof(buf)));
+            if (n > 0) {
+                child->output.append(buf, n);
+                print_child_output(child, false);
+            } else {
+                print_child_output(child, true);
+                close(child->fd);
+                child->fd = -1;
+                --open_pipes;
+            }
+        }
+    }
+
+    int failures = 0;
+    for (const DeviceChild& child : children) {
+        int status;
+        bool ok = TEMP_FAILURE_RETRY(waitpid(child.pid, &status, 0)) == child.pid &&
+                  WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        fprintf(stderr, "%s: %s\n", child.serial.c_str(), ok ? "OKAY" : "FAILED");
+        if (!ok) ++failures;
+    }
+    fprintf(stderr, "finished %zu device(s), %d failed\n", children.size(), failures);
+    return failures ? 1 : 0;
+}
+#endif
+
 static void syntax_error(const char* fmt, ...) {
     fprintf(stderr, "fastboot: usage: ");
 
@@ -390,6 +507,8 @@ static int show_help() {
             "                                           For ethernet, provide an address in the\n"
             "                                           form <protocol>:<hostname>[:port] where\n"
             "                                           <protocol> is either tcp or udp.\n"
+            "                                           ALL runs the command on every USB\n"
+            "                                           device in parallel.\n"
             "  -c <cmdline>                             Override kernel commandline.\n"
             "  -i <vendor id>                           Specify a custom USB vendor id.\n"
             "  -b, --base <base_addr>                   Specify a custom kernel base\n"
@@ -428,6 +547,12 @@ static int show_help() {
             "                                           the vbmeta image being flashed.\n"
             "  --disable-verification                   Set the disable-verification flag in"
             "                                           the vbmeta image being flashed.\n"
+            "  --disable-compression                    Send downloads uncompressed even if\n"
+            "                                           the bootloader supports compression.\n"
+            "  --timing-report <file>                   Write how long each step took on the\n"
+            "                                           host, transferring and on the device\n"
+            "                                           to <file> as JSON. With -s ALL, the\n"
+            "                                           serial number is appended to <file>.\n"
 #if !defined(_WIN32)
             "  --wipe-and-use-fbe                       On devices which support it,\n"
             "                                           erase userdata and cache, and\n"
@@ -1529,6 +1654,8 @@ int main(int argc, char **argv)
         {"skip-reboot", no_argument, 0, 0},
         {"disable-verity", no_argument, 0, 0},
         {"disable-verification", no_argument, 0, 0},
+        {"disable-compression", no_argument, 0, 0},
+        {"timing-report", required_argument, 0, 0},
         {"header-version", required_argument, 0, 0},
 #if !defined(_WIN32)
         {"wipe-and-use-fbe", no_argument, 0, 0},
@@ -1617,6 +1744,10 @@ int main(int argc, char **argv)
                 g_disable_verity = true;
             } else if (strcmp("disable-verification", longopts[longindex].name) == 0 ) {
                 g_disable_verification = true;
+            } else if (strcmp("disable-compression", longopts[longindex].name) == 0) {
+                g_disable_compression = true;
+            } else if (strcmp("timing-report", longopts[longindex].name) == 0) {
+                g_timing_report = optarg;
 #if !defined(_WIN32)
             } else if (strcmp("wipe-and-use-fbe", longopts[longindex].name) == 0) {
                 wants_wipe = true;
@@ -1649,13 +1780,35 @@ int main(int argc, char **argv)
         return show_help();
     }
 
+    if (serial != nullptr && strcmp(serial, "ALL") == 0) {
+#if !defined(_WIN32)
+        int status = fork_per_device();
+        if (status != -1) return status;
+#else
+        die("-s ALL is not supported on Windows");
+#endif
+    }
+
     Transport* transport = open_device();
     if (transport == nullptr) {
         return 1;
     }
 
+    std::unique_ptr<TimingReport> timing;
+    if (!g_timing_report.empty()) {
+        TimedTransport* timed = new TimedTransport(std::unique_ptr<Transport>(transport));
+        transport = timed;
+        timing.reset(new TimingReport(timed));
+        fb_set_timing_report(timing.get());
+    }
+
     const double start = now();
 
+    std::string compression;
+    if (!g_disable_compression && fb_getvar(transport, "compression", &compression)) {
+        fb_set_compression(compression);
+    }
+
     if (!supports_AB(transport) && supports_AB_obsolete(transport)) {
         fprintf(stderr, "Warning: Device A/B support is outdated. Bootloader update required.\n");
     }
@@ -1888,5 +2041,9 @@ int main(int argc, char **argv)
 
     int status = fb_execute_queue(transport) ? EXIT_FAILURE : EXIT_SUCCESS;
     fprintf(stderr, "Finished. Total time: %.3fs\n", (now() - start));
+    if (timing && !timing->Write(g_timing_report)) {
+        fprintf(stderr, "Failed to write timing report to %s: %s\n", g_timing_report.c_str(),
+                strerror(errno));
+    }
     return status;
 }
@@ -37,15 +37,19 @@
 #include "transport.h"
 
 struct sparse_file;
+class SparseStream;
+class TimingReport;
 
 /* protocol.c - fastboot protocol */
 int fb_command(Transport* transport, const std::string& cmd);
 int fb_command_response(Transport* transport, const std::string& cmd, char* response);
 int64_t fb_download_data(Transport* transport, const void* data, uint32_t size);
 int64_t fb_download_data_fd(Transport* transport, int fd, uint32_t size);
-int fb_download_data_sparse(Transport* transport, struct sparse_file* s);
+int fb_download_data_sparse(Transport* transport, SparseStream* stream);
 int64_t fb_upload_data(Transport* transport, const char* outfile);
 const std::string fb_get_error();
+// Takes the device's "compression" variable, and returns true if downloads will be compressed.
+bool fb_set_compression(const std::string& supported);
 
 #define FB_COMMAND_SZ 64
 #define FB_RESPONSE_SZ 64
@@ -71,6 +75,8 @@ void fb_queue_notice(const std::string& notice);
 void fb_queue_wait_for_disconnect(void);
 int64_t fb_execute_queue(Transport* transport);
 void fb_set_active(const std::string& slot);
+// Records every action fb_execute_queue() runs in |report|, which may be null to stop.
+void fb_set_timing_report(TimingReport* report);
 
 /* util stuff */
 double now();
@@ -26,9 +26,6 @@
  * SUCH DAMAGE.
  */
 
-#define round_down(a, b) \
-    ({ typeof(a) _a = (a); typeof(b) _b = (b); _a - (_a % _b); })
-
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,15 +37,27 @@
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
-#include <sparse/sparse.h>
+#include <lz4.h>
 #include <utils/FileMap.h>
 
 #include "fastboot.h"
+#include "sparse_stream.h"
 #include "transport.h"
 
 static std::string g_error;
 
+// Set by fb_set_compression() when the device takes "download-lz4".
+static bool g_download_lz4 = false;
+
+// Framing of a "download-lz4" payload: blocks of at most kLz4BlockSize bytes once decompressed,
+// each preceded by two little-endian words, its decompressed size and its stored size. Blocks
+// LZ4 can't shrink are stored as is, flagged by kLz4Stored in the stored size.
+static constexpr size_t kLz4BlockSize = 1024 * 1024;
+static constexpr size_t kLz4HeaderSize = 2 * sizeof(uint32_t);
+static constexpr uint32_t kLz4Stored = 0x80000000;
+
 using android::base::unique_fd;
 using android::base::WriteStringToFile;
 
@@ -227,6 +236,59 @@ static int _command_send_no_data(Transport* transport, const std::string& cmd, c
     return _command_start(transport, cmd, 0, response);
 }
 
+static void put_le32(char* p, uint32_t value) {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        p[i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+// Appends |size| bytes of |data| to |payload| in the "download-lz4" framing.
+static void lz4_append(std::vector<char>* payload, const char* data, size_t size) {
+    while (size > 0) {
+        size_t raw = std::min(size, kLz4BlockSize);
+        size_t header = payload->size();
+        int bound = LZ4_compressBound(raw);
+        payload->resize(header + kLz4HeaderSize + bound);
+
+        char* block = payload->data() + header + kLz4HeaderSize;
+        int stored = LZ4_compress_default(data, block, raw, bound);
+        uint32_t stored_size = stored;
+        if (stored <= 0 || static_cast<size_t>(stored) >= raw) {
+            memcpy(block, data, raw);
+            stored = raw;
+            stored_size = raw | kLz4Stored;
+        }
+        put_le32(payload->data() + header, raw);
+        put_le32(payload->data() + header + sizeof(uint32_t), stored_size);
+        payload->resize(header + kLz4HeaderSize + stored);
+
+        data += raw;
+        size -= raw;
+    }
+}
+
+// Sends |payload|, the framed compression of |size| bytes, to be decompressed into the download
+// buffer as it is received.
+static int64_t _command_send_lz4(Transport* transport, uint32_t size,
+                                 const std::vector<char>& payload) {
+    if (payload.size() > std::numeric_limits<uint32_t>::max()) {
+        g_error = "compressed download too large";
+        return -1;
+    }
+    std::string cmd(android::base::StringPrintf("download-lz4:%08x:%08zx", size, payload.size()));
+    return _command_send(transport, cmd, payload.data(), payload.size(), 0) < 0 ? -1 : 0;
+}
+
+bool fb_set_compression(const std::string& supported) {
+    g_download_lz4 = false;
+    for (const std::string& algorithm : android::base::Split(supported, ",")) {
+        if (android::base::Trim(algorithm) == "lz4") {
+            g_download_lz4 = true;
+        }
+    }
+    return g_download_lz4;
+}
+
 int fb_command(Transport* transport, const std::string& cmd) {
     return _command_send_no_data(transport, cmd, 0);
 }
@@ -236,11 +298,33 @@ int fb_command_response(Transport* transport, const std::string& cmd, char* resp
 }
 
 int64_t fb_download_data(Transport* transport, const void* data, uint32_t size) {
+    if (g_download_lz4 && size > 0) {
+        std::vector<char> payload;
+        lz4_append(&payload, reinterpret_cast<const char*>(data), size);
+        return _command_send_lz4(transport, size, payload);
+    }
+
     std::string cmd(android::base::StringPrintf("download:%08x", size));
     return _command_send(transport, cmd.c_str(), data, size, 0) < 0 ? -1 : 0;
 }
 
 int64_t fb_download_data_fd(Transport* transport, int fd, uint32_t size) {
+    if (g_download_lz4 && size > 0) {
+        static constexpr uint32_t MAX_MAP_SIZE = 64 * 1024 * 1024;
+        std::vector<char> payload;
+        for (uint32_t offset = 0; offset < size;) {
+            android::FileMap filemap;
+            uint32_t len = std::min(size - offset, MAX_MAP_SIZE);
+            if (!filemap.create(NULL, fd, offset, len, true)) {
+                g_error = android::base::StringPrintf("failed to map image (%s)", strerror(errno));
+                return -1;
+            }
+            lz4_append(&payload, reinterpret_cast<const char*>(filemap.getDataPtr()), len);
+            offset += len;
+        }
+        return _command_send_lz4(transport, size, payload);
+    }
+
     std::string cmd(android::base::StringPrintf("download:%08x", size));
     return _command_send_fd(transport, cmd.c_str(), fd, size, 0) < 0 ? -1 : 0;
 }
@@ -267,90 +351,43 @@ int64_t fb_upload_data(Transport* transport, const char* outfile) {
     return _command_end(transport);
 }
 
-#define TRANSPORT_BUF_SIZE 1024
-static char transport_buf[TRANSPORT_BUF_SIZE];
-static int transport_buf_len;
-
-static int fb_download_data_sparse_write(void *priv, const void *data, int len)
-{
-    int r;
-    Transport* transport = reinterpret_cast<Transport*>(priv);
-    int to_write;
-    const char* ptr = reinterpret_cast<const char*>(data);
-
-    if (transport_buf_len) {
-        to_write = std::min(TRANSPORT_BUF_SIZE - transport_buf_len, len);
-
-        memcpy(transport_buf + transport_buf_len, ptr, to_write);
-        transport_buf_len += to_write;
-        ptr += to_write;
-        len -= to_write;
-    }
-
-    if (transport_buf_len == TRANSPORT_BUF_SIZE) {
-        r = _command_write_data(transport, transport_buf, TRANSPORT_BUF_SIZE);
-        if (r != TRANSPORT_BUF_SIZE) {
-            return -1;
-        }
-        transport_buf_len = 0;
-    }
-
-    if (len > TRANSPORT_BUF_SIZE) {
-        if (transport_buf_len > 0) {
-            g_error = "internal error: transport_buf not empty";
-            return -1;
-        }
-        to_write = round_down(len, TRANSPORT_BUF_SIZE);
-        r = _command_write_data(transport, ptr, to_write);
-        if (r != to_write) {
-            return -1;
-        }
-        ptr += to_write;
-        len -= to_write;
+int fb_download_data_sparse(Transport* transport, SparseStream* stream) {
+    int64_t size = stream->size();
+    if (size <= 0 || size > UINT32_MAX) {
+        g_error = "sparse image too large to download";
+        return -1;
     }
 
-    if (len > 0) {
-        if (len > TRANSPORT_BUF_SIZE) {
-            g_error = "internal error: too much left for transport_buf";
-            return -1;
+    if (g_download_lz4) {
+        // The compressed size has to be known up front, so the payload is built in full first.
+        std::vector<char> payload;
+        std::vector<char> buffer;
+        while (stream->Next(&buffer)) {
+            lz4_append(&payload, buffer.data(), buffer.size());
         }
-        memcpy(transport_buf, ptr, len);
-        transport_buf_len = len;
-    }
-
-    return 0;
-}
-
-static int fb_download_data_sparse_flush(Transport* transport) {
-    if (transport_buf_len > 0) {
-        int64_t r = _command_write_data(transport, transport_buf, transport_buf_len);
-        if (r != static_cast<int64_t>(transport_buf_len)) {
+        if (stream->error()) {
+            g_error = "failed to read sparse image";
             return -1;
         }
-        transport_buf_len = 0;
-    }
-    return 0;
-}
-
-int fb_download_data_sparse(Transport* transport, struct sparse_file* s) {
-    int size = sparse_file_len(s, true, false);
-    if (size <= 0) {
-        return -1;
+        return _command_send_lz4(transport, size, payload);
     }
 
-    std::string cmd(android::base::StringPrintf("download:%08x", size));
+    std::string cmd(android::base::StringPrintf("download:%08x", static_cast<uint32_t>(size)));
     int r = _command_start(transport, cmd, size, 0);
     if (r < 0) {
         return -1;
     }
 
-    r = sparse_file_callback(s, true, false, fb_download_data_sparse_write, transport);
-    if (r < 0) {
-        return -1;
+    // Buffers come in multiples of 1k but for the last one, which is what bootloaders expect.
+    std::vector<char> buffer;
+    while (stream->Next(&buffer)) {
+        int64_t written = _command_write_data(transport, buffer.data(), buffer.size());
+        if (written != static_cast<int64_t>(buffer.size())) {
+            return -1;
+        }
     }
-
-    r = fb_download_data_sparse_flush(transport);
-    if (r < 0) {
+    if (stream->error()) {
+        g_error = "failed to read sparse image";
         return -1;
     }
 
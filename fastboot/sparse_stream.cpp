@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "sparse_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <sparse/sparse.h>
+
+SparseStream::SparseStream(sparse_file* s)
+    : sparse_(s), size_(sparse_file_len(s, true, false)), thread_(&SparseStream::Produce, this) {}
+
+SparseStream::~SparseStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+int SparseStream::Write(void* priv, const void* data, int len) {
+    return reinterpret_cast<SparseStream*>(priv)->Append(reinterpret_cast<const char*>(data), len);
+}
+
+int SparseStream::Append(const char* data, size_t len) {
+    while (len > 0) {
+        if (pending_.empty()) {
+            pending_.reserve(kBufferSize);
+        }
+        size_t n = std::min(len, kBufferSize - pending_.size());
+        pending_.insert(pending_.end(), data, data + n);
+        data += n;
+        len -= n;
+        if (pending_.size() == kBufferSize && !Push(&pending_)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+bool SparseStream::Push(std::vector<char>* buffer) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return cancelled_ || buffered_ < kMaxBuffered; });
+    if (cancelled_) {
+        return false;
+    }
+    buffered_ += buffer->size();
+    buffers_.push_back(std::move(*buffer));
+    buffer->clear();
+    cv_.notify_all();
+    return true;
+}
+
+void SparseStream::Produce() {
+    bool ok = size_ > 0 && sparse_file_callback(sparse_, true, false, Write, this) == 0 &&
+              (pending_.empty() || Push(&pending_));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    error_ = !ok;
+    cv_.notify_all();
+}
+
+bool SparseStream::Next(std::vector<char>* buffer) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return done_ || !buffers_.empty(); });
+    if (buffers_.empty()) {
+        return false;
+    }
+    *buffer = std::move(buffers_.front());
+    buffers_.pop_front();
+    buffered_ -= buffer->size();
+    cv_.notify_all();
+    return true;
+}
+
+bool SparseStream::error() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef SPARSE_STREAM_H_
+#define SPARSE_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android-base/macros.h>
+
+struct sparse_file;
+
+// Serializes a sparse file into its download stream on a worker thread, so reading and
+// chunking the backing image overlaps with the USB or network transfer that consumes it. The
+// worker stays at most kMaxBuffered bytes ahead of the consumer.
+//
+// Sparse files resparsed from one image share its fd and seek it while being written out, so
+// only one SparseStream per image may be producing at a time: start the next one once Next()
+// has returned false.
+class SparseStream {
+  public:
+    static constexpr size_t kBufferSize = 1024 * 1024;
+    static constexpr size_t kMaxBuffered = 32 * 1024 * 1024;
+
+    // Starts producing immediately. |s| must outlive this object.
+    explicit SparseStream(sparse_file* s);
+    ~SparseStream();
+
+    // Size of the whole stream in bytes, or a negative value if it can't be represented.
+    int64_t size() const { return size_; }
+
+    // Hands over the next buffer, every one but the last being kBufferSize long. Returns false
+    // once the stream is exhausted or if serializing the sparse file failed; error() tells the
+    // two apart.
+    bool Next(std::vector<char>* buffer);
+    bool error();
+
+  private:
+    static int Write(void* priv, const void* data, int len);
+    int Append(const char* data, size_t len);
+    bool Push(std::vector<char>* buffer);
+    void Produce();
+
+    sparse_file* sparse_;
+    int64_t size_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::vector<char>> buffers_;
+    size_t buffered_ = 0;
+    bool done_ = false;
+    bool error_ = false;
+    bool cancelled_ = false;
+
+    // Only touched by the worker.
+    std::vector<char> pending_;
+
+    std::thread thread_;
+
+    DISALLOW_COPY_AND_ASSIGN(SparseStream);
+};
+
+#endif  // SPARSE_STREAM_H_
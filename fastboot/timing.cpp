@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "timing.h"
+
+#include <stdio.h>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include "fastboot.h"
+
+using android::base::StringAppendF;
+
+TimedTransport::TimedTransport(std::unique_ptr<Transport> transport)
+    : transport_(std::move(transport)) {}
+
+ssize_t TimedTransport::Read(void* data, size_t len) {
+    double start = now();
+    ssize_t r = transport_->Read(data, len);
+    counters_.read_time += now() - start;
+    if (r > 0) counters_.bytes_read += r;
+    return r;
+}
+
+ssize_t TimedTransport::Write(const void* data, size_t len) {
+    double start = now();
+    ssize_t r = transport_->Write(data, len);
+    double elapsed = now() - start;
+    counters_.write_time += elapsed;
+    counters_.max_write_time = std::max(counters_.max_write_time, elapsed);
+    counters_.writes++;
+    if (r > 0) counters_.bytes_written += r;
+    return r;
+}
+
+int TimedTransport::Close() {
+    return transport_->Close();
+}
+
+int TimedTransport::WaitForDisconnect() {
+    double start = now();
+    int r = transport_->WaitForDisconnect();
+    counters_.read_time += now() - start;
+    return r;
+}
+
+TimingReport::TimingReport(TimedTransport* transport) : transport_(transport) {
+    start_ = Take();
+}
+
+TimingReport::Sample TimingReport::Take() const {
+    Sample sample;
+    sample.time = now();
+#if !defined(_WIN32)
+    // Covers every thread, so includes SparseStream resparsing ahead of the transfer.
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        sample.cpu_user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+        sample.cpu_system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+    }
+#endif
+    sample.counters = transport_->counters();
+    return sample;
+}
+
+void TimingReport::Begin(const char* op, const std::string& cmd, const std::string& msg) {
+    Entry entry;
+    entry.op = op;
+    entry.cmd = cmd;
+    entry.msg = msg;
+    transport_->ResetMaxWriteTime();
+    entry.start = Take();
+    entries_.push_back(entry);
+}
+
+void TimingReport::End(int64_t status) {
+    if (entries_.empty() || entries_.back().ended) return;
+    entries_.back().status = status;
+    entries_.back().end = Take();
+    entries_.back().ended = true;
+}
+
+static std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            StringAppendF(&out, "\\u%04x", c);
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Appends the fields describing what happened between |start| and |end|.
+static void append_span(std::string* out, const char* indent, double start_time, double end_time,
+                        double cpu_user, double cpu_system, const TimedTransport::Counters& start,
+                        const TimedTransport::Counters& end) {
+    double wall = end_time - start_time;
+    double transfer = end.write_time - start.write_time;
+    double device = end.read_time - start.read_time;
+    uint64_t written = end.bytes_written - start.bytes_written;
+
+    StringAppendF(out, "%s\"wall_s\": %.6f,\n", indent, wall);
+    StringAppendF(out, "%s\"host_s\": %.6f,\n", indent, std::max(0.0, wall - transfer - device));
+    StringAppendF(out, "%s\"transfer_s\": %.6f,\n", indent, transfer);
+    StringAppendF(out, "%s\"device_s\": %.6f,\n", indent, device);
+    StringAppendF(out, "%s\"bytes_written\": %" PRIu64 ",\n", indent, written);
+    StringAppendF(out, "%s\"bytes_read\": %" PRIu64 ",\n", indent,
+                  end.bytes_read - start.bytes_read);
+    StringAppendF(out, "%s\"writes\": %" PRIu64 ",\n", indent, end.writes - start.writes);
+    StringAppendF(out, "%s\"transfer_bytes_per_s\": %.0f,\n", indent,
+                  transfer > 0 ? written / transfer : 0);
+    StringAppendF(out, "%s\"cpu_user_s\": %.6f,\n", indent, cpu_user);
+    StringAppendF(out, "%s\"cpu_system_s\": %.6f", indent, cpu_system);
+}
+
+bool TimingReport::Write(const std::string& path) const {
+    Sample end = Take();
+    std::string out = "{\n";
+    append_span(&out, "  ", start_.time, end.time, end.cpu_user - start_.cpu_user,
+                end.cpu_system - start_.cpu_system, start_.counters, end.counters);
+    out += ",\n  \"actions\": [";
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& e = entries_[i];
+        // An action still running, if any, is reported up to now.
+        const Sample& e_end = e.ended ? e.end : end;
+        out += i ? ",\n    {\n" : "\n    {\n";
+        StringAppendF(&out, "      \"op\": \"%s\",\n", e.op);
+        if (!e.cmd.empty()) {
+            StringAppendF(&out, "      \"command\": %s,\n", json_string(e.cmd).c_str());
+        }
+        if (!e.msg.empty()) {
+            StringAppendF(&out, "      \"message\": %s,\n", json_string(e.msg).c_str());
+        }
+        StringAppendF(&out, "      \"status\": %" PRId64 ",\n", e.status);
+        StringAppendF(&out, "      \"max_write_s\": %.6f,\n", e_end.counters.max_write_time);
+        append_span(&out, "      ", e.start.time, e_end.time, e_end.cpu_user - e.start.cpu_user,
+                    e_end.cpu_system - e.start.cpu_system, e.start.counters, e_end.counters);
+        out += "\n    }";
+    }
+    out += entries_.empty() ? "]\n}\n" : "\n  ]\n}\n";
+    return android::base::WriteStringToFile(out, path);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/macros.h>
+
+#include "transport.h"
+
+// Wraps a transport to count the bytes moved and the time spent in each direction. Time in
+// Write() is the host to device transfer, time in Read() and WaitForDisconnect() is spent
+// waiting for the device to answer, which for commands like flash or erase is the device
+// writing to or erasing its storage.
+class TimedTransport : public Transport {
+  public:
+    struct Counters {
+        uint64_t bytes_written = 0;
+        uint64_t bytes_read = 0;
+        uint64_t writes = 0;
+        double write_time = 0;
+        double read_time = 0;
+        double max_write_time = 0;
+    };
+
+    explicit TimedTransport(std::unique_ptr<Transport> transport);
+    ~TimedTransport() override = default;
+
+    ssize_t Read(void* data, size_t len) override;
+    ssize_t Write(const void* data, size_t len) override;
+    int Close() override;
+    int WaitForDisconnect() override;
+
+    const Counters& counters() const { return counters_; }
+    // Starts over the longest single Write(), which is the only counter that isn't a sum.
+    void ResetMaxWriteTime() { counters_.max_write_time = 0; }
+
+  private:
+    std::unique_ptr<Transport> transport_;
+    Counters counters_;
+
+    DISALLOW_COPY_AND_ASSIGN(TimedTransport);
+};
+
+// Collects what fb_execute_queue() did, one entry per action, and writes it out as JSON for
+// --timing-report.
+class TimingReport {
+  public:
+    explicit TimingReport(TimedTransport* transport);
+
+    // Every Begin() is followed by an End(), further End() calls are ignored.
+    void Begin(const char* op, const std::string& cmd, const std::string& msg);
+    void End(int64_t status);
+
+    // Returns false if |path| couldn't be written.
+    bool Write(const std::string& path) const;
+
+  private:
+    struct Sample {
+        double time = 0;
+        double cpu_user = 0;
+        double cpu_system = 0;
+        TimedTransport::Counters counters;
+    };
+
+    struct Entry {
+        const char* op;
+        std::string cmd;
+        std::string msg;
+        int64_t status = 0;
+        bool ended = false;
+        Sample start;
+        Sample end;
+    };
+
+    Sample Take() const;
+
+    TimedTransport* transport_;
+    Sample start_;
+    std::vector<Entry> entries_;
+
+    DISALLOW_COPY_AND_ASSIGN(TimingReport);
+};
+
+#endif  // TIMING_H_
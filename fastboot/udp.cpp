@@ -130,9 +130,17 @@ class UdpTransport : public Transport {
                                    uint8_t* rx_data, size_t rx_length, int attempts,
                                    std::string* error);
 
+    // Sends |length| bytes from |data| with up to |window_size_| packets in flight, for writes,
+    // whose responses carry no data. Packets are retransmitted only if their response doesn't
+    // come, so the device may ack or drop those that arrive out of order. Returns true on success,
+    // and fills |error| on failure.
+    bool SendWindowedData(Id id, const uint8_t* tx_data, size_t tx_length, int attempts,
+                          std::string* error);
+
     std::unique_ptr<Socket> socket_;
     int sequence_ = -1;
     size_t max_data_length_ = kMinPacketSize - kHeaderSize;
+    size_t window_size_ = 1;
     std::vector<uint8_t> rx_packet_;
 
     DISALLOW_COPY_AND_ASSIGN(UdpTransport);
@@ -150,7 +158,7 @@ std::unique_ptr<UdpTransport> UdpTransport::NewTransport(std::unique_ptr<Socket>
 }
 
 bool UdpTransport::InitializeProtocol(std::string* error) {
-    uint8_t rx_data[4];
+    uint8_t rx_data[6];
 
     sequence_ = 0;
     rx_packet_.resize(kMinPacketSize);
@@ -168,9 +176,11 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     // The first two bytes contain the next expected sequence number.
     sequence_ = ExtractUint16(rx_data);
 
-    // Now send the initialization packet with our version and maximum packet size.
-    uint8_t init_data[] = {kProtocolVersion >> 8, kProtocolVersion & 0xFF,
-                           kHostMaxPacketSize >> 8, kHostMaxPacketSize & 0xFF};
+    // Now send the initialization packet with our version, maximum packet size and window size.
+    // Devices before kWindowedProtocolVersion ignore the window size as extra data.
+    uint8_t init_data[] = {kProtocolVersion >> 8,   kProtocolVersion & 0xFF,
+                           kHostMaxPacketSize >> 8, kHostMaxPacketSize & 0xFF,
+                           kHostMaxWindowSize >> 8, kHostMaxWindowSize & 0xFF};
     rx_bytes = SendData(kIdInitialization, init_data, sizeof(init_data), rx_data, sizeof(rx_data),
                         kMaxTransmissionAttempts, error);
     if (rx_bytes == -1) {
@@ -198,6 +208,12 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     max_data_length_ = packet_size - kHeaderSize;
     rx_packet_.resize(packet_size);
 
+    window_size_ = 1;
+    if (version >= kWindowedProtocolVersion && rx_bytes >= 6) {
+        uint16_t device_window_size = ExtractUint16(rx_data + 4);
+        window_size_ = std::max<size_t>(1, std::min(kHostMaxWindowSize, device_window_size));
+    }
+
     return true;
 }
 
@@ -324,6 +340,83 @@ ssize_t UdpTransport::SendSinglePacketHelper(
     return total_data_bytes;
 }
 
+bool UdpTransport::SendWindowedData(Id id, const uint8_t* tx_data, size_t tx_length,
+                                    int attempts, std::string* error) {
+    error->clear();
+
+    // Packet |i| of the transfer has sequence number |sequence_| + |i|, and those from |acked|
+    // to |sent| are in flight, with their responses tracked in a ring of |window_size_|.
+    size_t packets = (tx_length + max_data_length_ - 1) / max_data_length_;
+    std::vector<bool> responded(window_size_);
+    size_t acked = 0;
+    size_t sent = 0;
+
+    auto send_packet = [&](size_t i) {
+        size_t offset = i * max_data_length_;
+        size_t length = std::min(max_data_length_, tx_length - offset);
+        Header header;
+        header.Set(id, sequence_ + i, i + 1 < packets ? kFlagContinuation : kFlagNone);
+        if (!socket_->Send({{header.bytes(), kHeaderSize}, {tx_data + offset, length}})) {
+            *error = Socket::GetErrorMessage();
+            return false;
+        }
+        return true;
+    };
+
+    int attempts_left = attempts;
+    while (acked < packets) {
+        for (; sent < packets && sent - acked < window_size_; ++sent) {
+            responded[sent % window_size_] = false;
+            if (!send_packet(sent)) return false;
+        }
+
+        ssize_t bytes = socket_->Receive(rx_packet_.data(), rx_packet_.size(), kResponseTimeoutMs);
+        if (bytes == -1) {
+            if (!socket_->ReceiveTimedOut()) {
+                *error = Socket::GetErrorMessage();
+                return false;
+            }
+            if (--attempts_left <= 0) {
+                *error = "no response from target";
+                return false;
+            }
+            for (size_t i = acked; i < sent; ++i) {
+                if (!responded[i % window_size_] && !send_packet(i)) return false;
+            }
+            continue;
+        } else if (bytes < static_cast<ssize_t>(kHeaderSize)) {
+            *error = "protocol error: incomplete header";
+            return false;
+        }
+
+        // Ignore responses to packets that aren't in flight, like stale duplicates.
+        uint16_t offset = ExtractUint16(&rx_packet_[kIndexSeqH]) - (sequence_ + acked);
+        if (offset >= sent - acked ||
+            (rx_packet_[kIndexId] != id && rx_packet_[kIndexId] != kIdError)) {
+            continue;
+        }
+
+        if (rx_packet_[kIndexId] == kIdError) {
+            *error = "target reported error: " +
+                     std::string(rx_packet_.data() + kHeaderSize, rx_packet_.data() + bytes);
+            return false;
+        } else if (bytes > static_cast<ssize_t>(kHeaderSize) ||
+                   (rx_packet_[kIndexFlags] & kFlagContinuation)) {
+            *error = "target sent fastboot data out-of-turn";
+            return false;
+        }
+
+        attempts_left = attempts;
+        responded[(acked + offset) % window_size_] = true;
+        while (acked < sent && responded[acked % window_size_]) {
+            ++acked;
+        }
+    }
+
+    sequence_ += packets;
+    return true;
+}
+
 ssize_t UdpTransport::Read(void* data, size_t length) {
     // Read from the target by sending an empty packet.
     std::string error;
@@ -345,6 +438,19 @@ ssize_t UdpTransport::Read(void* data, size_t length) {
 
 ssize_t UdpTransport::Write(const void* data, size_t length) {
     std::string error;
+
+    if (window_size_ > 1 && length > max_data_length_) {
+        if (socket_ == nullptr) {
+            fprintf(stderr, "UDP error: socket is closed\n");
+            return -1;
+        }
+        if (!SendWindowedData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length,
+                              kMaxTransmissionAttempts, &error)) {
+            fprintf(stderr, "UDP error: %s\n", error.c_str());
+            return -1;
+        }
+        return length;
+    }
     ssize_t bytes = SendData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length, nullptr,
                              0, kMaxTransmissionAttempts, &error);
 
@@ -51,6 +51,12 @@ constexpr uint16_t kProtocolVersion = 1;
 // This will be negotiated with the device so may end up being smaller.
 constexpr uint16_t kHostMaxPacketSize = 8192;
 
+// Devices from this version on may answer the host's maximum window size, appended to its
+// initialization packet, with their own. Writes then keep up to the smaller of the two packets in
+// flight rather than waiting for each response in turn.
+constexpr uint16_t kWindowedProtocolVersion = 2;
+constexpr uint16_t kHostMaxWindowSize = 32;
+
 // Retransmission constants. Retransmission timeout must be at least 500ms, and the host must
 // attempt to send packets for at least 1 minute once the device has connected. See
 // fastboot_protocol.txt for more information.
@@ -56,6 +56,17 @@ static std::string InitPacket(uint16_t sequence, uint16_t version, uint16_t max_
            PacketValue(version) + PacketValue(max_packet_size);
 }
 
+// Returns an Init packet with a 2-byte |version|, |max_packet_size| and |max_window_size|.
+static std::string InitPacket(uint16_t sequence, uint16_t version, uint16_t max_packet_size,
+                              uint16_t max_window_size) {
+    return InitPacket(sequence, version, max_packet_size) + PacketValue(max_window_size);
+}
+
+// Returns the Init packet the host sends.
+static std::string HostInitPacket(uint16_t sequence) {
+    return InitPacket(sequence, kProtocolVersion, kHostMaxPacketSize, kHostMaxWindowSize);
+}
+
 // Returns a Fastboot packet with |data|.
 static std::string FastbootPacket(uint16_t sequence, const std::string& data = "",
                                   char flags = kFlagNone) {
@@ -89,7 +100,7 @@ TEST_F(UdpConnectTest, InitializationSuccess) {
     for (uint16_t seq : kTestSequenceNumbers) {
         mock_socket_->ExpectSend(QueryPacket(0));
         mock_socket_->AddReceive(QueryPacket(0, seq));
-        mock_socket_->ExpectSend(InitPacket(seq, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(seq));
         mock_socket_->AddReceive(InitPacket(seq, kProtocolVersion, 1024));
 
         EXPECT_TRUE(UdpConnect());
@@ -103,7 +114,7 @@ TEST_F(UdpConnectTest, InitializationContinuationSuccess) {
     mock_socket_->ExpectSend(std::string{kIdDeviceQuery, kFlagNone, 0, 1});
     mock_socket_->AddReceive(std::string{kIdDeviceQuery, kFlagNone, 0, 1, 0x55});
 
-    mock_socket_->ExpectSend(InitPacket(0x4455, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0x4455));
     mock_socket_->AddReceive(std::string{kIdInitialization, kFlagContinuation, 0x44, 0x55, 0});
     mock_socket_->ExpectSend(std::string{kIdInitialization, kFlagNone, 0x44, 0x56});
     mock_socket_->AddReceive(std::string{kIdInitialization, kFlagContinuation, 0x44, 0x56, 1});
@@ -121,14 +132,14 @@ TEST_F(UdpConnectTest, InitializationContinuationSuccess) {
 TEST_F(UdpConnectTest, InitializationVersionMismatch) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, 2, 1024));
 
     EXPECT_TRUE(UdpConnect());
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, 0, 1024));
 
     EXPECT_FALSE(UdpConnect());
@@ -154,7 +165,7 @@ TEST_F(UdpConnectTest, InitResponseTimeoutFailure) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
     for (int i = 0; i < kMaxTransmissionAttempts; ++i) {
-        mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(0));
         mock_socket_->AddReceiveTimeout();
     }
 
@@ -164,7 +175,7 @@ TEST_F(UdpConnectTest, InitResponseTimeoutFailure) {
 TEST_F(UdpConnectTest, InitResponseReceiveFailure) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceiveFailure();
 
     EXPECT_FALSE(UdpConnect());
@@ -182,10 +193,10 @@ TEST_F(UdpConnectTest, ResponseRecovery) {
 
     // Subsequent packets try up to (kMaxTransmissionAttempts - 1) times.
     for (int i = 0; i < kMaxTransmissionAttempts - 1; ++i) {
-        mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(0));
         mock_socket_->AddReceiveTimeout();
     }
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024));
 
     EXPECT_TRUE(UdpConnect());
@@ -195,7 +206,7 @@ TEST_F(UdpConnectTest, ResponseRecovery) {
 TEST_F(UdpConnectTest, ExtraResponseDataSuccess) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0) + "foo");
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024) + "bar");
 
     EXPECT_TRUE(UdpConnect());
@@ -208,7 +219,7 @@ TEST_F(UdpConnectTest, WrongSequenceRecovery) {
     mock_socket_->AddReceive(QueryPacket(1, 0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
 
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(1, kProtocolVersion, 1024));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024));
 
@@ -221,7 +232,7 @@ TEST_F(UdpConnectTest, WrongIdRecovery) {
     mock_socket_->AddReceive(FastbootPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
 
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(FastbootPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024));
 
@@ -251,7 +262,7 @@ TEST_F(UdpConnectTest, InvalidInitResponseFailure) {
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 511));
 
     EXPECT_FALSE(UdpConnect(&error));
@@ -259,7 +270,7 @@ TEST_F(UdpConnectTest, InvalidInitResponseFailure) {
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, 0, 1024));
 
     EXPECT_FALSE(UdpConnect(&error));
@@ -277,7 +288,7 @@ TEST_F(UdpConnectTest, ErrorResponseFailure) {
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(ErrorPacket(0, "error2"));
 
     EXPECT_FALSE(UdpConnect(&error));
@@ -309,15 +320,21 @@ class UdpTest : public ::testing::Test {
     }
 
     // Sets up |mock_socket_| to correctly initialize the protocol and creates |transport_|. This
-    // can be called multiple times in a test if needed.
-    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512) {
+    // can be called multiple times in a test if needed. A |device_window_size| makes the device
+    // answer with kWindowedProtocolVersion.
+    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512,
+                             uint16_t device_window_size = 0) {
         mock_socket_ = new SocketMock;
         mock_socket_->ExpectSend(QueryPacket(0));
         mock_socket_->AddReceive(QueryPacket(0, starting_sequence));
-        mock_socket_->ExpectSend(
-                InitPacket(starting_sequence, kProtocolVersion, kHostMaxPacketSize));
-        mock_socket_->AddReceive(
-                InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size));
+        mock_socket_->ExpectSend(HostInitPacket(starting_sequence));
+        if (device_window_size > 0) {
+            mock_socket_->AddReceive(InitPacket(starting_sequence, kWindowedProtocolVersion,
+                                                device_max_packet_size, device_window_size));
+        } else {
+            mock_socket_->AddReceive(
+                    InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size));
+        }
 
         std::string error;
         transport_ = Connect(std::unique_ptr<Socket>(mock_socket_), &error);
@@ -523,6 +540,68 @@ TEST_F(UdpTest, ErrorResponse) {
 }
 
 // Tests that attempting to use a closed transport returns -1 without making any socket calls.
+// Tests a write with several packets in flight, sent as the window moves.
+TEST_F(UdpTest, WindowedWrite) {
+    ASSERT_TRUE(InitializeTransport(0xFFFD, 512, 4));
+
+    std::string packets[6];
+    for (int i = 0; i < 6; ++i) {
+        packets[i] = std::string(i < 5 ? 508 : 10, 'a' + i);
+    }
+    auto packet = [&packets](int i) {
+        return FastbootPacket(0xFFFE + i, packets[i], i < 5 ? kFlagContinuation : kFlagNone);
+    };
+
+    for (int i = 0; i < 4; ++i) {
+        mock_socket_->ExpectSend(packet(i));
+    }
+    mock_socket_->AddReceive(FastbootPacket(0xFFFE));
+    mock_socket_->ExpectSend(packet(4));
+    mock_socket_->AddReceive(FastbootPacket(0xFFFF));
+    mock_socket_->ExpectSend(packet(5));
+    for (int i = 2; i < 6; ++i) {
+        mock_socket_->AddReceive(FastbootPacket(0xFFFE + i));
+    }
+
+    EXPECT_TRUE(Write(packets[0] + packets[1] + packets[2] + packets[3] + packets[4] +
+                      packets[5]));
+
+    // The sequence carries on after the window.
+    mock_socket_->ExpectSend(FastbootPacket(4, "foo"));
+    mock_socket_->AddReceive(FastbootPacket(4));
+    EXPECT_TRUE(Write("foo"));
+}
+
+// Tests that only the packets whose responses didn't come are sent again.
+TEST_F(UdpTest, WindowedWriteSelectiveRetransmit) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4));
+
+    std::string data(508 * 4, 'x');
+    for (int i = 0; i < 4; ++i) {
+        mock_socket_->ExpectSend(FastbootPacket(
+                1 + i, data.substr(i * 508, 508), i < 3 ? kFlagContinuation : kFlagNone));
+    }
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->AddReceive(FastbootPacket(3));
+    mock_socket_->AddReceive(FastbootPacket(4));
+    mock_socket_->AddReceiveTimeout();
+    mock_socket_->ExpectSend(FastbootPacket(2, data.substr(508, 508), kFlagContinuation));
+    mock_socket_->AddReceive(FastbootPacket(2));
+
+    EXPECT_TRUE(Write(data));
+}
+
+TEST_F(UdpTest, WindowedWriteErrorResponse) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4));
+
+    std::string data(508 * 2, 'x');
+    mock_socket_->ExpectSend(FastbootPacket(1, data.substr(0, 508), kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(2, data.substr(508)));
+    mock_socket_->AddReceive(ErrorPacket(1, "oops"));
+
+    EXPECT_FALSE(Write(data));
+}
+
 TEST_F(UdpTest, CloseTransport) {
     char buffer[32];
     EXPECT_EQ(0, transport_->Close());
@@ -37,15 +37,18 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 
 #include <linux/usbdevice_fs.h>
 #include <linux/version.h>
 #include <linux/usb/ch9.h>
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include "fastboot.h"
 #include "usb.h"
@@ -83,6 +86,13 @@ using namespace std::chrono_literals;
 // kernel.
 #define MAX_USBFS_BULK_SIZE (16 * 1024)
 
+// Writes are queued as URBs, so that the host controller always has the next transfer to start
+// as soon as one completes rather than idling while we make the next ioctl. On kernels that stitch
+// URBs together from 16KiB pieces (see above) each URB can be bigger, which saves interrupts and
+// syscalls; should one still fail to get memory, we fall back to MAX_USBFS_BULK_SIZE.
+#define MAX_USBFS_URB_SIZE (256 * 1024)
+#define MAX_URBS_IN_FLIGHT 16
+
 struct usb_handle
 {
     char fname[64];
@@ -102,7 +112,12 @@ class LinuxUsbTransport : public Transport {
     int WaitForDisconnect() override;
 
   private:
+    ssize_t WriteSync(const void* data, size_t len);
+    int ReapUrb(struct usbdevfs_urb** urb);
+
     std::unique_ptr<usb_handle> handle_;
+    std::vector<struct usbdevfs_urb> urbs_;
+    size_t urb_size_ = 0;
 
     DISALLOW_COPY_AND_ASSIGN(LinuxUsbTransport);
 };
@@ -384,7 +399,7 @@ static std::unique_ptr<usb_handle> find_usb_device(const char* base, ifc_match_f
     return usb;
 }
 
-ssize_t LinuxUsbTransport::Write(const void* _data, size_t len)
+ssize_t LinuxUsbTransport::WriteSync(const void* _data, size_t len)
 {
     unsigned char *data = (unsigned char*) _data;
     unsigned count = 0;
@@ -419,6 +434,124 @@ ssize_t LinuxUsbTransport::Write(const void* _data, size_t len)
     return count;
 }
 
+// Kernels from 3.6 on take URBs larger than MAX_USBFS_BULK_SIZE reliably.
+static size_t default_urb_size()
+{
+    struct utsname name;
+    int major, minor;
+    if (uname(&name) == 0 && sscanf(name.release, "%d.%d", &major, &minor) == 2 &&
+        (major > 3 || (major == 3 && minor >= 6))) {
+        return MAX_USBFS_URB_SIZE;
+    }
+    return MAX_USBFS_BULK_SIZE;
+}
+
+int LinuxUsbTransport::ReapUrb(struct usbdevfs_urb** urb)
+{
+    int n;
+    do {
+        n = ioctl(handle_->desc, USBDEVFS_REAPURB, urb);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        DBG("ERROR: reap urb, errno = %d (%s)\n", errno, strerror(errno));
+    }
+    return n;
+}
+
+ssize_t LinuxUsbTransport::Write(const void* _data, size_t len)
+{
+    const unsigned char* data = (const unsigned char*) _data;
+    size_t submitted = 0;
+    size_t count = 0;
+    bool failed = false;
+
+    if (handle_->ep_out == 0 || handle_->desc == -1) {
+        return -1;
+    }
+
+    // A zero length write is a single empty bulk transfer.
+    if (len == 0) {
+        return WriteSync(_data, len);
+    }
+
+    if (urbs_.empty()) {
+        urbs_.resize(MAX_URBS_IN_FLIGHT);
+        urb_size_ = default_urb_size();
+    }
+    std::vector<struct usbdevfs_urb*> free_urbs;
+    for (struct usbdevfs_urb& urb : urbs_) {
+        free_urbs.push_back(&urb);
+    }
+
+    while (count < len && !failed) {
+        // Keep as many URBs queued as we can.
+        while (submitted < len && !free_urbs.empty()) {
+            struct usbdevfs_urb* urb = free_urbs.back();
+            size_t xfer = std::min(len - submitted, urb_size_);
+
+            memset(urb, 0, sizeof(*urb));
+            urb->type = USBDEVFS_URB_TYPE_BULK;
+            urb->endpoint = handle_->ep_out;
+            urb->buffer = const_cast<unsigned char*>(data + submitted);
+            urb->buffer_length = xfer;
+
+            if (ioctl(handle_->desc, USBDEVFS_SUBMITURB, urb) < 0) {
+                if (errno == ENOMEM && free_urbs.size() < urbs_.size()) {
+                    // Out of usbfs memory for now, wait for one in flight to complete.
+                    break;
+                }
+                if (errno == ENOMEM && urb_size_ > MAX_USBFS_BULK_SIZE) {
+                    urb_size_ = MAX_USBFS_BULK_SIZE;
+                    continue;
+                }
+                DBG("ERROR: submit urb, errno = %d (%s)\n", errno, strerror(errno));
+                failed = true;
+                break;
+            }
+            free_urbs.pop_back();
+            submitted += xfer;
+        }
+        if (free_urbs.size() == urbs_.size()) {
+            break;
+        }
+
+        // URBs on an endpoint complete in order, so count only grows contiguously.
+        struct usbdevfs_urb* urb;
+        if (ReapUrb(&urb) < 0) {
+            failed = true;
+            break;
+        }
+        free_urbs.push_back(urb);
+        if (urb->status != 0 || urb->actual_length != urb->buffer_length) {
+            DBG("ERROR: urb status = %d, %d of %d bytes\n", urb->status, urb->actual_length,
+                urb->buffer_length);
+            failed = true;
+            break;
+        }
+        count += urb->actual_length;
+    }
+
+    if (failed) {
+        // The URBs still queued point into the caller's buffer, so cancel them and wait for
+        // the kernel to give them back before returning.
+        for (struct usbdevfs_urb& urb : urbs_) {
+            if (std::find(free_urbs.begin(), free_urbs.end(), &urb) == free_urbs.end()) {
+                ioctl(handle_->desc, USBDEVFS_DISCARDURB, &urb);
+            }
+        }
+        while (free_urbs.size() < urbs_.size()) {
+            struct usbdevfs_urb* urb;
+            if (ReapUrb(&urb) < 0) {
+                break;
+            }
+            free_urbs.push_back(urb);
+        }
+        return -1;
+    }
+
+    return count;
+}
+
 ssize_t LinuxUsbTransport::Read(void* _data, size_t len)
 {
     unsigned char *data = (unsigned char*) _data;
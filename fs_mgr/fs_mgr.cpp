@@ -36,6 +36,7 @@
 #include <thread>
 #include <vector>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
@@ -555,11 +556,14 @@ static int fs_match(const char *in1, const char *in2)
  * end_idx: On return, will be the last rec that was looked at.
  * attempted_idx: On return, will indicate which fstab rec
  *     succeeded. In case of failure, it will be the start_idx.
+ * prepared_fs_stat: if not null, the fs_stat of the recs that
+ *     prepare_fs_independently() already prepared, or -1.
  * Returns
  *   -1 on failure with errno set to match the 1st mount failure.
  *   0 on success.
  */
-static int mount_with_alternatives(struct fstab *fstab, int start_idx, int *end_idx, int *attempted_idx)
+static int mount_with_alternatives(struct fstab *fstab, int start_idx, int *end_idx, int *attempted_idx,
+                                   std::vector<int>* prepared_fs_stat)
 {
     int i;
     int mount_errno = 0;
@@ -591,7 +595,14 @@ static int mount_with_alternatives(struct fstab *fstab, int start_idx, int *end_
                 continue;
             }
 
-            int fs_stat = prepare_fs_for_mount(fstab->recs[i].blk_device, &fstab->recs[i]);
+            int fs_stat;
+            if (prepared_fs_stat && (*prepared_fs_stat)[i] >= 0) {
+                fs_stat = (*prepared_fs_stat)[i];
+                // Replaying the mount after a format must prepare it again.
+                (*prepared_fs_stat)[i] = -1;
+            } else {
+                fs_stat = prepare_fs_for_mount(fstab->recs[i].blk_device, &fstab->recs[i]);
+            }
             if (fs_stat & FS_STAT_EXT4_INVALID_MAGIC) {
                 LERROR << __FUNCTION__ << "(): skipping mount, invalid ext4, mountpoint="
                        << fstab->recs[i].mount_point << " rec[" << i
@@ -794,6 +805,191 @@ static bool call_vdc(const std::vector<std::string>& args) {
     return true;
 }
 
+static bool should_mount_all(const struct fstab_rec* rec, int mount_mode) {
+    /* Don't mount entries that are managed by vold or not for the mount mode*/
+    if ((rec->fs_mgr_flags & (MF_VOLDMANAGED | MF_RECOVERYONLY)) ||
+        ((mount_mode == MOUNT_MODE_LATE) && !fs_mgr_is_latemount(rec)) ||
+        ((mount_mode == MOUNT_MODE_EARLY) && fs_mgr_is_latemount(rec))) {
+        return false;
+    }
+
+    /* Skip swap and raw partition entries such as boot, recovery, etc */
+    if (!strcmp(rec->fs_type, "swap") || !strcmp(rec->fs_type, "emmc") ||
+        !strcmp(rec->fs_type, "mtd")) {
+        return false;
+    }
+    return true;
+}
+
+enum VeritySetUpResult {
+    VERITY_NOT_SET_UP = -1,
+    VERITY_MOUNT,
+    VERITY_SKIP,
+    VERITY_FATAL,
+};
+
+// Sets up dm-verity for |rec|, from AVB or from the verity metadata on the partition, if its
+// fstab entry asks for it, and returns whether to go on and mount it.
+static VeritySetUpResult set_up_verity(struct fstab* fstab, struct fstab_rec* rec,
+                                       FsManagerAvbUniquePtr* avb_handle,
+                                       bool wait_for_verity_dev) {
+    if (rec->fs_mgr_flags & MF_AVB) {
+        if (!*avb_handle) {
+            *avb_handle = FsManagerAvbHandle::Open(*fstab);
+            if (!*avb_handle) {
+                LERROR << "Failed to open FsManagerAvbHandle";
+                return VERITY_FATAL;
+            }
+        }
+        if ((*avb_handle)->SetUpAvbHashtree(rec, wait_for_verity_dev) ==
+            SetUpAvbHashtreeResult::kFail) {
+            LERROR << "Failed to set up AVB on partition: " << rec->mount_point << ", skipping!";
+            /* Skips mounting the device. */
+            return VERITY_SKIP;
+        }
+    } else if ((rec->fs_mgr_flags & MF_VERIFY)) {
+        int rc = fs_mgr_setup_verity(rec, wait_for_verity_dev);
+        if (__android_log_is_debuggable() &&
+                (rc == FS_MGR_SETUP_VERITY_DISABLED ||
+                 rc == FS_MGR_SETUP_VERITY_SKIPPED)) {
+            LINFO << "Verity disabled";
+        } else if (rc != FS_MGR_SETUP_VERITY_SUCCESS) {
+            LERROR << "Could not set up verified partition, skipping!";
+            return VERITY_SKIP;
+        }
+    }
+    return VERITY_MOUNT;
+}
+
+// Sets up dm-verity for all the records that mount_all is about to mount before mounting any,
+// and only then waits for their devices, so that ueventd creates them all at once rather than
+// one per mount. Records with alternatives for their mount point, named by label, or keeping
+// their verity state anywhere but on a block device that may not be mounted yet, are left to
+// the mount loop. On return, |results| holds the set_up_verity() result of each record, or
+// VERITY_NOT_SET_UP. Returns false if mount_all must fail.
+static bool set_up_verity_devices(struct fstab* fstab, int mount_mode,
+                                  FsManagerAvbUniquePtr* avb_handle, std::vector<int>* results) {
+    results->assign(fstab->num_entries, VERITY_NOT_SET_UP);
+
+    android::base::Timer t;
+    std::vector<int> recs;
+    for (int i = 0; i < fstab->num_entries; i++) {
+        struct fstab_rec* rec = &fstab->recs[i];
+        if (!should_mount_all(rec, mount_mode) || !strcmp(rec->mount_point, "/") ||
+            !(rec->fs_mgr_flags & (MF_AVB | MF_VERIFY)) ||
+            !strncmp(rec->blk_device, "LABEL=", 6)) {
+            continue;
+        }
+        if (!(rec->fs_mgr_flags & MF_AVB) && rec->verity_loc &&
+            !android::base::StartsWith(rec->verity_loc, "/dev/")) {
+            continue;
+        }
+        bool alternatives = false;
+        for (int j = 0; j < fstab->num_entries && !alternatives; j++) {
+            alternatives = j != i && fs_match(rec->mount_point, fstab->recs[j].mount_point);
+        }
+        if (alternatives) {
+            continue;
+        }
+        // Left for the mount loop to skip if it doesn't show up.
+        if ((rec->fs_mgr_flags & MF_WAIT) && !fs_mgr_wait_for_file(rec->blk_device, 20s)) {
+            continue;
+        }
+
+        (*results)[i] = set_up_verity(fstab, rec, avb_handle, false /* wait_for_verity_dev */);
+        if ((*results)[i] == VERITY_FATAL) {
+            return false;
+        }
+        recs.push_back(i);
+    }
+    if (recs.empty()) {
+        return true;
+    }
+
+    for (int i : recs) {
+        if ((*results)[i] == VERITY_MOUNT && !fs_mgr_wait_for_file(fstab->recs[i].blk_device, 1s)) {
+            LERROR << "Verity device " << fstab->recs[i].blk_device << " for "
+                   << fstab->recs[i].mount_point << " didn't show up, skipping!";
+            (*results)[i] = VERITY_SKIP;
+        }
+    }
+    LINFO << "Set up " << recs.size() << " verity devices in " << t;
+    return true;
+}
+
+// Whether the mount point of |rec| is below that of another fstab record, so that it is only
+// checked once that one is mounted, or shared with another, as alternatives for the same
+// partition are tried in turn, or whether its block device is used by another record.
+static bool depends_on_other_recs(const struct fstab* fstab, int idx) {
+    const struct fstab_rec* rec = &fstab->recs[idx];
+    for (int i = 0; i < fstab->num_entries; i++) {
+        const struct fstab_rec* other = &fstab->recs[i];
+        if (i == idx || (other->fs_mgr_flags & MF_VOLDMANAGED)) {
+            continue;
+        }
+        if (fs_match(rec->mount_point, other->mount_point) ||
+            !strcmp(rec->blk_device, other->blk_device)) {
+            return true;
+        }
+        std::string parent(other->mount_point);
+        if (parent.empty() || parent == "/") {
+            continue;
+        }
+        if (parent.back() != '/') {
+            parent += '/';
+        }
+        if (android::base::StartsWith(rec->mount_point, parent.c_str())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// With ro.fs_mgr.parallel_fsck set, runs prepare_fs_for_mount(), and so fsck, at once for the
+// records that mount_all would mount and that don't depend on any other, rather than one after
+// the other as they are mounted. Records set up with dm-verity or AVB, or named by label, are
+// left to be prepared in turn, as their block device is only known then. The mounts still
+// happen in fstab order. Returns the fs_stat of each record, or -1 if it wasn't prepared.
+static std::vector<int> prepare_fs_independently(struct fstab* fstab, int mount_mode) {
+    std::vector<int> fs_stat(fstab->num_entries, -1);
+    if (!android::base::GetBoolProperty("ro.fs_mgr.parallel_fsck", false)) {
+        return fs_stat;
+    }
+
+    std::vector<int> recs;
+    for (int i = 0; i < fstab->num_entries; i++) {
+        struct fstab_rec* rec = &fstab->recs[i];
+        if (!should_mount_all(rec, mount_mode) || !strcmp(rec->mount_point, "/") ||
+            (rec->fs_mgr_flags & (MF_AVB | MF_VERIFY)) ||
+            !strncmp(rec->blk_device, "LABEL=", 6) ||
+            (!is_extfs(rec->fs_type) && strcmp(rec->fs_type, "f2fs")) ||
+            depends_on_other_recs(fstab, i)) {
+            continue;
+        }
+        recs.push_back(i);
+    }
+    if (recs.size() < 2) {
+        return fs_stat;
+    }
+
+    LINFO << "Preparing " << recs.size() << " filesystems in parallel";
+    std::vector<std::thread> threads;
+    for (int i : recs) {
+        threads.emplace_back([fstab, i, &fs_stat] {
+            struct fstab_rec* rec = &fstab->recs[i];
+            // Left for mount_all to skip if it doesn't show up.
+            if ((rec->fs_mgr_flags & MF_WAIT) && !fs_mgr_wait_for_file(rec->blk_device, 20s)) {
+                return;
+            }
+            fs_stat[i] = prepare_fs_for_mount(rec->blk_device, rec);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return fs_stat;
+}
+
 /* When multiple fstab records share the same mount_point, it will
  * try to mount each one in turn, and ignore any duplicates after a
  * first successful mount.
@@ -813,18 +1009,14 @@ int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
         return FS_MGR_MNTALL_FAIL;
     }
 
-    for (i = 0; i < fstab->num_entries; i++) {
-        /* Don't mount entries that are managed by vold or not for the mount mode*/
-        if ((fstab->recs[i].fs_mgr_flags & (MF_VOLDMANAGED | MF_RECOVERYONLY)) ||
-             ((mount_mode == MOUNT_MODE_LATE) && !fs_mgr_is_latemount(&fstab->recs[i])) ||
-             ((mount_mode == MOUNT_MODE_EARLY) && fs_mgr_is_latemount(&fstab->recs[i]))) {
-            continue;
-        }
+    std::vector<int> verity_set_up;
+    if (!set_up_verity_devices(fstab, mount_mode, &avb_handle, &verity_set_up)) {
+        return FS_MGR_MNTALL_FAIL;
+    }
+    std::vector<int> prepared_fs_stat = prepare_fs_independently(fstab, mount_mode);
 
-        /* Skip swap and raw partition entries such as boot, recovery, etc */
-        if (!strcmp(fstab->recs[i].fs_type, "swap") ||
-            !strcmp(fstab->recs[i].fs_type, "emmc") ||
-            !strcmp(fstab->recs[i].fs_type, "mtd")) {
+    for (i = 0; i < fstab->num_entries; i++) {
+        if (!should_mount_all(&fstab->recs[i], mount_mode)) {
             continue;
         }
 
@@ -851,37 +1043,23 @@ int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
             continue;
         }
 
-        if (fstab->recs[i].fs_mgr_flags & MF_AVB) {
-            if (!avb_handle) {
-                avb_handle = FsManagerAvbHandle::Open(*fstab);
-                if (!avb_handle) {
-                    LERROR << "Failed to open FsManagerAvbHandle";
-                    return FS_MGR_MNTALL_FAIL;
-                }
-            }
-            if (avb_handle->SetUpAvbHashtree(&fstab->recs[i], true /* wait_for_verity_dev */) ==
-                SetUpAvbHashtreeResult::kFail) {
-                LERROR << "Failed to set up AVB on partition: "
-                       << fstab->recs[i].mount_point << ", skipping!";
-                /* Skips mounting the device. */
-                continue;
-            }
-        } else if ((fstab->recs[i].fs_mgr_flags & MF_VERIFY)) {
-            int rc = fs_mgr_setup_verity(&fstab->recs[i], true);
-            if (__android_log_is_debuggable() &&
-                    (rc == FS_MGR_SETUP_VERITY_DISABLED ||
-                     rc == FS_MGR_SETUP_VERITY_SKIPPED)) {
-                LINFO << "Verity disabled";
-            } else if (rc != FS_MGR_SETUP_VERITY_SUCCESS) {
-                LERROR << "Could not set up verified partition, skipping!";
-                continue;
-            }
+        int verity = verity_set_up[i];
+        if (verity == VERITY_NOT_SET_UP) {
+            verity = set_up_verity(fstab, &fstab->recs[i], &avb_handle, true);
+        }
+        /* A replayed mount, after a format, sets it up again. */
+        verity_set_up[i] = VERITY_NOT_SET_UP;
+        if (verity == VERITY_FATAL) {
+            return FS_MGR_MNTALL_FAIL;
+        } else if (verity == VERITY_SKIP) {
+            continue;
         }
 
         int last_idx_inspected;
         int top_idx = i;
 
-        mret = mount_with_alternatives(fstab, i, &last_idx_inspected, &attempted_idx);
+        mret = mount_with_alternatives(fstab, i, &last_idx_inspected, &attempted_idx,
+                                       &prepared_fs_stat);
         i = last_idx_inspected;
         mount_errno = errno;
 
@@ -26,6 +26,7 @@
 #include <string>
 #include <vector>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/properties.h>
@@ -485,8 +486,10 @@ FsManagerAvbUniquePtr FsManagerAvbHandle::DoOpen(FsManagerAvbOps* avb_ops) {
 
     AvbSlotVerifyFlags flags = is_device_unlocked ? AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR
                                                   : AVB_SLOT_VERIFY_FLAGS_NONE;
+    android::base::Timer t;
     AvbSlotVerifyResult verify_result =
         avb_ops->AvbSlotVerify(fs_mgr_get_slot_suffix(), flags, &avb_handle->avb_slot_data_);
+    LINFO << "avb_slot_verify took " << t;
 
     // Only allow two verify results:
     //   - AVB_SLOT_VERIFY_RESULT_OK.
@@ -579,6 +582,7 @@ SetUpAvbHashtreeResult FsManagerAvbHandle::SetUpAvbHashtree(struct fstab_rec* fs
         }
     }
 
+    android::base::Timer t;
     AvbHashtreeDescriptor hashtree_descriptor;
     std::string salt;
     std::string root_digest;
@@ -593,5 +597,6 @@ SetUpAvbHashtreeResult FsManagerAvbHandle::SetUpAvbHashtree(struct fstab_rec* fs
         return SetUpAvbHashtreeResult::kFail;
     }
 
+    LINFO << "Set up AVB HASHTREE for " << fstab_entry->mount_point << " in " << t;
     return SetUpAvbHashtreeResult::kSuccess;
 }
@@ -21,9 +21,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mount.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -724,10 +728,32 @@ static std::set<std::string> extract_boot_devices(const fstab& fstab) {
     return boot_devices;
 }
 
+/*
+ * The fstab files and the device tree hardly ever change, but the same process
+ * reads them for every mount_all, verity state update or lookup. The last fstab
+ * parsed from each file, and the one from the device tree, are kept, and callers
+ * get copies of them, as they may modify theirs.
+ */
+using FstabPtr = std::unique_ptr<struct fstab, decltype(&fs_mgr_free_fstab)>;
+
+struct cached_fstab {
+    struct stat st;
+    FstabPtr fstab;
+};
+
+static std::mutex fstab_cache_lock;
+static std::map<std::string, cached_fstab> fstab_file_cache;
+
+static bool same_file(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
 struct fstab *fs_mgr_read_fstab(const char *fstab_path)
 {
     FILE *fstab_file;
     struct fstab *fstab;
+    struct stat st;
 
     fstab_file = fopen(fstab_path, "r");
     if (!fstab_file) {
@@ -735,6 +761,16 @@ struct fstab *fs_mgr_read_fstab(const char *fstab_path)
         return nullptr;
     }
 
+    bool cacheable = fstat(fileno(fstab_file), &st) == 0;
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(fstab_cache_lock);
+        auto cached = fstab_file_cache.find(fstab_path);
+        if (cached != fstab_file_cache.end() && same_file(cached->second.st, st)) {
+            fclose(fstab_file);
+            return fs_mgr_dup_fstab(cached->second.fstab.get());
+        }
+    }
+
     fstab = fs_mgr_read_fstab_file(fstab_file);
     if (fstab) {
         fstab->fstab_filename = strdup(fstab_path);
@@ -743,6 +779,15 @@ struct fstab *fs_mgr_read_fstab(const char *fstab_path)
     }
 
     fclose(fstab_file);
+
+    if (fstab && cacheable) {
+        FstabPtr copy(fs_mgr_dup_fstab(fstab), fs_mgr_free_fstab);
+        if (copy) {
+            std::lock_guard<std::mutex> lock(fstab_cache_lock);
+            fstab_file_cache.erase(fstab_path);
+            fstab_file_cache.emplace(fstab_path, cached_fstab{st, std::move(copy)});
+        }
+    }
     return fstab;
 }
 
@@ -751,12 +796,21 @@ struct fstab *fs_mgr_read_fstab(const char *fstab_path)
  */
 struct fstab *fs_mgr_read_fstab_dt()
 {
-    std::string fstab_buf = read_fstab_from_dt();
+    // The device tree is read once per process.
+    static const std::string fstab_buf = read_fstab_from_dt();
     if (fstab_buf.empty()) {
         LINFO << __FUNCTION__ << "(): failed to read fstab from dt";
         return nullptr;
     }
 
+    static FstabPtr dt_fstab(nullptr, fs_mgr_free_fstab);
+    {
+        std::lock_guard<std::mutex> lock(fstab_cache_lock);
+        if (dt_fstab) {
+            return fs_mgr_dup_fstab(dt_fstab.get());
+        }
+    }
+
     std::unique_ptr<FILE, decltype(&fclose)> fstab_file(
         fmemopen(static_cast<void*>(const_cast<char*>(fstab_buf.c_str())),
                  fstab_buf.length(), "r"), fclose);
@@ -769,6 +823,11 @@ struct fstab *fs_mgr_read_fstab_dt()
     if (!fstab) {
         LERROR << __FUNCTION__ << "(): failed to load fstab from kernel:"
                << std::endl << fstab_buf;
+    } else {
+        std::lock_guard<std::mutex> lock(fstab_cache_lock);
+        if (!dt_fstab) {
+            dt_fstab.reset(fs_mgr_dup_fstab(fstab));
+        }
     }
 
     return fstab;
@@ -841,6 +900,7 @@ void fs_mgr_free_fstab(struct fstab *fstab)
         free(fstab->recs[i].fs_options);
         free(fstab->recs[i].key_loc);
         free(fstab->recs[i].key_dir);
+        free(fstab->recs[i].verity_loc);
         free(fstab->recs[i].label);
         free(fstab->recs[i].sysfs_path);
     }
@@ -855,6 +915,57 @@ void fs_mgr_free_fstab(struct fstab *fstab)
     free(fstab);
 }
 
+static bool dup_string(char** to, const char* from) {
+    if (from) {
+        *to = strdup(from);
+        return *to != nullptr;
+    }
+    return true;
+}
+
+/* Returns a copy of the fstab, to be freed with fs_mgr_free_fstab(), or NULL if out of memory */
+struct fstab *fs_mgr_dup_fstab(const struct fstab *fstab)
+{
+    if (!fstab) {
+        return nullptr;
+    }
+
+    struct fstab* copy = static_cast<struct fstab*>(calloc(1, sizeof(struct fstab)));
+    if (!copy) {
+        return nullptr;
+    }
+    copy->recs = static_cast<struct fstab_rec*>(calloc(fstab->num_entries,
+                                                       sizeof(struct fstab_rec)));
+    if (!dup_string(&copy->fstab_filename, fstab->fstab_filename) ||
+        (!copy->recs && fstab->num_entries)) {
+        fs_mgr_free_fstab(copy);
+        return nullptr;
+    }
+
+    for (int i = 0; i < fstab->num_entries; i++) {
+        const struct fstab_rec* from = &fstab->recs[i];
+        struct fstab_rec* to = &copy->recs[i];
+        // Copies the numbers, then each string.
+        *to = *from;
+        to->blk_device = to->mount_point = to->fs_type = to->fs_options = nullptr;
+        to->key_loc = to->key_dir = to->verity_loc = to->label = to->sysfs_path = nullptr;
+        copy->num_entries++;
+        if (!dup_string(&to->blk_device, from->blk_device) ||
+            !dup_string(&to->mount_point, from->mount_point) ||
+            !dup_string(&to->fs_type, from->fs_type) ||
+            !dup_string(&to->fs_options, from->fs_options) ||
+            !dup_string(&to->key_loc, from->key_loc) ||
+            !dup_string(&to->key_dir, from->key_dir) ||
+            !dup_string(&to->verity_loc, from->verity_loc) ||
+            !dup_string(&to->label, from->label) ||
+            !dup_string(&to->sysfs_path, from->sysfs_path)) {
+            fs_mgr_free_fstab(copy);
+            return nullptr;
+        }
+    }
+    return copy;
+}
+
 /* Add an entry to the fstab, and return 0 on success or -1 on error */
 int fs_mgr_add_entry(struct fstab *fstab,
                      const char *mount_point, const char *fs_type,
@@ -900,6 +1011,31 @@ struct fstab_rec* fs_mgr_get_entry_for_mount_point(struct fstab* fstab, const st
     return nullptr;
 }
 
+FstabIndex::FstabIndex(struct fstab* fstab) : fstab_(fstab) {
+    if (!fstab) {
+        return;
+    }
+    // The first entry for each wins, as with fs_mgr_get_entry_for_mount_point().
+    for (int i = 0; i < fstab->num_entries; i++) {
+        if (fstab->recs[i].mount_point) {
+            mount_points_.emplace(fstab->recs[i].mount_point, i);
+        }
+        if (fstab->recs[i].blk_device) {
+            blk_devices_.emplace(fstab->recs[i].blk_device, i);
+        }
+    }
+}
+
+struct fstab_rec* FstabIndex::FindByMountPoint(const std::string& path) const {
+    auto it = mount_points_.find(path);
+    return it != mount_points_.end() ? &fstab_->recs[it->second] : nullptr;
+}
+
+struct fstab_rec* FstabIndex::FindByBlkDevice(const std::string& path) const {
+    auto it = blk_devices_.find(path);
+    return it != blk_devices_.end() ? &fstab_->recs[it->second] : nullptr;
+}
+
 std::set<std::string> fs_mgr_get_boot_devices() {
     // boot_devices can be specified in device tree.
     std::string dt_value;
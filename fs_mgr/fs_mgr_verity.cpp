@@ -29,6 +29,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
@@ -346,7 +347,7 @@ out:
     return rc;
 }
 
-static int was_verity_restart()
+static int check_verity_restarts()
 {
     static const char* files[] = {
         // clang-format off
@@ -367,6 +368,14 @@ static int was_verity_restart()
     return 0;
 }
 
+// The logs of the previous boot don't change until the next one, so they
+// are only searched once, rather than for each verity partition.
+static int was_verity_restart()
+{
+    static const int restarted = check_verity_restarts();
+    return restarted;
+}
+
 static int metadata_add(FILE *fp, long start, const char *tag,
         unsigned int length, off64_t *offset)
 {
@@ -571,32 +580,39 @@ static int read_partition(const char *path, uint64_t size)
     return 0;
 }
 
-static int compare_last_signature(struct fstab_rec *fstab, int *match)
+// Compares the signature of the verity metadata of the partition with the one
+// recorded when it was last set up. |verity| is the metadata if the caller has
+// already read it, or NULL to read it from the partition.
+static int compare_last_signature(struct fstab_rec *fstab,
+        const struct fec_verity_metadata *verity, int *match)
 {
     char tag[METADATA_TAG_MAX_LENGTH + 1];
     int fd = -1;
     int rc = -1;
     off64_t offset = 0;
     struct fec_handle *f = NULL;
-    struct fec_verity_metadata verity;
+    struct fec_verity_metadata read_verity;
     uint8_t curr[SHA256_DIGEST_LENGTH];
     uint8_t prev[SHA256_DIGEST_LENGTH];
 
     *match = 1;
 
-    if (fec_open(&f, fstab->blk_device, O_RDONLY, FEC_VERITY_DISABLE,
-            FEC_DEFAULT_ROOTS) == -1) {
-        PERROR << "Failed to open '" << fstab->blk_device << "'";
-        return rc;
-    }
+    if (!verity) {
+        if (fec_open(&f, fstab->blk_device, O_RDONLY, FEC_VERITY_DISABLE,
+                FEC_DEFAULT_ROOTS) == -1) {
+            PERROR << "Failed to open '" << fstab->blk_device << "'";
+            return rc;
+        }
 
-    // read verity metadata
-    if (fec_verity_get_metadata(f, &verity) == -1) {
-        PERROR << "Failed to get verity metadata '" << fstab->blk_device << "'";
-        goto out;
+        // read verity metadata
+        if (fec_verity_get_metadata(f, &read_verity) == -1) {
+            PERROR << "Failed to get verity metadata '" << fstab->blk_device << "'";
+            goto out;
+        }
+        verity = &read_verity;
     }
 
-    SHA256(verity.signature, sizeof(verity.signature), curr);
+    SHA256(verity->signature, sizeof(verity->signature), curr);
 
     if (snprintf(tag, sizeof(tag), VERITY_LASTSIG_TAG "_%s",
             basename(fstab->mount_point)) >= (int)sizeof(tag)) {
@@ -638,7 +654,12 @@ static int compare_last_signature(struct fstab_rec *fstab, int *match)
     rc = 0;
 
 out:
-    fec_close(f);
+    if (fd != -1) {
+        close(fd);
+    }
+    if (f) {
+        fec_close(f);
+    }
     return rc;
 }
 
@@ -656,7 +677,8 @@ static int get_verity_state_offset(struct fstab_rec *fstab, off64_t *offset)
                 offset);
 }
 
-int load_verity_state(struct fstab_rec* fstab, int* mode) {
+static int load_verity_state(struct fstab_rec* fstab, const struct fec_verity_metadata* verity,
+                             int* mode) {
     int match = 0;
     off64_t offset = 0;
 
@@ -683,7 +705,7 @@ int load_verity_state(struct fstab_rec* fstab, int* mode) {
         return write_verity_state(fstab->verity_loc, offset, *mode);
     }
 
-    if (!compare_last_signature(fstab, &match) && !match) {
+    if (!compare_last_signature(fstab, verity, &match) && !match) {
         /* partition has been reflashed, reset dm-verity state */
         *mode = VERITY_MODE_DEFAULT;
         return write_verity_state(fstab->verity_loc, offset, *mode);
@@ -692,6 +714,10 @@ int load_verity_state(struct fstab_rec* fstab, int* mode) {
     return read_verity_state(fstab->verity_loc, offset, mode);
 }
 
+int load_verity_state(struct fstab_rec* fstab, int* mode) {
+    return load_verity_state(fstab, nullptr, mode);
+}
+
 // Update the verity table using the actual block device path.
 // Two cases:
 // Case-1: verity table is shared for devices with different by-name prefix.
@@ -764,6 +790,7 @@ int fs_mgr_setup_verity(struct fstab_rec *fstab, bool wait_for_verity_dev)
     struct dm_ioctl *io = (struct dm_ioctl *) buffer;
     const std::string mount_point(basename(fstab->mount_point));
     bool verified_at_boot = false;
+    android::base::Timer t;
 
     if (fec_open(&f, fstab->blk_device, O_RDONLY, FEC_VERITY_DISABLE,
             FEC_DEFAULT_ROOTS) < 0) {
@@ -815,7 +842,7 @@ int fs_mgr_setup_verity(struct fstab_rec *fstab, bool wait_for_verity_dev)
         goto out;
     }
 
-    if (load_verity_state(fstab, &params.mode) < 0) {
+    if (load_verity_state(fstab, &verity, &params.mode) < 0) {
         /* if accessing or updating the state failed, switch to the default
          * safe mode. This makes sure the device won't end up in an endless
          * restart loop, and no corrupted data will be exposed to userspace
@@ -933,6 +960,7 @@ loaded:
     }
 
     retval = FS_MGR_SETUP_VERITY_SUCCESS;
+    LINFO << "Set up dm-verity for " << mount_point.c_str() << " in " << t;
 
 out:
     if (fd != -1) {
@@ -24,6 +24,7 @@
 
 #include <set>
 #include <string>
+#include <unordered_map>
 
 /*
  * The entries must be kept in the same order as they were seen in the fstab.
@@ -63,6 +64,7 @@ struct fstab_rec {
 struct fstab* fs_mgr_read_fstab_default();
 struct fstab* fs_mgr_read_fstab_dt();
 struct fstab* fs_mgr_read_fstab(const char* fstab_path);
+struct fstab* fs_mgr_dup_fstab(const struct fstab* fstab);
 void fs_mgr_free_fstab(struct fstab* fstab);
 
 int fs_mgr_add_entry(struct fstab* fstab, const char* mount_point, const char* fs_type,
@@ -92,4 +94,23 @@ int fs_mgr_is_wrapped_key_supported(const struct fstab_rec *fstab);
 std::string fs_mgr_get_slot_suffix();
 std::set<std::string> fs_mgr_get_boot_devices();
 
+/*
+ * Finds the first entry of an fstab for a mount point or block device without
+ * going through all of them, for callers that look up many. The fstab must
+ * outlive the index and keep its entries. Entries are indexed by the block
+ * device they had when the index was built, before any verity setup.
+ */
+class FstabIndex {
+  public:
+    explicit FstabIndex(struct fstab* fstab);
+
+    struct fstab_rec* FindByMountPoint(const std::string& path) const;
+    struct fstab_rec* FindByBlkDevice(const std::string& path) const;
+
+  private:
+    struct fstab* fstab_;
+    std::unordered_map<std::string, int> mount_points_;
+    std::unordered_map<std::string, int> blk_devices_;
+};
+
 #endif /* __CORE_FS_TAB_H */
@@ -22,8 +22,10 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <memory>
+#include <unordered_map>
 
 #include <android/security/IKeystoreService.h>
 #include <binder/IPCThreadState.h>
@@ -37,6 +39,7 @@
 #include <log/log.h>
 #include <utils/Log.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 
 #include "SoftGateKeeperDevice.h"
 
@@ -54,6 +57,34 @@ namespace android {
 static const String16 KEYGUARD_PERMISSION("android.permission.ACCESS_KEYGUARD_SECURE_STORAGE");
 static const String16 DUMP_PERMISSION("android.permission.DUMP");
 
+// Latency of one phase of the requests, reported by dump.
+struct PhaseStats {
+    const char *name;
+    uint64_t count;
+    nsecs_t total;
+    nsecs_t max;
+
+    void add(nsecs_t start) {
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        count++;
+        total += elapsed;
+        if (elapsed > max) max = elapsed;
+    }
+
+    void dump(int fd) const {
+        dprintf(fd, "%s: count=%" PRIu64 " avg=%" PRId64 "us max=%" PRId64 "us\n", name, count,
+                count ? nanoseconds_to_microseconds(total) / static_cast<int64_t>(count) : 0,
+                nanoseconds_to_microseconds(max));
+    }
+};
+
+// The secure user id of a uid, as stored in its sid file.
+struct SidEntry {
+    // Whether the sid file exists.
+    bool stored;
+    uint64_t sid;
+};
+
 class GateKeeperProxy : public BnGateKeeperService {
 public:
     GateKeeperProxy() {
@@ -70,14 +101,25 @@ public:
     }
 
     void store_sid(uint32_t uid, uint64_t sid) {
+        // Re-enrolling keeps the sid, so there is usually nothing to write.
+        auto it = sids.find(uid);
+        if (it != sids.end() && it->second.stored && it->second.sid == sid) {
+            return;
+        }
+
         char filename[21];
         snprintf(filename, sizeof(filename), "%u", uid);
         int fd = open(filename, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
         if (fd < 0) {
             ALOGE("could not open file: %s: %s", filename, strerror(errno));
+            sids.erase(uid);
             return;
         }
-        write(fd, &sid, sizeof(sid));
+        if (write(fd, &sid, sizeof(sid)) == static_cast<ssize_t>(sizeof(sid))) {
+            sids[uid] = {true, sid};
+        } else {
+            sids.erase(uid);
+        }
         close(fd);
     }
 
@@ -111,22 +153,13 @@ public:
     }
 
     void maybe_store_sid(uint32_t uid, uint64_t sid) {
-        char filename[21];
-        snprintf(filename, sizeof(filename), "%u", uid);
-        if (access(filename, F_OK) == -1) {
+        if (!lookup_sid(uid).stored) {
             store_sid(uid, sid);
         }
     }
 
     uint64_t read_sid(uint32_t uid) {
-        char filename[21];
-        uint64_t sid;
-        snprintf(filename, sizeof(filename), "%u", uid);
-        int fd = open(filename, O_RDONLY);
-        if (fd < 0) return 0;
-        read(fd, &sid, sizeof(sid));
-        close(fd);
-        return sid;
+        return lookup_sid(uid).sid;
     }
 
     void clear_sid(uint32_t uid) {
@@ -135,9 +168,48 @@ public:
         if (remove(filename) < 0) {
             ALOGE("%s: could not remove file [%s], attempting 0 write", __func__, strerror(errno));
             store_sid(uid, 0);
+        } else {
+            sids[uid] = {false, 0};
         }
     }
 
+    // Returns the sid file of uid, read once and then kept up to date by store_sid and
+    // clear_sid, as gatekeeperd is the only one writing these files.
+    const SidEntry& lookup_sid(uint32_t uid) {
+        auto it = sids.find(uid);
+        if (it != sids.end()) {
+            return it->second;
+        }
+
+        char filename[21];
+        SidEntry entry = {false, 0};
+        snprintf(filename, sizeof(filename), "%u", uid);
+        int fd = open(filename, O_RDONLY);
+        if (fd >= 0) {
+            entry.stored = true;
+            ssize_t len = read(fd, &entry.sid, sizeof(entry.sid));
+            if (len != static_cast<ssize_t>(sizeof(entry.sid))) {
+                entry.sid = 0;
+            }
+            close(fd);
+        } else if (errno != ENOENT) {
+            // Don't remember an error that may be transient.
+            static const SidEntry unknown = {false, 0};
+            return unknown;
+        }
+        return sids[uid] = entry;
+    }
+
+    sp<security::IKeystoreService> get_keystore() {
+        if (keystore_service == nullptr ||
+                !IInterface::asBinder(keystore_service)->isBinderAlive()) {
+            sp<IServiceManager> sm = defaultServiceManager();
+            sp<IBinder> binder = sm->getService(String16("android.security.keystore"));
+            keystore_service = interface_cast<security::IKeystoreService>(binder);
+        }
+        return keystore_service;
+    }
+
     virtual int enroll(uint32_t uid,
             const uint8_t *current_password_handle, uint32_t current_password_handle_length,
             const uint8_t *current_password, uint32_t current_password_length,
@@ -181,6 +253,7 @@ public:
             newPwd.setToExternal(const_cast<uint8_t*>(desired_password),
                                  desired_password_length);
 
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
             Return<void> hwRes = hw_device->enroll(uid, curPwdHandle, curPwd, newPwd,
                               [&ret, enrolled_password_handle, enrolled_password_handle_length]
                                    (const GatekeeperResponse &rsp) {
@@ -198,16 +271,19 @@ public:
                     ret = rsp.timeout;
                 }
             });
+            enroll_stats.add(start);
             if (!hwRes.isOk()) {
                 ALOGE("enroll transaction failed\n");
                 ret = -1;
             }
         } else {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
             ret = soft_device->enroll(uid,
                     current_password_handle, current_password_handle_length,
                     current_password, current_password_length,
                     desired_password, desired_password_length,
                     enrolled_password_handle, enrolled_password_handle_length);
+            enroll_stats.add(start);
         }
 
         if (ret == GATEKEEPER_RESPONSE_OK && (*enrolled_password_handle == nullptr ||
@@ -270,6 +346,7 @@ public:
                 android::hardware::hidl_vec<uint8_t> enteredPwd;
                 enteredPwd.setToExternal(const_cast<uint8_t*>(provided_password),
                                          provided_password_length);
+                nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
                 Return<void> hwRes = hw_device->verify(uid, challenge, curPwdHandle, enteredPwd,
                                         [&ret, request_reenroll, auth_token, auth_token_length]
                                              (const GatekeeperResponse &rsp) {
@@ -288,6 +365,7 @@ public:
                         ret = rsp.timeout;
                     }
                 });
+                verify_stats.add(start);
                 if (!hwRes.isOk()) {
                     ALOGE("verify transaction failed\n");
                     ret = -1;
@@ -306,18 +384,17 @@ public:
                 }
             }
         } else {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
             ret = soft_device->verify(uid, challenge,
                 enrolled_password_handle, enrolled_password_handle_length,
                 provided_password, provided_password_length, auth_token, auth_token_length,
                 request_reenroll);
+            verify_stats.add(start);
         }
 
         if (ret == 0 && *auth_token != NULL && *auth_token_length > 0) {
-            // TODO: cache service?
-            sp<IServiceManager> sm = defaultServiceManager();
-            sp<IBinder> binder = sm->getService(String16("android.security.keystore"));
-            sp<security::IKeystoreService> service =
-                interface_cast<security::IKeystoreService>(binder);
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            sp<security::IKeystoreService> service = get_keystore();
             if (service != NULL) {
                 std::vector<uint8_t> auth_token_vector(*auth_token,
                                                        (*auth_token) + *auth_token_length);
@@ -326,6 +403,7 @@ public:
                 if (!binder_result.isOk() || !keystore::KeyStoreServiceReturnCode(result).isOk()) {
                     ALOGE("Failure sending auth token to KeyStore: %" PRId32, result);
                 }
+                keystore_stats.add(start);
             } else {
                 ALOGE("Unable to communicate with KeyStore");
             }
@@ -383,6 +461,10 @@ public:
             const char *result = "OK";
             write(fd, result, strlen(result) + 1);
         }
+        dprintf(fd, "\n");
+        enroll_stats.dump(fd);
+        verify_stats.dump(fd);
+        keystore_stats.dump(fd);
 
         return NO_ERROR;
     }
@@ -390,6 +472,12 @@ public:
 private:
     sp<IGatekeeper> hw_device;
     std::unique_ptr<SoftGateKeeperDevice> soft_device;
+    sp<security::IKeystoreService> keystore_service;
+    std::unordered_map<uint32_t, SidEntry> sids;
+
+    PhaseStats enroll_stats = {"enroll", 0, 0, 0};
+    PhaseStats verify_stats = {"verify", 0, 0, 0};
+    PhaseStats keystore_stats = {"keystore addAuthToken", 0, 0, 0};
 
     bool clear_state_if_needed_done;
 };
@@ -31,6 +31,7 @@
 #include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <batteryservice/BatteryService.h>
 #include <cutils/klog.h>
 #include <cutils/properties.h>
@@ -140,9 +141,36 @@ int BatteryMonitor::getBatteryHealth(const char* status) {
     return ret;
 }
 
+// The attributes are read on every update, so they are kept open and reread
+// from the start, which makes sysfs generate them again.
 int BatteryMonitor::readFromFile(const String8& path, std::string* buf) {
-    if (android::base::ReadFileToString(path.c_str(), buf)) {
-        *buf = android::base::Trim(*buf);
+    buf->clear();
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        auto it = mSysfsFds.find(path.string());
+        if (it == mSysfsFds.end()) {
+            android::base::unique_fd fd(open(path.string(), O_RDONLY | O_CLOEXEC));
+            if (fd == -1) {
+                return 0;
+            }
+            it = mSysfsFds.emplace(path.string(), std::move(fd)).first;
+        }
+
+        char chunk[512];
+        off_t offset = 0;
+        ssize_t len;
+        while ((len = TEMP_FAILURE_RETRY(pread(it->second, chunk, sizeof(chunk), offset))) > 0) {
+            buf->append(chunk, len);
+            offset += len;
+        }
+        if (len == 0) {
+            *buf = android::base::Trim(*buf);
+            break;
+        }
+
+        // The power supply may have gone and come back, so open it again.
+        buf->clear();
+        mSysfsFds.erase(it);
     }
     return buf->length();
 }
@@ -301,12 +329,18 @@ bool BatteryMonitor::update(void) {
                              mChargerNames[i].string());
             }
 
-            int ChargingCurrent =
-                  (access(SYSFS_BATTERY_CURRENT, R_OK) == 0) ? abs(getIntField(String8(SYSFS_BATTERY_CURRENT))) : 0;
+            std::string value;
+            int ChargingCurrent = 0;
+            if (readFromFile(String8(SYSFS_BATTERY_CURRENT), &value) > 0) {
+                android::base::ParseInt(value, &ChargingCurrent);
+                ChargingCurrent = abs(ChargingCurrent);
+            }
 
-            int ChargingVoltage =
-                  (access(SYSFS_BATTERY_VOLTAGE, R_OK) == 0) ? getIntField(String8(SYSFS_BATTERY_VOLTAGE)) :
-                   DEFAULT_VBUS_VOLTAGE;
+            int ChargingVoltage = DEFAULT_VBUS_VOLTAGE;
+            if (readFromFile(String8(SYSFS_BATTERY_VOLTAGE), &value) > 0) {
+                ChargingVoltage = 0;
+                android::base::ParseInt(value, &ChargingVoltage);
+            }
 
             double power = ((double)ChargingCurrent / MILLION) *
                            ((double)ChargingVoltage / MILLION);
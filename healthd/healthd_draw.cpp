@@ -48,6 +48,14 @@ HealthdDraw::HealthdDraw(animation* anim)
 HealthdDraw::~HealthdDraw() {}
 
 void HealthdDraw::redraw_screen(const animation* batt_anim, GRSurface* surf_unknown) {
+  // Once the battery is full, or the charger unplugged, most transitions show
+  // the frame that's already on screen, so leave the screen as it is then.
+  std::string contents = screen_contents(batt_anim, surf_unknown);
+  if (contents == drawn_contents_) {
+    LOGV("screen unchanged\n");
+    return;
+  }
+
   clear_screen();
 
   /* try to display *something* */
@@ -56,9 +64,30 @@ void HealthdDraw::redraw_screen(const animation* batt_anim, GRSurface* surf_unkn
   else
     draw_battery(batt_anim);
   gr_flip();
+  drawn_contents_ = std::move(contents);
+}
+
+void HealthdDraw::blank_screen(bool blank) {
+  if (blank) drawn_contents_.clear();
+  gr_fb_blank(blank);
 }
 
-void HealthdDraw::blank_screen(bool blank) { gr_fb_blank(blank); }
+std::string HealthdDraw::screen_contents(const animation* batt_anim,
+                                         GRSurface* surf_unknown) {
+  if (batt_anim->cur_level < 0 || batt_anim->num_frames == 0) {
+    return base::StringPrintf("unknown %p", surf_unknown);
+  }
+
+  // The clock is only drawn to the minute.
+  char clock_str[8] = "";
+  if (batt_anim->text_clock.font != nullptr) {
+    time_t rawtime;
+    time(&rawtime);
+    strftime(clock_str, sizeof(clock_str), "%H:%M", localtime(&rawtime));
+  }
+  return base::StringPrintf("%p %d %d %s", batt_anim->frames[batt_anim->cur_frame].surface,
+                            batt_anim->cur_level, batt_anim->cur_status, clock_str);
+}
 
 void HealthdDraw::clear_screen(void) {
   gr_color(0, 0, 0, 255);
@@ -20,6 +20,8 @@
 #include <linux/input.h>
 #include <minui/minui.h>
 
+#include <string>
+
 #include "animation.h"
 
 using namespace android;
@@ -30,7 +32,7 @@ class HealthdDraw {
   HealthdDraw(animation* anim);
   virtual ~HealthdDraw();
 
-  // Redraws screen.
+  // Redraws screen, unless it already shows what would be drawn.
   void redraw_screen(const animation* batt_anim, GRSurface* surf_unknown);
 
   // Blanks screen if true, unblanks if false.
@@ -58,6 +60,12 @@ class HealthdDraw {
   // Draws charger->surf_unknown or basic text.
   virtual void draw_unknown(GRSurface* surf_unknown);
 
+  // Describes what redraw_screen() would draw, to compare with what's drawn.
+  virtual std::string screen_contents(const animation* batt_anim, GRSurface* surf_unknown);
+
+  // screen_contents() of the screen as last drawn, or empty if it was blanked.
+  std::string drawn_contents_;
+
   // Pixel sizes of characters for default font.
   int char_width_;
   int char_height_;
@@ -17,6 +17,10 @@
 #ifndef HEALTHD_BATTERYMONITOR_H
 #define HEALTHD_BATTERYMONITOR_H
 
+#include <map>
+#include <string>
+
+#include <android-base/unique_fd.h>
 #include <batteryservice/BatteryService.h>
 #include <utils/String8.h>
 #include <utils/Vector.h>
@@ -51,6 +55,8 @@ class BatteryMonitor {
     int mBatteryFixedCapacity;
     int mBatteryFixedTemperature;
     struct BatteryProperties props;
+    // Open sysfs attributes, by path.
+    std::map<std::string, android::base::unique_fd> mSysfsFds;
 
     int getBatteryStatus(const char* status);
     int getBatteryHealth(const char* status);
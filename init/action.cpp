@@ -20,6 +20,7 @@
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include "boot_trace.h"
 #include "util.h"
 
 #if defined(__ANDROID__)
@@ -112,6 +113,32 @@ void Action::ExecuteOneCommand(std::size_t command) const {
     ExecuteCommand(cmd);
 }
 
+std::size_t Action::ExecuteCommands(std::size_t command) const {
+    // Boot tracing wants each command on its own, so nothing is batched while tracing.
+    if (!subcontext_ || !commands_[command].execute_in_subcontext() || IsBootTracing()) {
+        ExecuteOneCommand(command);
+        return 1;
+    }
+
+    // Commands executed in the subcontext can't import .rc files, so commands_ doesn't change
+    // while they run and they need no copy.
+    auto batch = std::vector<const std::vector<std::string>*>{};
+    for (auto i = command; i < commands_.size() && commands_[i].execute_in_subcontext(); ++i) {
+        batch.emplace_back(&commands_[i].args());
+    }
+
+    // Replies are streamed back as each command completes, so the time between them is the time
+    // a command took.
+    android::base::Timer t;
+    std::size_t executed = 0;
+    subcontext_->ExecuteBatch(batch, [&](const Result<Success>& result) {
+        ReportResult(commands_[command + executed], result, t.duration());
+        ++executed;
+        t = android::base::Timer();
+    });
+    return executed;
+}
+
 void Action::ExecuteAllCommands() const {
     for (const auto& c : commands_) {
         ExecuteCommand(c);
@@ -119,10 +146,19 @@ void Action::ExecuteAllCommands() const {
 }
 
 void Action::ExecuteCommand(const Command& command) const {
+    if (IsBootTracing()) {
+        RecordBootTraceEvent(BootTracePhase::kBegin, BootTraceCategory::kCommand,
+                             command.BuildCommandString());
+    }
     android::base::Timer t;
     auto result = command.InvokeFunc(subcontext_);
     auto duration = t.duration();
+    RecordBootTraceEvent(BootTracePhase::kEnd, BootTraceCategory::kCommand, "");
+    ReportResult(command, result, duration);
+}
 
+void Action::ReportResult(const Command& command, const Result<Success>& result,
+                          std::chrono::milliseconds duration) const {
     // There are many legacy paths in rootdir/init.rc that will virtually never exist on a new
     // device, such as '/sys/class/leds/jogball-backlight/brightness'.  As of this writing, there
     // are 198 such failures on bullhead.  Instead of spamming the log reporting them, we do not
@@ -17,6 +17,7 @@
 #ifndef _INIT_ACTION_H
 #define _INIT_ACTION_H
 
+#include <chrono>
 #include <map>
 #include <queue>
 #include <string>
@@ -43,6 +44,8 @@ class Command {
     std::string BuildCommandString() const;
 
     int line() const { return line_; }
+    bool execute_in_subcontext() const { return execute_in_subcontext_; }
+    const std::vector<std::string>& args() const { return args_; }
 
   private:
     BuiltinFunction func_;
@@ -65,6 +68,9 @@ class Action {
     void AddCommand(BuiltinFunction f, const std::vector<std::string>& args, int line);
     std::size_t NumCommands() const;
     void ExecuteOneCommand(std::size_t command) const;
+    // Executes |command|, along with the commands following it that a single subcontext round
+    // trip can take. Returns the number of commands executed.
+    std::size_t ExecuteCommands(std::size_t command) const;
     void ExecuteAllCommands() const;
     bool CheckEvent(const EventTrigger& event_trigger) const;
     bool CheckEvent(const PropertyChange& property_change) const;
@@ -75,12 +81,18 @@ class Action {
     bool oneshot() const { return oneshot_; }
     const std::string& filename() const { return filename_; }
     int line() const { return line_; }
+    const std::map<std::string, std::string>& property_triggers() const {
+        return property_triggers_;
+    }
+    const std::string& event_trigger() const { return event_trigger_; }
     static void set_function_map(const KeywordFunctionMap* function_map) {
         function_map_ = function_map;
     }
 
   private:
     void ExecuteCommand(const Command& command) const;
+    void ReportResult(const Command& command, const Result<Success>& result,
+                      std::chrono::milliseconds duration) const;
     bool CheckPropertyTriggers(const std::string& name = "",
                                const std::string& value = "") const;
 
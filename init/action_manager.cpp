@@ -18,6 +18,8 @@
 
 #include <android-base/logging.h>
 
+#include "boot_trace.h"
+
 namespace android {
 namespace init {
 
@@ -29,14 +31,25 @@ ActionManager& ActionManager::GetInstance() {
 }
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
+    // Actions with an event trigger only run on that event, never on a property change.
+    if (action->event_trigger().empty()) {
+        for (const auto& [name, value] : action->property_triggers()) {
+            property_actions_[name].emplace_back(action.get());
+        }
+    }
     actions_.emplace_back(std::move(action));
 }
 
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
+    RecordBootTraceEvent(BootTracePhase::kInstant, BootTraceCategory::kTrigger, trigger);
     event_queue_.emplace(trigger);
 }
 
 void ActionManager::QueuePropertyChange(const std::string& name, const std::string& value) {
+    if (IsBootTracing() && !name.empty()) {
+        RecordBootTraceEvent(BootTracePhase::kInstant, BootTraceCategory::kProperty,
+                             name + "=" + value);
+    }
     event_queue_.emplace(std::make_pair(name, value));
 }
 
@@ -58,6 +71,21 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func, const std::string&
 void ActionManager::ExecuteOneCommand() {
     // Loop through the event queue until we have an action to execute
     while (current_executing_actions_.empty() && !event_queue_.empty()) {
+        // QueueAllPropertyActions() queues a change with no name, which matches every action.
+        auto property_change = std::get_if<PropertyChange>(&event_queue_.front());
+        if (property_change != nullptr && !property_change->first.empty()) {
+            auto property_actions = property_actions_.find(property_change->first);
+            if (property_actions != property_actions_.end()) {
+                for (const auto& action : property_actions->second) {
+                    if (action->CheckEvent(*property_change)) {
+                        current_executing_actions_.emplace(action);
+                    }
+                }
+            }
+            event_queue_.pop();
+            continue;
+        }
+
         for (const auto& action : actions_) {
             if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
                            event_queue_.front())) {
@@ -79,16 +107,24 @@ void ActionManager::ExecuteOneCommand() {
                   << ":" << action->line() << ")";
     }
 
-    action->ExecuteOneCommand(current_command_);
+    // Commands executed in a subcontext are run a batch at a time.
+    current_command_ += action->ExecuteCommands(current_command_);
 
     // If this was the last command in the current action, then remove
     // the action from the executing list.
     // If this action was oneshot, then also remove it from actions_.
-    ++current_command_;
     if (current_command_ == action->NumCommands()) {
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            for (const auto& [name, value] : action->property_triggers()) {
+                if (auto it = property_actions_.find(name); it != property_actions_.end()) {
+                    auto& property_actions = it->second;
+                    property_actions.erase(
+                        std::remove(property_actions.begin(), property_actions.end(), action),
+                        property_actions.end());
+                }
+            }
             auto eraser = [&action](std::unique_ptr<Action>& a) { return a.get() == action; };
             actions_.erase(std::remove_if(actions_.begin(), actions_.end(), eraser));
         }
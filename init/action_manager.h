@@ -17,6 +17,7 @@
 #ifndef _INIT_ACTION_MANAGER_H
 #define _INIT_ACTION_MANAGER_H
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -48,6 +49,9 @@ class ActionManager {
     void operator=(ActionManager const&) = delete;
 
     std::vector<std::unique_ptr<Action>> actions_;
+    // The actions that a change of each property can trigger, in the order of actions_, so that
+    // a property change does not check every action.
+    std::map<std::string, std::vector<const Action*>> property_actions_;
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_trace.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include <android-base/chrono_utils.h>
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+using android::base::boot_clock;
+using android::base::StringAppendF;
+
+namespace android {
+namespace init {
+
+namespace {
+
+struct BootTraceEvent {
+    int64_t timestamp_ns;
+    BootTracePhase phase;
+    BootTraceCategory category;
+    int id;
+    char name[kMaxBootTraceNameSize + 1];
+};
+
+std::unique_ptr<BootTraceEvent[]> boot_trace_events;
+size_t boot_trace_max_events;
+// Events ever recorded, so the next one goes to boot_trace_count % boot_trace_max_events.
+uint64_t boot_trace_count;
+
+const char* CategoryName(BootTraceCategory category) {
+    switch (category) {
+        case BootTraceCategory::kCommand:
+            return "command";
+        case BootTraceCategory::kTrigger:
+            return "trigger";
+        case BootTraceCategory::kProperty:
+            return "property";
+        case BootTraceCategory::kService:
+            return "service";
+    }
+    return "";
+}
+
+void AppendJsonString(const char* str, std::string* out) {
+    out->push_back('"');
+    for (const char* p = str; *p != '\0'; ++p) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            StringAppendF(out, "\\u%04x", c);
+        } else {
+            out->push_back(c);
+        }
+    }
+    out->push_back('"');
+}
+
+}  // namespace
+
+void StartBootTrace(size_t max_events) {
+    boot_trace_events.reset(new BootTraceEvent[max_events]);
+    boot_trace_max_events = max_events;
+    boot_trace_count = 0;
+}
+
+void StopBootTrace() {
+    boot_trace_events.reset();
+    boot_trace_max_events = 0;
+    boot_trace_count = 0;
+}
+
+bool IsBootTracing() {
+    return boot_trace_events != nullptr;
+}
+
+void RecordBootTraceEvent(BootTracePhase phase, BootTraceCategory category,
+                          const std::string& name, int id) {
+    if (!IsBootTracing()) return;
+
+    BootTraceEvent& event = boot_trace_events[boot_trace_count++ % boot_trace_max_events];
+    event.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             boot_clock::now().time_since_epoch())
+                             .count();
+    event.phase = phase;
+    event.category = category;
+    event.id = id;
+    size_t size = std::min(name.size(), kMaxBootTraceNameSize);
+    memcpy(event.name, name.data(), size);
+    event.name[size] = '\0';
+}
+
+Result<Success> WriteBootTrace(const std::string& path) {
+    if (!IsBootTracing()) return Error() << "Boot tracing was not started";
+
+    // Timestamps are in microseconds, and every event belongs to init's main thread.
+    std::string trace = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    uint64_t first = boot_trace_count > boot_trace_max_events
+                         ? boot_trace_count - boot_trace_max_events
+                         : 0;
+    for (uint64_t i = first; i < boot_trace_count; ++i) {
+        const BootTraceEvent& event = boot_trace_events[i % boot_trace_max_events];
+        StringAppendF(&trace, "{\"ph\":\"%c\",\"cat\":\"%s\",\"ts\":%" PRId64 ".%03" PRId64
+                      ",\"pid\":1,\"tid\":1",
+                      static_cast<char>(event.phase), CategoryName(event.category),
+                      event.timestamp_ns / 1000, event.timestamp_ns % 1000);
+        if (event.name[0] != '\0') {
+            trace += ",\"name\":";
+            AppendJsonString(event.name, &trace);
+        }
+        switch (event.phase) {
+            case BootTracePhase::kInstant:
+                trace += ",\"s\":\"p\"";
+                break;
+            case BootTracePhase::kAsyncBegin:
+            case BootTracePhase::kAsyncEnd:
+                StringAppendF(&trace, ",\"id\":%d", event.id);
+                break;
+            default:
+                break;
+        }
+        trace += i + 1 < boot_trace_count ? "},\n" : "}\n";
+    }
+    trace += "]}\n";
+
+    if (!android::base::WriteStringToFile(trace, path)) {
+        return ErrnoError() << "Unable to write boot trace to " << path;
+    }
+    return Success();
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_BOOT_TRACE_H
+#define _INIT_BOOT_TRACE_H
+
+#include <stddef.h>
+
+#include <string>
+
+#include "result.h"
+
+namespace android {
+namespace init {
+
+// Boot tracing records what init does, as it happens, into a ring of events that is allocated
+// once when tracing starts. The ring is written out in the JSON trace event format, which
+// Perfetto and the systrace viewer both load. Only init's main thread may record events.
+
+enum class BootTraceCategory {
+    kCommand,
+    kTrigger,
+    kProperty,
+    kService,
+};
+
+enum class BootTracePhase : char {
+    kBegin = 'B',
+    kEnd = 'E',
+    kInstant = 'i',
+    // Spans that can overlap others, matched by id, such as the life of a service's process.
+    kAsyncBegin = 'b',
+    kAsyncEnd = 'e',
+};
+
+// Names longer than this are cut.
+constexpr size_t kMaxBootTraceNameSize = 96;
+
+void StartBootTrace(size_t max_events);
+void StopBootTrace();
+
+// Callers should check this before building the name of an event.
+bool IsBootTracing();
+
+void RecordBootTraceEvent(BootTracePhase phase, BootTraceCategory category,
+                          const std::string& name, int id = 0);
+
+// Writes the events in the ring, oldest first.
+Result<Success> WriteBootTrace(const std::string& path);
+
+}  // namespace init
+}  // namespace android
+
+#endif
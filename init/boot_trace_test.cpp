@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_trace.h"
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+using android::base::ReadFileToString;
+using android::base::Split;
+
+namespace android {
+namespace init {
+
+TEST(boot_trace, NotStarted) {
+    EXPECT_FALSE(IsBootTracing());
+    RecordBootTraceEvent(BootTracePhase::kInstant, BootTraceCategory::kTrigger, "boot");
+
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    EXPECT_FALSE(WriteBootTrace(tf.path));
+}
+
+TEST(boot_trace, Events) {
+    StartBootTrace(16);
+    ASSERT_TRUE(IsBootTracing());
+    RecordBootTraceEvent(BootTracePhase::kBegin, BootTraceCategory::kCommand, "mkdir /data");
+    RecordBootTraceEvent(BootTracePhase::kEnd, BootTraceCategory::kCommand, "");
+    RecordBootTraceEvent(BootTracePhase::kInstant, BootTraceCategory::kProperty, "a=\"\\\n");
+    RecordBootTraceEvent(BootTracePhase::kAsyncBegin, BootTraceCategory::kService, "ueventd", 42);
+    RecordBootTraceEvent(BootTracePhase::kAsyncEnd, BootTraceCategory::kService, "ueventd", 42);
+
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(WriteBootTrace(tf.path));
+    StopBootTrace();
+    EXPECT_FALSE(IsBootTracing());
+
+    std::string trace;
+    ASSERT_TRUE(ReadFileToString(tf.path, &trace));
+    auto lines = Split(trace, "\n");
+    ASSERT_EQ(8U, lines.size()) << trace;
+    EXPECT_EQ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", lines[0]);
+    EXPECT_NE(std::string::npos, lines[1].find("\"ph\":\"B\",\"cat\":\"command\""));
+    EXPECT_NE(std::string::npos, lines[1].find("\"name\":\"mkdir /data\"},"));
+    EXPECT_EQ(std::string::npos, lines[2].find("\"name\""));
+    EXPECT_NE(std::string::npos, lines[3].find("\"name\":\"a=\\\"\\\\\\u000a\",\"s\":\"p\""));
+    EXPECT_NE(std::string::npos, lines[4].find("\"name\":\"ueventd\",\"id\":42},"));
+    EXPECT_NE(std::string::npos, lines[5].find("\"ph\":\"e\""));
+    EXPECT_EQ('}', lines[5].back());
+    EXPECT_EQ("]}", lines[6]);
+}
+
+TEST(boot_trace, Wraps) {
+    StartBootTrace(4);
+    for (int i = 0; i < 10; ++i) {
+        RecordBootTraceEvent(BootTracePhase::kInstant, BootTraceCategory::kTrigger,
+                             "trigger" + std::to_string(i));
+    }
+    RecordBootTraceEvent(BootTracePhase::kInstant, BootTraceCategory::kTrigger,
+                         std::string(kMaxBootTraceNameSize + 10, 'x'));
+
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(WriteBootTrace(tf.path));
+    StopBootTrace();
+
+    std::string trace;
+    ASSERT_TRUE(ReadFileToString(tf.path, &trace));
+    auto lines = Split(trace, "\n");
+    ASSERT_EQ(7U, lines.size()) << trace;
+    EXPECT_NE(std::string::npos, lines[1].find("\"name\":\"trigger7\""));
+    EXPECT_NE(std::string::npos, lines[2].find("\"name\":\"trigger8\""));
+    EXPECT_NE(std::string::npos, lines[3].find("\"name\":\"trigger9\""));
+    EXPECT_NE(std::string::npos,
+              lines[4].find("\"name\":\"" + std::string(kMaxBootTraceNameSize, 'x') + "\""));
+}
+
+}  // namespace init
+}  // namespace android
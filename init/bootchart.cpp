@@ -37,6 +37,8 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 
+#include "boot_trace.h"
+
 using android::base::StringPrintf;
 using namespace std::chrono_literals;
 
@@ -176,6 +178,13 @@ static Result<Success> do_bootchart_start() {
 }
 
 static Result<Success> do_bootchart_stop() {
+    if (IsBootTracing()) {
+        if (auto result = WriteBootTrace("/data/bootchart/trace.json"); !result) {
+            LOG(ERROR) << "bootchart: " << result.error();
+        }
+        StopBootTrace();
+    }
+
     if (!g_bootcharting_thread) return Success();
 
     // Tell the worker thread it's time to quit.
@@ -132,6 +132,37 @@ bool Permissions::Match(const std::string& path) const {
     return path == name_;
 }
 
+std::string Permissions::MatchPrefix() const {
+    if (!wildcard_) return name_;
+    // fnmatch() compares a pattern literally up to its first special character.
+    return name_.substr(0, name_.find_first_of("*?[\\"));
+}
+
+void PermissionsIndex::Add(const std::string& prefix, size_t rule) {
+    size_t node = 0;
+    for (char c : prefix) {
+        auto [child, inserted] = nodes_[node].children.emplace(c, nodes_.size());
+        if (inserted) {
+            nodes_.emplace_back();
+        }
+        node = child->second;
+    }
+    nodes_[node].rules.emplace_back(rule);
+}
+
+void PermissionsIndex::Find(const std::string& path, std::vector<size_t>* rules) const {
+    size_t node = 0;
+    for (size_t i = 0;; ++i) {
+        const auto& node_rules = nodes_[node].rules;
+        rules->insert(rules->end(), node_rules.begin(), node_rules.end());
+        if (i == path.size()) return;
+
+        auto child = nodes_[node].children.find(path[i]);
+        if (child == nodes_[node].children.end()) return;
+        node = child->second;
+    }
+}
+
 bool SysfsPermissions::MatchWithSubsystem(const std::string& path,
                                           const std::string& subsystem) const {
     std::string path_basename = Basename(path);
@@ -195,7 +226,18 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
     // contain, so we prepend it...
     std::string path = "/sys" + upath;
 
-    for (const auto& s : sysfs_permissions_) {
+    // MatchWithSubsystem() may also match the class and bus paths of the device, so the rules
+    // that may match any of them are checked, in order.
+    std::string path_basename = Basename(path);
+    std::vector<size_t> rules;
+    sysfs_permissions_index_.Find(path, &rules);
+    sysfs_permissions_index_.Find("/sys/class/" + subsystem + "/" + path_basename, &rules);
+    sysfs_permissions_index_.Find("/sys/bus/" + subsystem + "/devices/" + path_basename, &rules);
+    std::sort(rules.begin(), rules.end());
+    rules.erase(std::unique(rules.begin(), rules.end()), rules.end());
+
+    for (size_t rule : rules) {
+        const auto& s = sysfs_permissions_[rule];
         if (s.MatchWithSubsystem(path, subsystem)) s.SetPermissions(path);
     }
 
@@ -209,24 +251,50 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
 
 std::tuple<mode_t, uid_t, gid_t> DeviceHandler::GetDevicePermissions(
     const std::string& path, const std::vector<std::string>& links) const {
+    std::vector<size_t> rules;
+    dev_permissions_index_.Find(path, &rules);
+    for (const auto& link : links) {
+        dev_permissions_index_.Find(link, &rules);
+    }
+
     // Search the perms list in reverse so that ueventd.$hardware can override ueventd.rc.
-    for (auto it = dev_permissions_.crbegin(); it != dev_permissions_.crend(); ++it) {
-        if (it->Match(path) || std::any_of(links.cbegin(), links.cend(),
-                                           [it](const auto& link) { return it->Match(link); })) {
-            return {it->perm(), it->uid(), it->gid()};
+    std::sort(rules.begin(), rules.end(), std::greater<size_t>());
+    rules.erase(std::unique(rules.begin(), rules.end()), rules.end());
+    for (size_t rule : rules) {
+        const auto& p = dev_permissions_[rule];
+        if (p.Match(path) || std::any_of(links.cbegin(), links.cend(),
+                                         [&p](const auto& link) { return p.Match(link); })) {
+            return {p.perm(), p.uid(), p.gid()};
         }
     }
     /* Default if nothing found. */
     return {0600, 0, 0};
 }
 
+// Devices that are removed and added back, or that get several add events, keep the label that
+// was looked up the first time instead of matching the file contexts again.
+bool DeviceHandler::LookupDeviceLabel(const std::string& path,
+                                      const std::vector<std::string>& links, mode_t mode,
+                                      std::string* secontext) const {
+    auto key = std::make_tuple(path, links, mode);
+    if (auto it = device_labels_.find(key); it != device_labels_.end()) {
+        *secontext = it->second;
+        return true;
+    }
+    if (!SelabelLookupFileContextBestMatch(path, links, mode, secontext)) {
+        return false;
+    }
+    device_labels_.emplace(std::move(key), *secontext);
+    return true;
+}
+
 void DeviceHandler::MakeDevice(const std::string& path, bool block, int major, int minor,
                                const std::vector<std::string>& links) const {
     auto[mode, uid, gid] = GetDevicePermissions(path, links);
     mode |= (block ? S_IFBLK : S_IFCHR);
 
     std::string secontext;
-    if (!SelabelLookupFileContextBestMatch(path, links, mode, &secontext)) {
+    if (!LookupDeviceLabel(path, links, mode, &secontext)) {
         PLOG(ERROR) << "Device '" << path << "' not created; cannot find SELinux label";
         return;
     }
@@ -425,6 +493,8 @@ DeviceHandler::DeviceHandler(std::vector<Permissions> dev_permissions,
                              bool skip_restorecon)
     : dev_permissions_(std::move(dev_permissions)),
       sysfs_permissions_(std::move(sysfs_permissions)),
+      dev_permissions_index_(dev_permissions_),
+      sysfs_permissions_index_(sysfs_permissions_),
       subsystems_(std::move(subsystems)),
       boot_devices_(std::move(boot_devices)),
       skip_restorecon_(skip_restorecon),
@@ -21,8 +21,10 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <map>
 #include <set>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <android-base/file.h>
@@ -38,6 +40,8 @@ class Permissions {
     Permissions(const std::string& name, mode_t perm, uid_t uid, gid_t gid);
 
     bool Match(const std::string& path) const;
+    // The text that every path that Match() accepts starts with.
+    std::string MatchPrefix() const;
 
     mode_t perm() const { return perm_; }
     uid_t uid() const { return uid_; }
@@ -68,6 +72,33 @@ class SysfsPermissions : public Permissions {
     const std::string attribute_;
 };
 
+// Indexes rules by their MatchPrefix() in a trie, so that finding the rules that may match a path
+// walks the path once instead of calling Match() on every rule.
+class PermissionsIndex {
+  public:
+    PermissionsIndex() : nodes_(1) {}
+
+    template <typename T>
+    explicit PermissionsIndex(const std::vector<T>& permissions) : nodes_(1) {
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            Add(permissions[i].MatchPrefix(), i);
+        }
+    }
+
+    void Add(const std::string& prefix, size_t rule);
+
+    // Appends to rules the rules whose prefix starts path, which is every rule that may match it.
+    void Find(const std::string& path, std::vector<size_t>* rules) const;
+
+  private:
+    struct Node {
+        std::map<char, size_t> children;
+        std::vector<size_t> rules;
+    };
+
+    std::vector<Node> nodes_;
+};
+
 class Subsystem {
   public:
     friend class SubsystemParser;
@@ -114,6 +145,8 @@ class DeviceHandler {
 
   private:
     bool FindPlatformDevice(std::string path, std::string* platform_device_path) const;
+    bool LookupDeviceLabel(const std::string& path, const std::vector<std::string>& links,
+                           mode_t mode, std::string* secontext) const;
     std::tuple<mode_t, uid_t, gid_t> GetDevicePermissions(
         const std::string& path, const std::vector<std::string>& links) const;
     void MakeDevice(const std::string& path, bool block, int major, int minor,
@@ -124,10 +157,16 @@ class DeviceHandler {
 
     std::vector<Permissions> dev_permissions_;
     std::vector<SysfsPermissions> sysfs_permissions_;
+    PermissionsIndex dev_permissions_index_;
+    PermissionsIndex sysfs_permissions_index_;
     std::vector<Subsystem> subsystems_;
     std::set<std::string> boot_devices_;
     bool skip_restorecon_;
     std::string sysfs_mount_point_;
+    // The labels found for device nodes, by path, links and mode, which stay the same while
+    // ueventd runs since it loads the file contexts once.
+    mutable std::map<std::tuple<std::string, std::vector<std::string>, mode_t>, std::string>
+        device_labels_;
 };
 
 // Exposed for testing
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "devices.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace init {
+
+// A ueventd.rc sized set of rules, with exact names, prefixes and wildcards, and the device paths
+// of a coldboot that mostly match none of them.
+static std::vector<Permissions> BuildPermissions(size_t count) {
+    std::vector<Permissions> permissions;
+    for (size_t i = 0; i < count; ++i) {
+        switch (i % 3) {
+            case 0:
+                permissions.emplace_back(StringPrintf("/dev/device%zu", i), 0660, 0, 0);
+                break;
+            case 1:
+                permissions.emplace_back(StringPrintf("/dev/prefix%zu*", i), 0660, 0, 0);
+                break;
+            case 2:
+                permissions.emplace_back(StringPrintf("/dev/dir%zu/*/node", i), 0660, 0, 0);
+                break;
+        }
+    }
+    return permissions;
+}
+
+static std::vector<std::string> BuildPaths() {
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < 64; ++i) {
+        paths.emplace_back(StringPrintf("/dev/block/mmcblk0p%zu", i));
+        paths.emplace_back(StringPrintf("/dev/block/platform/soc/by-name/part%zu", i));
+    }
+    paths.emplace_back("/dev/device3");
+    paths.emplace_back("/dev/prefix4x");
+    paths.emplace_back("/dev/dir5/x/node");
+    return paths;
+}
+
+static void BenchmarkMatchAll(benchmark::State& state) {
+    auto permissions = BuildPermissions(state.range(0));
+    auto paths = BuildPaths();
+    size_t matches = 0;
+    while (state.KeepRunning()) {
+        for (const auto& path : paths) {
+            for (const auto& p : permissions) {
+                if (p.Match(path)) matches++;
+            }
+        }
+    }
+    benchmark::DoNotOptimize(matches);
+    state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BenchmarkMatchAll)->Arg(100)->Arg(500);
+
+static void BenchmarkMatchIndex(benchmark::State& state) {
+    auto permissions = BuildPermissions(state.range(0));
+    PermissionsIndex index(permissions);
+    auto paths = BuildPaths();
+    size_t matches = 0;
+    std::vector<size_t> rules;
+    while (state.KeepRunning()) {
+        for (const auto& path : paths) {
+            rules.clear();
+            index.Find(path, &rules);
+            for (size_t rule : rules) {
+                if (permissions[rule].Match(path)) matches++;
+            }
+        }
+    }
+    benchmark::DoNotOptimize(matches);
+    state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BenchmarkMatchIndex)->Arg(100)->Arg(500);
+
+}  // namespace init
+}  // namespace android
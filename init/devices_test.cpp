@@ -309,5 +309,47 @@ TEST(device_handler, SysfsPermissionsMatchWithSubsystemBus) {
     EXPECT_EQ(1001U, permissions.gid());
 }
 
+TEST(device_handler, PermissionsMatchPrefix) {
+    EXPECT_EQ("/dev/null", Permissions("/dev/null", 0666, 0, 0).MatchPrefix());
+    EXPECT_EQ("/dev/tty", Permissions("/dev/tty*", 0666, 0, 0).MatchPrefix());
+    EXPECT_EQ("/dev/block/", Permissions("/dev/block/*/by-name", 0666, 0, 0).MatchPrefix());
+    EXPECT_EQ("/dev/", Permissions("/dev/[a-c]*/x", 0666, 0, 0).MatchPrefix());
+}
+
+TEST(device_handler, PermissionsIndexFind) {
+    std::vector<Permissions> permissions{
+        {"/dev/null", 0666, 0, 0},
+        {"/dev/tty*", 0666, 0, 0},
+        {"/dev/*/by-name", 0666, 0, 0},
+        {"/dev/ttyS0", 0666, 0, 0},
+        {"/sys/*", 0666, 0, 0},
+    };
+    PermissionsIndex index(permissions);
+
+    auto find = [&index](const std::string& path) {
+        std::vector<size_t> rules;
+        index.Find(path, &rules);
+        std::sort(rules.begin(), rules.end());
+        return rules;
+    };
+    EXPECT_EQ((std::vector<size_t>{0, 2}), find("/dev/null"));
+    EXPECT_EQ((std::vector<size_t>{1, 2, 3}), find("/dev/ttyS0"));
+    EXPECT_EQ((std::vector<size_t>{1, 2}), find("/dev/ttyS1"));
+    EXPECT_EQ((std::vector<size_t>{2}), find("/dev/block/by-name"));
+    EXPECT_EQ((std::vector<size_t>{}), find("/de"));
+    EXPECT_EQ((std::vector<size_t>{4}), find("/sys/class"));
+
+    // Every rule that matches a path must be found for it.
+    for (const auto& path : {"/dev/null", "/dev/ttyS0", "/dev/block/by-name", "/sys/class"}) {
+        auto rules = find(path);
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            if (permissions[i].Match(path)) {
+                EXPECT_NE(rules.end(), std::find(rules.begin(), rules.end(), i))
+                    << path << " " << i;
+            }
+        }
+    }
+}
+
 }  // namespace init
 }  // namespace android
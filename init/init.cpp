@@ -47,6 +47,7 @@
 #include <optional>
 
 #include "action_parser.h"
+#include "boot_trace.h"
 #include "boringssl_self_test.h"
 #include "import_parser.h"
 #include "init_first_stage.h"
@@ -670,6 +671,11 @@ int main(int argc, char** argv) {
     // used by init as well as the current required properties.
     export_kernel_boot_props();
 
+    // androidboot.init_trace=1 traces the rest of the boot, see bootchart stop.
+    if (android::base::GetBoolProperty("ro.boot.init_trace", false)) {
+        StartBootTrace(16 * 1024);
+    }
+
     // Make the time that init started available for bootstat to log.
     property_set("ro.boottime.init", getenv("INIT_STARTED_AT"));
     property_set("ro.boottime.init.selinux", getenv("INIT_SELINUX_TOOK"));
@@ -189,8 +189,15 @@ bool FirstStageMount::InitRequiredDevices() {
         }
     }
 
+    // Only block devices are needed, and reading them from /sys/class/block is much quicker than
+    // having the kernel regenerate the uevents of everything in /sys/devices. Those added since
+    // are still queued on the uevent socket opened before, for Poll() below.
     auto uevent_callback = [this](const Uevent& uevent) { return UeventCallback(uevent); };
-    uevent_listener_.RegenerateUevents(uevent_callback);
+    Timer t;
+    auto required_count = required_devices_partition_names_.size();
+    uevent_listener_.ReadBlockDeviceUevents(uevent_callback);
+    LOG(INFO) << "Found " << required_count - required_devices_partition_names_.size() << " of "
+              << required_count << " required partition(s) in /sys after " << t;
 
     // UeventCallback() will remove found partitions from required_devices_partition_names_.
     // So if it isn't empty here, it means some partitions are not found.
@@ -198,9 +205,9 @@ bool FirstStageMount::InitRequiredDevices() {
         LOG(INFO) << __PRETTY_FUNCTION__
                   << ": partition(s) not found in /sys, waiting for their uevent(s): "
                   << android::base::Join(required_devices_partition_names_, ", ");
-        Timer t;
+        Timer poll_timer;
         uevent_listener_.Poll(uevent_callback, 10s);
-        LOG(INFO) << "Wait for partitions returned after " << t;
+        LOG(INFO) << "Wait for partitions returned after " << poll_timer;
     }
 
     if (!required_devices_partition_names_.empty()) {
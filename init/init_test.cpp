@@ -113,6 +113,41 @@ execute_third
     TestInitText(init_script, test_function_map, commands, &service_list);
 }
 
+TEST(init, PropertyTriggerOrder) {
+    std::string init_script =
+        R"init(
+on property:init_test.prop=1
+execute_first
+
+on property:init_test.other=1
+execute_other
+
+on boot && property:init_test.prop=1
+execute_other
+
+on property:init_test.prop=*
+execute_second
+
+on property:init_test.prop=2
+execute_other
+)init";
+
+    int num_executed = 0;
+    TestFunctionMap test_function_map;
+    test_function_map.Add("execute_first", [&num_executed]() { EXPECT_EQ(0, num_executed++); });
+    test_function_map.Add("execute_second", [&num_executed]() { EXPECT_EQ(1, num_executed++); });
+    test_function_map.Add("execute_other", []() { FAIL() << "Unexpected action"; });
+
+    ActionManagerCommand change_property = [](ActionManager& am) {
+        am.QueuePropertyChange("init_test.prop", "1");
+    };
+    std::vector<ActionManagerCommand> commands{change_property};
+
+    ServiceList service_list;
+    TestInitText(init_script, test_function_map, commands, &service_list);
+    EXPECT_EQ(2, num_executed);
+}
+
 TEST(init, OverrideService) {
     std::string init_script = R"init(
 service A something
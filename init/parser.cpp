@@ -39,14 +39,11 @@ void Parser::AddSingleLineParser(const std::string& prefix, LineCallback callbac
     line_callbacks_.emplace_back(prefix, callback);
 }
 
-void Parser::ParseData(const std::string& filename, const std::string& data, size_t* parse_errors) {
-    // TODO: Use a parser with const input and remove this copy
-    std::vector<char> data_copy(data.begin(), data.end());
-    data_copy.push_back('\0');
-
+// The tokenizer unquotes and unescapes in place, so data is overwritten.
+void Parser::ParseData(const std::string& filename, std::string* data, size_t* parse_errors) {
     parse_state state;
     state.line = 0;
-    state.ptr = &data_copy[0];
+    state.ptr = &(*data)[0];
     state.nexttoken = 0;
 
     SectionParser* section_parser = nullptr;
@@ -65,47 +62,55 @@ void Parser::ParseData(const std::string& filename, const std::string& data, siz
         section_start_line = -1;
     };
 
+    auto parse_line = [&] {
+        // If we have a line matching a prefix we recognize, call its callback and unset any
+        // current section parsers.  This is meant for /sys/ and /dev/ line entries for
+        // uevent.
+        for (const auto& [prefix, callback] : line_callbacks_) {
+            if (android::base::StartsWith(args[0], prefix)) {
+                end_section();
+
+                if (auto result = callback(std::move(args)); !result) {
+                    (*parse_errors)++;
+                    LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
+                }
+                break;
+            }
+        }
+        if (section_parsers_.count(args[0])) {
+            end_section();
+            section_parser = section_parsers_[args[0]].get();
+            section_start_line = state.line;
+            if (auto result = section_parser->ParseSection(std::move(args), filename, state.line);
+                !result) {
+                (*parse_errors)++;
+                LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
+                section_parser = nullptr;
+            }
+        } else if (section_parser) {
+            if (auto result = section_parser->ParseLineSection(std::move(args), state.line);
+                !result) {
+                (*parse_errors)++;
+                LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
+            }
+        }
+        args.clear();
+    };
+
     for (;;) {
         switch (next_token(&state)) {
             case T_EOF:
+                // The last line of a file does not need to end with a newline.
+                if (!args.empty()) {
+                    state.line++;
+                    parse_line();
+                }
                 end_section();
                 return;
             case T_NEWLINE:
                 state.line++;
                 if (args.empty()) break;
-                // If we have a line matching a prefix we recognize, call its callback and unset any
-                // current section parsers.  This is meant for /sys/ and /dev/ line entries for
-                // uevent.
-                for (const auto& [prefix, callback] : line_callbacks_) {
-                    if (android::base::StartsWith(args[0], prefix)) {
-                        end_section();
-
-                        if (auto result = callback(std::move(args)); !result) {
-                            (*parse_errors)++;
-                            LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                        }
-                        break;
-                    }
-                }
-                if (section_parsers_.count(args[0])) {
-                    end_section();
-                    section_parser = section_parsers_[args[0]].get();
-                    section_start_line = state.line;
-                    if (auto result =
-                            section_parser->ParseSection(std::move(args), filename, state.line);
-                        !result) {
-                        (*parse_errors)++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                        section_parser = nullptr;
-                    }
-                } else if (section_parser) {
-                    if (auto result = section_parser->ParseLineSection(std::move(args), state.line);
-                        !result) {
-                        (*parse_errors)++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                    }
-                }
-                args.clear();
+                parse_line();
                 break;
             case T_TEXT:
                 args.emplace_back(state.text);
@@ -123,8 +128,7 @@ bool Parser::ParseConfigFile(const std::string& path, size_t* parse_errors) {
         return false;
     }
 
-    config_contents->push_back('\n');  // TODO: fix parse_config.
-    ParseData(path, *config_contents, parse_errors);
+    ParseData(path, &*config_contents, parse_errors);
     for (const auto& [section_name, section_parser] : section_parsers_) {
         section_parser->EndFile();
     }
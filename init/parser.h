@@ -77,7 +77,7 @@ class Parser {
     void AddSingleLineParser(const std::string& prefix, LineCallback callback);
 
   private:
-    void ParseData(const std::string& filename, const std::string& data, size_t* parse_errors);
+    void ParseData(const std::string& filename, std::string* data, size_t* parse_errors);
     bool ParseConfigFile(const std::string& path, size_t* parse_errors);
     bool ParseConfigDir(const std::string& path, size_t* parse_errors);
 
@@ -18,11 +18,13 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/system_properties.h>
 #include <sys/types.h>
 
 #include <memory>
+#include <unordered_map>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -45,6 +47,13 @@ namespace {
 
 constexpr const char kLegacyPersistentPropertyDir[] = "/data/property";
 
+// Past this size, the journal is folded into the persistent property file on the next write.
+constexpr off_t kMaxJournalSize = 32 * 1024;
+
+std::string JournalFilename() {
+    return persistent_property_filename + ".journal";
+}
+
 void AddPersistentProperty(const std::string& name, const std::string& value,
                            PersistentProperties* persistent_properties) {
     auto persistent_property_record = persistent_properties->add_properties();
@@ -154,18 +163,107 @@ Result<std::string> ReadPersistentPropertyFile() {
     return *file_contents;
 }
 
+// The journal holds the properties written since the persistent property file was last
+// rewritten, each as a native endian uint32_t size followed by a serialized
+// PersistentPropertyRecord. It only exists next to a persistent property file that could be
+// parsed, since it is created when that file is written.
+void ApplyJournal(PersistentProperties* persistent_properties) {
+    auto journal = ReadFile(JournalFilename());
+    if (!journal) {
+        if (journal.error_errno() != ENOENT) {
+            LOG(ERROR) << "Unable to read persistent property journal: " << journal.error();
+        }
+        return;
+    }
+
+    std::unordered_map<std::string, int> indexes;
+    for (int i = 0; i < persistent_properties->properties_size(); ++i) {
+        indexes[persistent_properties->properties(i).name()] = i;
+    }
+
+    size_t offset = 0;
+    while (offset < journal->size()) {
+        uint32_t size;
+        if (journal->size() - offset < sizeof(size)) break;
+        memcpy(&size, journal->data() + offset, sizeof(size));
+        PersistentProperties::PersistentPropertyRecord record;
+        if (journal->size() - offset - sizeof(size) < size ||
+            !record.ParseFromArray(journal->data() + offset + sizeof(size), size)) {
+            break;
+        }
+        offset += sizeof(size) + size;
+
+        auto it = indexes.find(record.name());
+        if (it != indexes.end()) {
+            persistent_properties->mutable_properties(it->second)->set_value(record.value());
+        } else {
+            indexes.emplace(record.name(), persistent_properties->properties_size());
+            AddPersistentProperty(record.name(), record.value(), persistent_properties);
+        }
+    }
+
+    // The device lost power while this record was being written, so it was never acknowledged.
+    // It is cut off so that the records appended after it can be read.
+    if (offset != journal->size()) {
+        LOG(ERROR) << "Dropping " << journal->size() - offset
+                   << " bytes at the end of the persistent property journal";
+        truncate(JournalFilename().c_str(), offset);
+    }
+}
+
+Result<Success> ResetJournal() {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(JournalFilename().c_str(),
+                                         O_WRONLY | O_CREAT | O_NOFOLLOW | O_TRUNC | O_CLOEXEC,
+                                         0600)));
+    if (fd == -1) {
+        return ErrnoError() << "Could not open persistent property journal";
+    }
+    fsync(fd);
+    return Success();
+}
+
+// Appends one record to the journal, which was size bytes long. A failed write is cut off again
+// so that later records can still be read.
+Result<Success> AppendToJournal(int fd, off_t size, const std::string& name,
+                                const std::string& value) {
+    PersistentProperties::PersistentPropertyRecord record;
+    record.set_name(name);
+    record.set_value(value);
+    std::string serialized_record;
+    if (!record.SerializeToString(&serialized_record)) {
+        return Error() << "Unable to serialize property";
+    }
+    uint32_t record_size = serialized_record.size();
+    serialized_record.insert(0, reinterpret_cast<const char*>(&record_size), sizeof(record_size));
+
+    if (!WriteStringToFd(serialized_record, fd) || fdatasync(fd) == -1) {
+        int saved_errno = errno;
+        ftruncate(fd, size);
+        return Error(saved_errno) << "Unable to write persistent property journal";
+    }
+    return Success();
+}
+
 }  // namespace
 
 Result<PersistentProperties> LoadPersistentPropertyFile() {
     auto file_contents = ReadPersistentPropertyFile();
-    if (!file_contents) return file_contents.error();
+    if (!file_contents) {
+        unlink(JournalFilename().c_str());
+        return file_contents.error();
+    }
 
     PersistentProperties persistent_properties;
-    if (persistent_properties.ParseFromString(*file_contents)) return persistent_properties;
+    if (persistent_properties.ParseFromString(*file_contents)) {
+        ApplyJournal(&persistent_properties);
+        return persistent_properties;
+    }
 
     // If the file cannot be parsed in either format, then we don't have any recovery
     // mechanisms, so we delete it to allow for future writes to take place successfully.
+    // The journal only makes sense on top of it.
     unlink(persistent_property_filename.c_str());
+    unlink(JournalFilename().c_str());
     return Error() << "Unable to parse persistent property file: Could not parse protobuf";
 }
 
@@ -191,12 +289,29 @@ Result<Success> WritePersistentPropertyFile(const PersistentProperties& persiste
         unlink(temp_filename.c_str());
         return Error(saved_errno) << "Unable to rename persistent property file";
     }
-    return Success();
+
+    // Every record of the journal is also in the new file, so replaying the old journal on top of
+    // it after a power loss here gives the same properties.
+    return ResetJournal();
 }
 
-// Persistent properties are not written often, so we rather not keep any data in memory and read
-// then rewrite the persistent property file for each update.
+// Persistent property writes only append a record to the journal. Once the journal has grown too
+// large, the persistent property file is rewritten from the file and the journal, which then
+// already holds the new record.
 void WritePersistentProperty(const std::string& name, const std::string& value) {
+    {
+        unique_fd fd(TEMP_FAILURE_RETRY(
+            open(JournalFilename().c_str(), O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC)));
+        struct stat sb;
+        if (fd != -1 && fstat(fd, &sb) == 0) {
+            if (auto result = AppendToJournal(fd, sb.st_size, name, value); !result) {
+                LOG(ERROR) << "Rewriting persistent property file: " << result.error();
+            } else if (sb.st_size < kMaxJournalSize) {
+                return;
+            }
+        }
+    }
+
     auto persistent_properties = LoadPersistentPropertyFile();
 
     if (!persistent_properties) {
@@ -152,5 +152,55 @@ TEST(persistent_properties, UpdatePropertyBadParse) {
     EXPECT_FALSE(it == read_back_properties.properties().end());
 }
 
+TEST(persistent_properties, ManyWritesCompactJournal) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+
+    ASSERT_TRUE(WritePersistentPropertyFile(VectorToPersistentProperties({})));
+
+    // Enough writes to fold the journal into the file more than once.
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected;
+    for (int i = 0; i < 10; ++i) {
+        persistent_properties_expected.emplace_back("persist.test." + std::to_string(i), "");
+    }
+    for (int j = 0; j < 300; ++j) {
+        for (auto& [name, value] : persistent_properties_expected) {
+            value = std::string(j % 7, 'x') + std::to_string(j);
+            WritePersistentProperty(name, value);
+        }
+    }
+
+    auto read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties_expected, read_back_properties);
+    unlink((persistent_property_filename + ".journal").c_str());
+}
+
+TEST(persistent_properties, TruncatedJournal) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+    std::string journal_filename = persistent_property_filename + ".journal";
+
+    ASSERT_TRUE(WritePersistentPropertyFile(
+        VectorToPersistentProperties({{"persist.sys.locale", "en-US"}})));
+    WritePersistentProperty("persist.sys.locale", "pt-BR");
+    WritePersistentProperty("persist.sys.timezone", "America/Los_Angeles");
+
+    // Lose the end of the last record, as if the device lost power while it was written.
+    auto journal = ReadFile(journal_filename);
+    ASSERT_TRUE(journal) << journal.error();
+    ASSERT_TRUE(WriteFile(journal_filename, journal->substr(0, journal->size() - 3)));
+
+    CheckPropertiesEqual({{"persist.sys.locale", "pt-BR"}}, LoadPersistentProperties());
+
+    // Records written after the truncated one are read back.
+    WritePersistentProperty("persist.sys.timezone", "Europe/Lisbon");
+    CheckPropertiesEqual(
+        {{"persist.sys.locale", "pt-BR"}, {"persist.sys.timezone", "Europe/Lisbon"}},
+        LoadPersistentProperties());
+    unlink(journal_filename.c_str());
+}
+
 }  // namespace init
 }  // namespace android
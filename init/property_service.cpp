@@ -314,6 +314,12 @@ class SocketConnection {
         return result == sizeof(value);
     }
 
+    bool SendUint32s(const std::vector<uint32_t>& values) {
+        size_t size = values.size() * sizeof(values[0]);
+        ssize_t result = TEMP_FAILURE_RETRY(send(socket_, values.data(), size, 0));
+        return result == static_cast<ssize_t>(size);
+    }
+
     int socket() { return socket_; }
 
     const ucred& cred() { return cred_; }
@@ -554,6 +560,52 @@ static void handle_property_set_fd() {
         break;
       }
 
+    case kPropMsgSetPropBatch: {
+        // Everything is read before anything is set, and the properties are
+        // set in order, so triggers see the same sequence of changes as if
+        // they had been set one by one.
+        uint32_t count = 0;
+        if (!socket.RecvUint32(&count, &timeout_ms)) {
+            PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading the count";
+            socket.SendUint32(PROP_ERROR_READ_DATA);
+            return;
+        }
+        if (count == 0 || count > kMaxPropertyBatchSize) {
+            LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): invalid count " << count;
+            socket.SendUint32(PROP_ERROR_READ_DATA);
+            return;
+        }
+
+        std::vector<std::pair<std::string, std::string>> properties(count);
+        for (auto& [name, value] : properties) {
+            if (!socket.RecvString(&name, &timeout_ms) ||
+                !socket.RecvString(&value, &timeout_ms)) {
+                PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading name/value "
+                               "from the socket";
+                socket.SendUint32(PROP_ERROR_READ_DATA);
+                return;
+            }
+        }
+
+        const auto& cr = socket.cred();
+        std::string source_context = socket.source_context();
+        std::vector<uint32_t> results;
+        results.reserve(count + 1);
+        results.emplace_back(PROP_SUCCESS);
+        for (const auto& [name, value] : properties) {
+            std::string error;
+            uint32_t result = HandlePropertySet(name, value, source_context, cr, &error);
+            if (result != PROP_SUCCESS) {
+                LOG(ERROR) << "Unable to set property '" << name << "' to '" << value
+                           << "' from uid:" << cr.uid << " gid:" << cr.gid << " pid:" << cr.pid
+                           << ": " << error;
+            }
+            results.emplace_back(result);
+        }
+        socket.SendUint32s(results);
+        break;
+      }
+
     default:
         LOG(ERROR) << "sys_prop: invalid command " << cmd;
         socket.SendUint32(PROP_ERROR_INVALID_CMD);
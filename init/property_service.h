@@ -24,6 +24,14 @@
 namespace android {
 namespace init {
 
+// Sets up to kMaxPropertyBatchSize properties over one connection. The
+// request is the command, a count and then that many name and value strings,
+// sent the same way as in PROP_MSG_SETPROP2. The reply is PROP_SUCCESS
+// followed by one result per property, in order, or a single error if the
+// request could not be read, in which case no property is set.
+static constexpr uint32_t kPropMsgSetPropBatch = 0x00020002;
+static constexpr uint32_t kMaxPropertyBatchSize = 256;
+
 extern uint32_t (*property_set)(const std::string& name, const std::string& value);
 
 uint32_t HandlePropertySet(const std::string& name, const std::string& value,
@@ -21,18 +21,23 @@
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include <string>
+#include <vector>
+
 #include <android-base/properties.h>
 #include <gtest/gtest.h>
 
+#include "property_service.h"
+
+using android::base::GetProperty;
 using android::base::SetProperty;
 
 namespace android {
 namespace init {
 
-TEST(property_service, very_long_name_35166374) {
-  // Connect to the property service directly...
-  int fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
-  ASSERT_NE(fd, -1);
+static void ConnectToPropertyService(int* fd) {
+  *fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ASSERT_NE(*fd, -1);
 
   static const char* property_service_socket = "/dev/socket/" PROP_SERVICE_NAME;
   sockaddr_un addr = {};
@@ -40,7 +45,22 @@ TEST(property_service, very_long_name_35166374) {
   strlcpy(addr.sun_path, property_service_socket, sizeof(addr.sun_path));
 
   socklen_t addr_len = strlen(property_service_socket) + offsetof(sockaddr_un, sun_path) + 1;
-  ASSERT_NE(connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len), -1);
+  ASSERT_NE(connect(*fd, reinterpret_cast<sockaddr*>(&addr), addr_len), -1);
+}
+
+static void SendUint32(int fd, uint32_t value) {
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(value)), send(fd, &value, sizeof(value), 0));
+}
+
+static void SendString(int fd, const std::string& value) {
+  SendUint32(fd, value.size());
+  ASSERT_EQ(static_cast<ssize_t>(value.size()), send(fd, value.data(), value.size(), 0));
+}
+
+TEST(property_service, very_long_name_35166374) {
+  // Connect to the property service directly...
+  int fd;
+  ASSERT_NO_FATAL_FAILURE(ConnectToPropertyService(&fd));
 
   // ...so we can send it a malformed request.
   uint32_t msg = PROP_MSG_SETPROP2;
@@ -55,6 +75,45 @@ TEST(property_service, very_long_name_35166374) {
   ASSERT_EQ(0, close(fd));
 }
 
+TEST(property_service, set_batch) {
+  int fd;
+  ASSERT_NO_FATAL_FAILURE(ConnectToPropertyService(&fd));
+
+  ASSERT_NO_FATAL_FAILURE(SendUint32(fd, kPropMsgSetPropBatch));
+  ASSERT_NO_FATAL_FAILURE(SendUint32(fd, 3));
+  ASSERT_NO_FATAL_FAILURE(SendString(fd, "property_service_batch_test"));
+  ASSERT_NO_FATAL_FAILURE(SendString(fd, "first"));
+  ASSERT_NO_FATAL_FAILURE(SendString(fd, "property_service_batch_test"));
+  ASSERT_NO_FATAL_FAILURE(SendString(fd, "\x80"));
+  ASSERT_NO_FATAL_FAILURE(SendString(fd, "property_service_batch_test2"));
+  ASSERT_NO_FATAL_FAILURE(SendString(fd, "second"));
+
+  std::vector<uint32_t> results(4);
+  ssize_t size = results.size() * sizeof(results[0]);
+  ASSERT_EQ(size, TEMP_FAILURE_RETRY(recv(fd, results.data(), size, MSG_WAITALL)));
+  EXPECT_EQ(static_cast<uint32_t>(PROP_SUCCESS), results[0]);
+  EXPECT_EQ(static_cast<uint32_t>(PROP_SUCCESS), results[1]);
+  EXPECT_EQ(static_cast<uint32_t>(PROP_ERROR_INVALID_VALUE), results[2]);
+  EXPECT_EQ(static_cast<uint32_t>(PROP_SUCCESS), results[3]);
+  ASSERT_EQ(0, close(fd));
+
+  EXPECT_EQ("first", GetProperty("property_service_batch_test", ""));
+  EXPECT_EQ("second", GetProperty("property_service_batch_test2", ""));
+}
+
+TEST(property_service, set_batch_too_large) {
+  int fd;
+  ASSERT_NO_FATAL_FAILURE(ConnectToPropertyService(&fd));
+
+  ASSERT_NO_FATAL_FAILURE(SendUint32(fd, kPropMsgSetPropBatch));
+  ASSERT_NO_FATAL_FAILURE(SendUint32(fd, kMaxPropertyBatchSize + 1));
+  uint32_t result = 0;
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(result)),
+            TEMP_FAILURE_RETRY(recv(fd, &result, sizeof(result), MSG_WAITALL)));
+  EXPECT_EQ(static_cast<uint32_t>(PROP_ERROR_READ_DATA), result);
+  ASSERT_EQ(0, close(fd));
+}
+
 TEST(property_service, non_utf8_value) {
     ASSERT_TRUE(SetProperty("property_service_utf8_test", "base_success"));
     EXPECT_FALSE(SetProperty("property_service_utf8_test", "\x80"));
@@ -101,6 +101,8 @@ class MountEntry {
         }
     }
 
+    const std::string& mnt_dir() const { return mnt_dir_; }
+
     void DoFsck() {
         int st;
         if (IsF2Fs()) {
@@ -256,6 +258,55 @@ static void DumpUmountDebuggingInfo(bool dump_all) {
     }
 }
 
+// Returns whether |entry|, at |index| in |entries|, has to wait for another of
+// |entries| to be umounted first: one mounted under it, or over it.
+static bool DependsOnOtherMount(const std::vector<MountEntry*>& entries, size_t index) {
+    const std::string& dir = entries[index]->mnt_dir();
+    const std::string prefix = dir == "/" ? dir : dir + "/";
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i == index) continue;
+        const std::string& other = entries[i]->mnt_dir();
+        // |entries| lists the most recent mounts first.
+        if ((other == dir && i < index) || android::base::StartsWith(other, prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Umounts |block_devices| concurrently, as umounting each file system mostly waits for its own
+// device to write back. The mount points that nothing else pending is mounted under or over are
+// umounted together, then the ones that were waiting for them, and so on.
+// Returns true if all were umounted.
+static bool UmountBlockDevices(std::vector<MountEntry>* block_devices, bool force) {
+    std::vector<MountEntry*> pending;
+    for (auto& entry : *block_devices) pending.emplace_back(&entry);
+
+    bool unmount_done = true;
+    while (!pending.empty()) {
+        std::vector<MountEntry*> ready;
+        std::vector<MountEntry*> waiting;
+        for (size_t i = 0; i < pending.size(); i++) {
+            (DependsOnOtherMount(pending, i) ? waiting : ready).emplace_back(pending[i]);
+        }
+
+        std::vector<char> results(ready.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < ready.size(); i++) {
+            threads.emplace_back([&ready, &results, i, force] {
+                results[i] = ready[i]->Umount(force);
+            });
+        }
+        results[0] = ready[0]->Umount(force);
+        for (auto& thread : threads) thread.join();
+        for (char result : results) {
+            if (!result) unmount_done = false;
+        }
+        pending.swap(waiting);
+    }
+    return unmount_done;
+}
+
 static UmountStat UmountPartitions(std::chrono::milliseconds timeout) {
     Timer t;
     /* data partition needs all pending writes to be completed and all emulated partitions
@@ -280,9 +331,7 @@ static UmountStat UmountPartitions(std::chrono::milliseconds timeout) {
                 sync();
             }
         }
-        for (auto& entry : block_devices) {
-            if (!entry.Umount(timeout == 0ms)) unmount_done = false;
-        }
+        if (!UmountBlockDevices(&block_devices, timeout == 0ms)) unmount_done = false;
         if (unmount_done) {
             return UMOUNT_STAT_SUCCESS;
         }
@@ -414,7 +463,7 @@ void DoReboot(unsigned int cmd, const std::string& reason, const std::string& re
         int service_count = 0;
         // Only wait up to half of timeout here
         auto termination_wait_timeout = shutdown_timeout / 2;
-        while (t.duration() < termination_wait_timeout) {
+        while (true) {
             ReapAnyOutstandingChildren();
 
             service_count = 0;
@@ -434,12 +483,16 @@ void DoReboot(unsigned int cmd, const std::string& reason, const std::string& re
                 break;
             }
 
-            // Wait a bit before recounting the number or running services.
-            std::this_thread::sleep_for(50ms);
+            // Wait for the next service to exit before recounting the number of running
+            // services, so that the last one is noticed as soon as it exits.
+            auto remaining = termination_wait_timeout - t.duration();
+            if (remaining <= 0ms) break;
+            WaitForSigchld(remaining);
         }
         LOG(INFO) << "Terminating running services took " << t
                   << " with remaining services:" << service_count;
     }
+    auto terminate_done = t.duration();
 
     // minimum safety steps before restarting
     // 2. kill all services except ones that are necessary for the shutdown sequence.
@@ -447,6 +500,7 @@ void DoReboot(unsigned int cmd, const std::string& reason, const std::string& re
         if (!s->IsShutdownCritical()) s->Stop();
     }
     ReapAnyOutstandingChildren();
+    auto kill_done = t.duration();
 
     // 3. send volume shutdown to vold
     Service* voldService = ServiceList::GetInstance().FindService("vold");
@@ -460,12 +514,19 @@ void DoReboot(unsigned int cmd, const std::string& reason, const std::string& re
     for (const auto& s : ServiceList::GetInstance().services_in_shutdown_order()) {
         if (kill_after_apps.count(s->name())) s->Stop();
     }
+    auto vold_done = t.duration();
     // 4. sync, try umount, and optionally run fsck for user shutdown
     sync();
     UmountStat stat = TryUmountAndFsck(runFsck, shutdown_timeout - t.duration());
+    auto umount_done = t.duration();
     // Follow what linux shutdown is doing: one more sync with little bit delay
     sync();
     if (!is_thermal_shutdown) std::this_thread::sleep_for(100ms);
+    LOG(INFO) << "Shutdown phases: terminate " << terminate_done.count() << "ms, kill "
+              << (kill_done - terminate_done).count() << "ms, vold "
+              << (vold_done - kill_done).count() << "ms, umount and fsck "
+              << (umount_done - vold_done).count() << "ms, sync "
+              << (t.duration() - umount_done).count() << "ms";
     LogShutdownTime(stat, &t);
     // Reboot regardless of umount status. If umount fails, fsck after reboot will fix it.
     RebootSystem(cmd, rebootTarget);
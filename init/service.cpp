@@ -29,6 +29,8 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include <map>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
@@ -40,6 +42,7 @@
 #include <selinux/selinux.h>
 #include <system/thread_defs.h>
 
+#include "boot_trace.h"
 #include "rlimit_parser.h"
 #include "util.h"
 
@@ -66,7 +69,30 @@ using android::base::WriteStringToFile;
 namespace android {
 namespace init {
 
-static Result<std::string> ComputeContextFromExecutable(const std::string& service_path) {
+// The context computed for an executable only depends on its label and on init's own context,
+// which does not change once services can be started. An executable that is replaced or
+// relabeled gets a new ctime, so the cached context is computed again.
+struct ExecutableContext {
+    dev_t dev;
+    ino_t ino;
+    struct timespec ctime;
+    std::string context;
+};
+
+static std::map<std::string, ExecutableContext> executable_contexts;
+
+static Result<std::string> ComputeContextFromExecutable(const std::string& service_path,
+                                                        const struct stat& sb) {
+    auto cached = executable_contexts.find(service_path);
+    if (cached != executable_contexts.end()) {
+        const ExecutableContext& entry = cached->second;
+        if (entry.dev == sb.st_dev && entry.ino == sb.st_ino &&
+            entry.ctime.tv_sec == sb.st_ctim.tv_sec && entry.ctime.tv_nsec == sb.st_ctim.tv_nsec) {
+            return entry.context;
+        }
+        executable_contexts.erase(cached);
+    }
+
     std::string computed_context;
 
     char* raw_con = nullptr;
@@ -104,6 +130,8 @@ static Result<std::string> ComputeContextFromExecutable(const std::string& servi
     if (rc < 0) {
         return Error() << "Could not get process context";
     }
+    executable_contexts.emplace(
+        service_path, ExecutableContext{sb.st_dev, sb.st_ino, sb.st_ctim, computed_context});
     return computed_context;
 }
 
@@ -337,6 +365,8 @@ void Service::SetProcessAttributes() {
 }
 
 void Service::Reap(const siginfo_t& siginfo) {
+    RecordBootTraceEvent(BootTracePhase::kAsyncEnd, BootTraceCategory::kService, name_, pid_);
+
     if (!(flags_ & SVC_ONESHOT) || (flags_ & SVC_RESTART)) {
         KillProcessGroup(SIGKILL);
     }
@@ -832,7 +862,7 @@ Result<Success> Service::Start() {
     if (!seclabel_.empty()) {
         scon = seclabel_;
     } else {
-        auto result = ComputeContextFromExecutable(args_[0]);
+        auto result = ComputeContextFromExecutable(args_[0], sb);
         if (!result) {
             return result.error();
         }
@@ -948,6 +978,7 @@ Result<Success> Service::Start() {
     time_started_ = boot_clock::now();
     pid_ = pid;
     flags_ |= SVC_RUNNING;
+    RecordBootTraceEvent(BootTracePhase::kAsyncBegin, BootTraceCategory::kService, name_, pid_);
     start_order_ = next_start_order_++;
     process_cgroup_empty_ = false;
 
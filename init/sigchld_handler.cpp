@@ -16,6 +16,8 @@
 
 #include "sigchld_handler.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -120,6 +122,22 @@ void ReapAnyOutstandingChildren() {
     }
 }
 
+bool WaitForSigchld(std::chrono::milliseconds timeout) {
+    pollfd pfd = {.fd = signal_read_fd, .events = POLLIN};
+    int rc = poll(&pfd, 1, timeout.count());
+    if (rc == -1) {
+        // SIGCHLD itself interrupts poll(), as it isn't restartable.
+        if (errno == EINTR) return true;
+        PLOG(ERROR) << "poll(signal_read_fd) failed";
+        return false;
+    }
+    if (rc == 0) return false;
+
+    char buf[32];
+    read(signal_read_fd, buf, sizeof(buf));
+    return true;
+}
+
 void sigchld_handler_init() {
     // Create a signalling mechanism for SIGCHLD.
     int s[2];
@@ -17,11 +17,17 @@
 #ifndef _INIT_SIGCHLD_HANDLER_H_
 #define _INIT_SIGCHLD_HANDLER_H_
 
+#include <chrono>
+
 namespace android {
 namespace init {
 
 void ReapAnyOutstandingChildren();
 
+// Waits up to |timeout| for a child to exit, without reaping it. Returns true
+// if one may have.
+bool WaitForSigchld(std::chrono::milliseconds timeout);
+
 void sigchld_handler_init(void);
 
 }  // namespace init
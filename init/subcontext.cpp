@@ -62,7 +62,7 @@ namespace {
 constexpr size_t kBufferSize = 4096;
 
 Result<std::string> ReadMessage(int socket) {
-    char buffer[kBufferSize] = {};
+    char buffer[kBufferSize];
     auto result = TEMP_FAILURE_RETRY(recv(socket, buffer, sizeof(buffer), 0));
     if (result <= 0) {
         return ErrnoError();
@@ -195,6 +195,21 @@ void SubcontextProcess::MainLoop() {
                 ExpandArgs(subcontext_command.expand_args_command(), &reply);
                 break;
             }
+            case SubcontextCommand::kExecuteCommands: {
+                // Each reply is sent as soon as its command completes, the last one below.
+                const auto& commands = subcontext_command.execute_commands().commands();
+                for (int i = 0; i < commands.size(); ++i) {
+                    if (i > 0) {
+                        if (auto result = SendMessage(init_fd_, reply); !result) {
+                            LOG(FATAL) << "Failed to send message to init: " << result.error();
+                        }
+                        reply.Clear();
+                    }
+                    RunCommand(commands.Get(i), &reply);
+                    if (reply.properties_to_set_size() > 0) break;
+                }
+                break;
+            }
             default:
                 LOG(FATAL) << "Unknown message type from init: "
                            << subcontext_command.command_case();
@@ -277,7 +292,10 @@ Result<SubcontextReply> Subcontext::TransmitMessage(const SubcontextCommand& sub
         Restart();
         return ErrnoError() << "Failed to send message to subcontext";
     }
+    return ReceiveReply();
+}
 
+Result<SubcontextReply> Subcontext::ReceiveReply() {
     auto subcontext_message = ReadMessage(socket_);
     if (!subcontext_message) {
         Restart();
@@ -292,6 +310,29 @@ Result<SubcontextReply> Subcontext::TransmitMessage(const SubcontextCommand& sub
     return subcontext_reply;
 }
 
+Result<Success> Subcontext::HandleExecuteReply(const SubcontextReply& subcontext_reply) {
+    for (const auto& property : subcontext_reply.properties_to_set()) {
+        ucred cr = {.pid = pid_, .uid = 0, .gid = 0};
+        std::string error;
+        if (HandlePropertySet(property.name(), property.value(), context_, cr, &error) != 0) {
+            LOG(ERROR) << "Subcontext init could not set '" << property.name() << "' to '"
+                       << property.value() << "': " << error;
+        }
+    }
+
+    if (subcontext_reply.reply_case() == SubcontextReply::kFailure) {
+        auto& failure = subcontext_reply.failure();
+        return ResultError(failure.error_string(), failure.error_errno());
+    }
+
+    if (subcontext_reply.reply_case() != SubcontextReply::kSuccess) {
+        return Error() << "Unexpected message type from subcontext: "
+                       << subcontext_reply.reply_case();
+    }
+
+    return Success();
+}
+
 Result<Success> Subcontext::Execute(const std::vector<std::string>& args) {
     auto subcontext_command = SubcontextCommand();
     std::copy(
@@ -302,27 +343,49 @@ Result<Success> Subcontext::Execute(const std::vector<std::string>& args) {
     if (!subcontext_reply) {
         return subcontext_reply.error();
     }
+    return HandleExecuteReply(*subcontext_reply);
+}
+
+void Subcontext::ExecuteBatch(const std::vector<const std::vector<std::string>*>& commands,
+                              const std::function<void(const Result<Success>&)>& callback) {
+    if (commands.empty()) return;
+    if (commands.size() == 1) {
+        callback(Execute(*commands[0]));
+        return;
+    }
 
-    for (const auto& property : subcontext_reply->properties_to_set()) {
-        ucred cr = {.pid = pid_, .uid = 0, .gid = 0};
-        std::string error;
-        if (HandlePropertySet(property.name(), property.value(), context_, cr, &error) != 0) {
-            LOG(ERROR) << "Subcontext init could not set '" << property.name() << "' to '"
-                       << property.value() << "': " << error;
+    // Take the commands that fit in one message, and at least one so that a command too long to
+    // send fails the same way it does on its own.
+    auto subcontext_command = SubcontextCommand();
+    auto* execute_commands = subcontext_command.mutable_execute_commands();
+    for (const auto* args : commands) {
+        auto* execute_command = execute_commands->add_commands();
+        std::copy(args->begin(), args->end(),
+                  RepeatedPtrFieldBackInserter(execute_command->mutable_args()));
+        if (execute_commands->commands_size() > 1 &&
+            static_cast<size_t>(subcontext_command.ByteSize()) > kBufferSize) {
+            execute_commands->mutable_commands()->RemoveLast();
+            break;
         }
     }
 
-    if (subcontext_reply->reply_case() == SubcontextReply::kFailure) {
-        auto& failure = subcontext_reply->failure();
-        return ResultError(failure.error_string(), failure.error_errno());
+    if (auto result = SendMessage(socket_, subcontext_command); !result) {
+        Restart();
+        callback(ErrnoError() << "Failed to send message to subcontext");
+        return;
     }
 
-    if (subcontext_reply->reply_case() != SubcontextReply::kSuccess) {
-        return Error() << "Unexpected message type from subcontext: "
-                       << subcontext_reply->reply_case();
+    // The subcontext replies to each command in turn, and stops after one that sets properties.
+    // If it dies, the commands it didn't get to are left for the next batch.
+    for (int i = 0; i < execute_commands->commands_size(); ++i) {
+        auto subcontext_reply = ReceiveReply();
+        if (!subcontext_reply) {
+            callback(subcontext_reply.error());
+            return;
+        }
+        callback(HandleExecuteReply(*subcontext_reply));
+        if (subcontext_reply->properties_to_set_size() > 0) return;
     }
-
-    return Success();
 }
 
 Result<std::vector<std::string>> Subcontext::ExpandArgs(const std::vector<std::string>& args) {
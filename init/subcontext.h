@@ -19,6 +19,7 @@
 
 #include <signal.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -43,6 +44,12 @@ class Subcontext {
     }
 
     Result<Success> Execute(const std::vector<std::string>& args);
+    // Executes a run of commands in one round trip, calling |callback| with the result of each as
+    // the subcontext completes it. This stops short after a command that sets properties, so that
+    // they are set before the commands following it run, and after the commands that fit in one
+    // message; the number of callbacks tells how many were executed.
+    void ExecuteBatch(const std::vector<const std::vector<std::string>*>& commands,
+                      const std::function<void(const Result<Success>&)>& callback);
     Result<std::vector<std::string>> ExpandArgs(const std::vector<std::string>& args);
     void Restart();
 
@@ -53,6 +60,8 @@ class Subcontext {
   private:
     void Fork();
     Result<SubcontextReply> TransmitMessage(const SubcontextCommand& subcontext_command);
+    Result<SubcontextReply> ReceiveReply();
+    Result<Success> HandleExecuteReply(const SubcontextReply& subcontext_reply);
 
     std::string path_prefix_;
     std::string context_;
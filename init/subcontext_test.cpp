@@ -121,6 +121,46 @@ TEST(subcontext, MultipleCommands) {
     });
 }
 
+TEST(subcontext, ExecuteBatch) {
+    RunTest([](auto& subcontext, auto& context_string) {
+        auto first_pid = subcontext.pid();
+
+        auto expected_words = std::vector<std::string>{
+            "this",
+            "is",
+            "a",
+            "test",
+        };
+
+        auto commands = std::vector<std::vector<std::string>>{};
+        for (const auto& word : expected_words) {
+            commands.emplace_back(std::vector<std::string>{"add_word", word});
+        }
+        commands.emplace_back(std::vector<std::string>{"return_words_as_error"});
+        commands.emplace_back(std::vector<std::string>{"generate_sane_error"});
+
+        auto batch = std::vector<const std::vector<std::string>*>{};
+        for (const auto& command : commands) {
+            batch.emplace_back(&command);
+        }
+
+        auto results = std::vector<Result<Success>>{};
+        subcontext.ExecuteBatch(batch, [&results](const Result<Success>& result) {
+            results.emplace_back(result);
+        });
+
+        ASSERT_EQ(commands.size(), results.size());
+        for (std::size_t i = 0; i < expected_words.size(); ++i) {
+            EXPECT_TRUE(results[i]) << results[i].error();
+        }
+        ASSERT_FALSE(results[4]);
+        EXPECT_EQ(Join(expected_words, " "), results[4].error_string());
+        ASSERT_FALSE(results[5]);
+        EXPECT_EQ("Sane error!", results[5].error_string());
+        EXPECT_EQ(first_pid, subcontext.pid());
+    });
+}
+
 TEST(subcontext, RecoverAfterAbort) {
     RunTest([](auto& subcontext, auto& context_string) {
         auto first_pid = subcontext.pid();
@@ -21,9 +21,12 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/strings.h>
 #include <cutils/uevent.h>
 
 namespace android {
@@ -168,6 +171,37 @@ ListenerAction UeventListener::RegenerateUeventsForPath(const std::string& path,
     return RegenerateUeventsForDir(d.get(), callback);
 }
 
+// Block devices can also be found without the kernel's help: each has a link in /sys/class/block,
+// to a directory whose uevent file lists the same variables as the uevent it was added with.
+ListenerAction UeventListener::ReadBlockDeviceUevents(const ListenerCallback& callback) const {
+    std::unique_ptr<DIR, decltype(&closedir)> d(opendir("/sys/class/block"), closedir);
+    if (!d) return ListenerAction::kContinue;
+
+    dirent* de;
+    while ((de = readdir(d.get())) != nullptr) {
+        if (de->d_name[0] == '.') continue;
+
+        std::string path;
+        if (!android::base::Realpath(std::string("/sys/class/block/") + de->d_name, &path) ||
+            !android::base::StartsWith(path, "/sys/")) {
+            continue;
+        }
+
+        std::string variables;
+        if (!android::base::ReadFileToString(path + "/uevent", &variables)) continue;
+
+        // Lay the variables out as ParseEvent() expects them from the netlink socket.
+        auto msg = "ACTION=add\nDEVPATH=" + path.substr(4) + "\nSUBSYSTEM=block\n" + variables;
+        std::replace(msg.begin(), msg.end(), '\n', '\0');
+
+        Uevent uevent;
+        ParseEvent(msg.c_str(), &uevent);
+        if (callback(uevent) == ListenerAction::kStop) return ListenerAction::kStop;
+    }
+
+    return ListenerAction::kContinue;
+}
+
 static const char* kRegenerationPaths[] = {"/sys/class", "/sys/block", "/sys/devices"};
 
 void UeventListener::RegenerateUevents(const ListenerCallback& callback) const {
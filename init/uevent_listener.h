@@ -46,6 +46,7 @@ class UeventListener {
     void RegenerateUevents(const ListenerCallback& callback) const;
     ListenerAction RegenerateUeventsForPath(const std::string& path,
                                             const ListenerCallback& callback) const;
+    ListenerAction ReadBlockDeviceUevents(const ListenerCallback& callback) const;
     void Poll(const ListenerCallback& callback,
               const std::optional<std::chrono::milliseconds> relative_timeout = {}) const;
 
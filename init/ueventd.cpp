@@ -22,8 +22,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
+#include <atomic>
 #include <set>
 #include <thread>
 
@@ -82,10 +84,12 @@
 // 1) ueventd regenerates uevents by doing the /sys traversal and listens to the netlink socket for
 //    the generated uevents.  It writes these uevents into a queue represented by a vector.
 //
-// 2) ueventd forks 'n' separate uevent handler subprocesses and has each of them to handle the
-//    uevents in the queue based on a starting offset (their process number) and a stride (the total
-//    number of processes).  Note that no IPC happens at this point and only const functions from
-//    DeviceHandler should be called from this context.
+// 2) ueventd forks 'n' separate uevent handler subprocesses and has each of them take the next
+//    uevent to handle from the queue, through an index in shared memory, until the queue is empty.
+//    A few slow devices (for example storage with many partitions) then only hold up the
+//    subprocess that handles them instead of a fixed share of the queue.  Note that apart from this
+//    index no IPC happens at this point and only const functions from DeviceHandler should be
+//    called from this context.
 //
 // 3) In parallel to the subprocesses handling the uevents, the main thread of ueventd calls
 //    selinux_android_restorecon() recursively on /sys/class, /sys/block, and /sys/devices.
@@ -115,7 +119,7 @@ class ColdBoot {
     void Run();
 
   private:
-    void UeventHandlerMain(unsigned int process_num, unsigned int total_processes);
+    void UeventHandlerMain();
     void RegenerateUevents();
     void ForkSubProcesses();
     void DoRestoreCon();
@@ -126,12 +130,15 @@ class ColdBoot {
 
     unsigned int num_handler_subprocesses_;
     std::vector<Uevent> uevent_queue_;
+    // The index of the next uevent of uevent_queue_ to handle, shared with the subprocesses.
+    std::atomic<size_t>* next_uevent_ = nullptr;
 
     std::set<pid_t> subprocess_pids_;
 };
 
-void ColdBoot::UeventHandlerMain(unsigned int process_num, unsigned int total_processes) {
-    for (unsigned int i = process_num; i < uevent_queue_.size(); i += total_processes) {
+void ColdBoot::UeventHandlerMain() {
+    for (size_t i = next_uevent_->fetch_add(1); i < uevent_queue_.size();
+         i = next_uevent_->fetch_add(1)) {
         auto& uevent = uevent_queue_[i];
         device_handler_.HandleDeviceEvent(uevent);
     }
@@ -148,6 +155,13 @@ void ColdBoot::RegenerateUevents() {
 }
 
 void ColdBoot::ForkSubProcesses() {
+    void* next_uevent = mmap(nullptr, sizeof(*next_uevent_), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next_uevent == MAP_FAILED) {
+        PLOG(FATAL) << "mmap() failed!";
+    }
+    next_uevent_ = new (next_uevent) std::atomic<size_t>(0);
+
     for (unsigned int i = 0; i < num_handler_subprocesses_; ++i) {
         auto pid = fork();
         if (pid < 0) {
@@ -155,7 +169,7 @@ void ColdBoot::ForkSubProcesses() {
         }
 
         if (pid == 0) {
-            UeventHandlerMain(i, num_handler_subprocesses_);
+            UeventHandlerMain();
         }
 
         subprocess_pids_.emplace(pid);
@@ -198,6 +212,9 @@ void ColdBoot::WaitForSubProcesses() {
             LOG(FATAL) << "subprocess killed by signal " << WTERMSIG(status);
         }
     }
+
+    munmap(next_uevent_, sizeof(*next_uevent_));
+    next_uevent_ = nullptr;
 }
 
 void ColdBoot::Run() {
@@ -16,6 +16,7 @@
 
 #include "libappfuse/FuseBridgeLoop.h"
 
+#include <fcntl.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 
@@ -30,7 +31,12 @@ namespace android {
 namespace fuse {
 namespace {
 
-enum class FuseBridgeState { kWaitToReadEither, kWaitToReadProxy, kWaitToWriteProxy, kClosing };
+enum class FuseBridgeState { kWaitToReadEither, kWaitToWriteProxy, kClosing };
+
+// Maximum number of messages moved in each direction before waiting for epoll again. Read-ahead
+// and write-back make the kernel send several requests at once, and the proxy answers them in
+// a burst.
+constexpr size_t kMaxMessagesPerEvent = 16;
 
 struct FuseBridgeEntryEvent {
     FuseBridgeEntry* entry;
@@ -43,10 +49,6 @@ void GetObservedEvents(FuseBridgeState state, int* device_events, int* proxy_eve
             *device_events = EPOLLIN;
             *proxy_events = EPOLLIN;
             return;
-        case FuseBridgeState::kWaitToReadProxy:
-            *device_events = 0;
-            *proxy_events = EPOLLIN;
-            return;
         case FuseBridgeState::kWaitToWriteProxy:
             *device_events = 0;
             *proxy_events = EPOLLOUT;
@@ -75,7 +77,15 @@ class FuseBridgeEntry {
           last_state_(FuseBridgeState::kWaitToReadEither),
           last_device_events_({this, 0}),
           last_proxy_events_({this, 0}),
-          open_count_(0) {}
+          open_count_(0) {
+        // Reading the device until it runs out of requests needs it not to block.
+        const int flags = fcntl(device_fd_, F_GETFL);
+        device_nonblocking_ =
+            flags != -1 && fcntl(device_fd_, F_SETFL, flags | O_NONBLOCK) != -1;
+        if (!device_nonblocking_) {
+            PLOG(WARNING) << "Failed to make the device FD non-blocking";
+        }
+    }
 
     // Transfer bytes depends on availability of FDs and the internal |state_|.
     void Transfer(FuseBridgeLoopCallback* callback) {
@@ -101,21 +111,16 @@ class FuseBridgeEntry {
 
         switch (state_) {
             case FuseBridgeState::kWaitToReadEither:
-                if (proxy_read_ready) {
-                    state_ = ReadFromProxy();
-                } else if (device_read_ready) {
-                    state_ = ReadFromDevice(callback);
-                }
-                return;
-
-            case FuseBridgeState::kWaitToReadProxy:
-                CHECK(proxy_read_ready);
-                state_ = ReadFromProxy();
+                state_ = ReadFromEither(callback, proxy_read_ready, device_read_ready);
                 return;
 
             case FuseBridgeState::kWaitToWriteProxy:
                 CHECK(proxy_write_ready);
                 state_ = WriteToProxy();
+                if (state_ == FuseBridgeState::kWaitToReadEither) {
+                    // The device may have queued more requests in the meantime.
+                    state_ = ReadFromEither(callback, false, device_nonblocking_);
+                }
                 return;
 
             case FuseBridgeState::kClosing:
@@ -130,14 +135,41 @@ class FuseBridgeEntry {
   private:
     friend class BridgeEpollController;
 
-    FuseBridgeState ReadFromProxy() {
+    // Moves messages until both FDs run out of them, the proxy can't take more requests, or
+    // kMaxMessagesPerEvent is reached. Responses go first, as they are what the kernel waits for.
+    FuseBridgeState ReadFromEither(FuseBridgeLoopCallback* callback, bool proxy_read_ready,
+                                   bool device_read_ready) {
+        size_t proxy_count = 0;
+        size_t device_count = 0;
+        while (true) {
+            FuseBridgeState state;
+            if (proxy_read_ready && proxy_count < kMaxMessagesPerEvent) {
+                proxy_count++;
+                state = ReadFromProxy(&proxy_read_ready);
+            } else if (device_read_ready && device_count < kMaxMessagesPerEvent) {
+                device_count++;
+                state = ReadFromDevice(callback, &device_read_ready);
+                // Only a non-blocking device can be read until it's empty.
+                device_read_ready &= device_nonblocking_;
+            } else {
+                return FuseBridgeState::kWaitToReadEither;
+            }
+            if (state != FuseBridgeState::kWaitToReadEither) {
+                return state;
+            }
+        }
+    }
+
+    // Clears |*ready| once the proxy has no more responses.
+    FuseBridgeState ReadFromProxy(bool* ready) {
         switch (buffer_.response.ReadOrAgain(proxy_fd_)) {
             case ResultOrAgain::kSuccess:
                 break;
             case ResultOrAgain::kFailure:
                 return FuseBridgeState::kClosing;
             case ResultOrAgain::kAgain:
-                return FuseBridgeState::kWaitToReadProxy;
+                *ready = false;
+                return FuseBridgeState::kWaitToReadEither;
         }
 
         if (!buffer_.response.Write(device_fd_)) {
@@ -172,10 +204,17 @@ class FuseBridgeEntry {
         return FuseBridgeState::kWaitToReadEither;
     }
 
-    FuseBridgeState ReadFromDevice(FuseBridgeLoopCallback* callback) {
+    // Clears |*ready| once the device has no more requests.
+    FuseBridgeState ReadFromDevice(FuseBridgeLoopCallback* callback, bool* ready) {
         LOG(VERBOSE) << "ReadFromDevice";
-        if (!buffer_.request.Read(device_fd_)) {
-            return FuseBridgeState::kClosing;
+        switch (buffer_.request.ReadFileOrAgain(device_fd_)) {
+            case ResultOrAgain::kSuccess:
+                break;
+            case ResultOrAgain::kFailure:
+                return FuseBridgeState::kClosing;
+            case ResultOrAgain::kAgain:
+                *ready = false;
+                return FuseBridgeState::kWaitToReadEither;
         }
 
         const uint32_t opcode = buffer_.request.header.opcode;
@@ -253,6 +292,8 @@ class FuseBridgeEntry {
 
     int open_count_;
 
+    bool device_nonblocking_;
+
     DISALLOW_COPY_AND_ASSIGN(FuseBridgeEntry);
 };
 
@@ -170,6 +170,11 @@ ResultOrAgain FuseMessage<T>::ReadOrAgain(int fd) {
     return ReadInternal(this, fd, MSG_DONTWAIT);
 }
 
+template <typename T>
+ResultOrAgain FuseMessage<T>::ReadFileOrAgain(int fd) {
+    return ReadInternal(this, fd, 0);
+}
+
 template <typename T>
 bool FuseMessage<T>::Write(int fd) const {
     return WriteInternal(this, fd, 0, nullptr, sizeof(T)) == ResultOrAgain::kSuccess;
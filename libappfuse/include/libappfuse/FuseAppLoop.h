@@ -29,6 +29,14 @@ namespace fuse {
 
 class EpollController;
 
+// Callbacks for the requests of a FuseAppLoop, invoked on the thread running the loop.
+//
+// A callback doesn't have to reply before returning: it can hand the request over to another
+// thread, which replies later with the Reply* methods of the loop and |unique|. The loop then
+// goes on with the next request, so a slow request doesn't hold up the others, and replies can
+// be sent in any order. Each request must be replied to exactly once.
+//
+// The |data| passed to OnWrite is only valid until OnWrite returns.
 class FuseAppLoopCallback {
  public:
    virtual void OnLookup(uint64_t unique, uint64_t inode) = 0;
@@ -49,6 +57,8 @@ class FuseAppLoop final {
     void Start(FuseAppLoopCallback* callback);
     void Break();
 
+    // Sends the reply for a request. These can be called from any thread, concurrently, for as
+    // long as the loop exists.
     bool ReplySimple(uint64_t unique, int32_t result);
     bool ReplyLookup(uint64_t unique, uint64_t inode, int64_t size);
     bool ReplyGetAttr(uint64_t unique, uint64_t inode, int64_t size, int mode);
@@ -45,6 +45,8 @@ class FuseMessage {
   bool Write(int fd) const;
   bool WriteWithBody(int fd, size_t max_size, const void* data) const;
   ResultOrAgain ReadOrAgain(int fd);
+  // Same as ReadOrAgain for an FD with O_NONBLOCK set, which needn't be a socket.
+  ResultOrAgain ReadFileOrAgain(int fd);
   ResultOrAgain WriteOrAgain(int fd) const;
 };
 
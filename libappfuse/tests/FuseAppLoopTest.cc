@@ -21,6 +21,8 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 #include "libappfuse/EpollController.h"
@@ -80,6 +82,38 @@ class Callback : public FuseAppLoopCallback {
   }
 };
 
+// Replies to reads from another thread, once the test lets it.
+class DeferredReadCallback : public Callback {
+ public:
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool release_reads = false;
+  std::vector<std::thread> threads;
+
+  ~DeferredReadCallback() {
+      for (auto& thread : threads) {
+          thread.join();
+      }
+  }
+
+  void OnRead(uint64_t seq, uint64_t inode ATTRIBUTE_UNUSED, uint64_t offset ATTRIBUTE_UNUSED,
+              uint32_t size) override {
+      threads.emplace_back([this, seq, size] {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [this] { return release_reads; });
+          lock.unlock();
+          std::vector<char> data(size, static_cast<char>(seq));
+          EXPECT_TRUE(loop->ReplyRead(seq, size, data.data()));
+      });
+  }
+
+  void ReleaseReads() {
+      std::lock_guard<std::mutex> lock(mutex);
+      release_reads = true;
+      cond.notify_all();
+  }
+};
+
 class FuseAppLoopTest : public ::testing::Test {
  protected:
    std::thread thread_;
@@ -282,6 +316,45 @@ TEST_F(FuseAppLoopTest, Write) {
   CheckCallback(sizeof(fuse_write_in), FUSE_WRITE, sizeof(fuse_write_out));
 }
 
+TEST(FuseAppLoopDeferredTest, RepliesOutOfOrder) {
+  base::unique_fd sockets[2];
+  ASSERT_TRUE(SetupMessageSockets(&sockets));
+  FuseAppLoop loop(std::move(sockets[1]));
+  DeferredReadCallback callback;
+  callback.loop = &loop;
+  std::thread thread([&loop, &callback] { loop.Start(&callback); });
+
+  FuseRequest request;
+  FuseResponse response;
+  for (uint64_t unique = 1; unique <= 3; unique++) {
+    request.Reset(sizeof(fuse_read_in), FUSE_READ, unique);
+    request.header.nodeid = 10;
+    request.read_in.size = 16;
+    ASSERT_TRUE(request.Write(sockets[0]));
+  }
+
+  // The loop carries on while the reads are pending.
+  request.Reset(sizeof(fuse_getattr_in), FUSE_GETATTR, 4);
+  request.header.nodeid = 10;
+  ASSERT_TRUE(request.Write(sockets[0]));
+  ASSERT_TRUE(response.Read(sockets[0]));
+  EXPECT_EQ(4u, response.header.unique);
+
+  callback.ReleaseReads();
+  uint64_t replied = 0;
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(response.Read(sockets[0]));
+    EXPECT_EQ(kFuseSuccess, response.header.error);
+    ASSERT_EQ(sizeof(fuse_out_header) + 16, response.header.len);
+    EXPECT_EQ(static_cast<char>(response.header.unique), response.read_data[15]);
+    replied |= 1u << response.header.unique;
+  }
+  EXPECT_EQ(0xeu, replied);
+
+  loop.Break();
+  thread.join();
+}
+
 TEST_F(FuseAppLoopTest, Break) {
     // Ensure that the loop started.
     request_.Reset(sizeof(fuse_open_in), FUSE_OPEN, 1);
@@ -210,5 +210,35 @@ TEST_F(FuseBridgeLoopTest, Proxy) {
   Close();
 }
 
+TEST_F(FuseBridgeLoopTest, ProxyBurst) {
+  // More messages than the loop moves per epoll event, sent before any is answered.
+  constexpr uint64_t kCount = 40;
+  for (uint64_t unique = 1; unique <= kCount; unique++) {
+    memset(&request_, 0, sizeof(FuseRequest));
+    request_.header.opcode = FUSE_GETATTR;
+    request_.header.unique = unique;
+    request_.header.len = sizeof(fuse_in_header);
+    ASSERT_TRUE(request_.Write(dev_sockets_[0]));
+  }
+  for (uint64_t unique = 1; unique <= kCount; unique++) {
+    memset(&request_, 0, sizeof(FuseRequest));
+    ASSERT_TRUE(request_.Read(proxy_sockets_[1]));
+    EXPECT_EQ(unique, request_.header.unique);
+  }
+
+  for (uint64_t unique = 1; unique <= kCount; unique++) {
+    memset(&response_, 0, sizeof(FuseResponse));
+    response_.header.len = sizeof(fuse_out_header);
+    response_.header.unique = unique;
+    response_.header.error = kFuseSuccess;
+    ASSERT_TRUE(response_.Write(proxy_sockets_[1]));
+  }
+  for (uint64_t unique = 1; unique <= kCount; unique++) {
+    memset(&response_, 0, sizeof(FuseResponse));
+    ASSERT_TRUE(response_.Read(dev_sockets_[0]));
+    EXPECT_EQ(unique, response_.header.unique);
+  }
+}
+
 }  // namespace fuse
 }  // namespace android
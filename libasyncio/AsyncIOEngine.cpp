@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <asyncio/AsyncIOEngine.h>
+
+#include <asyncio/AsyncIO.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+namespace android {
+namespace asyncio {
+
+AsyncIOEngine::AsyncIOEngine(Backend backend, unsigned depth)
+    : backend_(backend), depth_(depth), event_fd_(-1), requests_(depth), queued_(0),
+      in_flight_(0) {
+    free_slots_.reserve(depth);
+    for (unsigned slot = depth; slot > 0; slot--) {
+        free_slots_.push_back(slot - 1);
+    }
+}
+
+AsyncIOEngine::~AsyncIOEngine() {
+    if (event_fd_ != -1) {
+        close(event_fd_);
+    }
+}
+
+bool AsyncIOEngine::PrepRead(int fd, void* buf, size_t count, int64_t offset, uint64_t data) {
+    return Queue(fd, buf, count, offset, data, true);
+}
+
+bool AsyncIOEngine::PrepWrite(int fd, const void* buf, size_t count, int64_t offset,
+                              uint64_t data) {
+    return Queue(fd, buf, count, offset, data, false);
+}
+
+bool AsyncIOEngine::Queue(int fd, const void* buf, size_t count, int64_t offset, uint64_t data,
+                          bool read) {
+    if (free_slots_.empty()) {
+        errno = EBUSY;
+        return false;
+    }
+    unsigned slot = free_slots_.back();
+    free_slots_.pop_back();
+    requests_[slot].data = data;
+    requests_[slot].vec.iov_base = const_cast<void*>(buf);
+    requests_[slot].vec.iov_len = count;
+    Prep(slot, fd, read, offset);
+    queued_++;
+    return true;
+}
+
+void AsyncIOEngine::FreeSlot(unsigned slot) {
+    free_slots_.push_back(slot);
+}
+
+void AsyncIOEngine::ClearEventFd() {
+    uint64_t value;
+    if (event_fd_ != -1 && TEMP_FAILURE_RETRY(read(event_fd_, &value, sizeof(value))) == -1) {
+        // EAGAIN: nothing completed since it was last cleared.
+    }
+}
+
+namespace {
+
+class AioEngine : public AsyncIOEngine {
+  public:
+    explicit AioEngine(unsigned depth)
+        : AsyncIOEngine(kAio, depth), ctx_(0), iocbs_(depth), events_(depth) {
+        pending_.reserve(depth);
+    }
+
+    ~AioEngine() override {
+        // Cancels, and waits for, whatever is still in flight.
+        if (ctx_ != 0) {
+            io_destroy(ctx_);
+        }
+    }
+
+    bool Init(int event_fd) {
+        event_fd_ = event_fd;
+        return io_setup(depth_, &ctx_) == 0;
+    }
+
+    // Linux AIO has nothing like registered buffers.
+    bool RegisterBuffers(const iovec*, size_t) override { return true; }
+
+    int Submit() override {
+        size_t submitted = 0;
+        while (submitted < pending_.size()) {
+            int rc = TEMP_FAILURE_RETRY(
+                io_submit(ctx_, pending_.size() - submitted, pending_.data() + submitted));
+            if (rc < 0 && errno == EAGAIN) {
+                if (submitted == 0) {
+                    return -EAGAIN;
+                }
+                break;
+            }
+            if (rc < 0) {
+                // io_submit() fails on the first bad request. Complete it with the
+                // error, as io_uring would, rather than hold up the others.
+                io_event failure = {};
+                failure.data = pending_[submitted]->aio_data;
+                failure.res = -errno;
+                failed_.push_back(failure);
+                rc = 1;
+            }
+            submitted += rc;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + submitted);
+        if (!failed_.empty() && event_fd_ != -1) {
+            eventfd_write(event_fd_, 1);
+        }
+        queued_ -= submitted;
+        in_flight_ += submitted;
+        return submitted;
+    }
+
+    int Reap(Completion* completions, size_t min_count, size_t max_count,
+             const timespec* timeout) override {
+        ClearEventFd();
+        size_t n = 0;
+        for (; n < max_count && !failed_.empty(); n++) {
+            Complete(&completions[n], failed_.back());
+            failed_.pop_back();
+        }
+        if (n < max_count) {
+            timespec remaining;
+            if (timeout != nullptr) {
+                remaining = *timeout;
+            }
+            int rc = TEMP_FAILURE_RETRY(io_getevents(
+                ctx_, n < min_count ? min_count - n : 0, std::min(max_count - n, events_.size()),
+                events_.data(), timeout != nullptr ? &remaining : nullptr));
+            if (rc < 0) {
+                return n > 0 ? static_cast<int>(n) : -errno;
+            }
+            for (int i = 0; i < rc; i++, n++) {
+                Complete(&completions[n], events_[i]);
+            }
+        }
+        return n;
+    }
+
+  protected:
+    void Prep(unsigned slot, int fd, bool read, int64_t offset) override {
+        iocb* cb = &iocbs_[slot];
+        io_prep(cb, fd, requests_[slot].vec.iov_base, requests_[slot].vec.iov_len, offset, read);
+        cb->aio_data = slot;
+        if (event_fd_ != -1) {
+            cb->aio_flags = IOCB_FLAG_RESFD;
+            cb->aio_resfd = event_fd_;
+        }
+        pending_.push_back(cb);
+    }
+
+  private:
+    void Complete(Completion* completion, const io_event& event) {
+        unsigned slot = event.data;
+        completion->data = requests_[slot].data;
+        completion->result = event.res;
+        FreeSlot(slot);
+        in_flight_--;
+    }
+
+    aio_context_t ctx_;
+    std::vector<iocb> iocbs_;
+    std::vector<iocb*> pending_;
+    std::vector<io_event> events_;
+    // Requests that io_submit() refused, completed by the next Reap().
+    std::vector<io_event> failed_;
+};
+
+#if defined(HAVE_IO_URING)
+
+class IoUringEngine : public AsyncIOEngine {
+  public:
+    explicit IoUringEngine(unsigned depth)
+        : AsyncIOEngine(kIoUring, depth), ring_fd_(-1), sq_ring_(MAP_FAILED),
+          cq_ring_(MAP_FAILED), sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)), sq_ring_size_(0),
+          cq_ring_size_(0), sqes_size_(0), sq_tail_(0) {}
+
+    ~IoUringEngine() override {
+        // Unlike io_destroy(), closing the ring doesn't wait for what's in flight.
+        Completion completion;
+        while (in_flight_ > 0 && Reap(&completion, 1, 1, nullptr) >= 0) {
+        }
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (ring_fd_ != -1) {
+            close(ring_fd_);
+        }
+    }
+
+    bool Init(int event_fd) {
+        io_uring_params params = {};
+        ring_fd_ = syscall(__NR_io_uring_setup, depth_, &params);
+        if (ring_fd_ == -1) {
+            return false;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            return false;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                return false;
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                                IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_tail_ptr_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        sq_tail_ = *sq_tail_ptr_;
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ptr_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        cq_tail_ptr_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        if (event_fd != -1) {
+            event_fd_ = event_fd;
+            if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_,
+                        1) == -1) {
+                // Left for the caller to close.
+                event_fd_ = -1;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool RegisterBuffers(const iovec* buffers, size_t count) override {
+        if (queued_ > 0 || in_flight_ > 0) {
+            errno = EBUSY;
+            return false;
+        }
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, buffers,
+                    count) == -1) {
+            return false;
+        }
+        buffers_.assign(buffers, buffers + count);
+        return true;
+    }
+
+    int Submit() override {
+        if (queued_ == 0) {
+            return 0;
+        }
+        __atomic_store_n(sq_tail_ptr_, sq_tail_, __ATOMIC_RELEASE);
+        int rc = TEMP_FAILURE_RETRY(syscall(__NR_io_uring_enter, ring_fd_, queued_, 0, 0,
+                                            nullptr, 0));
+        if (rc < 0) {
+            return -errno;
+        }
+        queued_ -= rc;
+        in_flight_ += rc;
+        return rc;
+    }
+
+    int Reap(Completion* completions, size_t min_count, size_t max_count,
+             const timespec* timeout) override {
+        ClearEventFd();
+        size_t n = 0;
+        while (true) {
+            uint32_t head = *cq_head_ptr_;
+            uint32_t tail = __atomic_load_n(cq_tail_ptr_, __ATOMIC_ACQUIRE);
+            for (; head != tail && n < max_count; head++, n++) {
+                const io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+                unsigned slot = cqe->user_data;
+                completions[n].data = requests_[slot].data;
+                completions[n].result = cqe->res;
+                FreeSlot(slot);
+                in_flight_--;
+            }
+            __atomic_store_n(cq_head_ptr_, head, __ATOMIC_RELEASE);
+            if (n >= min_count || n >= max_count) {
+                return n;
+            }
+
+            int rc;
+            if (timeout != nullptr) {
+                // io_uring_enter() only takes a timeout on recent kernels.
+                pollfd pfd = {.fd = ring_fd_, .events = POLLIN, .revents = 0};
+                rc = TEMP_FAILURE_RETRY(ppoll(&pfd, 1, timeout, nullptr));
+                if (rc == 0) {
+                    return n;
+                }
+            } else {
+                rc = TEMP_FAILURE_RETRY(syscall(__NR_io_uring_enter, ring_fd_, 0,
+                                                min_count - n, IORING_ENTER_GETEVENTS,
+                                                nullptr, 0));
+            }
+            if (rc < 0) {
+                return n > 0 ? static_cast<int>(n) : -errno;
+            }
+        }
+    }
+
+  protected:
+    void Prep(unsigned slot, int fd, bool read, int64_t offset) override {
+        io_uring_sqe* sqe = &sqes_[sq_tail_ & sq_mask_];
+        memset(sqe, 0, sizeof(*sqe));
+        const iovec& vec = requests_[slot].vec;
+        size_t index = FindBuffer(vec);
+        if (index < buffers_.size()) {
+            sqe->opcode = read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            sqe->addr = reinterpret_cast<uint64_t>(vec.iov_base);
+            sqe->len = vec.iov_len;
+            sqe->buf_index = index;
+        } else {
+            // IORING_OP_READ and IORING_OP_WRITE are more recent.
+            sqe->opcode = read ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr = reinterpret_cast<uint64_t>(&vec);
+            sqe->len = 1;
+        }
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->user_data = slot;
+        sq_array_[sq_tail_ & sq_mask_] = sq_tail_ & sq_mask_;
+        sq_tail_++;
+    }
+
+  private:
+    // Returns the index of the registered buffer holding |vec|, or buffers_.size().
+    size_t FindBuffer(const iovec& vec) const {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(vec.iov_base);
+        for (size_t i = 0; i < buffers_.size(); i++) {
+            uintptr_t buffer = reinterpret_cast<uintptr_t>(buffers_[i].iov_base);
+            if (begin >= buffer && begin - buffer + vec.iov_len <= buffers_[i].iov_len) {
+                return i;
+            }
+        }
+        return buffers_.size();
+    }
+
+    int ring_fd_;
+    void* sq_ring_;
+    void* cq_ring_;
+    io_uring_sqe* sqes_;
+    size_t sq_ring_size_;
+    size_t cq_ring_size_;
+    size_t sqes_size_;
+
+    uint32_t* sq_tail_ptr_;
+    uint32_t* sq_array_;
+    uint32_t sq_mask_;
+    // Tail of the requests queued so far, published by Submit().
+    uint32_t sq_tail_;
+    uint32_t* cq_head_ptr_;
+    uint32_t* cq_tail_ptr_;
+    uint32_t cq_mask_;
+    io_uring_cqe* cqes_;
+
+    std::vector<iovec> buffers_;
+};
+
+#endif  // HAVE_IO_URING
+
+}  // namespace
+
+std::unique_ptr<AsyncIOEngine> AsyncIOEngine::Create(unsigned depth, int flags) {
+    if (depth == 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    int event_fd = -1;
+    if (flags & kEventFd) {
+        event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd == -1) {
+            return nullptr;
+        }
+    }
+
+#if defined(HAVE_IO_URING)
+    if (flags & kTryIoUring) {
+        std::unique_ptr<IoUringEngine> engine(new IoUringEngine(depth));
+        if (engine->Init(event_fd)) {
+            return engine;
+        }
+        // Too old a kernel, or io_uring is disabled: fall back to Linux AIO.
+    }
+#endif
+
+    std::unique_ptr<AioEngine> engine(new AioEngine(depth));
+    if (!engine->Init(event_fd)) {
+        int saved_errno = errno;
+        engine.reset();
+        errno = saved_errno;
+        return nullptr;
+    }
+    return engine;
+}
+
+}  // namespace asyncio
+}  // namespace android
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ASYNCIO_ENGINE_H
+#define _ASYNCIO_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace asyncio {
+
+/**
+ * Queue of reads and writes, submitted in batches and completed asynchronously,
+ * on top of either io_uring or Linux AIO.
+ *
+ * Requests are queued by PrepRead() and PrepWrite(), and handed to the kernel
+ * together by Submit(). Their results are collected by Reap(), in the order
+ * they complete, along with the |data| they were queued with. At most |depth|
+ * requests can be queued or in flight at once.
+ *
+ * An engine must only be used by one thread at a time. Destroying it waits for
+ * the requests in flight, so their buffers must outlive it.
+ */
+class AsyncIOEngine {
+  public:
+    enum Backend {
+        kAio,
+        kIoUring,
+    };
+
+    enum {
+        // Signal event_fd() when requests complete.
+        kEventFd = 1 << 0,
+        // Use io_uring if the kernel has it. This is opt-in, as a seccomp filter
+        // that doesn't know of io_uring kills the process rather than failing the
+        // call. Linux AIO is used otherwise.
+        kTryIoUring = 1 << 1,
+    };
+
+    struct Completion {
+        uint64_t data;
+        // Number of bytes transferred, or -errno.
+        int64_t result;
+    };
+
+    // Returns nullptr, with errno set, on failure.
+    static std::unique_ptr<AsyncIOEngine> Create(unsigned depth, int flags = 0);
+    virtual ~AsyncIOEngine();
+
+    Backend backend() const { return backend_; }
+    unsigned depth() const { return depth_; }
+
+    // With kEventFd, an eventfd that becomes readable when requests complete,
+    // for epoll loops. Reap() clears it, so that once Reap() returns fewer
+    // completions than asked for, the next completion signals it again.
+    // -1 otherwise.
+    int event_fd() const { return event_fd_; }
+
+    // Registers buffers that requests then use without the kernel having to map
+    // them each time, where the backend supports it. Must be called before any
+    // request is queued. Requests whose buffer is within a registered one use it
+    // automatically. Returns false, with errno set, on failure.
+    virtual bool RegisterBuffers(const iovec* buffers, size_t count) = 0;
+
+    // Queue a request, returning false if |depth| requests are already queued
+    // or in flight.
+    bool PrepRead(int fd, void* buf, size_t count, int64_t offset, uint64_t data);
+    bool PrepWrite(int fd, const void* buf, size_t count, int64_t offset, uint64_t data);
+
+    // Submits the queued requests. Returns the number submitted, or -errno if
+    // none were. Those that weren't stay queued.
+    virtual int Submit() = 0;
+
+    // Waits until at least |min_count| requests completed, or until |timeout|
+    // if it is not null, and returns up to |max_count| of them in |completions|.
+    // Returns their number, or -errno.
+    virtual int Reap(Completion* completions, size_t min_count, size_t max_count,
+                     const timespec* timeout) = 0;
+
+    // Number of requests queued but not submitted, and submitted but not reaped.
+    size_t queued() const { return queued_; }
+    size_t in_flight() const { return in_flight_; }
+
+  protected:
+    struct Request {
+        uint64_t data;
+        // Vector of the request for the backends that need one.
+        iovec vec;
+    };
+
+    AsyncIOEngine(Backend backend, unsigned depth);
+
+    // Queues the request in |slot|.
+    virtual void Prep(unsigned slot, int fd, bool read, int64_t offset) = 0;
+
+    // Returns the request in |slot| to the free list.
+    void FreeSlot(unsigned slot);
+    void ClearEventFd();
+
+    const Backend backend_;
+    const unsigned depth_;
+    int event_fd_;
+    std::vector<Request> requests_;
+    std::vector<unsigned> free_slots_;
+    size_t queued_;
+    size_t in_flight_;
+
+  private:
+    bool Queue(int fd, const void* buf, size_t count, int64_t offset, uint64_t data, bool read);
+
+    AsyncIOEngine(const AsyncIOEngine&) = delete;
+    AsyncIOEngine& operator=(const AsyncIOEngine&) = delete;
+};
+
+}  // namespace asyncio
+}  // namespace android
+
+#endif  // _ASYNCIO_ENGINE_H
@@ -31,6 +31,7 @@
 
 #include "BacktraceLog.h"
 #include "UnwindStack.h"
+#include "UnwindStackMap.h"
 #include "thread_utils.h"
 
 using android::base::StringPrintf;
@@ -40,6 +41,10 @@ using android::base::StringPrintf;
 //-------------------------------------------------------------------------
 Backtrace::Backtrace(pid_t pid, pid_t tid, BacktraceMap* map)
     : pid_(pid), tid_(tid), map_(map), map_shared_(true) {
+  if (map_ == nullptr && pid == getpid()) {
+    shared_local_map_ = UnwindStackMap::GetSharedLocal();
+    map_ = shared_local_map_.get();
+  }
   if (map_ == nullptr) {
     map_ = BacktraceMap::Create(pid);
     map_shared_ = false;
@@ -18,7 +18,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <string>
@@ -30,6 +32,9 @@
 #include <backtrace/Backtrace.h>
 #include <demangle.h>
 #include <unwindstack/Elf.h>
+#include <unwindstack/MachineArm64.h>
+#include <unwindstack/MachineX86.h>
+#include <unwindstack/MachineX86_64.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
@@ -144,6 +149,164 @@ bool Backtrace::UnwindOffline(unwindstack::Regs* regs, BacktraceMap* back_map,
   return Backtrace::Unwind(regs, back_map, frames, 0U, nullptr, error);
 }
 
+// Returns the register that holds the frame pointer, or -1 if the frame
+// records of this architecture can't be followed.
+static int FramePointerRegister(unwindstack::ArchEnum arch) {
+  switch (arch) {
+    case unwindstack::ARCH_ARM64:
+      return unwindstack::ARM64_REG_R29;
+    case unwindstack::ARCH_X86:
+      return unwindstack::X86_REG_EBP;
+    case unwindstack::ARCH_X86_64:
+      return unwindstack::X86_64_REG_RBP;
+    default:
+      // arm and thumb code do not agree on the frame pointer register, nor
+      // on the layout of the record.
+      return -1;
+  }
+}
+
+// Steps to the caller using the frame record the frame pointer points at:
+// the caller's frame pointer followed by the return address. Nothing is
+// changed if the record does not look valid.
+template <typename AddressType>
+static bool StepFramePointer(unwindstack::Regs* regs, int fp_reg, unwindstack::Maps* maps,
+                             unwindstack::Memory* process_memory) {
+  AddressType* raw_regs = reinterpret_cast<AddressType*>(regs->RawData());
+  uint64_t fp = raw_regs[fp_reg];
+  uint64_t sp = regs->sp();
+  if (fp % sizeof(AddressType) != 0 || fp < sp) {
+    return false;
+  }
+
+  // The record must be on the same stack as sp, so a frame pointer register
+  // used for something else is not followed into the rest of the process.
+  unwindstack::MapInfo* stack_info = maps->Find(sp);
+  if (stack_info == nullptr || (stack_info->flags & (PROT_EXEC | PROT_DEVICE_MAP)) ||
+      fp + 2 * sizeof(AddressType) > stack_info->end) {
+    return false;
+  }
+  AddressType record[2];
+  if (!process_memory->ReadFully(fp, record, sizeof(record))) {
+    return false;
+  }
+
+  // The stack grows down, so the caller's record is above this one, unless
+  // this is the last record.
+  if (record[0] != 0 && record[0] <= fp) {
+    return false;
+  }
+  unwindstack::MapInfo* map_info = maps->Find(record[1]);
+  if (map_info == nullptr || !(map_info->flags & PROT_EXEC) ||
+      (map_info->flags & PROT_DEVICE_MAP)) {
+    return false;
+  }
+
+  // This is the cfa of an x86 frame. On arm64 the record can be below the
+  // cfa, which only matters if the unwind information is used for a caller.
+  raw_regs[fp_reg] = record[0];
+  regs->set_sp(fp + 2 * sizeof(AddressType));
+  regs->set_pc(record[1]);
+  return true;
+}
+
+// Like Backtrace::Unwind, but every frame past the first is stepped using its
+// frame record when it has a valid one, and using the unwind information
+// when it does not. The function names are cached in the map.
+static bool UnwindFramePointers(unwindstack::Regs* regs, UnwindStackMap* stack_map,
+                                std::vector<backtrace_frame_data_t>* frames,
+                                size_t num_ignore_frames,
+                                const std::vector<std::string>& skip_names,
+                                BacktraceUnwindError* error) {
+  int fp_reg = FramePointerRegister(regs->Arch());
+  unwindstack::Maps* maps = stack_map->stack_maps();
+  unwindstack::Memory* process_memory = stack_map->process_memory().get();
+  size_t max_frames = MAX_BACKTRACE_FRAMES + num_ignore_frames;
+
+  frames->clear();
+  error->error_code = BACKTRACE_UNWIND_NO_ERROR;
+  bool skipping = !skip_names.empty();
+  size_t num_frames = 0;
+  for (bool adjust_pc = false;; adjust_pc = true) {
+    if (num_frames == max_frames) {
+      error->error_code = BACKTRACE_UNWIND_ERROR_EXCEED_MAX_FRAMES_LIMIT;
+      break;
+    }
+    uint64_t cur_pc = regs->pc();
+    uint64_t cur_sp = regs->sp();
+
+    unwindstack::MapInfo* map_info = maps->Find(cur_pc);
+    unwindstack::Elf* elf = nullptr;
+    uint64_t rel_pc = cur_pc;
+    uint64_t pc_adjustment = 0;
+    if (map_info != nullptr) {
+      elf = map_info->GetElf(stack_map->process_memory(), true);
+      rel_pc = elf->GetRelPc(cur_pc, map_info);
+      if (adjust_pc) {
+        pc_adjustment = regs->GetPcAdjustment(rel_pc, elf);
+      }
+    } else {
+      error->error_code = BACKTRACE_UNWIND_ERROR_MAP_MISSING;
+    }
+
+    if (map_info == nullptr || !skipping ||
+        std::find(skip_names.begin(), skip_names.end(), basename(map_info->name.c_str())) ==
+            skip_names.end()) {
+      skipping = false;
+      if (num_frames++ >= num_ignore_frames) {
+        frames->resize(frames->size() + 1);
+        backtrace_frame_data_t* frame = &frames->back();
+        frame->num = frames->size() - 1;
+        frame->rel_pc = rel_pc - pc_adjustment;
+        frame->pc = cur_pc - pc_adjustment;
+        frame->sp = cur_sp;
+        if (map_info != nullptr) {
+          frame->map.name = map_info->name;
+          frame->map.start = map_info->start;
+          frame->map.end = map_info->end;
+          frame->map.offset = map_info->offset;
+          frame->map.load_bias = elf->GetLoadBias();
+          frame->map.flags = map_info->flags;
+          if (stack_map->ResolveNames()) {
+            frame->func_name = stack_map->GetCachedFunctionName(frame->pc, &frame->func_offset);
+          }
+        }
+      }
+    }
+    if (map_info == nullptr || (map_info->flags & PROT_DEVICE_MAP)) {
+      break;
+    }
+
+    // The first frame may not have pushed its record yet, or be a leaf
+    // function that never does, and a signal frame has no record.
+    bool stepped = false;
+    bool finished = false;
+    if (adjust_pc && !(elf->valid() && regs->StepIfSignalHandler(rel_pc, elf, process_memory))) {
+      if (regs->Is32Bit()) {
+        stepped = StepFramePointer<uint32_t>(regs, fp_reg, maps, process_memory);
+      } else {
+        stepped = StepFramePointer<uint64_t>(regs, fp_reg, maps, process_memory);
+      }
+      finished = stepped && regs->pc() == 0;
+    }
+    if (!stepped) {
+      stepped = elf->Step(rel_pc, rel_pc - pc_adjustment, regs, process_memory, &finished);
+    }
+    if (!stepped) {
+      error->error_code = BACKTRACE_UNWIND_ERROR_UNWIND_INFO;
+      break;
+    }
+    if (finished || regs->pc() == 0) {
+      break;
+    }
+    if (cur_pc == regs->pc() && cur_sp == regs->sp()) {
+      error->error_code = BACKTRACE_UNWIND_ERROR_REPEATED_FRAME;
+      break;
+    }
+  }
+  return true;
+}
+
 UnwindStackCurrent::UnwindStackCurrent(pid_t pid, pid_t tid, BacktraceMap* map)
     : BacktraceCurrent(pid, tid, map) {}
 
@@ -166,6 +329,10 @@ bool UnwindStackCurrent::UnwindFromContext(size_t num_ignore_frames, void* ucont
   if (!skip_frames_) {
     skip_names.clear();
   }
+  if (use_frame_pointers_ && FramePointerRegister(regs->Arch()) != -1) {
+    return UnwindFramePointers(regs.get(), static_cast<UnwindStackMap*>(GetMap()), &frames_,
+                               num_ignore_frames, skip_names, &error_);
+  }
   return Backtrace::Unwind(regs.get(), GetMap(), &frames_, num_ignore_frames, &skip_names, &error_);
 }
 
@@ -184,6 +351,8 @@ bool UnwindStackPtrace::Unwind(size_t num_ignore_frames, void* context) {
     regs.reset(unwindstack::Regs::CreateFromUcontext(unwindstack::Regs::CurrentArch(), context));
   }
 
+  // The thread may have run since the last unwind, don't trust cached pages.
+  static_cast<UnwindStackMap*>(GetMap())->process_memory()->Clear();
   return Backtrace::Unwind(regs.get(), GetMap(), &frames_, num_ignore_frames, nullptr, &error_);
 }
 
@@ -18,10 +18,15 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include <android-base/file.h>
 #include <backtrace/BacktraceMap.h>
+#include <demangle.h>
 #include <unwindstack/Elf.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
@@ -34,13 +39,17 @@ UnwindStackMap::UnwindStackMap(pid_t pid) : BacktraceMap(pid) {}
 bool UnwindStackMap::Build() {
   if (pid_ == 0) {
     pid_ = getpid();
-    stack_maps_.reset(new unwindstack::LocalMaps);
-  } else {
-    stack_maps_.reset(new unwindstack::RemoteMaps(pid_));
+    return Build(new unwindstack::LocalMaps, nullptr);
   }
+  return Build(new unwindstack::RemoteMaps(pid_), nullptr);
+}
+
+bool UnwindStackMap::Build(unwindstack::Maps* maps, UnwindStackMap* previous) {
+  stack_maps_.reset(maps);
 
-  // Create the process memory object.
-  process_memory_ = unwindstack::Memory::CreateProcessMemory(pid_);
+  // Create the process memory object. Remote reads are cached page by page,
+  // the cache is dropped at the start of every unwind.
+  process_memory_ = unwindstack::Memory::CreateProcessMemoryCached(pid_);
 
   // Create a JitDebug object for getting jit unwind information.
   std::vector<std::string> search_libs_{"libart.so", "libartd.so"};
@@ -53,6 +62,26 @@ bool UnwindStackMap::Build() {
     return false;
   }
 
+  if (previous != nullptr) {
+    // Both sets of maps are sorted by address.
+    auto old_it = previous->stack_maps_->begin();
+    auto old_end = previous->stack_maps_->end();
+    for (auto* map_info : *stack_maps_) {
+      while (old_it != old_end && (*old_it)->start < map_info->start) {
+        ++old_it;
+      }
+      if (old_it == old_end) {
+        break;
+      }
+      unwindstack::MapInfo* old_info = *old_it;
+      if (old_info->start == map_info->start && old_info->end == map_info->end &&
+          old_info->offset == map_info->offset && old_info->flags == map_info->flags &&
+          old_info->name == map_info->name) {
+        map_info->ShareElf(old_info);
+      }
+    }
+  }
+
   // Iterate through the maps and fill in the backtrace_map_t structure.
   for (auto* map_info : *stack_maps_) {
     backtrace_map_t map;
@@ -117,10 +146,62 @@ std::string UnwindStackMap::GetFunctionName(uint64_t pc, uint64_t* offset) {
   return name;
 }
 
+// Bounds the memory used by the cache, it is simply emptied when full.
+static constexpr size_t kMaxCachedFunctionNames = 4096;
+
+std::string UnwindStackMap::GetCachedFunctionName(uint64_t pc, uint64_t* offset) {
+  {
+    std::lock_guard<std::mutex> guard(function_names_lock_);
+    auto entry = function_names_.find(pc);
+    if (entry != function_names_.end()) {
+      *offset = entry->second.second;
+      return entry->second.first;
+    }
+  }
+
+  // Look the name up without the lock, two threads that miss at the same
+  // time find the same name.
+  std::string name = demangle(GetFunctionName(pc, offset).c_str());
+
+  std::lock_guard<std::mutex> guard(function_names_lock_);
+  if (function_names_.size() >= kMaxCachedFunctionNames) {
+    function_names_.clear();
+  }
+  function_names_.emplace(pc, std::make_pair(name, *offset));
+  return name;
+}
+
 std::shared_ptr<unwindstack::Memory> UnwindStackMap::GetProcessMemory() {
   return process_memory_;
 }
 
+static std::mutex g_shared_local_lock;
+static std::shared_ptr<UnwindStackMap> g_shared_local_map;
+static std::string g_shared_local_maps_data;
+
+std::shared_ptr<BacktraceMap> UnwindStackMap::GetSharedLocal() {
+  // Reading the maps is cheap next to parsing them and creating the Elf
+  // objects, which is what is saved when nothing changed.
+  std::string maps_data;
+  if (!android::base::ReadFileToString("/proc/self/maps", &maps_data)) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(g_shared_local_lock);
+  if (g_shared_local_map != nullptr && maps_data == g_shared_local_maps_data) {
+    return g_shared_local_map;
+  }
+
+  // The buffer is only used while parsing.
+  std::shared_ptr<UnwindStackMap> map(new UnwindStackMap(getpid()));
+  if (!map->Build(new unwindstack::BufferMaps(maps_data.c_str()), g_shared_local_map.get())) {
+    return nullptr;
+  }
+  g_shared_local_map = map;
+  g_shared_local_maps_data = std::move(maps_data);
+  return map;
+}
+
 UnwindStackOfflineMap::UnwindStackOfflineMap(pid_t pid) : UnwindStackMap(pid) {}
 
 bool UnwindStackOfflineMap::Build() {
@@ -22,7 +22,9 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <backtrace/Backtrace.h>
@@ -45,9 +47,20 @@ class UnwindStackMap : public BacktraceMap {
 
   void FillIn(uint64_t addr, backtrace_map_t* map) override;
 
+  // Returns the map of the current process shared by every Backtrace that
+  // is created without one. It is reused as long as /proc/self/maps reads the
+  // same, and when it changes the new map keeps the Elf objects of all the
+  // mappings that did not. Returns nullptr if the maps can't be read.
+  static std::shared_ptr<BacktraceMap> GetSharedLocal();
+
   virtual std::string GetFunctionName(uint64_t pc, uint64_t* offset) override;
   virtual std::shared_ptr<unwindstack::Memory> GetProcessMemory() override final;
 
+  // Like GetFunctionName, but the name is demangled and remembered for the
+  // pc, so that unwinds that keep going through the same call sites only
+  // look each one up once. Can be called from several threads.
+  std::string GetCachedFunctionName(uint64_t pc, uint64_t* offset);
+
   unwindstack::Maps* stack_maps() { return stack_maps_.get(); }
 
   const std::shared_ptr<unwindstack::Memory>& process_memory() { return process_memory_; }
@@ -61,12 +74,19 @@ class UnwindStackMap : public BacktraceMap {
  protected:
   uint64_t GetLoadBias(size_t index) override;
 
+  // Takes ownership of maps. If previous is not null, the maps that are the
+  // same in both share their Elf objects.
+  bool Build(unwindstack::Maps* maps, UnwindStackMap* previous);
+
   std::unique_ptr<unwindstack::Maps> stack_maps_;
   std::shared_ptr<unwindstack::Memory> process_memory_;
   std::unique_ptr<unwindstack::JitDebug> jit_debug_;
 #if !defined(NO_LIBDEXFILE_SUPPORT)
   std::unique_ptr<unwindstack::DexFiles> dex_files_;
 #endif
+
+  std::mutex function_names_lock_;
+  std::unordered_map<uint64_t, std::pair<std::string, uint64_t>> function_names_;
 };
 
 class UnwindStackOfflineMap : public UnwindStackMap {
@@ -306,6 +306,31 @@ TEST(libbacktrace, local_trace) {
   ASSERT_NE(test_level_one(1, 2, 3, 4, VerifyLevelBacktrace, nullptr), 0);
 }
 
+static void VerifyLevelFramePointers(void*) {
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
+  ASSERT_TRUE(backtrace.get() != nullptr);
+  backtrace->SetUseFramePointers(true);
+  ASSERT_TRUE(backtrace->Unwind(0));
+  VERIFY_NO_ERROR(backtrace->GetError().error_code);
+  VerifyLevelDump(backtrace.get());
+
+  // The second unwind gets its names from the cache.
+  std::vector<backtrace_frame_data_t> frames(backtrace->begin(), backtrace->end());
+  ASSERT_TRUE(backtrace->Unwind(0));
+  VerifyLevelDump(backtrace.get());
+  for (size_t i = 0; i < frames.size() && i < backtrace->NumFrames(); i++) {
+    if (frames[i].pc == backtrace->GetFrame(i)->pc) {
+      ASSERT_EQ(frames[i].func_name, backtrace->GetFrame(i)->func_name);
+      ASSERT_EQ(frames[i].func_offset, backtrace->GetFrame(i)->func_offset);
+    }
+  }
+}
+
+TEST(libbacktrace, local_trace_frame_pointers) {
+  ASSERT_NE(test_level_one(1, 2, 3, 4, VerifyLevelFramePointers, nullptr), 0);
+}
+
 static void VerifyIgnoreFrames(Backtrace* bt_all, Backtrace* bt_ign1, Backtrace* bt_ign2,
                                const char* cur_proc) {
   ASSERT_EQ(bt_all->NumFrames(), bt_ign1->NumFrames() + 1) << "All backtrace:\n"
@@ -1471,6 +1496,42 @@ TEST(libbacktrace, unwind_thread_doesnt_exist) {
   ASSERT_EQ(BACKTRACE_UNWIND_ERROR_THREAD_DOESNT_EXIST, backtrace->GetError().error_code);
 }
 
+TEST(libbacktrace, local_shared_map) {
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
+  ASSERT_TRUE(backtrace.get() != nullptr);
+
+  // Objects created one after the other share their map, unless something
+  // happened to be mapped in between.
+  bool shared = false;
+  for (size_t i = 0; i < 10 && !shared; i++) {
+    std::unique_ptr<Backtrace> next(
+        Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
+    ASSERT_TRUE(next.get() != nullptr);
+    shared = next->GetMap() == backtrace->GetMap();
+    backtrace = std::move(next);
+  }
+  ASSERT_TRUE(shared);
+
+  // A new mapping is seen by the next object, the old one keeps working.
+  size_t page_size = getpagesize();
+  void* new_map = mmap(nullptr, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, new_map);
+  uint64_t addr = reinterpret_cast<uint64_t>(new_map);
+  std::unique_ptr<Backtrace> after(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
+  ASSERT_TRUE(after.get() != nullptr);
+  ASSERT_NE(backtrace->GetMap(), after->GetMap());
+  backtrace_map_t map;
+  after->FillInMap(addr, &map);
+  EXPECT_LE(map.start, addr);
+  EXPECT_GT(map.end, addr);
+
+  ASSERT_TRUE(backtrace->Unwind(0));
+  ASSERT_TRUE(after->Unwind(0));
+  ASSERT_EQ(0, munmap(new_map, page_size));
+}
+
 TEST(libbacktrace, local_get_function_name_before_unwind) {
   std::unique_ptr<Backtrace> backtrace(
       Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -120,7 +121,10 @@ class Backtrace {
   // If pid >= 0 and tid < 0, then the Backtrace object corresponds to a
   // different process.
   // Tracing a thread in a different process is not supported.
-  // If map is NULL, then create the map and manage it internally.
+  // If map is NULL, then create the map and manage it internally. For the
+  // current process, that map is shared with the other Backtrace objects
+  // created while the maps of the process do not change, so it must not be
+  // modified.
   // If map is not NULL, the map is still owned by the caller.
   static Backtrace* Create(pid_t pid, pid_t tid, BacktraceMap* map = NULL);
 
@@ -207,6 +211,16 @@ class Backtrace {
   // Set whether to skip frames in libbacktrace/libunwindstack when doing a local unwind.
   void SetSkipFrames(bool skip_frames) { skip_frames_ = skip_frames; }
 
+  // Set whether a local unwind follows the frame records kept on the stack
+  // by code built with frame pointers, instead of evaluating the unwind
+  // information of every frame. This is much faster, and the unwind
+  // information is still used for the first frame, for signal frames, and
+  // for any frame whose record does not look valid. A function built without
+  // frame pointers that calls one built with them can be missing from the
+  // unwind. Frames are not found in jit or dex code. Ignored on arm, where
+  // the frame records are not reliable, and for other processes.
+  void SetUseFramePointers(bool use_frame_pointers) { use_frame_pointers_ = use_frame_pointers; }
+
  protected:
   Backtrace(pid_t pid, pid_t tid, BacktraceMap* map);
 
@@ -223,12 +237,18 @@ class Backtrace {
 
   BacktraceMap* map_;
   bool map_shared_;
+  // Keeps the map of the current process shared between Backtrace objects
+  // alive, when no map was passed in.
+  std::shared_ptr<BacktraceMap> shared_local_map_;
 
   std::vector<backtrace_frame_data_t> frames_;
 
   // Skip frames in libbacktrace/libunwindstack when doing a local unwind.
   bool skip_frames_ = true;
 
+  // Use the frame records instead of the unwind information when doing a local unwind.
+  bool use_frame_pointers_ = false;
+
   BacktraceUnwindError error_;
 };
 
@@ -20,23 +20,36 @@
  * Implementation of the user-space ashmem API for devices, which have our
  * ashmem-enabled kernel. See ashmem-sim.c for the "fake" tmp-based version,
  * used by the simulator.
+ *
+ * With sys.use_memfd set, and a kernel that has F_SEAL_FUTURE_WRITE, regions
+ * are created as sealable memfds instead, which take a single syscall rather
+ * than an open() and two ioctls. Every call below accepts either kind, so that
+ * regions received from other processes work whichever kind they created.
  */
 #define LOG_TAG "ashmem"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/ashmem.h>
+#include <linux/memfd.h>
 #include <pthread.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 
 #define ASHMEM_DEVICE "/dev/ashmem"
 
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
 /* ashmem identity */
 static dev_t __ashmem_rdev;
 /*
@@ -44,6 +57,8 @@ static dev_t __ashmem_rdev;
  * signal handler calls ashmem, we could get into a deadlock state.
  */
 static pthread_mutex_t __ashmem_lock = PTHREAD_MUTEX_INITIALIZER;
+/* whether to create memfds, -1 until the first region is created */
+static int __ashmem_use_memfd = -1;
 
 /* logistics of getting file descriptor for ashmem */
 static int __ashmem_open_locked()
@@ -84,7 +99,43 @@ static int __ashmem_open()
     return fd;
 }
 
-/* Make sure file descriptor references ashmem, negative number means false */
+static int __memfd_create(const char *name, unsigned int flags)
+{
+    return syscall(__NR_memfd_create, name, flags);
+}
+
+/*
+ * Protection is dropped by sealing future writes, which the kernel must
+ * support for memfds to stand in for ashmem.
+ */
+static int __has_memfd_support()
+{
+    int fd = __memfd_create("ashmem_memfd_test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return 0;
+    }
+
+    int ret = TEMP_FAILURE_RETRY(fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE));
+    close(fd);
+    return ret == 0;
+}
+
+static int __ashmem_memfd_enabled()
+{
+    pthread_mutex_lock(&__ashmem_lock);
+    if (__ashmem_use_memfd < 0) {
+        __ashmem_use_memfd = property_get_bool("sys.use_memfd", false) && __has_memfd_support();
+    }
+    int enabled = __ashmem_use_memfd;
+    pthread_mutex_unlock(&__ashmem_lock);
+
+    return enabled;
+}
+
+/*
+ * Make sure file descriptor references ashmem, negative number means false.
+ * Returns 0 for ashmem, and 1 for a sealable memfd.
+ */
 static int __ashmem_is_ashmem(int fd, int fatal)
 {
     dev_t rdev;
@@ -115,6 +166,8 @@ static int __ashmem_is_ashmem(int fd, int fatal)
         if (st.st_rdev == rdev) {
             return 0;
         }
+    } else if (S_ISREG(st.st_mode) && TEMP_FAILURE_RETRY(fcntl(fd, F_GET_SEALS)) >= 0) {
+        return 1;
     }
 
     if (fatal) {
@@ -147,10 +200,33 @@ int ashmem_valid(int fd)
  * `name' is an optional label to give the region (visible in /proc/pid/maps)
  * `size' is the size of the region, in page-aligned bytes
  */
+static int __memfd_create_region(const char *name, size_t size)
+{
+    int fd = __memfd_create(name ? name : "none", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return fd;
+    }
+
+    /* Like ashmem regions, memfds can't be resized once created. */
+    if (TEMP_FAILURE_RETRY(ftruncate(fd, size)) < 0 ||
+        TEMP_FAILURE_RETRY(fcntl(fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK)) < 0) {
+        int save_errno = errno;
+        close(fd);
+        errno = save_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
 int ashmem_create_region(const char *name, size_t size)
 {
     int ret, save_errno;
 
+    if (__ashmem_memfd_enabled()) {
+        return __memfd_create_region(name, size);
+    }
+
     int fd = __ashmem_open();
     if (fd < 0) {
         return fd;
@@ -187,6 +263,25 @@ int ashmem_set_prot_region(int fd, int prot)
         return ret;
     }
 
+    if (ret == 1) {
+        /*
+         * Memfds can always be read and executed. As with ashmem, write access
+         * can be dropped, and not taken back.
+         */
+        int seals = TEMP_FAILURE_RETRY(fcntl(fd, F_GET_SEALS));
+        if (seals < 0) {
+            return seals;
+        }
+        if (prot & PROT_WRITE) {
+            if (seals & F_SEAL_FUTURE_WRITE) {
+                errno = EINVAL;
+                return -1;
+            }
+            return 0;
+        }
+        return TEMP_FAILURE_RETRY(fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE));
+    }
+
     return TEMP_FAILURE_RETRY(ioctl(fd, ASHMEM_SET_PROT_MASK, prot));
 }
 
@@ -200,6 +295,11 @@ int ashmem_pin_region(int fd, size_t offset, size_t len)
         return ret;
     }
 
+    /* Memfds are never purged, so they always stay pinned. */
+    if (ret == 1) {
+        return ASHMEM_NOT_PURGED;
+    }
+
     return TEMP_FAILURE_RETRY(ioctl(fd, ASHMEM_PIN, &pin));
 }
 
@@ -213,6 +313,11 @@ int ashmem_unpin_region(int fd, size_t offset, size_t len)
         return ret;
     }
 
+    /* Memfds are never purged, so unpinning them is a no-op. */
+    if (ret == 1) {
+        return 0;
+    }
+
     return TEMP_FAILURE_RETRY(ioctl(fd, ASHMEM_UNPIN, &pin));
 }
 
@@ -223,5 +328,11 @@ int ashmem_get_size_region(int fd)
         return ret;
     }
 
+    if (ret == 1) {
+        struct stat st;
+        ret = TEMP_FAILURE_RETRY(fstat(fd, &st));
+        return ret < 0 ? ret : static_cast<int>(st.st_size);
+    }
+
     return TEMP_FAILURE_RETRY(ioctl(fd, ASHMEM_GET_SIZE, NULL));
 }
@@ -289,6 +289,56 @@ static bool fs_config_cmp(bool partial, const char* prefix, size_t len, const ch
 auto __for_testing_only__fs_config_cmp = fs_config_cmp;
 #endif
 
+// Reads the next rule of a fs_config_(dirs|files) file, with its prefix in a
+// buffer to free. Returns false at the end of the file or if it is corrupted.
+static bool fs_config_read_rule(int fd, const char* name, struct fs_path_config* pc,
+                                size_t* plen) {
+    struct fs_path_config_from_file header;
+    if (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) != sizeof(header)) {
+        return false;
+    }
+
+    char* prefix;
+    uint16_t host_len = get2LE((const uint8_t*)&header.len);
+    ssize_t len, remainder = host_len - sizeof(header);
+    if (remainder <= 0) {
+        ALOGE("%s len is corrupted", name);
+        return false;
+    }
+    prefix = static_cast<char*>(calloc(1, remainder));
+    if (!prefix) {
+        ALOGE("%s out of memory", name);
+        return false;
+    }
+    if (TEMP_FAILURE_RETRY(read(fd, prefix, remainder)) != remainder) {
+        free(prefix);
+        ALOGE("%s prefix is truncated", name);
+        return false;
+    }
+    len = strnlen(prefix, remainder);
+    if (len >= remainder) {  // missing a terminating null
+        free(prefix);
+        ALOGE("%s is corrupted", name);
+        return false;
+    }
+
+    pc->uid = get2LE((const uint8_t*)&(header.uid));
+    pc->gid = get2LE((const uint8_t*)&(header.gid));
+    pc->mode = get2LE((const uint8_t*)&(header.mode));
+    pc->capabilities = get8LE((const uint8_t*)&(header.capabilities));
+    pc->prefix = prefix;
+    *plen = len;
+    return true;
+}
+
+static void fs_config_apply(const struct fs_path_config* pc, unsigned* uid, unsigned* gid,
+                            unsigned* mode, uint64_t* capabilities) {
+    *uid = pc->uid;
+    *gid = pc->gid;
+    *mode = (*mode & (~07777)) | pc->mode;
+    *capabilities = pc->capabilities;
+}
+
 void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
                unsigned* mode, uint64_t* capabilities) {
     const struct fs_path_config* pc;
@@ -301,45 +351,20 @@ void fs_config(const char* path, int dir, const char* target_out_path, unsigned*
     plen = strlen(path);
 
     for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
-        struct fs_path_config_from_file header;
+        struct fs_path_config rule;
+        size_t len;
 
         int fd = fs_config_open(dir, which, target_out_path);
         if (fd < 0) continue;
 
-        while (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) == sizeof(header)) {
-            char* prefix;
-            uint16_t host_len = get2LE((const uint8_t*)&header.len);
-            ssize_t len, remainder = host_len - sizeof(header);
-            if (remainder <= 0) {
-                ALOGE("%s len is corrupted", conf[which][dir]);
-                break;
-            }
-            prefix = static_cast<char*>(calloc(1, remainder));
-            if (!prefix) {
-                ALOGE("%s out of memory", conf[which][dir]);
-                break;
-            }
-            if (TEMP_FAILURE_RETRY(read(fd, prefix, remainder)) != remainder) {
-                free(prefix);
-                ALOGE("%s prefix is truncated", conf[which][dir]);
-                break;
-            }
-            len = strnlen(prefix, remainder);
-            if (len >= remainder) {  // missing a terminating null
-                free(prefix);
-                ALOGE("%s is corrupted", conf[which][dir]);
-                break;
-            }
-            if (fs_config_cmp(dir, prefix, len, path, plen)) {
-                free(prefix);
+        while (fs_config_read_rule(fd, conf[which][dir], &rule, &len)) {
+            bool match = fs_config_cmp(dir, rule.prefix, len, path, plen);
+            free(const_cast<char*>(rule.prefix));
+            if (match) {
                 close(fd);
-                *uid = get2LE((const uint8_t*)&(header.uid));
-                *gid = get2LE((const uint8_t*)&(header.gid));
-                *mode = (*mode & (~07777)) | get2LE((const uint8_t*)&(header.mode));
-                *capabilities = get8LE((const uint8_t*)&(header.capabilities));
+                fs_config_apply(&rule, uid, gid, mode, capabilities);
                 return;
             }
-            free(prefix);
         }
         close(fd);
     }
@@ -349,10 +374,120 @@ void fs_config(const char* path, int dir, const char* target_out_path, unsigned*
             break;
         }
     }
-    *uid = pc->uid;
-    *gid = pc->gid;
-    *mode = (*mode & (~07777)) | pc->mode;
-    *capabilities = pc->capabilities;
+    fs_config_apply(pc, uid, gid, mode, capabilities);
+}
+
+// The rules that fs_config() would go through, in the same order: those of
+// the files, then the compiled-in ones up to their catch-all default.
+struct fs_config_rules {
+    struct fs_path_config* rules;
+    size_t* lens;
+    size_t count;
+    size_t files_count;  // the prefixes of these were allocated
+};
+
+struct fs_config_index {
+    struct fs_config_rules rules[2];  // files, dirs
+};
+
+static bool fs_config_add_rule(struct fs_config_rules* rules, const struct fs_path_config* pc,
+                               size_t len, size_t* capacity) {
+    if (rules->count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        void* new_rules = realloc(rules->rules, new_capacity * sizeof(*rules->rules));
+        if (new_rules) rules->rules = static_cast<struct fs_path_config*>(new_rules);
+        void* new_lens = realloc(rules->lens, new_capacity * sizeof(*rules->lens));
+        if (new_lens) rules->lens = static_cast<size_t*>(new_lens);
+        if (!new_rules || !new_lens) return false;
+        *capacity = new_capacity;
+    }
+    rules->rules[rules->count] = *pc;
+    rules->lens[rules->count] = len;
+    rules->count++;
+    return true;
+}
+
+static bool fs_config_load_rules(struct fs_config_rules* rules, int dir,
+                                 const char* target_out_path) {
+    size_t capacity = 0;
+
+    for (size_t which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        struct fs_path_config rule;
+        size_t len;
+
+        int fd = fs_config_open(dir, which, target_out_path);
+        if (fd < 0) continue;
+
+        while (fs_config_read_rule(fd, conf[which][dir], &rule, &len)) {
+            if (!fs_config_add_rule(rules, &rule, len, &capacity)) {
+                free(const_cast<char*>(rule.prefix));
+                close(fd);
+                return false;
+            }
+            rules->files_count++;
+        }
+        close(fd);
+    }
+
+    for (const struct fs_path_config* pc = dir ? android_dirs : android_files;; pc++) {
+        if (!fs_config_add_rule(rules, pc, pc->prefix ? strlen(pc->prefix) : 0, &capacity)) {
+            return false;
+        }
+        if (!pc->prefix) return true;
+    }
+}
+
+static void fs_config_free_rules(struct fs_config_rules* rules) {
+    for (size_t i = 0; i < rules->files_count; i++) {
+        free(const_cast<char*>(rules->rules[i].prefix));
+    }
+    free(rules->rules);
+    free(rules->lens);
+}
+
+struct fs_config_index* fs_config_index_create(const char* target_out_path) {
+    struct fs_config_index* index =
+        static_cast<struct fs_config_index*>(calloc(1, sizeof(struct fs_config_index)));
+    if (!index) {
+        return NULL;
+    }
+    for (int dir = 0; dir < 2; dir++) {
+        if (!fs_config_load_rules(&index->rules[dir], dir, target_out_path)) {
+            ALOGE("out of memory for the fs_config rules");
+            fs_config_index_free(index);
+            return NULL;
+        }
+    }
+    return index;
+}
+
+void fs_config_index_lookup(const struct fs_config_index* index, const char* path, int dir,
+                            unsigned* uid, unsigned* gid, unsigned* mode,
+                            uint64_t* capabilities) {
+    const struct fs_config_rules* rules = &index->rules[dir ? 1 : 0];
+
+    if (path[0] == '/') {
+        path++;
+    }
+
+    size_t plen = strlen(path);
+    size_t i;
+    for (i = 0; i + 1 < rules->count; i++) {
+        if (fs_config_cmp(dir, rules->rules[i].prefix, rules->lens[i], path, plen)) {
+            break;
+        }
+    }
+    fs_config_apply(&rules->rules[i], uid, gid, mode, capabilities);
+}
+
+void fs_config_index_free(struct fs_config_index* index) {
+    if (!index) {
+        return;
+    }
+    for (int dir = 0; dir < 2; dir++) {
+        fs_config_free_rules(&index->rules[dir]);
+    }
+    free(index);
 }
 
 ssize_t fs_config_generate(char* buffer, size_t length, const struct fs_path_config* pc) {
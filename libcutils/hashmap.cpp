@@ -24,54 +24,69 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
-typedef struct Entry Entry;
-struct Entry {
+/*
+ * Entries are kept in the table itself, with linear probing, rather than
+ * allocated one at a time and chained. Removed entries are left as tombstones
+ * until the table is rehashed, so that hashmapForEach() callbacks can remove
+ * entries as they go.
+ */
+enum SlotState {
+    SLOT_EMPTY = 0,
+    SLOT_USED,
+    SLOT_DELETED,
+};
+
+typedef struct Slot Slot;
+struct Slot {
     void* key;
-    int hash;
     void* value;
-    Entry* next;
+    int hash;
+    int state;
 };
 
 struct Hashmap {
-    Entry** buckets;
-    size_t bucketCount;
+    Slot* slots;
+    size_t slotCount;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
-    mutex_t lock; 
+    mutex_t lock;
     size_t size;
+    size_t deleted;
 };
 
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
     assert(hash != NULL);
     assert(equals != NULL);
-    
+
     Hashmap* map = static_cast<Hashmap*>(malloc(sizeof(Hashmap)));
     if (map == NULL) {
         return NULL;
     }
-    
-    // 0.75 load factor.
-    size_t minimumBucketCount = initialCapacity * 4 / 3;
-    map->bucketCount = 1;
-    while (map->bucketCount <= minimumBucketCount) {
-        // Bucket count must be power of 2.
-        map->bucketCount <<= 1; 
+
+    // 0.5 load factor, as probing gets longer much faster than chains do.
+    // At least one slot must stay empty for lookups to end.
+    size_t minimumSlotCount = initialCapacity * 2;
+    map->slotCount = 2;
+    while (map->slotCount <= minimumSlotCount) {
+        // Slot count must be power of 2.
+        map->slotCount <<= 1;
     }
 
-    map->buckets = static_cast<Entry**>(calloc(map->bucketCount, sizeof(Entry*)));
-    if (map->buckets == NULL) {
+    map->slots = static_cast<Slot*>(calloc(map->slotCount, sizeof(Slot)));
+    if (map->slots == NULL) {
         free(map);
         return NULL;
     }
-    
+
     map->size = 0;
+    map->deleted = 0;
 
     map->hash = hash;
     map->equals = equals;
-    
+
     mutex_init(&map->lock);
-    
+
     return map;
 }
 
@@ -90,7 +105,7 @@ static inline int hashKey(Hashmap* map, void* key) {
     h ^= (((unsigned int) h) >> 14);
     h += (h << 4);
     h ^= (((unsigned int) h) >> 10);
-       
+
     return h;
 }
 
@@ -98,39 +113,60 @@ size_t hashmapSize(Hashmap* map) {
     return map->size;
 }
 
-static inline size_t calculateIndex(size_t bucketCount, int hash) {
-    return ((size_t) hash) & (bucketCount - 1);
+static inline size_t calculateIndex(size_t slotCount, int hash) {
+    return ((size_t) hash) & (slotCount - 1);
 }
 
-static void expandIfNecessary(Hashmap* map) {
-    // If the load factor exceeds 0.75...
-    if (map->size > (map->bucketCount * 3 / 4)) {
-        // Start off with a 0.33 load factor.
-        size_t newBucketCount = map->bucketCount << 1;
-        Entry** newBuckets = static_cast<Entry**>(calloc(newBucketCount, sizeof(Entry*)));
-        if (newBuckets == NULL) {
-            // Abort expansion.
-            return;
-        }
-        
-        // Move over existing entries.
-        size_t i;
-        for (i = 0; i < map->bucketCount; i++) {
-            Entry* entry = map->buckets[i];
-            while (entry != NULL) {
-                Entry* next = entry->next;
-                size_t index = calculateIndex(newBucketCount, entry->hash);
-                entry->next = newBuckets[index];
-                newBuckets[index] = entry;
-                entry = next;
+static inline size_t nextIndex(size_t slotCount, size_t index) {
+    return (index + 1) & (slotCount - 1);
+}
+
+/**
+ * Moves the entries to a new table, dropping the tombstones.
+ */
+static bool rehash(Hashmap* map, size_t newSlotCount) {
+    Slot* newSlots = static_cast<Slot*>(calloc(newSlotCount, sizeof(Slot)));
+    if (newSlots == NULL) {
+        return false;
+    }
+
+    size_t i;
+    for (i = 0; i < map->slotCount; i++) {
+        Slot* slot = &map->slots[i];
+        if (slot->state == SLOT_USED) {
+            size_t index = calculateIndex(newSlotCount, slot->hash);
+            while (newSlots[index].state != SLOT_EMPTY) {
+                index = nextIndex(newSlotCount, index);
             }
+            newSlots[index] = *slot;
         }
+    }
+
+    free(map->slots);
+    map->slots = newSlots;
+    map->slotCount = newSlotCount;
+    map->deleted = 0;
+    return true;
+}
 
-        // Copy over internals.
-        free(map->buckets);
-        map->buckets = newBuckets;
-        map->bucketCount = newBucketCount;
+/**
+ * Makes room for a new entry. Returns false if there is none.
+ */
+static bool reserveSlot(Hashmap* map) {
+    // If the load factor, tombstones included, would exceed 0.5...
+    if (map->size + map->deleted + 1 > map->slotCount / 2) {
+        // Start off with a 0.25 load factor, or only drop the tombstones
+        // if they are most of the load.
+        size_t newSlotCount = map->slotCount;
+        if (map->size + 1 > map->slotCount / 4) {
+            newSlotCount <<= 1;
+        }
+        if (!rehash(map, newSlotCount)) {
+            // Abort expansion, as long as a slot stays empty.
+            return map->size + map->deleted + 1 < map->slotCount;
+        }
     }
+    return true;
 }
 
 void hashmapLock(Hashmap* map) {
@@ -142,16 +178,7 @@ void hashmapUnlock(Hashmap* map) {
 }
 
 void hashmapFree(Hashmap* map) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
-    free(map->buckets);
+    free(map->slots);
     mutex_destroy(&map->lock);
     free(map);
 }
@@ -171,18 +198,6 @@ int hashmapHash(void* key, size_t keySize) {
     return h;
 }
 
-static Entry* createEntry(void* key, int hash, void* value) {
-    Entry* entry = static_cast<Entry*>(malloc(sizeof(Entry)));
-    if (entry == NULL) {
-        return NULL;
-    }
-    entry->key = key;
-    entry->hash = hash;
-    entry->value = value;
-    entry->next = NULL;
-    return entry;
-}
-
 static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
         bool (*equals)(void*, void*)) {
     if (keyA == keyB) {
@@ -194,154 +209,131 @@ static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
     return equals(keyA, keyB);
 }
 
-void* hashmapPut(Hashmap* map, void* key, void* value) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry** p = &(map->buckets[index]);
+/**
+ * Returns the slot holding the given key, or NULL.
+ */
+static Slot* findSlot(Hashmap* map, void* key, int hash) {
+    size_t index = calculateIndex(map->slotCount, hash);
     while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, value);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            map->size++;
-            expandIfNecessary(map);
+        Slot* slot = &map->slots[index];
+        if (slot->state == SLOT_EMPTY) {
             return NULL;
         }
-
-        // Replace existing entry.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* oldValue = current->value;
-            current->value = value;
-            return oldValue;
+        if (slot->state == SLOT_USED &&
+                equalKeys(slot->key, slot->hash, key, hash, map->equals)) {
+            return slot;
         }
+        index = nextIndex(map->slotCount, index);
+    }
+}
+
+/**
+ * Adds an entry for a key that isn't in the map, reusing the first tombstone on its way.
+ */
+static void addEntry(Hashmap* map, void* key, int hash, void* value) {
+    size_t index = calculateIndex(map->slotCount, hash);
+    while (map->slots[index].state == SLOT_USED) {
+        index = nextIndex(map->slotCount, index);
+    }
 
-        // Move to next entry.
-        p = &current->next;
+    Slot* slot = &map->slots[index];
+    if (slot->state == SLOT_DELETED) {
+        map->deleted--;
     }
+    slot->key = key;
+    slot->hash = hash;
+    slot->value = value;
+    slot->state = SLOT_USED;
+    map->size++;
 }
 
-void* hashmapGet(Hashmap* map, void* key) {
+void* hashmapPut(Hashmap* map, void* key, void* value) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
 
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return entry->value;
-        }
-        entry = entry->next;
+    // Replace existing entry.
+    Slot* slot = findSlot(map, key, hash);
+    if (slot != NULL) {
+        void* oldValue = slot->value;
+        slot->value = value;
+        return oldValue;
     }
 
+    // Add a new entry.
+    if (!reserveSlot(map)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    addEntry(map, key, hash, value);
     return NULL;
 }
 
-bool hashmapContainsKey(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return true;
-        }
-        entry = entry->next;
-    }
+void* hashmapGet(Hashmap* map, void* key) {
+    Slot* slot = findSlot(map, key, hashKey(map, key));
+    return slot != NULL ? slot->value : NULL;
+}
 
-    return false;
+bool hashmapContainsKey(Hashmap* map, void* key) {
+    return findSlot(map, key, hashKey(map, key)) != NULL;
 }
 
-void* hashmapMemoize(Hashmap* map, void* key, 
+void* hashmapMemoize(Hashmap* map, void* key,
         void* (*initialValue)(void* key, void* context), void* context) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry** p = &(map->buckets[index]);
-    while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, NULL);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            void* value = initialValue(key, context);
-            (*p)->value = value;
-            map->size++;
-            expandIfNecessary(map);
-            return value;
-        }
 
-        // Return existing value.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            return current->value;
-        }
+    // Return existing value.
+    Slot* slot = findSlot(map, key, hash);
+    if (slot != NULL) {
+        return slot->value;
+    }
 
-        // Move to next entry.
-        p = &current->next;
+    // Add a new entry.
+    if (!reserveSlot(map)) {
+        errno = ENOMEM;
+        return NULL;
     }
+    void* value = initialValue(key, context);
+    addEntry(map, key, hash, value);
+    return value;
 }
 
 void* hashmapRemove(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    // Pointer to the current entry.
-    Entry** p = &(map->buckets[index]);
-    Entry* current;
-    while ((current = *p) != NULL) {
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* value = current->value;
-            *p = current->next;
-            free(current);
-            map->size--;
-            return value;
-        }
-
-        p = &current->next;
+    Slot* slot = findSlot(map, key, hashKey(map, key));
+    if (slot == NULL) {
+        return NULL;
     }
 
-    return NULL;
+    // Leave a tombstone, as lookups must carry on past this slot.
+    void* value = slot->value;
+    slot->state = SLOT_DELETED;
+    map->size--;
+    map->deleted++;
+    return value;
 }
 
-void hashmapForEach(Hashmap* map, 
+void hashmapForEach(Hashmap* map,
         bool (*callback)(void* key, void* value, void* context),
         void* context) {
     size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            if (!callback(entry->key, entry->value, context)) {
-                return;
-            }
-            entry = next;
+    for (i = 0; i < map->slotCount; i++) {
+        Slot* slot = &map->slots[i];
+        if (slot->state == SLOT_USED && !callback(slot->key, slot->value, context)) {
+            return;
         }
     }
 }
 
 size_t hashmapCurrentCapacity(Hashmap* map) {
-    size_t bucketCount = map->bucketCount;
-    return bucketCount * 3 / 4;
+    return map->slotCount / 2;
 }
 
 size_t hashmapCountCollisions(Hashmap* map) {
+    // Count the entries that aren't in the slot they hash to.
     size_t collisions = 0;
     size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            if (entry->next != NULL) {
-                collisions++;
-            }
-            entry = entry->next;
+    for (i = 0; i < map->slotCount; i++) {
+        Slot* slot = &map->slots[i];
+        if (slot->state == SLOT_USED && calculateIndex(map->slotCount, slot->hash) != i) {
+            collisions++;
         }
     }
     return collisions;
@@ -56,6 +56,14 @@ typedef enum {
 
 extern int set_cpuset_policy(int tid, SchedPolicy policy);
 
+/* Assign all the threads of process pid to the cpuset and schedtune cgroups
+ * associated with the specified policy, with one write to each cgroup.procs
+ * rather than one per thread, so that no thread created meanwhile is left out.
+ * Zero pid means current process.
+ * Return value: 0 for success, or -errno for error.
+ */
+extern int set_cpuset_policy_process(int pid, SchedPolicy policy);
+
 /* Assign thread tid to the cgroup associated with the specified policy.
  * If the thread is a thread group leader, that is it's gettid() == getpid(),
  * then the other threads in the same thread group are _not_ affected.
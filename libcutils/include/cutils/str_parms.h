@@ -55,6 +55,35 @@ char *str_parms_to_str(struct str_parms *str_parms);
 /* debug */
 void str_parms_dump(struct str_parms *str_parms);
 
+// For strings that are only parsed and looked up, such as those passed to audio HALs'
+// set_parameters(): str_parms_view_init() parses `string` in place, overwriting its separators,
+// into the view's own table, so that the pairs it finds need no allocation. Strings with more
+// than STR_PARMS_VIEW_CAPACITY pairs fall back to a struct str_parms. The view refers to
+// `string`, which must outlive it, and must be released with str_parms_view_release().
+// Returns 0, or -ENOMEM if the fallback could not be allocated.
+#define STR_PARMS_VIEW_CAPACITY 16
+
+struct str_parms_view {
+    unsigned count;
+    struct {
+        const char *key;
+        const char *value;
+    } pairs[STR_PARMS_VIEW_CAPACITY];
+    struct str_parms *overflow;
+};
+
+int str_parms_view_init(struct str_parms_view *view, char *string);
+void str_parms_view_release(struct str_parms_view *view);
+
+// Same as the str_parms_has_key() and str_parms_get_*() above.
+int str_parms_view_has_key(const struct str_parms_view *view, const char *key);
+int str_parms_view_get_str(const struct str_parms_view *view, const char *key,
+                           char *out_val, int len);
+int str_parms_view_get_int(const struct str_parms_view *view, const char *key,
+                           int *out_val);
+int str_parms_view_get_float(const struct str_parms_view *view, const char *key,
+                             float *out_val);
+
 __END_DECLS
 
 #endif /* __CUTILS_STR_PARMS_H */
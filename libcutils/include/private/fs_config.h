@@ -76,6 +76,19 @@ void fs_config(const char* path, int dir, const char* target_out_path, unsigned*
 
 ssize_t fs_config_generate(char* buffer, size_t length, const struct fs_path_config* pc);
 
+/*
+ * For the tools that look up every path of an image: the rules fs_config()
+ * reads from the fs_config_(dirs|files) files for target_out_path are loaded
+ * once, so that fs_config_index_lookup() returns the same as fs_config()
+ * without any I/O. Returns NULL if out of memory.
+ */
+struct fs_config_index;
+
+struct fs_config_index* fs_config_index_create(const char* target_out_path);
+void fs_config_index_lookup(const struct fs_config_index* index, const char* path, int dir,
+                            unsigned* uid, unsigned* gid, unsigned* mode, uint64_t* capabilities);
+void fs_config_index_free(struct fs_config_index* index);
+
 __END_DECLS
 
 #endif /* _LIBS_CUTILS_PRIVATE_FS_CONFIG_H */
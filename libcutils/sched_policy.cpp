@@ -38,9 +38,11 @@ static inline SchedPolicy _policy(SchedPolicy p)
 
 #if defined(__ANDROID__)
 
+#include <dirent.h>
 #include <pthread.h>
 #include <sched.h>
 #include <sys/prctl.h>
+#include <time.h>
 
 #define POLICY_DEBUG 0
 
@@ -48,7 +50,11 @@ static inline SchedPolicy _policy(SchedPolicy p)
 #define TIMER_SLACK_BG 40000000
 #define TIMER_SLACK_FG 50000
 
+// moving a process between cgroups for longer than this is logged
+#define SLOW_PROCESS_MOVE_MS 10
+
 static pthread_once_t the_once = PTHREAD_ONCE_INIT;
+static pthread_once_t the_procs_once = PTHREAD_ONCE_INIT;
 
 static int __sys_supports_timerslack = -1;
 
@@ -65,6 +71,17 @@ static int fg_schedboost_fd = -1;
 static int ta_schedboost_fd = -1;
 static int rt_schedboost_fd = -1;
 
+// File descriptors open to the cgroup.procs of the same cgroups, setup by
+// __initialize_procs on the first set_cpuset_policy_process(), or -1 on error
+static int system_bg_cpuset_procs_fd = -1;
+static int bg_cpuset_procs_fd = -1;
+static int fg_cpuset_procs_fd = -1;
+static int ta_cpuset_procs_fd = -1;
+static int rs_cpuset_procs_fd = -1;
+static int bg_schedboost_procs_fd = -1;
+static int fg_schedboost_procs_fd = -1;
+static int ta_schedboost_procs_fd = -1;
+
 /* Add tid to the scheduling group defined by the policy */
 static int add_tid_to_cgroup(int tid, int fd)
 {
@@ -173,6 +190,27 @@ static void __initialize() {
     __sys_supports_timerslack = !access(buf, W_OK);
 }
 
+static void __initialize_procs() {
+    if (!cpusets_enabled() || access("/dev/cpuset/tasks", W_OK)) {
+        return;
+    }
+
+    fg_cpuset_procs_fd = open("/dev/cpuset/foreground/cgroup.procs", O_WRONLY | O_CLOEXEC);
+    bg_cpuset_procs_fd = open("/dev/cpuset/background/cgroup.procs", O_WRONLY | O_CLOEXEC);
+    system_bg_cpuset_procs_fd =
+        open("/dev/cpuset/system-background/cgroup.procs", O_WRONLY | O_CLOEXEC);
+    ta_cpuset_procs_fd = open("/dev/cpuset/top-app/cgroup.procs", O_WRONLY | O_CLOEXEC);
+    rs_cpuset_procs_fd = open("/dev/cpuset/restricted/cgroup.procs", O_WRONLY | O_CLOEXEC);
+
+    if (schedboost_enabled()) {
+        ta_schedboost_procs_fd = open("/dev/stune/top-app/cgroup.procs", O_WRONLY | O_CLOEXEC);
+        fg_schedboost_procs_fd =
+            open("/dev/stune/foreground/cgroup.procs", O_WRONLY | O_CLOEXEC);
+        bg_schedboost_procs_fd =
+            open("/dev/stune/background/cgroup.procs", O_WRONLY | O_CLOEXEC);
+    }
+}
+
 /*
  * Returns the path under the requested cgroup subsystem (if it exists)
  *
@@ -278,46 +316,52 @@ int get_sched_policy(int tid, SchedPolicy *policy)
     return 0;
 }
 
-int set_cpuset_policy(int tid, SchedPolicy policy)
+/* Get the fds of the tasks, or of the cgroup.procs, of the cgroups of the policy */
+static void get_cpuset_policy_fds(SchedPolicy policy, bool procs, int* fd, int* boost_fd)
 {
-    // in the absence of cpusets, use the old sched policy
-    if (!cpusets_enabled()) {
-        return set_sched_policy(tid, policy);
-    }
-
-    if (tid == 0) {
-        tid = gettid();
-    }
-    policy = _policy(policy);
-    pthread_once(&the_once, __initialize);
-
-    int fd = -1;
-    int boost_fd = -1;
+    *boost_fd = -1;
     switch (policy) {
     case SP_BACKGROUND:
-        fd = bg_cpuset_fd;
-        boost_fd = bg_schedboost_fd;
+        *fd = procs ? bg_cpuset_procs_fd : bg_cpuset_fd;
+        *boost_fd = procs ? bg_schedboost_procs_fd : bg_schedboost_fd;
         break;
     case SP_FOREGROUND:
     case SP_AUDIO_APP:
     case SP_AUDIO_SYS:
-        fd = fg_cpuset_fd;
-        boost_fd = fg_schedboost_fd;
+        *fd = procs ? fg_cpuset_procs_fd : fg_cpuset_fd;
+        *boost_fd = procs ? fg_schedboost_procs_fd : fg_schedboost_fd;
         break;
     case SP_TOP_APP :
-        fd = ta_cpuset_fd;
-        boost_fd = ta_schedboost_fd;
+        *fd = procs ? ta_cpuset_procs_fd : ta_cpuset_fd;
+        *boost_fd = procs ? ta_schedboost_procs_fd : ta_schedboost_fd;
         break;
     case SP_SYSTEM:
-        fd = system_bg_cpuset_fd;
+        *fd = procs ? system_bg_cpuset_procs_fd : system_bg_cpuset_fd;
         break;
     case SP_RESTRICTED:
-        fd = rs_cpuset_fd;
+        *fd = procs ? rs_cpuset_procs_fd : rs_cpuset_fd;
         break;
     default:
-        boost_fd = fd = -1;
+        *fd = -1;
         break;
     }
+}
+
+int set_cpuset_policy(int tid, SchedPolicy policy)
+{
+    // in the absence of cpusets, use the old sched policy
+    if (!cpusets_enabled()) {
+        return set_sched_policy(tid, policy);
+    }
+
+    if (tid == 0) {
+        tid = gettid();
+    }
+    policy = _policy(policy);
+    pthread_once(&the_once, __initialize);
+
+    int fd, boost_fd;
+    get_cpuset_policy_fds(policy, false, &fd, &boost_fd);
 
     if (add_tid_to_cgroup(tid, fd) != 0) {
         if (errno != ESRCH && errno != ENOENT)
@@ -334,6 +378,79 @@ int set_cpuset_policy(int tid, SchedPolicy policy)
     return 0;
 }
 
+static int set_sched_policy_threads(int pid, SchedPolicy policy)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR* d = opendir(path);
+    if (!d) {
+        return errno == ENOENT ? 0 : -errno;
+    }
+
+    int ret = 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        int tid = atoi(de->d_name);
+        if (tid <= 0) {
+            continue;
+        }
+        int err = set_sched_policy(tid, policy);
+        if (err != 0 && err != -ESRCH) {
+            ret = err;
+        }
+    }
+    closedir(d);
+    return ret;
+}
+
+static long long elapsed_ms(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000LL + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+int set_cpuset_policy_process(int pid, SchedPolicy policy)
+{
+    if (pid == 0) {
+        pid = getpid();
+    }
+    policy = _policy(policy);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int ret = 0;
+    if (!cpusets_enabled()) {
+        // in the absence of cpusets, use the old sched policy
+        ret = set_sched_policy_threads(pid, policy);
+    } else {
+        pthread_once(&the_once, __initialize);
+        pthread_once(&the_procs_once, __initialize_procs);
+
+        int fd, boost_fd;
+        get_cpuset_policy_fds(policy, true, &fd, &boost_fd);
+
+        if (add_tid_to_cgroup(pid, fd) != 0) {
+            if (errno != ESRCH && errno != ENOENT)
+                ret = -errno;
+        }
+
+        if (ret == 0 && schedboost_enabled()) {
+            if (boost_fd > 0 && add_tid_to_cgroup(pid, boost_fd) != 0) {
+                if (errno != ESRCH && errno != ENOENT)
+                    ret = -errno;
+            }
+        }
+    }
+
+    long long ms = elapsed_ms(&start);
+    if (ms >= SLOW_PROCESS_MOVE_MS) {
+        SLOGW("moving pid %d to %s took %lldms", pid, get_sched_policy_name(policy), ms);
+    }
+    return ret;
+}
+
 static void set_timerslack_ns(int tid, unsigned long slack) {
     // v4.6+ kernels support the /proc/<tid>/timerslack_ns interface.
     // TODO: once we've backported this, log if the open(2) fails.
@@ -453,6 +570,10 @@ int set_sched_policy(int /*tid*/, SchedPolicy /*policy*/) {
     return 0;
 }
 
+int set_cpuset_policy_process(int /*pid*/, SchedPolicy /*policy*/) {
+    return 0;
+}
+
 int get_sched_policy(int /*tid*/, SchedPolicy* policy) {
     *policy = SP_SYSTEM_DEFAULT;
     return 0;
@@ -293,12 +293,10 @@ int str_parms_get_str(struct str_parms *str_parms, const char *key, char *val,
     return -ENOENT;
 }
 
-int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
+static int parse_int(const char *value, int *val)
 {
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
     if (!value)
         return -ENOENT;
 
@@ -309,14 +307,11 @@ int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
     return -EINVAL;
 }
 
-int str_parms_get_float(struct str_parms *str_parms, const char *key,
-                        float *val)
+static int parse_float(const char *value, float *val)
 {
     float out;
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)(key)));
     if (!value)
         return -ENOENT;
 
@@ -328,6 +323,19 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     return 0;
 }
 
+int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
+{
+    // TODO: hashmapGet should take a const* key.
+    return parse_int(static_cast<char*>(hashmapGet(str_parms->map, (void*)key)), val);
+}
+
+int str_parms_get_float(struct str_parms *str_parms, const char *key,
+                        float *val)
+{
+    // TODO: hashmapGet should take a const* key.
+    return parse_float(static_cast<char*>(hashmapGet(str_parms->map, (void*)(key))), val);
+}
+
 static bool combine_strings(void *key, void *value, void *context)
 {
     char** old_str = static_cast<char**>(context);
@@ -371,3 +379,101 @@ void str_parms_dump(struct str_parms *str_parms)
 {
     hashmapForEach(str_parms->map, dump_entry, str_parms);
 }
+
+int str_parms_view_init(struct str_parms_view *view, char *string)
+{
+    char *kvpair;
+    char *tmpstr;
+
+    view->count = 0;
+    view->overflow = NULL;
+
+    /* Pairs are split as str_parms_create_str() splits them. */
+    for (kvpair = strtok_r(string, ";", &tmpstr); kvpair;
+         kvpair = strtok_r(NULL, ";", &tmpstr)) {
+        char *eq = strchr(kvpair, '=');
+        const char *value = "";
+
+        if (eq == kvpair)
+            continue;
+        if (eq) {
+            *eq = '\0';
+            value = eq + 1;
+        }
+
+        if (!view->overflow && view->count < STR_PARMS_VIEW_CAPACITY) {
+            view->pairs[view->count].key = kvpair;
+            view->pairs[view->count].value = value;
+            view->count++;
+            continue;
+        }
+
+        if (!view->overflow) {
+            view->overflow = str_parms_create();
+            if (!view->overflow)
+                return -ENOMEM;
+            for (unsigned i = 0; i < view->count; i++) {
+                if (str_parms_add_str(view->overflow, view->pairs[i].key,
+                                      view->pairs[i].value) < 0)
+                    goto err_overflow;
+            }
+            view->count = 0;
+        }
+        if (str_parms_add_str(view->overflow, kvpair, value) < 0)
+            goto err_overflow;
+    }
+
+    return 0;
+
+err_overflow:
+    str_parms_view_release(view);
+    return -ENOMEM;
+}
+
+void str_parms_view_release(struct str_parms_view *view)
+{
+    if (view->overflow)
+        str_parms_destroy(view->overflow);
+    view->overflow = NULL;
+    view->count = 0;
+}
+
+static const char *view_get(const struct str_parms_view *view, const char *key)
+{
+    if (view->overflow)
+        return static_cast<char*>(hashmapGet(view->overflow->map, (void*)key));
+
+    /* Later pairs replace earlier ones with the same key. */
+    for (unsigned i = view->count; i > 0; i--) {
+        if (!strcmp(view->pairs[i - 1].key, key))
+            return view->pairs[i - 1].value;
+    }
+    return NULL;
+}
+
+int str_parms_view_has_key(const struct str_parms_view *view, const char *key)
+{
+    return view_get(view, key) != NULL;
+}
+
+int str_parms_view_get_str(const struct str_parms_view *view, const char *key,
+                           char *val, int len)
+{
+    const char *value = view_get(view, key);
+    if (value)
+        return strlcpy(val, value, len);
+
+    return -ENOENT;
+}
+
+int str_parms_view_get_int(const struct str_parms_view *view, const char *key,
+                           int *val)
+{
+    return parse_int(view_get(view, key), val);
+}
+
+int str_parms_view_get_float(const struct str_parms_view *view, const char *key,
+                             float *val)
+{
+    return parse_float(view_get(view, key), val);
+}
@@ -15,14 +15,17 @@
  */
 
 #include <inttypes.h>
+#include <sys/stat.h>
 
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/test_utils.h>
 
 #include <private/android_filesystem_config.h>
 #include <private/fs_config.h>
@@ -246,3 +249,65 @@ TEST(fs_config, odm_files_alias) {
 TEST(fs_config, system_alias) {
     EXPECT_FALSE(check_fs_config_cmp(fs_config_cmp_tests));
 }
+
+static void write_rules(const std::string& file, const std::vector<fs_path_config>& rules) {
+    std::string data;
+    for (const auto& rule : rules) {
+        char buffer[256];
+        ssize_t len = fs_config_generate(buffer, sizeof(buffer), &rule);
+        ASSERT_LT(0, len);
+        data.append(buffer, len);
+    }
+    ASSERT_TRUE(android::base::WriteStringToFile(data, file));
+}
+
+TEST(fs_config, index_matches_fs_config) {
+    TemporaryDir tmp_dir;
+    std::string root(tmp_dir.path);
+    for (const char* dir : {"/system", "/system/etc", "/vendor", "/vendor/etc"}) {
+        ASSERT_EQ(0, mkdir((root + dir).c_str(), 0700));
+    }
+    write_rules(root + "/system/etc/fs_config_files",
+                {{00700, AID_SYSTEM, AID_SYSTEM, 0, "system/bin/foo"},
+                 {00600, AID_SHELL, AID_SHELL, 0, "system/etc/foo/*"}});
+    write_rules(root + "/vendor/etc/fs_config_files",
+                {{00750, AID_ROOT, AID_SHELL, CAP_MASK_LONG(CAP_NET_RAW), "vendor/bin/bar"}});
+    write_rules(root + "/system/etc/fs_config_dirs",
+                {{00751, AID_SYSTEM, AID_SHELL, 0, "data/foo"}});
+
+    std::string target_out_path = root + "/system";
+    fs_config_index* index = fs_config_index_create(target_out_path.c_str());
+    ASSERT_TRUE(index != nullptr);
+
+    static const char* const paths[] = {
+        "system/bin/foo", "/system/bin/foo", "system/bin/foobar", "system/bin/sh",
+        "system/etc/foo/bar", "vendor/bin/bar", "system/vendor/bin/bar", "vendor/bin/baz",
+        "data/foo", "data/misc", "data/app/x.apk", "init.rc", "system/xbin/su", "",
+    };
+    for (const char* path : paths) {
+        for (int dir = 0; dir < 2; dir++) {
+            unsigned uid = 1, gid = 2, mode = S_IFREG | 07777;
+            uint64_t capabilities = 3;
+            fs_config(path, dir, target_out_path.c_str(), &uid, &gid, &mode, &capabilities);
+
+            unsigned index_uid = 1, index_gid = 2, index_mode = S_IFREG | 07777;
+            uint64_t index_capabilities = 3;
+            fs_config_index_lookup(index, path, dir, &index_uid, &index_gid, &index_mode,
+                                   &index_capabilities);
+
+            EXPECT_EQ(uid, index_uid) << path << " dir=" << dir;
+            EXPECT_EQ(gid, index_gid) << path << " dir=" << dir;
+            EXPECT_EQ(mode, index_mode) << path << " dir=" << dir;
+            EXPECT_EQ(capabilities, index_capabilities) << path << " dir=" << dir;
+        }
+    }
+
+    unsigned uid, gid, mode = 0;
+    uint64_t capabilities;
+    fs_config_index_lookup(index, "vendor/bin/bar", 0, &uid, &gid, &mode, &capabilities);
+    EXPECT_EQ(AID_SHELL, gid);
+    EXPECT_EQ(00750U, mode);
+    EXPECT_EQ(CAP_MASK_LONG(CAP_NET_RAW), capabilities);
+
+    fs_config_index_free(index);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/hashmap.h>
+
+#include <gtest/gtest.h>
+
+static const int kKeyCount = 1000;
+
+static bool remove_entry(void* key, void*, void* context) {
+    Hashmap* map = static_cast<Hashmap*>(context);
+    EXPECT_EQ(key, hashmapGet(map, key));
+    EXPECT_EQ(key, hashmapRemove(map, key));
+    return true;
+}
+
+static bool count_entry(void*, void*, void* context) {
+    (*static_cast<size_t*>(context))++;
+    return true;
+}
+
+static void* memoized_value(void* key, void* context) {
+    (*static_cast<size_t*>(context))++;
+    return key;
+}
+
+TEST(hashmap, put_get_remove) {
+    static int keys[kKeyCount];
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+
+    for (int i = 0; i < kKeyCount; i++) {
+        keys[i] = i;
+        ASSERT_EQ(nullptr, hashmapPut(map, &keys[i], &keys[i]));
+    }
+    ASSERT_EQ(static_cast<size_t>(kKeyCount), hashmapSize(map));
+    ASSERT_LE(static_cast<size_t>(kKeyCount), hashmapCurrentCapacity(map));
+
+    for (int i = 0; i < kKeyCount; i++) {
+        int key = i;
+        ASSERT_EQ(&keys[i], hashmapGet(map, &key));
+        ASSERT_TRUE(hashmapContainsKey(map, &key));
+    }
+    int missing = kKeyCount;
+    ASSERT_EQ(nullptr, hashmapGet(map, &missing));
+
+    // Replacing a value returns the old one.
+    ASSERT_EQ(&keys[1], hashmapPut(map, &keys[1], &keys[2]));
+    ASSERT_EQ(&keys[2], hashmapGet(map, &keys[1]));
+    ASSERT_EQ(static_cast<size_t>(kKeyCount), hashmapSize(map));
+
+    for (int i = 0; i < kKeyCount; i += 2) {
+        ASSERT_TRUE(hashmapRemove(map, &keys[i]) != nullptr);
+    }
+    ASSERT_EQ(static_cast<size_t>(kKeyCount / 2), hashmapSize(map));
+    for (int i = 0; i < kKeyCount; i++) {
+        ASSERT_EQ(i % 2 == 1, hashmapContainsKey(map, &keys[i]));
+    }
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, remove_in_for_each) {
+    static int keys[kKeyCount];
+    Hashmap* map = hashmapCreate(5, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+
+    for (int i = 0; i < kKeyCount; i++) {
+        keys[i] = i;
+        hashmapPut(map, &keys[i], &keys[i]);
+    }
+    hashmapForEach(map, remove_entry, map);
+    ASSERT_EQ(0U, hashmapSize(map));
+
+    size_t count = 0;
+    hashmapForEach(map, count_entry, &count);
+    ASSERT_EQ(0U, count);
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, reuse_removed) {
+    static int keys[kKeyCount];
+    Hashmap* map = hashmapCreate(16, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+    size_t capacity = hashmapCurrentCapacity(map);
+
+    // Putting and removing keys doesn't grow the map.
+    for (int i = 0; i < kKeyCount; i++) {
+        keys[i] = i;
+        hashmapPut(map, &keys[i], &keys[i]);
+        if (i >= 8) {
+            hashmapRemove(map, &keys[i - 8]);
+        }
+    }
+    ASSERT_EQ(8U, hashmapSize(map));
+    ASSERT_EQ(capacity, hashmapCurrentCapacity(map));
+    for (int i = kKeyCount - 8; i < kKeyCount; i++) {
+        ASSERT_EQ(&keys[i], hashmapGet(map, &keys[i]));
+    }
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, memoize) {
+    int keys[] = { 1, 2 };
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+
+    size_t calls = 0;
+    ASSERT_EQ(&keys[0], hashmapMemoize(map, &keys[0], memoized_value, &calls));
+    ASSERT_EQ(&keys[0], hashmapMemoize(map, &keys[0], memoized_value, &calls));
+    ASSERT_EQ(&keys[1], hashmapMemoize(map, &keys[1], memoized_value, &calls));
+    ASSERT_EQ(2U, calls);
+    ASSERT_EQ(2U, hashmapSize(map));
+
+    hashmapFree(map);
+}
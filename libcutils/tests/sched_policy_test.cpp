@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <vector>
@@ -96,3 +97,37 @@ TEST(SchedPolicy, get_sched_policy) {
     ASSERT_EQ(0, get_sched_policy(0, &newPolicy));
     EXPECT_EQ(SP_BACKGROUND, newPolicy);
 }
+
+TEST(SchedPolicy, set_cpuset_policy_process) {
+    if (!hasCapSysNice()) {
+        GTEST_LOG_(INFO) << "skipping test that requires CAP_SYS_NICE";
+        return;
+    }
+
+    // Every thread of the process is moved, not only the caller.
+    std::atomic<pid_t> tid(0);
+    std::atomic<bool> done(false);
+    std::thread thread([&tid, &done]() {
+        tid = gettid();
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    while (tid == 0) {
+        std::this_thread::yield();
+    }
+
+    SchedPolicy policy;
+    ASSERT_EQ(0, set_cpuset_policy_process(0, SP_BACKGROUND));
+    ASSERT_EQ(0, get_sched_policy(tid, &policy));
+    EXPECT_EQ(SP_BACKGROUND, policy);
+    ASSERT_EQ(0, get_sched_policy(0, &policy));
+    EXPECT_EQ(SP_BACKGROUND, policy);
+
+    ASSERT_EQ(0, set_cpuset_policy_process(0, SP_FOREGROUND));
+    ASSERT_EQ(0, get_sched_policy(tid, &policy));
+    EXPECT_EQ(SP_FOREGROUND, policy);
+
+    done = true;
+    thread.join();
+}
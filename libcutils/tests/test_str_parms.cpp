@@ -17,6 +17,9 @@
 #include <cutils/str_parms.h>
 #include <gtest/gtest.h>
 
+#include <stdio.h>
+#include <string.h>
+
 static void test_str_parms_str(const char* str, const char* expected) {
     str_parms* str_parms = str_parms_create_str(str);
     str_parms_add_str(str_parms, "dude", "woah");
@@ -55,3 +58,57 @@ TEST(str_parms, put_ENOMEM) {
     ASSERT_EQ(ENOMEM, errno);
     test_str_parms_str("foo=bar;baz=", "foo=bar;baz=");
 }
+
+static void test_str_parms_view(const char* str, const char* key, const char* expected) {
+    char buffer[256];
+    strlcpy(buffer, str, sizeof(buffer));
+    str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_init(&view, buffer)) << str;
+
+    str_parms* str_parms = str_parms_create_str(str);
+    char value[64] = "";
+    char view_value[64] = "";
+    ASSERT_EQ(str_parms_get_str(str_parms, key, value, sizeof(value)),
+              str_parms_view_get_str(&view, key, view_value, sizeof(view_value)))
+        << str;
+    EXPECT_STREQ(expected, view_value) << str;
+    EXPECT_EQ(str_parms_has_key(str_parms, key), str_parms_view_has_key(&view, key)) << str;
+    str_parms_destroy(str_parms);
+
+    str_parms_view_release(&view);
+}
+
+TEST(str_parms, view) {
+    test_str_parms_view("", "foo", "");
+    test_str_parms_view("=bar;", "foo", "");
+    test_str_parms_view("foo=", "foo", "");
+    test_str_parms_view("foo=bar", "foo", "bar");
+    test_str_parms_view("foo=bar;baz", "baz", "");
+    test_str_parms_view("foo=bar;baz=bat;", "baz", "bat");
+    test_str_parms_view("foo=bar1;baz=bat;foo=bar2", "foo", "bar2");
+}
+
+TEST(str_parms, view_overflow) {
+    char buffer[1024] = "";
+    for (int i = 0; i < 2 * STR_PARMS_VIEW_CAPACITY; i++) {
+        char pair[32];
+        snprintf(pair, sizeof(pair), "key%d=%d;", i, i);
+        strlcat(buffer, pair, sizeof(buffer));
+    }
+    strlcat(buffer, "key0=last", sizeof(buffer));
+
+    str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_init(&view, buffer));
+    ASSERT_TRUE(view.overflow != nullptr);
+    for (int i = 1; i < 2 * STR_PARMS_VIEW_CAPACITY; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        int value;
+        ASSERT_EQ(0, str_parms_view_get_int(&view, key, &value));
+        EXPECT_EQ(i, value);
+    }
+    char value[16];
+    EXPECT_EQ(4, str_parms_view_get_str(&view, "key0", value, sizeof(value)));
+    EXPECT_STREQ("last", value);
+    str_parms_view_release(&view);
+}
@@ -19,7 +19,9 @@
 #include "trace-dev.inc"
 
 #include <cutils/sockets.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 
 /**
@@ -28,6 +30,27 @@
  */
 #define CONTAINER_ATRACE_MESSAGE_LENGTH (ATRACE_MESSAGE_LENGTH + 512)
 
+/**
+ * With debug.atrace.container_batch set, the events of each thread are kept in
+ * a buffer of its own and sent in batches with a single sendmmsg(), which is
+ * done as soon as the buffer is full or holds an event older than
+ * CONTAINER_ATRACE_BATCH_DELAY_US, and when the thread or process exits.
+ * Unlike those written to trace_marker, which the kernel timestamps as they
+ * are written, the events sent to the socket carry their own timestamps.
+ */
+#define CONTAINER_ATRACE_BATCH_EVENTS   64
+#define CONTAINER_ATRACE_BATCH_BYTES    (16 * 1024)
+#define CONTAINER_ATRACE_BATCH_DELAY_US 100000
+
+struct atrace_batch {
+    size_t count;
+    size_t used;
+    uint64_t first_ts;
+    struct iovec iovs[CONTAINER_ATRACE_BATCH_EVENTS];
+    struct mmsghdr msgs[CONTAINER_ATRACE_BATCH_EVENTS];
+    char data[CONTAINER_ATRACE_BATCH_BYTES];
+};
+
 static pthread_once_t atrace_once_control = PTHREAD_ONCE_INIT;
 
 // Variables used for tracing in container with socket.
@@ -38,6 +61,10 @@ static bool             atrace_use_container_sock    = false;
 static int              atrace_container_sock_fd     = -1;
 static pthread_mutex_t  atrace_enabling_mutex        = PTHREAD_MUTEX_INITIALIZER;
 static pthread_rwlock_t atrace_container_sock_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static bool             atrace_batch_events          = false;
+static pthread_key_t    atrace_batch_key;
+
+static void atrace_batch_flush(struct atrace_batch* batch);
 
 static bool atrace_init_container_sock()
 {
@@ -53,6 +80,13 @@ static bool atrace_init_container_sock()
 
 static void atrace_close_container_sock()
 {
+    // Zygote forks right after, so the events of this thread must not be left behind.
+    if (atrace_batch_events) {
+        struct atrace_batch* batch =
+            static_cast<struct atrace_batch*>(pthread_getspecific(atrace_batch_key));
+        if (batch != NULL) atrace_batch_flush(batch);
+    }
+
     pthread_rwlock_wrlock(&atrace_container_sock_rwlock);
     if (atrace_container_sock_fd != -1) close(atrace_container_sock_fd);
     atrace_container_sock_fd = -1;
@@ -80,6 +114,77 @@ void atrace_set_tracing_enabled(bool enabled)
     atrace_update_tags();
 }
 
+static void atrace_batch_flush(struct atrace_batch* batch)
+{
+    pthread_rwlock_rdlock(&atrace_container_sock_rwlock);
+    size_t sent = 0;
+    while (atrace_container_sock_fd != -1 && sent < batch->count) {
+        int ret = TEMP_FAILURE_RETRY(sendmmsg(atrace_container_sock_fd, batch->msgs + sent,
+                                              batch->count - sent, 0));
+        if (ret <= 0) break;
+        sent += ret;
+    }
+    pthread_rwlock_unlock(&atrace_container_sock_rwlock);
+
+    batch->count = 0;
+    batch->used = 0;
+}
+
+static void atrace_batch_destroy(void* batch)
+{
+    atrace_batch_flush(static_cast<struct atrace_batch*>(batch));
+    free(batch);
+}
+
+// Thread-specific data isn't destroyed when the process exits.
+static void atrace_batch_flush_at_exit()
+{
+    void* batch = pthread_getspecific(atrace_batch_key);
+    if (batch != NULL) atrace_batch_flush(static_cast<struct atrace_batch*>(batch));
+}
+
+// Returns the batch of the calling thread, with room for another event, or
+// NULL if the events are to be sent one at a time.
+static struct atrace_batch* atrace_get_batch()
+{
+    if (CC_LIKELY(!atrace_batch_events)) return NULL;
+
+    struct atrace_batch* batch =
+        static_cast<struct atrace_batch*>(pthread_getspecific(atrace_batch_key));
+    if (CC_UNLIKELY(batch == NULL)) {
+        batch = static_cast<struct atrace_batch*>(calloc(1, sizeof(struct atrace_batch)));
+        if (batch == NULL || pthread_setspecific(atrace_batch_key, batch) != 0) {
+            free(batch);
+            return NULL;
+        }
+        for (size_t i = 0; i < CONTAINER_ATRACE_BATCH_EVENTS; i++) {
+            batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+            batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    if (batch->used + CONTAINER_ATRACE_MESSAGE_LENGTH > CONTAINER_ATRACE_BATCH_BYTES) {
+        atrace_batch_flush(batch);
+    }
+    return batch;
+}
+
+// Adds the event of len bytes formatted at the end of the batch.
+static void atrace_batch_add(struct atrace_batch* batch, int len, uint64_t ts)
+{
+    if (len <= 0) return;
+
+    batch->iovs[batch->count].iov_base = batch->data + batch->used;
+    batch->iovs[batch->count].iov_len = len;
+    if (batch->count++ == 0) batch->first_ts = ts;
+    batch->used += len;
+
+    if (batch->count == CONTAINER_ATRACE_BATCH_EVENTS ||
+            ts - batch->first_ts >= CONTAINER_ATRACE_BATCH_DELAY_US) {
+        atrace_batch_flush(batch);
+    }
+}
+
 static void atrace_init_once()
 {
     atrace_marker_fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
@@ -101,6 +206,12 @@ static void atrace_init_once()
             atrace_enabled_tags = 0;
             goto done;
         }
+
+        if (property_get_bool("debug.atrace.container_batch", false) &&
+                pthread_key_create(&atrace_batch_key, atrace_batch_destroy) == 0) {
+            atexit(atrace_batch_flush_at_exit);
+            atrace_batch_events = true;
+        }
     }
     atrace_enabled_tags = atrace_get_property();
 
@@ -120,25 +231,24 @@ static inline uint64_t gettime(clockid_t clk_id)
     return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-// Write trace events to container trace file. Note that we need to amend tid and time information
-// here comparing to normal ftrace, where those informations are added by kernel.
-#define WRITE_MSG_IN_CONTAINER_LOCKED(ph, sep_before_name, value_format, name, value) { \
-    char buf[CONTAINER_ATRACE_MESSAGE_LENGTH]; \
+// Format trace events for the container trace file. Note that we need to amend tid and time
+// information here comparing to normal ftrace, where those informations are added by kernel.
+#define FORMAT_MSG_IN_CONTAINER(buf, size, len, ts, ph, sep_before_name, value_format, name, \
+                                value) { \
     int pid = getpid(); \
     int tid = gettid(); \
-    uint64_t ts = gettime(CLOCK_MONOTONIC); \
     uint64_t tts = gettime(CLOCK_THREAD_CPUTIME_ID); \
-    int len = snprintf( \
-            buf, sizeof(buf), \
+    len = snprintf( \
+            buf, size, \
             ph "|%d|%d|%" PRIu64 "|%" PRIu64 sep_before_name "%s" value_format, \
             pid, tid, ts, tts, name, value); \
-    if (len >= (int) sizeof(buf)) { \
-        int name_len = strlen(name) - (len - sizeof(buf)) - 1; \
+    if (len >= (int) (size)) { \
+        int name_len = strlen(name) - (len - (size)) - 1; \
         /* Truncate the name to make the message fit. */ \
         if (name_len > 0) { \
             ALOGW("Truncated name in %s: %s\n", __FUNCTION__, name); \
             len = snprintf( \
-                    buf, sizeof(buf), \
+                    buf, size, \
                     ph "|%d|%d|%" PRIu64 "|%" PRIu64 sep_before_name "%.*s" value_format, \
                     pid, tid, ts, tts, name_len, name, value); \
         } else { \
@@ -147,17 +257,28 @@ static inline uint64_t gettime(clockid_t clk_id)
             len = 0; \
         } \
     } \
-    if (len > 0) { \
-        write(atrace_container_sock_fd, buf, len); \
-    } \
 }
 
 #define WRITE_MSG_IN_CONTAINER(ph, sep_before_name, value_format, name, value) { \
-    pthread_rwlock_rdlock(&atrace_container_sock_rwlock); \
-    if (atrace_container_sock_fd != -1) { \
-       WRITE_MSG_IN_CONTAINER_LOCKED(ph, sep_before_name, value_format, name, value); \
+    uint64_t ts = gettime(CLOCK_MONOTONIC); \
+    int len; \
+    struct atrace_batch* batch = atrace_get_batch(); \
+    if (batch != NULL) { \
+        FORMAT_MSG_IN_CONTAINER(batch->data + batch->used, CONTAINER_ATRACE_MESSAGE_LENGTH, \
+                                len, ts, ph, sep_before_name, value_format, name, value); \
+        atrace_batch_add(batch, len, ts); \
+    } else { \
+        pthread_rwlock_rdlock(&atrace_container_sock_rwlock); \
+        if (atrace_container_sock_fd != -1) { \
+            char buf[CONTAINER_ATRACE_MESSAGE_LENGTH]; \
+            FORMAT_MSG_IN_CONTAINER(buf, sizeof(buf), len, ts, ph, sep_before_name, \
+                                    value_format, name, value); \
+            if (len > 0) { \
+                write(atrace_container_sock_fd, buf, len); \
+            } \
+        } \
+        pthread_rwlock_unlock(&atrace_container_sock_rwlock); \
     } \
-    pthread_rwlock_unlock(&atrace_container_sock_rwlock); \
 }
 
 void atrace_begin_body(const char* name)
@@ -50,6 +50,36 @@ int ion_query_get_heaps(int fd, int cnt, void* buffers);
 
 int ion_is_legacy(int fd);
 
+/**
+  * Pool of buffers allocated with ion_alloc_fd(), for clients that allocate
+  * and free buffers of the same size and heap over and over. Freed buffers are
+  * kept, up to |budget| bytes of them, and handed out again by later
+  * allocations of the same heap mask, flags and size class. Sizes are rounded
+  * up to their class, at most 12.5% above the page-aligned size.
+  *
+  * |fd| is an ion fd from ion_open(), which must stay open while the pool is
+  * used. A pool can be used from several threads at once.
+  */
+struct ion_pool;
+
+/* Zero a recycled buffer, through a CPU mapping, before returning it. New
+ * buffers come zeroed from the kernel. */
+#define ION_POOL_FLAG_ZERO 1
+
+struct ion_pool* ion_pool_create(int fd, size_t budget);
+/* Closes the cached buffers. Buffers still allocated from the pool are left
+ * to the caller to close. */
+void ion_pool_destroy(struct ion_pool* pool);
+int ion_pool_alloc_fd(struct ion_pool* pool, size_t len, unsigned int heap_mask,
+                      unsigned int flags, unsigned int pool_flags, int* handle_fd);
+/* Returns a buffer from ion_pool_alloc_fd() to the pool, which then owns and
+ * eventually closes |handle_fd|. */
+int ion_pool_free_fd(struct ion_pool* pool, int handle_fd);
+/* Closes the least recently freed buffers until at most |max_size| bytes of
+ * them are left, e.g. under memory pressure. */
+void ion_pool_trim(struct ion_pool* pool, size_t max_size);
+size_t ion_pool_cached_size(struct ion_pool* pool);
+
 __END_DECLS
 
 #endif /* __SYS_CORE_ION_H */
@@ -0,0 +1,232 @@
+/*
+ *  ion_pool.c
+ *
+ * Recycling of ion buffers
+ *
+ *   Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#define LOG_TAG "ion"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <ion/ion.h>
+
+#include <log/log.h>
+
+struct ion_pool_buffer {
+    int fd;
+    unsigned int heap_mask;
+    unsigned int flags;
+    size_t size;
+};
+
+struct ion_pool_buffers {
+    struct ion_pool_buffer* buffers;
+    size_t count;
+    size_t capacity;
+};
+
+struct ion_pool {
+    int ion_fd;
+    size_t budget;
+    pthread_mutex_t lock;
+    /* Freed buffers, oldest first, and their total size. */
+    struct ion_pool_buffers cached;
+    size_t cached_size;
+    /* Buffers allocated from the pool. */
+    struct ion_pool_buffers used;
+};
+
+/*
+ * Allocations are rounded up to a size class, so that buffers of nearly the
+ * same size can be recycled for one another. Classes are an eighth of a power
+ * of two apart, which wastes at most 12.5% of a buffer.
+ */
+static size_t ion_pool_size_class(size_t len) {
+    size_t page_size = getpagesize();
+    size_t step;
+
+    len = (len + page_size - 1) & ~(page_size - 1);
+    if (len <= 8 * page_size) return len;
+    step = ((size_t)1 << (sizeof(size_t) * 8 - 1 - __builtin_clzl(len))) / 8;
+    return (len + step - 1) & ~(step - 1);
+}
+
+static int ion_pool_push(struct ion_pool_buffers* array, const struct ion_pool_buffer* buffer) {
+    if (array->count == array->capacity) {
+        size_t capacity = array->capacity ? array->capacity * 2 : 16;
+        struct ion_pool_buffer* buffers =
+                realloc(array->buffers, capacity * sizeof(struct ion_pool_buffer));
+        if (buffers == NULL) return -ENOMEM;
+        array->buffers = buffers;
+        array->capacity = capacity;
+    }
+    array->buffers[array->count++] = *buffer;
+    return 0;
+}
+
+static void ion_pool_remove(struct ion_pool_buffers* array, size_t i) {
+    memmove(&array->buffers[i], &array->buffers[i + 1],
+            (array->count - i - 1) * sizeof(struct ion_pool_buffer));
+    array->count--;
+}
+
+/* Closes the oldest cached buffers until at most |max_size| bytes are left. */
+static void ion_pool_evict(struct ion_pool* pool, size_t max_size) {
+    size_t evicted = 0;
+
+    while (pool->cached_size > max_size) {
+        const struct ion_pool_buffer* buffer = &pool->cached.buffers[evicted++];
+        pool->cached_size -= buffer->size;
+        close(buffer->fd);
+    }
+    if (evicted > 0) {
+        memmove(pool->cached.buffers, &pool->cached.buffers[evicted],
+                (pool->cached.count - evicted) * sizeof(struct ion_pool_buffer));
+        pool->cached.count -= evicted;
+    }
+}
+
+static int ion_pool_zero(int fd, size_t size) {
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        int ret_errno = errno;
+
+        ALOGE("mmap failed: %s\n", strerror(ret_errno));
+        return -ret_errno;
+    }
+    memset(ptr, 0, size);
+    munmap(ptr, size);
+    return 0;
+}
+
+struct ion_pool* ion_pool_create(int fd, size_t budget) {
+    struct ion_pool* pool = calloc(1, sizeof(struct ion_pool));
+    if (pool == NULL) return NULL;
+
+    pool->ion_fd = fd;
+    pool->budget = budget;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void ion_pool_destroy(struct ion_pool* pool) {
+    if (pool == NULL) return;
+
+    ion_pool_evict(pool, 0);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->cached.buffers);
+    free(pool->used.buffers);
+    free(pool);
+}
+
+int ion_pool_alloc_fd(struct ion_pool* pool, size_t len, unsigned int heap_mask,
+                      unsigned int flags, unsigned int pool_flags, int* handle_fd) {
+    struct ion_pool_buffer buffer = {
+        .fd = -1, .heap_mask = heap_mask, .flags = flags, .size = ion_pool_size_class(len),
+    };
+    int ret;
+
+    if (pool == NULL || handle_fd == NULL || len == 0) return -EINVAL;
+
+    /* Recycle the most recently freed buffer that fits. */
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = pool->cached.count; i-- > 0;) {
+        const struct ion_pool_buffer* cached = &pool->cached.buffers[i];
+        if (cached->size == buffer.size && cached->heap_mask == heap_mask &&
+            cached->flags == flags) {
+            buffer.fd = cached->fd;
+            pool->cached_size -= cached->size;
+            ion_pool_remove(&pool->cached, i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (buffer.fd < 0) {
+        ret = ion_alloc_fd(pool->ion_fd, buffer.size, 0, heap_mask, flags, &buffer.fd);
+        if (ret < 0) return ret;
+    } else if (pool_flags & ION_POOL_FLAG_ZERO) {
+        ret = ion_pool_zero(buffer.fd, buffer.size);
+        if (ret < 0) {
+            close(buffer.fd);
+            return ret;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    ret = ion_pool_push(&pool->used, &buffer);
+    pthread_mutex_unlock(&pool->lock);
+    if (ret < 0) {
+        close(buffer.fd);
+        return ret;
+    }
+
+    *handle_fd = buffer.fd;
+    return 0;
+}
+
+int ion_pool_free_fd(struct ion_pool* pool, int handle_fd) {
+    struct ion_pool_buffer buffer;
+    size_t i;
+
+    if (pool == NULL) return -EINVAL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < pool->used.count; i++) {
+        if (pool->used.buffers[i].fd == handle_fd) break;
+    }
+    if (i == pool->used.count) {
+        pthread_mutex_unlock(&pool->lock);
+        return -EINVAL;
+    }
+    buffer = pool->used.buffers[i];
+    pool->used.buffers[i] = pool->used.buffers[--pool->used.count];
+
+    if (buffer.size > pool->budget) {
+        close(buffer.fd);
+    } else {
+        ion_pool_evict(pool, pool->budget - buffer.size);
+        if (ion_pool_push(&pool->cached, &buffer) < 0) {
+            close(buffer.fd);
+        } else {
+            pool->cached_size += buffer.size;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void ion_pool_trim(struct ion_pool* pool, size_t max_size) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    ion_pool_evict(pool, max_size);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t ion_pool_cached_size(struct ion_pool* pool) {
+    size_t size;
+
+    pthread_mutex_lock(&pool->lock);
+    size = pool->cached_size;
+    pthread_mutex_unlock(&pool->lock);
+    return size;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <gtest/gtest.h>
+
+#include <ion/ion.h>
+#include "ion_test_fixture.h"
+
+class Pool : public IonAllHeapsTest {
+};
+
+TEST_F(Pool, Recycle)
+{
+    static const size_t size = 64*1024;
+    for (unsigned int heapMask : m_allHeaps) {
+        SCOPED_TRACE(::testing::Message() << "heap " << heapMask);
+        struct ion_pool* pool = ion_pool_create(m_ionFd, 4 * size);
+        ASSERT_TRUE(pool != NULL);
+
+        int fd = -1;
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, size, heapMask, 0, 0, &fd));
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd));
+        ASSERT_EQ(size, ion_pool_cached_size(pool));
+        ASSERT_EQ(-EINVAL, ion_pool_free_fd(pool, fd));
+
+        // A slightly smaller buffer of the same heap gets the same one back.
+        int recycled_fd = -1;
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, size - 4096, heapMask, 0, 0, &recycled_fd));
+        ASSERT_EQ(fd, recycled_fd);
+        ASSERT_EQ(0U, ion_pool_cached_size(pool));
+        ASSERT_EQ(0, ion_pool_free_fd(pool, recycled_fd));
+
+        ion_pool_destroy(pool);
+    }
+}
+
+TEST_F(Pool, Zero)
+{
+    static const size_t size = 64*1024;
+    for (unsigned int heapMask : m_allHeaps) {
+        SCOPED_TRACE(::testing::Message() << "heap " << heapMask);
+        struct ion_pool* pool = ion_pool_create(m_ionFd, size);
+        ASSERT_TRUE(pool != NULL);
+
+        int fd = -1;
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, size, heapMask, 0, 0, &fd));
+        void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ASSERT_TRUE(ptr != MAP_FAILED);
+        memset(ptr, 0xaa, size);
+        ASSERT_EQ(0, munmap(ptr, size));
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd));
+
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, size, heapMask, 0, ION_POOL_FLAG_ZERO, &fd));
+        ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        ASSERT_TRUE(ptr != MAP_FAILED);
+        for (size_t i = 0; i < size; i++) {
+            ASSERT_EQ(0, static_cast<unsigned char*>(ptr)[i]) << "offset " << i;
+        }
+        ASSERT_EQ(0, munmap(ptr, size));
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd));
+
+        ion_pool_destroy(pool);
+    }
+}
+
+TEST_F(Pool, Budget)
+{
+    static const size_t size = 64*1024;
+    for (unsigned int heapMask : m_allHeaps) {
+        SCOPED_TRACE(::testing::Message() << "heap " << heapMask);
+        struct ion_pool* pool = ion_pool_create(m_ionFd, 2 * size);
+        ASSERT_TRUE(pool != NULL);
+
+        int fds[3];
+        for (int& fd : fds) {
+            ASSERT_EQ(0, ion_pool_alloc_fd(pool, size, heapMask, 0, 0, &fd));
+        }
+        for (int fd : fds) {
+            ASSERT_EQ(0, ion_pool_free_fd(pool, fd));
+        }
+        ASSERT_EQ(2 * size, ion_pool_cached_size(pool));
+
+        ion_pool_trim(pool, size);
+        ASSERT_EQ(size, ion_pool_cached_size(pool));
+        ion_pool_trim(pool, 0);
+        ASSERT_EQ(0U, ion_pool_cached_size(pool));
+
+        ion_pool_destroy(pool);
+    }
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Asynchronous logd transport, selected with LOGGER_ASYNC.
+ *
+ * The caller copies its entry into a bounded lock-free ring and returns; a
+ * helper thread drains the ring in batches and writes the entries to logd
+ * on behalf of the original thread. Should the ring be full, or the entry
+ * be important (crash buffer, error or fatal priority), the ring is flushed
+ * and the entry written synchronously by the caller, so nothing is lost to
+ * a full queue or an imminent abort.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <log/uio.h>
+#include <private/android_logger.h>
+
+#include "config_write.h"
+#include "log_portability.h"
+#include "logger.h"
+
+/* Entries larger than this are written synchronously */
+#define ASYNC_PAYLOAD_MAX 512
+/* Must be a power of two */
+#define ASYNC_RING_SIZE 256
+
+struct async_slot {
+  atomic_uint_fast32_t sequence;
+  log_id_t logId;
+  pid_t tid;
+  struct timespec ts;
+  size_t len;
+  char payload[ASYNC_PAYLOAD_MAX];
+};
+
+static struct async_slot ring[ASYNC_RING_SIZE];
+static atomic_uint_fast32_t enqueuePos;
+static atomic_uint_fast32_t dequeuePos;
+static atomic_int flusherPid;
+static sem_t pending;
+
+static int asyncAvailable(log_id_t logId);
+static int asyncOpen();
+static void asyncClose();
+static int asyncWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                      size_t nr);
+
+LIBLOG_HIDDEN struct android_log_transport_write asyncLoggerWrite = {
+  .node = { &asyncLoggerWrite.node, &asyncLoggerWrite.node },
+  .context.priv = NULL,
+  .name = "async",
+  .available = asyncAvailable,
+  .open = asyncOpen,
+  .close = asyncClose,
+  .write = asyncWrite,
+};
+
+static int asyncAvailable(log_id_t logId) {
+  extern struct android_log_transport_write logdLoggerWrite;
+
+  return (*logdLoggerWrite.available)(logId);
+}
+
+/* Returns false if the ring is empty */
+static bool asyncFlushOne() {
+  struct async_slot* slot;
+  uint_fast32_t pos = atomic_load_explicit(&dequeuePos, memory_order_relaxed);
+  struct iovec vec;
+
+  for (;;) {
+    slot = &ring[pos & (ASYNC_RING_SIZE - 1)];
+    uint_fast32_t seq =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&dequeuePos, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = atomic_load_explicit(&dequeuePos, memory_order_relaxed);
+    }
+  }
+
+  vec.iov_base = slot->payload;
+  vec.iov_len = slot->len;
+  __android_log_logd_write(slot->logId, slot->tid, &slot->ts, &vec, 1);
+
+  atomic_store_explicit(&slot->sequence, pos + ASYNC_RING_SIZE,
+                        memory_order_release);
+  return true;
+}
+
+static void asyncFlush() {
+  while (asyncFlushOne()) {
+  }
+}
+
+static void* asyncFlusher(void* obj __unused) {
+  for (;;) {
+    if (sem_wait(&pending) && (errno == EINTR)) {
+      continue;
+    }
+    asyncFlush();
+  }
+  return NULL;
+}
+
+/* Start the helper thread once per process, forked children included */
+static void asyncStartFlusher() {
+  pid_t pid = getpid();
+  int expected = atomic_load(&flusherPid);
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  if (expected == pid) {
+    return;
+  }
+  if (!atomic_compare_exchange_strong(&flusherPid, &expected, pid)) {
+    return;
+  }
+  sem_init(&pending, 0, 0);
+  if (pthread_attr_init(&attr)) {
+    atomic_store(&flusherPid, 0);
+    return;
+  }
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, asyncFlusher, NULL)) {
+    atomic_store(&flusherPid, 0);
+  }
+  pthread_attr_destroy(&attr);
+}
+
+static void asyncAtExit() {
+  asyncFlush();
+}
+
+/* log_init_lock assumed */
+static int asyncOpen() {
+  extern struct android_log_transport_write logdLoggerWrite;
+  static bool initialized;
+
+  if (!initialized) {
+    uint_fast32_t i;
+
+    for (i = 0; i < ASYNC_RING_SIZE; ++i) {
+      atomic_init(&ring[i].sequence, i);
+    }
+    atexit(asyncAtExit);
+    initialized = true;
+  }
+
+  return (*logdLoggerWrite.open)();
+}
+
+static void asyncClose() {
+  extern struct android_log_transport_write logdLoggerWrite;
+
+  asyncFlush();
+  (*logdLoggerWrite.close)();
+}
+
+static bool asyncImportant(log_id_t logId, struct iovec* vec, size_t nr) {
+  if ((logId == LOG_ID_CRASH) || (logId == LOG_ID_SECURITY)) {
+    return true;
+  }
+  if ((logId == LOG_ID_EVENTS) || (logId == LOG_ID_STATS) || !nr ||
+      (vec[0].iov_len < 1)) {
+    return false;
+  }
+  return *(const unsigned char*)vec[0].iov_base >= ANDROID_LOG_ERROR;
+}
+
+static int asyncWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                      size_t nr) {
+  struct async_slot* slot;
+  uint_fast32_t pos;
+  size_t i, len;
+  char* cp;
+
+  for (len = i = 0; i < nr; ++i) {
+    len += vec[i].iov_len;
+  }
+  if ((len > ASYNC_PAYLOAD_MAX) || asyncImportant(logId, vec, nr)) {
+    goto synchronous;
+  }
+
+  asyncStartFlusher();
+
+  pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+  for (;;) {
+    slot = &ring[pos & (ASYNC_RING_SIZE - 1)];
+    uint_fast32_t seq =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&enqueuePos, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      goto synchronous; /* full */
+    } else {
+      pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+    }
+  }
+
+  slot->logId = logId;
+  slot->tid = gettid();
+  slot->ts = *ts;
+  slot->len = len;
+  for (cp = slot->payload, i = 0; i < nr; ++i) {
+    memcpy(cp, vec[i].iov_base, vec[i].iov_len);
+    cp += vec[i].iov_len;
+  }
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+  sem_post(&pending);
+
+  return len;
+
+synchronous:
+  /* keep order with what is already queued */
+  asyncFlush();
+  return __android_log_logd_write(logId, gettid(), ts, vec, nr);
+}
@@ -62,8 +62,8 @@ LIBLOG_HIDDEN void __android_log_config_read() {
   }
 
 #if (FAKE_LOG_DEVICE == 0)
-  if ((__android_log_transport == LOGGER_DEFAULT) ||
-      (__android_log_transport & LOGGER_LOGD)) {
+  if (((__android_log_transport & ~LOGGER_PMSG_COALESCE) == LOGGER_DEFAULT) ||
+      (__android_log_transport & (LOGGER_LOGD | LOGGER_ASYNC))) {
     extern struct android_log_transport_read logdLoggerRead;
     extern struct android_log_transport_read pmsgLoggerRead;
 
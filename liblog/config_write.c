@@ -62,14 +62,18 @@ LIBLOG_HIDDEN void __android_log_config_write() {
                                 &localLoggerWrite);
   }
 
-  if ((__android_log_transport == LOGGER_DEFAULT) ||
-      (__android_log_transport & LOGGER_LOGD)) {
+  if (((__android_log_transport & ~LOGGER_PMSG_COALESCE) == LOGGER_DEFAULT) ||
+      (__android_log_transport & (LOGGER_LOGD | LOGGER_ASYNC))) {
 #if (FAKE_LOG_DEVICE == 0)
     extern struct android_log_transport_write logdLoggerWrite;
+    extern struct android_log_transport_write asyncLoggerWrite;
     extern struct android_log_transport_write pmsgLoggerWrite;
 
+    /* async queues in front of logd, never both */
     __android_log_add_transport(&__android_log_transport_write,
-                                &logdLoggerWrite);
+                                (__android_log_transport & LOGGER_ASYNC)
+                                    ? &asyncLoggerWrite
+                                    : &logdLoggerWrite);
     __android_log_add_transport(&__android_log_persist_write, &pmsgLoggerWrite);
 #else
     extern struct android_log_transport_write fakeLoggerWrite;
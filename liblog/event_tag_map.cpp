@@ -29,10 +29,12 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include <log/event_tag_map.h>
 #include <log/log_properties.h>
 #include <private/android_logger.h>
+#include <private/android_logger_tag_hash.h>
 #include <utils/FastStrcmp.h>
 #include <utils/RWLock.h>
 
@@ -124,6 +126,10 @@ struct EventTagMap {
   std::unordered_map<MapString, uint32_t> Tag2Idx;
   // protect unordered sets
   android::RWLock rwlock;
+  // Entries parsed from the map files, frozen before the map is handed out
+  // and searched without taking rwlock. Values point into Idx2TagFmt,
+  // whose entries are never erased while the map is open.
+  android::EventTagHash<const TagFmt*> frozen;
 
  public:
   EventTagMap() {
@@ -144,6 +150,7 @@ struct EventTagMap {
   }
 
   bool emplaceUnique(uint32_t tag, const TagFmt& tagfmt, bool verbose = false);
+  void freeze();
   const TagFmt* find(uint32_t tag) const;
   int find(TagFmt&& tagfmt) const;
   int find(MapString&& tag) const;
@@ -205,7 +212,20 @@ bool EventTagMap::emplaceUnique(uint32_t tag, const TagFmt& tagfmt,
   return ret;
 }
 
+void EventTagMap::freeze() {
+  std::vector<std::pair<uint32_t, const TagFmt*>> entries;
+  android::RWLock::AutoRLock readLock(rwlock);
+  entries.reserve(Idx2TagFmt.size());
+  for (const auto& it : Idx2TagFmt) {
+    entries.emplace_back(it.first, &it.second);
+  }
+  frozen.build(entries);
+}
+
 const TagFmt* EventTagMap::find(uint32_t tag) const {
+  const TagFmt* const* found = frozen.find(tag);
+  if (found) return *found;
+
   std::unordered_map<uint32_t, TagFmt>::const_iterator it;
   android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
   it = Idx2TagFmt.find(tag);
@@ -474,6 +494,7 @@ LIBLOG_ABI_PUBLIC EventTagMap* android_openEventTagMap(const char* fileName) {
     }
     /* See 'fd DONE' comments above and below, no need to clean up here */
   }
+  newTagMap->freeze();
 
   return newTagMap;
 
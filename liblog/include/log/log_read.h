@@ -199,7 +199,9 @@ struct log_msg {
 
 #ifndef __ANDROID_USE_LIBLOG_READER_INTERFACE
 #ifndef __ANDROID_API__
-#define __ANDROID_USE_LIBLOG_READER_INTERFACE 3
+#define __ANDROID_USE_LIBLOG_READER_INTERFACE 4
+#elif __ANDROID_API__ > 27 /* > Oreo */
+#define __ANDROID_USE_LIBLOG_READER_INTERFACE 4
 #elif __ANDROID_API__ > 23 /* > Marshmallow */
 #define __ANDROID_USE_LIBLOG_READER_INTERFACE 3
 #elif __ANDROID_API__ > 22 /* > Lollipop */
@@ -259,6 +261,38 @@ void android_logger_list_free(struct logger_list* logger_list);
 /* In the purest sense, the following two are orthogonal interfaces */
 int android_logger_list_read(struct logger_list* logger_list,
                              struct log_msg* log_msg);
+#if __ANDROID_USE_LIBLOG_READER_INTERFACE > 3
+/*
+ * Reads as many entries as are ready and fit in buf, blocking for the first
+ * one like android_logger_list_read(). From logd, many entries are received
+ * per system call, so the larger buf the fewer the calls. buf must be aligned
+ * like struct log_msg, and len at least sizeof(struct log_msg).
+ * Returns the number of bytes of entries stored in buf, 0 at the end of the
+ * logs, or a negative errno. Walk them with android_logger_batch_next().
+ */
+int android_logger_list_read_batch(struct logger_list* logger_list, void* buf,
+                                   size_t len);
+
+/*
+ * Returns the entry at *offset of the len bytes of entries that
+ * android_logger_list_read_batch() returned in buf, and moves *offset to the
+ * next one, or returns NULL past the last one. Start with *offset at 0.
+ * Entries are not copied out of buf: each is a header of entry->hdr_size
+ * bytes, fields past it being part of the payload, followed by entry->len
+ * bytes of payload.
+ */
+static inline struct logger_entry_v4* android_logger_batch_next(
+    void* buf, int len, size_t* offset) {
+  struct logger_entry_v4* entry;
+
+  if ((len <= 0) || (*offset + sizeof(struct logger_entry) > (size_t)len)) {
+    return NULL;
+  }
+  entry = (struct logger_entry_v4*)((char*)buf + *offset);
+  *offset += (entry->hdr_size + entry->len + 3) & ~3;
+  return entry;
+}
+#endif
 
 /* Multiple log_id_t opens */
 struct logger* android_logger_open(struct logger_list* logger_list, log_id_t id);
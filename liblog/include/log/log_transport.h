@@ -24,6 +24,8 @@ extern "C" {
 #define LOGGER_NULL    0x04 /* Does not release resources of other selections */
 #define LOGGER_LOCAL   0x08 /* logs sent to local memory */
 #define LOGGER_STDERR  0x10 /* logs sent to stderr */
+#define LOGGER_ASYNC   0x20 /* logs to logd queued, written by a helper thread */
+#define LOGGER_PMSG_COALESCE 0x40 /* pmsg writes batched per thread */
 /* clang-format on */
 
 /* Both return the selected transport flag mask, or negative errno */
@@ -105,6 +105,16 @@ int android_log_addFilterRule(AndroidLogFormat* p_format,
 int android_log_addFilterString(AndroidLogFormat* p_format,
                                 const char* filterString);
 
+/**
+ * Summarizes the filters for the log source to apply ahead of us. Returns
+ * the lowest priority any tag can print at. If every tag not named by a
+ * filter is silent, fills tags with a comma separated list of the named
+ * tags that can print, otherwise, or if the list does not fit in len, tags
+ * is set to the empty string.
+ */
+android_LogPriority android_log_getFilterHint(AndroidLogFormat* p_format,
+                                              char* tags, size_t len);
+
 /**
  * returns 1 if this log line should be printed based on its priority
  * and tag, and 0 if it should not
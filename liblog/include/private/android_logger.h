@@ -150,9 +150,21 @@ bool __android_logger_property_get_bool(const char* key, int flag);
 unsigned long __android_logger_get_buffer_size(log_id_t logId);
 bool __android_logger_valid_buffer_size(unsigned long value);
 
+/* Reader side filter hint for logd, see logger_read.c */
+struct logger_list;
+int __android_logger_list_set_filter(struct logger_list* logger_list,
+                                     int prio, const char* tags);
+
 /* Retrieve the composed event buffer */
 int android_log_write_list_buffer(android_log_context ctx, const char** msg);
 
+/*
+ * Write a binary event from a vector, the first element of which holds the
+ * tag. Only for LOG_ID_EVENTS, LOG_ID_STATS and LOG_ID_SECURITY.
+ */
+struct iovec;
+int __android_log_event_writev(log_id_t logId, struct iovec* vec, size_t nr);
+
 #ifdef __cplusplus
 #ifdef __class_android_log_event_list_defined
 #ifndef __class_android_log_event_list_private_defined
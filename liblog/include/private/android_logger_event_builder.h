@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Allocation free event list writer for a field list known at compile time */
+
+#ifndef _SYSTEM_CORE_INCLUDE_PRIVATE_ANDROID_LOGGER_EVENT_BUILDER_H_
+#define _SYSTEM_CORE_INCLUDE_PRIVATE_ANDROID_LOGGER_EVENT_BUILDER_H_
+
+#if defined(__cplusplus)
+
+#include <stdint.h>
+#include <string.h>
+
+#include <type_traits>
+
+#if defined(_USING_LIBCXX)
+#include <string>
+#endif
+
+#include <log/log.h>
+#include <log/uio.h>
+#include <private/android_logger.h>
+
+namespace android {
+
+/*
+ * Serializes an event of the given fields, in order, exactly as
+ * android_log_event_list would: a list when there is more than one field,
+ * the bare element otherwise. The type bytes, scalars and string lengths go
+ * to a buffer on the stack sized at compile time, string contents are
+ * referenced from the caller's memory, and the whole is handed to the
+ * transports as one iovec, so there is no heap allocation and no copy into
+ * an intermediate LOGGER_ENTRY_MAX_PAYLOAD buffer.
+ *
+ *   android::EventBuilder<int32_t, int64_t, const char*> event(tag);
+ *   event.write(LOG_ID_EVENTS, pid, elapsed, name);
+ *
+ * Or, deducing the fields from the arguments:
+ *
+ *   android::writeEvent(LOG_ID_STATS, tag, pid, elapsed, name);
+ *
+ * Nested lists are not supported, use android_log_event_list for those.
+ * Strings that would overflow the payload are truncated, the same as
+ * android_log_write_string8_len() does.
+ */
+
+template <typename T>
+struct EventField;
+
+template <>
+struct EventField<int32_t> {
+  static constexpr size_t kSize = sizeof(uint8_t) + sizeof(int32_t);
+  static constexpr bool kString = false;
+  static uint8_t* put(uint8_t* p, int32_t value) {
+    *p++ = EVENT_TYPE_INT;
+    return put4LE(p, value);
+  }
+  static uint8_t* put4LE(uint8_t* p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+    return p + sizeof(value);
+  }
+};
+
+template <>
+struct EventField<uint32_t> : EventField<int32_t> {};
+
+template <>
+struct EventField<bool> : EventField<int32_t> {};
+
+template <>
+struct EventField<int64_t> {
+  static constexpr size_t kSize = sizeof(uint8_t) + sizeof(int64_t);
+  static constexpr bool kString = false;
+  static uint8_t* put(uint8_t* p, int64_t value) {
+    *p++ = EVENT_TYPE_LONG;
+    p = EventField<int32_t>::put4LE(p, static_cast<uint64_t>(value));
+    return EventField<int32_t>::put4LE(p, static_cast<uint64_t>(value) >> 32);
+  }
+};
+
+template <>
+struct EventField<uint64_t> : EventField<int64_t> {};
+
+template <>
+struct EventField<float> {
+  static constexpr size_t kSize = sizeof(uint8_t) + sizeof(float);
+  static constexpr bool kString = false;
+  static uint8_t* put(uint8_t* p, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    *p++ = EVENT_TYPE_FLOAT;
+    return EventField<int32_t>::put4LE(p, bits);
+  }
+};
+
+/* Only the type and length are serialized, contents stay where they are */
+template <>
+struct EventField<const char*> {
+  static constexpr size_t kSize = sizeof(uint8_t) + sizeof(int32_t);
+  static constexpr bool kString = true;
+  static const char* data(const char* value) {
+    return value ? value : "";
+  }
+  static size_t length(const char* value) {
+    return value ? strlen(value) : 0;
+  }
+};
+
+template <>
+struct EventField<char*> : EventField<const char*> {};
+
+#if defined(_USING_LIBCXX)
+template <>
+struct EventField<std::string> {
+  static constexpr size_t kSize = sizeof(uint8_t) + sizeof(int32_t);
+  static constexpr bool kString = true;
+  static const char* data(const std::string& value) {
+    return value.data();
+  }
+  static size_t length(const std::string& value) {
+    return value.length();
+  }
+};
+#endif
+
+template <typename... Fields>
+class EventBuilder {
+  template <typename... T>
+  struct Sum {
+    static constexpr size_t kSize = 0;
+    static constexpr size_t kStrings = 0;
+  };
+  template <typename T, typename... Rest>
+  struct Sum<T, Rest...> {
+    static constexpr size_t kSize = EventField<T>::kSize + Sum<Rest...>::kSize;
+    static constexpr size_t kStrings =
+        EventField<T>::kString + Sum<Rest...>::kStrings;
+  };
+
+ public:
+  static constexpr size_t kFields = sizeof...(Fields);
+  static constexpr size_t kListHeader =
+      (kFields > 1) ? (sizeof(uint8_t) + sizeof(uint8_t)) : 0;
+  /* Serialized size of everything but string contents */
+  static constexpr size_t kFixedSize = kListHeader + Sum<Fields...>::kSize;
+  static constexpr size_t kMaxPayload =
+      LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t);
+
+  static_assert(kFields > 0, "an event needs at least one field");
+  static_assert(kFields <= UINT8_MAX, "too many fields for an event list");
+  static_assert(kFixedSize <= kMaxPayload, "event does not fit a payload");
+
+  explicit EventBuilder(int32_t tag) : tag(tag) {
+  }
+
+  /* Returns what __android_log_bwrite() would have */
+  int write(log_id_t id, const Fields&... values) {
+    uint8_t storage[kFixedSize];
+    /* tag, then fixed bytes and string contents alternating */
+    struct iovec vec[2 + 2 * Sum<Fields...>::kStrings];
+    State state = { storage, vec + 1, storage, kMaxPayload - kFixedSize };
+
+    vec[0].iov_base = &tag;
+    vec[0].iov_len = sizeof(tag);
+    if (kListHeader) {
+      *state.p++ = EVENT_TYPE_LIST;
+      *state.p++ = kFields;
+    }
+    put(state, values...);
+    state.close();
+
+    return __android_log_event_writev(id, vec, state.vec - vec);
+  }
+
+ private:
+  int32_t tag;
+
+  struct State {
+    uint8_t* p;        /* next byte of storage */
+    struct iovec* vec; /* next free vector */
+    uint8_t* start;    /* storage not yet covered by a vector */
+    size_t left;       /* budget for string contents */
+
+    void close() {
+      if (p == start) return;
+      vec->iov_base = start;
+      vec->iov_len = p - start;
+      ++vec;
+      start = p;
+    }
+  };
+
+  static void put(State&) {
+  }
+
+  template <typename T, typename... Rest>
+  static void put(State& state, const T& value, const Rest&... rest) {
+    putOne(state, value, std::integral_constant<bool, EventField<T>::kString>());
+    put(state, rest...);
+  }
+
+  template <typename T>
+  static void putOne(State& state, const T& value, std::false_type) {
+    state.p = EventField<T>::put(state.p, value);
+  }
+
+  template <typename T>
+  static void putOne(State& state, const T& value, std::true_type) {
+    size_t len = EventField<T>::length(value);
+    if (len > state.left) len = state.left;
+    state.left -= len;
+    *state.p++ = EVENT_TYPE_STRING;
+    state.p = EventField<int32_t>::put4LE(state.p, len);
+    if (!len) return;
+    state.close();
+    state.vec->iov_base = const_cast<char*>(EventField<T>::data(value));
+    state.vec->iov_len = len;
+    ++state.vec;
+  }
+};
+
+template <typename... Args>
+int writeEvent(log_id_t id, int32_t tag, const Args&... values) {
+  /* decay const qualified so string literals become const char* */
+  return EventBuilder<typename std::decay<const Args>::type...>(tag).write(
+      id, values...);
+}
+
+}  // namespace android
+
+#endif /* __cplusplus */
+
+#endif /* _SYSTEM_CORE_INCLUDE_PRIVATE_ANDROID_LOGGER_EVENT_BUILDER_H_ */
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Frozen event tag lookup table shared by liblog and logd */
+
+#ifndef _SYSTEM_CORE_INCLUDE_PRIVATE_ANDROID_LOGGER_TAG_HASH_H_
+#define _SYSTEM_CORE_INCLUDE_PRIVATE_ANDROID_LOGGER_TAG_HASH_H_
+
+#if defined(__cplusplus)
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+/*
+ * A perfect hash from event tag number to T over a set of tags that is
+ * known in full up front, typically the content of event-log-tags. Built
+ * hash and displace style: tags are spread over buckets, and each bucket,
+ * largest first, is given the displacement that lands all of its tags in
+ * free slots. A lookup is then two hashes, two loads and a single compare.
+ *
+ * The table is never modified after build(), so it can be read from any
+ * number of threads without a lock provided it was built before it was
+ * shared. Tags registered later belong in a separate, locked, overflow map.
+ */
+template <typename T>
+class EventTagHash {
+  struct Slot {
+    uint32_t tag;
+    bool used;
+    T value;
+  };
+
+  std::vector<uint32_t> displacements;
+  std::vector<Slot> slots;
+
+  static uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+  }
+  uint32_t bucket(uint32_t tag) const {
+    return mix(tag) & (displacements.size() - 1);
+  }
+  uint32_t slot(uint32_t tag, uint32_t displacement) const {
+    return mix(tag + (displacement + 1) * 0x9e3779b9U) & (slots.size() - 1);
+  }
+
+ public:
+  /* Returns false, and stays empty, if no perfect hash was found */
+  bool build(const std::vector<std::pair<uint32_t, T>>& entries) {
+    displacements.clear();
+    slots.clear();
+    if (entries.empty()) return true;
+
+    size_t buckets = 1;
+    while ((buckets * 2) < entries.size()) buckets *= 2;
+    size_t size = 1;
+    while (size < (entries.size() + entries.size() / 2)) size *= 2;
+    displacements.resize(buckets);
+    slots.resize(size);
+
+    std::vector<std::vector<size_t>> members(buckets);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      members[bucket(entries[i].first)].push_back(i);
+    }
+    std::vector<size_t> order(buckets);
+    for (size_t i = 0; i < buckets; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&members](size_t a, size_t b) {
+      return members[a].size() > members[b].size();
+    });
+
+    std::vector<uint32_t> placed;
+    for (size_t b : order) {
+      if (members[b].empty()) break;
+      uint32_t d;
+      for (d = 0; d < 65536; ++d) {
+        placed.clear();
+        for (size_t i : members[b]) {
+          uint32_t s = slot(entries[i].first, d);
+          if (slots[s].used ||
+              (std::find(placed.begin(), placed.end(), s) != placed.end())) {
+            break;
+          }
+          placed.push_back(s);
+        }
+        if (placed.size() == members[b].size()) break;
+      }
+      if (d >= 65536) { /* duplicate tags, or very unlucky */
+        displacements.clear();
+        slots.clear();
+        return false;
+      }
+      displacements[b] = d;
+      for (size_t j = 0; j < placed.size(); ++j) {
+        Slot& entry = slots[placed[j]];
+        entry.tag = entries[members[b][j]].first;
+        entry.used = true;
+        entry.value = entries[members[b][j]].second;
+      }
+    }
+    return true;
+  }
+
+  const T* find(uint32_t tag) const {
+    if (slots.empty()) return nullptr;
+    const Slot& entry = slots[slot(tag, displacements[bucket(tag)])];
+    return (entry.used && (entry.tag == tag)) ? &entry.value : nullptr;
+  }
+
+  size_t size() const {
+    return slots.size();
+  }
+};
+
+}  // namespace android
+
+#endif /* __cplusplus */
+
+#endif /* _SYSTEM_CORE_INCLUDE_PRIVATE_ANDROID_LOGGER_TAG_HASH_H_ */
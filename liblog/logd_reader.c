@@ -49,6 +49,9 @@ static int logdVersion(struct android_log_logger* logger,
 static int logdRead(struct android_log_logger_list* logger_list,
                     struct android_log_transport_context* transp,
                     struct log_msg* log_msg);
+static int logdReadBatch(struct android_log_logger_list* logger_list,
+                         struct android_log_transport_context* transp,
+                         char* buf, size_t len);
 static int logdPoll(struct android_log_logger_list* logger_list,
                     struct android_log_transport_context* transp);
 static void logdClose(struct android_log_logger_list* logger_list,
@@ -78,6 +81,7 @@ LIBLOG_HIDDEN struct android_log_transport_read logdLoggerRead = {
   .available = logdAvailable,
   .version = logdVersion,
   .read = logdRead,
+  .readBatch = logdReadBatch,
   .poll = logdPoll,
   .close = logdClose,
   .clear = logdClear,
@@ -534,6 +538,22 @@ static int logdOpen(struct android_log_logger_list* logger_list,
   if (logger_list->pid) {
     ret = snprintf(cp, remaining, " pid=%u", logger_list->pid);
     ret = min(ret, remaining);
+    remaining -= ret;
+    cp += ret;
+  }
+
+  if (logger_list->prio > ANDROID_LOG_VERBOSE) {
+    ret = snprintf(cp, remaining, " prio=%d", logger_list->prio);
+    ret = min(ret, remaining);
+    remaining -= ret;
+    cp += ret;
+  }
+
+  /* a tag list that does not fit is dropped whole, reader filters anyway */
+  if (logger_list->tags &&
+      ((int)(strlen(logger_list->tags) + sizeof(" tags=")) < remaining)) {
+    ret = snprintf(cp, remaining, " tags=%s", logger_list->tags);
+    ret = min(ret, remaining);
     cp += ret;
   }
 
@@ -574,23 +594,16 @@ static int logdOpen(struct android_log_logger_list* logger_list,
   return sock;
 }
 
-/* Read from the selected logs */
-static int logdRead(struct android_log_logger_list* logger_list,
-                    struct android_log_transport_context* transp,
-                    struct log_msg* log_msg) {
-  int ret, e;
+/*
+ * ANDROID_LOG_NONBLOCK reads are bounded by an alarm, returns the alarm set
+ * for logdStopReadAlarm, or 0 if none.
+ */
+static unsigned int logdStartReadAlarm(
+    struct android_log_logger_list* logger_list,
+    struct sigaction* old_sigaction, unsigned int* old_alarm) {
   struct sigaction ignore;
-  struct sigaction old_sigaction;
-  unsigned int old_alarm = 0;
-
-  ret = logdOpen(logger_list, transp);
-  if (ret < 0) {
-    return ret;
-  }
-
-  memset(log_msg, 0, sizeof(*log_msg));
-
   unsigned int new_alarm = 0;
+
   if (logger_list->mode & ANDROID_LOG_NONBLOCK) {
     if ((logger_list->mode & ANDROID_LOG_WRAP) &&
         (logger_list->start.tv_sec || logger_list->start.tv_nsec)) {
@@ -605,9 +618,35 @@ static int logdRead(struct android_log_logger_list* logger_list,
     ignore.sa_handler = caught_signal;
     sigemptyset(&ignore.sa_mask);
     /* particularily useful if tombstone is reporting for logd */
-    sigaction(SIGALRM, &ignore, &old_sigaction);
-    old_alarm = alarm(new_alarm);
+    sigaction(SIGALRM, &ignore, old_sigaction);
+    *old_alarm = alarm(new_alarm);
   }
+  return new_alarm;
+}
+
+static void logdStopReadAlarm(struct sigaction* old_sigaction,
+                              unsigned int old_alarm) {
+  alarm(old_alarm);
+  sigaction(SIGALRM, old_sigaction, NULL);
+}
+
+/* Read from the selected logs */
+static int logdRead(struct android_log_logger_list* logger_list,
+                    struct android_log_transport_context* transp,
+                    struct log_msg* log_msg) {
+  int ret, e;
+  struct sigaction old_sigaction;
+  unsigned int old_alarm = 0;
+
+  ret = logdOpen(logger_list, transp);
+  if (ret < 0) {
+    return ret;
+  }
+
+  memset(log_msg, 0, sizeof(*log_msg));
+
+  unsigned int new_alarm =
+      logdStartReadAlarm(logger_list, &old_sigaction, &old_alarm);
 
   /* NOTE: SOCK_SEQPACKET guarantees we read exactly one full entry */
   ret = recv(ret, log_msg, LOGGER_ENTRY_MAX_LEN, 0);
@@ -618,8 +657,7 @@ static int logdRead(struct android_log_logger_list* logger_list,
       e = EAGAIN;
       ret = -1;
     }
-    alarm(old_alarm);
-    sigaction(SIGALRM, &old_sigaction, NULL);
+    logdStopReadAlarm(&old_sigaction, old_alarm);
   }
 
   if ((ret == -1) && e) {
@@ -628,6 +666,120 @@ static int logdRead(struct android_log_logger_list* logger_list,
   return ret;
 }
 
+/* Most entries received by one recvmmsg() */
+#define LOGD_READ_BATCH_MAX 64
+
+/*
+ * Fixes up the header of an entry of size bytes, as android_transport_read()
+ * does. Returns the bytes it takes in the batch, 0 to drop it, or -EINVAL.
+ */
+static int logdBatchEntry(struct logger_entry_v4* entry, unsigned int size) {
+  if (size < sizeof(entry->len) + sizeof(entry->hdr_size)) {
+    return 0;
+  }
+  if (size > LOGGER_ENTRY_MAX_LEN) {
+    size = LOGGER_ENTRY_MAX_LEN;
+  }
+
+  /* hdr_size correction (logger_entry -> logger_entry_v2+ conversion) */
+  if (entry->hdr_size == 0) {
+    entry->hdr_size = sizeof(struct logger_entry);
+  }
+  if ((entry->hdr_size < sizeof(struct logger_entry)) ||
+      (entry->hdr_size > sizeof(struct logger_entry_v4))) {
+    return -EINVAL;
+  }
+  if (size <= entry->hdr_size) {
+    return 0;
+  }
+  entry->len = size - entry->hdr_size;
+  return (size + 3) & ~3;
+}
+
+/*
+ * Read as many entries as are ready. Entries are still sent by logd one per
+ * packet, recvmmsg() receives each in its own LOGGER_ENTRY_MAX_LEN slot of buf,
+ * and they are then moved down to follow each other. Later slots are never
+ * overwritten as no entry takes more than a slot.
+ */
+static int logdReadBatch(struct android_log_logger_list* logger_list,
+                         struct android_log_transport_context* transp,
+                         char* buf, size_t len) {
+  struct mmsghdr msgs[LOGD_READ_BATCH_MAX];
+  struct iovec iov[LOGD_READ_BATCH_MAX];
+  struct sigaction old_sigaction;
+  unsigned int old_alarm = 0;
+  size_t used = 0;
+  int flags = MSG_WAITFORONE;
+  int sock, ret, e;
+  unsigned int slots, i;
+
+  sock = logdOpen(logger_list, transp);
+  if (sock < 0) {
+    return sock;
+  }
+
+  do {
+    slots = min((len - used) / LOGGER_ENTRY_MAX_LEN, LOGD_READ_BATCH_MAX);
+    if (slots == 0) {
+      break;
+    }
+    memset(msgs, 0, sizeof(msgs[0]) * slots);
+    for (i = 0; i < slots; ++i) {
+      iov[i].iov_base = buf + used + i * LOGGER_ENTRY_MAX_LEN;
+      iov[i].iov_len = LOGGER_ENTRY_MAX_LEN;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if (flags & MSG_DONTWAIT) {
+      ret = recvmmsg(sock, msgs, slots, flags, NULL);
+      if (ret < 0) {
+        /* Nothing more ready, or an error the next read reports. */
+        break;
+      }
+    } else {
+      unsigned int new_alarm =
+          logdStartReadAlarm(logger_list, &old_sigaction, &old_alarm);
+      ret = recvmmsg(sock, msgs, slots, flags, NULL);
+      e = errno;
+      if (new_alarm) {
+        if (e == EINTR) {
+          e = EAGAIN;
+        }
+        logdStopReadAlarm(&old_sigaction, old_alarm);
+      }
+      if (ret < 0) {
+        return e ? -e : -EIO;
+      }
+      flags |= MSG_DONTWAIT;
+    }
+
+    for (i = 0; i < (unsigned int)ret; ++i) {
+      char* entry = iov[i].iov_base;
+      int size;
+
+      if (msgs[i].msg_len == 0) {
+        /* logd closed the socket, at the end of a ANDROID_LOG_NONBLOCK dump */
+        if (used == 0 && (logger_list->mode & ANDROID_LOG_NONBLOCK)) {
+          return -EAGAIN;
+        }
+        return used;
+      }
+      size = logdBatchEntry((struct logger_entry_v4*)entry, msgs[i].msg_len);
+      if (size < 0) {
+        return used ? (int)used : size;
+      }
+      if (size > 0) {
+        memmove(buf + used, entry, size);
+        used += size;
+      }
+    }
+  } while ((unsigned int)ret == slots);
+
+  return used;
+}
+
 static int logdPoll(struct android_log_logger_list* logger_list,
                     struct android_log_transport_context* transp) {
   struct pollfd p;
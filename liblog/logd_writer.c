@@ -126,6 +126,13 @@ static int logdAvailable(log_id_t logId) {
 
 static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
                      size_t nr) {
+  return __android_log_logd_write(logId, gettid(), ts, vec, nr);
+}
+
+/* Also used by the async transport to write on behalf of thread tid */
+LIBLOG_HIDDEN int __android_log_logd_write(log_id_t logId, pid_t tid,
+                                           struct timespec* ts,
+                                           struct iovec* vec, size_t nr) {
   ssize_t ret;
   int sock;
   static const unsigned headerLength = 1;
@@ -173,7 +180,7 @@ static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
    *  };
    */
 
-  header.tid = gettid();
+  header.tid = tid;
   header.realtime.tv_sec = ts->tv_sec;
   header.realtime.tv_nsec = ts->tv_nsec;
 
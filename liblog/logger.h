@@ -73,6 +73,13 @@ struct android_log_transport_read {
   int (*read)(struct android_log_logger_list* logger_list,
               struct android_log_transport_context* transp,
               struct log_msg* log_msg);
+  /*
+   * Optional, reads as many entries as are ready and fit in buf, as laid out
+   * for android_logger_list_read_batch(). Returns the bytes used.
+   */
+  int (*readBatch)(struct android_log_logger_list* logger_list,
+                   struct android_log_transport_context* transp, char* buf,
+                   size_t len);
   /* Must only be called if not ANDROID_LOG_NONBLOCK (blocking) */
   int (*poll)(struct android_log_logger_list* logger_list,
               struct android_log_transport_context* transp);
@@ -105,6 +112,8 @@ struct android_log_logger_list {
   unsigned int tail;
   log_time start;
   pid_t pid;
+  int prio;   /* reader side filter, text logs below this are not sent */
+  char* tags; /* comma separated text log tags to send, NULL for all */
 };
 
 struct android_log_logger {
@@ -195,6 +204,11 @@ LIBLOG_HIDDEN void __android_log_unlock();
 
 LIBLOG_HIDDEN int __android_log_transport;
 
+/* logd transport write on behalf of thread tid, furnished in logd_writer.c */
+LIBLOG_HIDDEN int __android_log_logd_write(log_id_t logId, pid_t tid,
+                                           struct timespec* ts,
+                                           struct iovec* vec, size_t nr);
+
 __END_DECLS
 
 #endif /* _LIBLOG_LOGGER_H__ */
@@ -16,6 +16,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sched.h>
 #include <stddef.h>
@@ -264,6 +265,39 @@ LIBLOG_ABI_PUBLIC struct logger_list* android_logger_list_alloc_time(
   return (struct logger_list*)logger_list;
 }
 
+/*
+ * Ask the log daemon to leave out text log entries below prio or, if tags is
+ * a comma separated list, entries with some other tag. Purely a hint to save
+ * the transfer, the caller must still apply its own filters.
+ */
+LIBLOG_ABI_PRIVATE int __android_logger_list_set_filter(
+    struct logger_list* logger_list, int prio, const char* tags) {
+  struct android_log_logger_list* logger_list_internal =
+      (struct android_log_logger_list*)logger_list;
+  char* copy = NULL;
+
+  if (!logger_list_internal) {
+    return -EINVAL;
+  }
+  if (tags && *tags) {
+    if (strchr(tags, ' ')) {
+      return -EINVAL;
+    }
+    copy = strdup(tags);
+    if (!copy) {
+      return -ENOMEM;
+    }
+  }
+
+  logger_list_wrlock();
+  free(logger_list_internal->tags);
+  logger_list_internal->tags = copy;
+  logger_list_internal->prio = prio;
+  logger_list_unlock();
+
+  return 0;
+}
+
 /* android_logger_list_register unimplemented, no use case */
 /* android_logger_list_unregister unimplemented, no use case */
 
@@ -463,6 +497,48 @@ LIBLOG_ABI_PUBLIC int android_logger_list_read(struct logger_list* logger_list,
   return android_transport_read(logger_list_internal, transp, log_msg);
 }
 
+/* Read as many entries as are ready and fit */
+LIBLOG_ABI_PUBLIC int android_logger_list_read_batch(
+    struct logger_list* logger_list, void* buf, size_t len) {
+  struct android_log_transport_context* transp;
+  struct android_log_logger_list* logger_list_internal =
+      (struct android_log_logger_list*)logger_list;
+  struct log_msg log_msg;
+  int ret;
+
+  if (!buf || (len < sizeof(log_msg))) {
+    return -EINVAL;
+  }
+  if (len > INT_MAX) {
+    len = INT_MAX;
+  }
+
+  ret = init_transport_context(logger_list_internal);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* at least one transport */
+  transp = node_to_item(logger_list_internal->transport.next,
+                        struct android_log_transport_context, node);
+
+  /* only one, that can batch? */
+  if ((transp->node.next == &logger_list_internal->transport) &&
+      transp->transport->readBatch) {
+    return (*transp->transport->readBatch)(logger_list_internal, transp,
+                                           (char*)buf, len);
+  }
+
+  /* otherwise entries are merge sorted, one entry at a time */
+  ret = android_logger_list_read(logger_list, &log_msg);
+  if (ret <= 0) {
+    return ret;
+  }
+  ret = log_msg.entry.hdr_size + log_msg.entry.len;
+  memcpy(buf, &log_msg, ret);
+  return ret;
+}
+
 /* Close all the logs */
 LIBLOG_ABI_PUBLIC void android_logger_list_free(struct logger_list* logger_list) {
   struct android_log_logger_list* logger_list_internal =
@@ -495,5 +571,6 @@ LIBLOG_ABI_PUBLIC void android_logger_list_free(struct logger_list* logger_list)
     android_logger_free((struct logger*)logger);
   }
 
+  free(logger_list_internal->tags);
   free(logger_list_internal);
 }
@@ -583,6 +583,19 @@ LIBLOG_ABI_PUBLIC int __android_log_security_bwrite(int32_t tag,
   return write_to_log(LOG_ID_SECURITY, vec, 2);
 }
 
+LIBLOG_ABI_PRIVATE int __android_log_event_writev(log_id_t logId,
+                                                 struct iovec* vec, size_t nr) {
+  if ((logId != LOG_ID_EVENTS) && (logId != LOG_ID_STATS) &&
+      (logId != LOG_ID_SECURITY)) {
+    return -EINVAL;
+  }
+  if (!vec || !nr || (vec[0].iov_len != sizeof(int32_t))) {
+    return -EINVAL;
+  }
+
+  return write_to_log(logId, vec, nr);
+}
+
 /*
  * Like __android_log_bwrite, but takes the type as well.  Doesn't work
  * for the general case where we're generating lists of stuff, but very
@@ -684,9 +697,13 @@ LIBLOG_ABI_PUBLIC int android_set_log_transport(int transport_flag) {
     return retval;
   }
 
-  __android_log_transport &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR;
+  __android_log_transport &=
+      LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR | LOGGER_ASYNC |
+      LOGGER_PMSG_COALESCE;
 
-  transport_flag &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR;
+  transport_flag &=
+      LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR | LOGGER_ASYNC |
+      LOGGER_PMSG_COALESCE;
 
   if (__android_log_transport != transport_flag) {
     __android_log_transport = transport_flag;
@@ -714,7 +731,9 @@ LIBLOG_ABI_PUBLIC int android_get_log_transport() {
   if (write_to_log == __write_to_log_null) {
     ret = LOGGER_NULL;
   } else {
-    __android_log_transport &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR;
+    __android_log_transport &=
+        LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR | LOGGER_ASYNC |
+        LOGGER_PMSG_COALESCE;
     ret = __android_log_transport;
     if ((write_to_log != __write_to_log_init) &&
         (write_to_log != __write_to_log_daemon)) {
@@ -68,6 +68,11 @@ struct AndroidLogFormat_t {
   bool monotonic_output;
   bool uid_output;
   bool descriptive_output;
+  /* localtime_r and strftime result for the last second formatted */
+  bool time_cache_valid;
+  time_t time_cache_sec;
+  char time_cache[32];
+  char time_cache_zone[16];
 };
 
 /*
@@ -194,6 +199,44 @@ static android_LogPriority filterPriForTag(AndroidLogFormat* p_format,
   return p_format->global_pri;
 }
 
+LIBLOG_ABI_PUBLIC android_LogPriority android_log_getFilterHint(
+    AndroidLogFormat* p_format, char* tags, size_t len) {
+  android_LogPriority pri = p_format->global_pri;
+  bool listed = (pri == ANDROID_LOG_SILENT) && tags && len;
+  FilterInfo* p_curFilter;
+  size_t used = 0;
+
+  for (p_curFilter = p_format->filters; p_curFilter != NULL;
+       p_curFilter = p_curFilter->p_next) {
+    android_LogPriority tag_pri = p_curFilter->mPri;
+    if (tag_pri == ANDROID_LOG_DEFAULT) {
+      tag_pri = p_format->global_pri;
+    }
+    if (tag_pri < pri) {
+      pri = tag_pri;
+    }
+    if (!listed || (tag_pri >= ANDROID_LOG_SILENT)) {
+      continue;
+    }
+    size_t tag_len = strlen(p_curFilter->mTag);
+    if (strchr(p_curFilter->mTag, ',') ||
+        ((used + !!used + tag_len) >= len)) {
+      listed = false;
+      continue;
+    }
+    if (used) {
+      tags[used++] = ',';
+    }
+    memcpy(tags + used, p_curFilter->mTag, tag_len);
+    used += tag_len;
+  }
+
+  if (tags && len) {
+    tags[listed ? used : 0] = '\0';
+  }
+  return pri;
+}
+
 /**
  * returns 1 if this log line should be printed based on its priority
  * and tag, and 0 if it should not
@@ -260,6 +303,7 @@ LIBLOG_ABI_PUBLIC void android_log_format_free(AndroidLogFormat* p_format) {
 
 LIBLOG_ABI_PUBLIC int android_log_setPrintFormat(AndroidLogFormat* p_format,
                                                  AndroidLogPrintFormat format) {
+  p_format->time_cache_valid = false;
   switch (format) {
     case FORMAT_MODIFIER_COLOR:
       p_format->colored_output = true;
@@ -1212,6 +1256,32 @@ LIBLOG_WEAK ssize_t utf8_character_length(const char* src, size_t len) {
   return num_to_read;
 }
 
+/*
+ * Length of the leading run of message that convertPrintable() would copy
+ * unchanged, plain ASCII from ' ' up with no backslash. Checked a word at a
+ * time, an odd byte anywhere in the word ends the run at the word before.
+ */
+static size_t printableRun(const char* message, size_t messageLen) {
+  static const uint64_t ones = 0x0101010101010101ULL;
+  static const uint64_t highs = 0x8080808080808080ULL;
+  size_t len = 0;
+
+  while ((messageLen - len) >= sizeof(uint64_t)) {
+    uint64_t x, y, odd;
+
+    memcpy(&x, message + len, sizeof(x));
+    odd = x & highs;                        /* not ASCII */
+    odd |= (x - ones * ' ') & ~x & highs;   /* control characters */
+    y = x ^ (ones * '\\');
+    odd |= (y - ones) & ~y & highs;         /* backslash */
+    if (odd) {
+      break;
+    }
+    len += sizeof(x);
+  }
+  return len;
+}
+
 /*
  * Convert to printable from message to p buffer, return string length. If p is
  * NULL, do not copy, but still return the expected string length.
@@ -1221,6 +1291,17 @@ static size_t convertPrintable(char* p, const char* message, size_t messageLen)
   bool print = p != NULL;
 
   while (messageLen) {
+    size_t run = printableRun(message, messageLen);
+    if (run) {
+      if (print) {
+        memcpy(p, message, run);
+      }
+      p += run;
+      message += run;
+      messageLen -= run;
+      continue;
+    }
+
     char buf[6];
     ssize_t len = sizeof(buf) - 1;
     if ((size_t)len > messageLen) {
@@ -1266,6 +1347,9 @@ static size_t convertPrintable(char* p, const char* message, size_t messageLen)
     message += len;
     messageLen -= len;
   }
+  if (print) {
+    *p = '\0';
+  }
   return p - begin;
 }
 
@@ -1602,17 +1686,27 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
     nsec = NS_PER_SEC - nsec;
   }
   if (p_format->epoch_output || p_format->monotonic_output) {
-    ptm = NULL;
     snprintf(timeBuf, sizeof(timeBuf),
              p_format->monotonic_output ? "%6lld" : "%19lld", (long long)now);
   } else {
+    /* Consecutive entries mostly land in the same second */
+    if (!p_format->time_cache_valid || (p_format->time_cache_sec != now)) {
 #if !defined(_WIN32)
-    ptm = localtime_r(&now, &tmBuf);
+      ptm = localtime_r(&now, &tmBuf);
 #else
-    ptm = localtime(&now);
+      ptm = localtime(&now);
 #endif
-    strftime(timeBuf, sizeof(timeBuf),
-             &"%Y-%m-%d %H:%M:%S"[p_format->year_output ? 0 : 3], ptm);
+      strftime(p_format->time_cache, sizeof(p_format->time_cache),
+               &"%Y-%m-%d %H:%M:%S"[p_format->year_output ? 0 : 3], ptm);
+      p_format->time_cache_zone[0] = '\0';
+      if (ptm) {
+        strftime(p_format->time_cache_zone, sizeof(p_format->time_cache_zone),
+                 " %z", ptm);
+      }
+      p_format->time_cache_sec = now;
+      p_format->time_cache_valid = true;
+    }
+    strcpy(timeBuf, p_format->time_cache);
   }
   len = strlen(timeBuf);
   if (p_format->nsec_time_output) {
@@ -1624,8 +1718,10 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
     len += snprintf(timeBuf + len, sizeof(timeBuf) - len, ".%03ld",
                     nsec / MS_PER_NSEC);
   }
-  if (p_format->zone_output && ptm) {
-    strftime(timeBuf + len, sizeof(timeBuf) - len, " %z", ptm);
+  if (p_format->zone_output && !p_format->epoch_output &&
+      !p_format->monotonic_output) {
+    snprintf(timeBuf + len, sizeof(timeBuf) - len, "%s",
+             p_format->time_cache_zone);
   }
 
   /*
@@ -20,6 +20,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +28,7 @@
 #include <time.h>
 
 #include <log/log_properties.h>
+#include <log/log_transport.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
 
@@ -50,6 +52,86 @@ LIBLOG_HIDDEN struct android_log_transport_write pmsgLoggerWrite = {
   .write = pmsgWrite,
 };
 
+/*
+ * With LOGGER_PMSG_COALESCE, pstore writes are expensive per call on SoCs
+ * where the ramoops region is mapped uncached, so each thread packs its
+ * entries back to back and hands them to the driver in one write once the
+ * buffer fills, PMSG_COALESCE_WINDOW has passed since the first of them,
+ * the thread exits or the transport is closed. Fatal text messages and the
+ * crash and security buffers flush the buffer and are written at once.
+ */
+#define PMSG_COALESCE_SIZE 8192
+#define PMSG_COALESCE_WINDOW 50000000 /* nsec */
+
+struct pmsg_coalesce {
+  pid_t pid; /* buffers inherited across fork are discarded */
+  size_t len;
+  struct timespec first;
+  char buf[PMSG_COALESCE_SIZE];
+};
+
+static pthread_key_t pmsgCoalesceKey;
+static pthread_once_t pmsgCoalesceOnce = PTHREAD_ONCE_INIT;
+
+static void pmsgCoalesceFlush(struct pmsg_coalesce* coalesce) {
+  int fd;
+
+  if (!coalesce->len) {
+    return;
+  }
+  fd = atomic_load(&pmsgLoggerWrite.context.fd);
+  if ((fd >= 0) && (coalesce->pid == getpid())) {
+    TEMP_FAILURE_RETRY(write(fd, coalesce->buf, coalesce->len));
+  }
+  coalesce->len = 0;
+}
+
+static void pmsgCoalesceDestroy(void* arg) {
+  pmsgCoalesceFlush(arg);
+  free(arg);
+}
+
+/* Key destructors do not run for the thread calling exit() */
+static void pmsgCoalesceExit() {
+  struct pmsg_coalesce* coalesce = pthread_getspecific(pmsgCoalesceKey);
+  if (coalesce) {
+    pmsgCoalesceFlush(coalesce);
+  }
+}
+
+static void pmsgCoalesceInit() {
+  if (!pthread_key_create(&pmsgCoalesceKey, pmsgCoalesceDestroy)) {
+    atexit(pmsgCoalesceExit);
+  }
+}
+
+static struct pmsg_coalesce* pmsgCoalesceGet(bool create) {
+  struct pmsg_coalesce* coalesce;
+
+  pthread_once(&pmsgCoalesceOnce, pmsgCoalesceInit);
+  coalesce = pthread_getspecific(pmsgCoalesceKey);
+  if (!coalesce && create) {
+    coalesce = malloc(sizeof(*coalesce));
+    if (coalesce) {
+      coalesce->pid = getpid();
+      coalesce->len = 0;
+      if (pthread_setspecific(pmsgCoalesceKey, coalesce)) {
+        free(coalesce);
+        coalesce = NULL;
+      }
+    }
+  }
+  return coalesce;
+}
+
+static bool pmsgCoalesceExpired(const struct pmsg_coalesce* coalesce,
+                                const struct timespec* ts) {
+  long long elapsed = (ts->tv_sec - coalesce->first.tv_sec) * 1000000000LL +
+                      (ts->tv_nsec - coalesce->first.tv_nsec);
+  /* time going backwards counts as expired too */
+  return (elapsed < 0) || (elapsed >= PMSG_COALESCE_WINDOW);
+}
+
 static int pmsgOpen() {
   int fd = atomic_load(&pmsgLoggerWrite.context.fd);
   if (fd < 0) {
@@ -66,7 +148,16 @@ static int pmsgOpen() {
 }
 
 static void pmsgClose() {
-  int fd = atomic_exchange(&pmsgLoggerWrite.context.fd, -1);
+  int fd;
+
+  if (__android_log_transport & LOGGER_PMSG_COALESCE) {
+    struct pmsg_coalesce* coalesce = pmsgCoalesceGet(false);
+    if (coalesce) {
+      pmsgCoalesceFlush(coalesce);
+    }
+  }
+
+  fd = atomic_exchange(&pmsgLoggerWrite.context.fd, -1);
   if (fd >= 0) {
     close(fd);
   }
@@ -96,12 +187,13 @@ static inline uint32_t get4LE(const uint8_t* src) {
   return src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
 }
 
-static int pmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
-                     size_t nr) {
+static int pmsgWriteEntry(log_id_t logId, struct timespec* ts,
+                          struct iovec* vec, size_t nr, bool batch) {
   static const unsigned headerLength = 2;
   struct iovec newVec[nr + headerLength];
   android_log_header_t header;
   android_pmsg_log_header_t pmsgHeader;
+  struct pmsg_coalesce* coalesce;
   size_t i, payloadSize;
   ssize_t ret;
 
@@ -169,12 +261,53 @@ static int pmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
   }
   pmsgHeader.len += payloadSize;
 
+  coalesce = NULL;
+  if (__android_log_transport & LOGGER_PMSG_COALESCE) {
+    bool urgent = !batch || (logId == LOG_ID_CRASH) ||
+                  (logId == LOG_ID_SECURITY) ||
+                  ((logId != LOG_ID_EVENTS) && (logId != LOG_ID_STATS) &&
+                   vec[0].iov_len &&
+                   (*(const char*)vec[0].iov_base >= ANDROID_LOG_FATAL));
+
+    coalesce = pmsgCoalesceGet(!urgent);
+    if (coalesce && (coalesce->pid != pmsgHeader.pid)) {
+      coalesce->pid = pmsgHeader.pid;
+      coalesce->len = 0;
+    }
+    if (coalesce && !urgent) {
+      size_t j;
+
+      if ((coalesce->len + pmsgHeader.len) > sizeof(coalesce->buf)) {
+        pmsgCoalesceFlush(coalesce);
+      }
+      if (!coalesce->len) {
+        coalesce->first = *ts;
+      }
+      for (j = 0; j < i; ++j) {
+        memcpy(coalesce->buf + coalesce->len, newVec[j].iov_base,
+               newVec[j].iov_len);
+        coalesce->len += newVec[j].iov_len;
+      }
+      if (pmsgCoalesceExpired(coalesce, ts)) {
+        pmsgCoalesceFlush(coalesce);
+      }
+      ret = pmsgHeader.len;
+      goto done;
+    }
+  }
+  /* keep this thread's entries in order */
+  if (coalesce) {
+    pmsgCoalesceFlush(coalesce);
+  }
+
   ret = TEMP_FAILURE_RETRY(
       writev(atomic_load(&pmsgLoggerWrite.context.fd), newVec, i));
   if (ret < 0) {
     ret = errno ? -errno : -ENOTCONN;
   }
 
+done:
+
   if (ret > (ssize_t)(sizeof(header) + sizeof(pmsgHeader))) {
     ret -= sizeof(header) - sizeof(pmsgHeader);
   }
@@ -182,6 +315,11 @@ static int pmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
   return ret;
 }
 
+static int pmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                     size_t nr) {
+  return pmsgWriteEntry(logId, ts, vec, nr, true);
+}
+
 /*
  * Virtual pmsg filesystem
  *
@@ -285,7 +423,8 @@ LIBLOG_ABI_PRIVATE ssize_t __android_log_pmsg_file_write(log_id_t logId,
       }
     }
 
-    ret = pmsgWrite(logId, &ts, vec, sizeof(vec) / sizeof(vec[0]));
+    ret = pmsgWriteEntry(logId, &ts, vec, sizeof(vec) / sizeof(vec[0]),
+                         false);
 
     if (ret <= 0) {
       if (weOpened) {
@@ -16,6 +16,7 @@
 
 #include <ctype.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -88,114 +89,42 @@ static void refresh_cache(struct cache_char* cache, const char* key) {
   }
 }
 
-static int __android_log_level(const char* tag, size_t len, int default_prio) {
+/*
+ * Evaluate the level for a tag straight from the properties, no caching.
+ * Priorities are:
+ *    log.tag.<tag>
+ *    persist.log.tag.<tag>
+ *    log.tag
+ *    persist.log.tag
+ * Where the missing tag matches all tags and becomes the
+ * system global default. We do not support ro.log.tag* .
+ */
+static char __android_log_level_evaluate(const char* tag, size_t len) {
   /* sizeof() is used on this array below */
   static const char log_namespace[] = "persist.log.tag.";
   static const size_t base_offset = 8; /* skip "persist." */
-  /* calculate the size of our key temporary buffer */
-  const size_t taglen = tag ? len : 0;
   /* sizeof(log_namespace) = strlen(log_namespace) + 1 */
-  char key[sizeof(log_namespace) + taglen];
+  char key[sizeof(log_namespace) + len];
+  struct cache_char temp_cache;
   char* kp;
   size_t i;
   char c = 0;
-  /*
-   * Single layer cache of four properties. Priorities are:
-   *    log.tag.<tag>
-   *    persist.log.tag.<tag>
-   *    log.tag
-   *    persist.log.tag
-   * Where the missing tag matches all tags and becomes the
-   * system global default. We do not support ro.log.tag* .
-   */
-  static char* last_tag;
-  static size_t last_tag_len;
-  static uint32_t global_serial;
-  /* some compilers erroneously see uninitialized use. !not_locked */
-  uint32_t current_global_serial = 0;
-  static struct cache_char tag_cache[2];
-  static struct cache_char global_cache[2];
-  int change_detected;
-  int global_change_detected;
-  int not_locked;
 
   strcpy(key, log_namespace);
 
-  global_change_detected = change_detected = not_locked = lock();
-
-  if (!not_locked) {
-    /*
-     *  check all known serial numbers to changes.
-     */
-    for (i = 0; i < (sizeof(tag_cache) / sizeof(tag_cache[0])); ++i) {
-      if (check_cache(&tag_cache[i].cache)) {
-        change_detected = 1;
-      }
-    }
-    for (i = 0; i < (sizeof(global_cache) / sizeof(global_cache[0])); ++i) {
-      if (check_cache(&global_cache[i].cache)) {
-        global_change_detected = 1;
-      }
-    }
-
-    current_global_serial = __system_property_area_serial();
-    if (current_global_serial != global_serial) {
-      change_detected = 1;
-      global_change_detected = 1;
-    }
-  }
-
-  if (taglen) {
-    int local_change_detected = change_detected;
-    if (!not_locked) {
-      if (!last_tag || !last_tag[0] || (last_tag[0] != tag[0]) ||
-          strncmp(last_tag + 1, tag + 1, last_tag_len - 1)) {
-        /* invalidate log.tag.<tag> cache */
-        for (i = 0; i < (sizeof(tag_cache) / sizeof(tag_cache[0])); ++i) {
-          tag_cache[i].cache.pinfo = NULL;
-          tag_cache[i].c = '\0';
-        }
-        if (last_tag) last_tag[0] = '\0';
-        local_change_detected = 1;
-      }
-      if (!last_tag || !last_tag[0]) {
-        if (!last_tag) {
-          last_tag = calloc(1, len + 1);
-          last_tag_len = 0;
-          if (last_tag) last_tag_len = len + 1;
-        } else if (len >= last_tag_len) {
-          last_tag = realloc(last_tag, len + 1);
-          last_tag_len = 0;
-          if (last_tag) last_tag_len = len + 1;
-        }
-        if (last_tag) {
-          strncpy(last_tag, tag, len);
-          last_tag[len] = '\0';
-        }
-      }
-    }
+  if (len) {
     strncpy(key + sizeof(log_namespace) - 1, tag, len);
     key[sizeof(log_namespace) - 1 + len] = '\0';
 
     kp = key;
-    for (i = 0; i < (sizeof(tag_cache) / sizeof(tag_cache[0])); ++i) {
-      struct cache_char* cache = &tag_cache[i];
-      struct cache_char temp_cache;
-
-      if (not_locked) {
-        temp_cache.cache.pinfo = NULL;
-        temp_cache.c = '\0';
-        cache = &temp_cache;
-      }
-      if (local_change_detected) {
-        refresh_cache(cache, kp);
-      }
-
-      if (cache->c) {
-        c = cache->c;
+    for (i = 0; i < 2; ++i) {
+      temp_cache.cache.pinfo = NULL;
+      temp_cache.c = '\0';
+      refresh_cache(&temp_cache, kp);
+      if (temp_cache.c) {
+        c = temp_cache.c;
         break;
       }
-
       kp = key + base_offset;
     }
   }
@@ -216,35 +145,117 @@ static int __android_log_level(const char* tag, size_t len, int default_prio) {
       key[sizeof(log_namespace) - 2] = '\0';
 
       kp = key;
-      for (i = 0; i < (sizeof(global_cache) / sizeof(global_cache[0])); ++i) {
-        struct cache_char* cache = &global_cache[i];
-        struct cache_char temp_cache;
-
-        if (not_locked) {
-          temp_cache = *cache;
-          if (temp_cache.cache.pinfo != cache->cache.pinfo) { /* check atomic */
-            temp_cache.cache.pinfo = NULL;
-            temp_cache.c = '\0';
-          }
-          cache = &temp_cache;
-        }
-        if (global_change_detected) {
-          refresh_cache(cache, kp);
-        }
-
-        if (cache->c) {
-          c = cache->c;
+      for (i = 0; i < 2; ++i) {
+        temp_cache.cache.pinfo = NULL;
+        temp_cache.c = '\0';
+        refresh_cache(&temp_cache, kp);
+        if (temp_cache.c) {
+          c = temp_cache.c;
           break;
         }
-
         kp = key + base_offset;
       }
       break;
   }
 
-  if (!not_locked) {
-    global_serial = current_global_serial;
-    unlock();
+  return c;
+}
+
+/*
+ * Read mostly cache of evaluated levels, one direct mapped slot per tag
+ * hash, valid for as long as the property area serial is unchanged. Any
+ * property change thus invalidates every slot at once, and each tag is
+ * evaluated again on its next use. Readers take no lock and never block:
+ * a slot is published under a sequence count, odd while it is being
+ * written, and a reader that sees the count move under it treats the slot
+ * as a miss. Writers are rare and serialized with a flag they only ever
+ * try to take, so a signal handler logging in the middle of an update
+ * just evaluates without publishing its answer.
+ */
+#define LOGGABLE_CACHE_SIZE 64 /* Must be a power of two */
+#define LOGGABLE_TAG_MAX 32    /* longer tags are evaluated every time */
+
+struct loggable_slot {
+  atomic_uint_fast32_t seq;
+  uint32_t serial;
+  bool used;
+  unsigned char len;
+  char c;
+  char tag[LOGGABLE_TAG_MAX];
+};
+
+static struct loggable_slot loggable_cache[LOGGABLE_CACHE_SIZE];
+static atomic_flag loggable_writer = ATOMIC_FLAG_INIT;
+
+static struct loggable_slot* loggable_slot_of(const char* tag, size_t len) {
+  uint32_t hash = 2166136261U; /* FNV-1a */
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    hash = (hash ^ (unsigned char)tag[i]) * 16777619U;
+  }
+  return &loggable_cache[hash & (LOGGABLE_CACHE_SIZE - 1)];
+}
+
+static bool loggable_read(struct loggable_slot* slot, const char* tag,
+                          size_t len, uint32_t serial, char* c) {
+  uint_fast32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+  bool hit;
+  char value;
+
+  if (seq & 1) {
+    return false;
+  }
+  hit = slot->used && (slot->serial == serial) && (slot->len == len) &&
+        !memcmp(slot->tag, tag, len);
+  value = slot->c;
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+    return false;
+  }
+  if (hit) {
+    *c = value;
+  }
+  return hit;
+}
+
+static void loggable_write(struct loggable_slot* slot, const char* tag,
+                           size_t len, uint32_t serial, char c) {
+  uint_fast32_t seq;
+
+  if (atomic_flag_test_and_set_explicit(&loggable_writer,
+                                        memory_order_acquire)) {
+    return;
+  }
+  seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  slot->serial = serial;
+  slot->used = true;
+  slot->len = len;
+  slot->c = c;
+  if (len) {
+    memcpy(slot->tag, tag, len);
+  }
+  atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+  atomic_flag_clear_explicit(&loggable_writer, memory_order_release);
+}
+
+static int __android_log_level(const char* tag, size_t len, int default_prio) {
+  const size_t taglen = tag ? len : 0;
+  char c;
+
+  if (taglen <= LOGGABLE_TAG_MAX) {
+    /* read before evaluating, a change meanwhile forces another pass */
+    uint32_t serial = __system_property_area_serial();
+    struct loggable_slot* slot = loggable_slot_of(tag, taglen);
+
+    if (!loggable_read(slot, tag, taglen, serial, &c)) {
+      c = __android_log_level_evaluate(tag, taglen);
+      loggable_write(slot, tag, taglen, serial, c);
+    }
+  } else {
+    c = __android_log_level_evaluate(tag, taglen);
   }
 
   switch (toupper(c)) {
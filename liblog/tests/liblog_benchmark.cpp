@@ -31,6 +31,7 @@
 #include <log/event_tag_map.h>
 #include <log/log_transport.h>
 #include <private/android_logger.h>
+#include <private/android_logger_event_builder.h>
 
 BENCHMARK_MAIN();
 
@@ -89,6 +90,20 @@ static void BM_log_maximum_null(benchmark::State& state) {
 }
 BENCHMARK(BM_log_maximum_null);
 
+static void BM_log_maximum_async(benchmark::State& state) {
+  android_set_log_transport(LOGGER_ASYNC);
+  BM_log_maximum(state);
+  set_log_default();
+}
+BENCHMARK(BM_log_maximum_async);
+
+static void BM_log_maximum_pmsg_coalesce(benchmark::State& state) {
+  android_set_log_transport(LOGGER_LOGD | LOGGER_PMSG_COALESCE);
+  BM_log_maximum(state);
+  set_log_default();
+}
+BENCHMARK(BM_log_maximum_pmsg_coalesce);
+
 /*
  *	Measure the time it takes to collect the time using
  * discrete acquisition (state.PauseTiming() to state.ResumeTiming())
@@ -627,6 +642,32 @@ static void BM_log_event_overhead_null(benchmark::State& state) {
 }
 BENCHMARK(BM_log_event_overhead_null);
 
+/*
+ *	Measure the cost of composing and submitting a structured event of a
+ * few fields, through the heap allocated android_log_event_list context and
+ * through the stack based android::EventBuilder, without the transport.
+ */
+static void BM_log_event_list_null(benchmark::State& state) {
+  set_log_null();
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android_log_event_list ctx(42);
+    ctx << static_cast<int32_t>(i) << i << "BM_log_event_list_null";
+    ctx.write();
+  }
+  set_log_default();
+}
+BENCHMARK(BM_log_event_list_null);
+
+static void BM_log_event_builder_null(benchmark::State& state) {
+  set_log_null();
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android::writeEvent(LOG_ID_EVENTS, 42, static_cast<int32_t>(i), i,
+                        "BM_log_event_builder_null");
+  }
+  set_log_default();
+}
+BENCHMARK(BM_log_event_builder_null);
+
 /*
  *	Measure the time it takes to submit the android event logging call
  * using discrete acquisition under very-light load (<1% CPU utilization).
@@ -822,7 +863,24 @@ static void BM_is_loggable(benchmark::State& state) {
                                   ANDROID_LOG_VERBOSE);
   }
 }
-BENCHMARK(BM_is_loggable);
+// Contended, readers must not serialize on one another.
+BENCHMARK(BM_is_loggable)->ThreadRange(1, 8);
+
+/*
+ *	Measure __android_log_is_loggable alternating between several tags, as
+ * a service with many components would.
+ */
+static void BM_is_loggable_tags(benchmark::State& state) {
+  static const char* const tags[] = { "logd", "liblog", "logcat", "lmkd" };
+  size_t i = 0;
+
+  while (state.KeepRunning()) {
+    const char* tag = tags[i++ & 3];
+    __android_log_is_loggable_len(ANDROID_LOG_WARN, tag, strlen(tag),
+                                  ANDROID_LOG_VERBOSE);
+  }
+}
+BENCHMARK(BM_is_loggable_tags)->ThreadRange(1, 8);
 
 /*
  *	Measure the time it takes for android_log_clockid.
@@ -77,6 +77,97 @@ TEST(liblog, __android_log_write__android_logger_list_read) {
 #endif
 }
 
+TEST(liblog, __android_log_write__android_logger_list_read_batch) {
+#ifdef __ANDROID__
+  pid_t pid = getpid();
+
+  struct logger_list* logger_list;
+  ASSERT_TRUE(
+      NULL !=
+      (logger_list = android_logger_list_open(
+           LOG_ID_MAIN, ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, 1000, pid)));
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  std::string buf = android::base::StringPrintf("pid=%u ts=%ld.%09ld", pid,
+                                                ts.tv_sec, ts.tv_nsec);
+  static const char tag[] =
+      "liblog.__android_log_write__android_logger_list_read_batch";
+  static const char prio = ANDROID_LOG_DEBUG;
+  static const int entries = 10;
+  for (int i = 0; i < entries; ++i) {
+    ASSERT_LT(0, __android_log_write(prio, tag, buf.c_str()));
+  }
+  usleep(1000000);
+
+  buf = std::string(&prio, sizeof(prio)) + tag + std::string("", 1) + buf +
+        std::string("", 1);
+
+  int count = 0;
+  int reads = 0;
+
+  for (;;) {
+    log_msg batch[16];
+    int len = android_logger_list_read_batch(logger_list, batch, sizeof(batch));
+    if (len <= 0) break;
+    ++reads;
+
+    size_t offset = 0;
+    struct logger_entry_v4* entry;
+    while ((entry = android_logger_batch_next(batch, len, &offset)) != NULL) {
+      EXPECT_EQ(entry->pid, pid);
+      EXPECT_EQ(entry->lid, LOG_ID_MAIN);
+
+      if (entry->len != buf.length()) continue;
+
+      const char* msg = reinterpret_cast<const char*>(entry) + entry->hdr_size;
+      if (buf != std::string(msg, entry->len)) continue;
+
+      ++count;
+    }
+  }
+  android_logger_list_close(logger_list);
+
+  EXPECT_EQ(entries, count);
+  // All of them fit in one batch, but for what logd had yet to send.
+  EXPECT_GT(entries, reads);
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, android_logger_batch_next) {
+  log_msg batch[2];
+  char* buf = reinterpret_cast<char*>(batch);
+
+  struct logger_entry_v4 entry = {};
+  entry.hdr_size = sizeof(entry);
+  entry.len = 5;
+  entry.pid = 1;
+  memcpy(buf, &entry, sizeof(entry));
+  memcpy(buf + sizeof(entry), "abcd", 5);
+  // The next entry starts 4 byte aligned.
+  size_t second = (sizeof(entry) + 5 + 3) & ~3;
+  entry.len = 3;
+  entry.pid = 2;
+  memcpy(buf + second, &entry, sizeof(entry));
+  memcpy(buf + second + sizeof(entry), "xy", 3);
+  int len = second + sizeof(entry) + 3;
+
+  size_t offset = 0;
+  struct logger_entry_v4* next = android_logger_batch_next(buf, len, &offset);
+  ASSERT_TRUE(next != NULL);
+  EXPECT_EQ(reinterpret_cast<char*>(next), buf);
+  EXPECT_EQ(1, next->pid);
+  EXPECT_STREQ("abcd", buf + next->hdr_size);
+  next = android_logger_batch_next(buf, len, &offset);
+  ASSERT_TRUE(next != NULL);
+  EXPECT_EQ(reinterpret_cast<char*>(next), buf + second);
+  EXPECT_EQ(2, next->pid);
+  EXPECT_EQ(NULL, android_logger_batch_next(buf, len, &offset));
+  EXPECT_EQ(NULL, android_logger_batch_next(buf, 0, &offset));
+}
+
 TEST(liblog, android_logger_get_) {
 #ifdef __ANDROID__
   // This test assumes the log buffers are filled with noise from
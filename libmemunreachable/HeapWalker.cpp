@@ -16,12 +16,20 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <utility>
 
+#include "android-base/macros.h"
+
 #include "Allocator.h"
 #include "HeapWalker.h"
 #include "LeakFolding.h"
@@ -30,6 +38,85 @@
 
 namespace android {
 
+// Ranges are scanned in pieces of at most this many bytes, so that a large
+// allocation or root can be shared between the marking threads.
+static constexpr size_t kMarkChunkSize = 64 * 1024;
+
+// A marking thread with more ranges than this left to scan gives half of them
+// away when another one is idle, and an idle thread takes this many at once.
+static constexpr size_t kMarkBatchSize = 64;
+
+// Bounds the size of the index bitmap, the blocks get larger instead.
+static constexpr size_t kMaxIndexBits = 1 << 24;
+
+static void PushChunks(const Range& range, allocator::vector<Range>* to_do) {
+  for (uintptr_t begin = range.begin; begin < range.end; begin += kMarkChunkSize) {
+    to_do->push_back(Range{begin, std::min(range.end, begin + kMarkChunkSize)});
+  }
+}
+
+// The ranges waiting to be scanned that no marking thread has taken yet.
+class MarkQueue {
+ public:
+  MarkQueue(Allocator<Range> allocator, size_t num_threads)
+      : ranges_(allocator), busy_(num_threads), waiting_(0) {}
+
+  // Only used before the marking threads start.
+  allocator::vector<Range>* ranges() { return &ranges_; }
+
+  // Called by a marking thread that has nothing left to scan. Waits until
+  // there are ranges to move to to_do, or until every thread is waiting,
+  // which means the marking is done, and then returns false.
+  bool Take(allocator::vector<Range>* to_do) {
+    std::unique_lock<std::mutex> lk(m_);
+    busy_--;
+    waiting_++;
+    cv_.wait(lk, [&] { return !ranges_.empty() || busy_ == 0; });
+    waiting_--;
+    if (ranges_.empty()) {
+      cv_.notify_all();
+      return false;
+    }
+    size_t n = std::min(ranges_.size(), kMarkBatchSize);
+    to_do->insert(to_do->end(), ranges_.end() - n, ranges_.end());
+    ranges_.erase(ranges_.end() - n, ranges_.end());
+    busy_++;
+    return true;
+  }
+
+  // Called for the threads that were counted but never started.
+  void Leave(size_t num_threads) {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      busy_ -= num_threads;
+    }
+    cv_.notify_all();
+  }
+
+  // Gives half of to_do away if another thread is waiting for ranges.
+  void Share(allocator::vector<Range>* to_do) {
+    if (to_do->size() <= kMarkBatchSize || waiting_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    size_t n = to_do->size() / 2;
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      ranges_.insert(ranges_.end(), to_do->end() - n, to_do->end());
+    }
+    to_do->erase(to_do->end() - n, to_do->end());
+    cv_.notify_all();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MarkQueue);
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  allocator::vector<Range> ranges_;
+  size_t busy_;
+  std::atomic<size_t> waiting_;
+};
+
 bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
   if (end == begin) {
     end = begin + 1;
@@ -40,6 +127,7 @@ bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
     valid_allocations_range_.begin = std::min(valid_allocations_range_.begin, begin);
     valid_allocations_range_.end = std::max(valid_allocations_range_.end, end);
     allocation_bytes_ += range.size();
+    index_valid_ = false;
     return true;
   } else {
     Range overlap = inserted.first->first;
@@ -52,14 +140,35 @@ bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
   }
 }
 
-bool HeapWalker::WordContainsAllocationPtr(uintptr_t word_ptr, Range* range, AllocationInfo** info) {
-  walking_ptr_ = word_ptr;
+bool HeapWalker::WordContainsAllocationPtr(uintptr_t word_ptr, Range* range, AllocationInfo** info,
+                                           uintptr_t* walking_ptr) {
+  *walking_ptr = word_ptr;
   // This access may segfault if the process under test has done something strange,
   // for example mprotect(PROT_NONE) on a native heap page.  If so, it will be
   // caught and handled by mmaping a zero page over the faulting page.
   uintptr_t value = *reinterpret_cast<uintptr_t*>(word_ptr);
-  walking_ptr_ = 0;
+  *walking_ptr = 0;
   if (value >= valid_allocations_range_.begin && value < valid_allocations_range_.end) {
+    if (index_valid_) {
+      // Most words that aren't pointers land in a block without allocations.
+      size_t block = (value - valid_allocations_range_.begin) >> index_shift_;
+      size_t word = block / 64;
+      if (!(index_bits_[word] & (1ULL << (block % 64)))) {
+        return false;
+      }
+      auto first = index_.begin() + index_first_[word];
+      auto last = index_.begin() + std::min<size_t>(index_first_[word + 1] + 1, index_.size());
+      auto entry = std::upper_bound(first, last, value, [](uintptr_t value, const IndexEntry& e) {
+        return value < e.end;
+      });
+      if (entry != last && entry->begin <= value) {
+        *range = Range{entry->begin, entry->end};
+        *info = entry->info;
+        return true;
+      }
+      return false;
+    }
+
     AllocationMap::iterator it = allocations_.find(Range{value, value + 1});
     if (it != allocations_.end()) {
       *range = it->first;
@@ -70,19 +179,100 @@ bool HeapWalker::WordContainsAllocationPtr(uintptr_t word_ptr, Range* range, All
   return false;
 }
 
-void HeapWalker::RecurseRoot(const Range& root) {
-  allocator::vector<Range> to_do(1, root, allocator_);
-  while (!to_do.empty()) {
+void HeapWalker::BuildIndex() {
+  index_.clear();
+  index_bits_.clear();
+  index_first_.clear();
+  if (allocations_.empty()) {
+    index_valid_ = false;
+    return;
+  }
+
+  uintptr_t base = valid_allocations_range_.begin;
+  uintptr_t span = valid_allocations_range_.end - base;
+  index_shift_ = 4;
+  while ((span >> index_shift_) >= kMaxIndexBits) {
+    index_shift_++;
+  }
+  size_t num_words = (((span - 1) >> index_shift_) / 64) + 1;
+  index_bits_.resize(num_words);
+  index_first_.resize(num_words + 1);
+
+  index_.reserve(allocations_.size());
+  for (auto& it : allocations_) {
+    index_.push_back(IndexEntry{it.first.begin, it.first.end, &it.second});
+    size_t last_block = (it.first.end - 1 - base) >> index_shift_;
+    for (size_t block = (it.first.begin - base) >> index_shift_; block <= last_block; block++) {
+      index_bits_[block / 64] |= 1ULL << (block % 64);
+    }
+  }
+
+  size_t entry = 0;
+  for (size_t word = 0; word <= num_words; word++) {
+    uintptr_t word_begin = base + (static_cast<uintptr_t>(word) << index_shift_) * 64;
+    while (entry < index_.size() && index_[entry].end <= word_begin) {
+      entry++;
+    }
+    index_first_[word] = entry;
+  }
+  index_valid_ = true;
+}
+
+void HeapWalker::Mark(MarkQueue* queue, size_t index) {
+  allocator::vector<Range> to_do(allocator_);
+  while (!to_do.empty() || queue->Take(&to_do)) {
     Range range = to_do.back();
     to_do.pop_back();
 
-    ForEachPtrInRange(range, [&](Range& ref_range, AllocationInfo* ref_info) {
-      if (!ref_info->referenced_from_root) {
-        ref_info->referenced_from_root = true;
-        to_do.push_back(ref_range);
-      }
-    });
+    ForEachPtrInRange(range, &walking_ptrs_[index],
+                      [&](Range& ref_range, AllocationInfo* ref_info) {
+                        std::atomic<bool>& marked = ref_info->referenced_from_root;
+                        if (!marked.load(std::memory_order_relaxed) &&
+                            !marked.exchange(true, std::memory_order_relaxed)) {
+                          PushChunks(ref_range, &to_do);
+                        }
+                      });
+    queue->Share(&to_do);
+  }
+}
+
+struct MarkThread {
+  HeapWalker* heap_walker;
+  MarkQueue* queue;
+  size_t index;
+};
+
+bool HeapWalker::MarkInThreads(MarkQueue* queue, size_t num_threads) {
+  allocator::vector<MarkThread> threads(allocator_);
+  allocator::vector<pthread_t> pthreads(allocator_);
+  threads.reserve(num_threads);
+
+  auto proxy = [](void* arg) -> void* {
+    MarkThread* thread = reinterpret_cast<MarkThread*>(arg);
+    thread->heap_walker->Mark(thread->queue, thread->index);
+    return nullptr;
+  };
+
+  // Unlike std::thread, pthread_create does not need malloc, which may be
+  // disabled.
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.push_back(MarkThread{this, queue, i});
+    pthread_t pthread;
+    int ret = pthread_create(&pthread, nullptr, proxy, &threads.back());
+    if (ret != 0) {
+      MEM_ALOGE("failed to create marking thread: %s", strerror(ret));
+      break;
+    }
+    pthreads.push_back(pthread);
+  }
+  queue->Leave(num_threads - 1 - pthreads.size());
+
+  Mark(queue, 0);
+
+  for (auto it = pthreads.begin(); it != pthreads.end(); it++) {
+    pthread_join(*it, nullptr);
   }
+  return true;
 }
 
 void HeapWalker::Root(uintptr_t begin, uintptr_t end) {
@@ -101,19 +291,30 @@ size_t HeapWalker::AllocationBytes() {
   return allocation_bytes_;
 }
 
-bool HeapWalker::DetectLeaks() {
+bool HeapWalker::DetectLeaks(size_t num_threads) {
+  num_threads = std::max<size_t>(1, std::min(num_threads, kMaxMarkThreads));
+  MarkQueue queue(allocator_, num_threads);
+
+  if (!index_valid_) {
+    BuildIndex();
+  }
+
   // Recursively walk pointers from roots to mark referenced allocations
   for (auto it = roots_.begin(); it != roots_.end(); it++) {
-    RecurseRoot(*it);
+    PushChunks(*it, queue.ranges());
   }
 
   Range vals;
   vals.begin = reinterpret_cast<uintptr_t>(root_vals_.data());
   vals.end = vals.begin + root_vals_.size() * sizeof(uintptr_t);
 
-  RecurseRoot(vals);
+  PushChunks(vals, queue.ranges());
 
-  return true;
+  if (num_threads == 1) {
+    Mark(&queue, 0);
+    return true;
+  }
+  return MarkInThreads(&queue, num_threads);
 }
 
 bool HeapWalker::Leaked(allocator::vector<Range>& leaked, size_t limit, size_t* num_leaks_out,
@@ -164,7 +365,8 @@ static bool MapOverPage(void* addr) {
 void HeapWalker::HandleSegFault(ScopedSignalHandler& handler, int signal, siginfo_t* si,
                                 void* /*uctx*/) {
   uintptr_t addr = reinterpret_cast<uintptr_t>(si->si_addr);
-  if (addr != walking_ptr_) {
+  if (addr == 0 || std::find(std::begin(walking_ptrs_), std::end(walking_ptrs_), addr) ==
+      std::end(walking_ptrs_)) {
     handler.reset();
     return;
   }
@@ -19,6 +19,8 @@
 
 #include <signal.h>
 
+#include <atomic>
+
 #include "android-base/macros.h"
 
 #include "Allocator.h"
@@ -44,6 +46,8 @@ struct compare_range {
   bool operator()(const Range& a, const Range& b) const { return a.end <= b.begin; }
 };
 
+class MarkQueue;
+
 class HeapWalker {
  public:
   explicit HeapWalker(Allocator<HeapWalker> allocator)
@@ -53,7 +57,12 @@ class HeapWalker {
         roots_(allocator),
         root_vals_(allocator),
         segv_handler_(allocator),
-        walking_ptr_(0) {
+        walking_ptrs_(),
+        index_(allocator),
+        index_bits_(allocator),
+        index_first_(allocator),
+        index_shift_(0),
+        index_valid_(false) {
     valid_allocations_range_.end = 0;
     valid_allocations_range_.begin = ~valid_allocations_range_.end;
 
@@ -68,7 +77,9 @@ class HeapWalker {
   void Root(uintptr_t begin, uintptr_t end);
   void Root(const allocator::vector<uintptr_t>& vals);
 
-  bool DetectLeaks();
+  // Marks the allocations reachable from the roots, using up to
+  // num_threads threads.
+  bool DetectLeaks(size_t num_threads = 1);
 
   bool Leaked(allocator::vector<Range>&, size_t limit, size_t* num_leaks, size_t* leak_bytes);
   size_t Allocations();
@@ -81,12 +92,25 @@ class HeapWalker {
   void ForEachAllocation(F&& f);
 
   struct AllocationInfo {
-    bool referenced_from_root;
+    AllocationInfo() : referenced_from_root(false) {}
+    AllocationInfo(const AllocationInfo& other)
+        : referenced_from_root(other.referenced_from_root.load()) {}
+
+    // Set by the marking threads.
+    std::atomic<bool> referenced_from_root;
   };
 
+  static constexpr size_t kMaxMarkThreads = 16;
+
  private:
-  void RecurseRoot(const Range& root);
-  bool WordContainsAllocationPtr(uintptr_t ptr, Range* range, AllocationInfo** info);
+  template <class F>
+  void ForEachPtrInRange(const Range& range, uintptr_t* walking_ptr, F&& f);
+
+  void BuildIndex();
+  void Mark(MarkQueue* queue, size_t index);
+  bool MarkInThreads(MarkQueue* queue, size_t num_threads);
+  bool WordContainsAllocationPtr(uintptr_t ptr, Range* range, AllocationInfo** info,
+                                 uintptr_t* walking_ptr);
   void HandleSegFault(ScopedSignalHandler&, int, siginfo_t*, void*);
 
   DISALLOW_COPY_AND_ASSIGN(HeapWalker);
@@ -100,11 +124,34 @@ class HeapWalker {
   allocator::vector<uintptr_t> root_vals_;
 
   ScopedSignalHandler segv_handler_;
-  uintptr_t walking_ptr_;
+  // The word each marking thread is reading, 0 when it is not reading one.
+  // The first one is also used outside of marking.
+  uintptr_t walking_ptrs_[kMaxMarkThreads];
+
+  // A flat copy of allocations_ for the lookups of the scanned words, built
+  // by DetectLeaks(). index_bits_ has a bit for each block of 1 << index_shift_
+  // bytes from valid_allocations_range_.begin, set if an allocation overlaps
+  // it. For each word of index_bits_, index_first_ has the first entry of
+  // index_ that ends after the start of the word's blocks.
+  struct IndexEntry {
+    uintptr_t begin;
+    uintptr_t end;
+    AllocationInfo* info;
+  };
+  allocator::vector<IndexEntry> index_;
+  allocator::vector<uint64_t> index_bits_;
+  allocator::vector<uint32_t> index_first_;
+  size_t index_shift_;
+  bool index_valid_;
 };
 
 template <class F>
 inline void HeapWalker::ForEachPtrInRange(const Range& range, F&& f) {
+  ForEachPtrInRange(range, &walking_ptrs_[0], f);
+}
+
+template <class F>
+inline void HeapWalker::ForEachPtrInRange(const Range& range, uintptr_t* walking_ptr, F&& f) {
   uintptr_t begin = (range.begin + (sizeof(uintptr_t) - 1)) & ~(sizeof(uintptr_t) - 1);
   // TODO(ccross): we might need to consider a pointer to the end of a buffer
   // to be inside the buffer, which means the common case of a pointer to the
@@ -112,7 +159,7 @@ inline void HeapWalker::ForEachPtrInRange(const Range& range, F&& f) {
   for (uintptr_t i = begin; i < range.end; i += sizeof(uintptr_t)) {
     Range ref_range;
     AllocationInfo* ref_info;
-    if (WordContainsAllocationPtr(i, &ref_range, &ref_info)) {
+    if (WordContainsAllocationPtr(i, &ref_range, &ref_info, walking_ptr)) {
       f(ref_range, ref_info);
     }
   }
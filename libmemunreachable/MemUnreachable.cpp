@@ -16,7 +16,10 @@
 
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iomanip>
 #include <mutex>
@@ -49,6 +52,10 @@ namespace android {
 
 const size_t Leak::contents_length;
 
+// The heap walker process runs after the threads of the process have been
+// released, so it only competes with them for the cpus.
+static constexpr size_t kHeapWalkerThreads = 4;
+
 class MemUnreachable {
  public:
   MemUnreachable(pid_t pid, Allocator<void> allocator)
@@ -57,7 +64,9 @@ class MemUnreachable {
                           const allocator::vector<Mapping>& mappings,
                           const allocator::vector<uintptr_t>& refs);
   bool GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t limit, size_t* num_leaks,
-                            size_t* leak_bytes);
+                            size_t* leak_bytes, const LeakHistory* history,
+                            allocator::vector<uint64_t>& fingerprints, size_t* num_known_leaks,
+                            size_t* known_leak_bytes);
   size_t Allocations() { return heap_walker_.Allocations(); }
   size_t AllocationBytes() { return heap_walker_.AllocationBytes(); }
 
@@ -73,6 +82,23 @@ class MemUnreachable {
   HeapWalker heap_walker_;
 };
 
+// FNV-1a over the size, the backtrace and the first bytes of the leak, which
+// stay the same across checks as long as nothing writes to the leak.
+static uint64_t LeakFingerprint(const Range& range, const Leak::Backtrace& backtrace) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  auto add = [&hash](const void* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+  };
+  size_t size = range.size();
+  add(&size, sizeof(size));
+  add(backtrace.frames, backtrace.num_frames * sizeof(backtrace.frames[0]));
+  add(reinterpret_cast<const void*>(range.begin), std::min(size, Leak::contents_length));
+  return hash;
+}
+
 static void HeapIterate(const Mapping& heap_mapping,
                         const std::function<void(uintptr_t, size_t)>& func) {
   malloc_iterate(heap_mapping.begin, heap_mapping.end - heap_mapping.begin,
@@ -128,12 +154,23 @@ bool MemUnreachable::CollectAllocations(const allocator::vector<ThreadInfo>& thr
   return true;
 }
 
+// Leaks found in history are left out of leaks and counted in num_known_leaks
+// and known_leak_bytes instead. The fingerprints of the reported leaks, and of
+// the similar leaks folded into them, are returned in fingerprints.
 bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t limit,
-                                          size_t* num_leaks, size_t* leak_bytes) {
+                                          size_t* num_leaks, size_t* leak_bytes,
+                                          const LeakHistory* history,
+                                          allocator::vector<uint64_t>& fingerprints,
+                                          size_t* num_known_leaks, size_t* known_leak_bytes) {
   MEM_ALOGI("sweeping process %d for unreachable memory", pid_);
   leaks.clear();
+  fingerprints.clear();
+  *num_known_leaks = 0;
+  *known_leak_bytes = 0;
 
-  if (!heap_walker_.DetectLeaks()) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t num_threads = std::min(kHeapWalkerThreads, static_cast<size_t>(std::max(cpus, 1L)));
+  if (!heap_walker_.DetectLeaks(num_threads)) {
     return false;
   }
 
@@ -156,6 +193,8 @@ bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t
   }
 
   allocator::unordered_map<Leak::Backtrace, Leak*> backtrace_map{allocator_};
+  // The fingerprint of each new leak, with the begin of the leak it is reported in.
+  allocator::vector<std::pair<uintptr_t, uint64_t>> new_leaks{allocator_};
 
   // Prevent reallocations of backing memory so we can store pointers into it
   // in backtrace_map.
@@ -169,7 +208,17 @@ bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t
         reinterpret_cast<void*>(it.range.begin), leak->backtrace.frames, leak->backtrace.max_frames);
     if (num_backtrace_frames > 0) {
       leak->backtrace.num_frames = num_backtrace_frames;
+    }
+
+    uint64_t fingerprint = LeakFingerprint(it.range, leak->backtrace);
+    if (history != nullptr && history->Contains(fingerprint)) {
+      leaks.pop_back();
+      *num_known_leaks += 1 + it.referenced_count;
+      *known_leak_bytes += it.range.size() + it.referenced_size;
+      continue;
+    }
 
+    if (num_backtrace_frames > 0) {
       auto inserted = backtrace_map.emplace(leak->backtrace, leak);
       if (!inserted.second) {
         // Leak with same backtrace already exists, drop this one and
@@ -182,6 +231,7 @@ bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t
         similar_leak->similar_referenced_size += it.referenced_size;
         similar_leak->total_size += it.range.size();
         similar_leak->total_size += it.referenced_size;
+        new_leaks.emplace_back(similar_leak->begin, fingerprint);
         continue;
       }
     }
@@ -193,6 +243,7 @@ bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t
     leak->total_size = leak->size + leak->referenced_size;
     memcpy(leak->contents, reinterpret_cast<void*>(it.range.begin),
            std::min(leak->size, Leak::contents_length));
+    new_leaks.emplace_back(leak->begin, fingerprint);
   }
 
   MEM_ALOGI("folding done");
@@ -204,6 +255,21 @@ bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t
     leaks.resize(limit);
   }
 
+  if (history != nullptr) {
+    // Leaks cut by the limit are not remembered, so a later check reports them.
+    allocator::vector<uintptr_t> reported{allocator_};
+    reported.reserve(leaks.size());
+    for (const Leak& leak : leaks) {
+      reported.push_back(leak.begin);
+    }
+    std::sort(reported.begin(), reported.end());
+    for (const auto& new_leak : new_leaks) {
+      if (std::binary_search(reported.begin(), reported.end(), new_leak.first)) {
+        fingerprints.push_back(new_leak.second);
+      }
+    }
+  }
+
   return true;
 }
 
@@ -269,7 +335,8 @@ static inline const char* plural(T val) {
   return (val == 1) ? "" : "s";
 }
 
-bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
+static bool GetUnreachableMemory(UnreachableMemoryInfo& info, LeakHistory* history,
+                                 size_t limit) {
   int parent_pid = getpid();
   int parent_tid = gettid();
 
@@ -283,6 +350,7 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
     // Collection thread
     /////////////////////////////////////////////
     MEM_ALOGI("collecting thread info for process %d...", parent_pid);
+    auto pause_start = std::chrono::steady_clock::now();
 
     ThreadCapture thread_capture(parent_pid, heap);
     allocator::vector<ThreadInfo> thread_info(heap);
@@ -345,15 +413,24 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
 
       allocator::vector<Leak> leaks{heap};
 
+      allocator::vector<uint64_t> fingerprints{heap};
+
       size_t num_leaks = 0;
       size_t leak_bytes = 0;
-      bool ok = unreachable.GetUnreachableMemory(leaks, limit, &num_leaks, &leak_bytes);
+      size_t num_known_leaks = 0;
+      size_t known_leak_bytes = 0;
+      bool ok = unreachable.GetUnreachableMemory(leaks, limit, &num_leaks, &leak_bytes, history,
+                                                 fingerprints, &num_known_leaks,
+                                                 &known_leak_bytes);
 
       ok = ok && pipe.Sender().Send(num_allocations);
       ok = ok && pipe.Sender().Send(allocation_bytes);
       ok = ok && pipe.Sender().Send(num_leaks);
       ok = ok && pipe.Sender().Send(leak_bytes);
       ok = ok && pipe.Sender().SendVector(leaks);
+      ok = ok && pipe.Sender().Send(num_known_leaks);
+      ok = ok && pipe.Sender().Send(known_leak_bytes);
+      ok = ok && pipe.Sender().SendVector(fingerprints);
 
       if (!ok) {
         _exit(3);
@@ -363,7 +440,10 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
     } else {
       // Nothing left to do in the collection thread, return immediately,
       // releasing all the captured threads.
-      MEM_ALOGI("collection thread done");
+      auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - pause_start);
+      MEM_ALOGI("collection thread done, process %d paused for %" PRId64 " us", parent_pid,
+                static_cast<int64_t>(pause.count()));
       return 0;
     }
   }};
@@ -399,23 +479,54 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
     return false;
   }
 
+  std::vector<uint64_t> fingerprints;
+
   bool ok = true;
   ok = ok && pipe.Receiver().Receive(&info.num_allocations);
   ok = ok && pipe.Receiver().Receive(&info.allocation_bytes);
   ok = ok && pipe.Receiver().Receive(&info.num_leaks);
   ok = ok && pipe.Receiver().Receive(&info.leak_bytes);
   ok = ok && pipe.Receiver().ReceiveVector(info.leaks);
+  ok = ok && pipe.Receiver().Receive(&info.num_known_leaks);
+  ok = ok && pipe.Receiver().Receive(&info.known_leak_bytes);
+  ok = ok && pipe.Receiver().ReceiveVector(fingerprints);
   if (!ok) {
     return false;
   }
 
+  if (history != nullptr) {
+    history->Add(fingerprints);
+  }
+
   MEM_ALOGI("unreachable memory detection done");
   MEM_ALOGE("%zu bytes in %zu allocation%s unreachable out of %zu bytes in %zu allocation%s",
             info.leak_bytes, info.num_leaks, plural(info.num_leaks), info.allocation_bytes,
             info.num_allocations, plural(info.num_allocations));
+  if (info.num_known_leaks > 0) {
+    MEM_ALOGI("%zu bytes in %zu unreachable allocation%s were reported before",
+              info.known_leak_bytes, info.num_known_leaks, plural(info.num_known_leaks));
+  }
   return true;
 }
 
+bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
+  return GetUnreachableMemory(info, nullptr, limit);
+}
+
+bool GetUnreachableMemory(UnreachableMemoryInfo& info, LeakHistory& history, size_t limit) {
+  return GetUnreachableMemory(info, &history, limit);
+}
+
+bool LeakHistory::Contains(uint64_t fingerprint) const {
+  return std::binary_search(fingerprints_.begin(), fingerprints_.end(), fingerprint);
+}
+
+void LeakHistory::Add(const std::vector<uint64_t>& fingerprints) {
+  fingerprints_.insert(fingerprints_.end(), fingerprints.begin(), fingerprints.end());
+  std::sort(fingerprints_.begin(), fingerprints_.end());
+  fingerprints_.erase(std::unique(fingerprints_.begin(), fingerprints_.end()), fingerprints_.end());
+}
+
 std::string Leak::ToString(bool log_contents) const {
   std::ostringstream oss;
 
@@ -484,6 +595,11 @@ std::string UnreachableMemoryInfo::ToString(bool log_contents) const {
   oss << "  " << leak_bytes << " bytes in ";
   oss << num_leaks << " unreachable allocation" << plural(num_leaks);
   oss << std::endl;
+  if (num_known_leaks > 0) {
+    oss << "  " << known_leak_bytes << " bytes in ";
+    oss << num_known_leaks << " allocation" << plural(num_known_leaks) << " reported before";
+    oss << std::endl;
+  }
   oss << "  ABI: '" ABI_STRING "'" << std::endl;
   oss << std::endl;
 
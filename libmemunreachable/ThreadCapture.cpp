@@ -150,6 +150,7 @@ bool ThreadCaptureImpl::ListThreads(TidList& tids) {
 
 bool ThreadCaptureImpl::CaptureThreads() {
   TidList tids{allocator_};
+  TidList interrupted{allocator_};
 
   bool found_new_thread;
   do {
@@ -159,17 +160,37 @@ bool ThreadCaptureImpl::CaptureThreads() {
     }
 
     found_new_thread = false;
+    bool ok = true;
+    interrupted.clear();
 
+    // Interrupt all the new threads before waiting for any of them, so that
+    // they stop in parallel instead of one after the other.
     for (auto it = tids.begin(); it != tids.end(); it++) {
       auto captured = captured_threads_.find(*it);
       if (captured == captured_threads_.end()) {
-        if (CaptureThread(*it) < 0) {
-          ReleaseThreads();
-          return false;
+        int ret = PtraceAttach(*it);
+        if (ret < 0) {
+          ok = false;
+          break;
+        } else if (ret > 0) {
+          interrupted.push_back(*it);
         }
         found_new_thread = true;
       }
     }
+
+    // Wait for all the interrupted threads even after an error, so that the
+    // ones that stopped can be released.
+    for (auto it = interrupted.begin(); it != interrupted.end(); it++) {
+      if (CaptureThread(*it) < 0) {
+        ok = false;
+      }
+    }
+
+    if (!ok) {
+      ReleaseThreads();
+      return false;
+    }
   } while (found_new_thread);
 
   return true;
@@ -248,12 +269,9 @@ bool ThreadCaptureImpl::PtraceThreadInfo(pid_t tid, ThreadInfo& thread_info) {
   return true;
 }
 
+// Waits for a thread interrupted by PtraceAttach to stop.
+// Returns 1 on stop, 0 on thread killed, -1 and logs on error
 int ThreadCaptureImpl::CaptureThread(pid_t tid) {
-  int ret = PtraceAttach(tid);
-  if (ret <= 0) {
-    return ret;
-  }
-
   int status = 0;
   if (TEMP_FAILURE_RETRY(waitpid(tid, &status, __WALL)) < 0) {
     MEM_ALOGE("failed to wait for pause of thread %d of process %d: %s", tid, pid_, strerror(errno));
@@ -17,6 +17,7 @@
 #ifndef LIBMEMUNREACHABLE_MEMUNREACHABLE_H_
 #define LIBMEMUNREACHABLE_MEMUNREACHABLE_H_
 
+#include <stdint.h>
 #include <string.h>
 #include <sys/cdefs.h>
 
@@ -61,14 +62,39 @@ struct UnreachableMemoryInfo {
   size_t num_allocations;
   size_t allocation_bytes;
 
+  // Leaks left out of leaks because a LeakHistory already held them.
+  size_t num_known_leaks = 0;
+  size_t known_leak_bytes = 0;
+
   UnreachableMemoryInfo() {}
   ~UnreachableMemoryInfo();
 
   std::string ToString(bool log_contents) const;
 };
 
+// Fingerprints of the leaks reported by earlier calls to GetUnreachableMemory,
+// made of the size, the backtrace and the first bytes of each leak. Only
+// hashes are kept, so the history never makes a leak look referenced.
+class LeakHistory {
+ public:
+  size_t size() const { return fingerprints_.size(); }
+  void Clear() { fingerprints_.clear(); }
+
+  bool Contains(uint64_t fingerprint) const;
+  void Add(const std::vector<uint64_t>& fingerprints);
+
+ private:
+  // Sorted, so that the heap walker process can search it without allocating.
+  std::vector<uint64_t> fingerprints_;
+};
+
 bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit = 100);
 
+// Like GetUnreachableMemory, but only reports the leaks that are not in
+// history yet, and then adds the reported ones to it. All leaks are still
+// counted in num_leaks and leak_bytes.
+bool GetUnreachableMemory(UnreachableMemoryInfo& info, LeakHistory& history, size_t limit = 100);
+
 std::string GetUnreachableMemoryString(bool log_contents = false, size_t limit = 100);
 
 }  // namespace android
@@ -202,4 +202,104 @@ TEST_F(HeapWalkerTest, segv) {
   ASSERT_EQ(0U, leaked.size());
 }
 
+TEST_F(HeapWalkerTest, lookup) {
+  // Allocations of 24 bytes every 64 bytes, pointed at by their last byte
+  // when even, and by the byte after their end when odd.
+  const size_t num_allocations = 64;
+  char buffer[num_allocations * 64]{};
+  uintptr_t roots[num_allocations]{};
+  uintptr_t base = buffer_begin(buffer);
+
+  HeapWalker heap_walker(heap_);
+  for (size_t i = 0; i < num_allocations; i++) {
+    heap_walker.Allocation(base + i * 64, base + i * 64 + 24);
+    roots[i] = base + i * 64 + ((i % 2 == 0) ? 23 : 24);
+  }
+  heap_walker.Root(buffer_begin(roots), buffer_end(roots));
+
+  ASSERT_EQ(true, heap_walker.DetectLeaks());
+
+  allocator::vector<Range> leaked(heap_);
+  size_t num_leaks = 0;
+  size_t leaked_bytes = 0;
+  ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, &leaked_bytes));
+
+  EXPECT_EQ(num_allocations / 2, num_leaks);
+  EXPECT_EQ(num_allocations / 2 * 24, leaked_bytes);
+  ASSERT_EQ(num_allocations / 2, leaked.size());
+  for (size_t i = 0; i < leaked.size(); i++) {
+    EXPECT_EQ(base + (i * 2 + 1) * 64, leaked[i].begin);
+  }
+}
+
+TEST_F(HeapWalkerTest, threads) {
+  // A chain that can only be followed one link at a time, and a tree wide
+  // enough for its branches to be shared between the threads.
+  const size_t chain_length = 1000;
+  const size_t tree_width = 4096;
+  allocator::vector<uintptr_t> chain(chain_length, 0, heap_);
+  allocator::vector<uintptr_t> tree(tree_width, 0, heap_);
+  allocator::vector<uintptr_t> leaves(tree_width, 0, heap_);
+  uintptr_t root[2]{};
+
+  for (size_t i = 0; i + 1 < chain_length; i++) {
+    chain[i] = reinterpret_cast<uintptr_t>(&chain[i + 1]);
+  }
+  for (size_t i = 0; i < tree_width; i++) {
+    tree[i] = reinterpret_cast<uintptr_t>(&leaves[i]);
+  }
+  root[0] = reinterpret_cast<uintptr_t>(&chain[0]);
+  root[1] = reinterpret_cast<uintptr_t>(tree.data());
+
+  for (size_t num_threads : {1, 2, 4}) {
+    HeapWalker heap_walker(heap_);
+    for (size_t i = 0; i < chain_length; i++) {
+      heap_walker.Allocation(buffer_begin(&chain[i]), buffer_end(&chain[i]));
+    }
+    heap_walker.Allocation(buffer_begin(tree.data()), buffer_begin(tree.data() + tree_width));
+    for (size_t i = 0; i < tree_width; i++) {
+      heap_walker.Allocation(buffer_begin(&leaves[i]), buffer_end(&leaves[i]));
+    }
+    // Make one leaf unreachable.
+    tree[tree_width / 2] = 0;
+    heap_walker.Root(buffer_begin(root), buffer_end(root));
+
+    ASSERT_EQ(true, heap_walker.DetectLeaks(num_threads));
+
+    allocator::vector<Range> leaked(heap_);
+    size_t num_leaks = 0;
+    size_t leaked_bytes = 0;
+    ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, &leaked_bytes));
+
+    EXPECT_EQ(1U, num_leaks) << num_threads << " threads";
+    EXPECT_EQ(sizeof(uintptr_t), leaked_bytes);
+    ASSERT_EQ(1U, leaked.size());
+    EXPECT_EQ(buffer_begin(&leaves[tree_width / 2]), leaked[0].begin);
+  }
+}
+
+TEST_F(HeapWalkerTest, threads_segv) {
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  void* buffer1 = mmap(NULL, page_size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(buffer1, nullptr);
+  void* buffer2;
+
+  buffer2 = &buffer1;
+
+  HeapWalker heap_walker(heap_);
+  heap_walker.Allocation(buffer_begin(buffer1), buffer_begin(buffer1) + page_size);
+  heap_walker.Root(buffer_begin(buffer2), buffer_end(buffer2));
+
+  ASSERT_EQ(true, heap_walker.DetectLeaks(4));
+
+  allocator::vector<Range> leaked(heap_);
+  size_t num_leaks = 0;
+  size_t leaked_bytes = 0;
+  ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, &leaked_bytes));
+
+  EXPECT_EQ(0U, num_leaks);
+  EXPECT_EQ(0U, leaked_bytes);
+  ASSERT_EQ(0U, leaked.size());
+}
+
 }  // namespace android
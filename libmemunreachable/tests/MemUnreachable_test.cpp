@@ -226,6 +226,46 @@ TEST_F(MemunreachableTest, twice) {
   }
 }
 
+TEST_F(MemunreachableTest, history) {
+  HiddenPointer hidden_ptr;
+  LeakHistory history;
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemory(info, history));
+    ASSERT_EQ(1U, info.leaks.size());
+    ASSERT_EQ(0U, info.num_known_leaks);
+    ASSERT_EQ(1U, history.size());
+  }
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemory(info, history));
+    ASSERT_EQ(0U, info.leaks.size());
+    ASSERT_EQ(1U, info.num_leaks);
+    ASSERT_EQ(1U, info.num_known_leaks);
+  }
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemory(info));
+    ASSERT_EQ(1U, info.leaks.size());
+  }
+
+  hidden_ptr.Free();
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemory(info, history));
+    ASSERT_EQ(0U, info.num_leaks);
+    ASSERT_EQ(0U, info.num_known_leaks);
+  }
+}
+
 TEST_F(MemunreachableTest, log) {
   HiddenPointer hidden_ptr;
 
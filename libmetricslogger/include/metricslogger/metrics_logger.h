@@ -15,8 +15,12 @@
  */
 
 #include <log/log_event_list.h>
+#include <chrono>
 #include <cstdint>
+#include <map>
+#include <mutex>
 #include <string>
+#include <utility>
 
 namespace android {
 namespace metricslogger {
@@ -29,6 +33,48 @@ void LogHistogram(const std::string& event, int32_t data);
 // log buffer.
 void LogCounter(const std::string& name, int32_t val);
 
+// Collects histogram and counter metrics in memory, and logs them when flushed:
+// a single histogram event per |event| and bucket, with the number of times it
+// was recorded as its value, and a single counter event per |name|, with the
+// sum of its values. For code that records a metric per operation, such as its
+// latency, which would flood the event log with LogHistogram().
+//
+// Flush() is called on demand, on destruction, and by the Add*() call that
+// comes |flush_interval| after the previous flush. Thread-safe.
+class MetricsAggregator {
+  public:
+    explicit MetricsAggregator(
+            std::chrono::milliseconds flush_interval = std::chrono::minutes(1));
+    ~MetricsAggregator();
+
+    // Same as LogHistogram(|event|, |data|), aggregated.
+    void AddHistogram(const std::string& event, int32_t data);
+    // Same as LogCounter(|name|, |val|), aggregated.
+    void AddCounter(const std::string& name, int32_t val);
+
+    // Logs the metrics collected since the last flush.
+    void Flush();
+
+    // Number of events the next flush would log.
+    size_t pending() const;
+
+  private:
+    using Histograms = std::map<std::pair<std::string, int32_t>, int32_t>;
+    using Counters = std::map<std::string, int32_t>;
+
+    void FlushLocked(std::unique_lock<std::mutex>* lock);
+    void MaybeFlushLocked(std::unique_lock<std::mutex>* lock);
+
+    const std::chrono::milliseconds flush_interval_;
+    mutable std::mutex lock_;
+    std::chrono::steady_clock::time_point last_flush_;
+    Histograms histograms_;
+    Counters counters_;
+
+    MetricsAggregator(const MetricsAggregator&) = delete;
+    MetricsAggregator& operator=(const MetricsAggregator&) = delete;
+};
+
 // Logs a Tron multi_action with category|category| containing the string
 // |value| in the field |field|.
 void LogMultiAction(int32_t category, int32_t field, const std::string& value);
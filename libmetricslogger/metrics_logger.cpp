@@ -17,6 +17,7 @@
 #include "metricslogger/metrics_logger.h"
 
 #include <cstdlib>
+#include <limits>
 
 #include <log/event_tag_map.h>
 #include <log/log_event_list.h>
@@ -37,11 +38,16 @@ const int kSysuiMultiActionTag = 0;
 namespace android {
 namespace metricslogger {
 
-// Mirror com.android.internal.logging.MetricsLogger#histogram().
-void LogHistogram(const std::string& event, int32_t data) {
+// Logs |count| samples of |data| in the histogram |event|.
+static void LogHistogramCount(const std::string& event, int32_t data, int32_t count) {
     android_log_event_list log(kSysuiMultiActionTag);
     log << LOGBUILDER_CATEGORY << LOGBUILDER_HISTOGRAM << LOGBUILDER_NAME << event
-        << LOGBUILDER_BUCKET << data << LOGBUILDER_VALUE << 1 << LOG_ID_EVENTS;
+        << LOGBUILDER_BUCKET << data << LOGBUILDER_VALUE << count << LOG_ID_EVENTS;
+}
+
+// Mirror com.android.internal.logging.MetricsLogger#histogram().
+void LogHistogram(const std::string& event, int32_t data) {
+    LogHistogramCount(event, data, 1);
 }
 
 // Mirror com.android.internal.logging.MetricsLogger#count().
@@ -51,6 +57,76 @@ void LogCounter(const std::string& name, int32_t val) {
         << val << LOG_ID_EVENTS;
 }
 
+MetricsAggregator::MetricsAggregator(std::chrono::milliseconds flush_interval)
+    : flush_interval_(flush_interval), last_flush_(std::chrono::steady_clock::now()) {}
+
+MetricsAggregator::~MetricsAggregator() {
+    Flush();
+}
+
+void MetricsAggregator::AddHistogram(const std::string& event, int32_t data) {
+    std::unique_lock<std::mutex> lock(lock_);
+    int32_t& count = histograms_[std::make_pair(event, data)];
+    count++;
+    if (count == std::numeric_limits<int32_t>::max()) {
+        FlushLocked(&lock);
+    } else {
+        MaybeFlushLocked(&lock);
+    }
+}
+
+void MetricsAggregator::AddCounter(const std::string& name, int32_t val) {
+    std::unique_lock<std::mutex> lock(lock_);
+    int32_t& sum = counters_[name];
+    // Log what we have rather than overflow.
+    if ((val > 0 && sum > std::numeric_limits<int32_t>::max() - val) ||
+        (val < 0 && sum < std::numeric_limits<int32_t>::min() - val)) {
+        int32_t logged = sum;
+        sum = val;
+        lock.unlock();
+        LogCounter(name, logged);
+        lock.lock();
+    } else {
+        sum += val;
+    }
+    MaybeFlushLocked(&lock);
+}
+
+void MetricsAggregator::Flush() {
+    std::unique_lock<std::mutex> lock(lock_);
+    FlushLocked(&lock);
+}
+
+size_t MetricsAggregator::pending() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return histograms_.size() + counters_.size();
+}
+
+void MetricsAggregator::MaybeFlushLocked(std::unique_lock<std::mutex>* lock) {
+    if (std::chrono::steady_clock::now() - last_flush_ >= flush_interval_) {
+        FlushLocked(lock);
+    }
+}
+
+void MetricsAggregator::FlushLocked(std::unique_lock<std::mutex>* lock) {
+    // Log without the lock, so that other threads can keep recording.
+    Histograms histograms;
+    Counters counters;
+    histograms.swap(histograms_);
+    counters.swap(counters_);
+    last_flush_ = std::chrono::steady_clock::now();
+    lock->unlock();
+
+    for (const auto& histogram : histograms) {
+        LogHistogramCount(histogram.first.first, histogram.first.second, histogram.second);
+    }
+    for (const auto& counter : counters) {
+        LogCounter(counter.first, counter.second);
+    }
+
+    lock->lock();
+}
+
 // Mirror com.android.internal.logging.MetricsLogger#action().
 void LogMultiAction(int32_t category, int32_t field, const std::string& value) {
     android_log_event_list log(kSysuiMultiActionTag);
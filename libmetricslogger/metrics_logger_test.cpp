@@ -26,3 +26,23 @@ TEST(MetricsLoggerTest, AddSingleBootEvent) {
 TEST(MetricsLoggerTest, AddCounterVal) {
     android::metricslogger::LogCounter("test_count", 10);
 }
+
+TEST(MetricsLoggerTest, AggregateHistogram) {
+    android::metricslogger::MetricsAggregator aggregator(std::chrono::hours(1));
+    for (int i = 0; i < 100; i++) {
+        aggregator.AddHistogram("test_event", i % 4);
+    }
+    aggregator.AddCounter("test_count", 10);
+    aggregator.AddCounter("test_count", 5);
+    // One event per bucket, and one for the counter.
+    EXPECT_EQ(5U, aggregator.pending());
+
+    aggregator.Flush();
+    EXPECT_EQ(0U, aggregator.pending());
+}
+
+TEST(MetricsLoggerTest, AggregateFlushInterval) {
+    android::metricslogger::MetricsAggregator aggregator(std::chrono::milliseconds(0));
+    aggregator.AddHistogram("test_event", 42);
+    EXPECT_EQ(0U, aggregator.pending());
+}
@@ -48,6 +48,10 @@ bool PreInitializeNativeBridge(const char* app_data_dir, const char* instruction
 
 // Initialize the native bridge, if any. Should be called by Runtime::DidForkFromZygote. The JNIEnv*
 // will be used to modify the app environment for the bridge.
+//
+// A bridge that was preloaded by LoadNativeBridge() (v5) is only initialized when it is first
+// needed, e.g. by the loading of the first translated library, and this returns true as soon as
+// the environment is set up.
 bool InitializeNativeBridge(JNIEnv* env, const char* instruction_set);
 
 // Unload the native bridge, if any. Should be called by Runtime::DidForkFromZygote.
@@ -360,6 +364,21 @@ struct NativeBridgeCallbacks {
   // Returns:
   //   vendor namespace or null if it was not set up for the device
   native_bridge_namespace_t* (*getVendorNamespace)();
+
+  // Added callbacks in version 5.
+
+  // Load the state of the bridge that doesn't depend on the app, like its translation of the
+  // system libraries, so that it is shared by all the apps forked from zygote. Called by
+  // LoadNativeBridge(), in zygote.
+  //
+  // A bridge that is preloaded accepts that initialize() is deferred until the app first needs
+  // the bridge, and is then called from any thread; getAppEnv() is called before it.
+  //
+  // Parameters:
+  //   runtime_cbs [IN] the pointer to NativeBridgeRuntimeCallbacks.
+  // Returns:
+  //   true if the bridge was preloaded. It is then initialized lazily, as above.
+  bool (*preload)(const NativeBridgeRuntimeCallbacks* runtime_cbs);
 };
 
 // Runtime interfaces to native bridge.
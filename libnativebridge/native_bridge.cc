@@ -26,7 +26,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cstring>
+#include <mutex>
 
 #include <android-base/macros.h>
 #include <log/log.h>
@@ -50,6 +52,7 @@ enum class NativeBridgeState {
   kOpened,                          // After successful dlopen.
   kPreInitialized,                  // After successful pre-initialization.
   kInitialized,                     // After successful initialization.
+  kLazyInitialized,                 // After initialization, deferred until the first use.
   kClosed                           // Closed or errors.
 };
 
@@ -57,6 +60,7 @@ static constexpr const char* kNotSetupString = "kNotSetup";
 static constexpr const char* kOpenedString = "kOpened";
 static constexpr const char* kPreInitializedString = "kPreInitialized";
 static constexpr const char* kInitializedString = "kInitialized";
+static constexpr const char* kLazyInitializedString = "kLazyInitialized";
 static constexpr const char* kClosedString = "kClosed";
 
 static const char* GetNativeBridgeStateString(NativeBridgeState state) {
@@ -73,13 +77,17 @@ static const char* GetNativeBridgeStateString(NativeBridgeState state) {
     case NativeBridgeState::kInitialized:
       return kInitializedString;
 
+    case NativeBridgeState::kLazyInitialized:
+      return kLazyInitializedString;
+
     case NativeBridgeState::kClosed:
       return kClosedString;
   }
 }
 
-// Current state of the native bridge.
-static NativeBridgeState state = NativeBridgeState::kNotSetup;
+// Current state of the native bridge. Atomic, as a lazily initialized bridge leaves
+// kLazyInitialized on whichever thread uses it first.
+static std::atomic<NativeBridgeState> state(NativeBridgeState::kNotSetup);
 
 // The version of NativeBridge implementation.
 // Different Nativebridge interface needs the service of different version of
@@ -94,6 +102,8 @@ enum NativeBridgeImplementationVersion {
   NAMESPACE_VERSION = 3,
   // The version with vendor namespaces
   VENDOR_NAMESPACE_VERSION = 4,
+  // The version which preloading in zygote and lazy initialization are introduced.
+  PRELOAD_VERSION = 5,
 };
 
 // Whether we had an error at some point.
@@ -101,6 +111,8 @@ static bool had_error = false;
 
 // Handle of the loaded library.
 static void* native_bridge_handle = nullptr;
+// Whether the bridge preloaded its state in zygote, and accepts to be initialized on first use.
+static bool preloaded = false;
 // Pointer to the callbacks. Available as soon as LoadNativeBridge succeeds, but only initialized
 // later.
 static const NativeBridgeCallbacks* callbacks = nullptr;
@@ -109,6 +121,10 @@ static const NativeBridgeRuntimeCallbacks* runtime_callbacks = nullptr;
 
 // The app's code cache directory.
 static char* app_code_cache_dir = nullptr;
+// The app's instruction set, kept for a lazy initialization.
+static char* app_instruction_set = nullptr;
+// Serializes the lazy initialization.
+static std::mutex lazy_initialization_lock;
 
 // Code cache directory (relative to the application private directory)
 // Ideally we'd like to call into framework to retrieve this name. However that's considered an
@@ -134,6 +150,13 @@ static void ReleaseAppCodeCacheDir() {
   }
 }
 
+static void ReleaseAppInstructionSet() {
+  if (app_instruction_set != nullptr) {
+    delete[] app_instruction_set;
+    app_instruction_set = nullptr;
+  }
+}
+
 // We only allow simple names for the library. It is supposed to be a file in
 // /system/lib or /vendor/lib. Only allow a small range of characters, that is
 // names consisting of [a-zA-Z0-9._-] and starting with [a-zA-Z].
@@ -187,6 +210,7 @@ static void CloseNativeBridge(bool with_error) {
   state = NativeBridgeState::kClosed;
   had_error |= with_error;
   ReleaseAppCodeCacheDir();
+  ReleaseAppInstructionSet();
 }
 
 bool LoadNativeBridge(const char* nb_library_filename,
@@ -238,6 +262,14 @@ bool LoadNativeBridge(const char* nb_library_filename,
       } else {
         runtime_callbacks = runtime_cbs;
         state = NativeBridgeState::kOpened;
+
+        // Check the version first, the callback isn't there for older bridges.
+        if (callbacks->version >= PRELOAD_VERSION && isCompatibleWith(PRELOAD_VERSION)) {
+          preloaded = callbacks->preload(runtime_callbacks);
+          if (!preloaded) {
+            ALOGW("Native bridge could not be preloaded, it will be initialized after fork.");
+          }
+        }
       }
     }
     return state == NativeBridgeState::kOpened;
@@ -426,6 +458,19 @@ bool InitializeNativeBridge(JNIEnv* env, const char* instruction_set) {
       ReleaseAppCodeCacheDir();
     }
 
+    // A preloaded bridge is only initialized once the app needs it, see NativeBridgeReady(). The
+    // environment is set up now, as it needs this JNIEnv*.
+    if (preloaded) {
+      if (instruction_set != nullptr) {
+        const size_t len = strlen(instruction_set) + 1;
+        app_instruction_set = new char[len];
+        memcpy(app_instruction_set, instruction_set, len);
+      }
+      SetupEnvironment(callbacks, env, instruction_set);
+      state = NativeBridgeState::kLazyInitialized;
+      return true;
+    }
+
     // If we're still PreInitialized (dind't fail the code cache checks) try to initialize.
     if (state == NativeBridgeState::kPreInitialized) {
       if (callbacks->initialize(runtime_callbacks, app_code_cache_dir, instruction_set)) {
@@ -446,6 +491,27 @@ bool InitializeNativeBridge(JNIEnv* env, const char* instruction_set) {
   return state == NativeBridgeState::kInitialized;
 }
 
+// Completes the initialization InitializeNativeBridge() deferred, if it did. Called by the
+// functions that call into the bridge, which may happen from any thread. Returns whether the
+// bridge is initialized.
+static bool NativeBridgeReady() {
+  if (state == NativeBridgeState::kLazyInitialized) {
+    std::lock_guard<std::mutex> guard(lazy_initialization_lock);
+    if (state == NativeBridgeState::kLazyInitialized) {
+      if (callbacks->initialize(runtime_callbacks, app_code_cache_dir, app_instruction_set)) {
+        state = NativeBridgeState::kInitialized;
+        ReleaseAppCodeCacheDir();
+        ReleaseAppInstructionSet();
+      } else {
+        ALOGE("Native bridge failed to initialize on first use.");
+        // Other threads may be calling into the library, leave it loaded.
+        CloseNativeBridge(true);
+      }
+    }
+  }
+  return state == NativeBridgeState::kInitialized;
+}
+
 void UnloadNativeBridge() {
   // We expect only one place that calls UnloadNativeBridge: Runtime::DidForkFromZygote. At that
   // point we are not multi-threaded, so we do not need locking here.
@@ -454,6 +520,7 @@ void UnloadNativeBridge() {
     case NativeBridgeState::kOpened:
     case NativeBridgeState::kPreInitialized:
     case NativeBridgeState::kInitialized:
+    case NativeBridgeState::kLazyInitialized:
       // Unload.
       dlclose(native_bridge_handle);
       CloseNativeBridge(false);
@@ -477,17 +544,20 @@ bool NativeBridgeError() {
 bool NativeBridgeAvailable() {
   return state == NativeBridgeState::kOpened
       || state == NativeBridgeState::kPreInitialized
-      || state == NativeBridgeState::kInitialized;
+      || state == NativeBridgeState::kInitialized
+      || state == NativeBridgeState::kLazyInitialized;
 }
 
 bool NativeBridgeInitialized() {
   // Calls of this are supposed to happen in a state where the native bridge is stable, i.e., after
-  // Runtime::DidForkFromZygote. In that case we do not need a lock.
-  return state == NativeBridgeState::kInitialized;
+  // Runtime::DidForkFromZygote. In that case we do not need a lock. A lazily initialized bridge
+  // counts as initialized, as it will be on its first use.
+  return state == NativeBridgeState::kInitialized
+      || state == NativeBridgeState::kLazyInitialized;
 }
 
 void* NativeBridgeLoadLibrary(const char* libpath, int flag) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     return callbacks->loadLibrary(libpath, flag);
   }
   return nullptr;
@@ -495,14 +565,14 @@ void* NativeBridgeLoadLibrary(const char* libpath, int flag) {
 
 void* NativeBridgeGetTrampoline(void* handle, const char* name, const char* shorty,
                                 uint32_t len) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     return callbacks->getTrampoline(handle, name, shorty, len);
   }
   return nullptr;
 }
 
 bool NativeBridgeIsSupported(const char* libpath) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     return callbacks->isSupported(libpath);
   }
   return false;
@@ -516,7 +586,7 @@ uint32_t NativeBridgeGetVersion() {
 }
 
 NativeBridgeSignalHandlerFn NativeBridgeGetSignalHandler(int signal) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(SIGNAL_VERSION)) {
       return callbacks->getSignalHandler(signal);
     } else {
@@ -527,7 +597,7 @@ NativeBridgeSignalHandlerFn NativeBridgeGetSignalHandler(int signal) {
 }
 
 int NativeBridgeUnloadLibrary(void* handle) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->unloadLibrary(handle);
     } else {
@@ -538,7 +608,7 @@ int NativeBridgeUnloadLibrary(void* handle) {
 }
 
 const char* NativeBridgeGetError() {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->getError();
     } else {
@@ -549,7 +619,7 @@ const char* NativeBridgeGetError() {
 }
 
 bool NativeBridgeIsPathSupported(const char* path) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->isPathSupported(path);
     } else {
@@ -561,7 +631,7 @@ bool NativeBridgeIsPathSupported(const char* path) {
 
 bool NativeBridgeInitAnonymousNamespace(const char* public_ns_sonames,
                                         const char* anon_ns_library_path) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->initAnonymousNamespace(public_ns_sonames, anon_ns_library_path);
     } else {
@@ -578,7 +648,7 @@ native_bridge_namespace_t* NativeBridgeCreateNamespace(const char* name,
                                                        uint64_t type,
                                                        const char* permitted_when_isolated_path,
                                                        native_bridge_namespace_t* parent_ns) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->createNamespace(name,
                                         ld_library_path,
@@ -596,7 +666,7 @@ native_bridge_namespace_t* NativeBridgeCreateNamespace(const char* name,
 
 bool NativeBridgeLinkNamespaces(native_bridge_namespace_t* from, native_bridge_namespace_t* to,
                                 const char* shared_libs_sonames) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->linkNamespaces(from, to, shared_libs_sonames);
     } else {
@@ -608,7 +678,7 @@ bool NativeBridgeLinkNamespaces(native_bridge_namespace_t* from, native_bridge_n
 }
 
 native_bridge_namespace_t* NativeBridgeGetVendorNamespace() {
-  if (!NativeBridgeInitialized() || !isCompatibleWith(VENDOR_NAMESPACE_VERSION)) {
+  if (!NativeBridgeReady() || !isCompatibleWith(VENDOR_NAMESPACE_VERSION)) {
     return nullptr;
   }
 
@@ -616,7 +686,7 @@ native_bridge_namespace_t* NativeBridgeGetVendorNamespace() {
 }
 
 void* NativeBridgeLoadLibraryExt(const char* libpath, int flag, native_bridge_namespace_t* ns) {
-  if (NativeBridgeInitialized()) {
+  if (NativeBridgeReady()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
       return callbacks->loadLibraryExt(libpath, flag, ns);
     } else {
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "NativeBridgeTest.h"
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+namespace android {
+
+constexpr const char* kNativeBridgeLibrary5 = "libnativebridge5-dummy.so";
+
+TEST_F(NativeBridgeTest, V5_LazyInitialize) {
+  // Init
+  ASSERT_TRUE(LoadNativeBridge(kNativeBridgeLibrary5, nullptr));
+  ASSERT_TRUE(NativeBridgeAvailable());
+  ASSERT_TRUE(PreInitializeNativeBridge(".", "isa"));
+  ASSERT_TRUE(NativeBridgeAvailable());
+  ASSERT_TRUE(InitializeNativeBridge(nullptr, "isa"));
+  ASSERT_TRUE(NativeBridgeAvailable());
+  ASSERT_TRUE(NativeBridgeInitialized());
+  ASSERT_EQ(5U, NativeBridgeGetVersion());
+
+  void* handle = dlopen(kNativeBridgeLibrary5, RTLD_NOW | RTLD_NOLOAD);
+  ASSERT_TRUE(handle != nullptr);
+  int* initialize_calls = reinterpret_cast<int*>(dlsym(handle, "native_bridge5_initialize_calls"));
+  ASSERT_TRUE(initialize_calls != nullptr);
+
+  // The bridge is only initialized when first used, and only once.
+  ASSERT_EQ(0, *initialize_calls);
+  ASSERT_TRUE(NativeBridgeIsPathSupported(nullptr));
+  ASSERT_EQ(1, *initialize_calls);
+  ASSERT_EQ(nullptr, NativeBridgeLoadLibraryExt(nullptr, 0, nullptr));
+  ASSERT_EQ(1, *initialize_calls);
+  ASSERT_TRUE(NativeBridgeInitialized());
+  dlclose(handle);
+
+  // Unload
+  UnloadNativeBridge();
+  ASSERT_FALSE(NativeBridgeAvailable());
+  ASSERT_FALSE(NativeBridgeError());
+
+  // Clean-up code_cache
+  ASSERT_EQ(0, rmdir(kCodeCache));
+}
+
+}  // namespace android
@@ -20,6 +20,7 @@
 #include "jni.h"
 #include <stdint.h>
 #include <string>
+#include <vector>
 #if defined(__ANDROID__)
 #include <android/dlext.h>
 #endif
@@ -47,6 +48,15 @@ void* OpenNativeLibrary(JNIEnv* env,
                         bool* needs_native_bridge,
                         std::string* error_msg);
 
+// Looks up |libraries|, given by name as System.loadLibrary() maps them, on the
+// library path of the namespace of |class_loader| ahead of OpenNativeLibrary(),
+// for instance from a background thread while the app starts. Returns the number
+// of them found there; the others are left to the linker when they are opened.
+__attribute__((visibility("default")))
+size_t PreloadNativeLibraries(JNIEnv* env,
+                              jobject class_loader,
+                              const std::vector<std::string>& libraries);
+
 __attribute__((visibility("default")))
 bool CloseNativeLibrary(void* handle, const bool needs_native_bridge);
 
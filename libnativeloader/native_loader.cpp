@@ -25,6 +25,8 @@
 #include "log/log.h"
 #endif
 #include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include "nativebridge/native_bridge.h"
 
@@ -32,6 +34,8 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <android-base/file.h>
@@ -51,13 +55,98 @@ using namespace std::string_literals;
 namespace android {
 
 #if defined(__ANDROID__)
+// Remembers where the libraries opened by name were found on the library path of
+// a classloader namespace, so that opening them again doesn't make the linker
+// probe every directory of the path. An entry is dropped once the file it points
+// to is replaced, as when the apk is updated.
+class LibraryPathCache {
+ public:
+  LibraryPathCache(const std::string& library_path, const std::string& exposed_libraries)
+      : search_path_(base::Split(library_path, ":")) {
+    for (const std::string& soname : base::Split(exposed_libraries, ":")) {
+      if (!soname.empty()) {
+        exposed_libraries_.insert(soname);
+      }
+    }
+  }
+
+  // Returns the path |name| resolves to on the library path, or an empty string if
+  // the linker has to look it up itself.
+  std::string Resolve(const char* name) {
+    // Paths are opened as they are, and the libraries linked from other namespaces
+    // are found by soname before the library path is searched.
+    if (name == nullptr || strchr(name, '/') != nullptr ||
+        exposed_libraries_.count(name) != 0) {
+      return "";
+    }
+
+    auto it = entries_.find(name);
+    if (it != entries_.end()) {
+      struct stat st;
+      if (stat(it->second.path.c_str(), &st) == 0 && it->second.Matches(st)) {
+        return it->second.path;
+      }
+      entries_.erase(it);
+    }
+
+    Entry entry;
+    if (!Search(name, &entry)) {
+      return "";
+    }
+    return entries_.emplace(name, entry).first->second.path;
+  }
+
+ private:
+  struct Entry {
+    std::string path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+
+    bool Matches(const struct stat& st) const {
+      return st.st_dev == dev && st.st_ino == ino && st.st_mtim.tv_sec == mtime.tv_sec &&
+             st.st_mtim.tv_nsec == mtime.tv_nsec;
+    }
+  };
+
+  bool Search(const std::string& name, Entry* entry) {
+    for (const std::string& dir : search_path_) {
+      if (dir.empty()) {
+        continue;
+      }
+      // Libraries stored uncompressed in the apk ("base.apk!/lib/<abi>") can't
+      // be stat'ed; leave the whole search to the linker so that the order of
+      // the library path is kept.
+      if (dir.find('!') != std::string::npos) {
+        return false;
+      }
+      std::string path = dir + "/" + name;
+      struct stat st;
+      if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        entry->path = path;
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+        entry->mtime = st.st_mtim;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::string> search_path_;
+  std::unordered_set<std::string> exposed_libraries_;
+  std::unordered_map<std::string, Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(LibraryPathCache);
+};
+
 class NativeLoaderNamespace {
  public:
   NativeLoaderNamespace()
       : android_ns_(nullptr), native_bridge_ns_(nullptr) { }
 
-  explicit NativeLoaderNamespace(android_namespace_t* ns)
-      : android_ns_(ns), native_bridge_ns_(nullptr) { }
+  NativeLoaderNamespace(android_namespace_t* ns, std::shared_ptr<LibraryPathCache> path_cache)
+      : android_ns_(ns), native_bridge_ns_(nullptr), path_cache_(std::move(path_cache)) { }
 
   explicit NativeLoaderNamespace(native_bridge_namespace_t* ns)
       : android_ns_(nullptr), native_bridge_ns_(ns) { }
@@ -81,10 +170,18 @@ class NativeLoaderNamespace {
     return native_bridge_ns_ == nullptr;
   }
 
+  // Null for the namespaces of the native bridge, which finds the libraries
+  // itself.
+  LibraryPathCache* get_path_cache() const {
+    return path_cache_.get();
+  }
+
  private:
   // Only one of them can be not null
   android_namespace_t* android_ns_;
   native_bridge_namespace_t* native_bridge_ns_;
+  // Shared by the copies handed out by FindNamespaceByClassLoader().
+  std::shared_ptr<LibraryPathCache> path_cache_;
 };
 
 static constexpr const char kPublicNativeLibrariesSystemConfigPathFromRoot[] =
@@ -287,7 +384,12 @@ class LibraryNamespaces {
         }
       }
 
-      native_loader_ns = NativeLoaderNamespace(ns);
+      std::string linked_libraries = system_exposed_libraries + ':' + vendor_public_libraries_;
+      if (vndk_ns != nullptr) {
+        linked_libraries = linked_libraries + ':' + system_vndksp_libraries_;
+      }
+      native_loader_ns = NativeLoaderNamespace(
+          ns, std::make_shared<LibraryPathCache>(library_path, linked_libraries));
     } else {
       native_bridge_namespace_t* ns = NativeBridgeCreateNamespace(namespace_name,
                                                                   nullptr,
@@ -672,7 +774,10 @@ void* OpenNativeLibrary(JNIEnv* env,
     extinfo.flags = ANDROID_DLEXT_USE_NAMESPACE;
     extinfo.library_namespace = ns.get_android_ns();
 
-    void* handle = android_dlopen_ext(path, RTLD_NOW, &extinfo);
+    LibraryPathCache* path_cache = ns.get_path_cache();
+    std::string resolved_path = path_cache != nullptr ? path_cache->Resolve(path) : "";
+    void* handle = android_dlopen_ext(resolved_path.empty() ? path : resolved_path.c_str(),
+                                      RTLD_NOW, &extinfo);
     if (handle == nullptr) {
       *error_msg = dlerror();
     }
@@ -735,6 +840,30 @@ void* OpenNativeLibrary(JNIEnv* env,
 #endif
 }
 
+size_t PreloadNativeLibraries(JNIEnv* env,
+                              jobject class_loader,
+                              const std::vector<std::string>& libraries) {
+#if defined(__ANDROID__)
+  std::lock_guard<std::mutex> guard(g_namespaces_mutex);
+  NativeLoaderNamespace ns;
+  if (!g_namespaces->FindNamespaceByClassLoader(env, class_loader, &ns) ||
+      ns.get_path_cache() == nullptr) {
+    return 0;
+  }
+
+  size_t resolved = 0;
+  for (const std::string& library : libraries) {
+    if (!ns.get_path_cache()->Resolve(library.c_str()).empty()) {
+      resolved++;
+    }
+  }
+  return resolved;
+#else
+  UNUSED(env, class_loader, libraries);
+  return 0;
+#endif
+}
+
 bool CloseNativeLibrary(void* handle, const bool needs_native_bridge) {
     return needs_native_bridge ? NativeBridgeUnloadLibrary(handle) :
                                  dlclose(handle);
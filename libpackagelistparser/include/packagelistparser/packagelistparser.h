@@ -87,6 +87,25 @@ extern bool packagelist_parse(pfn_on_package callback, void *userdata);
  */
 extern void packagelist_free(pkg_info *info);
 
+/**
+ * Looks up a package in an index of PACKAGES_LIST_FILE, which is parsed on the
+ * first lookup, and again only when the file was replaced or modified since.
+ * Lookups are thread safe.
+ * @param name
+ *  The name of the package.
+ * @return
+ *  A copy of the package's information, to free with packagelist_free(), or
+ *  NULL with errno set to ENOENT if there is no such package, or to another
+ *  value on failure.
+ */
+extern pkg_info *packagelist_find_by_name(const char *name);
+
+/**
+ * Same as packagelist_find_by_name(), by uid. Of the packages sharing a uid,
+ * the first listed is returned.
+ */
+extern pkg_info *packagelist_find_by_uid(uid_t uid);
+
 __END_DECLS
 
 #endif /* PACKAGELISTPARSER_H_ */
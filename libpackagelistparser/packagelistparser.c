@@ -21,11 +21,13 @@
 #define LOG_TAG "packagelistparser"
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/limits.h>
+#include <sys/stat.h>
 
 #include <log/log.h>
 #include <packagelistparser/packagelistparser.h>
@@ -263,3 +265,226 @@ void packagelist_free(pkg_info *info)
         free(info);
     }
 }
+
+/*
+ * The index of packagelist_find_by_*(): the packages in the order they are
+ * listed, with the sorted orders to search them by. PackageManager writes the
+ * file anew and renames it into place, so a change of inode, size or mtime
+ * tells that the index is stale.
+ */
+typedef struct index_entry {
+    pkg_info *info;
+    size_t line;
+} index_entry;
+
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stat index_stat;
+static index_entry *index_by_name;
+static index_entry *index_by_uid;
+static size_t index_cnt;
+
+struct index_builder {
+    index_entry *entries;
+    size_t cnt;
+    size_t capacity;
+    bool out_of_memory;
+};
+
+static bool add_to_index(pkg_info *info, void *userdata)
+{
+    struct index_builder *builder = userdata;
+
+    if (builder->cnt == builder->capacity) {
+        size_t capacity = builder->capacity ? builder->capacity * 2 : 512;
+        index_entry *entries = realloc(builder->entries, capacity * sizeof(*entries));
+        if (!entries) {
+            packagelist_free(info);
+            builder->out_of_memory = true;
+            return false;
+        }
+        builder->entries = entries;
+        builder->capacity = capacity;
+    }
+
+    builder->entries[builder->cnt].info = info;
+    builder->entries[builder->cnt].line = builder->cnt;
+    builder->cnt++;
+    return true;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    const index_entry *entry_a = a;
+    const index_entry *entry_b = b;
+    int ret = strcmp(entry_a->info->name, entry_b->info->name);
+
+    if (ret) {
+        return ret;
+    }
+    return entry_a->line < entry_b->line ? -1 : entry_a->line > entry_b->line;
+}
+
+static int compare_uids(const void *a, const void *b)
+{
+    const index_entry *entry_a = a;
+    const index_entry *entry_b = b;
+
+    if (entry_a->info->uid != entry_b->info->uid) {
+        return entry_a->info->uid < entry_b->info->uid ? -1 : 1;
+    }
+    return entry_a->line < entry_b->line ? -1 : entry_a->line > entry_b->line;
+}
+
+static void free_index_locked()
+{
+    size_t i;
+
+    for (i = 0; i < index_cnt; i++) {
+        packagelist_free(index_by_name[i].info);
+    }
+    free(index_by_name);
+    free(index_by_uid);
+    index_by_name = NULL;
+    index_by_uid = NULL;
+    index_cnt = 0;
+    memset(&index_stat, 0, sizeof(index_stat));
+}
+
+static bool refresh_index_locked()
+{
+    struct stat st;
+    struct index_builder builder = { NULL, 0, 0, false };
+
+    if (stat(PACKAGES_LIST_FILE, &st) < 0) {
+        return false;
+    }
+    if (index_by_name && st.st_ino == index_stat.st_ino && st.st_size == index_stat.st_size &&
+            st.st_mtim.tv_sec == index_stat.st_mtim.tv_sec &&
+            st.st_mtim.tv_nsec == index_stat.st_mtim.tv_nsec) {
+        return true;
+    }
+
+    free_index_locked();
+
+    if (!packagelist_parse(add_to_index, &builder)) {
+        goto err;
+    }
+    if (builder.out_of_memory) {
+        errno = ENOMEM;
+        goto err;
+    }
+
+    index_by_uid = malloc((builder.cnt ? builder.cnt : 1) * sizeof(*index_by_uid));
+    if (!index_by_uid) {
+        goto err;
+    }
+    memcpy(index_by_uid, builder.entries, builder.cnt * sizeof(*index_by_uid));
+    qsort(index_by_uid, builder.cnt, sizeof(*index_by_uid), compare_uids);
+
+    index_by_name = builder.entries ? builder.entries : malloc(sizeof(*index_by_name));
+    if (!index_by_name) {
+        free(index_by_uid);
+        index_by_uid = NULL;
+        return false;
+    }
+    qsort(index_by_name, builder.cnt, sizeof(*index_by_name), compare_names);
+    index_cnt = builder.cnt;
+    index_stat = st;
+    return true;
+
+err:
+    while (builder.cnt) {
+        packagelist_free(builder.entries[--builder.cnt].info);
+    }
+    free(builder.entries);
+    if (!errno) {
+        errno = EINVAL;
+    }
+    return false;
+}
+
+static pkg_info *dup_pkg_info(const pkg_info *info)
+{
+    pkg_info *copy = calloc(1, sizeof(*copy));
+    if (!copy) {
+        return NULL;
+    }
+
+    copy->uid = info->uid;
+    copy->debuggable = info->debuggable;
+    copy->name = strdup(info->name);
+    copy->data_dir = strdup(info->data_dir);
+    copy->seinfo = strdup(info->seinfo);
+    copy->gids.cnt = info->gids.cnt;
+    if (info->gids.cnt) {
+        copy->gids.gids = malloc(info->gids.cnt * sizeof(gid_t));
+        if (copy->gids.gids) {
+            memcpy(copy->gids.gids, info->gids.gids, info->gids.cnt * sizeof(gid_t));
+        }
+    }
+
+    if (!copy->name || !copy->data_dir || !copy->seinfo || (info->gids.cnt && !copy->gids.gids)) {
+        packagelist_free(copy);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return copy;
+}
+
+/*
+ * Returns a copy of the first entry of |index| that |compare| finds equal to
+ * |key|, as the indexes are sorted by their line after their key.
+ */
+static pkg_info *find_in_index(const index_entry **index, const pkg_info *key,
+                               int (*compare)(const void *, const void *))
+{
+    pkg_info *found = NULL;
+    size_t lo = 0;
+    size_t hi;
+    int saved_errno = errno;
+
+    pthread_mutex_lock(&index_lock);
+    errno = 0;
+    if (!refresh_index_locked()) {
+        pthread_mutex_unlock(&index_lock);
+        return NULL;
+    }
+
+    /* Find the first entry not before |key|, with a line before all others. */
+    index_entry key_entry = { (pkg_info *) key, 0 };
+    hi = index_cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (compare(&(*index)[mid], &key_entry) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    key_entry.line = (size_t) -1;
+    if (lo < index_cnt && compare(&(*index)[lo], &key_entry) < 0) {
+        found = dup_pkg_info((*index)[lo].info);
+        if (found) {
+            errno = saved_errno;
+        }
+    } else {
+        errno = ENOENT;
+    }
+    pthread_mutex_unlock(&index_lock);
+    return found;
+}
+
+pkg_info *packagelist_find_by_name(const char *name)
+{
+    pkg_info key = { .name = (char *) name };
+
+    return find_in_index((const index_entry **) &index_by_name, &key, compare_names);
+}
+
+pkg_info *packagelist_find_by_uid(uid_t uid)
+{
+    pkg_info key = { .uid = uid };
+
+    return find_in_index((const index_entry **) &index_by_uid, &key, compare_uids);
+}
@@ -60,6 +60,12 @@ PIXELFLINGER_SRC_FILES_mips64 := \
 	arch-mips64/col32cb16blend.S \
 	arch-mips64/t32cb16blend.S \
 
+PIXELFLINGER_SRC_FILES_x86 := \
+	arch-x86/scanline_sse2.cpp \
+
+PIXELFLINGER_SRC_FILES_x86_64 := \
+	arch-x86/scanline_sse2.cpp \
+
 #
 # Shared library
 #
@@ -70,6 +76,8 @@ LOCAL_SRC_FILES_arm := $(PIXELFLINGER_SRC_FILES_arm)
 LOCAL_SRC_FILES_arm64 := $(PIXELFLINGER_SRC_FILES_arm64)
 LOCAL_SRC_FILES_mips := $(PIXELFLINGER_SRC_FILES_mips)
 LOCAL_SRC_FILES_mips64 := $(PIXELFLINGER_SRC_FILES_mips64)
+LOCAL_SRC_FILES_x86 := $(PIXELFLINGER_SRC_FILES_x86)
+LOCAL_SRC_FILES_x86_64 := $(PIXELFLINGER_SRC_FILES_x86_64)
 LOCAL_CFLAGS := $(PIXELFLINGER_CFLAGS)
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/include
 LOCAL_C_INCLUDES += $(LOCAL_EXPORT_C_INCLUDE_DIRS) \
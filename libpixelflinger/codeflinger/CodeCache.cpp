@@ -149,34 +149,37 @@ ssize_t Assembly::resize(size_t newSize)
 // ----------------------------------------------------------------------------
 
 CodeCache::CodeCache(size_t size)
-    : mCacheSize(size), mCacheInUse(0)
+    : mWhen(0), mCacheSize(size), mCacheInUse(0)
 {
-    pthread_mutex_init(&mLock, 0);
+    pthread_rwlock_init(&mLock, 0);
 }
 
 CodeCache::~CodeCache()
 {
-    pthread_mutex_destroy(&mLock);
+    pthread_rwlock_destroy(&mLock);
 }
 
 sp<Assembly> CodeCache::lookup(const AssemblyKeyBase& keyBase) const
 {
-    pthread_mutex_lock(&mLock);
+    pthread_rwlock_rdlock(&mLock);
     sp<Assembly> r;
     ssize_t index = mCacheData.indexOfKey(key_t(keyBase));
     if (index >= 0) {
         const cache_entry_t& e = mCacheData.valueAt(index);
-        e.when = mWhen++;
+        // Entries are only added and evicted with the lock held for writing;
+        // all a lookup changes is the LRU order.
+        e.when.store(mWhen.fetch_add(1, std::memory_order_relaxed),
+                     std::memory_order_relaxed);
         r = e.entry;
     }
-    pthread_mutex_unlock(&mLock);
+    pthread_rwlock_unlock(&mLock);
     return r;
 }
 
 int CodeCache::cache(  const AssemblyKeyBase& keyBase,
                             const sp<Assembly>& assembly)
 {
-    pthread_mutex_lock(&mLock);
+    pthread_rwlock_wrlock(&mLock);
 
     const ssize_t assemblySize = assembly->size();
     while (mCacheInUse + assemblySize > mCacheSize) {
@@ -194,17 +197,17 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
         mCacheData.removeItemsAt(lru);
     }
 
-    ssize_t err = mCacheData.add(key_t(keyBase), cache_entry_t(assembly, mWhen));
+    ssize_t err = mCacheData.add(key_t(keyBase),
+            cache_entry_t(assembly, mWhen.fetch_add(1, std::memory_order_relaxed)));
     if (err >= 0) {
         mCacheInUse += assemblySize;
-        mWhen++;
         // synchronize caches...
         char* base = reinterpret_cast<char*>(assembly->base());
         char* curr = reinterpret_cast<char*>(base + assembly->size());
         __builtin___clear_cache(base, curr);
     }
 
-    pthread_mutex_unlock(&mLock);
+    pthread_rwlock_unlock(&mLock);
     return err;
 }
 
@@ -84,6 +84,8 @@ public:
     explicit            CodeCache(size_t size);
                         ~CodeCache();
 
+    // Lookups only take the lock for reading, so that threads picking a
+    // scanline that is already cached don't wait for one another.
     sp<Assembly>        lookup(const AssemblyKeyBase& key) const;
 
     int                 cache(const AssemblyKeyBase& key,
@@ -95,8 +97,16 @@ private:
         inline cache_entry_t() { }
         inline cache_entry_t(const sp<Assembly>& a, int64_t w)
                 : entry(a), when(w) { }
-        sp<Assembly>            entry;
-        mutable int64_t         when;
+        inline cache_entry_t(const cache_entry_t& rhs)
+                : entry(rhs.entry), when(rhs.when.load(std::memory_order_relaxed)) { }
+        inline cache_entry_t& operator = (const cache_entry_t& rhs) {
+            entry = rhs.entry;
+            when.store(rhs.when.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+        sp<Assembly>                    entry;
+        // Updated by concurrent lookups.
+        mutable std::atomic<int64_t>    when;
     };
 
     class key_t {
@@ -109,8 +119,8 @@ private:
         explicit key_t(const AssemblyKeyBase& k) : mKey(&k)  { }
     };
 
-    mutable pthread_mutex_t             mLock;
-    mutable int64_t                     mWhen;
+    mutable pthread_rwlock_t            mLock;
+    mutable std::atomic<int64_t>        mWhen;
     size_t                              mCacheSize;
     size_t                              mCacheInUse;
     KeyedVector<key_t, cache_entry_t>   mCacheData;
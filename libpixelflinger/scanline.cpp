@@ -136,6 +136,10 @@ extern "C" void scanline_t32cb16blend_mips(uint16_t*, uint32_t*, size_t);
 #elif defined(__mips__) && defined(__LP64__)
 extern "C" void scanline_t32cb16blend_mips64(uint16_t*, uint32_t*, size_t);
 extern "C" void scanline_col32cb16blend_mips64(uint16_t *dst, uint32_t col, size_t ct);
+#elif defined(__SSE2__)
+extern "C" void scanline_t32cb16blend_sse2(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_t32cb16_sse2(uint16_t *dst, uint32_t *src, size_t ct);
+extern "C" void scanline_col32cb16blend_sse2(uint16_t *dst, uint32_t col, size_t ct);
 #endif
 
 // ----------------------------------------------------------------------------
@@ -2107,6 +2111,8 @@ void scanline_col32cb16blend(context_t* c)
     scanline_col32cb16blend_arm64(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
 #elif ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && (defined(__mips__) && defined(__LP64__)))
     scanline_col32cb16blend_mips64(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
+#elif ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__SSE2__))
+    scanline_col32cb16blend_sse2(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
 #else
     uint32_t s = GGL_RGBA_TO_HOST(c->packed8888);
     int sA = (s>>24);
@@ -2144,6 +2150,10 @@ void scanline_t32cb16(context_t* c)
     const int32_t u = (c->state.texture[0].shade.is0>>16) + x;
     const int32_t v = (c->state.texture[0].shade.it0>>16) + y;
     uint32_t *src = reinterpret_cast<uint32_t*>(tex->data)+(u+(tex->stride*v));
+
+#if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__SSE2__))
+    scanline_t32cb16_sse2(dst, src, ct);
+#else
     uint32_t s, d;
 
     if (ct==1 || uintptr_t(dst)&2) {
@@ -2174,12 +2184,14 @@ last_one:
     if (ct > 0) {
         goto last_one;
     }
+#endif
 }
 
 void scanline_t32cb16blend(context_t* c)
 {
 #if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && (defined(__arm__) || defined(__aarch64__) || \
-    (defined(__mips__) && ((!defined(__LP64__) && __mips_isa_rev < 6) || defined(__LP64__)))))
+    (defined(__mips__) && ((!defined(__LP64__) && __mips_isa_rev < 6) || defined(__LP64__))) || \
+    defined(__SSE2__)))
     int32_t x = c->iterators.xl;
     size_t ct = c->iterators.xr - x;
     int32_t y = c->iterators.y;
@@ -2199,6 +2211,8 @@ void scanline_t32cb16blend(context_t* c)
     scanline_t32cb16blend_mips(dst, src, ct);
 #elif defined(__mips__) && defined(__LP64__)
     scanline_t32cb16blend_mips64(dst, src, ct);
+#elif defined(__SSE2__)
+    scanline_t32cb16blend_sse2(dst, src, ct);
 #endif
 #else
     dst_iterator16  di(c);
@@ -0,0 +1,3 @@
+ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+include $(all-subdir-makefiles)
+endif
@@ -0,0 +1,18 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    scanline_sse2_test.cpp \
+    ../../../arch-x86/scanline_sse2.cpp
+
+LOCAL_SHARED_LIBRARIES :=
+
+LOCAL_C_INCLUDES :=
+
+LOCAL_MODULE:= test-pixelflinger-x86-scanline_sse2
+
+LOCAL_CFLAGS := -Wall -Werror
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" void scanline_t32cb16blend_sse2(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_col32cb16blend_sse2(uint16_t*, uint32_t, size_t);
+extern "C" void scanline_t32cb16_sse2(uint16_t*, uint32_t*, size_t);
+
+// The C versions of scanline.cpp.
+static uint16_t blend_c(uint32_t s, uint16_t d) {
+    int sA = (s>>24);
+    int f = 0x100 - (sA + (sA>>7));
+    int sR = (s >> (   3))&0x1F;
+    int sG = (s >> ( 8+2))&0x3F;
+    int sB = (s >> (16+3))&0x1F;
+    int dR = (d>>11)&0x1f;
+    int dG = (d>>5)&0x3f;
+    int dB = (d)&0x1f;
+    sR += (f*dR)>>8;
+    sG += (f*dG)>>8;
+    sB += (f*dB)>>8;
+    return uint16_t((sR<<11)|(sG<<5)|sB);
+}
+
+static uint16_t convert_c(uint32_t s) {
+    return uint16_t(((s << 8) & 0xf800) | ((s >> 5) & 0x07e0) | ((s >> 19) & 0x001f));
+}
+
+static const size_t kMaxCount = 37;
+
+static uint32_t random_pixel() {
+    uint32_t s = uint32_t(rand()) ^ (uint32_t(rand()) << 16);
+    switch (rand() % 4) {
+        case 0: return 0;
+        case 1: return s | 0xff000000;
+        default: return s;
+    }
+}
+
+int main() {
+    int failures = 0;
+    srand(1);
+    for (int i = 0; i < 10000; i++) {
+        const size_t count = rand() % kMaxCount;
+        uint32_t src[kMaxCount + 1];
+        uint16_t dst[kMaxCount + 1], expected[kMaxCount + 1];
+        for (size_t j = 0; j <= count; j++) {
+            src[j] = random_pixel();
+            dst[j] = expected[j] = uint16_t(rand());
+        }
+        // The pixel past the end must be left alone.
+        for (size_t j = 0; j < count; j++) {
+            expected[j] = src[j] ? blend_c(src[j], dst[j]) : dst[j];
+        }
+        scanline_t32cb16blend_sse2(dst, src, count);
+        if (memcmp(dst, expected, sizeof(dst[0]) * (count + 1)) != 0) {
+            printf("t32cb16blend failed for count %zu\n", count);
+            failures++;
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            expected[j] = blend_c(src[0], dst[j]);
+        }
+        scanline_col32cb16blend_sse2(dst, src[0], count);
+        if (memcmp(dst, expected, sizeof(dst[0]) * (count + 1)) != 0) {
+            printf("col32cb16blend failed for count %zu, color %08" PRIx32 "\n", count, src[0]);
+            failures++;
+        }
+
+        for (size_t j = 0; j < count; j++) {
+            expected[j] = convert_c(src[j]);
+        }
+        scanline_t32cb16_sse2(dst, src, count);
+        if (memcmp(dst, expected, sizeof(dst[0]) * (count + 1)) != 0) {
+            printf("t32cb16 failed for count %zu\n", count);
+            failures++;
+        }
+    }
+    printf("%s\n", failures ? "Failed" : "Passed");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -17,6 +17,8 @@
 #ifndef _PROCESSGROUP_H_
 #define _PROCESSGROUP_H_
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
@@ -31,8 +33,17 @@ int killProcessGroup(uid_t uid, int initialPid, int signal);
 // that it only returns 0 in the case that the cgroup exists and it contains no processes.
 int killProcessGroupOnce(uid_t uid, int initialPid, int signal);
 
+// Kills the process cgroups of uids[i] and initialPids[i], for i < count, like
+// killProcessGroup(), but waits for all of them at once. Returns 0 if all of them
+// were removed, and -1 otherwise.
+int killProcessGroups(size_t count, const uid_t* uids, const int* initialPids, int signal);
+
 int createProcessGroup(uid_t uid, int initialPid);
 
+// Moves the processes to the process cgroup created for initialPid.
+// Returns 0, or the -errno of the first process that could not be moved.
+int addProcessesToProcessGroup(uid_t uid, int initialPid, const pid_t* pids, size_t count);
+
 bool setProcessGroupSwappiness(uid_t uid, int initialPid, int swappiness);
 bool setProcessGroupSoftLimit(uid_t uid, int initialPid, int64_t softLimitInBytes);
 bool setProcessGroupLimit(uid_t uid, int initialPid, int64_t limitInBytes);
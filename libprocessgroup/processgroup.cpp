@@ -31,11 +31,13 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -44,6 +46,7 @@
 #endif
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <private/android_filesystem_config.h>
 
 #include <processgroup/processgroup.h>
@@ -53,7 +56,8 @@ using android::base::GetBoolProperty;
 #endif
 using android::base::StartsWith;
 using android::base::StringPrintf;
-using android::base::WriteStringToFile;
+using android::base::WriteFully;
+using android::base::unique_fd;
 
 using namespace std::chrono_literals;
 
@@ -61,7 +65,11 @@ using namespace std::chrono_literals;
 #define MEM_CGROUP_TASKS "/dev/memcg/apps/tasks"
 #define ACCT_CGROUP_PATH "/acct"
 
-#define PROCESSGROUP_CGROUP_PROCS_FILE "/cgroup.procs"
+#define PROCESSGROUP_CGROUP_PROCS_FILE "cgroup.procs"
+#define PROCESSGROUP_CGROUP_KILL_FILE "cgroup.kill"
+
+// Number of process cgroup directories kept open.
+#define PROCESSGROUP_DIR_CACHE_SIZE 64
 
 std::once_flag init_path_flag;
 
@@ -98,9 +106,86 @@ static std::string ConvertUidPidToPath(uid_t uid, int pid) {
     return StringPrintf("%s/uid_%d/pid_%d", GetCgroupRootPath().c_str(), uid, pid);
 }
 
+// The directories of the process cgroups used last, so that their files are
+// opened relative to them instead of resolving their whole path every time.
+// Groups are created, tuned and killed in quick succession while apps start
+// and stop. An open directory does not prevent its cgroup from being removed.
+class ProcessGroupDirCache {
+  public:
+    // Returns the fd of the directory of the process cgroup, or nullptr with
+    // errno set. The fd stays valid while the returned pointer is held, even
+    // if it is dropped from the cache meanwhile.
+    std::shared_ptr<unique_fd> Get(uid_t uid, int pid) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+                if (it->uid == uid && it->pid == pid) {
+                    entries_.splice(entries_.begin(), entries_, it);
+                    return it->fd;
+                }
+            }
+        }
+
+        auto path = ConvertUidPidToPath(uid, pid);
+        auto fd = std::make_shared<unique_fd>(
+                TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+        if (*fd == -1) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.push_front(Entry{uid, pid, fd});
+        if (entries_.size() > PROCESSGROUP_DIR_CACHE_SIZE) {
+            entries_.pop_back();
+        }
+        return fd;
+    }
+
+    void Remove(uid_t uid, int pid) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.remove_if([=](const Entry& e) { return e.uid == uid && e.pid == pid; });
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+    }
+
+  private:
+    struct Entry {
+        uid_t uid;
+        int pid;
+        std::shared_ptr<unique_fd> fd;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+};
+
+static ProcessGroupDirCache& GetProcessGroupDirCache() {
+    static ProcessGroupDirCache* cache = new ProcessGroupDirCache();
+    return *cache;
+}
+
+// Opens a file of the process cgroup. Returns -1 with errno set on failure.
+static int OpenProcessGroupFile(uid_t uid, int pid, const char* file_name, int flags) {
+    auto dir = GetProcessGroupDirCache().Get(uid, pid);
+    if (dir == nullptr) {
+        return -1;
+    }
+    return TEMP_FAILURE_RETRY(openat(*dir, file_name, flags | O_CLOEXEC));
+}
+
+static bool WriteProcessGroupFile(uid_t uid, int pid, const char* file_name,
+                                  const std::string& value) {
+    unique_fd fd(OpenProcessGroupFile(uid, pid, file_name, O_WRONLY));
+    return fd != -1 && WriteFully(fd, value.data(), value.size());
+}
+
 static int RemoveProcessGroup(uid_t uid, int pid) {
     int ret;
 
+    GetProcessGroupDirCache().Remove(uid, pid);
     auto uid_pid_path = ConvertUidPidToPath(uid, pid);
     ret = rmdir(uid_pid_path.c_str());
 
@@ -133,6 +218,7 @@ static void RemoveUidProcessGroups(const std::string& uid_path) {
 void removeAllProcessGroups()
 {
     LOG(VERBOSE) << "removeAllProcessGroups()";
+    GetProcessGroupDirCache().Clear();
     const auto& cgroup_root_path = GetCgroupRootPath();
     std::unique_ptr<DIR, decltype(&closedir)> root(opendir(cgroup_root_path.c_str()), closedir);
     if (root == NULL) {
@@ -156,16 +242,48 @@ void removeAllProcessGroups()
     }
 }
 
+// A process cgroup being killed, whose files stay open between retries.
+struct ProcessGroupKill {
+    uid_t uid;
+    int initialPid;
+    std::unique_ptr<FILE, decltype(&fclose)> procs{nullptr, fclose};
+    // cgroup.kill, which kills every process of the cgroup at once, on
+    // kernels that have it.
+    unique_fd kill_fd;
+    int processes = -1;
+    int result = -1;
+};
+
+static bool OpenProcessGroupKill(ProcessGroupKill* group, int signal) {
+    unique_fd fd(OpenProcessGroupFile(group->uid, group->initialPid,
+                                      PROCESSGROUP_CGROUP_PROCS_FILE, O_RDONLY));
+    if (fd != -1) {
+        group->procs.reset(fdopen(fd, "re"));
+    }
+    if (!group->procs) {
+        PLOG(WARNING) << "Failed to open process cgroup uid " << group->uid << " pid "
+                      << group->initialPid;
+        return false;
+    }
+    fd.release();
+
+    if (signal == SIGKILL) {
+        group->kill_fd.reset(OpenProcessGroupFile(group->uid, group->initialPid,
+                                                  PROCESSGROUP_CGROUP_KILL_FILE, O_WRONLY));
+    }
+    return true;
+}
+
 // Returns number of processes killed on success
 // Returns 0 if there are no processes in the process cgroup left to kill
 // Returns -1 on error
-static int DoKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
-    auto path = ConvertUidPidToPath(uid, initialPid) + PROCESSGROUP_CGROUP_PROCS_FILE;
-    std::unique_ptr<FILE, decltype(&fclose)> fd(fopen(path.c_str(), "re"), fclose);
-    if (!fd) {
-        PLOG(WARNING) << "Failed to open process cgroup uid " << uid << " pid " << initialPid;
-        return -1;
-    }
+static int DoKillProcessGroupOnce(ProcessGroupKill* group, int signal) {
+    uid_t uid = group->uid;
+    int initialPid = group->initialPid;
+    FILE* fd = group->procs.get();
+
+    // cgroup.procs lists the processes again when read from the start.
+    rewind(fd);
 
     // We separate all of the pids in the cgroup into those pids that are also the leaders of
     // process groups (stored in the pgids set) and those that are not (stored in the pids set).
@@ -175,8 +293,11 @@ static int DoKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
 
     pid_t pid;
     int processes = 0;
-    while (fscanf(fd.get(), "%d\n", &pid) == 1 && pid >= 0) {
+    while (fscanf(fd, "%d\n", &pid) == 1 && pid >= 0) {
         processes++;
+        if (group->kill_fd != -1) {
+            continue;
+        }
         if (pid == 0) {
             // Should never happen...  but if it does, trying to kill this
             // will boomerang right back and kill us!  Let's not let that happen.
@@ -191,10 +312,23 @@ static int DoKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
             pids.emplace(pid);
         }
     }
+    bool complete = feof(fd);
+
+    // Only the process group of initialPid is still signalled on its own then.
+    if (group->kill_fd != -1 && processes > 0) {
+        LOG(VERBOSE) << "Killing process cgroup uid " << uid << " pid " << initialPid
+                     << " with " PROCESSGROUP_CGROUP_KILL_FILE;
+        if (!WriteFully(group->kill_fd, "1", 1)) {
+            PLOG(WARNING) << "Failed to write " PROCESSGROUP_CGROUP_KILL_FILE " of uid " << uid
+                          << " pid " << initialPid;
+            // Signal the processes one by one from the next retry on.
+            group->kill_fd.reset();
+        }
+    }
 
     // Erase all pids that will be killed when we kill the process groups.
     for (auto it = pids.begin(); it != pids.end();) {
-        pid_t pgid = getpgid(pid);
+        pid_t pgid = getpgid(*it);
         if (pgids.count(pgid) == 1) {
             it = pids.erase(it);
         } else {
@@ -222,53 +356,91 @@ static int DoKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
         }
     }
 
-    return feof(fd.get()) ? processes : -1;
+    return complete ? processes : -1;
 }
 
-static int KillProcessGroup(uid_t uid, int initialPid, int signal, int retries) {
+// Signals all the groups, then waits for all of them together, so that killing
+// many groups takes about as long as killing the slowest one.
+// Returns 0 if every group was removed, -1 otherwise.
+static int KillProcessGroups(ProcessGroupKill* groups, size_t count, int signal, int retries) {
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    int retry = retries;
-    int processes;
-    while ((processes = DoKillProcessGroupOnce(uid, initialPid, signal)) > 0) {
-        LOG(VERBOSE) << "Killed " << processes << " processes for processgroup " << initialPid;
-        if (retry > 0) {
-            std::this_thread::sleep_for(5ms);
-            --retry;
-        } else {
-            break;
+    std::vector<ProcessGroupKill*> pending;
+    for (size_t i = 0; i < count; i++) {
+        if (OpenProcessGroupKill(&groups[i], signal)) {
+            pending.push_back(&groups[i]);
         }
     }
 
-    if (processes < 0) {
-        PLOG(ERROR) << "Error encountered killing process cgroup uid " << uid << " pid "
-                    << initialPid;
-        return -1;
+    int retry = retries;
+    while (!pending.empty()) {
+        for (auto it = pending.begin(); it != pending.end();) {
+            ProcessGroupKill* group = *it;
+            group->processes = DoKillProcessGroupOnce(group, signal);
+            if (group->processes > 0) {
+                LOG(VERBOSE) << "Killed " << group->processes << " processes for processgroup "
+                             << group->initialPid;
+                ++it;
+            } else {
+                it = pending.erase(it);
+            }
+        }
+        if (pending.empty() || retry == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(5ms);
+        --retry;
     }
 
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 
-    // We only calculate the number of 'processes' when killing the processes.
-    // In the retries == 0 case, we only kill the processes once and therefore
-    // will not have waited then recalculated how many processes are remaining
-    // after the first signals have been sent.
-    // Logging anything regarding the number of 'processes' here does not make sense.
+    int ret = 0;
+    for (size_t i = 0; i < count; i++) {
+        ProcessGroupKill* group = &groups[i];
+        uid_t uid = group->uid;
+        int initialPid = group->initialPid;
+
+        if (group->processes < 0) {
+            PLOG(ERROR) << "Error encountered killing process cgroup uid " << uid << " pid "
+                        << initialPid;
+            ret = -1;
+            continue;
+        }
+
+        // We only calculate the number of 'processes' when killing the processes.
+        // In the retries == 0 case, we only kill the processes once and therefore
+        // will not have waited then recalculated how many processes are remaining
+        // after the first signals have been sent.
+        // Logging anything regarding the number of 'processes' here does not make sense.
 
-    if (processes == 0) {
-        if (retries > 0) {
-            LOG(INFO) << "Successfully killed process cgroup uid " << uid << " pid " << initialPid
-                      << " in " << static_cast<int>(ms) << "ms";
+        if (group->processes == 0) {
+            if (retries > 0) {
+                LOG(INFO) << "Successfully killed process cgroup uid " << uid << " pid "
+                          << initialPid << " in " << static_cast<int>(ms) << "ms";
+            }
+            group->result = RemoveProcessGroup(uid, initialPid);
+        } else {
+            if (retries > 0) {
+                LOG(ERROR) << "Failed to kill process cgroup uid " << uid << " pid " << initialPid
+                           << " in " << static_cast<int>(ms) << "ms, " << group->processes
+                           << " processes remain";
+            }
+            group->result = -1;
         }
-        return RemoveProcessGroup(uid, initialPid);
-    } else {
-        if (retries > 0) {
-            LOG(ERROR) << "Failed to kill process cgroup uid " << uid << " pid " << initialPid
-                       << " in " << static_cast<int>(ms) << "ms, " << processes
-                       << " processes remain";
+        if (group->result != 0) {
+            ret = -1;
         }
-        return -1;
     }
+    return ret;
+}
+
+static int KillProcessGroup(uid_t uid, int initialPid, int signal, int retries) {
+    ProcessGroupKill group;
+    group.uid = uid;
+    group.initialPid = initialPid;
+    KillProcessGroups(&group, 1, signal, retries);
+    return group.result;
 }
 
 int killProcessGroup(uid_t uid, int initialPid, int signal) {
@@ -279,6 +451,15 @@ int killProcessGroupOnce(uid_t uid, int initialPid, int signal) {
     return KillProcessGroup(uid, initialPid, signal, 0 /*retries*/);
 }
 
+int killProcessGroups(size_t count, const uid_t* uids, const int* initialPids, int signal) {
+    std::vector<ProcessGroupKill> groups(count);
+    for (size_t i = 0; i < count; i++) {
+        groups[i].uid = uids[i];
+        groups[i].initialPid = initialPids[i];
+    }
+    return KillProcessGroups(groups.data(), count, signal, 40 /*retries*/);
+}
+
 static bool MkdirAndChown(const std::string& path, mode_t mode, uid_t uid, gid_t gid) {
     if (mkdir(path.c_str(), mode) == -1 && errno != EEXIST) {
         return false;
@@ -294,6 +475,32 @@ static bool MkdirAndChown(const std::string& path, mode_t mode, uid_t uid, gid_t
     return true;
 }
 
+// Writes the pids to cgroup.procs, which only takes one pid per write, through
+// a single open file. Returns 0 or the -errno of the first failure.
+static int WriteProcessGroupProcs(uid_t uid, int initialPid, const pid_t* pids, size_t count) {
+    unique_fd fd(OpenProcessGroupFile(uid, initialPid, PROCESSGROUP_CGROUP_PROCS_FILE, O_WRONLY));
+    if (fd == -1) {
+        int ret = -errno;
+        PLOG(ERROR) << "Failed to open " << PROCESSGROUP_CGROUP_PROCS_FILE << " of uid " << uid
+                    << " pid " << initialPid;
+        return ret;
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto value = std::to_string(pids[i]);
+        if (!WriteFully(fd, value.data(), value.size())) {
+            if (ret == 0) {
+                ret = -errno;
+            }
+            PLOG(ERROR) << "Failed to write '" << pids[i] << "' to "
+                        << PROCESSGROUP_CGROUP_PROCS_FILE << " of uid " << uid << " pid "
+                        << initialPid;
+        }
+    }
+    return ret;
+}
+
 int createProcessGroup(uid_t uid, int initialPid)
 {
     auto uid_path = ConvertUidToPath(uid);
@@ -310,40 +517,37 @@ int createProcessGroup(uid_t uid, int initialPid)
         return -errno;
     }
 
-    auto uid_pid_procs_file = uid_pid_path + PROCESSGROUP_CGROUP_PROCS_FILE;
-
-    int ret = 0;
-    if (!WriteStringToFile(std::to_string(initialPid), uid_pid_procs_file)) {
-        ret = -errno;
-        PLOG(ERROR) << "Failed to write '" << initialPid << "' to " << uid_pid_procs_file;
-    }
+    // A cached directory of a removed group of the same uid and pid is stale.
+    GetProcessGroupDirCache().Remove(uid, initialPid);
+    return WriteProcessGroupProcs(uid, initialPid, &initialPid, 1);
+}
 
-    return ret;
+int addProcessesToProcessGroup(uid_t uid, int initialPid, const pid_t* pids, size_t count) {
+    return WriteProcessGroupProcs(uid, initialPid, pids, count);
 }
 
-static bool SetProcessGroupValue(uid_t uid, int pid, const std::string& file_name, int64_t value) {
+static bool SetProcessGroupValue(uid_t uid, int pid, const char* file_name, int64_t value) {
     if (GetCgroupRootPath() != MEM_CGROUP_PATH) {
         PLOG(ERROR) << "Memcg is not mounted.";
         return false;
     }
 
-    auto path = ConvertUidPidToPath(uid, pid) + file_name;
-
-    if (!WriteStringToFile(std::to_string(value), path)) {
-        PLOG(ERROR) << "Failed to write '" << value << "' to " << path;
+    if (!WriteProcessGroupFile(uid, pid, file_name, std::to_string(value))) {
+        PLOG(ERROR) << "Failed to write '" << value << "' to " << file_name << " of uid " << uid
+                    << " pid " << pid;
         return false;
     }
     return true;
 }
 
 bool setProcessGroupSwappiness(uid_t uid, int pid, int swappiness) {
-    return SetProcessGroupValue(uid, pid, "/memory.swappiness", swappiness);
+    return SetProcessGroupValue(uid, pid, "memory.swappiness", swappiness);
 }
 
 bool setProcessGroupSoftLimit(uid_t uid, int pid, int64_t soft_limit_in_bytes) {
-    return SetProcessGroupValue(uid, pid, "/memory.soft_limit_in_bytes", soft_limit_in_bytes);
+    return SetProcessGroupValue(uid, pid, "memory.soft_limit_in_bytes", soft_limit_in_bytes);
 }
 
 bool setProcessGroupLimit(uid_t uid, int pid, int64_t limit_in_bytes) {
-    return SetProcessGroupValue(uid, pid, "/memory.limit_in_bytes", limit_in_bytes);
+    return SetProcessGroupValue(uid, pid, "memory.limit_in_bytes", limit_in_bytes);
 }
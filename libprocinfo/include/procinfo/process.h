@@ -18,6 +18,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -25,6 +26,7 @@
 #include <memory>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
@@ -110,6 +112,60 @@ auto GetProcessTids(pid_t pid, Collection* out) ->
   return GetProcessTidsFromProcPidFd(fd.get(), out);
 }
 
+// The fields of /proc/<tid>/stat that monitoring needs. Times are in clock ticks, vsize is in
+// bytes and rss in pages.
+struct ProcessStat {
+  pid_t tid;
+  char name[16];
+  ProcessState state;
+  pid_t ppid;
+  uint64_t minflt;
+  uint64_t majflt;
+  uint64_t utime;
+  uint64_t stime;
+  int32_t num_threads;
+  uint64_t starttime;
+  uint64_t vsize;
+  uint64_t rss;
+};
+
+// /proc/<pid>/statm, in pages.
+struct ProcessStatm {
+  uint64_t size;
+  uint64_t resident;
+  uint64_t shared;
+};
+
+// Reads /proc for whole-system snapshots. Directories are read with getdents64() and files with a
+// single read(), into buffers kept from one call to the next, and fields are parsed in place, so
+// that once the buffers and |out| vectors have grown, walking every process and thread doesn't
+// allocate. As processes come and go while they are walked, failures set errno and return false
+// without logging. A ProcReader must only be used by one thread at a time.
+class ProcReader {
+ public:
+  ProcReader();
+
+  // Lists the processes in /proc, or the threads of |pid|.
+  bool GetPids(std::vector<pid_t>* out);
+  bool GetTids(pid_t pid, std::vector<pid_t>* out);
+
+  bool ReadStat(pid_t tid, ProcessStat* stat);
+  bool ReadStatm(pid_t pid, ProcessStatm* statm);
+  // Same as GetProcessInfo().
+  bool ReadStatus(pid_t tid, ProcessInfo* process_info);
+
+ private:
+  bool ListIds(const char* path, std::vector<pid_t>* out);
+  // Reads the start of /proc/<id>/<name> into buffer_, NUL-terminated.
+  bool ReadProcFile(pid_t id, const char* name);
+
+  std::vector<char> dirents_;
+  char buffer_[4096];
+
+  ProcReader(const ProcReader&) = delete;
+  ProcReader& operator=(const ProcReader&) = delete;
+};
+
 #endif
 
 } /* namespace procinfo */
@@ -20,8 +20,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
 
 #include <android-base/unique_fd.h>
@@ -62,68 +64,210 @@ static ProcessState parse_state(const char* state) {
   }
 }
 
-bool GetProcessInfoFromProcPidFd(int fd, ProcessInfo* process_info) {
-  int status_fd = openat(fd, "status", O_RDONLY | O_CLOEXEC);
+// Reads the start of a /proc file with a single read(), which is how procfs hands out a
+// consistent snapshot of it, and NUL-terminates it.
+static bool ReadProcFd(int fd, char* buf, size_t size) {
+  ssize_t n = TEMP_FAILURE_RETRY(read(fd, buf, size - 1));
+  if (n < 0) {
+    return false;
+  }
+  buf[n] = '\0';
+  return true;
+}
+
+// Parses the fields of ProcessInfo, which all come first, from the contents of a status file.
+static bool ParseStatus(const char* buf, ProcessInfo* process_info) {
+  int field_bitmap = 0;
+  static constexpr int finished_bitmap = 255;
+
+  for (const char* line = buf; *line != '\0' && field_bitmap != finished_bitmap;) {
+    const char* end = strchrnul(line, '\n');
+    const char* tab = static_cast<const char*>(memchr(line, '\t', end - line));
+    if (tab != nullptr) {
+      auto header_is = [line, tab](const char* header) {
+        size_t header_len = strlen(header);
+        return static_cast<size_t>(tab - line) == header_len && !memcmp(line, header, header_len);
+      };
 
+      if (header_is("Name:")) {
+        process_info->name.assign(tab + 1, end);
+        field_bitmap |= 1;
+      } else if (header_is("Pid:")) {
+        process_info->tid = atoi(tab + 1);
+        field_bitmap |= 2;
+      } else if (header_is("Tgid:")) {
+        process_info->pid = atoi(tab + 1);
+        field_bitmap |= 4;
+      } else if (header_is("PPid:")) {
+        process_info->ppid = atoi(tab + 1);
+        field_bitmap |= 8;
+      } else if (header_is("TracerPid:")) {
+        process_info->tracer = atoi(tab + 1);
+        field_bitmap |= 16;
+      } else if (header_is("Uid:")) {
+        process_info->uid = atoi(tab + 1);
+        field_bitmap |= 32;
+      } else if (header_is("Gid:")) {
+        process_info->gid = atoi(tab + 1);
+        field_bitmap |= 64;
+      } else if (header_is("State:")) {
+        process_info->state = parse_state(tab + 1);
+        field_bitmap |= 128;
+      }
+    }
+    line = *end != '\0' ? end + 1 : end;
+  }
+
+  return field_bitmap == finished_bitmap;
+}
+
+bool GetProcessInfoFromProcPidFd(int fd, ProcessInfo* process_info) {
+  unique_fd status_fd(openat(fd, "status", O_RDONLY | O_CLOEXEC));
   if (status_fd == -1) {
     PLOG(ERROR) << "failed to open status fd in GetProcessInfoFromProcPidFd";
     return false;
   }
 
-  std::unique_ptr<FILE, decltype(&fclose)> fp(fdopen(status_fd, "r"), fclose);
-  if (!fp) {
-    PLOG(ERROR) << "failed to open status file in GetProcessInfoFromProcPidFd";
-    close(status_fd);
+  char buf[4096];
+  if (!ReadProcFd(status_fd.get(), buf, sizeof(buf))) {
+    PLOG(ERROR) << "failed to read status file in GetProcessInfoFromProcPidFd";
     return false;
   }
 
-  int field_bitmap = 0;
-  static constexpr int finished_bitmap = 255;
-  char* line = nullptr;
-  size_t len = 0;
+  return ParseStatus(buf, process_info);
+}
+
+ProcReader::ProcReader() : dirents_(32 * 1024) {}
+
+bool ProcReader::ListIds(const char* path, std::vector<pid_t>* out) {
+  out->clear();
+
+  unique_fd fd(open(path, O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    return false;
+  }
 
-  while (getline(&line, &len, fp.get()) != -1 && field_bitmap != finished_bitmap) {
-    char* tab = strchr(line, '\t');
-    if (tab == nullptr) {
-      continue;
+  struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    uint16_t d_reclen;
+    char d_type;
+    char d_name[];
+  } __attribute((packed));
+  while (true) {
+    ssize_t nread = syscall(SYS_getdents64, fd.get(), dirents_.data(), dirents_.size());
+    if (nread < 0) {
+      return false;
+    } else if (nread == 0) {
+      return true;
     }
 
-    size_t header_len = tab - line;
-    std::string header = std::string(line, header_len);
-    if (header == "Name:") {
-      std::string name = line + header_len + 1;
-
-      // line includes the trailing newline.
-      name.pop_back();
-      process_info->name = std::move(name);
-
-      field_bitmap |= 1;
-    } else if (header == "Pid:") {
-      process_info->tid = atoi(tab + 1);
-      field_bitmap |= 2;
-    } else if (header == "Tgid:") {
-      process_info->pid = atoi(tab + 1);
-      field_bitmap |= 4;
-    } else if (header == "PPid:") {
-      process_info->ppid = atoi(tab + 1);
-      field_bitmap |= 8;
-    } else if (header == "TracerPid:") {
-      process_info->tracer = atoi(tab + 1);
-      field_bitmap |= 16;
-    } else if (header == "Uid:") {
-      process_info->uid = atoi(tab + 1);
-      field_bitmap |= 32;
-    } else if (header == "Gid:") {
-      process_info->gid = atoi(tab + 1);
-      field_bitmap |= 64;
-    } else if (header == "State:") {
-      process_info->state = parse_state(tab + 1);
-      field_bitmap |= 128;
+    for (ssize_t off = 0; off < nread;) {
+      auto dirent = reinterpret_cast<const linux_dirent64*>(&dirents_[off]);
+      off += dirent->d_reclen;
+      // Everything but the processes' directories starts with something else than a digit.
+      pid_t id = atoi(dirent->d_name);
+      if (id > 0) {
+        out->push_back(id);
+      }
     }
   }
+}
 
-  free(line);
-  return field_bitmap == finished_bitmap;
+bool ProcReader::GetPids(std::vector<pid_t>* out) {
+  return ListIds("/proc", out);
+}
+
+bool ProcReader::GetTids(pid_t pid, std::vector<pid_t>* out) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/task", pid);
+  return ListIds(path, out);
+}
+
+bool ProcReader::ReadProcFile(pid_t id, const char* name) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/%s", id, name);
+
+  unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    return false;
+  }
+  return ReadProcFd(fd.get(), buffer_, sizeof(buffer_));
+}
+
+bool ProcReader::ReadStat(pid_t tid, ProcessStat* stat) {
+  if (!ReadProcFile(tid, "stat")) {
+    return false;
+  }
+
+  // The name is in parentheses, and may contain anything, parentheses included, so the fields
+  // start after the last one.
+  char* name_start = strchr(buffer_, '(');
+  char* name_end = strrchr(buffer_, ')');
+  if (name_start == nullptr || name_end == nullptr || name_end < name_start ||
+      name_end[1] != ' ') {
+    errno = EINVAL;
+    return false;
+  }
+
+  stat->tid = atoi(buffer_);
+  size_t name_len =
+      std::min(static_cast<size_t>(name_end - name_start - 1), sizeof(stat->name) - 1);
+  memcpy(stat->name, name_start + 1, name_len);
+  stat->name[name_len] = '\0';
+  stat->state = parse_state(name_end + 2);
+
+  // Fields 4 to 24, as numbered in proc(5).
+  uint64_t fields[24 - 3];
+  char* p = name_end + 3;
+  for (uint64_t& field : fields) {
+    char* end;
+    field = strtoll(p, &end, 10);
+    if (end == p) {
+      errno = EINVAL;
+      return false;
+    }
+    p = end;
+  }
+
+  stat->ppid = fields[4 - 4];
+  stat->minflt = fields[10 - 4];
+  stat->majflt = fields[12 - 4];
+  stat->utime = fields[14 - 4];
+  stat->stime = fields[15 - 4];
+  stat->num_threads = fields[20 - 4];
+  stat->starttime = fields[22 - 4];
+  stat->vsize = fields[23 - 4];
+  stat->rss = fields[24 - 4];
+  return true;
+}
+
+bool ProcReader::ReadStatm(pid_t pid, ProcessStatm* statm) {
+  if (!ReadProcFile(pid, "statm")) {
+    return false;
+  }
+
+  char* p = buffer_;
+  char* end;
+  statm->size = strtoull(p, &end, 10);
+  statm->resident = strtoull(end, &p, 10);
+  statm->shared = strtoull(p, &end, 10);
+  if (end == p) {
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+bool ProcReader::ReadStatus(pid_t tid, ProcessInfo* process_info) {
+  if (!ReadProcFile(tid, "status")) {
+    return false;
+  }
+  if (!ParseStatus(buffer_, process_info)) {
+    errno = EINVAL;
+    return false;
+  }
+  return true;
 }
 
 } /* namespace procinfo */
@@ -116,3 +116,40 @@ TEST(process_info, process_state) {
 
   ASSERT_EQ(forkpid, waitpid(forkpid, nullptr, 0));
 }
+
+TEST(process_info, proc_reader_smoke) {
+  android::procinfo::ProcReader reader;
+
+  std::vector<pid_t> pids;
+  ASSERT_TRUE(reader.GetPids(&pids));
+  ASSERT_EQ(1, std::count(pids.begin(), pids.end(), getpid()));
+
+  pid_t main_tid = gettid();
+  std::thread([&reader, main_tid]() {
+    std::vector<pid_t> tids;
+    ASSERT_TRUE(reader.GetTids(getpid(), &tids));
+    ASSERT_EQ(1, std::count(tids.begin(), tids.end(), main_tid));
+    ASSERT_EQ(1, std::count(tids.begin(), tids.end(), gettid()));
+
+    android::procinfo::ProcessStat stat;
+    ASSERT_TRUE(reader.ReadStat(gettid(), &stat));
+    ASSERT_EQ(gettid(), stat.tid);
+    ASSERT_STREQ("libprocinfo_tes", stat.name);
+    ASSERT_EQ(android::procinfo::kProcessStateRunning, stat.state);
+    ASSERT_EQ(getppid(), stat.ppid);
+    ASSERT_LE(2, stat.num_threads);
+    ASSERT_LT(0U, stat.vsize);
+  }).join();
+
+  android::procinfo::ProcessStatm statm;
+  ASSERT_TRUE(reader.ReadStatm(getpid(), &statm));
+  ASSERT_LT(0U, statm.size);
+  ASSERT_LE(statm.resident, statm.size);
+
+  android::procinfo::ProcessInfo self;
+  ASSERT_TRUE(reader.ReadStatus(gettid(), &self));
+  ASSERT_EQ("libprocinfo_tes", self.name);
+  ASSERT_EQ(gettid(), self.tid);
+  ASSERT_EQ(getpid(), self.pid);
+  ASSERT_EQ(getuid(), self.uid);
+}
@@ -17,6 +17,7 @@
 #ifndef __LEGACY_QTAGUID_H
 #define __LEGACY_QTAGUID_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -37,6 +38,14 @@ extern int legacy_tagSocket(int sockfd, int tag, uid_t uid);
  */
 extern int legacy_untagSocket(int sockfd);
 
+/*
+ * Tag, or untag, each of |count| sockets as above, sharing the setup of the
+ * module's control file. All the sockets are attempted even if some fail.
+ * Returns 0 if all succeeded, or the -errno of the first failure.
+ */
+extern int legacy_tagSockets(const int* sockfds, size_t count, int tag, uid_t uid);
+extern int legacy_untagSockets(const int* sockfds, size_t count);
+
 /*
  * For the given uid, switch counter sets.
  * The kernel only keeps a limited number of sets.
@@ -48,6 +48,37 @@ void legacy_resTrack(void) {
     resTrackFd = TEMP_FAILURE_RETRY(open("/dev/xt_qtaguid", O_RDONLY | O_CLOEXEC));
 }
 
+/*
+ * One per process as well, opened on first use rather than for every command.
+ * If it turns out to have been closed behind our back, it is reopened.
+ */
+static int ctrlFd = -1;
+static pthread_mutex_t ctrlFdLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Returns the ctrl fd, opening it if it isn't open yet or is |staleFd|.
+ * Returns:
+ *   the fd on success.
+ *   -errno on failure.
+ */
+static int get_ctrl_fd(int staleFd) {
+    int fd, res;
+
+    pthread_mutex_lock(&ctrlFdLock);
+    if (ctrlFd < 0 || ctrlFd == staleFd) {
+        fd = TEMP_FAILURE_RETRY(open(CTRL_PROCPATH, O_WRONLY | O_CLOEXEC));
+        if (fd < 0) {
+            res = -errno;
+            pthread_mutex_unlock(&ctrlFdLock);
+            return res;
+        }
+        ctrlFd = fd;
+    }
+    fd = ctrlFd;
+    pthread_mutex_unlock(&ctrlFdLock);
+    return fd;
+}
+
 /*
  * Returns:
  *   0 on success.
@@ -58,12 +89,19 @@ static int write_ctrl(const char* cmd) {
 
     ALOGV("write_ctrl(%s)", cmd);
 
-    fd = TEMP_FAILURE_RETRY(open(CTRL_PROCPATH, O_WRONLY | O_CLOEXEC));
+    fd = get_ctrl_fd(-1);
     if (fd < 0) {
-        return -errno;
+        return fd;
     }
 
     res = TEMP_FAILURE_RETRY(write(fd, cmd, strlen(cmd)));
+    if (res < 0 && errno == EBADF) {
+        fd = get_ctrl_fd(fd);
+        if (fd < 0) {
+            return fd;
+        }
+        res = TEMP_FAILURE_RETRY(write(fd, cmd, strlen(cmd)));
+    }
     if (res < 0) {
         savedErrno = errno;
     } else {
@@ -73,7 +111,6 @@ static int write_ctrl(const char* cmd) {
         // ALOGV is enough because all the callers also log failures
         ALOGV("Failed write_ctrl(%s) res=%d errno=%d", cmd, res, savedErrno);
     }
-    close(fd);
     return -savedErrno;
 }
 
@@ -112,6 +149,34 @@ int legacy_untagSocket(int sockfd) {
     return res;
 }
 
+int legacy_tagSockets(const int* sockfds, size_t count, int tag, uid_t uid) {
+    size_t i;
+    int res, firstRes = 0;
+
+    for (i = 0; i < count; i++) {
+        res = legacy_tagSocket(sockfds[i], tag, uid);
+        if (res < 0 && firstRes == 0) {
+            firstRes = res;
+        }
+    }
+
+    return firstRes;
+}
+
+int legacy_untagSockets(const int* sockfds, size_t count) {
+    size_t i;
+    int res, firstRes = 0;
+
+    for (i = 0; i < count; i++) {
+        res = legacy_untagSocket(sockfds[i]);
+        if (res < 0 && firstRes == 0) {
+            firstRes = res;
+        }
+    }
+
+    return firstRes;
+}
+
 int legacy_setCounterSet(int counterSetNum, uid_t uid) {
     char lineBuf[CTRL_MAX_INPUT_LEN];
     int res;
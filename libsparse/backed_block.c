@@ -16,6 +16,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -211,6 +212,11 @@ static int merge_bb(struct backed_block_list *bbl,
 		return -EINVAL;
 	}
 
+	/* Merged length would not fit */
+	if (a->len > UINT_MAX - b->len) {
+		return -EINVAL;
+	}
+
 	switch (a->type) {
 	case BACKED_BLOCK_DATA:
 		/* Don't support merging data for now */
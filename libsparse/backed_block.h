@@ -17,6 +17,10 @@
 #ifndef _BACKED_BLOCK_H_
 #define _BACKED_BLOCK_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include <stdint.h>
 
 struct backed_block_list;
@@ -61,4 +65,8 @@ void backed_block_list_move(struct backed_block_list *from,
 		struct backed_block_list *to, struct backed_block *start,
 		struct backed_block *end);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -40,7 +40,8 @@
 
 void usage()
 {
-    fprintf(stderr, "Usage: img2simg <raw_image_file> <sparse_image_file> [<block_size>]\n");
+    fprintf(stderr, "Usage: img2simg [-d] <raw_image_file> <sparse_image_file> [<block_size>]\n");
+    fprintf(stderr, "  -d  write repeated blocks as Copy chunks\n");
 }
 
 int main(int argc, char *argv[])
@@ -51,6 +52,13 @@ int main(int argc, char *argv[])
 	struct sparse_file *s;
 	unsigned int block_size = 4096;
 	off64_t len;
+	bool dedupe = false;
+
+	if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+		dedupe = true;
+		argc--;
+		argv++;
+	}
 
 	if (argc < 3 || argc > 4) {
 		usage();
@@ -96,6 +104,9 @@ int main(int argc, char *argv[])
 	}
 
 	sparse_file_verbose(s);
+	if (dedupe) {
+		sparse_file_dedupe(s);
+	}
 	ret = sparse_file_read(s, in, false, false);
 	if (ret) {
 		fprintf(stderr, "Failed to read file\n");
@@ -18,6 +18,7 @@
 #define _LIBSPARSE_SPARSE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef	__cplusplus
@@ -285,6 +286,81 @@ struct sparse_file *sparse_file_import_auto(int fd, bool crc, bool verbose);
 int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
 		struct sparse_file **out_s, int out_s_count);
 
+/**
+ * struct sparse_stream_ops - callbacks of a streaming sparse file parser
+ *
+ * @header - called once the file header has been parsed, with the block
+ *           size and the size of the expanded file, may be NULL
+ * @data - called with expanded data at the given offset, possibly several
+ *         times per chunk as input arrives
+ * @fill - called for len bytes at the given offset filled with fill_val
+ * @skip - called for len bytes at the given offset that are don't care
+ * @copy - called for len bytes at the given offset that repeat the bytes
+ *         already parsed at src_offset, may be NULL if Copy chunks need not
+ *         be supported
+ *
+ * Offsets are into the expanded file and never go backwards.  Callbacks
+ * should return negative on error, 0 on success.
+ */
+struct sparse_stream_ops {
+	int (*header)(void *priv, unsigned int block_size, int64_t len);
+	int (*data)(void *priv, int64_t offset, const void *data, size_t len);
+	int (*fill)(void *priv, int64_t offset, uint32_t fill_val, int64_t len);
+	int (*skip)(void *priv, int64_t offset, int64_t len);
+	int (*copy)(void *priv, int64_t offset, int64_t src_offset, int64_t len);
+};
+
+struct sparse_stream;
+
+/**
+ * sparse_stream_new - create a streaming sparse file parser
+ *
+ * @ops - callbacks to call as chunks are parsed
+ * @priv - value that will be passed as the first argument to the callbacks
+ * @crc - verify the crc of the file, if it has a crc chunk
+ *
+ * Unlike sparse_file_import, the parser is fed the file incrementally
+ * with sparse_stream_feed, so it works on pipes and sockets, and needs
+ * memory for neither the file nor a list of its chunks.
+ *
+ * Returns the parser, or NULL on error.
+ */
+struct sparse_stream *sparse_stream_new(const struct sparse_stream_ops *ops,
+		void *priv, bool crc);
+
+/**
+ * sparse_stream_feed - parse the next part of a sparse file
+ *
+ * @ss - parser
+ * @data - next bytes of the file
+ * @len - number of bytes
+ *
+ * Calls the callbacks for everything in data that can be parsed, keeping
+ * at most a chunk header's worth of it for the next call.  Bytes following
+ * the last chunk are ignored.
+ *
+ * Returns 0 on success, negative errno on error or if a callback failed,
+ * after which the parser only returns that error.
+ */
+int sparse_stream_feed(struct sparse_stream *ss, const void *data, size_t len);
+
+/**
+ * sparse_stream_finish - check that a sparse file was parsed in full
+ *
+ * @ss - parser
+ *
+ * Returns 0 if every chunk has been parsed, -EINVAL if the file was
+ * truncated, or the error sparse_stream_feed returned.
+ */
+int sparse_stream_finish(struct sparse_stream *ss);
+
+/**
+ * sparse_stream_destroy - destroy a streaming sparse file parser
+ *
+ * @ss - parser
+ */
+void sparse_stream_destroy(struct sparse_stream *ss);
+
 /**
  * sparse_file_verbose - set a sparse file cookie to print verbose errors
  *
@@ -294,6 +370,19 @@ int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
  */
 void sparse_file_verbose(struct sparse_file *s);
 
+/**
+ * sparse_file_dedupe - write repeated blocks of a sparse file as copies
+ *
+ * @s - sparse file cookie
+ *
+ * When s is later written as a sparse file without a crc, a data block that
+ * is identical to an earlier one is written as a Copy chunk naming that
+ * block rather than written out again.  Finding them reads all of the data
+ * once more before writing.  Files with Copy chunks have minor version 1,
+ * and can only be read by readers that know about them.
+ */
+void sparse_file_dedupe(struct sparse_file *s);
+
 /**
  * sparse_print_verbose - function called to print verbose errors
  *
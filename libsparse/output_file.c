@@ -36,11 +36,17 @@
 
 #ifndef _WIN32
 #include <sys/mman.h>
+#include <sys/uio.h>
 #define O_BINARY 0
 #else
 #define ftruncate64 ftruncate
 #endif
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
 #if defined(__APPLE__) && defined(__MACH__)
 #define lseek64 lseek
 #define ftruncate64 ftruncate
@@ -56,6 +62,9 @@
 #define SPARSE_HEADER_LEN       (sizeof(sparse_header_t))
 #define CHUNK_HEADER_LEN (sizeof(chunk_header_t))
 
+/* Fill blocks handed to writev() at once */
+#define FILL_IOVECS 256
+
 #define container_of(inner, outer_t, elem) \
 	((outer_t *)((char *)(inner) - offsetof(outer_t, elem)))
 
@@ -64,15 +73,26 @@ struct output_file_ops {
 	int (*skip)(struct output_file *, int64_t);
 	int (*pad)(struct output_file *, int64_t);
 	int (*write)(struct output_file *, void *, size_t);
+	/* Optional: writes count copies of a len byte buffer */
+	int (*write_repeat)(struct output_file *, void *, size_t len,
+			unsigned int count);
+	/* Optional: copies len bytes of fd at offset without reading them */
+	int (*write_fd)(struct output_file *, int fd, int64_t offset, size_t len);
 	void (*close)(struct output_file *);
 };
 
 struct sparse_file_ops {
 	int (*write_data_chunk)(struct output_file *out, unsigned int len,
 			void *data);
+	/* Used instead of write_data_chunk() when ops->write_fd is set */
+	int (*write_fd_chunk)(struct output_file *out, unsigned int len,
+			int fd, int64_t offset);
 	int (*write_fill_chunk)(struct output_file *out, unsigned int len,
 			uint32_t fill_val);
 	int (*write_skip_chunk)(struct output_file *out, int64_t len);
+	/* May be NULL when copies can't be represented */
+	int (*write_copy_chunk)(struct output_file *out, unsigned int len,
+			unsigned int src_block);
 	int (*write_end_chunk)(struct output_file *out);
 };
 
@@ -101,6 +121,7 @@ struct output_file_gz {
 struct output_file_normal {
 	struct output_file out;
 	int fd;
+	bool no_copy_range;
 };
 
 #define to_output_file_normal(_o) \
@@ -171,6 +192,96 @@ static int file_write(struct output_file *out, void *data, size_t len)
 	return 0;
 }
 
+#ifndef _WIN32
+static int file_write_repeat(struct output_file *out, void *data, size_t len,
+		unsigned int count)
+{
+	struct output_file_normal *outn = to_output_file_normal(out);
+	struct iovec iov[FILL_IOVECS];
+	unsigned int i;
+	size_t skip = 0;
+	ssize_t ret;
+
+	for (i = 0; i < FILL_IOVECS; i++) {
+		iov[i].iov_base = data;
+		iov[i].iov_len = len;
+	}
+
+	while (count > 0) {
+		unsigned int iovcnt = min(count, (unsigned int)FILL_IOVECS);
+
+		/* Resume a short write part way into the first buffer */
+		iov[0].iov_base = (char *)data + skip;
+		iov[0].iov_len = len - skip;
+		ret = writev(outn->fd, iov, iovcnt);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error_errno("writev");
+			return -1;
+		}
+
+		ret += skip;
+		count -= ret / len;
+		skip = ret % len;
+	}
+
+	return 0;
+}
+#endif
+
+#if defined(__linux__)
+/*
+ * Copies straight from the input file to the output file in the kernel,
+ * with copy_file_range(), which may share extents on some filesystems, or
+ * with sendfile() where copy_file_range() isn't available, for instance
+ * across filesystems on older kernels.
+ */
+static int file_write_fd(struct output_file *out, int fd, int64_t offset,
+		size_t len)
+{
+	struct output_file_normal *outn = to_output_file_normal(out);
+	ssize_t ret;
+
+	while (len > 0) {
+		size_t to_copy = min(len, (size_t)INT_MAX);
+		off64_t in_off = offset;
+
+#ifdef __NR_copy_file_range
+		if (!outn->no_copy_range) {
+			ret = syscall(__NR_copy_file_range, fd, &in_off, outn->fd, NULL,
+					to_copy, 0);
+			if (ret < 0 && errno != EINTR) {
+				outn->no_copy_range = true;
+				continue;
+			}
+		} else
+#endif
+		{
+			ret = sendfile64(outn->fd, fd, &in_off, to_copy);
+		}
+
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error_errno("sendfile");
+			return -1;
+		}
+		if (ret == 0) {
+			error("unexpected end of input file");
+			return -1;
+		}
+
+		offset += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+#endif
+
 static void file_close(struct output_file *out)
 {
 	struct output_file_normal *outn = to_output_file_normal(out);
@@ -183,6 +294,12 @@ static struct output_file_ops file_ops = {
 	.skip = file_skip,
 	.pad = file_pad,
 	.write = file_write,
+#ifndef _WIN32
+	.write_repeat = file_write_repeat,
+#endif
+#if defined(__linux__)
+	.write_fd = file_write_fd,
+#endif
 	.close = file_close,
 };
 
@@ -405,42 +522,99 @@ static int write_sparse_fill_chunk(struct output_file *out, unsigned int len,
 	return 0;
 }
 
-static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
-		void *data)
+static int write_sparse_data_header(struct output_file *out, unsigned int len)
 {
 	chunk_header_t chunk_header;
-	int rnd_up_len, zero_len;
-	int ret;
+	int rnd_up_len;
 
 	/* Round up the data length to a multiple of the block size */
 	rnd_up_len = ALIGN(len, out->block_size);
-	zero_len = rnd_up_len - len;
 
 	/* Finally we can safely emit a chunk of data */
 	chunk_header.chunk_type = CHUNK_TYPE_RAW;
 	chunk_header.reserved1 = 0;
 	chunk_header.chunk_sz = rnd_up_len / out->block_size;
 	chunk_header.total_sz = CHUNK_HEADER_LEN + rnd_up_len;
-	ret = out->ops->write(out, &chunk_header, sizeof(chunk_header));
+	return out->ops->write(out, &chunk_header, sizeof(chunk_header));
+}
 
-	if (ret < 0)
-		return -1;
-	ret = out->ops->write(out, data, len);
-	if (ret < 0)
-		return -1;
+static int write_sparse_data_padding(struct output_file *out, unsigned int len)
+{
+	int rnd_up_len, zero_len;
+	int ret;
+
+	rnd_up_len = ALIGN(len, out->block_size);
+	zero_len = rnd_up_len - len;
 	if (zero_len) {
 		ret = out->ops->write(out, out->zero_buf, zero_len);
 		if (ret < 0)
 			return -1;
+		if (out->use_crc)
+			out->crc32 = sparse_crc32(out->crc32, out->zero_buf, zero_len);
 	}
 
-	if (out->use_crc) {
+	out->cur_out_ptr += rnd_up_len;
+	out->chunk_cnt++;
+
+	return 0;
+}
+
+static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
+		void *data)
+{
+	int ret;
+
+	ret = write_sparse_data_header(out, len);
+	if (ret < 0)
+		return -1;
+	ret = out->ops->write(out, data, len);
+	if (ret < 0)
+		return -1;
+
+	if (out->use_crc)
 		out->crc32 = sparse_crc32(out->crc32, data, len);
-		if (zero_len)
-			out->crc32 = sparse_crc32(out->crc32, out->zero_buf, zero_len);
+
+	return write_sparse_data_padding(out, len);
+}
+
+static int write_sparse_fd_chunk(struct output_file *out, unsigned int len,
+		int fd, int64_t offset)
+{
+	int ret;
+
+	ret = write_sparse_data_header(out, len);
+	if (ret < 0)
+		return -1;
+	ret = out->ops->write_fd(out, fd, offset, len);
+	if (ret < 0)
+		return -1;
+
+	return write_sparse_data_padding(out, len);
+}
+
+static int write_sparse_copy_chunk(struct output_file *out, unsigned int len,
+		unsigned int src_block)
+{
+	chunk_header_t chunk_header;
+	uint32_t src = src_block;
+	int ret;
+
+	if (len % out->block_size || out->use_crc) {
+		return -EINVAL;
 	}
 
-	out->cur_out_ptr += rnd_up_len;
+	chunk_header.chunk_type = CHUNK_TYPE_COPY;
+	chunk_header.reserved1 = 0;
+	chunk_header.chunk_sz = len / out->block_size;
+	chunk_header.total_sz = CHUNK_HEADER_LEN + sizeof(src);
+	ret = out->ops->write(out, &chunk_header, sizeof(chunk_header));
+	if (ret < 0)
+		return -1;
+	ret = out->ops->write(out, &src, sizeof(src));
+	if (ret < 0)
+		return -1;
+
+	out->cur_out_ptr += len;
 	out->chunk_cnt++;
 
 	return 0;
@@ -474,8 +648,10 @@ int write_sparse_end_chunk(struct output_file *out)
 
 static struct sparse_file_ops sparse_file_ops = {
 		.write_data_chunk = write_sparse_data_chunk,
+		.write_fd_chunk = write_sparse_fd_chunk,
 		.write_fill_chunk = write_sparse_fill_chunk,
 		.write_skip_chunk = write_sparse_skip_chunk,
+		.write_copy_chunk = write_sparse_copy_chunk,
 		.write_end_chunk = write_sparse_end_chunk,
 };
 
@@ -497,6 +673,24 @@ static int write_normal_data_chunk(struct output_file *out, unsigned int len,
 	return ret;
 }
 
+static int write_normal_fd_chunk(struct output_file *out, unsigned int len,
+		int fd, int64_t offset)
+{
+	int ret;
+	unsigned int rnd_up_len = ALIGN(len, out->block_size);
+
+	ret = out->ops->write_fd(out, fd, offset, len);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (rnd_up_len > len) {
+		ret = out->ops->skip(out, rnd_up_len - len);
+	}
+
+	return ret;
+}
+
 static int write_normal_fill_chunk(struct output_file *out, unsigned int len,
 		uint32_t fill_val)
 {
@@ -509,6 +703,15 @@ static int write_normal_fill_chunk(struct output_file *out, unsigned int len,
 		out->fill_buf[i] = fill_val;
 	}
 
+	if (out->ops->write_repeat && len >= out->block_size) {
+		ret = out->ops->write_repeat(out, out->fill_buf, out->block_size,
+				len / out->block_size);
+		if (ret < 0) {
+			return ret;
+		}
+		len %= out->block_size;
+	}
+
 	while (len) {
 		write_len = min(len, out->block_size);
 		ret = out->ops->write(out, out->fill_buf, write_len);
@@ -534,6 +737,7 @@ int write_normal_end_chunk(struct output_file *out)
 
 static struct sparse_file_ops normal_file_ops = {
 		.write_data_chunk = write_normal_data_chunk,
+		.write_fd_chunk = write_normal_fd_chunk,
 		.write_fill_chunk = write_normal_fill_chunk,
 		.write_skip_chunk = write_normal_skip_chunk,
 		.write_end_chunk = write_normal_end_chunk,
@@ -546,7 +750,7 @@ void output_file_close(struct output_file *out)
 }
 
 static int output_file_init(struct output_file *out, int block_size,
-		int64_t len, bool sparse, int chunks, bool crc)
+		int64_t len, bool sparse, int chunks, bool crc, bool copy)
 {
 	int ret;
 
@@ -580,7 +784,8 @@ static int output_file_init(struct output_file *out, int block_size,
 		sparse_header_t sparse_header = {
 				.magic = SPARSE_HEADER_MAGIC,
 				.major_version = SPARSE_HEADER_MAJOR_VER,
-				.minor_version = SPARSE_HEADER_MINOR_VER,
+				.minor_version = copy ? SPARSE_HEADER_MINOR_VER_COPY :
+						SPARSE_HEADER_MINOR_VER,
 				.file_hdr_sz = SPARSE_HEADER_LEN,
 				.chunk_hdr_sz = CHUNK_HEADER_LEN,
 				.blk_sz = out->block_size,
@@ -636,7 +841,7 @@ static struct output_file *output_file_new_normal(void)
 
 struct output_file *output_file_open_callback(int (*write)(void *, const void *, int),
 		void *priv, unsigned int block_size, int64_t len,
-		int gz __unused, int sparse, int chunks, int crc)
+		int gz __unused, int sparse, int chunks, int crc, int copy)
 {
 	int ret;
 	struct output_file_callback *outc;
@@ -651,7 +856,8 @@ struct output_file *output_file_open_callback(int (*write)(void *, const void *,
 	outc->priv = priv;
 	outc->write = write;
 
-	ret = output_file_init(&outc->out, block_size, len, sparse, chunks, crc);
+	ret = output_file_init(&outc->out, block_size, len, sparse, chunks, crc,
+			copy);
 	if (ret < 0) {
 		free(outc);
 		return NULL;
@@ -661,7 +867,7 @@ struct output_file *output_file_open_callback(int (*write)(void *, const void *,
 }
 
 struct output_file *output_file_open_fd(int fd, unsigned int block_size, int64_t len,
-		int gz, int sparse, int chunks, int crc)
+		int gz, int sparse, int chunks, int crc, int copy)
 {
 	int ret;
 	struct output_file *out;
@@ -677,7 +883,7 @@ struct output_file *output_file_open_fd(int fd, unsigned int block_size, int64_t
 
 	out->ops->open(out, fd);
 
-	ret = output_file_init(out, block_size, len, sparse, chunks, crc);
+	ret = output_file_init(out, block_size, len, sparse, chunks, crc, copy);
 	if (ret < 0) {
 		free(out);
 		return NULL;
@@ -708,6 +914,11 @@ int write_fd_chunk(struct output_file *out, unsigned int len,
 	uint64_t buffer_size;
 	char *ptr;
 
+	/* The data only needs to be seen if it goes into the checksum */
+	if (out->ops->write_fd && !out->use_crc) {
+		return out->sparse_ops->write_fd_chunk(out, len, fd, offset);
+	}
+
 	aligned_offset = offset & ~(4096 - 1);
 	aligned_diff = offset - aligned_offset;
 	buffer_size = (uint64_t)len + (uint64_t)aligned_diff;
@@ -773,3 +984,13 @@ int write_skip_chunk(struct output_file *out, int64_t len)
 {
 	return out->sparse_ops->write_skip_chunk(out, len);
 }
+
+/* Write a copy of len bytes of earlier blocks starting at src_block */
+int write_copy_chunk(struct output_file *out, unsigned int len,
+		unsigned int src_block)
+{
+	if (!out->sparse_ops->write_copy_chunk) {
+		return -EINVAL;
+	}
+	return out->sparse_ops->write_copy_chunk(out, len, src_block);
+}
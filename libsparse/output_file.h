@@ -26,10 +26,10 @@ extern "C" {
 struct output_file;
 
 struct output_file *output_file_open_fd(int fd, unsigned int block_size, int64_t len,
-		int gz, int sparse, int chunks, int crc);
+		int gz, int sparse, int chunks, int crc, int copy);
 struct output_file *output_file_open_callback(int (*write)(void *, const void *, int),
 		void *priv, unsigned int block_size, int64_t len, int gz, int sparse,
-		int chunks, int crc);
+		int chunks, int crc, int copy);
 int write_data_chunk(struct output_file *out, unsigned int len, void *data);
 int write_fill_chunk(struct output_file *out, unsigned int len,
 		uint32_t fill_val);
@@ -38,6 +38,8 @@ int write_file_chunk(struct output_file *out, unsigned int len,
 int write_fd_chunk(struct output_file *out, unsigned int len,
 		int fd, int64_t offset);
 int write_skip_chunk(struct output_file *out, int64_t len);
+int write_copy_chunk(struct output_file *out, unsigned int len,
+		unsigned int src_block);
 void output_file_close(struct output_file *out);
 
 int read_all(int fd, void *buf, size_t len);
@@ -30,11 +30,146 @@
 #define O_BINARY 0
 #endif
 
+#define STREAM_BUF_SIZE (1024 * 1024)
+
 void usage()
 {
   fprintf(stderr, "Usage: simg2img <sparse_image_files> <raw_image_file>\n");
 }
 
+struct stream_out {
+	int fd;
+	int64_t len;
+};
+
+static int stream_write(int fd, int64_t offset, const void *data, size_t len)
+{
+	if (lseek(fd, offset, SEEK_SET) == -1) {
+		return -1;
+	}
+	while (len > 0) {
+		ssize_t ret = write(fd, data, len);
+		if (ret < 0) {
+			return -1;
+		}
+		data = (const char *)data + ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int stream_header(void *priv, unsigned int block_size, int64_t len)
+{
+	(void)block_size;
+	((struct stream_out *)priv)->len = len;
+	return 0;
+}
+
+static int stream_data(void *priv, int64_t offset, const void *data, size_t len)
+{
+	return stream_write(((struct stream_out *)priv)->fd, offset, data, len);
+}
+
+static int stream_fill(void *priv, int64_t offset, uint32_t fill_val, int64_t len)
+{
+	static uint32_t buf[16384];
+	size_t i;
+
+	for (i = 0; i < sizeof(buf) / sizeof(buf[0]); i++) {
+		buf[i] = fill_val;
+	}
+	while (len > 0) {
+		size_t chunk = len < (int64_t)sizeof(buf) ? (size_t)len : sizeof(buf);
+		if (stream_write(((struct stream_out *)priv)->fd, offset, buf, chunk) < 0) {
+			return -1;
+		}
+		offset += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+static int stream_skip(void *priv, int64_t offset, int64_t len)
+{
+	(void)priv;
+	(void)offset;
+	(void)len;
+	return 0;
+}
+
+/* Reads back what was already written, holes left by skips read as zero */
+static int stream_copy(void *priv, int64_t offset, int64_t src_offset, int64_t len)
+{
+	static char buf[65536];
+	int fd = ((struct stream_out *)priv)->fd;
+
+	while (len > 0) {
+		size_t chunk = len < (int64_t)sizeof(buf) ? (size_t)len : sizeof(buf);
+		ssize_t ret;
+
+		if (lseek(fd, src_offset, SEEK_SET) == -1) {
+			return -1;
+		}
+		ret = read(fd, buf, chunk);
+		if (ret < 0) {
+			return -1;
+		}
+		memset(buf + ret, 0, chunk - ret);
+		if (stream_write(fd, offset, buf, chunk) < 0) {
+			return -1;
+		}
+		offset += chunk;
+		src_offset += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+static const struct sparse_stream_ops stream_ops = {
+	.header = stream_header,
+	.data = stream_data,
+	.fill = stream_fill,
+	.skip = stream_skip,
+	.copy = stream_copy,
+};
+
+/*
+ * Input that can't be seeked, such as a pipe, is expanded as it is read
+ * rather than imported first.
+ */
+static int stream_sparse_file(int in, int out)
+{
+	struct stream_out priv = { out, 0 };
+	struct sparse_stream *ss;
+	char *buf;
+	ssize_t len;
+	int ret = 0;
+
+	buf = malloc(STREAM_BUF_SIZE);
+	ss = sparse_stream_new(&stream_ops, &priv, false);
+	if (!buf || !ss) {
+		free(buf);
+		return -1;
+	}
+
+	while (ret == 0 && (len = read(in, buf, STREAM_BUF_SIZE)) > 0) {
+		ret = sparse_stream_feed(ss, buf, len);
+	}
+	if (ret == 0 && len < 0) {
+		ret = -1;
+	}
+	if (ret == 0) {
+		ret = sparse_stream_finish(ss);
+	}
+	if (ret == 0 && ftruncate(out, priv.len) < 0) {
+		ret = -1;
+	}
+
+	sparse_stream_destroy(ss);
+	free(buf);
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	int in;
@@ -47,7 +182,7 @@ int main(int argc, char *argv[])
 		exit(-1);
 	}
 
-	out = open(argv[argc - 1], O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0664);
+	out = open(argv[argc - 1], O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0664);
 	if (out < 0) {
 		fprintf(stderr, "Cannot open output file %s\n", argv[argc - 1]);
 		exit(-1);
@@ -64,6 +199,15 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		if (lseek(in, 0, SEEK_CUR) == -1) {
+			if (stream_sparse_file(in, out) < 0) {
+				fprintf(stderr, "Failed to expand sparse file\n");
+				exit(-1);
+			}
+			close(in);
+			continue;
+		}
+
 		s = sparse_file_import(in, true, false);
 		if (!s) {
 			fprintf(stderr, "Failed to read sparse file\n");
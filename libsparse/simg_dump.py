@@ -90,8 +90,8 @@ def main():
       print("%s: %s: Magic should be 0xED26FF3A but is 0x%08X"
             % (me, path, magic))
       continue
-    if major_version != 1 or minor_version != 0:
-      print("%s: %s: I only know about version 1.0, but this is version %u.%u"
+    if major_version != 1 or minor_version > 1:
+      print("%s: %s: I only know about versions 1.0 and 1.1, but this is version %u.%u"
             % (me, path, major_version, minor_version))
       continue
     if file_hdr_sz != 28:
@@ -169,6 +169,15 @@ def main():
           break
         else:
           curtype = "Don't care"
+      elif chunk_type == 0xCAC5:
+        if data_sz != 4:
+          print("Copy chunk should have 4 bytes of source block, but this has %u"
+                % (data_sz))
+          break
+        else:
+          src_bin = FH.read(4)
+          src = struct.unpack("<I", src_bin)
+          curtype = format("Copy of block %u" % (src))
       elif chunk_type == 0xCAC4:
         if data_sz != 4:
           print("CRC32 chunk should have 4 bytes of CRC, but this has %u"
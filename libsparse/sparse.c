@@ -24,6 +24,7 @@
 
 #include "output_file.h"
 #include "backed_block.h"
+#include "sparse_dedupe.h"
 #include "sparse_defs.h"
 #include "sparse_format.h"
 
@@ -158,22 +159,63 @@ static int write_all_blocks(struct sparse_file *s, struct output_file *out)
 	return 0;
 }
 
+/*
+ * Counts the chunks s will be written as, first working out which blocks
+ * can be Copy chunks if s was asked to deduplicate.  Copy chunks only exist
+ * in sparse output, and are not used with a CRC chunk as the data they
+ * stand for is never seen by the output file.
+ */
+static int sparse_file_plan(struct sparse_file *s, bool sparse, bool crc,
+		struct dedupe_plan **plan)
+{
+	int ret;
+
+	*plan = NULL;
+	if (!s->dedupe || !sparse || crc) {
+		return sparse_count_chunks(s);
+	}
+
+	*plan = dedupe_plan_new(s, &ret);
+	if (!*plan) {
+		return ret;
+	}
+	return dedupe_plan_chunks(*plan);
+}
+
+static int write_blocks(struct sparse_file *s, struct output_file *out,
+		struct dedupe_plan *plan)
+{
+	if (plan) {
+		return dedupe_plan_write(plan, out);
+	}
+	return write_all_blocks(s, out);
+}
+
 int sparse_file_write(struct sparse_file *s, int fd, bool gz, bool sparse,
 		bool crc)
 {
 	int ret;
 	int chunks;
 	struct output_file *out;
+	struct dedupe_plan *plan;
 
-	chunks = sparse_count_chunks(s);
-	out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc);
+	chunks = sparse_file_plan(s, sparse, crc, &plan);
+	if (chunks < 0)
+		return chunks;
+	out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc,
+			plan != NULL);
 
-	if (!out)
-		return -ENOMEM;
+	if (!out) {
+		ret = -ENOMEM;
+		goto out;
+	}
 
-	ret = write_all_blocks(s, out);
+	ret = write_blocks(s, out, plan);
 
 	output_file_close(out);
+out:
+	if (plan)
+		dedupe_plan_destroy(plan);
 
 	return ret;
 }
@@ -184,17 +226,25 @@ int sparse_file_callback(struct sparse_file *s, bool sparse, bool crc,
 	int ret;
 	int chunks;
 	struct output_file *out;
+	struct dedupe_plan *plan;
 
-	chunks = sparse_count_chunks(s);
+	chunks = sparse_file_plan(s, sparse, crc, &plan);
+	if (chunks < 0)
+		return chunks;
 	out = output_file_open_callback(write, priv, s->block_size, s->len, false,
-			sparse, chunks, crc);
+			sparse, chunks, crc, plan != NULL);
 
-	if (!out)
-		return -ENOMEM;
+	if (!out) {
+		ret = -ENOMEM;
+		goto out;
+	}
 
-	ret = write_all_blocks(s, out);
+	ret = write_blocks(s, out, plan);
 
 	output_file_close(out);
+out:
+	if (plan)
+		dedupe_plan_destroy(plan);
 
 	return ret;
 }
@@ -231,7 +281,7 @@ int sparse_file_foreach_chunk(struct sparse_file *s, bool sparse, bool crc,
 	chunks = sparse_count_chunks(s);
 	out = output_file_open_callback(foreach_chunk_write, &chk,
 					s->block_size, s->len, false, sparse,
-					chunks, crc);
+					chunks, crc, false);
 
 	if (!out)
 		return -ENOMEM;
@@ -260,19 +310,26 @@ static int out_counter_write(void *priv, const void *data __unused, int len)
 int64_t sparse_file_len(struct sparse_file *s, bool sparse, bool crc)
 {
 	int ret;
-	int chunks = sparse_count_chunks(s);
+	int chunks;
 	int64_t count = 0;
 	struct output_file *out;
+	struct dedupe_plan *plan;
 
+	chunks = sparse_file_plan(s, sparse, crc, &plan);
+	if (chunks < 0) {
+		return -1;
+	}
 	out = output_file_open_callback(out_counter_write, &count,
-			s->block_size, s->len, false, sparse, chunks, crc);
+			s->block_size, s->len, false, sparse, chunks, crc, plan != NULL);
 	if (!out) {
-		return -1;
+		ret = -1;
+	} else {
+		ret = write_blocks(s, out, plan);
+		output_file_close(out);
+	}
+	if (plan) {
+		dedupe_plan_destroy(plan);
 	}
-
-	ret = write_all_blocks(s, out);
-
-	output_file_close(out);
 
 	if (ret < 0) {
 		return -1;
@@ -308,7 +365,7 @@ static struct backed_block *move_chunks_up_to_len(struct sparse_file *from,
 
 	start = backed_block_iter_new(from->backed_block_list);
 	out_counter = output_file_open_callback(out_counter_write, &count,
-			to->block_size, to->len, false, true, 0, false);
+			to->block_size, to->len, false, true, 0, false, false);
 	if (!out_counter) {
 		return NULL;
 	}
@@ -368,6 +425,7 @@ int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
 
 	do {
 		s = sparse_file_new(in_s->block_size, in_s->len);
+		s->dedupe = in_s->dedupe;
 
 		bb = move_chunks_up_to_len(in_s, s, max_len);
 
@@ -393,3 +451,8 @@ void sparse_file_verbose(struct sparse_file *s)
 {
 	s->verbose = true;
 }
+
+void sparse_file_dedupe(struct sparse_file *s)
+{
+	s->dedupe = true;
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE64_SOURCE 1
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "backed_block.h"
+#include "defs.h"
+#include "output_file.h"
+#include "sparse_dedupe.h"
+#include "sparse_defs.h"
+#include "sparse_file.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#if defined(__APPLE__) && defined(__MACH__)
+#define lseek64 lseek
+#endif
+
+/* Blocks of a data backed block read at a time while hashing */
+static constexpr unsigned int DEDUPE_BATCH_BLOCKS = 256;
+
+/*
+ * A run of blocks, in block order: all of a fill backed block, part of a
+ * data backed block to write as is, or blocks to copy from src_block.
+ */
+struct dedupe_segment {
+	struct backed_block *bb;
+	unsigned int block;
+	unsigned int blocks;
+	bool copy;
+	unsigned int src_block;
+};
+
+struct dedupe_plan {
+	struct sparse_file *s;
+	std::vector<dedupe_segment> segments;
+	unsigned int chunks;
+};
+
+/* Reads the data of backed blocks, keeping files open until destroyed */
+class dedupe_reader {
+  public:
+	~dedupe_reader() {
+		for (auto &file : files_) {
+			close(file.second);
+		}
+	}
+
+	/* Reads len bytes at byte offset off into the backed block */
+	int read(struct backed_block *bb, int64_t off, void *buf, size_t len) {
+		switch (backed_block_type(bb)) {
+		case BACKED_BLOCK_DATA:
+			memcpy(buf, (char *)backed_block_data(bb) + off, len);
+			return 0;
+		case BACKED_BLOCK_FD:
+			return pread_all(backed_block_fd(bb), buf, len,
+					backed_block_file_offset(bb) + off);
+		case BACKED_BLOCK_FILE: {
+			int fd = file(backed_block_filename(bb));
+			if (fd < 0) {
+				return fd;
+			}
+			return pread_all(fd, buf, len, backed_block_file_offset(bb) + off);
+		}
+		default:
+			return -EINVAL;
+		}
+	}
+
+  private:
+	static int pread_all(int fd, void *buf, size_t len, int64_t offset) {
+		/* The fd is shared, so seek and read rather than rely on pread() */
+		if (lseek64(fd, offset, SEEK_SET) < 0) {
+			return -errno;
+		}
+		return read_all(fd, buf, len);
+	}
+
+	int file(const char *filename) {
+		auto it = files_.find(filename);
+		if (it != files_.end()) {
+			return it->second;
+		}
+		int fd = open(filename, O_RDONLY | O_BINARY);
+		if (fd < 0) {
+			return -errno;
+		}
+		files_[filename] = fd;
+		return fd;
+	}
+
+	std::map<std::string, int> files_;
+};
+
+static uint64_t hash_block(const void *data, unsigned int block_size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (unsigned int i = 0; i + sizeof(uint64_t) <= block_size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, p + i, sizeof(word));
+		h = (h ^ (word * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+static void plan_add(struct dedupe_plan *plan, struct backed_block *bb,
+		unsigned int block, bool copy, unsigned int src_block)
+{
+	if (!plan->segments.empty()) {
+		dedupe_segment &last = plan->segments.back();
+		if (last.bb == bb && last.copy == copy &&
+				last.block + last.blocks == block &&
+				(!copy || last.src_block + last.blocks == src_block)) {
+			last.blocks++;
+			return;
+		}
+	}
+	plan->segments.push_back({bb, block, 1, copy, src_block});
+}
+
+/* Finds the data backed block holding block, data_bbs being in block order */
+static struct backed_block *find_data_bb(
+		const std::vector<struct backed_block *> &data_bbs, unsigned int block)
+{
+	auto it = std::upper_bound(data_bbs.begin(), data_bbs.end(), block,
+			[](unsigned int b, struct backed_block *bb) {
+				return b < backed_block_block(bb);
+			});
+	return it == data_bbs.begin() ? nullptr : *(it - 1);
+}
+
+static unsigned int segment_len(struct dedupe_plan *plan,
+		const dedupe_segment &seg)
+{
+	unsigned int block_size = plan->s->block_size;
+
+	if (backed_block_type(seg.bb) == BACKED_BLOCK_FILL) {
+		return backed_block_len(seg.bb);
+	}
+	int64_t off = (int64_t)(seg.block - backed_block_block(seg.bb)) * block_size;
+	return std::min((int64_t)seg.blocks * block_size,
+			(int64_t)backed_block_len(seg.bb) - off);
+}
+
+struct dedupe_plan *dedupe_plan_new(struct sparse_file *s, int *error)
+{
+	unsigned int block_size = s->block_size;
+	dedupe_plan *plan = new dedupe_plan{s, {}, 0};
+	dedupe_reader reader;
+	/* First block seen with each hash, always written as is */
+	std::unordered_map<uint64_t, unsigned int> first_blocks;
+	std::vector<struct backed_block *> data_bbs;
+	std::vector<char> batch((size_t)DEDUPE_BATCH_BLOCKS * block_size);
+	std::vector<char> source(block_size);
+	struct backed_block *bb;
+	int ret;
+
+	for (bb = backed_block_iter_new(s->backed_block_list); bb;
+			bb = backed_block_iter_next(bb)) {
+		unsigned int len = backed_block_len(bb);
+		unsigned int blocks = DIV_ROUND_UP(len, block_size);
+
+		if (backed_block_type(bb) == BACKED_BLOCK_FILL) {
+			plan->segments.push_back({bb, backed_block_block(bb), blocks, false, 0});
+			continue;
+		}
+		data_bbs.push_back(bb);
+
+		for (unsigned int i = 0; i < blocks; i += DEDUPE_BATCH_BLOCKS) {
+			unsigned int count = std::min(DEDUPE_BATCH_BLOCKS, blocks - i);
+			size_t bytes = std::min((int64_t)count * block_size,
+					(int64_t)len - (int64_t)i * block_size);
+			ret = reader.read(bb, (int64_t)i * block_size, batch.data(), bytes);
+			if (ret < 0) {
+				goto err;
+			}
+
+			for (unsigned int j = 0; j < count; j++) {
+				unsigned int block = backed_block_block(bb) + i + j;
+				const char *data = batch.data() + (size_t)j * block_size;
+
+				/* A short last block is never shared */
+				if ((size_t)(j + 1) * block_size > bytes) {
+					plan_add(plan, bb, block, false, 0);
+					continue;
+				}
+
+				uint64_t hash = hash_block(data, block_size);
+				auto it = first_blocks.find(hash);
+				if (it == first_blocks.end()) {
+					first_blocks.emplace(hash, block);
+					plan_add(plan, bb, block, false, 0);
+					continue;
+				}
+
+				/* Only trust the hash once the contents compare equal */
+				unsigned int src_block = it->second;
+				struct backed_block *src_bb = find_data_bb(data_bbs, src_block);
+				ret = reader.read(src_bb,
+						(int64_t)(src_block - backed_block_block(src_bb)) * block_size,
+						source.data(), block_size);
+				if (ret < 0) {
+					goto err;
+				}
+				bool same = memcmp(source.data(), data, block_size) == 0;
+				plan_add(plan, bb, block, same, same ? src_block : 0);
+			}
+		}
+	}
+
+	{
+		unsigned int last_block = 0;
+		for (const dedupe_segment &seg : plan->segments) {
+			if (seg.block > last_block) {
+				plan->chunks++;
+			}
+			plan->chunks++;
+			last_block = seg.block + seg.blocks;
+		}
+		if (last_block < DIV_ROUND_UP(s->len, block_size)) {
+			plan->chunks++;
+		}
+	}
+	return plan;
+
+err:
+	delete plan;
+	*error = ret;
+	return NULL;
+}
+
+unsigned int dedupe_plan_chunks(struct dedupe_plan *plan)
+{
+	return plan->chunks;
+}
+
+int dedupe_plan_write(struct dedupe_plan *plan, struct output_file *out)
+{
+	unsigned int block_size = plan->s->block_size;
+	unsigned int last_block = 0;
+	int64_t pad;
+	int ret = 0;
+
+	for (const dedupe_segment &seg : plan->segments) {
+		struct backed_block *bb = seg.bb;
+		unsigned int len = segment_len(plan, seg);
+		int64_t off = (int64_t)(seg.block - backed_block_block(bb)) * block_size;
+
+		if (seg.block > last_block) {
+			write_skip_chunk(out, (int64_t)(seg.block - last_block) * block_size);
+		}
+
+		if (seg.copy) {
+			ret = write_copy_chunk(out, len, seg.src_block);
+		} else {
+			switch (backed_block_type(bb)) {
+			case BACKED_BLOCK_DATA:
+				ret = write_data_chunk(out, len, (char *)backed_block_data(bb) + off);
+				break;
+			case BACKED_BLOCK_FILE:
+				ret = write_file_chunk(out, len, backed_block_filename(bb),
+						backed_block_file_offset(bb) + off);
+				break;
+			case BACKED_BLOCK_FD:
+				ret = write_fd_chunk(out, len, backed_block_fd(bb),
+						backed_block_file_offset(bb) + off);
+				break;
+			case BACKED_BLOCK_FILL:
+				ret = write_fill_chunk(out, len, backed_block_fill_val(bb));
+				break;
+			}
+		}
+		if (ret)
+			return ret;
+		last_block = seg.block + seg.blocks;
+	}
+
+	pad = plan->s->len - (int64_t)last_block * block_size;
+	if (pad > 0) {
+		write_skip_chunk(out, pad);
+	}
+
+	return 0;
+}
+
+void dedupe_plan_destroy(struct dedupe_plan *plan)
+{
+	delete plan;
+}
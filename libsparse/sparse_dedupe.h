@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBSPARSE_SPARSE_DEDUPE_H_
+#define _LIBSPARSE_SPARSE_DEDUPE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sparse/sparse.h>
+
+struct dedupe_plan;
+struct output_file;
+
+/*
+ * Reads every data block of s and works out which can be written as Copy
+ * chunks of an identical earlier block.  Returns NULL on error, with the
+ * negative errno in *error.
+ */
+struct dedupe_plan *dedupe_plan_new(struct sparse_file *s, int *error);
+
+/* Number of chunks dedupe_plan_write() will write */
+unsigned int dedupe_plan_chunks(struct dedupe_plan *plan);
+
+/* Writes the blocks of the sparse file the plan was made for */
+int dedupe_plan_write(struct dedupe_plan *plan, struct output_file *out);
+
+void dedupe_plan_destroy(struct dedupe_plan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
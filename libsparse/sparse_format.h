@@ -42,6 +42,10 @@ typedef struct sparse_header {
 #define CHUNK_TYPE_FILL		0xCAC2
 #define CHUNK_TYPE_DONT_CARE	0xCAC3
 #define CHUNK_TYPE_CRC32    0xCAC4
+#define CHUNK_TYPE_COPY     0xCAC5
+
+/* Minor version of images that may contain Copy chunks */
+#define SPARSE_HEADER_MINOR_VER_COPY 1
 
 typedef struct chunk_header {
   __le16	chunk_type;	/* 0xCAC1 -> raw; 0xCAC2 -> fill; 0xCAC3 -> don't care */
@@ -50,10 +54,13 @@ typedef struct chunk_header {
   __le32	total_sz;	/* in bytes of chunk input file including chunk header and data */
 } chunk_header_t;
 
-/* Following a Raw or Fill or CRC32 chunk is data.
+/* Following a Raw or Fill or CRC32 or Copy chunk is data.
  *  For a Raw chunk, it's the data in chunk_sz * blk_sz.
  *  For a Fill chunk, it's 4 bytes of the fill data.
  *  For a CRC32 chunk, it's 4 bytes of CRC32
+ *  For a Copy chunk, it's the 4 byte number of the first block to copy
+ *  chunk_sz blocks from.  The source blocks are earlier in the output image
+ *  and were all written by Raw chunks.
  */
 
 #ifdef __cplusplus
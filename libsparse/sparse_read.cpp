@@ -26,7 +26,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 #include <sparse/sparse.h>
 
@@ -50,6 +52,13 @@
 static constexpr int64_t COPY_BUF_SIZE = 1024 * 1024;
 static char *copybuf;
 
+/* Where the data of a Raw chunk is, for Copy chunks to refer back to */
+struct raw_chunk {
+	unsigned int block;
+	unsigned int blocks;
+	int64_t offset;
+};
+
 static std::string ErrorString(int err)
 {
 	if (err == -EOVERFLOW) return "EOF while reading file";
@@ -75,7 +84,7 @@ static void verbose_error(bool verbose, int err, const char *fmt, ...)
 
 static int process_raw_chunk(struct sparse_file *s, unsigned int chunk_size,
 		int fd, int64_t offset, unsigned int blocks, unsigned int block,
-		uint32_t *crc32)
+		std::vector<raw_chunk> *raw_chunks, uint32_t *crc32)
 {
 	int ret;
 	int chunk;
@@ -93,6 +102,7 @@ static int process_raw_chunk(struct sparse_file *s, unsigned int chunk_size,
 	if (ret < 0) {
 		return ret;
 	}
+	raw_chunks->push_back({block, blocks, offset});
 
 	if (crc32) {
 		while (len) {
@@ -174,6 +184,74 @@ static int process_skip_chunk(struct sparse_file *s, unsigned int chunk_size,
 	return 0;
 }
 
+static int process_copy_chunk(struct sparse_file *s, unsigned int chunk_size,
+		int fd, unsigned int blocks, unsigned int block,
+		const std::vector<raw_chunk> &raw_chunks, uint32_t *crc32)
+{
+	int ret;
+	uint32_t src_block;
+	off64_t pos = 0;
+
+	if (chunk_size != sizeof(src_block)) {
+		return -EINVAL;
+	}
+
+	ret = read_all(fd, &src_block, sizeof(src_block));
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (src_block > block || blocks > block - src_block) {
+		return -EINVAL;
+	}
+
+	if (crc32) {
+		pos = lseek64(fd, 0, SEEK_CUR);
+	}
+
+	/* The source may span several Raw chunks, add the data of each */
+	while (blocks) {
+		auto it = std::upper_bound(raw_chunks.begin(), raw_chunks.end(), src_block,
+				[](unsigned int b, const raw_chunk &raw) { return b < raw.block; });
+		if (it == raw_chunks.begin() ||
+				src_block - (it - 1)->block >= (it - 1)->blocks) {
+			return -EINVAL;
+		}
+		const raw_chunk &raw = *(it - 1);
+		unsigned int n = std::min(blocks, raw.block + raw.blocks - src_block);
+		int64_t offset = raw.offset + (int64_t)(src_block - raw.block) * s->block_size;
+		int64_t len = (int64_t)n * s->block_size;
+
+		ret = sparse_file_add_fd(s, fd, offset, len, block);
+		if (ret < 0) {
+			return ret;
+		}
+
+		if (crc32) {
+			lseek64(fd, offset, SEEK_SET);
+			while (len) {
+				int chunk = std::min(len, COPY_BUF_SIZE);
+				ret = read_all(fd, copybuf, chunk);
+				if (ret < 0) {
+					return ret;
+				}
+				*crc32 = sparse_crc32(*crc32, copybuf, chunk);
+				len -= chunk;
+			}
+		}
+
+		src_block += n;
+		block += n;
+		blocks -= n;
+	}
+
+	if (crc32) {
+		lseek64(fd, pos, SEEK_SET);
+	}
+
+	return 0;
+}
+
 static int process_crc32_chunk(int fd, unsigned int chunk_size, uint32_t *crc32)
 {
 	uint32_t file_crc32;
@@ -197,7 +275,8 @@ static int process_crc32_chunk(int fd, unsigned int chunk_size, uint32_t *crc32)
 
 static int process_chunk(struct sparse_file *s, int fd, off64_t offset,
 		unsigned int chunk_hdr_sz, chunk_header_t *chunk_header,
-		unsigned int cur_block, uint32_t *crc_ptr)
+		unsigned int cur_block, std::vector<raw_chunk> *raw_chunks,
+		uint32_t *crc_ptr)
 {
 	int ret;
 	unsigned int chunk_data_size;
@@ -207,7 +286,7 @@ static int process_chunk(struct sparse_file *s, int fd, off64_t offset,
 	switch (chunk_header->chunk_type) {
 		case CHUNK_TYPE_RAW:
 			ret = process_raw_chunk(s, chunk_data_size, fd, offset,
-					chunk_header->chunk_sz, cur_block, crc_ptr);
+					chunk_header->chunk_sz, cur_block, raw_chunks, crc_ptr);
 			if (ret < 0) {
 				verbose_error(s->verbose, ret, "data block at %" PRId64, offset);
 				return ret;
@@ -231,6 +310,14 @@ static int process_chunk(struct sparse_file *s, int fd, off64_t offset,
 				}
 			}
 			return chunk_header->chunk_sz;
+		case CHUNK_TYPE_COPY:
+			ret = process_copy_chunk(s, chunk_data_size, fd,
+					chunk_header->chunk_sz, cur_block, *raw_chunks, crc_ptr);
+			if (ret < 0) {
+				verbose_error(s->verbose, ret, "copy block at %" PRId64, offset);
+				return ret;
+			}
+			return chunk_header->chunk_sz;
 		case CHUNK_TYPE_CRC32:
 			ret = process_crc32_chunk(fd, chunk_data_size, crc_ptr);
 			if (ret < 0) {
@@ -257,6 +344,7 @@ static int sparse_file_read_sparse(struct sparse_file *s, int fd, bool crc)
 	uint32_t *crc_ptr = 0;
 	unsigned int cur_block = 0;
 	off64_t offset;
+	std::vector<raw_chunk> raw_chunks;
 
 	if (!copybuf) {
 		copybuf = (char *)malloc(COPY_BUF_SIZE);
@@ -314,7 +402,7 @@ static int sparse_file_read_sparse(struct sparse_file *s, int fd, bool crc)
 		offset = lseek64(fd, 0, SEEK_CUR);
 
 		ret = process_chunk(s, fd, offset, sparse_header.chunk_hdr_sz, &chunk_header,
-				cur_block, crc_ptr);
+				cur_block, &raw_chunks, crc_ptr);
 		if (ret < 0) {
 			return ret;
 		}
@@ -329,55 +417,165 @@ static int sparse_file_read_sparse(struct sparse_file *s, int fd, bool crc)
 	return 0;
 }
 
-static int sparse_file_read_normal(struct sparse_file *s, int fd)
+/* Block classification of part of a normal file, as a list of runs */
+struct read_normal_run {
+	unsigned int block;
+	unsigned int blocks;
+	bool fill;
+	uint32_t fill_val;
+};
+
+/* Longest run, in bytes, handed to a single backed block */
+static constexpr int64_t READ_NORMAL_MAX_RUN = 1024 * 1024 * 1024;
+/* Files smaller than this are not worth splitting across threads */
+static constexpr int64_t READ_NORMAL_THREAD_MIN = 64 * 1024 * 1024;
+static constexpr unsigned int READ_NORMAL_MAX_THREADS = 8;
+
+static int pread_all(int fd, void *buf, size_t len, int64_t offset)
 {
-	int ret;
-	uint32_t *buf = (uint32_t *)malloc(s->block_size);
-	unsigned int block = 0;
-	int64_t remain = s->len;
-	int64_t offset = 0;
-	unsigned int to_read;
-	unsigned int i;
-	bool sparse_block;
+#if defined(_WIN32)
+	/* Single threaded on Windows, see sparse_file_read_normal() */
+	if (lseek64(fd, offset, SEEK_SET) < 0) {
+		return -errno;
+	}
+	return read_all(fd, buf, len);
+#else
+	char *ptr = (char *)buf;
+	while (len > 0) {
+		ssize_t ret = pread(fd, ptr, len, offset);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret < 0) {
+			return -errno;
+		}
+		if (ret == 0) {
+			return -EINVAL;
+		}
+		ptr += ret;
+		len -= ret;
+		offset += ret;
+	}
+	return 0;
+#endif
+}
 
-	if (!buf) {
-		return -ENOMEM;
+/*
+ * A full block is a fill block when all of its words are the same, which is
+ * when the block matches itself shifted by one word, letting memcmp() do the
+ * comparison a vector at a time.
+ */
+static bool is_fill_block(const uint32_t *buf, unsigned int block_size)
+{
+	return memcmp(buf, buf + 1, block_size - sizeof(uint32_t)) == 0;
+}
+
+static void read_normal_append(std::vector<read_normal_run> *runs,
+		unsigned int block_size, unsigned int block, bool fill,
+		uint32_t fill_val)
+{
+	if (!runs->empty()) {
+		read_normal_run &last = runs->back();
+		if (last.fill == fill && (!fill || last.fill_val == fill_val) &&
+				last.block + last.blocks == block &&
+				(int64_t)(last.blocks + 1) * block_size <= READ_NORMAL_MAX_RUN) {
+			last.blocks++;
+			return;
+		}
 	}
+	runs->push_back({block, 1, fill, fill_val});
+}
 
-	while (remain > 0) {
-		to_read = std::min(remain, (int64_t)(s->block_size));
-		ret = read_all(fd, buf, to_read);
+/* Classifies the blocks in [first, last) of fd, a normal file of size len */
+static int read_normal_range(int fd, int64_t len, unsigned int block_size,
+		unsigned int first, unsigned int last,
+		std::vector<read_normal_run> *runs)
+{
+	int64_t batch_blocks = std::max<int64_t>(COPY_BUF_SIZE / block_size, 1);
+	std::vector<uint32_t> buf(batch_blocks * block_size / sizeof(uint32_t));
+
+	for (unsigned int block = first; block < last;) {
+		int64_t offset = (int64_t)block * block_size;
+		unsigned int count = std::min<int64_t>(batch_blocks, last - block);
+		size_t to_read = std::min<int64_t>(len - offset,
+				(int64_t)count * block_size);
+		int ret = pread_all(fd, buf.data(), to_read, offset);
 		if (ret < 0) {
-			error("failed to read sparse file");
-			free(buf);
 			return ret;
 		}
 
-		if (to_read == s->block_size) {
-			sparse_block = true;
-			for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-				if (buf[0] != buf[i]) {
-					sparse_block = false;
-					break;
-				}
-			}
-		} else {
-			sparse_block = false;
+		for (unsigned int i = 0; i < count; i++, block++) {
+			const uint32_t *data = buf.data() + i * (block_size / sizeof(uint32_t));
+			/* A short last block is always stored as data */
+			bool fill = (to_read >= (i + 1) * (size_t)block_size) &&
+					is_fill_block(data, block_size);
+			read_normal_append(runs, block_size, block, fill, fill ? data[0] : 0);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Large files are split into contiguous ranges classified by concurrent
+ * threads, whose runs are then added to the backed block list in order, so
+ * the result does not depend on the number of threads.
+ */
+static int sparse_file_read_normal(struct sparse_file *s, int fd)
+{
+	unsigned int block_size = s->block_size;
+	unsigned int blocks = DIV_ROUND_UP(s->len, block_size);
+	unsigned int threads = 1;
+#if !defined(_WIN32)
+	if (s->len >= READ_NORMAL_THREAD_MIN) {
+		threads = std::min(std::max(std::thread::hardware_concurrency(), 1U),
+				READ_NORMAL_MAX_THREADS);
+	}
+#endif
+	threads = std::max(std::min(threads, blocks), 1U);
+
+	std::vector<std::vector<read_normal_run>> runs(threads);
+	std::vector<int> results(threads, 0);
+	unsigned int per_thread = DIV_ROUND_UP(blocks, threads);
+	if (threads == 1) {
+		results[0] = read_normal_range(fd, s->len, block_size, 0, blocks, &runs[0]);
+	} else {
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < threads; t++) {
+			unsigned int first = std::min(blocks, t * per_thread);
+			unsigned int last = std::min(blocks, first + per_thread);
+			workers.emplace_back([&, t, first, last]() {
+				results[t] = read_normal_range(fd, s->len, block_size, first,
+						last, &runs[t]);
+			});
+		}
+		for (std::thread &worker : workers) {
+			worker.join();
 		}
+	}
 
-		if (sparse_block) {
-			/* TODO: add flag to use skip instead of fill for buf[0] == 0 */
-			sparse_file_add_fill(s, buf[0], to_read, block);
-		} else {
-			sparse_file_add_fd(s, fd, offset, to_read, block);
+	for (unsigned int t = 0; t < threads; t++) {
+		if (results[t] < 0) {
+			error("failed to read sparse file");
+			return results[t];
 		}
+	}
 
-		remain -= to_read;
-		offset += to_read;
-		block++;
+	for (const std::vector<read_normal_run> &range : runs) {
+		for (const read_normal_run &run : range) {
+			int64_t offset = (int64_t)run.block * block_size;
+			unsigned int len = std::min<int64_t>(s->len - offset,
+					(int64_t)run.blocks * block_size);
+			/* TODO: add flag to use skip instead of fill for fill_val == 0 */
+			if (run.fill) {
+				sparse_file_add_fill(s, run.fill_val, len, run.block);
+			} else {
+				sparse_file_add_fd(s, fd, offset, len, run.block);
+			}
+		}
 	}
 
-	free(buf);
+	/* Leave fd where reading it sequentially would have */
+	lseek64(fd, s->len, SEEK_SET);
 	return 0;
 }
 
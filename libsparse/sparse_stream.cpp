@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sparse/sparse.h>
+
+#include "defs.h"
+#include "sparse_crc32.h"
+#include "sparse_format.h"
+
+#define SPARSE_HEADER_MAJOR_VER 1
+#define SPARSE_HEADER_LEN       (sizeof(sparse_header_t))
+#define CHUNK_HEADER_LEN (sizeof(chunk_header_t))
+
+static constexpr size_t CRC_BUF_SIZE = 64 * 1024;
+
+enum sparse_stream_state {
+	STREAM_FILE_HEADER,  /* collecting the sparse_header_t */
+	STREAM_CHUNK_HEADER, /* collecting a chunk_header_t */
+	STREAM_PAD,          /* skipping the rest of a longer header */
+	STREAM_CHUNK_BODY,   /* chunk header consumed, nothing else yet */
+	STREAM_RAW,          /* passing raw chunk data through */
+	STREAM_VALUE,        /* collecting the value of a fill, copy or crc chunk */
+	STREAM_DONE,
+	STREAM_ERROR,
+};
+
+struct sparse_stream {
+	const struct sparse_stream_ops *ops;
+	void *priv;
+	bool crc;
+	uint32_t crc32;
+	/* A Copy chunk was passed on, so crc32 no longer covers the file */
+	bool crc_lost;
+
+	enum sparse_stream_state state;
+	/* State to go to after STREAM_PAD */
+	enum sparse_stream_state next;
+	int error;
+
+	sparse_header_t header;
+	chunk_header_t chunk;
+	uint32_t value;
+	/* Bytes of the structure being collected that have arrived */
+	size_t have;
+	/* Bytes left to skip or pass through */
+	int64_t left;
+
+	unsigned int chunks_left;
+	unsigned int cur_block;
+	int64_t offset;
+
+	/* Fill or zero pattern for crc computation */
+	char *crc_buf;
+};
+
+static int stream_fail(struct sparse_stream *ss, int error)
+{
+	ss->state = STREAM_ERROR;
+	ss->error = error;
+	return error;
+}
+
+static void stream_crc_pattern(struct sparse_stream *ss, uint32_t fill_val,
+		int64_t len)
+{
+	uint32_t *fill = (uint32_t *)ss->crc_buf;
+	size_t i;
+
+	for (i = 0; i < CRC_BUF_SIZE / sizeof(fill_val); i++) {
+		fill[i] = fill_val;
+	}
+	while (len) {
+		size_t chunk = std::min(len, (int64_t)CRC_BUF_SIZE);
+		ss->crc32 = sparse_crc32(ss->crc32, ss->crc_buf, chunk);
+		len -= chunk;
+	}
+}
+
+/* Moves on to the next chunk header, or to the end of the file */
+static int stream_next_chunk(struct sparse_stream *ss)
+{
+	ss->have = 0;
+	if (ss->chunks_left == 0) {
+		if (ss->cur_block != ss->header.total_blks) {
+			return stream_fail(ss, -EINVAL);
+		}
+		ss->state = STREAM_DONE;
+	} else {
+		ss->chunks_left--;
+		ss->state = STREAM_CHUNK_HEADER;
+	}
+	return 0;
+}
+
+/* Skips len bytes of header padding, then goes to next */
+static int stream_pad(struct sparse_stream *ss, int64_t len,
+		enum sparse_stream_state next)
+{
+	ss->have = 0;
+	ss->left = len;
+	ss->next = next;
+	ss->state = STREAM_PAD;
+	return 0;
+}
+
+static int stream_file_header(struct sparse_stream *ss)
+{
+	const sparse_header_t *header = &ss->header;
+	int ret;
+
+	if (header->magic != SPARSE_HEADER_MAGIC ||
+			header->major_version != SPARSE_HEADER_MAJOR_VER ||
+			header->file_hdr_sz < SPARSE_HEADER_LEN ||
+			header->chunk_hdr_sz < CHUNK_HEADER_LEN ||
+			header->blk_sz == 0 || header->blk_sz % sizeof(uint32_t)) {
+		return stream_fail(ss, -EINVAL);
+	}
+
+	if (ss->ops->header) {
+		ret = ss->ops->header(ss->priv, header->blk_sz,
+				(int64_t)header->total_blks * header->blk_sz);
+		if (ret < 0) {
+			return stream_fail(ss, ret);
+		}
+	}
+
+	ss->chunks_left = header->total_chunks;
+	stream_next_chunk(ss);
+	if (ss->state == STREAM_ERROR) {
+		return ss->error;
+	}
+	if (ss->state == STREAM_DONE) {
+		/* No chunks, so ignore the rest of the header too */
+		return 0;
+	}
+	return stream_pad(ss, header->file_hdr_sz - SPARSE_HEADER_LEN,
+			STREAM_CHUNK_HEADER);
+}
+
+static int stream_chunk_header(struct sparse_stream *ss)
+{
+	return stream_pad(ss, ss->header.chunk_hdr_sz - CHUNK_HEADER_LEN,
+			STREAM_CHUNK_BODY);
+}
+
+/* Called once the chunk header, padding included, has been consumed */
+static int stream_chunk_start(struct sparse_stream *ss)
+{
+	const chunk_header_t *chunk = &ss->chunk;
+	int64_t len = (int64_t)chunk->chunk_sz * ss->header.blk_sz;
+	int ret;
+
+	if (chunk->total_sz < ss->header.chunk_hdr_sz) {
+		return stream_fail(ss, -EINVAL);
+	}
+	uint32_t data_sz = chunk->total_sz - ss->header.chunk_hdr_sz;
+
+	ss->have = 0;
+	switch (chunk->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (data_sz != len) {
+			return stream_fail(ss, -EINVAL);
+		}
+		ss->left = len;
+		ss->state = STREAM_RAW;
+		break;
+	case CHUNK_TYPE_FILL:
+	case CHUNK_TYPE_COPY:
+	case CHUNK_TYPE_CRC32:
+		if (data_sz != sizeof(ss->value)) {
+			return stream_fail(ss, -EINVAL);
+		}
+		ss->state = STREAM_VALUE;
+		return 0;
+	case CHUNK_TYPE_DONT_CARE:
+		if (data_sz != 0) {
+			return stream_fail(ss, -EINVAL);
+		}
+		ret = ss->ops->skip(ss->priv, ss->offset, len);
+		if (ret < 0) {
+			return stream_fail(ss, ret);
+		}
+		if (ss->crc) {
+			stream_crc_pattern(ss, 0, len);
+		}
+		ss->left = 0;
+		break;
+	default:
+		return stream_fail(ss, -EINVAL);
+	}
+
+	if (ss->left == 0) {
+		ss->offset += len;
+		ss->cur_block += chunk->chunk_sz;
+		return stream_next_chunk(ss);
+	}
+	return 0;
+}
+
+static int stream_value(struct sparse_stream *ss)
+{
+	int64_t len = (int64_t)ss->chunk.chunk_sz * ss->header.blk_sz;
+	int ret;
+
+	switch (ss->chunk.chunk_type) {
+	case CHUNK_TYPE_CRC32:
+		if (ss->crc && (ss->crc_lost || ss->value != ss->crc32)) {
+			return stream_fail(ss, -EINVAL);
+		}
+		return stream_next_chunk(ss);
+	case CHUNK_TYPE_COPY:
+		/* The source must already have been passed on in full */
+		if (!ss->ops->copy || ss->value > ss->cur_block ||
+				ss->chunk.chunk_sz > ss->cur_block - ss->value) {
+			return stream_fail(ss, -EINVAL);
+		}
+		ret = ss->ops->copy(ss->priv, ss->offset,
+				(int64_t)ss->value * ss->header.blk_sz, len);
+		if (ret < 0) {
+			return stream_fail(ss, ret);
+		}
+		ss->crc_lost = true;
+		break;
+	default:
+		ret = ss->ops->fill(ss->priv, ss->offset, ss->value, len);
+		if (ret < 0) {
+			return stream_fail(ss, ret);
+		}
+		if (ss->crc) {
+			stream_crc_pattern(ss, ss->value, len);
+		}
+		break;
+	}
+	ss->offset += len;
+	ss->cur_block += ss->chunk.chunk_sz;
+	return stream_next_chunk(ss);
+}
+
+/* Copies input into dst until it holds size bytes, returns true then */
+static bool stream_collect(struct sparse_stream *ss, void *dst, size_t size,
+		const char **data, size_t *len)
+{
+	size_t n = std::min(size - ss->have, *len);
+
+	memcpy((char *)dst + ss->have, *data, n);
+	ss->have += n;
+	*data += n;
+	*len -= n;
+	return ss->have == size;
+}
+
+struct sparse_stream *sparse_stream_new(const struct sparse_stream_ops *ops,
+		void *priv, bool crc)
+{
+	struct sparse_stream *ss = new sparse_stream();
+
+	ss->ops = ops;
+	ss->priv = priv;
+	ss->crc = crc;
+	ss->state = STREAM_FILE_HEADER;
+	if (crc) {
+		ss->crc_buf = new char[CRC_BUF_SIZE];
+	}
+	return ss;
+}
+
+int sparse_stream_feed(struct sparse_stream *ss, const void *buf, size_t len)
+{
+	const char *data = (const char *)buf;
+	size_t n;
+	int ret = 0;
+
+	while (ret == 0) {
+		/* States that move on without input first */
+		switch (ss->state) {
+		case STREAM_PAD:
+			if (ss->left == 0) {
+				ss->have = 0;
+				ss->state = ss->next;
+				continue;
+			}
+			break;
+		case STREAM_CHUNK_BODY:
+			ret = stream_chunk_start(ss);
+			continue;
+		case STREAM_DONE:
+			return 0;
+		case STREAM_ERROR:
+			return ss->error;
+		default:
+			break;
+		}
+
+		if (len == 0) {
+			break;
+		}
+
+		switch (ss->state) {
+		case STREAM_FILE_HEADER:
+			if (stream_collect(ss, &ss->header, SPARSE_HEADER_LEN, &data, &len)) {
+				ret = stream_file_header(ss);
+			}
+			break;
+		case STREAM_CHUNK_HEADER:
+			if (stream_collect(ss, &ss->chunk, CHUNK_HEADER_LEN, &data, &len)) {
+				ret = stream_chunk_header(ss);
+			}
+			break;
+		case STREAM_PAD:
+			n = std::min((int64_t)len, ss->left);
+			data += n;
+			len -= n;
+			ss->left -= n;
+			break;
+		case STREAM_RAW:
+			n = std::min((int64_t)len, ss->left);
+			ret = ss->ops->data(ss->priv, ss->offset, data, n);
+			if (ret < 0) {
+				return stream_fail(ss, ret);
+			}
+			ret = 0;
+			if (ss->crc) {
+				ss->crc32 = sparse_crc32(ss->crc32, data, n);
+			}
+			data += n;
+			len -= n;
+			ss->left -= n;
+			ss->offset += n;
+			if (ss->left == 0) {
+				ss->cur_block += ss->chunk.chunk_sz;
+				ret = stream_next_chunk(ss);
+			}
+			break;
+		case STREAM_VALUE:
+			if (stream_collect(ss, &ss->value, sizeof(ss->value), &data, &len)) {
+				ret = stream_value(ss);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return ret;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss)
+{
+	/* Finish off chunks that were waiting for no more input */
+	int ret = sparse_stream_feed(ss, NULL, 0);
+
+	if (ret < 0) {
+		return ret;
+	}
+	return ss->state == STREAM_DONE ? 0 : -EINVAL;
+}
+
+void sparse_stream_destroy(struct sparse_stream *ss)
+{
+	delete[] ss->crc_buf;
+	delete ss;
+}
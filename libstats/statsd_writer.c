@@ -25,6 +25,7 @@
 #include <private/android_logger.h>
 #include <stdarg.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -60,6 +61,64 @@ static int statsdOpen();
 static void statsdClose();
 static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr);
 
+/* Number of atoms lost, reported to statsd with the next atom written. */
+static atomic_int dropped;
+
+/*
+ * Atoms that could not be written because statsd's socket was full, oldest
+ * first. They are written again, in order, before the next atoms, so a short
+ * burst of atoms isn't lost. Only touched with retry_lock held, which is only
+ * ever tried: a writer that can't take it, as a signal handler that
+ * interrupted another writer, drops its atom as before.
+ */
+#define RETRY_RING_SIZE 8
+
+struct retry_entry {
+    size_t len;
+    uint8_t buf[sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD];
+};
+
+static pthread_mutex_t retry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct retry_entry retry_ring[RETRY_RING_SIZE];
+static size_t retry_head;
+static atomic_int retry_count;
+
+/* retry_lock assumed. Returns whether the ring is empty. */
+static bool flushRetryRing(int sock) {
+    while (atomic_load(&retry_count) > 0) {
+        const struct retry_entry* entry = &retry_ring[retry_head];
+        ssize_t ret = TEMP_FAILURE_RETRY(write(sock, entry->buf, entry->len));
+        if (ret < 0 && errno == EAGAIN) {
+            return false;
+        }
+        if (ret < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        }
+        retry_head = (retry_head + 1) % RETRY_RING_SIZE;
+        atomic_fetch_sub(&retry_count, 1);
+    }
+    return true;
+}
+
+/* retry_lock assumed. */
+static void pushRetryRing(const struct iovec* vec, size_t nr) {
+    struct retry_entry* entry;
+    size_t i;
+
+    if (atomic_load(&retry_count) == RETRY_RING_SIZE) {
+        retry_head = (retry_head + 1) % RETRY_RING_SIZE;
+        atomic_fetch_sub(&retry_count, 1);
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    }
+    entry = &retry_ring[(retry_head + atomic_load(&retry_count)) % RETRY_RING_SIZE];
+    entry->len = 0;
+    for (i = 0; i < nr; i++) {
+        memcpy(entry->buf + entry->len, vec[i].iov_base, vec[i].iov_len);
+        entry->len += vec[i].iov_len;
+    }
+    atomic_fetch_add(&retry_count, 1);
+}
+
 struct android_log_transport_write statsdLoggerWrite = {
     .name = "statsd",
     .sock = -EBADF,
@@ -138,7 +197,6 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
     struct iovec newVec[nr + headerLength];
     android_log_header_t header;
     size_t i, payloadSize;
-    static atomic_int dropped;
 
     sock = atomic_load(&statsdLoggerWrite.sock);
     if (sock < 0) switch (sock) {
@@ -209,6 +267,20 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
         }
     }
 
+    payloadSize = min(payloadSize, LOGGER_ENTRY_MAX_PAYLOAD);
+
+    // Atoms waiting to be retried go first, and this one waits behind them.
+    if (sock >= 0 && atomic_load(&retry_count) > 0 && !pthread_mutex_trylock(&retry_lock)) {
+        bool flushed = flushRetryRing(sock);
+        if (!flushed) {
+            pushRetryRing(newVec, i);
+        }
+        pthread_mutex_unlock(&retry_lock);
+        if (!flushed) {
+            return payloadSize;
+        }
+    }
+
     /*
      * The write below could be lost, but will never block.
      *
@@ -253,7 +325,13 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
     if (ret > (ssize_t)sizeof(header)) {
         ret -= sizeof(header);
     } else if (ret == -EAGAIN) {
-        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        if (!pthread_mutex_trylock(&retry_lock)) {
+            pushRetryRing(newVec, i);
+            pthread_mutex_unlock(&retry_lock);
+            ret = payloadSize;
+        } else {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        }
     }
 
     return ret;
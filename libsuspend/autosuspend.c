@@ -113,3 +113,16 @@ void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
 
     autosuspend_ops->set_wakeup_callback(func);
 }
+
+void autosuspend_set_attempt_callback(void (*func)(const struct autosuspend_attempt* attempt)) {
+    int ret;
+
+    ret = autosuspend_init();
+    if (ret) {
+        return;
+    }
+
+    ALOGV("set_attempt_callback");
+
+    autosuspend_ops->set_attempt_callback(func);
+}
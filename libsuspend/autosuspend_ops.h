@@ -22,6 +22,7 @@ struct autosuspend_ops {
     int (*disable)(void);
     int (*force_suspend)(int timeout_ms);
     void (*set_wakeup_callback)(void (*func)(bool success));
+    void (*set_attempt_callback)(void (*func)(const struct autosuspend_attempt* attempt));
 };
 
 __BEGIN_DECLS
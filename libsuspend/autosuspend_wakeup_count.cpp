@@ -17,6 +17,7 @@
 #define LOG_TAG "libsuspend"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -26,11 +27,13 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
+#include <suspend/autosuspend.h>
 
 #include "autosuspend_ops.h"
 
@@ -48,38 +51,76 @@ static pthread_t suspend_thread;
 static sem_t suspend_lockout;
 static constexpr char sleep_state[] = "mem";
 static void (*wakeup_func)(bool success) = NULL;
+static void (*attempt_func)(const struct autosuspend_attempt* attempt) = NULL;
 static int sleep_time = BASE_SLEEP_TIME;
 static constexpr char sys_power_state[] = "/sys/power/state";
 static constexpr char sys_power_wakeup_count[] = "/sys/power/wakeup_count";
 static bool autosuspend_is_init = false;
 
-static void update_sleep_time(bool success) {
-    if (success) {
-        sleep_time = BASE_SLEEP_TIME;
-        return;
+static void update_sleep_time(autosuspend_attempt_result result) {
+    switch (result) {
+        case AUTOSUSPEND_ATTEMPT_SUSPENDED:
+        case AUTOSUSPEND_ATTEMPT_WAKEUP_EVENT:
+        case AUTOSUSPEND_ATTEMPT_ABORTED_WAKEUP:
+            // A wakeup event explains the failure: reading wakeup_count again
+            // blocks until it is processed, so there is no point waiting longer.
+            sleep_time = BASE_SLEEP_TIME;
+            break;
+        case AUTOSUSPEND_ATTEMPT_FAILED:
+        case AUTOSUSPEND_ATTEMPT_READ_ERROR:
+            // double sleep time after each failure up to one minute
+            sleep_time = MIN(sleep_time * 2, MAX_SLEEP_TIME);
+            break;
+    }
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void report_attempt(struct autosuspend_attempt* attempt) {
+    update_sleep_time(attempt->result);
+    attempt->backoff_us = sleep_time;
+
+    LOG(VERBOSE) << "attempt result=" << attempt->result << " error=" << attempt->error
+                 << " wait_ns=" << attempt->wait_ns << " suspend_ns=" << attempt->suspend_ns
+                 << " backoff_us=" << attempt->backoff_us;
+
+    void (*func)(const struct autosuspend_attempt* attempt) = attempt_func;
+    if (func != NULL) {
+        (*func)(attempt);
     }
-    // double sleep time after each failure up to one minute
-    sleep_time = MIN(sleep_time * 2, MAX_SLEEP_TIME);
 }
 
 static void* suspend_thread_func(void* arg __attribute__((unused))) {
-    bool success = true;
+    // Reused by each attempt, sysfs reads are small.
+    std::string wakeup_count;
 
     while (true) {
-        update_sleep_time(success);
         usleep(sleep_time);
-        success = false;
+
+        struct autosuspend_attempt attempt = {};
+        attempt.result = AUTOSUSPEND_ATTEMPT_READ_ERROR;
+
         LOG(VERBOSE) << "read wakeup_count";
         lseek(wakeup_count_fd, 0, SEEK_SET);
-        std::string wakeup_count;
-        if (!ReadFdToString(wakeup_count_fd, &wakeup_count)) {
+        // The read blocks until the wakeup events in progress complete.
+        uint64_t start = now_ns();
+        bool read = ReadFdToString(wakeup_count_fd, &wakeup_count);
+        attempt.wait_ns = now_ns() - start;
+        if (!read) {
+            attempt.error = errno;
             PLOG(ERROR) << "error reading from " << sys_power_wakeup_count;
+            report_attempt(&attempt);
             continue;
         }
 
         wakeup_count = Trim(wakeup_count);
         if (wakeup_count.empty()) {
             LOG(ERROR) << "empty wakeup count";
+            report_attempt(&attempt);
             continue;
         }
 
@@ -93,13 +134,26 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
         LOG(VERBOSE) << "write " << wakeup_count << " to wakeup_count";
         if (WriteStringToFd(wakeup_count, wakeup_count_fd)) {
             LOG(VERBOSE) << "write " << sleep_state << " to " << sys_power_state;
-            success = WriteStringToFd(sleep_state, state_fd);
+            start = now_ns();
+            bool success = WriteStringToFd(sleep_state, state_fd);
+            attempt.suspend_ns = now_ns() - start;
+            if (success) {
+                attempt.result = AUTOSUSPEND_ATTEMPT_SUSPENDED;
+            } else {
+                // The kernel returns EBUSY when a wakeup event aborted the suspend.
+                attempt.error = errno;
+                attempt.result = errno == EBUSY ? AUTOSUSPEND_ATTEMPT_ABORTED_WAKEUP
+                                                : AUTOSUSPEND_ATTEMPT_FAILED;
+            }
 
             void (*func)(bool success) = wakeup_func;
             if (func != NULL) {
                 (*func)(success);
             }
         } else {
+            // The count changed since it was read: a wakeup event was reported.
+            attempt.error = errno;
+            attempt.result = AUTOSUSPEND_ATTEMPT_WAKEUP_EVENT;
             PLOG(ERROR) << "error writing to " << sys_power_wakeup_count;
         }
 
@@ -108,6 +162,8 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
         if (ret < 0) {
             PLOG(ERROR) << "error releasing semaphore";
         }
+
+        report_attempt(&attempt);
     }
     return NULL;
 }
@@ -216,7 +272,7 @@ static int force_suspend(int timeout_ms) {
     return WriteStringToFd(sleep_state, state_fd) ? 0 : -1;
 }
 
-static void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
+static void autosuspend_wakeup_count_set_wakeup_callback(void (*func)(bool success)) {
     if (wakeup_func != NULL) {
         LOG(ERROR) << "duplicate wakeup callback applied, keeping original";
         return;
@@ -224,11 +280,21 @@ static void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
     wakeup_func = func;
 }
 
+static void autosuspend_wakeup_count_set_attempt_callback(
+        void (*func)(const struct autosuspend_attempt* attempt)) {
+    if (attempt_func != NULL) {
+        LOG(ERROR) << "duplicate attempt callback applied, keeping original";
+        return;
+    }
+    attempt_func = func;
+}
+
 struct autosuspend_ops autosuspend_wakeup_count_ops = {
     .enable = autosuspend_wakeup_count_enable,
     .disable = autosuspend_wakeup_count_disable,
     .force_suspend = force_suspend,
-    .set_wakeup_callback = autosuspend_set_wakeup_callback,
+    .set_wakeup_callback = autosuspend_wakeup_count_set_wakeup_callback,
+    .set_attempt_callback = autosuspend_wakeup_count_set_attempt_callback,
 };
 
 struct autosuspend_ops* autosuspend_wakeup_count_init(void) {
@@ -19,6 +19,7 @@
 
 #include <sys/cdefs.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 __BEGIN_DECLS
 
@@ -64,6 +65,42 @@ int autosuspend_force_suspend(int timeout_ms);
  */
 void autosuspend_set_wakeup_callback(void (*func)(bool success));
 
+/*
+ * The outcome of an attempt to suspend, passed to the attempt callback.
+ */
+enum autosuspend_attempt_result {
+    /* The device suspended, and resumed. */
+    AUTOSUSPEND_ATTEMPT_SUSPENDED,
+    /* A wakeup event was reported while the attempt was being made. */
+    AUTOSUSPEND_ATTEMPT_WAKEUP_EVENT,
+    /* The kernel aborted the suspend because of a pending wakeup event. */
+    AUTOSUSPEND_ATTEMPT_ABORTED_WAKEUP,
+    /* The suspend failed for another reason, such as a driver refusing it. */
+    AUTOSUSPEND_ATTEMPT_FAILED,
+    /* The wakeup count could not be read. */
+    AUTOSUSPEND_ATTEMPT_READ_ERROR,
+};
+
+struct autosuspend_attempt {
+    enum autosuspend_attempt_result result;
+    /* errno of the failure, 0 if the device suspended. */
+    int error;
+    /* Time spent waiting for the wakeup events in progress to complete. */
+    uint64_t wait_ns;
+    /* Time spent entering and leaving suspend, not counting the time suspended. */
+    uint64_t suspend_ns;
+    /* Delay before the next attempt. */
+    uint64_t backoff_us;
+};
+
+/*
+ * set_attempt_callback
+ *
+ * Set a function to be called after each attempt to suspend, for instrumentation.
+ * It is called on the suspend thread and must not block.
+ */
+void autosuspend_set_attempt_callback(void (*func)(const struct autosuspend_attempt* attempt));
+
 __END_DECLS
 
 #endif
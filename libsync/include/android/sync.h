@@ -37,6 +37,8 @@
  * break builds.
  */
 
+#include <stddef.h>
+
 #include "../ndk/sync.h"
 
 __BEGIN_DECLS
@@ -64,6 +66,21 @@ struct sync_pt_info *sync_pt_info(struct sync_fence_info_data *info,
                                   struct sync_pt_info *itr);
 void sync_fence_info_free(struct sync_fence_info_data *info);
 
+/* Waits until all |count| fences are signaled, within a single timeout in
+ * msecs for the whole set. Returns 0, or -1 with errno set to ETIME on
+ * timeout or EINVAL if a fence is invalid, as sync_wait() does. */
+int sync_wait_many(const int *fds, size_t count, int timeout);
+
+/* Merges |count| sync files into one, pairing them up in a balanced tree so
+ * that each fence is only copied log2(count) times rather than once per
+ * sync_merge() of a chain. The caller still owns and closes |fds|. */
+int sync_merge_many(const char *name, const int *fds, size_t count);
+
+/* Stores the status of the sync file in |status|, with the meaning of
+ * sync_file_info.status, without allocating the info of its fences.
+ * Returns 0, or -1 with errno set. */
+int sync_file_status(int fd, int32_t *status);
+
 __END_DECLS
 
 #endif /* __SYS_CORE_SYNC_H */
@@ -23,10 +23,12 @@
 #include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <android/sync.h>
 
@@ -128,6 +130,82 @@ int sync_wait(int fd, int timeout)
     return ret;
 }
 
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int sync_wait_many(const int *fds, size_t count, int timeout)
+{
+    struct pollfd local_fds[16];
+    struct pollfd *pfds = local_fds;
+    size_t pending = count;
+    int64_t deadline = 0;
+    int saved_errno;
+    int ret = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (fds[i] < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (count > sizeof(local_fds) / sizeof(local_fds[0])) {
+        pfds = malloc(count * sizeof(*pfds));
+        if (pfds == NULL)
+            return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+    if (timeout > 0)
+        deadline = now_ms() + timeout;
+
+    while (pending > 0) {
+        ret = poll(pfds, count, timeout);
+        if (ret == 0) {
+            errno = ETIME;
+            ret = -1;
+            break;
+        } else if (ret < 0) {
+            if (errno != EINTR && errno != EAGAIN)
+                break;
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                if (pfds[i].fd < 0 || !pfds[i].revents)
+                    continue;
+                if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+                    errno = EINVAL;
+                    ret = -1;
+                    goto done;
+                }
+                /* poll() skips negative fds: signaled fences aren't polled again. */
+                pfds[i].fd = -1;
+                pending--;
+            }
+        }
+        ret = 0;
+
+        if (timeout > 0) {
+            int64_t left = deadline - now_ms();
+            timeout = left > 0 ? (int)left : 0;
+        }
+    }
+
+done:
+    saved_errno = errno;
+    if (pfds != local_fds)
+        free(pfds);
+    errno = saved_errno;
+    return ret;
+}
+
 static int legacy_sync_merge(const char *name, int fd1, int fd2)
 {
     struct sync_legacy_merge_data data;
@@ -183,6 +261,45 @@ int sync_merge(const char *name, int fd1, int fd2)
     return ret;
 }
 
+/* Merges fds[0..count), count >= 2, closing the intermediate sync files. */
+static int sync_merge_range(const char *name, const int *fds, size_t count)
+{
+    size_t half = count / 2;
+    int saved_errno;
+    int fd1, fd2;
+    int ret;
+
+    fd1 = half > 1 ? sync_merge_range(name, fds, half) : fds[0];
+    if (fd1 < 0)
+        return -1;
+    fd2 = count - half > 1 ? sync_merge_range(name, fds + half, count - half) : fds[half];
+    if (fd2 < 0) {
+        if (half > 1)
+            close(fd1);
+        return -1;
+    }
+
+    ret = sync_merge(name, fd1, fd2);
+    saved_errno = errno;
+    if (half > 1)
+        close(fd1);
+    if (count - half > 1)
+        close(fd2);
+    errno = saved_errno;
+    return ret;
+}
+
+int sync_merge_many(const char *name, const int *fds, size_t count)
+{
+    if (count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (count == 1)
+        return fcntl(fds[0], F_DUPFD_CLOEXEC, 0);
+    return sync_merge_range(name, fds, count);
+}
+
 static struct sync_fence_info_data *legacy_sync_fence_info(int fd)
 {
     struct sync_fence_info_data *legacy_info;
@@ -361,6 +478,44 @@ struct sync_file_info* sync_file_info(int32_t fd)
     return info;
 }
 
+int sync_file_status(int fd, int32_t *status)
+{
+    union {
+        struct sync_fence_info_data info;
+        uint8_t buf[4096];
+    } legacy;
+    int uapi;
+
+    uapi = atomic_load_explicit(&g_uapi_version, memory_order_acquire);
+
+    if (uapi == UAPI_MODERN || uapi == UAPI_UNKNOWN) {
+        /* Without room for fences, the kernel only fills in the status. */
+        struct sync_file_info info;
+
+        memset(&info, 0, sizeof(info));
+        if (ioctl(fd, SYNC_IOC_FILE_INFO, &info) == 0) {
+            if (uapi == UAPI_UNKNOWN) {
+                atomic_store_explicit(&g_uapi_version, UAPI_MODERN,
+                                      memory_order_release);
+            }
+            *status = info.status;
+            return 0;
+        }
+        if (errno != ENOTTY)
+            return -1;
+    }
+
+    legacy.info.len = sizeof(legacy);
+    if (ioctl(fd, SYNC_IOC_LEGACY_FENCE_INFO, &legacy.info) < 0)
+        return -1;
+    if (uapi == UAPI_UNKNOWN) {
+        atomic_store_explicit(&g_uapi_version, UAPI_LEGACY,
+                              memory_order_release);
+    }
+    *status = legacy.info.status;
+    return 0;
+}
+
 struct sync_pt_info *sync_pt_info(struct sync_fence_info_data *info,
                                   struct sync_pt_info *itr)
 {
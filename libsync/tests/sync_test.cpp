@@ -448,6 +448,96 @@ TEST(FenceTest, MultiTimelineWait) {
     ASSERT_EQ(mergedFence.wait(100), 0);
 }
 
+TEST(FenceTest, WaitMany) {
+    SyncTimeline timelineA, timelineB;
+
+    vector<SyncFence> fences;
+    for (int i = 1; i <= 20; i++) {
+        fences.push_back(SyncFence(i % 2 ? timelineA : timelineB, i));
+    }
+    vector<int> fds;
+    for (auto &fence : fences) {
+        fds.push_back(fence.getFd());
+    }
+
+    ASSERT_EQ(sync_wait_many(fds.data(), fds.size(), 0), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    // Only the fences of timeline A are signaled.
+    timelineA.inc(20);
+    ASSERT_EQ(sync_wait_many(fds.data(), fds.size(), 10), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    thread signaler([&]{
+        for (int i = 0; i < 20; i++) {
+            timelineB.inc(1);
+            usleep(1000);
+        }
+    });
+    ASSERT_EQ(sync_wait_many(fds.data(), fds.size(), 5000), 0);
+    signaler.join();
+
+    ASSERT_EQ(sync_wait_many(fds.data(), 0, 0), 0);
+    fds.push_back(-1);
+    ASSERT_EQ(sync_wait_many(fds.data(), fds.size(), 0), -1);
+    ASSERT_EQ(errno, EINVAL);
+}
+
+TEST(FenceTest, MergeMany) {
+    SyncTimeline timelineA, timelineB, timelineC;
+
+    vector<SyncFence> fences;
+    vector<int> fds;
+    for (int i = 0; i < 7; i++) {
+        fences.push_back(SyncFence(i % 3 == 0 ? timelineA : i % 3 == 1 ? timelineB : timelineC,
+                                   i + 1));
+        fds.push_back(fences.back().getFd());
+    }
+
+    int fd = sync_merge_many("mergeMany", fds.data(), fds.size());
+    ASSERT_GE(fd, 0);
+
+    struct sync_file_info *info = sync_file_info(fd);
+    ASSERT_TRUE(info != NULL);
+    // Only the last fence of each timeline remains.
+    EXPECT_EQ(info->num_fences, 3);
+    EXPECT_EQ(info->status, 0);
+    sync_file_info_free(info);
+
+    timelineA.inc(7);
+    timelineB.inc(5);
+    ASSERT_EQ(sync_wait(fd, 0), -1);
+    timelineC.inc(6);
+    ASSERT_EQ(sync_wait(fd, 0), 0);
+    close(fd);
+
+    // One sync file is duplicated.
+    fd = sync_merge_many("mergeMany", fds.data(), 1);
+    ASSERT_GE(fd, 0);
+    ASSERT_NE(fd, fds[0]);
+    close(fd);
+
+    ASSERT_LT(sync_merge_many("mergeMany", fds.data(), 0), 0);
+}
+
+TEST(FenceTest, FileStatus) {
+    SyncTimeline timeline;
+    ASSERT_TRUE(timeline.isValid());
+
+    SyncFence fence(timeline, 1);
+    ASSERT_TRUE(fence.isValid());
+
+    int32_t status = -1;
+    ASSERT_EQ(sync_file_status(fence.getFd(), &status), 0);
+    EXPECT_EQ(status, 0);
+
+    timeline.inc(1);
+    ASSERT_EQ(sync_file_status(fence.getFd(), &status), 0);
+    EXPECT_EQ(status, 1);
+
+    ASSERT_EQ(sync_file_status(-1, &status), -1);
+}
+
 TEST(FenceTest, GetInfoActive) {
     SyncTimeline timeline;
     ASSERT_TRUE(timeline.isValid());
@@ -5,6 +5,7 @@
 
 #include <pthread.h>
 #include <cutils/atomic.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 
@@ -62,6 +63,9 @@ public:
     int sendData(const void *data, int len);
     // iovec contents not preserved through call
     int sendDatav(struct iovec *iov, int iovcnt);
+    // Sends each message as its own record, for datagram and sequenced
+    // packet sockets. Records are not split, msgs contents not preserved.
+    int sendDatamv(struct mmsghdr *msgs, unsigned int vlen);
 
     // Optional reference counting.  Reference count starts at 1.  If
     // it's decremented to 0, it deletes itself.
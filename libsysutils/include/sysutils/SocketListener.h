@@ -18,6 +18,8 @@
 
 #include <pthread.h>
 
+#include <vector>
+
 #include <sysutils/SocketClient.h>
 #include "SocketClientCommand.h"
 
@@ -28,9 +30,18 @@ class SocketListener {
     SocketClientCollection  *mClients;
     pthread_mutex_t         mClientsLock;
     int                     mCtrlPipe[2];
+    int                     mEpollFd;
     pthread_t               mThread;
     bool                    mUseCmdNum;
 
+    // Clients that have data, waiting for a worker.
+    std::vector<pthread_t>  mWorkers;
+    size_t                  mWorkerCount;
+    SocketClientCollection  mWork;
+    pthread_mutex_t         mWorkLock;
+    pthread_cond_t          mWorkCond;
+    bool                    mStopWorkers;
+
 public:
     SocketListener(const char *socketName, bool listen);
     SocketListener(const char *socketName, bool listen, bool useCmdNum);
@@ -41,19 +52,32 @@ public:
     int startListener(int backlog);
     int stopListener();
 
+    /*
+     * Call onDataAvailable() from a pool of |count| threads rather than from
+     * the listener thread, so that a slow command only holds up its own
+     * client. Calls for one client still happen one at a time, in order, but
+     * those for different clients can then run at once. Must be called
+     * before startListener().
+     */
+    void setWorkerCount(size_t count) { mWorkerCount = count; }
+
     void sendBroadcast(int code, const char *msg, bool addErrno);
 
     void runOnEachSocket(SocketClientCommand *command);
 
-    bool release(SocketClient *c) { return release(c, true); }
+    bool release(SocketClient *c);
 
 protected:
     virtual bool onDataAvailable(SocketClient *c) = 0;
 
 private:
-    bool release(SocketClient *c, bool wakeup);
     static void *threadStart(void *obj);
+    static void *workerStart(void *obj);
     void runListener();
+    void runWorker();
+    bool watch(SocketClient *c, int op);
+    void process(SocketClient *c);
+    void stopWorkers();
     void init(const char *socketName, int socketFd, bool listen, bool useCmdNum);
 };
 #endif
@@ -187,6 +187,53 @@ int SocketClient::sendDatav(struct iovec *iov, int iovcnt) {
     return rc;
 }
 
+int SocketClient::sendDatamv(struct mmsghdr *msgs, unsigned int vlen) {
+    if (mSocket < 0) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    int ret = 0;
+    int e = 0;
+    unsigned int current = 0;
+
+    pthread_mutex_lock(&mWriteMutex);
+
+    struct sigaction new_action, old_action;
+    memset(&new_action, 0, sizeof(new_action));
+    new_action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &new_action, &old_action);
+
+    while (current < vlen) {
+        int rc = TEMP_FAILURE_RETRY(
+            sendmmsg(mSocket, msgs + current, vlen - current, 0));
+
+        if (rc > 0) {
+            current += rc;
+            continue;
+        }
+
+        if (rc == 0) {
+            e = EIO;
+            SLOGW("0 length write :(");
+        } else {
+            e = errno;
+            SLOGW("write error (%s)", strerror(e));
+        }
+        ret = -1;
+        break;
+    }
+
+    sigaction(SIGPIPE, &old_action, &new_action);
+
+    pthread_mutex_unlock(&mWriteMutex);
+
+    if (e != 0) {
+        errno = e;
+    }
+    return ret;
+}
+
 int SocketClient::sendDataLockedv(struct iovec *iov, int iovcnt) {
 
     if (mSocket < 0) {
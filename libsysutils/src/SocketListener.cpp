@@ -19,7 +19,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -32,7 +32,8 @@
 #include <sysutils/SocketClient.h>
 
 #define CtrlPipe_Shutdown 0
-#define CtrlPipe_Wakeup   1
+
+static const int kMaxEvents = 16;
 
 SocketListener::SocketListener(const char *socketName, bool listen) {
     init(socketName, -1, listen, false);
@@ -53,6 +54,13 @@ void SocketListener::init(const char *socketName, int socketFd, bool listen, boo
     mUseCmdNum = useCmdNum;
     pthread_mutex_init(&mClientsLock, NULL);
     mClients = new SocketClientCollection();
+    mCtrlPipe[0] = -1;
+    mCtrlPipe[1] = -1;
+    mEpollFd = -1;
+    mWorkerCount = 0;
+    pthread_mutex_init(&mWorkLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    mStopWorkers = false;
 }
 
 SocketListener::~SocketListener() {
@@ -63,6 +71,8 @@ SocketListener::~SocketListener() {
         close(mCtrlPipe[0]);
         close(mCtrlPipe[1]);
     }
+    if (mEpollFd != -1)
+        close(mEpollFd);
     SocketClientCollection::iterator it;
     for (it = mClients->begin(); it != mClients->end();) {
         (*it)->decRef();
@@ -102,8 +112,42 @@ int SocketListener::startListener(int backlog) {
         return -1;
     }
 
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        SLOGE("epoll_create1 failed (%s)", strerror(errno));
+        return -1;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = mCtrlPipe[0];
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mCtrlPipe[0], &ev) < 0) {
+        SLOGE("epoll_ctl failed (%s)", strerror(errno));
+        return -1;
+    }
+    if (mListen) {
+        ev.data.fd = mSock;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mSock, &ev) < 0) {
+            SLOGE("epoll_ctl failed (%s)", strerror(errno));
+            return -1;
+        }
+    } else if (!watch(*mClients->begin(), EPOLL_CTL_ADD)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < mWorkerCount; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, SocketListener::workerStart, this)) {
+            SLOGE("pthread_create (%s)", strerror(errno));
+            stopWorkers();
+            return -1;
+        }
+        mWorkers.push_back(worker);
+    }
+
     if (pthread_create(&mThread, NULL, SocketListener::threadStart, this)) {
         SLOGE("pthread_create (%s)", strerror(errno));
+        stopWorkers();
         return -1;
     }
 
@@ -125,10 +169,13 @@ int SocketListener::stopListener() {
         SLOGE("Error joining to listener thread (%s)", strerror(errno));
         return -1;
     }
+    stopWorkers();
     close(mCtrlPipe[0]);
     close(mCtrlPipe[1]);
     mCtrlPipe[0] = -1;
     mCtrlPipe[1] = -1;
+    close(mEpollFd);
+    mEpollFd = -1;
 
     if (mSocketName && mSock > -1) {
         close(mSock);
@@ -151,80 +198,104 @@ void *SocketListener::threadStart(void *obj) {
     return NULL;
 }
 
+void *SocketListener::workerStart(void *obj) {
+    SocketListener *me = reinterpret_cast<SocketListener *>(obj);
+
+    me->runWorker();
+    return NULL;
+}
+
+bool SocketListener::watch(SocketClient *c, int op) {
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    if (mWorkerCount > 0) {
+        // Don't report the client again until a worker is done with its data.
+        ev.events |= EPOLLONESHOT;
+    }
+    ev.data.fd = c->getSocket();
+    if (epoll_ctl(mEpollFd, op, c->getSocket(), &ev) < 0) {
+        // The client may have been released while it was being processed.
+        if (op != EPOLL_CTL_MOD || errno != ENOENT) {
+            SLOGE("epoll_ctl failed (%s)", strerror(errno));
+        }
+        return false;
+    }
+    return true;
+}
+
 void SocketListener::runListener() {
 
     SocketClientCollection pendingList;
+    struct epoll_event events[kMaxEvents];
 
     while(1) {
         SocketClientCollection::iterator it;
-        fd_set read_fds;
-        int rc = 0;
-        int max = -1;
 
-        FD_ZERO(&read_fds);
-
-        if (mListen) {
-            max = mSock;
-            FD_SET(mSock, &read_fds);
-        }
-
-        FD_SET(mCtrlPipe[0], &read_fds);
-        if (mCtrlPipe[0] > max)
-            max = mCtrlPipe[0];
-
-        pthread_mutex_lock(&mClientsLock);
-        for (it = mClients->begin(); it != mClients->end(); ++it) {
-            // NB: calling out to an other object with mClientsLock held (safe)
-            int fd = (*it)->getSocket();
-            FD_SET(fd, &read_fds);
-            if (fd > max) {
-                max = fd;
-            }
-        }
-        pthread_mutex_unlock(&mClientsLock);
-        SLOGV("mListen=%d, max=%d, mSocketName=%s", mListen, max, mSocketName);
-        if ((rc = select(max + 1, &read_fds, NULL, NULL, NULL)) < 0) {
-            if (errno == EINTR)
-                continue;
-            SLOGE("select failed (%s) mListen=%d, max=%d", strerror(errno), mListen, max);
+        int count = TEMP_FAILURE_RETRY(epoll_wait(mEpollFd, events, kMaxEvents, -1));
+        if (count < 0) {
+            SLOGE("epoll_wait failed (%s) mListen=%d", strerror(errno), mListen);
             sleep(1);
             continue;
-        } else if (!rc)
-            continue;
+        }
 
-        if (FD_ISSET(mCtrlPipe[0], &read_fds)) {
-            char c = CtrlPipe_Shutdown;
-            TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
-            if (c == CtrlPipe_Shutdown) {
+        pendingList.clear();
+        bool shutdown = false;
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == mCtrlPipe[0]) {
+                char c = CtrlPipe_Shutdown;
+                TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
+                shutdown = true;
                 break;
             }
-            continue;
-        }
-        if (mListen && FD_ISSET(mSock, &read_fds)) {
-            int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
-            if (c < 0) {
-                SLOGE("accept failed (%s)", strerror(errno));
-                sleep(1);
+            if (mListen && fd == mSock) {
+                int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
+                if (c < 0) {
+                    SLOGE("accept failed (%s)", strerror(errno));
+                    sleep(1);
+                    continue;
+                }
+                SocketClient* client = new SocketClient(c, true, mUseCmdNum);
+                if (!watch(client, EPOLL_CTL_ADD)) {
+                    client->decRef();
+                    continue;
+                }
+                pthread_mutex_lock(&mClientsLock);
+                mClients->push_back(client);
+                pthread_mutex_unlock(&mClientsLock);
                 continue;
             }
+
+            /* Clients released since epoll_wait() returned are gone from the list */
             pthread_mutex_lock(&mClientsLock);
-            mClients->push_back(new SocketClient(c, true, mUseCmdNum));
+            for (it = mClients->begin(); it != mClients->end(); ++it) {
+                SocketClient* c = *it;
+                // NB: calling out to an other object with mClientsLock held (safe)
+                if (c->getSocket() == fd) {
+                    pendingList.push_back(c);
+                    c->incRef();
+                    break;
+                }
+            }
             pthread_mutex_unlock(&mClientsLock);
         }
 
-        /* Add all active clients to the pending list first */
-        pendingList.clear();
-        pthread_mutex_lock(&mClientsLock);
-        for (it = mClients->begin(); it != mClients->end(); ++it) {
-            SocketClient* c = *it;
-            // NB: calling out to an other object with mClientsLock held (safe)
-            int fd = c->getSocket();
-            if (FD_ISSET(fd, &read_fds)) {
-                pendingList.push_back(c);
-                c->incRef();
+        if (shutdown) {
+            for (it = pendingList.begin(); it != pendingList.end(); ++it) {
+                (*it)->decRef();
             }
+            return;
+        }
+
+        if (mWorkerCount > 0) {
+            pthread_mutex_lock(&mWorkLock);
+            for (it = pendingList.begin(); it != pendingList.end(); ++it) {
+                mWork.push_back(*it);
+                pthread_cond_signal(&mWorkCond);
+            }
+            pthread_mutex_unlock(&mWorkLock);
+            continue;
         }
-        pthread_mutex_unlock(&mClientsLock);
 
         /* Process the pending list, since it is owned by the thread,
          * there is no need to lock it */
@@ -233,16 +304,61 @@ void SocketListener::runListener() {
             it = pendingList.begin();
             SocketClient* c = *it;
             pendingList.erase(it);
-            /* Process it, if false is returned, remove from list */
-            if (!onDataAvailable(c)) {
-                release(c, false);
-            }
-            c->decRef();
+            process(c);
         }
     }
 }
 
-bool SocketListener::release(SocketClient* c, bool wakeup) {
+void SocketListener::process(SocketClient *c) {
+    /* Process it, if false is returned, remove from list */
+    if (!onDataAvailable(c)) {
+        release(c);
+    }
+    if (mWorkerCount > 0) {
+        watch(c, EPOLL_CTL_MOD);
+    }
+    c->decRef();
+}
+
+void SocketListener::runWorker() {
+    pthread_mutex_lock(&mWorkLock);
+    while (1) {
+        while (!mStopWorkers && mWork.empty()) {
+            pthread_cond_wait(&mWorkCond, &mWorkLock);
+        }
+        if (mStopWorkers) {
+            break;
+        }
+        SocketClientCollection::iterator it = mWork.begin();
+        SocketClient* c = *it;
+        mWork.erase(it);
+        pthread_mutex_unlock(&mWorkLock);
+        process(c);
+        pthread_mutex_lock(&mWorkLock);
+    }
+    pthread_mutex_unlock(&mWorkLock);
+}
+
+void SocketListener::stopWorkers() {
+    pthread_mutex_lock(&mWorkLock);
+    mStopWorkers = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mWorkLock);
+
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        pthread_join(mWorkers[i], NULL);
+    }
+    mWorkers.clear();
+
+    SocketClientCollection::iterator it;
+    for (it = mWork.begin(); it != mWork.end();) {
+        (*it)->decRef();
+        it = mWork.erase(it);
+    }
+    mStopWorkers = false;
+}
+
+bool SocketListener::release(SocketClient* c) {
     bool ret = false;
     /* if our sockets are connection-based, remove and destroy it */
     if (mListen && c) {
@@ -259,11 +375,9 @@ bool SocketListener::release(SocketClient* c, bool wakeup) {
         }
         pthread_mutex_unlock(&mClientsLock);
         if (ret) {
+            // The socket stays open for as long as someone holds a reference.
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, c->getSocket(), NULL);
             ret = c->decRef();
-            if (wakeup) {
-                char b = CtrlPipe_Wakeup;
-                TEMP_FAILURE_RETRY(write(mCtrlPipe[1], &b, 1));
-            }
         }
     }
     return ret;
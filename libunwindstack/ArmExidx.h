@@ -62,6 +62,7 @@ class ArmExidx {
 
   ArmStatus status() { return status_; }
   uint64_t status_address() { return status_address_; }
+  void set_status(ArmStatus status) { status_ = status; }
 
   RegsArm* regs() { return regs_; }
 
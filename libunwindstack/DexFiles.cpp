@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <unwindstack/DexFiles.h>
@@ -93,28 +94,37 @@ uint64_t DexFiles::ReadEntryPtr64(uint64_t addr) {
   return entry;
 }
 
-bool DexFiles::ReadEntry32() {
-  DEXFileEntry32 entry;
-  if (!memory_->ReadFully(entry_addr_, &entry, sizeof(entry)) || entry.dex_file == 0) {
+bool DexFiles::AddEntry(uint64_t dex_file, uint64_t next, uint64_t* addr) {
+  auto seen = entries_.find(entry_addr_);
+  if (seen != entries_.end() && seen->second == dex_file) {
+    // This entry, and all of those after it, were read by an earlier scan.
     entry_addr_ = 0;
     return false;
   }
+  entries_[entry_addr_] = dex_file;
 
-  addrs_.push_back(entry.dex_file);
-  entry_addr_ = entry.next;
+  addrs_.insert(dex_file);
+  *addr = dex_file;
+  entry_addr_ = next;
   return true;
 }
 
-bool DexFiles::ReadEntry64() {
-  DEXFileEntry64 entry;
+bool DexFiles::ReadEntry32(uint64_t* addr) {
+  DEXFileEntry32 entry;
   if (!memory_->ReadFully(entry_addr_, &entry, sizeof(entry)) || entry.dex_file == 0) {
     entry_addr_ = 0;
     return false;
   }
+  return AddEntry(entry.dex_file, entry.next, addr);
+}
 
-  addrs_.push_back(entry.dex_file);
-  entry_addr_ = entry.next;
-  return true;
+bool DexFiles::ReadEntry64(uint64_t* addr) {
+  DEXFileEntry64 entry;
+  if (!memory_->ReadFully(entry_addr_, &entry, sizeof(entry)) || entry.dex_file == 0) {
+    entry_addr_ = 0;
+    return false;
+  }
+  return AddEntry(entry.dex_file, entry.next, addr);
 }
 
 void DexFiles::Init(Maps* maps) {
@@ -149,11 +159,30 @@ void DexFiles::Init(Maps* maps) {
     // Find first non-empty list (libart might be loaded multiple times).
     if (elf->GetGlobalVariable(dex_debug_name, &ptr) && ptr != 0) {
       entry_addr_ = (this->*read_entry_ptr_func_)(ptr + info->start);
+      if (entry_addr_ != 0 || descriptor_addr_ == 0) {
+        // If no list has any entries yet, keep the first so that later scans
+        // find the entries added to it.
+        descriptor_addr_ = ptr + info->start;
+      }
       if (entry_addr_ != 0) {
         break;
       }
     }
   }
+  first_entry_ = entry_addr_;
+}
+
+bool DexFiles::Rescan() {
+  if (descriptor_addr_ == 0) {
+    return false;
+  }
+  uint64_t first_entry = (this->*read_entry_ptr_func_)(descriptor_addr_);
+  if (first_entry == first_entry_) {
+    return false;
+  }
+  first_entry_ = first_entry;
+  entry_addr_ = first_entry;
+  return entry_addr_ != 0;
 }
 
 DexFile* DexFiles::GetDexFile(uint64_t dex_file_offset, MapInfo* info) {
@@ -169,16 +198,15 @@ DexFile* DexFiles::GetDexFile(uint64_t dex_file_offset, MapInfo* info) {
   return dex_file;
 }
 
-bool DexFiles::GetAddr(size_t index, uint64_t* addr) {
-  if (index < addrs_.size()) {
-    *addr = addrs_[index];
-    return true;
-  }
-  if (entry_addr_ != 0 && (this->*read_entry_func_)()) {
-    *addr = addrs_.back();
-    return true;
+bool DexFiles::GetMethodInformation(uint64_t addr, MapInfo* info, uint64_t dex_pc,
+                                    std::string* method_name, uint64_t* method_offset) {
+  if (addr < info->start || addr >= info->end || addr > dex_pc) {
+    return false;
   }
-  return false;
+
+  DexFile* dex_file = GetDexFile(addr, info);
+  return dex_file != nullptr &&
+         dex_file->GetMethodInformation(dex_pc - addr, method_name, method_offset);
 }
 
 void DexFiles::GetMethodInformation(Maps* maps, MapInfo* info, uint64_t dex_pc,
@@ -188,17 +216,27 @@ void DexFiles::GetMethodInformation(Maps* maps, MapInfo* info, uint64_t dex_pc,
     Init(maps);
   }
 
-  size_t index = 0;
-  uint64_t addr;
-  while (GetAddr(index++, &addr)) {
-    if (addr < info->start || addr >= info->end) {
-      continue;
+  // The dex file holding dex_pc starts below it, try the closest ones first.
+  auto entry = addrs_.upper_bound(std::min(dex_pc, info->end - 1));
+  while (entry != addrs_.begin()) {
+    uint64_t addr = *--entry;
+    if (addr < info->start) {
+      break;
+    }
+    if (GetMethodInformation(addr, info, dex_pc, method_name, method_offset)) {
+      return;
     }
+  }
 
-    DexFile* dex_file = GetDexFile(addr, info);
-    if (dex_file != nullptr &&
-        dex_file->GetMethodInformation(dex_pc - addr, method_name, method_offset)) {
-      break;
+  // Only read the descriptor again when none of the dex files already known
+  // has this pc, and only read the entries added since.
+  if (entry_addr_ == 0 && !Rescan()) {
+    return;
+  }
+  uint64_t addr;
+  while (entry_addr_ != 0 && (this->*read_entry_func_)(&addr)) {
+    if (GetMethodInformation(addr, info, dex_pc, method_name, method_offset)) {
+      return;
     }
   }
 }
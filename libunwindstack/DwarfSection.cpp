@@ -14,7 +14,16 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfLocation.h>
@@ -34,8 +43,20 @@
 
 namespace unwindstack {
 
+std::string* DwarfSection::index_directory_;
+size_t DwarfSection::loc_regs_cache_size_;
+
 DwarfSection::DwarfSection(Memory* memory) : memory_(memory) {}
 
+void DwarfSection::SetIndexDirectory(const std::string& directory) {
+  delete index_directory_;
+  index_directory_ = directory.empty() ? nullptr : new std::string(directory);
+}
+
+void DwarfSection::SetLocRegsCacheSize(size_t size) {
+  loc_regs_cache_size_ = size;
+}
+
 const DwarfFde* DwarfSection::GetFdeFromPc(uint64_t pc) {
   uint64_t fde_offset;
   if (!GetFdeOffsetFromPc(pc, &fde_offset)) {
@@ -57,7 +78,8 @@ const DwarfFde* DwarfSection::GetFdeFromPc(uint64_t pc) {
 bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished) {
   // Lookup the pc in the cache.
   auto it = loc_regs_.upper_bound(pc);
-  if (it == loc_regs_.end() || pc < it->second.pc_start) {
+  if (it == loc_regs_.end() || pc < it->second.loc_regs.pc_start) {
+    loc_regs_misses_++;
     last_error_.code = DWARF_ERROR_NONE;
     const DwarfFde* fde = GetFdeFromPc(pc);
     if (fde == nullptr || fde->cie == nullptr) {
@@ -72,12 +94,27 @@ bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* f
     }
     loc_regs.cie = fde->cie;
 
-    // Store it in the cache.
-    it = loc_regs_.emplace(loc_regs.pc_end, std::move(loc_regs)).first;
+    // Store it in the cache, replacing any row that ends at the same pc.
+    it = loc_regs_.find(loc_regs.pc_end);
+    if (it != loc_regs_.end()) {
+      loc_regs_lru_.erase(it->second.lru);
+    } else {
+      if (loc_regs_cache_size_ != 0 && loc_regs_.size() >= loc_regs_cache_size_) {
+        loc_regs_.erase(loc_regs_lru_.back());
+        loc_regs_lru_.pop_back();
+      }
+      it = loc_regs_.emplace(loc_regs.pc_end, LocRegsEntry()).first;
+    }
+    it->second.loc_regs = std::move(loc_regs);
+    it->second.lru = loc_regs_lru_.insert(loc_regs_lru_.begin(), it->first);
+  } else {
+    loc_regs_hits_++;
+    loc_regs_lru_.splice(loc_regs_lru_.begin(), loc_regs_lru_, it->second.lru);
   }
 
   // Now eval the actual registers.
-  return Eval(it->second.cie, process_memory, it->second, regs, finished);
+  const dwarf_loc_regs_t& loc_regs = it->second.loc_regs;
+  return Eval(loc_regs.cie, process_memory, loc_regs, regs, finished);
 }
 
 template <typename AddressType>
@@ -610,7 +647,17 @@ bool DwarfSectionImpl<AddressType>::Init(uint64_t offset, uint64_t size) {
   memory_.set_cur_offset(offset);
   memory_.set_pc_offset(offset);
 
-  return CreateSortedFdeList();
+  std::string index_path;
+  if (index_directory_ != nullptr && GetIndexPath(&index_path) && LoadFdeIndex(index_path)) {
+    return true;
+  }
+  if (!CreateSortedFdeList()) {
+    return false;
+  }
+  if (!index_path.empty()) {
+    SaveFdeIndex(index_path);
+  }
+  return true;
 }
 
 template <typename AddressType>
@@ -866,6 +913,106 @@ bool DwarfSectionImpl<AddressType>::CreateSortedFdeList() {
   return true;
 }
 
+// Header of a saved fde index, followed by count FdeInfo entries.
+struct FdeIndexHeader {
+  static constexpr uint32_t kMagic = 0x58444e49;  // "INDX"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t address_size;
+  uint32_t cie32_value;
+  uint64_t entries_offset;
+  uint64_t entries_end;
+  uint64_t hash;
+  uint64_t count;
+};
+
+template <typename AddressType>
+bool DwarfSectionImpl<AddressType>::GetIndexPath(std::string* path) {
+  // The pcs in an .eh_frame are relative to where the section is, so the
+  // offset is part of the key as well as the contents.
+  uint64_t hash = 0xcbf29ce484222325ULL ^ entries_offset_ ^ (sizeof(AddressType) << 56);
+  constexpr uint64_t kPrime = 0x100000001b3ULL;
+  std::vector<uint8_t> buffer(64 * 1024);
+  for (uint64_t offset = entries_offset_; offset < entries_end_;) {
+    size_t bytes = std::min(static_cast<uint64_t>(buffer.size()), entries_end_ - offset);
+    memory_.set_cur_offset(offset);
+    if (!memory_.ReadBytes(buffer.data(), bytes)) {
+      return false;
+    }
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, &buffer[i], sizeof(word));
+      hash = (hash ^ word) * kPrime;
+      hash ^= hash >> 29;
+    }
+    for (; i < bytes; i++) {
+      hash = (hash ^ buffer[i]) * kPrime;
+    }
+    offset += bytes;
+  }
+  hash_ = hash ^ (entries_end_ - entries_offset_);
+  *path = android::base::StringPrintf("%s/fde_index_%016" PRIx64, index_directory_->c_str(), hash_);
+  return true;
+}
+
+template <typename AddressType>
+bool DwarfSectionImpl<AddressType>::LoadFdeIndex(const std::string& path) {
+  std::string data;
+  if (!android::base::ReadFileToString(path, &data) || data.size() < sizeof(FdeIndexHeader)) {
+    return false;
+  }
+  FdeIndexHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != FdeIndexHeader::kMagic || header.version != FdeIndexHeader::kVersion ||
+      header.address_size != sizeof(AddressType) || header.cie32_value != cie32_value_ ||
+      header.entries_offset != entries_offset_ || header.entries_end != entries_end_ ||
+      header.hash != hash_ || header.count > (data.size() - sizeof(header)) / sizeof(FdeInfo) ||
+      data.size() != sizeof(header) + header.count * sizeof(FdeInfo)) {
+    return false;
+  }
+
+  std::vector<FdeInfo> fdes;
+  fdes.reserve(header.count);
+  const char* entry = &data[sizeof(header)];
+  for (uint64_t i = 0; i < header.count; i++, entry += sizeof(FdeInfo)) {
+    FdeInfo info(0, 0, 0);
+    memcpy(&info, entry, sizeof(info));
+    // Every lookup trusts these, so don't take anything out of order.
+    if (info.offset < entries_offset_ || info.offset >= entries_end_ || info.start > info.end ||
+        (!fdes.empty() && info.start < fdes.back().start)) {
+      return false;
+    }
+    fdes.push_back(info);
+  }
+  fdes_.swap(fdes);
+  fde_count_ = fdes_.size();
+  return true;
+}
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::SaveFdeIndex(const std::string& path) {
+  FdeIndexHeader header{};
+  header.magic = FdeIndexHeader::kMagic;
+  header.version = FdeIndexHeader::kVersion;
+  header.address_size = sizeof(AddressType);
+  header.cie32_value = cie32_value_;
+  header.entries_offset = entries_offset_;
+  header.entries_end = entries_end_;
+  header.hash = hash_;
+  header.count = fdes_.size();
+
+  std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+  data.append(reinterpret_cast<const char*>(fdes_.data()), fdes_.size() * sizeof(FdeInfo));
+  // Write and rename so that a reader never sees a partial index.
+  std::string tmp_path(path + android::base::StringPrintf(".%d", getpid()));
+  if (!android::base::WriteStringToFile(data, tmp_path) || rename(tmp_path.c_str(), path.c_str())) {
+    unlink(tmp_path.c_str());
+  }
+}
+
 template <typename AddressType>
 bool DwarfSectionImpl<AddressType>::GetFdeOffsetFromPc(uint64_t pc, uint64_t* fde_offset) {
   if (fde_count_ == 0) {
@@ -17,9 +17,12 @@
 #include <elf.h>
 #include <string.h>
 
+#include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 
 #define LOG_TAG "unwind"
@@ -36,9 +39,100 @@
 
 namespace unwindstack {
 
+// The cache is split in shards by file name, so that threads getting different files don't wait
+// on each other. All the entries of a file, whatever their offset, are in the same shard, which
+// gets an equal part of the cache limit.
+static constexpr size_t kCacheShards = 16;
+
+struct ElfCacheShard {
+  struct Entry {
+    std::shared_ptr<Elf> elf;
+    // Whether elf_offset should be set to offset when getting out of the cache.
+    bool set_elf_offset;
+    std::list<std::string>::iterator lru;
+  };
+
+  // Entries of a file at several offsets can share an elf object, which is only counted once.
+  struct Usage {
+    size_t entries;
+    uint64_t bytes;
+  };
+
+  void Put(const std::string& key, const std::shared_ptr<Elf>& elf, bool set_elf_offset);
+  Entry* Get(const std::string& key);
+  void Erase(std::unordered_map<std::string, Entry>::iterator it);
+  void Trim(uint64_t limit, Elf* keep);
+
+  std::mutex lock;
+  std::unordered_map<std::string, Entry> entries;
+  std::list<std::string> lru;  // Keys of entries, most recent first.
+  std::unordered_map<Elf*, Usage> usage;
+  uint64_t bytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+};
+
+void ElfCacheShard::Put(const std::string& key, const std::shared_ptr<Elf>& elf,
+                        bool set_elf_offset) {
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    if (it->second.elf == elf) {
+      it->second.set_elf_offset = set_elf_offset;
+      lru.splice(lru.begin(), lru, it->second.lru);
+      return;
+    }
+    Erase(it);
+  }
+
+  lru.push_front(key);
+  entries[key] = Entry{elf, set_elf_offset, lru.begin()};
+  Usage& elf_usage = usage[elf.get()];
+  if (elf_usage.entries++ == 0) {
+    elf_usage.bytes = elf->CacheFootprint();
+    bytes += elf_usage.bytes;
+  }
+}
+
+ElfCacheShard::Entry* ElfCacheShard::Get(const std::string& key) {
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return nullptr;
+  }
+  lru.splice(lru.begin(), lru, it->second.lru);
+  return &it->second;
+}
+
+void ElfCacheShard::Erase(std::unordered_map<std::string, Entry>::iterator it) {
+  auto elf_usage = usage.find(it->second.elf.get());
+  if (--elf_usage->second.entries == 0) {
+    bytes -= elf_usage->second.bytes;
+    usage.erase(elf_usage);
+  }
+  lru.erase(it->second.lru);
+  entries.erase(it);
+}
+
+// Evicts the least recently used entries until the shard is within |limit|, but never those of
+// |keep|, which were just added.
+void ElfCacheShard::Trim(uint64_t limit, Elf* keep) {
+  while (bytes > limit && !lru.empty()) {
+    auto it = entries.find(lru.back());
+    if (it->second.elf.get() == keep) {
+      break;
+    }
+    Erase(it);
+    evictions++;
+  }
+}
+
+static ElfCacheShard* GetCacheShard(ElfCacheShard* shards, const std::string& name) {
+  return &shards[std::hash<std::string>()(name) % kCacheShards];
+}
+
 bool Elf::cache_enabled_;
-std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>* Elf::cache_;
-std::mutex* Elf::cache_lock_;
+uint64_t Elf::cache_limit_;
+ElfCacheShard* Elf::cache_;
 
 bool Elf::Init(bool init_gnu_debugdata) {
   load_bias_ = 0;
@@ -309,21 +403,51 @@ uint64_t Elf::GetLoadBias(Memory* memory) {
 void Elf::SetCachingEnabled(bool enable) {
   if (!cache_enabled_ && enable) {
     cache_enabled_ = true;
-    cache_ = new std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>;
-    cache_lock_ = new std::mutex;
+    cache_ = new ElfCacheShard[kCacheShards];
   } else if (cache_enabled_ && !enable) {
     cache_enabled_ = false;
-    delete cache_;
-    delete cache_lock_;
+    delete[] cache_;
+  }
+}
+
+void Elf::SetCacheLimit(uint64_t bytes) {
+  cache_limit_ = bytes;
+}
+
+Elf::CacheStats Elf::GetCacheStats() {
+  CacheStats stats;
+  if (!cache_enabled_) {
+    return stats;
+  }
+  for (size_t i = 0; i < kCacheShards; i++) {
+    ElfCacheShard* shard = &cache_[i];
+    std::lock_guard<std::mutex> guard(shard->lock);
+    stats.hits += shard->hits;
+    stats.misses += shard->misses;
+    stats.evictions += shard->evictions;
+    stats.entries += shard->entries.size();
+    stats.elfs += shard->usage.size();
+    stats.bytes += shard->bytes;
+  }
+  return stats;
+}
+
+// The headers, interfaces and the caches they fill as pcs get looked up, plus the decompressed
+// .gnu_debugdata section, which usually is a few times the size of the compressed one.
+uint64_t Elf::CacheFootprint() {
+  uint64_t bytes = 16 * 1024;
+  if (gnu_debugdata_interface_ != nullptr) {
+    bytes += 4 * interface_->gnu_debugdata_size();
   }
+  return bytes;
 }
 
-void Elf::CacheLock() {
-  cache_lock_->lock();
+void Elf::CacheLock(MapInfo* info) {
+  GetCacheShard(cache_, info->name)->lock.lock();
 }
 
-void Elf::CacheUnlock() {
-  cache_lock_->unlock();
+void Elf::CacheUnlock(MapInfo* info) {
+  GetCacheShard(cache_, info->name)->lock.unlock();
 }
 
 void Elf::CacheAdd(MapInfo* info) {
@@ -333,16 +457,20 @@ void Elf::CacheAdd(MapInfo* info) {
   // For example, if there are two maps boot.odex:1000 and boot.odex:2000
   // where each reference the entire boot.odex, the cache will properly
   // use the same cached elf object.
+  ElfCacheShard* shard = GetCacheShard(cache_, info->name);
+  shard->misses++;
 
   if (info->offset == 0 || info->elf_offset != 0) {
-    (*cache_)[info->name] = std::make_pair(info->elf, true);
+    shard->Put(info->name, info->elf, true);
   }
 
   if (info->offset != 0) {
-    // The second element in the pair indicates whether elf_offset should
-    // be set to offset when getting out of the cache.
-    (*cache_)[info->name + ':' + std::to_string(info->offset)] =
-        std::make_pair(info->elf, info->elf_offset != 0);
+    shard->Put(info->name + ':' + std::to_string(info->offset), info->elf,
+               info->elf_offset != 0);
+  }
+
+  if (cache_limit_ != 0) {
+    shard->Trim(cache_limit_ / kCacheShards, info->elf.get());
   }
 }
 
@@ -351,16 +479,18 @@ bool Elf::CacheAfterCreateMemory(MapInfo* info) {
     return false;
   }
 
-  auto entry = cache_->find(info->name);
-  if (entry == cache_->end()) {
+  ElfCacheShard* shard = GetCacheShard(cache_, info->name);
+  ElfCacheShard::Entry* entry = shard->Get(info->name);
+  if (entry == nullptr) {
     return false;
   }
 
   // In this case, the whole file is the elf, and the name has already
   // been cached. Add an entry at name:offset to get this directly out
   // of the cache next time.
-  info->elf = entry->second.first;
-  (*cache_)[info->name + ':' + std::to_string(info->offset)] = std::make_pair(info->elf, true);
+  info->elf = entry->elf;
+  shard->Put(info->name + ':' + std::to_string(info->offset), info->elf, true);
+  shard->hits++;
   return true;
 }
 
@@ -369,12 +499,14 @@ bool Elf::CacheGet(MapInfo* info) {
   if (info->offset != 0) {
     name += ':' + std::to_string(info->offset);
   }
-  auto entry = cache_->find(name);
-  if (entry != cache_->end()) {
-    info->elf = entry->second.first;
-    if (entry->second.second) {
+  ElfCacheShard* shard = GetCacheShard(cache_, info->name);
+  ElfCacheShard::Entry* entry = shard->Get(name);
+  if (entry != nullptr) {
+    info->elf = entry->elf;
+    if (entry->set_elf_offset) {
       info->elf_offset = info->offset;
     }
+    shard->hits++;
     return true;
   }
   return false;
@@ -14,12 +14,25 @@
  * limitations under the License.
  */
 
+#include <dirent.h>
 #include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 
 #include <7zCrc.h>
 #include <Xz.h>
@@ -69,6 +82,132 @@ bool ElfInterface::IsValidPc(uint64_t pc) {
   return false;
 }
 
+std::string* ElfInterface::gnu_debugdata_cache_directory_;
+uint64_t ElfInterface::gnu_debugdata_cache_max_size_;
+
+static constexpr const char kGnuDebugdataCachePrefix[] = "gnu_debugdata_";
+
+struct GnuDebugdataCacheHeader {
+  static constexpr uint32_t kMagic = 0x64677564;  // "dugd"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint64_t compressed_size;
+  uint64_t size;
+};
+
+void ElfInterface::SetGnuDebugdataCache(const std::string& directory, uint64_t max_size) {
+  delete gnu_debugdata_cache_directory_;
+  gnu_debugdata_cache_directory_ = directory.empty() ? nullptr : new std::string(directory);
+  gnu_debugdata_cache_max_size_ = max_size;
+}
+
+static uint64_t HashGnuDebugdata(const std::vector<uint8_t>& data) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  constexpr uint64_t kPrime = 0x100000001b3ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, &data[i], sizeof(word));
+    hash = (hash ^ word) * kPrime;
+    hash ^= hash >> 29;
+  }
+  for (; i < data.size(); i++) {
+    hash = (hash ^ data[i]) * kPrime;
+  }
+  return hash ^ data.size();
+}
+
+static Memory* LoadCachedGnuDebugdata(const std::string& path, uint64_t hash,
+                                      uint64_t compressed_size) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return nullptr;
+  }
+  GnuDebugdataCacheHeader header;
+  struct stat st;
+  if (!android::base::ReadFully(fd, &header, sizeof(header)) || fstat(fd, &st) == -1 ||
+      header.magic != GnuDebugdataCacheHeader::kMagic ||
+      header.version != GnuDebugdataCacheHeader::kVersion || header.hash != hash ||
+      header.compressed_size != compressed_size || header.size == 0 ||
+      static_cast<uint64_t>(st.st_size) != sizeof(header) + header.size) {
+    return nullptr;
+  }
+
+  std::unique_ptr<MemoryFileAtOffset> memory(new MemoryFileAtOffset);
+  if (!memory->Init(path, sizeof(header), header.size) || memory->Size() != header.size) {
+    return nullptr;
+  }
+  // Mark it as recently used.
+  futimens(fd, nullptr);
+  return memory.release();
+}
+
+// Removes the least recently used files until the cache fits in max_size,
+// never the one just written.
+static void TrimGnuDebugdataCache(const std::string& directory, const std::string& keep,
+                                  uint64_t max_size) {
+  std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(directory.c_str()), closedir);
+  if (dir == nullptr) {
+    return;
+  }
+  std::vector<std::pair<struct timespec, std::string>> files;
+  uint64_t total = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir.get())) != nullptr) {
+    if (strncmp(entry->d_name, kGnuDebugdataCachePrefix, sizeof(kGnuDebugdataCachePrefix) - 1)) {
+      continue;
+    }
+    std::string path(directory + '/' + entry->d_name);
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    total += st.st_size;
+    if (path != keep) {
+      files.emplace_back(st.st_mtim, path);
+    }
+  }
+  std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+    return a.first.tv_sec < b.first.tv_sec ||
+           (a.first.tv_sec == b.first.tv_sec && a.first.tv_nsec < b.first.tv_nsec);
+  });
+  for (const auto& file : files) {
+    if (total <= max_size) {
+      break;
+    }
+    struct stat st;
+    if (stat(file.second.c_str(), &st) == 0 && unlink(file.second.c_str()) == 0) {
+      total -= std::min(total, static_cast<uint64_t>(st.st_size));
+    }
+  }
+}
+
+static void SaveCachedGnuDebugdata(const std::string& path, uint64_t hash,
+                                   uint64_t compressed_size, MemoryBuffer* memory) {
+  GnuDebugdataCacheHeader header{};
+  header.magic = GnuDebugdataCacheHeader::kMagic;
+  header.version = GnuDebugdataCacheHeader::kVersion;
+  header.hash = hash;
+  header.compressed_size = compressed_size;
+  header.size = memory->Size();
+
+  // Write and rename so that a reader never sees a partial file.
+  std::string tmp_path(path + android::base::StringPrintf(".%d", getpid()));
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+      open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+  if (fd == -1) {
+    return;
+  }
+  if (!android::base::WriteFully(fd, &header, sizeof(header)) ||
+      !android::base::WriteFully(fd, memory->GetPtr(0), memory->Size()) ||
+      rename(tmp_path.c_str(), path.c_str())) {
+    unlink(tmp_path.c_str());
+  }
+}
+
 Memory* ElfInterface::CreateGnuDebugdataMemory() {
   if (gnu_debugdata_offset_ == 0 || gnu_debugdata_size_ == 0) {
     return nullptr;
@@ -85,6 +224,19 @@ Memory* ElfInterface::CreateGnuDebugdataMemory() {
     return nullptr;
   }
 
+  std::string cache_path;
+  uint64_t hash = 0;
+  if (gnu_debugdata_cache_directory_ != nullptr) {
+    hash = HashGnuDebugdata(src);
+    cache_path = android::base::StringPrintf("%s/%s%016" PRIx64,
+                                             gnu_debugdata_cache_directory_->c_str(),
+                                             kGnuDebugdataCachePrefix, hash);
+    Memory* cached = LoadCachedGnuDebugdata(cache_path, hash, src.size());
+    if (cached != nullptr) {
+      return cached;
+    }
+  }
+
   ISzAlloc alloc;
   CXzUnpacker state;
   alloc.Alloc = [](void*, size_t size) { return malloc(size); };
@@ -120,6 +272,14 @@ Memory* ElfInterface::CreateGnuDebugdataMemory() {
   // Shrink back down to the exact size.
   dst->Resize(dst_offset);
 
+  if (!cache_path.empty() && dst->Size() != 0) {
+    SaveCachedGnuDebugdata(cache_path, hash, src.size(), dst.get());
+    if (gnu_debugdata_cache_max_size_ != 0) {
+      TrimGnuDebugdataCache(*gnu_debugdata_cache_directory_, cache_path,
+                            gnu_debugdata_cache_max_size_);
+    }
+  }
+
   return dst.release();
 }
 
@@ -17,6 +17,8 @@
 #include <elf.h>
 #include <stdint.h>
 
+#include <algorithm>
+
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/RegsArm.h>
@@ -36,12 +38,9 @@ bool ElfInterfaceArm::FindEntry(uint32_t pc, uint64_t* entry_offset) {
   size_t last = total_entries_;
   while (first < last) {
     size_t current = (first + last) / 2;
-    uint32_t addr = addrs_[current];
-    if (addr == 0) {
-      if (!GetPrel31Addr(start_offset_ + current * 8, &addr)) {
-        return false;
-      }
-      addrs_[current] = addr;
+    uint32_t addr;
+    if (!GetEntryAddr(current, &addr)) {
+      return false;
     }
     if (pc == addr) {
       *entry_offset = start_offset_ + current * 8;
@@ -75,6 +74,76 @@ bool ElfInterfaceArm::GetPrel31Addr(uint32_t offset, uint32_t* addr) {
   return true;
 }
 
+void ElfInterfaceArm::ReadIndex() {
+  index_read_ = true;
+  if (start_offset_ == 0 || total_entries_ == 0) {
+    return;
+  }
+
+  // Don't allocate for a table that isn't really there.
+  uint32_t data;
+  if (!memory_->Read32(start_offset_ + (total_entries_ - 1) * 8, &data)) {
+    return;
+  }
+
+  // Each entry is a prel31 pc followed by a word of unwind data.
+  constexpr size_t kEntriesPerRead = 512;
+  uint32_t buffer[kEntriesPerRead * 2];
+  std::vector<uint32_t> index(total_entries_);
+  for (size_t i = 0; i < total_entries_; i += kEntriesPerRead) {
+    size_t entries = std::min(kEntriesPerRead, total_entries_ - i);
+    uint32_t offset = start_offset_ + i * 8;
+    if (!memory_->ReadFully(offset, buffer, entries * 8)) {
+      return;
+    }
+    for (size_t j = 0; j < entries; j++, offset += 8) {
+      // Sign extend the value if necessary.
+      int32_t value = (static_cast<int32_t>(buffer[j * 2]) << 1) >> 1;
+      index[i + j] = offset + value;
+    }
+  }
+  index_ = std::move(index);
+}
+
+bool ElfInterfaceArm::GetEntryAddr(size_t index, uint32_t* addr) {
+  if (!index_read_) {
+    ReadIndex();
+  }
+  if (!index_.empty()) {
+    *addr = index_[index];
+    return true;
+  }
+
+  *addr = addrs_[index];
+  if (*addr == 0) {
+    if (!GetPrel31Addr(start_offset_ + index * 8, addr)) {
+      return false;
+    }
+    addrs_[index] = *addr;
+  }
+  return true;
+}
+
+bool ElfInterfaceArm::ExtractEntryData(uint64_t entry_offset, ArmExidx* arm) {
+  auto entry = entry_data_.find(entry_offset);
+  if (entry == entry_data_.end()) {
+    bool extracted = arm->ExtractEntryData(entry_offset);
+    // Failures other than a cant unwind entry are not kept, they are rare
+    // and a read that failed might work the next time.
+    if (extracted || arm->status() == ARM_STATUS_NO_UNWIND) {
+      EntryData& data = entry_data_[entry_offset];
+      data.status = arm->status();
+      data.data.assign(arm->data()->begin(), arm->data()->end());
+    }
+    return extracted;
+  }
+
+  const EntryData& data = entry->second;
+  arm->data()->assign(data.data.begin(), data.data.end());
+  arm->set_status(data.status);
+  return data.status == ARM_STATUS_NONE;
+}
+
 #if !defined(PT_ARM_EXIDX)
 #define PT_ARM_EXIDX 0x70000001
 #endif
@@ -93,6 +162,10 @@ bool ElfInterfaceArm::HandleType(uint64_t offset, uint32_t type, uint64_t load_b
   }
   start_offset_ = phdr.p_vaddr - load_bias;
   total_entries_ = phdr.p_memsz / 8;
+  index_read_ = false;
+  index_.clear();
+  addrs_.clear();
+  entry_data_.clear();
   return true;
 }
 
@@ -124,7 +197,7 @@ bool ElfInterfaceArm::StepExidx(uint64_t pc, uint64_t load_bias, Regs* regs, Mem
   ArmExidx arm(regs_arm, memory_, process_memory);
   arm.set_cfa(regs_arm->sp());
   bool return_value = false;
-  if (arm.ExtractEntryData(entry_offset) && arm.Eval()) {
+  if (ExtractEntryData(entry_offset, &arm) && arm.Eval()) {
     // If the pc was not set, then use the LR registers for the PC.
     if (!arm.pc_set()) {
       (*regs_arm)[ARM_REG_PC] = (*regs_arm)[ARM_REG_LR];
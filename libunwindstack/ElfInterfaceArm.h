@@ -22,10 +22,13 @@
 
 #include <iterator>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
 
+#include "ArmExidx.h"
+
 namespace unwindstack {
 
 class ElfInterfaceArm : public ElfInterface32 {
@@ -46,12 +49,9 @@ class ElfInterfaceArm : public ElfInterface32 {
     bool operator!=(const iterator& rhs) { return this->index_ != rhs.index_; }
 
     uint32_t operator*() {
-      uint32_t addr = interface_->addrs_[index_];
-      if (addr == 0) {
-        if (!interface_->GetPrel31Addr(interface_->start_offset_ + index_ * 8, &addr)) {
-          return 0;
-        }
-        interface_->addrs_[index_] = addr;
+      uint32_t addr;
+      if (!interface_->GetEntryAddr(index_, &addr)) {
+        return 0;
       }
       return addr;
     }
@@ -66,6 +66,9 @@ class ElfInterfaceArm : public ElfInterface32 {
 
   bool GetPrel31Addr(uint32_t offset, uint32_t* addr);
 
+  // Returns the pc of the entry at index in the exidx table.
+  bool GetEntryAddr(size_t index, uint32_t* addr);
+
   bool FindEntry(uint32_t pc, uint64_t* entry_offset);
 
   bool HandleType(uint64_t offset, uint32_t type, uint64_t load_bias) override;
@@ -76,6 +79,10 @@ class ElfInterfaceArm : public ElfInterface32 {
   bool StepExidx(uint64_t pc, uint64_t load_bias, Regs* regs, Memory* process_memory,
                  bool* finished);
 
+  // Same as arm->ExtractEntryData(entry_offset), but the unwind data is
+  // kept so later calls for the entry are served without reading memory.
+  bool ExtractEntryData(uint64_t entry_offset, ArmExidx* arm);
+
   bool GetFunctionName(uint64_t addr, uint64_t load_bias, std::string* name,
                        uint64_t* offset) override;
 
@@ -87,7 +94,18 @@ class ElfInterfaceArm : public ElfInterface32 {
   uint64_t start_offset_ = 0;
   size_t total_entries_ = 0;
 
+  // The pcs of the whole table, read in one go on first use. If that
+  // fails, entries are read one at a time into addrs_ instead.
+  void ReadIndex();
+  bool index_read_ = false;
+  std::vector<uint32_t> index_;
   std::unordered_map<size_t, uint32_t> addrs_;
+
+  struct EntryData {
+    ArmStatus status;
+    std::vector<uint8_t> data;
+  };
+  std::unordered_map<uint64_t, EntryData> entry_data_;
 };
 
 }  // namespace unwindstack
@@ -17,16 +17,25 @@
 #include <stdint.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/DwarfStructs.h>
 #include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
 #include <unwindstack/JitDebug.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 
 // This implements the JIT Compilation Interface.
 // See https://sourceware.org/gdb/onlinedocs/gdb/JIT-Interface.html
+//
+// Entries are added at the start of the list, so once all of them have been
+// read, only those before the first entry already read need to be read to
+// catch up with the process. The descriptor is read again only when a pc is
+// not found in any of the elfs created so far.
 
 namespace unwindstack {
 
@@ -198,11 +207,105 @@ void JitDebug::Init(Maps* maps) {
       // Search for the first non-zero entry.
       descriptor_addr += info->start;
       entry_addr_ = (this->*read_descriptor_func_)(descriptor_addr);
+      if (entry_addr_ != 0 || descriptor_addr_ == 0) {
+        // If no descriptor has any entries yet, keep the first so that later
+        // scans find the entries added to it.
+        descriptor_addr_ = descriptor_addr;
+      }
       if (entry_addr_ != 0) {
         break;
       }
     }
   }
+  first_entry_ = entry_addr_;
+}
+
+bool JitDebug::Rescan() {
+  if (descriptor_addr_ == 0) {
+    return false;
+  }
+  uint64_t first_entry = (this->*read_descriptor_func_)(descriptor_addr_);
+  if (first_entry == first_entry_) {
+    return false;
+  }
+  first_entry_ = first_entry;
+  entry_addr_ = first_entry;
+  scan_++;
+  return entry_addr_ != 0;
+}
+
+static void AddPcRange(ElfInterface* interface, uint64_t* start, uint64_t* end) {
+  if (interface == nullptr) {
+    return;
+  }
+
+  // Same as ElfInterface::IsValidPc, the PT_LOAD data takes precedence.
+  if (!interface->pt_loads().empty()) {
+    for (auto& entry : interface->pt_loads()) {
+      *start = std::min(*start, entry.second.table_offset);
+      *end = std::max(*end, entry.second.table_offset + entry.second.table_size);
+    }
+    return;
+  }
+
+  for (DwarfSection* section : {interface->debug_frame(), interface->eh_frame()}) {
+    if (section == nullptr) {
+      continue;
+    }
+    for (const DwarfFde* fde : *section) {
+      if (fde != nullptr && fde->pc_start < fde->pc_end) {
+        *start = std::min(*start, fde->pc_start);
+        *end = std::max(*end, fde->pc_end);
+      }
+    }
+  }
+}
+
+void JitDebug::AddElf(Elf* elf) {
+  uint64_t start = UINT64_MAX;
+  uint64_t end = 0;
+  AddPcRange(elf->interface(), &start, &end);
+  AddPcRange(elf->gnu_debugdata_interface(), &start, &end);
+  if (start >= end) {
+    unranged_elfs_.push_back(elf);
+    return;
+  }
+  start += elf->GetLoadBias();
+  end += elf->GetLoadBias();
+
+  // When code is freed and its memory reused, the entry of the new code is
+  // newer than the one of the old code. A scan reads the newest entries
+  // first, so within a scan the range already indexed wins, otherwise the new
+  // one replaces it.
+  auto first = elf_ranges_.lower_bound(start);
+  if (first != elf_ranges_.begin() && std::prev(first)->second.end > start) {
+    --first;
+  }
+  auto last = first;
+  for (; last != elf_ranges_.end() && last->first < end; ++last) {
+    if (last->second.scan == scan_) {
+      return;
+    }
+  }
+  elf_ranges_.erase(first, last);
+  elf_ranges_[start] = ElfRange{end, elf, scan_};
+}
+
+Elf* JitDebug::FindElf(uint64_t pc) {
+  auto entry = elf_ranges_.upper_bound(pc);
+  if (entry != elf_ranges_.begin()) {
+    --entry;
+    if (pc < entry->second.end && entry->second.elf->IsValidPc(pc)) {
+      return entry->second.elf;
+    }
+  }
+
+  for (Elf* elf : unranged_elfs_) {
+    if (elf->IsValidPc(pc)) {
+      return elf;
+    }
+  }
+  return nullptr;
 }
 
 Elf* JitDebug::GetElf(Maps* maps, uint64_t pc) {
@@ -214,18 +317,30 @@ Elf* JitDebug::GetElf(Maps* maps, uint64_t pc) {
   }
 
   // Search the existing elf object first.
-  for (Elf* elf : elf_list_) {
-    if (elf->IsValidPc(pc)) {
-      return elf;
-    }
+  Elf* elf = FindElf(pc);
+  if (elf != nullptr) {
+    return elf;
+  }
+
+  if (entry_addr_ == 0 && !Rescan()) {
+    return nullptr;
   }
 
   while (entry_addr_ != 0) {
-    uint64_t start;
-    uint64_t size;
+    uint64_t start = 0;
+    uint64_t size = 0;
+    uint64_t entry_addr = entry_addr_;
     entry_addr_ = (this->*read_entry_func_)(&start, &size);
 
-    Elf* elf = new Elf(new MemoryRange(memory_, start, size, 0));
+    auto seen = entries_.find(entry_addr);
+    if (seen != entries_.end() && seen->second == start) {
+      // This entry, and all of those after it, were read by an earlier scan.
+      entry_addr_ = 0;
+      break;
+    }
+    entries_[entry_addr] = start;
+
+    elf = new Elf(new MemoryRange(memory_, start, size, 0));
     elf->Init(true);
     if (!elf->valid()) {
       // The data is not formatted in a way we understand, do not attempt
@@ -235,6 +350,7 @@ Elf* JitDebug::GetElf(Maps* maps, uint64_t pc) {
       return nullptr;
     }
     elf_list_.push_back(elf);
+    AddElf(elf);
 
     if (elf->IsValidPc(pc)) {
       return elf;
@@ -115,10 +115,10 @@ Elf* MapInfo::GetElf(const std::shared_ptr<Memory>& process_memory, bool init_gn
 
   bool locked = false;
   if (Elf::CachingEnabled() && !name.empty()) {
-    Elf::CacheLock();
+    Elf::CacheLock(this);
     locked = true;
     if (Elf::CacheGet(this)) {
-      Elf::CacheUnlock();
+      Elf::CacheUnlock(this);
       return elf.get();
     }
   }
@@ -127,7 +127,7 @@ Elf* MapInfo::GetElf(const std::shared_ptr<Memory>& process_memory, bool init_gn
   if (locked) {
     if (Elf::CacheAfterCreateMemory(this)) {
       delete memory;
-      Elf::CacheUnlock();
+      Elf::CacheUnlock(this);
       return elf.get();
     }
   }
@@ -138,11 +138,21 @@ Elf* MapInfo::GetElf(const std::shared_ptr<Memory>& process_memory, bool init_gn
 
   if (locked) {
     Elf::CacheAdd(this);
-    Elf::CacheUnlock();
+    Elf::CacheUnlock(this);
   }
   return elf.get();
 }
 
+void MapInfo::ShareElf(MapInfo* other) {
+  std::lock_guard<std::mutex> guard(other->mutex_);
+  if (other->elf == nullptr) {
+    return;
+  }
+  elf = other->elf;
+  elf_offset = other->elf_offset;
+  load_bias = other->load_bias.load();
+}
+
 uint64_t MapInfo::GetLoadBias(const std::shared_ptr<Memory>& process_memory) {
   uint64_t cur_load_bias = load_bias.load();
   if (cur_load_bias != static_cast<uint64_t>(-1)) {
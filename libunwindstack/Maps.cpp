@@ -202,6 +202,50 @@ bool Maps::Parse() {
   return return_value;
 }
 
+static bool SameMap(const MapInfo* a, const MapInfo* b) {
+  return a->start == b->start && a->end == b->end && a->offset == b->offset &&
+         a->flags == b->flags && a->name == b->name;
+}
+
+bool Maps::Reparse(std::vector<MapInfo*>* added, std::vector<std::unique_ptr<MapInfo>>* removed) {
+  std::vector<MapInfo*> old_maps;
+  old_maps.swap(maps_);
+  if (!Parse()) {
+    for (auto& map : maps_) {
+      delete map;
+    }
+    maps_.swap(old_maps);
+    return false;
+  }
+
+  // Both lists are sorted by address, so walk them together.
+  auto old_map = old_maps.begin();
+  for (auto& map : maps_) {
+    while (old_map != old_maps.end() && (*old_map)->start < map->start) {
+      if (removed != nullptr) {
+        removed->emplace_back(*old_map);
+      } else {
+        delete *old_map;
+      }
+      ++old_map;
+    }
+    if (old_map != old_maps.end() && SameMap(*old_map, map)) {
+      delete map;
+      map = *old_map++;
+    } else if (added != nullptr) {
+      added->push_back(map);
+    }
+  }
+  for (; old_map != old_maps.end(); ++old_map) {
+    if (removed != nullptr) {
+      removed->emplace_back(*old_map);
+    } else {
+      delete *old_map;
+    }
+  }
+  return true;
+}
+
 void Maps::Add(uint64_t start, uint64_t end, uint64_t offset, uint64_t flags,
                const std::string& name, uint64_t load_bias) {
   MapInfo* map_info = new MapInfo(start, end, offset, flags, name);
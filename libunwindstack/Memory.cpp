@@ -174,6 +174,13 @@ std::shared_ptr<Memory> Memory::CreateProcessMemory(pid_t pid) {
   return std::shared_ptr<Memory>(new MemoryRemote(pid));
 }
 
+std::shared_ptr<Memory> Memory::CreateProcessMemoryCached(pid_t pid) {
+  if (pid == getpid()) {
+    return std::shared_ptr<Memory>(new MemoryLocal());
+  }
+  return std::shared_ptr<Memory>(new MemoryCache(new MemoryRemote(pid)));
+}
+
 size_t MemoryBuffer::Read(uint64_t addr, void* dst, size_t size) {
   if (addr >= raw_.size()) {
     return 0;
@@ -289,6 +296,60 @@ size_t MemoryRemote::Read(uint64_t addr, void* dst, size_t size) {
   }
 }
 
+// Returns the cached copy of the page, reading it in if need be, or nullptr
+// if the whole page can't be read.
+uint8_t* MemoryCache::GetPage(uint64_t page) {
+  auto entry = cache_.find(page);
+  if (entry != cache_.end()) {
+    return entry->second;
+  }
+  uint8_t* data = cache_[page];
+  if (!impl_->ReadFully(page << kCacheBits, data, kCacheSize)) {
+    cache_.erase(page);
+    return nullptr;
+  }
+  return data;
+}
+
+size_t MemoryCache::Read(uint64_t addr, void* dst, size_t size) {
+  if (size > kMaxCachedRead) {
+    return impl_->Read(addr, dst, size);
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  uint64_t page = addr >> kCacheBits;
+  uint8_t* data = GetPage(page);
+  if (data == nullptr) {
+    // Part of the page may still be readable, e.g. the end of a stack.
+    return impl_->Read(addr, dst, size);
+  }
+
+  size_t in_page = kCacheSize - (addr & kCacheMask);
+  if (size <= in_page) {
+    memcpy(dst, &data[addr & kCacheMask], size);
+    return size;
+  }
+
+  // A small read can only run into the next page.
+  memcpy(dst, &data[addr & kCacheMask], in_page);
+  dst = &reinterpret_cast<uint8_t*>(dst)[in_page];
+  if (page == (UINT64_MAX >> kCacheBits)) {
+    return in_page;
+  }
+  page++;
+  data = GetPage(page);
+  if (data == nullptr) {
+    return in_page + impl_->Read(page << kCacheBits, dst, size - in_page);
+  }
+  memcpy(dst, data, size - in_page);
+  return size;
+}
+
+void MemoryCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  cache_.clear();
+}
+
 size_t MemoryLocal::Read(uint64_t addr, void* dst, size_t size) {
   return ProcessVmRead(getpid(), addr, dst, size);
 }
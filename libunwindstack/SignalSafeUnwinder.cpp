@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/DwarfStructs.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/SignalSafeUnwinder.h>
+
+namespace unwindstack {
+
+// Registers are copied to the stack while stepping.
+static constexpr size_t kMaxRegs = 64;
+
+void SignalSafeUnwinder::AddSection(DwarfSection* section, uint64_t load_bias,
+                                    std::map<uint64_t, Row>* rows) {
+  if (section == nullptr) {
+    return;
+  }
+
+  for (const DwarfFde* fde : *section) {
+    if (fde == nullptr || fde->cie == nullptr) {
+      continue;
+    }
+
+    uint64_t pc = fde->pc_start;
+    while (pc < fde->pc_end) {
+      dwarf_loc_regs_t loc_regs;
+      if (!section->GetCfaLocationInfo(pc, fde, &loc_regs) || loc_regs.pc_end <= pc) {
+        break;
+      }
+      pc = loc_regs.pc_end;
+
+      Row row{.pc_start = loc_regs.pc_start + load_bias,
+              .pc_end = loc_regs.pc_end + load_bias,
+              .first_rule = static_cast<uint32_t>(rules_.size()),
+              .num_rules = 0,
+              .return_address_register = static_cast<uint16_t>(fde->cie->return_address_register),
+              .supported = true};
+
+      // A section tried earlier wins where rows overlap, like in ElfInterface::Step.
+      auto next = rows->lower_bound(row.pc_start);
+      if (next != rows->end() && next->first < row.pc_end) {
+        continue;
+      }
+      if (next != rows->begin() && std::prev(next)->second.pc_end > row.pc_start) {
+        continue;
+      }
+
+      // The cfa is always the first rule of a row.
+      auto cfa_entry = loc_regs.find(CFA_REG);
+      if (cfa_entry == loc_regs.end() || cfa_entry->second.type != DWARF_LOCATION_REGISTER) {
+        row.supported = false;
+      } else {
+        rules_.push_back(Rule{CFA_REG, cfa_entry->second.type,
+                              {cfa_entry->second.values[0], cfa_entry->second.values[1]}});
+        for (const auto& entry : loc_regs) {
+          if (entry.first == CFA_REG || entry.second.type == DWARF_LOCATION_INVALID) {
+            continue;
+          }
+          if (entry.second.type == DWARF_LOCATION_EXPRESSION ||
+              entry.second.type == DWARF_LOCATION_VAL_EXPRESSION) {
+            row.supported = false;
+            break;
+          }
+          rules_.push_back(Rule{entry.first, entry.second.type,
+                                {entry.second.values[0], entry.second.values[1]}});
+        }
+      }
+      if (row.supported) {
+        row.num_rules = rules_.size() - row.first_rule;
+      } else {
+        rules_.resize(row.first_rule);
+      }
+      rows->emplace(row.pc_start, row);
+    }
+  }
+}
+
+bool SignalSafeUnwinder::Init() {
+  map_entries_.clear();
+  rows_.clear();
+  rules_.clear();
+
+  // Maps of the same elf share its rows.
+  std::map<Elf*, std::pair<size_t, size_t>> elf_rows;
+  for (MapInfo* info : *maps_) {
+    if (!(info->flags & PROT_EXEC) || (info->flags & MAPS_FLAGS_DEVICE_MAP)) {
+      continue;
+    }
+    Elf* elf = info->GetElf(process_memory_, true);
+    if (elf == nullptr || !elf->valid()) {
+      continue;
+    }
+
+    auto entry = elf_rows.find(elf);
+    if (entry == elf_rows.end()) {
+      std::map<uint64_t, Row> rows;
+      uint64_t load_bias = elf->GetLoadBias();
+      ElfInterface* interface = elf->interface();
+      AddSection(interface->debug_frame(), load_bias, &rows);
+      AddSection(interface->eh_frame(), load_bias, &rows);
+      ElfInterface* gnu_debugdata_interface = elf->gnu_debugdata_interface();
+      if (gnu_debugdata_interface != nullptr) {
+        AddSection(gnu_debugdata_interface->debug_frame(), 0, &rows);
+        AddSection(gnu_debugdata_interface->eh_frame(), 0, &rows);
+      }
+
+      size_t first_row = rows_.size();
+      for (const auto& row : rows) {
+        rows_.push_back(row.second);
+      }
+      entry = elf_rows.emplace(elf, std::make_pair(first_row, rows_.size() - first_row)).first;
+    }
+    if (entry->second.second == 0) {
+      continue;
+    }
+
+    map_entries_.push_back(MapEntry{.start = info->start,
+                                    .end = info->end,
+                                    .rel_offset = elf->GetLoadBias() + info->elf_offset,
+                                    .elf = elf,
+                                    .first_row = entry->second.first,
+                                    .num_rows = entry->second.second});
+  }
+  rows_.shrink_to_fit();
+  rules_.shrink_to_fit();
+  return !map_entries_.empty();
+}
+
+template <typename AddressType>
+bool SignalSafeUnwinder::Step(const Row& row, Regs* regs, bool* finished) {
+  uint16_t total_regs = regs->total_regs();
+  if (!row.supported || row.return_address_register >= total_regs) {
+    return false;
+  }
+  AddressType* cur_regs = reinterpret_cast<AddressType*>(regs->RawData());
+  AddressType new_regs[kMaxRegs];
+  memcpy(new_regs, cur_regs, total_regs * sizeof(AddressType));
+
+  const Rule* rules = &rules_[row.first_rule];
+  if (rules[0].values[0] >= total_regs) {
+    return false;
+  }
+  AddressType cfa = cur_regs[rules[0].values[0]] + rules[0].values[1];
+
+  bool return_address_undefined = false;
+  for (size_t i = 1; i < row.num_rules; i++) {
+    const Rule& rule = rules[i];
+    if (rule.reg >= total_regs) {
+      // Skip this unknown register.
+      continue;
+    }
+    switch (rule.type) {
+      case DWARF_LOCATION_OFFSET:
+        if (!process_memory_->ReadFully(static_cast<AddressType>(cfa + rule.values[0]),
+                                        &new_regs[rule.reg], sizeof(AddressType))) {
+          return false;
+        }
+        break;
+      case DWARF_LOCATION_VAL_OFFSET:
+        new_regs[rule.reg] = cfa + rule.values[0];
+        break;
+      case DWARF_LOCATION_REGISTER:
+        if (rule.values[0] >= total_regs) {
+          return false;
+        }
+        new_regs[rule.reg] = cur_regs[rule.values[0]] + rule.values[1];
+        break;
+      case DWARF_LOCATION_UNDEFINED:
+        if (rule.reg == row.return_address_register) {
+          return_address_undefined = true;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  memcpy(cur_regs, new_regs, total_regs * sizeof(AddressType));
+  regs->set_pc(return_address_undefined ? 0 : new_regs[row.return_address_register]);
+  regs->set_sp(cfa);
+  regs->set_dex_pc(0);
+  *finished = regs->pc() == 0;
+  return true;
+}
+
+size_t SignalSafeUnwinder::Unwind(Regs* regs, uint64_t* pcs, size_t max_pcs) {
+  if (regs->total_regs() > kMaxRegs) {
+    return 0;
+  }
+
+  size_t num_pcs = 0;
+  bool return_address_attempt = false;
+  bool adjust_pc = false;
+  while (num_pcs < max_pcs) {
+    uint64_t cur_pc = regs->pc();
+    uint64_t cur_sp = regs->sp();
+
+    auto map_entry = std::upper_bound(
+        map_entries_.begin(), map_entries_.end(), cur_pc,
+        [](uint64_t pc, const MapEntry& entry) { return pc < entry.start; });
+    const MapEntry* entry = nullptr;
+    if (map_entry != map_entries_.begin() && cur_pc < std::prev(map_entry)->end) {
+      entry = &*std::prev(map_entry);
+    }
+
+    uint64_t rel_pc = 0;
+    uint64_t pc_adjustment = 0;
+    if (entry != nullptr) {
+      rel_pc = cur_pc - entry->start + entry->rel_offset;
+      if (adjust_pc) {
+        pc_adjustment = regs->GetPcAdjustment(rel_pc, entry->elf);
+      }
+    }
+    pcs[num_pcs++] = cur_pc - pc_adjustment;
+    adjust_pc = true;
+
+    bool stepped = false;
+    bool finished = false;
+    if (entry != nullptr) {
+      if (regs->StepIfSignalHandler(rel_pc, entry->elf, process_memory_.get())) {
+        stepped = true;
+      } else {
+        uint64_t step_pc = rel_pc - pc_adjustment;
+        auto first = rows_.begin() + entry->first_row;
+        auto row = std::upper_bound(first, first + entry->num_rows, step_pc,
+                                    [](uint64_t pc, const Row& row) { return pc < row.pc_start; });
+        if (row != first && step_pc < std::prev(row)->pc_end) {
+          if (regs->Is32Bit()) {
+            stepped = Step<uint32_t>(*std::prev(row), regs, &finished);
+          } else {
+            stepped = Step<uint64_t>(*std::prev(row), regs, &finished);
+          }
+        }
+      }
+    }
+
+    if (!stepped) {
+      if (return_address_attempt) {
+        // Remove the speculative frame.
+        num_pcs--;
+        break;
+      }
+      // Steping didn't work, try this secondary method.
+      if (!regs->SetPcFromReturnAddress(process_memory_.get())) {
+        break;
+      }
+      return_address_attempt = true;
+    } else {
+      if (finished) {
+        break;
+      }
+      return_address_attempt = false;
+    }
+
+    // If the pc and sp didn't change, then consider everything stopped.
+    if (cur_pc == regs->pc() && cur_sp == regs->sp()) {
+      break;
+    }
+  }
+  return num_pcs;
+}
+
+}  // namespace unwindstack
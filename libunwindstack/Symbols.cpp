@@ -16,8 +16,11 @@
 
 #include <elf.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include <unwindstack/Memory.h>
 
@@ -54,58 +57,63 @@ const Symbols::Info* Symbols::GetInfoFromCache(uint64_t addr) {
 }
 
 template <typename SymType>
-bool Symbols::GetName(uint64_t addr, uint64_t load_bias, Memory* elf_memory, std::string* name,
-                      uint64_t* func_offset) {
-  addr += load_bias;
-
-  if (symbols_.size() != 0) {
-    const Info* info = GetInfoFromCache(addr);
-    if (info) {
-      CHECK(addr >= info->start_offset && addr <= info->end_offset);
-      *func_offset = addr - info->start_offset;
-      return elf_memory->ReadString(info->str_offset, name, str_end_ - info->str_offset);
+void Symbols::BuildCache(uint64_t load_bias, Memory* elf_memory) {
+  // Read the entries a batch at a time, only falling back to reading them
+  // one by one to find where an unreadable table stops.
+  constexpr size_t kBatchEntries = 64;
+  std::vector<uint8_t> batch;
+  while (entry_size_ != 0 && cur_offset_ + entry_size_ <= end_) {
+    size_t entries =
+        std::min(static_cast<uint64_t>(kBatchEntries), (end_ - cur_offset_) / entry_size_);
+    batch.resize((entries - 1) * entry_size_ + sizeof(SymType));
+    if (!elf_memory->ReadFully(cur_offset_, batch.data(), batch.size())) {
+      entries = 1;
+      if (!elf_memory->ReadFully(cur_offset_, batch.data(), sizeof(SymType))) {
+        // Stop all processing, something looks like it is corrupted.
+        break;
+      }
     }
-  }
-
-  bool symbol_added = false;
-  bool return_value = false;
-  while (cur_offset_ + entry_size_ <= end_) {
-    SymType entry;
-    if (!elf_memory->ReadFully(cur_offset_, &entry, sizeof(entry))) {
-      // Stop all processing, something looks like it is corrupted.
-      cur_offset_ = UINT64_MAX;
-      return false;
+    cur_offset_ += entries * entry_size_;
+
+    for (size_t i = 0; i < entries; i++) {
+      SymType entry;
+      memcpy(&entry, &batch[i * entry_size_], sizeof(entry));
+      if (entry.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry.st_info) == STT_FUNC) {
+        // Treat st_value as virtual address.
+        uint64_t start_offset = entry.st_value;
+        if (entry.st_shndx != SHN_ABS) {
+          start_offset += load_bias;
+        }
+        symbols_.emplace_back(start_offset, start_offset + entry.st_size,
+                              str_offset_ + entry.st_name);
+      }
     }
-    cur_offset_ += entry_size_;
+  }
+  cur_offset_ = UINT64_MAX;
 
-    if (entry.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry.st_info) == STT_FUNC) {
-      // Treat st_value as virtual address.
-      uint64_t start_offset = entry.st_value;
-      if (entry.st_shndx != SHN_ABS) {
-        start_offset += load_bias;
-      }
-      uint64_t end_offset = start_offset + entry.st_size;
+  std::sort(symbols_.begin(), symbols_.end(),
+            [](const Info& a, const Info& b) { return a.start_offset < b.start_offset; });
+  symbols_.shrink_to_fit();
+}
 
-      // Cache the value.
-      symbols_.emplace_back(start_offset, end_offset, str_offset_ + entry.st_name);
-      symbol_added = true;
+template <typename SymType>
+bool Symbols::GetName(uint64_t addr, uint64_t load_bias, Memory* elf_memory, std::string* name,
+                      uint64_t* func_offset) {
+  addr += load_bias;
 
-      if (addr >= start_offset && addr < end_offset) {
-        *func_offset = addr - start_offset;
-        uint64_t offset = str_offset_ + entry.st_name;
-        if (offset < str_end_) {
-          return_value = elf_memory->ReadString(offset, name, str_end_ - offset);
-        }
-        break;
-      }
-    }
+  // The whole table is read and sorted on first use, after that every lookup
+  // is a binary search and a read of the one name it finds.
+  if (cur_offset_ != UINT64_MAX) {
+    BuildCache<SymType>(load_bias, elf_memory);
   }
 
-  if (symbol_added) {
-    std::sort(symbols_.begin(), symbols_.end(),
-              [](const Info& a, const Info& b) { return a.start_offset < b.start_offset; });
+  const Info* info = GetInfoFromCache(addr);
+  if (info == nullptr || info->str_offset >= str_end_) {
+    return false;
   }
-  return return_value;
+  CHECK(addr >= info->start_offset && addr <= info->end_offset);
+  *func_offset = addr - info->start_offset;
+  return elf_memory->ReadString(info->str_offset, name, str_end_ - info->str_offset);
 }
 
 template <typename SymType>
@@ -56,7 +56,10 @@ class Symbols {
   }
 
  private:
-  uint64_t cur_offset_;
+  template <typename SymType>
+  void BuildCache(uint64_t load_bias, Memory* elf_memory);
+
+  uint64_t cur_offset_;  // UINT64_MAX once symbols_ is complete.
   uint64_t offset_;
   uint64_t end_;
   uint64_t entry_size_;
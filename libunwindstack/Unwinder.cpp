@@ -23,6 +23,8 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include <android-base/stringprintf.h>
 
@@ -300,4 +302,70 @@ void Unwinder::SetDexFiles(DexFiles* dex_files, ArchEnum arch) {
 }
 #endif
 
+void ThreadUnwinder::SetJitDebug(JitDebug* jit_debug, ArchEnum arch) {
+  jit_debug_ = jit_debug;
+  arch_ = arch;
+}
+
+#if !defined(NO_LIBDEXFILE_SUPPORT)
+void ThreadUnwinder::SetDexFiles(DexFiles* dex_files, ArchEnum arch) {
+  dex_files_ = dex_files;
+  arch_ = arch;
+}
+#endif
+
+size_t ThreadUnwinder::AddThread(Regs* regs) {
+  // Everything that touches shared state is set up here, on the one
+  // thread, so the workers only have to call Unwind().
+  Unwinder* unwinder = new Unwinder(max_frames_, maps_, regs, process_memory_);
+  if (jit_debug_ != nullptr) {
+    unwinder->SetJitDebug(jit_debug_, arch_);
+  }
+#if !defined(NO_LIBDEXFILE_SUPPORT)
+  if (dex_files_ != nullptr) {
+    unwinder->SetDexFiles(dex_files_, arch_);
+  }
+#endif
+  unwinder->SetResolveNames(resolve_names_);
+  unwinders_.emplace_back(unwinder);
+  return unwinders_.size() - 1;
+}
+
+bool ThreadUnwinder::AddThread(pid_t tid) {
+  Regs* regs = Regs::RemoteGet(tid);
+  if (regs == nullptr) {
+    return false;
+  }
+  owned_regs_.emplace_back(regs);
+  AddThread(regs);
+  return true;
+}
+
+void ThreadUnwinder::Unwind(size_t num_workers,
+                            const std::vector<std::string>* initial_map_names_to_skip,
+                            const std::vector<std::string>* map_suffixes_to_ignore) {
+  if (num_workers == 0) {
+    num_workers = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  num_workers = std::min(num_workers, unwinders_.size());
+
+  // Hand out the threads one at a time, stacks vary a lot in depth.
+  std::atomic_size_t next(0);
+  auto work = [&]() {
+    size_t index;
+    while ((index = next++) < unwinders_.size()) {
+      unwinders_[index]->Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < num_workers; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
 }  // namespace unwindstack
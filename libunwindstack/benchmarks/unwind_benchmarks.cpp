@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays the offline snapshots used by the unit tests, which are made with
+// tools/unwind_for_offline, to measure the cost of an unwind:
+//   cold:      new maps every iteration, so every Elf is created again
+//   elf_cache: new maps every iteration, with Elf::SetCachingEnabled(true)
+//   warm:      the same maps every iteration, so only the steps are measured
+// with and without resolving function names. Each benchmark reports the
+// frames found and the reads made of the process memory per unwind.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/JitDebug.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsArm.h>
+#include <unwindstack/RegsArm64.h>
+#include <unwindstack/RegsX86.h>
+#include <unwindstack/RegsX86_64.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+class MemoryCounter : public Memory {
+ public:
+  MemoryCounter(std::shared_ptr<Memory> memory) : memory_(memory) {}
+  virtual ~MemoryCounter() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override {
+    reads_++;
+    return memory_->Read(addr, dst, size);
+  }
+
+  uint64_t reads() { return reads_; }
+
+ private:
+  std::shared_ptr<Memory> memory_;
+  uint64_t reads_ = 0;
+};
+
+class Snapshot {
+ public:
+  ~Snapshot() {
+    if (cwd_ != nullptr && chdir(cwd_) != 0) {
+      fprintf(stderr, "Cannot restore the working directory %s\n", cwd_);
+    }
+    free(cwd_);
+  }
+
+  // The libraries in the maps are found relative to the snapshot directory,
+  // so it stays the working directory until the snapshot is destroyed.
+  bool Init(const std::string& name, ArchEnum arch) {
+    std::string dir(android::base::GetExecutableDirectory() + "/tests/files/offline/" + name);
+    if (!android::base::ReadFileToString(dir + "/maps.txt", &maps_data_)) {
+      fprintf(stderr, "Cannot read %s/maps.txt\n", dir.c_str());
+      return false;
+    }
+
+    struct stat st;
+    if (stat((dir + "/stack.data").c_str(), &st) == 0) {
+      std::unique_ptr<MemoryOffline> stack(new MemoryOffline);
+      if (!stack->Init(dir + "/stack.data", 0)) {
+        return false;
+      }
+      stack_.reset(stack.release());
+    } else {
+      std::unique_ptr<MemoryOfflineParts> parts(new MemoryOfflineParts);
+      for (size_t i = 0;; i++) {
+        std::string stack_name(dir + "/stack" + std::to_string(i) + ".data");
+        if (stat(stack_name.c_str(), &st) == -1) {
+          break;
+        }
+        MemoryOffline* stack = new MemoryOffline;
+        if (!stack->Init(stack_name, 0)) {
+          delete stack;
+          return false;
+        }
+        parts->Add(stack);
+      }
+      stack_.reset(parts.release());
+    }
+
+    switch (arch) {
+      case ARCH_ARM:
+        regs_.reset(new RegsArm);
+        break;
+      case ARCH_ARM64:
+        regs_.reset(new RegsArm64);
+        break;
+      case ARCH_X86:
+        regs_.reset(new RegsX86);
+        break;
+      case ARCH_X86_64:
+        regs_.reset(new RegsX86_64);
+        break;
+      default:
+        return false;
+    }
+    if (!ReadRegs(dir + "/regs.txt")) {
+      return false;
+    }
+
+    cwd_ = getcwd(nullptr, 0);
+    return chdir(dir.c_str()) == 0;
+  }
+
+  const std::string& maps_data() { return maps_data_; }
+  std::shared_ptr<Memory>& stack() { return stack_; }
+  Regs* regs() { return regs_.get(); }
+
+ private:
+  bool ReadRegs(const std::string& file) {
+    // Number every register to learn which name goes with which index.
+    std::unordered_map<std::string, size_t> indexes;
+    for (size_t i = 0; i < regs_->total_regs(); i++) {
+      SetReg(i, i);
+    }
+    regs_->IterateRegisters(
+        [&indexes](const char* name, uint64_t index) { indexes[name] = index; });
+
+    std::string data;
+    if (!android::base::ReadFileToString(file, &data)) {
+      return false;
+    }
+    for (const std::string& line : android::base::Split(data, "\n")) {
+      char name[100];
+      uint64_t value;
+      if (line.empty()) {
+        continue;
+      }
+      if (sscanf(line.c_str(), "%99[^:]: %" SCNx64, name, &value) != 2 ||
+          indexes.count(name) == 0) {
+        fprintf(stderr, "Bad register line in %s: %s\n", file.c_str(), line.c_str());
+        return false;
+      }
+      SetReg(indexes[name], value);
+    }
+    return true;
+  }
+
+  void SetReg(size_t index, uint64_t value) {
+    if (regs_->Is32Bit()) {
+      reinterpret_cast<uint32_t*>(regs_->RawData())[index] = value;
+    } else {
+      reinterpret_cast<uint64_t*>(regs_->RawData())[index] = value;
+    }
+  }
+
+  char* cwd_ = nullptr;
+  std::string maps_data_;
+  std::shared_ptr<Memory> stack_;
+  std::unique_ptr<Regs> regs_;
+};
+
+enum Mode {
+  MODE_COLD,
+  MODE_ELF_CACHE,
+  MODE_WARM,
+};
+
+static void BM_unwind(benchmark::State& state, const char* name, ArchEnum arch, Mode mode,
+                      bool resolve_names) {
+  Snapshot snapshot;
+  if (!snapshot.Init(name, arch)) {
+    state.SkipWithError("Cannot load the snapshot.");
+    return;
+  }
+  Elf::SetCachingEnabled(mode == MODE_ELF_CACHE);
+
+  std::shared_ptr<MemoryCounter> counter(new MemoryCounter(snapshot.stack()));
+  std::shared_ptr<Memory> process_memory(counter);
+  std::unique_ptr<Maps> maps;
+  std::unique_ptr<JitDebug> jit_debug;
+  uint64_t frames = 0;
+  for (auto _ : state) {
+    if (maps == nullptr || mode != MODE_WARM) {
+      state.PauseTiming();
+      maps.reset(new BufferMaps(snapshot.maps_data().c_str()));
+      if (!maps->Parse()) {
+        state.SkipWithError("Cannot parse the maps.");
+        break;
+      }
+      jit_debug.reset(new JitDebug(process_memory));
+      state.ResumeTiming();
+    }
+
+    std::unique_ptr<Regs> regs(snapshot.regs()->Clone());
+    Unwinder unwinder(128, maps.get(), regs.get(), process_memory);
+    unwinder.SetJitDebug(jit_debug.get(), regs->Arch());
+    unwinder.SetResolveNames(resolve_names);
+    unwinder.Unwind();
+    frames += unwinder.NumFrames();
+  }
+
+  maps.reset();
+  Elf::SetCachingEnabled(false);
+  state.counters["frames"] = benchmark::Counter(frames, benchmark::Counter::kAvgIterations);
+  state.counters["reads"] =
+      benchmark::Counter(counter->reads(), benchmark::Counter::kAvgIterations);
+}
+
+#define UNWIND_BENCHMARKS(name, arch)                                         \
+  BENCHMARK_CAPTURE(BM_unwind, name##_cold, #name, arch, MODE_COLD, true);    \
+  BENCHMARK_CAPTURE(BM_unwind, name##_elf_cache, #name, arch, MODE_ELF_CACHE, \
+                    true);                                                    \
+  BENCHMARK_CAPTURE(BM_unwind, name##_warm, #name, arch, MODE_WARM, true);    \
+  BENCHMARK_CAPTURE(BM_unwind, name##_warm_no_names, #name, arch, MODE_WARM, false)
+
+// arm exidx, and a pc split across two maps.
+UNWIND_BENCHMARKS(straddle_arm, ARCH_ARM);
+// Frames only described by the .gnu_debugdata section.
+UNWIND_BENCHMARKS(gnu_debugdata_arm, ARCH_ARM);
+// Jit frames found through the jit debug interface.
+UNWIND_BENCHMARKS(jit_debug_arm, ARCH_ARM);
+UNWIND_BENCHMARKS(jit_debug_x86, ARCH_X86);
+UNWIND_BENCHMARKS(straddle_arm64, ARCH_ARM64);
+// An .eh_frame_hdr that can't be used, so the .eh_frame is read in full.
+UNWIND_BENCHMARKS(bad_eh_frame_hdr_arm64, ARCH_ARM64);
+UNWIND_BENCHMARKS(debug_frame_first_x86, ARCH_X86);
+UNWIND_BENCHMARKS(eh_frame_hdr_begin_x86_64, ARCH_X86_64);
+
+}  // namespace unwindstack
+
+BENCHMARK_MAIN();
@@ -21,6 +21,7 @@
 
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -50,15 +51,20 @@ class DexFiles {
  private:
   void Init(Maps* maps);
 
-  bool GetAddr(size_t index, uint64_t* addr);
+  bool Rescan();
+
+  bool AddEntry(uint64_t dex_file, uint64_t next, uint64_t* addr);
+
+  bool GetMethodInformation(uint64_t addr, MapInfo* info, uint64_t dex_pc,
+                            std::string* method_name, uint64_t* method_offset);
 
   uint64_t ReadEntryPtr32(uint64_t addr);
 
   uint64_t ReadEntryPtr64(uint64_t addr);
 
-  bool ReadEntry32();
+  bool ReadEntry32(uint64_t* addr);
 
-  bool ReadEntry64();
+  bool ReadEntry64(uint64_t* addr);
 
   std::shared_ptr<Memory> memory_;
   std::vector<std::string> search_libs_;
@@ -67,10 +73,17 @@ class DexFiles {
   bool initialized_ = false;
   std::unordered_map<uint64_t, DexFile*> files_;
 
+  uint64_t descriptor_addr_ = 0;
+  // The descriptor's first entry when it was last read.
+  uint64_t first_entry_ = 0;
+  // The next entry to read, zero once the entries added since the last scan are read.
   uint64_t entry_addr_ = 0;
   uint64_t (DexFiles::*read_entry_ptr_func_)(uint64_t) = nullptr;
-  bool (DexFiles::*read_entry_func_)() = nullptr;
-  std::vector<uint64_t> addrs_;
+  bool (DexFiles::*read_entry_func_)(uint64_t*) = nullptr;
+  // The address of every entry read, and the dex file address it had.
+  std::unordered_map<uint64_t, uint64_t> entries_;
+  // The dex file addresses read so far, in address order.
+  std::set<uint64_t> addrs_;
 };
 
 }  // namespace unwindstack
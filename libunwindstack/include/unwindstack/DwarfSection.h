@@ -20,7 +20,9 @@
 #include <stdint.h>
 
 #include <iterator>
+#include <list>
 #include <map>
+#include <string>
 #include <unordered_map>
 
 #include <unwindstack/DwarfError.h>
@@ -102,7 +104,33 @@ class DwarfSection {
 
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished);
 
+  // Sections without a binary search table (.debug_frame, or .eh_frame with
+  // no .eh_frame_hdr) need every entry read to build a sorted list of fdes.
+  // When an index directory is set, Init() saves those lists there, named
+  // after a hash of the section contents, and later Init() calls for the
+  // same section, in this or any other process, load the list back instead.
+  // An empty directory turns this off. Not thread safe, set it up front.
+  static void SetIndexDirectory(const std::string& directory);
+
+  // Step() keeps the cfa rules it works out for a range of pcs, so that the
+  // cfa instructions only run the first time a pc in that range is seen.
+  // By default every range is kept, a non-zero size bounds the number
+  // kept by each section, dropping the least recently used first.
+  static void SetLocRegsCacheSize(size_t size);
+
+  uint64_t LocRegsCacheHits() { return loc_regs_hits_; }
+  uint64_t LocRegsCacheMisses() { return loc_regs_misses_; }
+  size_t LocRegsCacheEntries() { return loc_regs_.size(); }
+
  protected:
+  struct LocRegsEntry {
+    dwarf_loc_regs_t loc_regs;
+    std::list<uint64_t>::iterator lru;
+  };
+
+  static std::string* index_directory_;
+  static size_t loc_regs_cache_size_;
+
   DwarfMemory memory_;
   DwarfErrorData last_error_{DWARF_ERROR_NONE, 0};
 
@@ -113,7 +141,10 @@ class DwarfSection {
   std::unordered_map<uint64_t, DwarfFde> fde_entries_;
   std::unordered_map<uint64_t, DwarfCie> cie_entries_;
   std::unordered_map<uint64_t, dwarf_loc_regs_t> cie_loc_regs_;
-  std::map<uint64_t, dwarf_loc_regs_t> loc_regs_;  // Single row indexed by pc_end.
+  std::map<uint64_t, LocRegsEntry> loc_regs_;  // Single row indexed by pc_end.
+  std::list<uint64_t> loc_regs_lru_;           // Keys of loc_regs_, most recent first.
+  uint64_t loc_regs_hits_ = 0;
+  uint64_t loc_regs_misses_ = 0;
 };
 
 template <typename AddressType>
@@ -162,9 +193,14 @@ class DwarfSectionImpl : public DwarfSection {
 
   bool CreateSortedFdeList();
 
+  bool GetIndexPath(std::string* path);
+  bool LoadFdeIndex(const std::string& path);
+  void SaveFdeIndex(const std::string& path);
+
   std::vector<FdeInfo> fdes_;
   uint64_t entries_offset_;
   uint64_t entries_end_;
+  uint64_t hash_ = 0;
 };
 
 }  // namespace unwindstack
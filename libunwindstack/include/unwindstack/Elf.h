@@ -35,6 +35,7 @@
 namespace unwindstack {
 
 // Forward declaration.
+struct ElfCacheShard;
 struct MapInfo;
 class Regs;
 
@@ -98,11 +99,30 @@ class Elf {
 
   static uint64_t GetLoadBias(Memory* memory);
 
+  struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    // Number of names in the cache, and of distinct elf objects they share.
+    size_t entries = 0;
+    size_t elfs = 0;
+    // Estimated memory held by the cached elf objects, see CacheFootprint().
+    uint64_t bytes = 0;
+  };
+
   static void SetCachingEnabled(bool enable);
   static bool CachingEnabled() { return cache_enabled_; }
 
-  static void CacheLock();
-  static void CacheUnlock();
+  // Limits the estimated memory held by the cache, evicting the least recently
+  // used elf objects past it. 0, the default, means no limit.
+  static void SetCacheLimit(uint64_t bytes);
+  static CacheStats GetCacheStats();
+
+  // Rough estimate of the memory held by this object.
+  uint64_t CacheFootprint();
+
+  static void CacheLock(MapInfo* info);
+  static void CacheUnlock(MapInfo* info);
   static void CacheAdd(MapInfo* info);
   static bool CacheGet(MapInfo* info);
   static bool CacheAfterCreateMemory(MapInfo* info);
@@ -122,8 +142,8 @@ class Elf {
   std::unique_ptr<ElfInterface> gnu_debugdata_interface_;
 
   static bool cache_enabled_;
-  static std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>* cache_;
-  static std::mutex* cache_lock_;
+  static uint64_t cache_limit_;
+  static ElfCacheShard* cache_;
 };
 
 }  // namespace unwindstack
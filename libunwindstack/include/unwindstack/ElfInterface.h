@@ -70,6 +70,17 @@ class ElfInterface {
 
   Memory* CreateGnuDebugdataMemory();
 
+  // Decompressing a .gnu_debugdata section is expensive, and short lived
+  // processes like crash_dump do it for the same libraries over and over.
+  // When a cache directory is set, CreateGnuDebugdataMemory() saves each
+  // decompressed section there, named after a hash of the compressed data,
+  // and later calls in this or any other process map that file instead of
+  // decompressing, so only the pages that get read are loaded. The least
+  // recently used files are removed to keep the directory under max_size
+  // bytes, 0 means no limit. An empty directory turns this off. Not thread
+  // safe, set it up front.
+  static void SetGnuDebugdataCache(const std::string& directory, uint64_t max_size);
+
   Memory* memory() { return memory_; }
 
   const std::unordered_map<uint64_t, LoadInfo>& pt_loads() { return pt_loads_; }
@@ -158,6 +169,9 @@ class ElfInterface {
 
   std::vector<Symbols*> symbols_;
   std::vector<std::pair<uint64_t, uint64_t>> strtabs_;
+
+  static std::string* gnu_debugdata_cache_directory_;
+  static uint64_t gnu_debugdata_cache_max_size_;
 };
 
 class ElfInterface32 : public ElfInterface {
@@ -19,9 +19,11 @@
 
 #include <stdint.h>
 
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace unwindstack {
@@ -43,12 +45,35 @@ class JitDebug {
   void SetArch(ArchEnum arch);
 
  private:
+  struct ElfRange {
+    uint64_t end;
+    Elf* elf;
+    uint64_t scan;
+  };
+
   void Init(Maps* maps);
 
+  bool Rescan();
+
+  void AddElf(Elf* elf);
+
+  Elf* FindElf(uint64_t pc);
+
   std::shared_ptr<Memory> memory_;
+  uint64_t descriptor_addr_ = 0;
+  // The descriptor's first entry when it was last read.
+  uint64_t first_entry_ = 0;
+  // The next entry to read, zero once the entries added since the last scan are read.
   uint64_t entry_addr_ = 0;
+  uint64_t scan_ = 0;
   bool initialized_ = false;
+  // Every elf created, they are only freed with this object.
   std::vector<Elf*> elf_list_;
+  // The address of every entry read, and the symfile address it had.
+  std::unordered_map<uint64_t, uint64_t> entries_;
+  // The elfs whose pc range is known, keyed by start of the range.
+  std::map<uint64_t, ElfRange> elf_ranges_;
+  std::vector<Elf*> unranged_elfs_;
   std::vector<std::string> search_libs_;
 
   std::mutex lock_;
@@ -62,6 +62,11 @@ struct MapInfo {
 
   uint64_t GetLoadBias(const std::shared_ptr<Memory>& process_memory);
 
+  // Shares the Elf object of other, if it has created one, with this map.
+  // Both maps must describe the same mapping, e.g. from two parses of the
+  // same process. other can be in use by other threads during the call.
+  void ShareElf(MapInfo* other);
+
  private:
   MapInfo(const MapInfo&) = delete;
   void operator=(const MapInfo&) = delete;
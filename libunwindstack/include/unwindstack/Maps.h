@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -40,6 +41,16 @@ class Maps {
 
   virtual bool Parse();
 
+  // Parses the maps again, for a process that has mapped or unmapped
+  // something since. Entries with the same range, offset, flags and name as
+  // before are kept as they are, together with their Elf objects and load
+  // bias, everything else is replaced. If given, added gets the new entries
+  // and removed takes ownership of the ones that went away, otherwise they
+  // are deleted. On failure the maps are left unchanged.
+  // Not thread safe, nothing else may use the maps until this returns.
+  bool Reparse(std::vector<MapInfo*>* added = nullptr,
+               std::vector<std::unique_ptr<MapInfo>>* removed = nullptr);
+
   virtual const std::string GetMapsFile() const { return ""; }
 
   void Add(uint64_t start, uint64_t end, uint64_t offset, uint64_t flags, const std::string& name,
@@ -23,7 +23,9 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace unwindstack {
@@ -34,9 +36,16 @@ class Memory {
   virtual ~Memory() = default;
 
   static std::shared_ptr<Memory> CreateProcessMemory(pid_t pid);
+  // Same as CreateProcessMemory, but reads of another process go through a
+  // MemoryCache, for callers that keep the process stopped while they use it.
+  static std::shared_ptr<Memory> CreateProcessMemoryCached(pid_t pid);
 
   virtual bool ReadString(uint64_t addr, std::string* string, uint64_t max_read = UINT64_MAX);
 
+  // Drops anything cached from the underlying memory, a no-op unless this is
+  // a MemoryCache.
+  virtual void Clear() {}
+
   virtual size_t Read(uint64_t addr, void* dst, size_t size) = 0;
 
   bool ReadFully(uint64_t addr, void* dst, size_t size);
@@ -90,7 +99,7 @@ class MemoryFileAtOffset : public Memory {
 
   size_t Size() { return size_; }
 
-  void Clear();
+  void Clear() override;
 
  protected:
   size_t size_ = 0;
@@ -112,6 +121,34 @@ class MemoryRemote : public Memory {
   std::atomic_uintptr_t read_redirect_func_;
 };
 
+// MemoryCache reads whole pages of the underlying memory, and serves small
+// reads from those, so that evaluating the CFA of a remote frame is a handful
+// of process_vm_readv/ptrace calls rather than one for every value read.
+// The pages are kept until Clear() is called, which must be done whenever
+// the memory may have changed, e.g. before each unwind of a live process.
+class MemoryCache : public Memory {
+ public:
+  MemoryCache(Memory* memory) : impl_(memory) {}
+  virtual ~MemoryCache() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+
+  void Clear();
+
+ private:
+  constexpr static size_t kCacheBits = 12;
+  constexpr static size_t kCacheMask = (1 << kCacheBits) - 1;
+  constexpr static size_t kCacheSize = 1 << kCacheBits;
+  // Reads larger than this go straight to the underlying memory.
+  constexpr static size_t kMaxCachedRead = 64;
+
+  uint8_t* GetPage(uint64_t page);
+
+  std::unique_ptr<Memory> impl_;
+  std::mutex lock_;
+  std::unordered_map<uint64_t, uint8_t[kCacheSize]> cache_;
+};
+
 class MemoryLocal : public Memory {
  public:
   MemoryLocal() = default;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_SIGNAL_SAFE_UNWINDER_H
+#define _LIBUNWINDSTACK_SIGNAL_SAFE_UNWINDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <unwindstack/DwarfLocation.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class DwarfSection;
+class Elf;
+class Maps;
+class Memory;
+class Regs;
+
+// Unwinds the current process using only tables built ahead of time, so that
+// Unwind() can be called from a signal handler: it does not allocate, take
+// locks or create Elf objects, and only reads memory through process_memory.
+//
+// Init() creates the Elf object of every executable map and flattens all of
+// the dwarf cfi rows of its debug_frame, eh_frame and gnu_debugdata sections
+// into one sorted table. Rows that need a dwarf expression evaluated, and
+// code only described by arm exidx, are not supported: the unwind stops
+// there. No names are resolved, only pcs are returned.
+//
+// process_memory must be safe to use from a signal handler, which a
+// Memory::CreateProcessMemory(getpid()) object is, and a cached one is not.
+// The maps must not change, nor be freed, while the unwinder is in use.
+// Once Init() has returned, any number of threads or handlers can call
+// Unwind() at the same time. Init() must not be called again while they can.
+class SignalSafeUnwinder {
+ public:
+  SignalSafeUnwinder(Maps* maps, std::shared_ptr<Memory> process_memory)
+      : maps_(maps), process_memory_(process_memory) {}
+  ~SignalSafeUnwinder() = default;
+
+  // Not signal safe. Returns false if no unwind information was found.
+  bool Init();
+
+  // Steps from regs, which must have been allocated beforehand and filled in
+  // with RegsGetLocal() or similar, and writes the pc of each frame to pcs.
+  // Returns the number of pcs written. regs is modified.
+  size_t Unwind(Regs* regs, uint64_t* pcs, size_t max_pcs);
+
+  size_t NumRows() { return rows_.size(); }
+
+ private:
+  struct Rule {
+    uint32_t reg;
+    DwarfLocationEnum type;
+    uint64_t values[2];
+  };
+
+  // The rules of one row of the cfi, for elf relative pcs in [pc_start, pc_end).
+  struct Row {
+    uint64_t pc_start;
+    uint64_t pc_end;
+    uint32_t first_rule;
+    uint16_t num_rules;
+    uint16_t return_address_register;
+    bool supported;
+  };
+
+  struct MapEntry {
+    uint64_t start;
+    uint64_t end;
+    uint64_t rel_offset;  // rel_pc = pc - start + rel_offset
+    Elf* elf;
+    size_t first_row;
+    size_t num_rows;
+  };
+
+  void AddSection(DwarfSection* section, uint64_t load_bias, std::map<uint64_t, Row>* rows);
+
+  template <typename AddressType>
+  bool Step(const Row& row, Regs* regs, bool* finished);
+
+  Maps* maps_;
+  std::shared_ptr<Memory> process_memory_;
+  std::vector<MapEntry> map_entries_;
+  std::vector<Row> rows_;
+  std::vector<Rule> rules_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_SIGNAL_SAFE_UNWINDER_H
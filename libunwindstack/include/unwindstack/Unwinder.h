@@ -104,6 +104,63 @@ class Unwinder {
   ErrorData last_error_;
 };
 
+// Unwinds a set of threads of one process, sharing one Maps, one process
+// memory object (use Memory::CreateProcessMemoryCached() to share its pages
+// too) and one JitDebug/DexFiles between all of them, and running the
+// unwinds on a number of threads.
+//
+// The workers read the target's memory through process_memory, which must
+// work from any thread of the caller. PTRACE_PEEKTEXT only works from the
+// thread that attached, so for a remote process this relies on
+// process_vm_readv being available.
+class ThreadUnwinder {
+ public:
+  ThreadUnwinder(size_t max_frames, Maps* maps, std::shared_ptr<Memory> process_memory)
+      : max_frames_(max_frames), maps_(maps), process_memory_(process_memory) {}
+  ~ThreadUnwinder() = default;
+
+  // These only apply to threads added afterwards.
+  void SetJitDebug(JitDebug* jit_debug, ArchEnum arch);
+#if !defined(NO_LIBDEXFILE_SUPPORT)
+  void SetDexFiles(DexFiles* dex_files, ArchEnum arch);
+#endif
+  void SetResolveNames(bool resolve) { resolve_names_ = resolve; }
+
+  // Adds a thread starting from regs, which is not owned, must stay valid
+  // until Unwind() returns, and is modified by it like Unwinder does.
+  // Returns the index of the thread.
+  size_t AddThread(Regs* regs);
+
+  // Adds a thread of a remote process from its current registers, it must
+  // be ptrace stopped by the calling thread. Returns false if the registers
+  // could not be read, in which case no thread is added.
+  bool AddThread(pid_t tid);
+
+  // Unwinds every thread added, using up to num_workers threads including
+  // the calling one; 0 picks one per cpu.
+  void Unwind(size_t num_workers = 0,
+              const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+              const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  size_t NumThreads() { return unwinders_.size(); }
+
+  // Frames and errors of an unwound thread, by the index AddThread() gave.
+  Unwinder* GetUnwinder(size_t index) { return unwinders_[index].get(); }
+
+ private:
+  size_t max_frames_;
+  Maps* maps_;
+  std::shared_ptr<Memory> process_memory_;
+  JitDebug* jit_debug_ = nullptr;
+#if !defined(NO_LIBDEXFILE_SUPPORT)
+  DexFiles* dex_files_ = nullptr;
+#endif
+  ArchEnum arch_;
+  bool resolve_names_ = true;
+  std::vector<std::unique_ptr<Regs>> owned_regs_;
+  std::vector<std::unique_ptr<Unwinder>> unwinders_;
+};
+
 }  // namespace unwindstack
 
 #endif  // _LIBUNWINDSTACK_UNWINDER_H
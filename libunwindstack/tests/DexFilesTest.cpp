@@ -265,6 +265,29 @@ TEST_F(DexFilesTest, get_method_information_search_libs) {
   EXPECT_EQ(4U, method_offset);
 }
 
+TEST_F(DexFilesTest, get_method_information_entry_added_after_scan) {
+  std::string method_name = "nothing";
+  uint64_t method_offset = 0x124;
+  MapInfo* info = maps_->Get(kMapDexFiles);
+
+  WriteDescriptor32(0xf800, 0x200000);
+  WriteEntry32(0x200000, 0, 0, 0x100000);
+
+  dex_files_->GetMethodInformation(maps_.get(), info, 0x300100, &method_name, &method_offset);
+  EXPECT_EQ("nothing", method_name);
+  EXPECT_EQ(0x124U, method_offset);
+
+  // Add a new entry at the start of the list.
+  WriteEntry32(0x200100, 0x200000, 0, 0x300000);
+  WriteEntry32(0x200000, 0, 0x200100, 0x100000);
+  WriteDescriptor32(0xf800, 0x200100);
+  WriteDex(0x300000);
+
+  dex_files_->GetMethodInformation(maps_.get(), info, 0x300100, &method_name, &method_offset);
+  EXPECT_EQ("Main.<init>", method_name);
+  EXPECT_EQ(0U, method_offset);
+}
+
 TEST_F(DexFilesTest, get_method_information_global_skip_zero_32) {
   std::string method_name = "nothing";
   uint64_t method_offset = 0x124;
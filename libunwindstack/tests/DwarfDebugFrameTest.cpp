@@ -15,7 +15,13 @@
  */
 
 #include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -42,6 +48,8 @@ class MockDwarfDebugFrame : public DwarfDebugFrame<TypeParam> {
     this->fdes_.push_back(info);
   }
 
+  using DwarfDebugFrame<TypeParam>::GetIndexPath;
+
   uint64_t TestGetFdeCount() { return this->fde_count_; }
   uint8_t TestGetOffset() { return this->offset_; }
   uint8_t TestGetEndOffset() { return this->end_offset_; }
@@ -393,6 +401,80 @@ TYPED_TEST_P(DwarfDebugFrameTest, Init_version4) {
   EXPECT_EQ(0x1700U, info.end);
 }
 
+TYPED_TEST_P(DwarfDebugFrameTest, Init_index) {
+  // The index is keyed by the whole section, so it all has to be readable.
+  this->memory_.SetMemory(0x5000, std::vector<uint8_t>(0x300, 0));
+
+  // CIE 32 information.
+  this->memory_.SetData32(0x5000, 0xfc);
+  this->memory_.SetData32(0x5004, 0xffffffff);
+  this->memory_.SetData8(0x5008, 1);
+  this->memory_.SetData8(0x5009, '\0');
+
+  // FDE 32 information.
+  this->memory_.SetData32(0x5100, 0xfc);
+  this->memory_.SetData32(0x5104, 0);
+  this->memory_.SetData32(0x5108, 0x2500);
+  this->memory_.SetData32(0x510c, 0x300);
+
+  this->memory_.SetData32(0x5200, 0xfc);
+  this->memory_.SetData32(0x5204, 0);
+  this->memory_.SetData32(0x5208, 0x1500);
+  this->memory_.SetData32(0x520c, 0x200);
+
+  TemporaryDir dir;
+  DwarfSection::SetIndexDirectory(dir.path);
+  ASSERT_TRUE(this->debug_frame_->Init(0x5000, 0x300));
+  ASSERT_EQ(2U, this->debug_frame_->TestGetFdeCount());
+
+  std::string index_path;
+  ASSERT_TRUE(this->debug_frame_->GetIndexPath(&index_path));
+  std::string index;
+  ASSERT_TRUE(android::base::ReadFileToString(index_path, &index));
+
+  // Move the second entry in the saved index, a new section over the same
+  // memory must take it from there rather than from the fdes.
+  typename DwarfDebugFrame<TypeParam>::FdeInfo info(0, 0, 0);
+  size_t entry = index.size() - sizeof(info);
+  memcpy(&info, &index[entry], sizeof(info));
+  ASSERT_EQ(0x5100U, info.offset);
+  info.end = 0x4000;
+  memcpy(&index[entry], &info, sizeof(info));
+  ASSERT_TRUE(android::base::WriteStringToFile(index, index_path));
+
+  MockDwarfDebugFrame<TypeParam> debug_frame(&this->memory_);
+  ASSERT_TRUE(debug_frame.Init(0x5000, 0x300));
+  ASSERT_EQ(2U, debug_frame.TestGetFdeCount());
+  debug_frame.TestGetFdeInfo(0, &info);
+  EXPECT_EQ(0x5200U, info.offset);
+  EXPECT_EQ(0x1500U, info.start);
+  EXPECT_EQ(0x1700U, info.end);
+  debug_frame.TestGetFdeInfo(1, &info);
+  EXPECT_EQ(0x5100U, info.offset);
+  EXPECT_EQ(0x2500U, info.start);
+  EXPECT_EQ(0x4000U, info.end);
+
+  // A truncated index is ignored, and written out again.
+  ASSERT_EQ(0, truncate(index_path.c_str(), index.size() - 1));
+  MockDwarfDebugFrame<TypeParam> debug_frame_rescan(&this->memory_);
+  ASSERT_TRUE(debug_frame_rescan.Init(0x5000, 0x300));
+  ASSERT_EQ(2U, debug_frame_rescan.TestGetFdeCount());
+  debug_frame_rescan.TestGetFdeInfo(1, &info);
+  EXPECT_EQ(0x2800U, info.end);
+  struct stat st;
+  ASSERT_EQ(0, stat(index_path.c_str(), &st));
+  EXPECT_EQ(static_cast<off_t>(index.size()), st.st_size);
+
+  // A different section misses the index.
+  this->memory_.SetData32(0x520c, 0x100);
+  MockDwarfDebugFrame<TypeParam> debug_frame_changed(&this->memory_);
+  ASSERT_TRUE(debug_frame_changed.Init(0x5000, 0x300));
+  debug_frame_changed.TestGetFdeInfo(0, &info);
+  EXPECT_EQ(0x1600U, info.end);
+
+  DwarfSection::SetIndexDirectory("");
+}
+
 TYPED_TEST_P(DwarfDebugFrameTest, GetFdeOffsetFromPc) {
   typename DwarfDebugFrame<TypeParam>::FdeInfo info(0, 0, 0);
   for (size_t i = 0; i < 9; i++) {
@@ -538,8 +620,8 @@ TYPED_TEST_P(DwarfDebugFrameTest, GetCieFde64) {
 REGISTER_TYPED_TEST_CASE_P(DwarfDebugFrameTest, Init32, Init32_fde_not_following_cie,
                            Init32_do_not_fail_on_bad_next_entry, Init64,
                            Init64_do_not_fail_on_bad_next_entry, Init64_fde_not_following_cie,
-                           Init_version1, Init_version4, GetFdeOffsetFromPc, GetCieFde32,
-                           GetCieFde64);
+                           Init_version1, Init_version4, Init_index, GetFdeOffsetFromPc,
+                           GetCieFde32, GetCieFde64);
 
 typedef ::testing::Types<uint32_t, uint64_t> DwarfDebugFrameTestTypes;
 INSTANTIATE_TYPED_TEST_CASE_P(, DwarfDebugFrameTest, DwarfDebugFrameTestTypes);
@@ -233,4 +233,79 @@ TEST_F(DwarfSectionTest, Step_cache_not_in_pc) {
   ASSERT_TRUE(mock_section.Step(0x700, nullptr, &process, &finished));
 }
 
+TEST_F(DwarfSectionTest, Step_cache_counters) {
+  MockDwarfSection mock_section(&memory_);
+
+  DwarfCie cie{};
+  DwarfFde fde{};
+  fde.pc_start = 0x500;
+  fde.pc_end = 0x2000;
+  fde.cie = &cie;
+
+  EXPECT_CALL(mock_section, GetFdeOffsetFromPc(0x1000, ::testing::_))
+      .WillOnce(::testing::Return(true));
+  EXPECT_CALL(mock_section, GetFdeFromOffset(::testing::_)).WillOnce(::testing::Return(&fde));
+  EXPECT_CALL(mock_section, GetCfaLocationInfo(0x1000, &fde, ::testing::_))
+      .WillOnce(::testing::Invoke(MockGetCfaLocationInfo));
+
+  MemoryFake process;
+  EXPECT_CALL(mock_section, Eval(&cie, &process, ::testing::_, nullptr, ::testing::_))
+      .WillRepeatedly(::testing::Return(true));
+
+  bool finished;
+  ASSERT_TRUE(mock_section.Step(0x1000, nullptr, &process, &finished));
+  ASSERT_EQ(0U, mock_section.LocRegsCacheHits());
+  ASSERT_EQ(1U, mock_section.LocRegsCacheMisses());
+
+  ASSERT_TRUE(mock_section.Step(0x1000, nullptr, &process, &finished));
+  ASSERT_TRUE(mock_section.Step(0x1fff, nullptr, &process, &finished));
+  ASSERT_EQ(2U, mock_section.LocRegsCacheHits());
+  ASSERT_EQ(1U, mock_section.LocRegsCacheMisses());
+  ASSERT_EQ(1U, mock_section.LocRegsCacheEntries());
+}
+
+TEST_F(DwarfSectionTest, Step_cache_size) {
+  DwarfSection::SetLocRegsCacheSize(2);
+  MockDwarfSection mock_section(&memory_);
+
+  DwarfCie cie{};
+  DwarfFde fdes[3]{};
+  for (size_t i = 0; i < 3; i++) {
+    fdes[i].pc_start = 0x1000 * (i + 1);
+    fdes[i].pc_end = 0x1000 * (i + 2);
+    fdes[i].cie = &cie;
+  }
+  EXPECT_CALL(mock_section, GetFdeOffsetFromPc(::testing::_, ::testing::_))
+      .WillRepeatedly(::testing::Invoke([](uint64_t pc, uint64_t* fde_offset) {
+        *fde_offset = pc / 0x1000 - 1;
+        return true;
+      }));
+  EXPECT_CALL(mock_section, GetFdeFromOffset(::testing::_))
+      .WillRepeatedly(::testing::Invoke([&fdes](uint64_t offset) { return &fdes[offset]; }));
+  EXPECT_CALL(mock_section, GetCfaLocationInfo(::testing::_, ::testing::_, ::testing::_))
+      .WillRepeatedly(::testing::Invoke(MockGetCfaLocationInfo));
+
+  MemoryFake process;
+  EXPECT_CALL(mock_section, Eval(&cie, &process, ::testing::_, nullptr, ::testing::_))
+      .WillRepeatedly(::testing::Return(true));
+
+  bool finished;
+  ASSERT_TRUE(mock_section.Step(0x1000, nullptr, &process, &finished));
+  ASSERT_TRUE(mock_section.Step(0x2000, nullptr, &process, &finished));
+  // Make the first row the most recently used, the second one is dropped.
+  ASSERT_TRUE(mock_section.Step(0x1100, nullptr, &process, &finished));
+  ASSERT_TRUE(mock_section.Step(0x3000, nullptr, &process, &finished));
+  ASSERT_EQ(2U, mock_section.LocRegsCacheEntries());
+  ASSERT_EQ(1U, mock_section.LocRegsCacheHits());
+  ASSERT_EQ(3U, mock_section.LocRegsCacheMisses());
+
+  ASSERT_TRUE(mock_section.Step(0x1200, nullptr, &process, &finished));
+  ASSERT_TRUE(mock_section.Step(0x3100, nullptr, &process, &finished));
+  ASSERT_EQ(3U, mock_section.LocRegsCacheHits());
+  ASSERT_TRUE(mock_section.Step(0x2100, nullptr, &process, &finished));
+  ASSERT_EQ(4U, mock_section.LocRegsCacheMisses());
+
+  DwarfSection::SetLocRegsCacheSize(0);
+}
+
 }  // namespace unwindstack
@@ -36,7 +36,10 @@ class ElfCacheTest : public ::testing::Test {
 
   void SetUp() override { Elf::SetCachingEnabled(true); }
 
-  void TearDown() override { Elf::SetCachingEnabled(false); }
+  void TearDown() override {
+    Elf::SetCachingEnabled(false);
+    Elf::SetCacheLimit(0);
+  }
 
   void WriteElfFile(uint64_t offset, TemporaryFile* tf, uint32_t type) {
     ASSERT_TRUE(type == EM_ARM || type == EM_386 || type == EM_X86_64);
@@ -261,4 +264,89 @@ TEST_F(ElfCacheTest, caching_valid_elf_offset_non_zero_never_read_at_zero) {
   VerifyWithinSameMapNeverReadAtZero(true);
 }
 
+TEST_F(ElfCacheTest, cache_stats) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  WriteElfFile(0, &tf, EM_ARM);
+  close(tf.fd);
+
+  MapInfo info1(0x1000, 0x20000, 0, 0x5, tf.path);
+  MapInfo info2(0x1000, 0x20000, 0, 0x5, tf.path);
+  Elf* elf1 = info1.GetElf(memory_, true);
+  ASSERT_TRUE(elf1->valid());
+  ASSERT_EQ(elf1, info2.GetElf(memory_, true));
+
+  Elf::CacheStats stats = Elf::GetCacheStats();
+  EXPECT_EQ(1U, stats.hits);
+  EXPECT_EQ(1U, stats.misses);
+  EXPECT_EQ(0U, stats.evictions);
+  EXPECT_EQ(1U, stats.entries);
+  EXPECT_EQ(1U, stats.elfs);
+  EXPECT_EQ(elf1->CacheFootprint(), stats.bytes);
+}
+
+// Verify that the names of one elf at several offsets share it in the stats.
+TEST_F(ElfCacheTest, cache_stats_shared_elf) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  WriteElfFile(0, &tf, EM_ARM);
+  lseek(tf.fd, 0x500, SEEK_SET);
+  uint8_t value = 0;
+  write(tf.fd, &value, 1);
+  close(tf.fd);
+
+  MapInfo info300(0x1000, 0x20000, 0x300, 0x5, tf.path);
+  MapInfo info400(0x1000, 0x20000, 0x400, 0x5, tf.path);
+  Elf* elf300 = info300.GetElf(memory_, true);
+  ASSERT_TRUE(elf300->valid());
+  ASSERT_EQ(elf300, info400.GetElf(memory_, true));
+
+  Elf::CacheStats stats = Elf::GetCacheStats();
+  EXPECT_EQ(1U, stats.hits);
+  EXPECT_EQ(1U, stats.misses);
+  EXPECT_EQ(3U, stats.entries);
+  EXPECT_EQ(1U, stats.elfs);
+  EXPECT_EQ(elf300->CacheFootprint(), stats.bytes);
+}
+
+TEST_F(ElfCacheTest, cache_limit_evicts_least_recently_used) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  WriteElfFile(0x100, &tf, EM_386);
+  WriteElfFile(0x200, &tf, EM_X86_64);
+  lseek(tf.fd, 0x500, SEEK_SET);
+  uint8_t value = 0;
+  write(tf.fd, &value, 1);
+  close(tf.fd);
+
+  // Any elf is over the limit, so only the last one added stays.
+  Elf::SetCacheLimit(1);
+  MapInfo info100_1(0x1000, 0x20000, 0x100, 0x5, tf.path);
+  MapInfo info100_2(0x1000, 0x20000, 0x100, 0x5, tf.path);
+  MapInfo info200_1(0x1000, 0x20000, 0x200, 0x5, tf.path);
+  MapInfo info200_2(0x1000, 0x20000, 0x200, 0x5, tf.path);
+
+  Elf* elf100_1 = info100_1.GetElf(memory_, true);
+  ASSERT_TRUE(elf100_1->valid());
+  Elf* elf200_1 = info200_1.GetElf(memory_, true);
+  ASSERT_TRUE(elf200_1->valid());
+  EXPECT_EQ(elf200_1, info200_2.GetElf(memory_, true));
+
+  Elf::CacheStats stats = Elf::GetCacheStats();
+  EXPECT_EQ(1U, stats.evictions);
+  EXPECT_EQ(1U, stats.entries);
+
+  // The evicted elf stays valid for the maps that have it, but isn't shared anymore.
+  Elf* elf100_2 = info100_2.GetElf(memory_, true);
+  ASSERT_TRUE(elf100_2->valid());
+  EXPECT_NE(elf100_1, elf100_2);
+  EXPECT_EQ(ARCH_X86, elf100_1->arch());
+
+  stats = Elf::GetCacheStats();
+  EXPECT_EQ(1U, stats.hits);
+  EXPECT_EQ(3U, stats.misses);
+  EXPECT_EQ(2U, stats.evictions);
+  EXPECT_EQ(1U, stats.entries);
+}
+
 }  // namespace unwindstack
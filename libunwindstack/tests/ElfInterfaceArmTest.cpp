@@ -154,6 +154,45 @@ TEST_F(ElfInterfaceArmTest, FindEntry_last_check_multiple_entries) {
   ASSERT_EQ(0x1008U, entry_offset);
 }
 
+TEST_F(ElfInterfaceArmTest, FindEntry_whole_table_read) {
+  ElfInterfaceArmFake interface(&memory_);
+  interface.FakeSetStartOffset(0x1000);
+  interface.FakeSetTotalEntries(3);
+  memory_.SetData32(0x1000, 0x5000);
+  memory_.SetData32(0x1004, 1);
+  memory_.SetData32(0x1008, 0x6000);
+  memory_.SetData32(0x100c, 1);
+  memory_.SetData32(0x1010, 0x7000);
+  memory_.SetData32(0x1014, 1);
+
+  // Only the middle entry is needed for this pc.
+  uint64_t entry_offset;
+  ASSERT_TRUE(interface.FindEntry(0x7008, &entry_offset));
+  ASSERT_EQ(0x1008U, entry_offset);
+
+  // Every entry was read along with it.
+  memory_.Clear();
+  ASSERT_TRUE(interface.FindEntry(0x6100, &entry_offset));
+  ASSERT_EQ(0x1000U, entry_offset);
+  ASSERT_TRUE(interface.FindEntry(0x8100, &entry_offset));
+  ASSERT_EQ(0x1010U, entry_offset);
+}
+
+TEST_F(ElfInterfaceArmTest, FindEntry_partial_table) {
+  ElfInterfaceArmFake interface(&memory_);
+  interface.FakeSetStartOffset(0x1000);
+  interface.FakeSetTotalEntries(3);
+  memory_.SetData32(0x1000, 0x5000);
+  memory_.SetData32(0x1008, 0x6000);
+
+  // The last entry can't be read, the others are still found.
+  uint64_t entry_offset;
+  ASSERT_TRUE(interface.FindEntry(0x6100, &entry_offset));
+  ASSERT_EQ(0x1000U, entry_offset);
+  ASSERT_TRUE(interface.FindEntry(0x7008, &entry_offset));
+  ASSERT_EQ(0x1008U, entry_offset);
+}
+
 TEST_F(ElfInterfaceArmTest, FindEntry_multiple_entries_even) {
   ElfInterfaceArmFake interface(&memory_);
   interface.FakeSetStartOffset(0x1000);
@@ -394,6 +433,34 @@ TEST_F(ElfInterfaceArmTest, StepExidx_cant_unwind) {
   ASSERT_EQ(0x1234U, regs.pc());
 }
 
+TEST_F(ElfInterfaceArmTest, StepExidx_entry_data_cached) {
+  ElfInterfaceArmFake interface(&memory_);
+
+  interface.FakeSetStartOffset(0x1000);
+  interface.FakeSetTotalEntries(1);
+  memory_.SetData32(0x1000, 0x6000);
+  memory_.SetData32(0x1004, 0x80b0b0b0);
+
+  RegsArm regs;
+  regs[ARM_REG_SP] = 0x1000;
+  regs[ARM_REG_LR] = 0x20000;
+  regs.set_sp(regs[ARM_REG_SP]);
+  regs.set_pc(0x1234);
+
+  bool finished;
+  ASSERT_TRUE(interface.StepExidx(0x7000, 0, &regs, &process_memory_, &finished));
+  ASSERT_FALSE(finished);
+  ASSERT_EQ(0x20000U, regs.pc());
+
+  // The unwind data is not read again.
+  memory_.Clear();
+  regs.set_pc(0x1234);
+  ASSERT_TRUE(interface.StepExidx(0x7000, 0, &regs, &process_memory_, &finished));
+  ASSERT_FALSE(finished);
+  ASSERT_EQ(0x1000U, regs.sp());
+  ASSERT_EQ(0x20000U, regs.pc());
+}
+
 TEST_F(ElfInterfaceArmTest, StepExidx_refuse_unwind) {
   ElfInterfaceArmFake interface(&memory_);
 
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <dirent.h>
 #include <elf.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -23,6 +24,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+
 #include <unwindstack/Elf.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/RegsArm.h>
@@ -290,6 +294,82 @@ TEST_F(ElfTest, gnu_debugdata_init64) {
   EXPECT_EQ(0x90U, elf.interface()->gnu_debugdata_size());
 }
 
+static std::vector<std::string> CacheFiles(const char* directory) {
+  std::vector<std::string> files;
+  std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(directory), closedir);
+  struct dirent* entry;
+  while (dir != nullptr && (entry = readdir(dir.get())) != nullptr) {
+    if (entry->d_name[0] != '.') {
+      files.push_back(std::string(directory) + '/' + entry->d_name);
+    }
+  }
+  return files;
+}
+
+TEST_F(ElfTest, gnu_debugdata_cache) {
+  TemporaryDir dir;
+  ElfInterface::SetGnuDebugdataCache(dir.path, 0);
+  TestInitGnuDebugdata<Elf64_Ehdr, Elf64_Shdr>(ELFCLASS64, EM_AARCH64, true,
+                                               [&](uint64_t offset, const void* ptr, size_t size) {
+                                                 memory_->SetMemory(offset, ptr, size);
+                                               });
+
+  Elf elf(memory_);
+  ASSERT_TRUE(elf.Init(true));
+  ASSERT_TRUE(elf.gnu_debugdata_interface() != nullptr);
+  std::vector<std::string> files(CacheFiles(dir.path));
+  ASSERT_EQ(1U, files.size());
+
+  // Make the file look old, using it again marks it as used.
+  struct timespec times[2] = {{1, 0}, {1, 0}};
+  ASSERT_EQ(0, utimensat(AT_FDCWD, files[0].c_str(), times, 0));
+  std::unique_ptr<Memory> cached(elf.interface()->CreateGnuDebugdataMemory());
+  ASSERT_TRUE(cached != nullptr);
+  struct stat st;
+  ASSERT_EQ(0, stat(files[0].c_str(), &st));
+  ASSERT_NE(1, st.st_mtim.tv_sec);
+
+  // It holds the same data as the decompressed section.
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(files[0], &contents));
+  ASSERT_LT(0x20U, contents.size());
+  std::vector<uint8_t> data(contents.size() - 0x20);
+  ASSERT_TRUE(cached->ReadFully(0, data.data(), data.size()));
+  ASSERT_EQ(0, memcmp(&contents[0x20], data.data(), data.size()));
+
+  ElfInterface::SetGnuDebugdataCache("", 0);
+}
+
+TEST_F(ElfTest, gnu_debugdata_cache_trim) {
+  TemporaryDir dir;
+  // Small enough that only the newest file is kept.
+  ElfInterface::SetGnuDebugdataCache(dir.path, 1);
+
+  TestInitGnuDebugdata<Elf32_Ehdr, Elf32_Shdr>(ELFCLASS32, EM_ARM, true,
+                                               [&](uint64_t offset, const void* ptr, size_t size) {
+                                                 memory_->SetMemory(offset, ptr, size);
+                                               });
+  Elf elf32(memory_);
+  ASSERT_TRUE(elf32.Init(true));
+  ASSERT_TRUE(elf32.gnu_debugdata_interface() != nullptr);
+  std::vector<std::string> files32(CacheFiles(dir.path));
+  ASSERT_EQ(1U, files32.size());
+
+  MemoryFake* memory64 = new MemoryFake;
+  TestInitGnuDebugdata<Elf64_Ehdr, Elf64_Shdr>(ELFCLASS64, EM_AARCH64, true,
+                                               [&](uint64_t offset, const void* ptr, size_t size) {
+                                                 memory64->SetMemory(offset, ptr, size);
+                                               });
+  Elf elf64(memory64);
+  ASSERT_TRUE(elf64.Init(true));
+  ASSERT_TRUE(elf64.gnu_debugdata_interface() != nullptr);
+  std::vector<std::string> files64(CacheFiles(dir.path));
+  ASSERT_EQ(1U, files64.size());
+  ASSERT_NE(files32[0], files64[0]);
+
+  ElfInterface::SetGnuDebugdataCache("", 0);
+}
+
 TEST_F(ElfTest, rel_pc) {
   ElfFake elf(memory_);
 
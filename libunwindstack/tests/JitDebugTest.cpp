@@ -382,6 +382,49 @@ TEST_F(JitDebugTest, get_elf_multiple_entries) {
   EXPECT_EQ(nullptr, jit_debug_->GetElf(maps_.get(), 0x2700));
 }
 
+TEST_F(JitDebugTest, get_elf_entry_added_after_scan) {
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x5000, ELFCLASS32, EM_ARM, 0x2300, 0x400);
+
+  WriteDescriptor32(0xf800, 0x200000);
+  WriteEntry32Pad(0x200000, 0, 0, 0x4000, 0x1000);
+
+  Elf* elf_1 = jit_debug_->GetElf(maps_.get(), 0x1500);
+  ASSERT_TRUE(elf_1 != nullptr);
+  ASSERT_TRUE(jit_debug_->GetElf(maps_.get(), 0x2300) == nullptr);
+
+  // Add a new entry at the start of the list.
+  WriteEntry32Pad(0x200100, 0x200000, 0, 0x5000, 0x1000);
+  WriteEntry32Pad(0x200000, 0, 0x200100, 0x4000, 0x1000);
+  WriteDescriptor32(0xf800, 0x200100);
+
+  Elf* elf_2 = jit_debug_->GetElf(maps_.get(), 0x2300);
+  ASSERT_TRUE(elf_2 != nullptr);
+  EXPECT_NE(elf_1, elf_2);
+  EXPECT_EQ(elf_1, jit_debug_->GetElf(maps_.get(), 0x1500));
+  EXPECT_EQ(elf_2, jit_debug_->GetElf(maps_.get(), 0x26ff));
+}
+
+TEST_F(JitDebugTest, get_elf_code_replaced) {
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x5000, ELFCLASS32, EM_ARM, 0x1500, 0x300);
+
+  WriteDescriptor32(0xf800, 0x200000);
+  WriteEntry32Pad(0x200000, 0, 0, 0x4000, 0x1000);
+
+  Elf* elf_1 = jit_debug_->GetElf(maps_.get(), 0x1500);
+  ASSERT_TRUE(elf_1 != nullptr);
+
+  // The code was freed, and new code covering the same pcs registered.
+  WriteEntry32Pad(0x200100, 0, 0, 0x5000, 0x1000);
+  WriteDescriptor32(0xf800, 0x200100);
+
+  Elf* elf_2 = jit_debug_->GetElf(maps_.get(), 0x1750);
+  ASSERT_TRUE(elf_2 != nullptr);
+  EXPECT_NE(elf_1, elf_2);
+  EXPECT_EQ(elf_2, jit_debug_->GetElf(maps_.get(), 0x1500));
+}
+
 TEST_F(JitDebugTest, get_elf_search_libs) {
   CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
 
@@ -91,6 +91,27 @@ TEST_F(MapInfoGetElfTest, valid32) {
   EXPECT_EQ(ELFCLASS32, elf->class_type());
 }
 
+TEST_F(MapInfoGetElfTest, share_elf) {
+  MapInfo info(0x3000, 0x4000, 0, PROT_READ, "");
+  MapInfo other(0x3000, 0x4000, 0, PROT_READ, "");
+
+  // Nothing to share until other has created its elf.
+  info.ShareElf(&other);
+  ASSERT_TRUE(info.elf == nullptr);
+
+  Elf32_Ehdr ehdr;
+  TestInitEhdr<Elf32_Ehdr>(&ehdr, ELFCLASS32, EM_ARM);
+  memory_->SetMemory(0x3000, &ehdr, sizeof(ehdr));
+  Elf* elf = other.GetElf(process_memory_, false);
+  ASSERT_TRUE(elf != nullptr);
+  ASSERT_EQ(0U, other.GetLoadBias(process_memory_));
+
+  info.ShareElf(&other);
+  ASSERT_EQ(elf, info.elf.get());
+  ASSERT_EQ(elf, info.GetElf(process_memory_, false));
+  ASSERT_EQ(0U, info.load_bias.load());
+}
+
 TEST_F(MapInfoGetElfTest, valid64) {
   MapInfo info(0x8000, 0x9000, 0, PROT_READ, "");
 
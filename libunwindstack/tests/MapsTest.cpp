@@ -538,6 +538,80 @@ TEST(MapsTest, large_file) {
   }
 }
 
+TEST(MapsTest, reparse) {
+  TemporaryFile tf;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("1000-2000 r-xp 00000000 00:00 0 /system/lib/liba.so\n"
+                                        "3000-4000 r-xp 00000000 00:00 0 /system/lib/libb.so\n"
+                                        "5000-6000 rw-p 00000000 00:00 0\n"
+                                        "7000-8000 r--p 00001000 00:00 0 /system/lib/libc.so\n",
+                                        tf.path, 0660, getuid(), getgid()));
+
+  FileMaps maps(tf.path);
+  ASSERT_TRUE(maps.Parse());
+  ASSERT_EQ(4U, maps.Total());
+  MapInfo* liba = maps.Get(0);
+  MapInfo* anon = maps.Get(2);
+  MapInfo* libc = maps.Get(3);
+  liba->load_bias = 0x100;
+
+  // libb unmapped, libd loaded, the anonymous map grew and libc's flags changed.
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("1000-2000 r-xp 00000000 00:00 0 /system/lib/liba.so\n"
+                                        "5000-6800 rw-p 00000000 00:00 0\n"
+                                        "7000-8000 r-xp 00001000 00:00 0 /system/lib/libc.so\n"
+                                        "9000-a000 r-xp 00000000 00:00 0 /system/lib/libd.so\n",
+                                        tf.path, 0660, getuid(), getgid()));
+  std::vector<MapInfo*> added;
+  std::vector<std::unique_ptr<MapInfo>> removed;
+  ASSERT_TRUE(maps.Reparse(&added, &removed));
+  ASSERT_EQ(4U, maps.Total());
+
+  ASSERT_EQ(liba, maps.Get(0));
+  ASSERT_EQ(0x100U, maps.Get(0)->load_bias);
+
+  ASSERT_EQ(3U, added.size());
+  EXPECT_EQ(maps.Get(1), added[0]);
+  EXPECT_EQ(0x6800U, added[0]->end);
+  EXPECT_EQ(maps.Get(2), added[1]);
+  EXPECT_EQ(PROT_READ | PROT_EXEC, added[1]->flags);
+  EXPECT_EQ(maps.Get(3), added[2]);
+  EXPECT_EQ("/system/lib/libd.so", added[2]->name);
+
+  ASSERT_EQ(3U, removed.size());
+  EXPECT_EQ("/system/lib/libb.so", removed[0]->name);
+  EXPECT_EQ(anon, removed[1].get());
+  EXPECT_EQ(libc, removed[2].get());
+
+  // Nothing changed.
+  added.clear();
+  removed.clear();
+  MapInfo* map = maps.Get(3);
+  ASSERT_TRUE(maps.Reparse(&added, &removed));
+  ASSERT_TRUE(added.empty());
+  ASSERT_TRUE(removed.empty());
+  ASSERT_EQ(map, maps.Get(3));
+}
+
+TEST(MapsTest, reparse_fail) {
+  TemporaryFile tf;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("1000-2000 r-xp 00000000 00:00 0 /system/lib/liba.so\n",
+                                        tf.path, 0660, getuid(), getgid()));
+
+  FileMaps maps(tf.path);
+  ASSERT_TRUE(maps.Parse());
+  MapInfo* liba = maps.Get(0);
+
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("1000-2000 r-xp 00000000 00:00 0 /system/lib/liba.so\n"
+                                        "not a map\n",
+                                        tf.path, 0660, getuid(), getgid()));
+  ASSERT_FALSE(maps.Reparse());
+  ASSERT_EQ(1U, maps.Total());
+  ASSERT_EQ(liba, maps.Get(0));
+}
+
 TEST(MapsTest, find) {
   BufferMaps maps(
       "1000-2000 r--p 00000010 00:00 0 /system/lib/fake1.so\n"
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <unwindstack/Memory.h>
+
+#include "MemoryFake.h"
+
+namespace unwindstack {
+
+class MemoryFakeCounting : public MemoryFake {
+ public:
+  size_t Read(uint64_t addr, void* buffer, size_t size) override {
+    reads++;
+    return MemoryFake::Read(addr, buffer, size);
+  }
+
+  size_t reads = 0;
+};
+
+class MemoryCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memory_ = new MemoryFakeCounting;
+    memory_cache_.reset(new MemoryCache(memory_));
+
+    memory_->SetMemory(0x10000, std::vector<uint8_t>(8192, 0x1a));
+  }
+
+  MemoryFakeCounting* memory_;
+  std::unique_ptr<MemoryCache> memory_cache_;
+};
+
+TEST_F(MemoryCacheTest, cached_read) {
+  uint64_t value;
+  ASSERT_TRUE(memory_cache_->Read64(0x10000, &value));
+  ASSERT_EQ(0x1a1a1a1a1a1a1a1aULL, value);
+  ASSERT_EQ(1U, memory_->reads);
+
+  // Served from the page read in above, even though the memory changed.
+  memory_->SetData64(0x10010, 0x1234);
+  ASSERT_TRUE(memory_cache_->Read64(0x10010, &value));
+  ASSERT_EQ(0x1a1a1a1a1a1a1a1aULL, value);
+  ASSERT_TRUE(memory_cache_->Read64(0x10ff8, &value));
+  ASSERT_EQ(1U, memory_->reads);
+
+  memory_cache_->Clear();
+  ASSERT_TRUE(memory_cache_->Read64(0x10010, &value));
+  ASSERT_EQ(0x1234U, value);
+  ASSERT_EQ(2U, memory_->reads);
+}
+
+TEST_F(MemoryCacheTest, read_across_pages) {
+  memory_->SetData32(0x10ffe, 0x12345678);
+  uint32_t value;
+  ASSERT_TRUE(memory_cache_->Read32(0x10ffe, &value));
+  ASSERT_EQ(0x12345678U, value);
+  ASSERT_EQ(2U, memory_->reads);
+
+  ASSERT_TRUE(memory_cache_->Read32(0x11000, &value));
+  ASSERT_EQ(2U, memory_->reads);
+}
+
+TEST_F(MemoryCacheTest, read_partial_page) {
+  // Only the start of the page after the cached ones is readable.
+  memory_->SetMemory(0x12000, std::vector<uint8_t>(16, 0x2b));
+
+  uint64_t value;
+  ASSERT_TRUE(memory_cache_->Read64(0x12008, &value));
+  ASSERT_EQ(0x2b2b2b2b2b2b2b2bULL, value);
+  ASSERT_FALSE(memory_cache_->Read64(0x1200c, &value));
+
+  // Running from a cached page into the partial one.
+  uint8_t data[24];
+  ASSERT_EQ(20U, memory_cache_->Read(0x11ffc, data, sizeof(data)));
+  for (size_t i = 0; i < 20; i++) {
+    ASSERT_EQ(i < 4 ? 0x1a : 0x2b, data[i]) << "Failed at byte " << i;
+  }
+}
+
+TEST_F(MemoryCacheTest, large_read_not_cached) {
+  std::vector<uint8_t> buffer(1024);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x10000, buffer.data(), buffer.size()));
+  ASSERT_EQ(1U, memory_->reads);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x10000, buffer.data(), buffer.size()));
+  ASSERT_EQ(2U, memory_->reads);
+  for (size_t i = 0; i < buffer.size(); i++) {
+    ASSERT_EQ(0x1aU, buffer[i]) << "Failed at byte " << i;
+  }
+}
+
+TEST_F(MemoryCacheTest, read_string) {
+  memory_->SetMemory(0x10100, std::string("short string"));
+  std::string name;
+  ASSERT_TRUE(memory_cache_->ReadString(0x10100, &name));
+  ASSERT_EQ("short string", name);
+  ASSERT_EQ(1U, memory_->reads);
+}
+
+TEST_F(MemoryCacheTest, unreadable) {
+  uint64_t value;
+  ASSERT_FALSE(memory_cache_->Read64(0x40000, &value));
+  ASSERT_FALSE(memory_cache_->Read64(UINT64_MAX - 3, &value));
+}
+
+}  // namespace unwindstack
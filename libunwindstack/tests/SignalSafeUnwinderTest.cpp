@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsGetLocal.h>
+#include <unwindstack/SignalSafeUnwinder.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+static SignalSafeUnwinder* g_unwinder;
+static Regs* g_regs;
+static uint64_t g_pcs[64];
+static size_t g_num_pcs;
+
+static std::string FunctionName(Maps* maps, uint64_t pc) {
+  MapInfo* map_info = maps->Find(pc);
+  if (map_info == nullptr || map_info->elf == nullptr) {
+    return "";
+  }
+  std::string name;
+  uint64_t offset;
+  if (!map_info->elf->GetFunctionName(map_info->elf->GetRelPc(pc, map_info), &name, &offset)) {
+    return "";
+  }
+  return name;
+}
+
+static void VerifyOrder(Maps* maps, std::vector<std::string> names) {
+  std::string unwind;
+  for (size_t i = 0; i < g_num_pcs; i++) {
+    std::string name = FunctionName(maps, g_pcs[i]);
+    unwind += "  " + name + "\n";
+    if (!names.empty() && name == names.front()) {
+      names.erase(names.begin());
+    }
+  }
+  ASSERT_TRUE(names.empty()) << "Did not find " << names.front() << " in:\n" << unwind;
+}
+
+// This test assumes that this code is compiled with optimizations turned
+// off. If this doesn't happen, then all of the calls will be optimized
+// away.
+extern "C" void SignalSafeInnerFunction(Maps* maps) {
+  std::unique_ptr<Regs> regs(Regs::CreateFromLocal());
+  RegsGetLocal(regs.get());
+  g_num_pcs = g_unwinder->Unwind(regs.get(), g_pcs, 64);
+
+  RegsGetLocal(regs.get());
+  Unwinder unwinder(64, maps, regs.get(), Memory::CreateProcessMemory(getpid()));
+  unwinder.Unwind();
+
+  // The first two frames are the register read and its return address,
+  // which differ between the two calls; everything from the caller of this
+  // function up to the test function must match.
+  ASSERT_LT(3U, g_num_pcs);
+  size_t i;
+  for (i = 2; i < unwinder.NumFrames() && i < g_num_pcs; i++) {
+    const FrameData& frame = unwinder.frames()[i];
+    ASSERT_EQ(frame.pc, g_pcs[i]) << "Frame " << i << " " << frame.function_name;
+    if (frame.function_name == "SignalSafeOuterFunction") {
+      break;
+    }
+  }
+  ASSERT_NE(g_num_pcs, i) << "Did not reach SignalSafeOuterFunction";
+}
+
+extern "C" void SignalSafeMiddleFunction(Maps* maps) {
+  SignalSafeInnerFunction(maps);
+}
+
+extern "C" void SignalSafeOuterFunction(Maps* maps) {
+  SignalSafeMiddleFunction(maps);
+}
+
+TEST(SignalSafeUnwinderTest, local) {
+  LocalMaps maps;
+  ASSERT_TRUE(maps.Parse());
+  SignalSafeUnwinder unwinder(&maps, Memory::CreateProcessMemory(getpid()));
+  ASSERT_TRUE(unwinder.Init());
+  ASSERT_NE(0U, unwinder.NumRows());
+  g_unwinder = &unwinder;
+
+  SignalSafeOuterFunction(&maps);
+  VerifyOrder(&maps, {"SignalSafeInnerFunction", "SignalSafeMiddleFunction",
+                      "SignalSafeOuterFunction"});
+}
+
+static void SignalSafeHandler(int, siginfo_t*, void*) {
+  RegsGetLocal(g_regs);
+  g_num_pcs = g_unwinder->Unwind(g_regs, g_pcs, 64);
+}
+
+extern "C" void SignalSafeSignalInnerFunction() {
+  raise(SIGUSR1);
+}
+
+extern "C" void SignalSafeSignalMiddleFunction() {
+  SignalSafeSignalInnerFunction();
+}
+
+extern "C" void SignalSafeSignalOuterFunction() {
+  SignalSafeSignalMiddleFunction();
+}
+
+TEST(SignalSafeUnwinderTest, from_signal_handler) {
+  LocalMaps maps;
+  ASSERT_TRUE(maps.Parse());
+  SignalSafeUnwinder unwinder(&maps, Memory::CreateProcessMemory(getpid()));
+  ASSERT_TRUE(unwinder.Init());
+  std::unique_ptr<Regs> regs(Regs::CreateFromLocal());
+  g_unwinder = &unwinder;
+  g_regs = regs.get();
+  g_num_pcs = 0;
+
+  struct sigaction act, oldact;
+  memset(&act, 0, sizeof(act));
+  act.sa_sigaction = SignalSafeHandler;
+  act.sa_flags = SA_RESTART | SA_SIGINFO;
+  ASSERT_EQ(0, sigaction(SIGUSR1, &act, &oldact));
+  SignalSafeSignalOuterFunction();
+  ASSERT_EQ(0, sigaction(SIGUSR1, &oldact, nullptr));
+
+  VerifyOrder(&maps, {"SignalSafeSignalInnerFunction", "SignalSafeSignalMiddleFunction",
+                      "SignalSafeSignalOuterFunction"});
+}
+
+TEST(SignalSafeUnwinderTest, no_maps) {
+  BufferMaps maps("1000-2000 rw-p 00000000 00:00 0\n");
+  ASSERT_TRUE(maps.Parse());
+  SignalSafeUnwinder unwinder(&maps, Memory::CreateProcessMemory(getpid()));
+  ASSERT_FALSE(unwinder.Init());
+  ASSERT_EQ(0U, unwinder.NumRows());
+
+  std::unique_ptr<Regs> regs(Regs::CreateFromLocal());
+  RegsGetLocal(regs.get());
+  uint64_t pcs[4];
+  // The first frame is always reported, then the unwind stops.
+  ASSERT_EQ(1U, unwinder.Unwind(regs.get(), pcs, 4));
+}
+
+}  // namespace unwindstack
@@ -29,6 +29,7 @@
 #include <vector>
 
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
@@ -330,6 +331,57 @@ TYPED_TEST_P(SymbolsTest, symtab_read_cached) {
   ASSERT_EQ(3U, func_offset);
 }
 
+// Verify a table larger than a single read comes out sorted.
+TYPED_TEST_P(SymbolsTest, symtab_many_entries) {
+  constexpr size_t kEntries = 1000;
+  Symbols symbols(0x10000, kEntries * sizeof(TypeParam), sizeof(TypeParam), 0x1000, 0x8000);
+
+  for (size_t i = 0; i < kEntries; i++) {
+    // Spread the entries out of order over the table.
+    size_t index = (i * 7) % kEntries;
+    TypeParam sym;
+    this->InitSym(&sym, 0x100000 + index * 0x100, 0x80, index * 8);
+    this->memory_.SetMemory(0x10000 + i * sizeof(sym), &sym, sizeof(sym));
+    std::string fake_name(android::base::StringPrintf("f%04zu", index));
+    this->memory_.SetMemory(0x1000 + index * 8, fake_name.c_str(), fake_name.size() + 1);
+  }
+
+  std::string name;
+  uint64_t func_offset;
+  for (size_t index = 0; index < kEntries; index++) {
+    ASSERT_TRUE(symbols.GetName<TypeParam>(0x100000 + index * 0x100 + 0x10, 0, &this->memory_,
+                                           &name, &func_offset))
+        << "Failed at index " << index;
+    ASSERT_EQ(android::base::StringPrintf("f%04zu", index), name);
+    ASSERT_EQ(0x10U, func_offset);
+    // The gaps between functions don't belong to any of them.
+    ASSERT_FALSE(symbols.GetName<TypeParam>(0x100000 + index * 0x100 + 0x80, 0, &this->memory_,
+                                            &name, &func_offset))
+        << "Failed at index " << index;
+  }
+}
+
+// Verify the entries before an unreadable one are still used.
+TYPED_TEST_P(SymbolsTest, symtab_read_partial) {
+  Symbols symbols(0x1000, 100 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0x10, 0x100);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x2000, 0x300, 0x200);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+
+  std::string fake_name("second_entry");
+  this->memory_.SetMemory(0xa200, fake_name.c_str(), fake_name.size() + 1);
+
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x2010, 0, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("second_entry", name);
+  ASSERT_EQ(0x10U, func_offset);
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0x5000, 0, &this->memory_, &name, &func_offset));
+}
+
 TYPED_TEST_P(SymbolsTest, get_global) {
   uint64_t start_offset = 0x1000;
   uint64_t str_offset = 0xa000;
@@ -392,7 +444,8 @@ TYPED_TEST_P(SymbolsTest, get_global) {
 
 REGISTER_TYPED_TEST_CASE_P(SymbolsTest, function_bounds_check, no_symbol, multiple_entries,
                            multiple_entries_nonstandard_size, load_bias, symtab_value_out_of_bounds,
-                           symtab_read_cached, get_global);
+                           symtab_read_cached, symtab_many_entries, symtab_read_partial,
+                           get_global);
 
 typedef ::testing::Types<Elf32_Sym, Elf64_Sym> SymbolsTestTypes;
 INSTANTIATE_TYPED_TEST_CASE_P(, SymbolsTest, SymbolsTestTypes);
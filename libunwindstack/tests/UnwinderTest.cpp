@@ -1063,4 +1063,68 @@ TEST_F(UnwinderTest, format_frame) {
   }
 }
 
+TEST_F(UnwinderTest, thread_unwinder) {
+  ElfInterfaceFake::FakePushFunctionData(FunctionData("Frame0", 0));
+  ElfInterfaceFake::FakePushFunctionData(FunctionData("Frame1", 1));
+  ElfInterfaceFake::FakePushFunctionData(FunctionData("Thread1Frame0", 2));
+
+  RegsFake regs0(5);
+  regs0.FakeSetArch(ARCH_ARM);
+  regs0.set_pc(0x1000);
+  regs0.set_sp(0x10000);
+  RegsFake regs1(5);
+  regs1.FakeSetArch(ARCH_ARM);
+  regs1.set_pc(0x20300);
+  regs1.set_sp(0x10100);
+  ElfInterfaceFake::FakePushStepData(StepData(0x1102, 0x10010, false));
+  ElfInterfaceFake::FakePushStepData(StepData(0, 0, true));
+  ElfInterfaceFake::FakePushStepData(StepData(0, 0, true));
+
+  // The fakes are consumed in order, so unwind on one thread.
+  ThreadUnwinder unwinder(64, &maps_, process_memory_);
+  ASSERT_EQ(0U, unwinder.AddThread(&regs0));
+  ASSERT_EQ(1U, unwinder.AddThread(&regs1));
+  unwinder.Unwind(1);
+  ASSERT_EQ(2U, unwinder.NumThreads());
+
+  Unwinder* thread = unwinder.GetUnwinder(0);
+  EXPECT_EQ(ERROR_NONE, thread->LastErrorCode());
+  ASSERT_EQ(2U, thread->NumFrames());
+  EXPECT_EQ(0x1000U, thread->frames()[0].pc);
+  EXPECT_EQ("Frame0", thread->frames()[0].function_name);
+  EXPECT_EQ(0x1100U, thread->frames()[1].pc);
+  EXPECT_EQ("Frame1", thread->frames()[1].function_name);
+
+  thread = unwinder.GetUnwinder(1);
+  EXPECT_EQ(ERROR_NONE, thread->LastErrorCode());
+  ASSERT_EQ(1U, thread->NumFrames());
+  EXPECT_EQ(0x20300U, thread->frames()[0].pc);
+  EXPECT_EQ(0x10100U, thread->frames()[0].sp);
+  EXPECT_EQ("Thread1Frame0", thread->frames()[0].function_name);
+  EXPECT_EQ("/system/fake/libunwind.so", thread->frames()[0].map_name);
+}
+
+TEST_F(UnwinderTest, thread_unwinder_many_workers) {
+  std::vector<std::unique_ptr<RegsFake>> regs;
+  ThreadUnwinder unwinder(64, &maps_, process_memory_);
+  unwinder.SetResolveNames(false);
+  for (size_t i = 0; i < 20; i++) {
+    regs.emplace_back(new RegsFake(5));
+    regs.back()->FakeSetArch(ARCH_ARM);
+    regs.back()->set_pc(0x1000 + i * 0x10);
+    regs.back()->set_sp(0x10000 + i * 0x10);
+    ASSERT_EQ(i, unwinder.AddThread(regs.back().get()));
+  }
+  // With no step data, every thread stops after its first frame.
+  unwinder.Unwind(4);
+
+  for (size_t i = 0; i < 20; i++) {
+    Unwinder* thread = unwinder.GetUnwinder(i);
+    ASSERT_EQ(1U, thread->NumFrames()) << "Failed at thread " << i;
+    EXPECT_EQ(0x1000U + i * 0x10, thread->frames()[0].pc) << "Failed at thread " << i;
+    EXPECT_EQ(0x10000U + i * 0x10, thread->frames()[0].sp) << "Failed at thread " << i;
+    EXPECT_EQ("", thread->frames()[0].function_name) << "Failed at thread " << i;
+  }
+}
+
 }  // namespace unwindstack
@@ -72,7 +72,12 @@ struct usb_host_context *usb_host_init(void);
 /* Call this to cleanup the USB host library. */
 void usb_host_cleanup(struct usb_host_context *context);
 
-/* Call this to get the inotify file descriptor. */
+/* Call this to get the inotify file descriptor.
+ * Rather than calling usb_host_run() from a dedicated thread, a caller can
+ * call usb_host_load(), add this fd to its own poll, epoll or Looper loop, and
+ * call usb_host_read_event() whenever it is readable. The fd can be made
+ * non-blocking.
+ */
 int usb_host_get_fd(struct usb_host_context *context);
 
 /* Call this to initialize the usb host context. */
@@ -82,7 +87,10 @@ int usb_host_load(struct usb_host_context *context,
                   usb_discovery_done_cb discovery_done_cb,
                   void *client_data);
 
-/* Call this to read and handle occuring usb event. */
+/* Call this to read and handle occuring usb event.
+ * Blocks until there is one, unless the fd is non-blocking, and then handles
+ * all the events queued.
+ */
 int usb_host_read_event(struct usb_host_context *context);
 
 /* Call this to monitor the USB bus for new and removed devices.
@@ -100,6 +108,17 @@ void usb_host_run(struct usb_host_context *context,
                   usb_discovery_done_cb discovery_done_cb,
                   void *client_data);
 
+/* Returns the names of all the USB devices currently attached, as a NULL
+ * terminated array, found in one pass over the bus directories. If count is
+ * not NULL, it is set to the number of devices.
+ * Returns NULL when out of memory.
+ * Call usb_host_free_device_list() to free the result when you are done with it.
+ */
+char **usb_host_get_device_list(size_t *count);
+
+/* Frees the result of usb_host_get_device_list() */
+void usb_host_free_device_list(char **dev_names);
+
 /* Creates a usb_device object for a USB device */
 struct usb_device *usb_device_open(const char *dev_name);
 
@@ -143,6 +162,8 @@ const struct usb_device_descriptor* usb_device_get_device_descriptor(struct usb_
 /* Returns a USB descriptor string for the given string ID.
  * Return value: < 0 on error.  0 on success.
  * The string is returned in ucs2_out in USB-native UCS-2 encoding.
+ * Each string is only read from the device once, and then returned from the
+ * usb_device object.
  *
  * parameters:
  *  id - the string descriptor index.
@@ -78,12 +78,28 @@ struct usb_host_context {
 
 #define MAX_DESCRIPTORS_LENGTH 4096
 
+/* A string descriptor read from the device, in UCS-2 */
+struct usb_string {
+    struct usb_string *next;
+    int id;
+    size_t length;
+    /* followed by three NULs */
+    char ucs2[];
+};
+
 struct usb_device {
     char dev_name[64];
     unsigned char desc[MAX_DESCRIPTORS_LENGTH];
     int desc_length;
     int fd;
     int writeable;
+    /* String descriptor zero, and the strings read so far. A device doesn't
+     * change them while it stays attached, so each is only read once.
+     */
+    __u16 languages[MAX_STRING_DESCRIPTOR_LENGTH / sizeof(__u16)];
+    int language_count;
+    int languages_read;
+    struct usb_string *strings;
 };
 
 static inline int badname(const char *name)
@@ -141,6 +157,66 @@ static int find_existing_devices(usb_device_added_cb added_cb,
     return done;
 }
 
+struct device_list {
+    char **names;
+    size_t count;
+    size_t capacity;
+};
+
+static int add_to_device_list(const char *dev_name, void *client_data)
+{
+    struct device_list *list = client_data;
+
+    /* keep room for the NULL at the end */
+    if (list->count + 1 >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 32;
+        char **names = realloc(list->names, capacity * sizeof(char *));
+        if (!names)
+            return 1;
+        list->names = names;
+        list->capacity = capacity;
+    }
+    list->names[list->count] = strdup(dev_name);
+    if (!list->names[list->count])
+        return 1;
+    list->count++;
+    list->names[list->count] = NULL;
+    return 0;
+}
+
+char **usb_host_get_device_list(size_t *count)
+{
+    struct device_list list;
+
+    memset(&list, 0, sizeof(list));
+    if (find_existing_devices(add_to_device_list, &list)) {
+        /* out of memory */
+        if (list.names)
+            list.names[list.count] = NULL;
+        usb_host_free_device_list(list.names);
+        return NULL;
+    }
+    if (!list.names) {
+        list.names = calloc(1, sizeof(char *));
+        if (!list.names)
+            return NULL;
+    }
+    if (count)
+        *count = list.count;
+    return list.names;
+}
+
+void usb_host_free_device_list(char **dev_names)
+{
+    char **name;
+
+    if (!dev_names)
+        return;
+    for (name = dev_names; *name; name++)
+        free(*name);
+    free(dev_names);
+}
+
 static void watch_existing_subdirs(struct usb_host_context *context,
                                    int *wds, int wd_count)
 {
@@ -229,77 +305,85 @@ int usb_host_load(struct usb_host_context *context,
 int usb_host_read_event(struct usb_host_context *context)
 {
     struct inotify_event* event;
-    char event_buf[512];
+    char event_buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
     char path[100];
     int i, ret, done = 0;
-    int offset = 0;
+    int offset;
     int wd;
+    int pending;
 
-    ret = read(context->fd, event_buf, sizeof(event_buf));
-    if (ret >= (int)sizeof(struct inotify_event)) {
-        while (offset < ret && !done) {
-            event = (struct inotify_event*)&event_buf[offset];
-            done = 0;
-            wd = event->wd;
-            if (wd == context->wdd) {
-                if ((event->mask & IN_CREATE) && !strcmp(event->name, "bus")) {
-                    context->wddbus = inotify_add_watch(context->fd, DEV_BUS_DIR, IN_CREATE | IN_DELETE);
-                    if (context->wddbus < 0) {
-                        done = 1;
-                    } else {
+    /* Handle all the events queued, so that a hub bringing up many devices at
+     * once is dealt with in one call, whether or not the fd is non-blocking.
+     */
+    do {
+        ret = read(context->fd, event_buf, sizeof(event_buf));
+        offset = 0;
+        if (ret >= (int)sizeof(struct inotify_event)) {
+            while (offset < ret && !done) {
+                event = (struct inotify_event*)&event_buf[offset];
+                done = 0;
+                wd = event->wd;
+                if (wd == context->wdd) {
+                    if ((event->mask & IN_CREATE) && !strcmp(event->name, "bus")) {
+                        context->wddbus = inotify_add_watch(context->fd, DEV_BUS_DIR,
+                                                            IN_CREATE | IN_DELETE);
+                        if (context->wddbus < 0) {
+                            done = 1;
+                        } else {
+                            watch_existing_subdirs(context, context->wds, MAX_USBFS_WD_COUNT);
+                            done = find_existing_devices(context->cb_added, context->data);
+                        }
+                    }
+                } else if (wd == context->wddbus) {
+                    if ((event->mask & IN_CREATE) && !strcmp(event->name, "usb")) {
                         watch_existing_subdirs(context, context->wds, MAX_USBFS_WD_COUNT);
                         done = find_existing_devices(context->cb_added, context->data);
+                    } else if ((event->mask & IN_DELETE) && !strcmp(event->name, "usb")) {
+                        for (i = 0; i < MAX_USBFS_WD_COUNT; i++) {
+                            if (context->wds[i] >= 0) {
+                                inotify_rm_watch(context->fd, context->wds[i]);
+                                context->wds[i] = -1;
+                            }
+                        }
                     }
-                }
-            } else if (wd == context->wddbus) {
-                if ((event->mask & IN_CREATE) && !strcmp(event->name, "usb")) {
-                    watch_existing_subdirs(context, context->wds, MAX_USBFS_WD_COUNT);
-                    done = find_existing_devices(context->cb_added, context->data);
-                } else if ((event->mask & IN_DELETE) && !strcmp(event->name, "usb")) {
-                    for (i = 0; i < MAX_USBFS_WD_COUNT; i++) {
-                        if (context->wds[i] >= 0) {
+                } else if (wd == context->wds[0]) {
+                    i = atoi(event->name);
+                    snprintf(path, sizeof(path), USB_FS_DIR "/%s", event->name);
+                    D("%s subdirectory %s: index: %d\n", (event->mask & IN_CREATE) ?
+                            "new" : "gone", path, i);
+                    if (i > 0 && i < MAX_USBFS_WD_COUNT) {
+                        int local_ret = 0;
+                        if (event->mask & IN_CREATE) {
+                            local_ret = inotify_add_watch(context->fd, path,
+                                    IN_CREATE | IN_DELETE);
+                            if (local_ret >= 0)
+                                context->wds[i] = local_ret;
+                            done = find_existing_devices_bus(path, context->cb_added,
+                                    context->data);
+                        } else if (event->mask & IN_DELETE) {
                             inotify_rm_watch(context->fd, context->wds[i]);
                             context->wds[i] = -1;
                         }
                     }
-                }
-            } else if (wd == context->wds[0]) {
-                i = atoi(event->name);
-                snprintf(path, sizeof(path), USB_FS_DIR "/%s", event->name);
-                D("%s subdirectory %s: index: %d\n", (event->mask & IN_CREATE) ?
-                        "new" : "gone", path, i);
-                if (i > 0 && i < MAX_USBFS_WD_COUNT) {
-                    int local_ret = 0;
-                    if (event->mask & IN_CREATE) {
-                        local_ret = inotify_add_watch(context->fd, path,
-                                IN_CREATE | IN_DELETE);
-                        if (local_ret >= 0)
-                            context->wds[i] = local_ret;
-                        done = find_existing_devices_bus(path, context->cb_added,
-                                context->data);
-                    } else if (event->mask & IN_DELETE) {
-                        inotify_rm_watch(context->fd, context->wds[i]);
-                        context->wds[i] = -1;
-                    }
-                }
-            } else {
-                for (i = 1; (i < MAX_USBFS_WD_COUNT) && !done; i++) {
-                    if (wd == context->wds[i]) {
-                        snprintf(path, sizeof(path), USB_FS_DIR "/%03d/%s", i, event->name);
-                        if (event->mask == IN_CREATE) {
-                            D("new device %s\n", path);
-                            done = context->cb_added(path, context->data);
-                        } else if (event->mask == IN_DELETE) {
-                            D("gone device %s\n", path);
-                            done = context->cb_removed(path, context->data);
+                } else {
+                    for (i = 1; (i < MAX_USBFS_WD_COUNT) && !done; i++) {
+                        if (wd == context->wds[i]) {
+                            snprintf(path, sizeof(path), USB_FS_DIR "/%03d/%s", i, event->name);
+                            if (event->mask == IN_CREATE) {
+                                D("new device %s\n", path);
+                                done = context->cb_added(path, context->data);
+                            } else if (event->mask == IN_DELETE) {
+                                D("gone device %s\n", path);
+                                done = context->cb_removed(path, context->data);
+                            }
                         }
                     }
                 }
-            }
 
-            offset += sizeof(struct inotify_event) + event->len;
+                offset += sizeof(struct inotify_event) + event->len;
+            }
         }
-    }
+    } while (!done && ret > 0 && ioctl(context->fd, FIONREAD, &pending) == 0 && pending > 0);
 
     return done;
 } /* usb_host_read_event() */
@@ -363,6 +447,13 @@ struct usb_device *usb_device_open(const char *dev_name)
 
 void usb_device_close(struct usb_device *device)
 {
+    struct usb_string *string = device->strings;
+
+    while (string) {
+        struct usb_string *next = string->next;
+        free(string);
+        string = next;
+    }
     close(device->fd);
     free(device);
 }
@@ -485,46 +576,67 @@ const unsigned char* usb_device_get_raw_descriptors(const struct usb_device* dev
  *                  The size isn't guaranteed to include null termination.
  * Call free() to free the result when you are done with it.
  */
+static int copy_string(const struct usb_string* string, void** ucs2_out, size_t* response_size) {
+    char* out = malloc(string->length + 3);
+    if (out == NULL) {
+        return -1;
+    }
+    memcpy(out, string->ucs2, string->length + 3);
+    *ucs2_out = (void*)out;
+    *response_size = string->length;
+    return 0;
+}
+
 int usb_device_get_string_ucs2(struct usb_device* device, int id, int timeout, void** ucs2_out,
                                size_t* response_size) {
-    __u16 languages[MAX_STRING_DESCRIPTOR_LENGTH / sizeof(__u16)];
     char response[MAX_STRING_DESCRIPTOR_LENGTH];
+    struct usb_string* string;
     int result;
-    int languageCount = 0;
 
     if (id == 0) return -1;
     if (*ucs2_out != NULL) return -1;
 
-    memset(languages, 0, sizeof(languages));
+    for (string = device->strings; string != NULL; string = string->next) {
+        if (string->id == id) {
+            return copy_string(string, ucs2_out, response_size);
+        }
+    }
 
-    // read list of supported languages
-    result = usb_device_control_transfer(device,
-            USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE, USB_REQ_GET_DESCRIPTOR,
-            (USB_DT_STRING << 8) | 0, 0, languages, sizeof(languages),
-            timeout);
-    if (result > 0)
-        languageCount = (result - 2) / 2;
+    // read list of supported languages, until a device answers
+    if (!device->languages_read) {
+        memset(device->languages, 0, sizeof(device->languages));
+        result = usb_device_control_transfer(device,
+                USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                (USB_DT_STRING << 8) | 0, 0, device->languages, sizeof(device->languages),
+                timeout);
+        if (result > 0) {
+            device->language_count = (result - 2) / 2;
+            device->languages_read = 1;
+        }
+    }
 
-    for (int i = 1; i <= languageCount; i++) {
+    for (int i = 1; i <= device->language_count; i++) {
         memset(response, 0, sizeof(response));
 
         result = usb_device_control_transfer(
             device, USB_DIR_IN | USB_TYPE_STANDARD | USB_RECIP_DEVICE, USB_REQ_GET_DESCRIPTOR,
-            (USB_DT_STRING << 8) | id, languages[i], response, sizeof(response), timeout);
+            (USB_DT_STRING << 8) | id, device->languages[i], response, sizeof(response), timeout);
         if (result >= 2) {  // string contents begin at offset 2.
             int descriptor_len = result - 2;
-            char* out = malloc(descriptor_len + 3);
-            if (out == NULL) {
+            string = malloc(sizeof(*string) + descriptor_len + 3);
+            if (string == NULL) {
                 return -1;
             }
-            memcpy(out, response + 2, descriptor_len);
+            string->id = id;
+            string->length = descriptor_len;
+            memcpy(string->ucs2, response + 2, descriptor_len);
             // trail with three additional NULLs, so that there's guaranteed
             // to be a UCS-2 NULL character beyond whatever USB returned.
             // The returned string length is still just what USB returned.
-            memset(out + descriptor_len, '\0', 3);
-            *ucs2_out = (void*)out;
-            *response_size = descriptor_len;
-            return 0;
+            memset(string->ucs2 + descriptor_len, '\0', 3);
+            string->next = device->strings;
+            device->strings = string;
+            return copy_string(string, ucs2_out, response_size);
         }
     }
     return -1;
@@ -39,18 +39,29 @@ CallStack::CallStack(const char* logtag, int32_t ignoreDepth) {
 CallStack::~CallStack() {
 }
 
-void CallStack::update(int32_t ignoreDepth, pid_t tid) {
-    mFrameLines.clear();
+// Always inlined, so that the ignoreDepth of the current thread's stack is the
+// same through either update().
+static inline __attribute__((always_inline)) void updateFrameLines(
+        Vector<String8>* frameLines, int32_t ignoreDepth, pid_t tid, BacktraceMap* map) {
+    frameLines->clear();
 
-    std::unique_ptr<Backtrace> backtrace(Backtrace::Create(BACKTRACE_CURRENT_PROCESS, tid));
+    std::unique_ptr<Backtrace> backtrace(Backtrace::Create(BACKTRACE_CURRENT_PROCESS, tid, map));
     if (!backtrace->Unwind(ignoreDepth)) {
         ALOGW("%s: Failed to unwind callstack.", __FUNCTION__);
     }
     for (size_t i = 0; i < backtrace->NumFrames(); i++) {
-      mFrameLines.push_back(String8(backtrace->FormatFrameData(i).c_str()));
+      frameLines->push_back(String8(backtrace->FormatFrameData(i).c_str()));
     }
 }
 
+void CallStack::update(int32_t ignoreDepth, pid_t tid) {
+    updateFrameLines(&mFrameLines, ignoreDepth, tid, nullptr);
+}
+
+void CallStack::update(int32_t ignoreDepth, pid_t tid, BacktraceMap* map) {
+    updateFrameLines(&mFrameLines, ignoreDepth, tid, map);
+}
+
 void CallStack::log(const char* logtag, android_LogPriority priority, const char* prefix) const {
     LogPrinter printer(logtag, priority, prefix, /*ignoreBlankLines*/false);
     print(printer);
@@ -39,6 +39,7 @@
 
 #include <string.h>
 #include <memory.h>
+#include <memory>
 #include <errno.h>
 #include <assert.h>
 
@@ -222,6 +223,11 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
 // Provide guidance to the system.
 #if !defined(_WIN32)
 int FileMap::advise(MapAdvice advice)
+{
+    return advise(advice, 0, mDataLength);
+}
+
+int FileMap::advise(MapAdvice advice, size_t offset, size_t length)
 {
     int cc, sysAdvice;
 
@@ -231,20 +237,77 @@ int FileMap::advise(MapAdvice advice)
         case SEQUENTIAL:    sysAdvice = MADV_SEQUENTIAL;    break;
         case WILLNEED:      sysAdvice = MADV_WILLNEED;      break;
         case DONTNEED:      sysAdvice = MADV_DONTNEED;      break;
+#if defined(MADV_HUGEPAGE)
+        case HUGEPAGE:      sysAdvice = MADV_HUGEPAGE;      break;
+        case NOHUGEPAGE:    sysAdvice = MADV_NOHUGEPAGE;    break;
+#endif
         default:
                             assert(false);
                             return -1;
     }
 
-    cc = madvise(mBasePtr, mBaseLength, sysAdvice);
+    if (offset > mDataLength || length > mDataLength - offset) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Round out to whole pages from the start of the data.
+    size_t start = (char*) mDataPtr - (char*) mBasePtr + offset;
+    size_t end = start + length;
+    start -= start % mPageSize;
+    end = (end + mPageSize - 1) / mPageSize * mPageSize;
+    if (end > mBaseLength) {
+        end = mBaseLength;
+    }
+
+    cc = madvise((char*) mBasePtr + start, end - start, sysAdvice);
     if (cc != 0)
         ALOGW("madvise(%d) failed: %s\n", sysAdvice, strerror(errno));
     return cc;
 }
 
+ssize_t FileMap::getResidentLength(void) const
+{
+    if (mBasePtr == NULL) {
+        return 0;
+    }
+
+    // mincore() looks at whole pages, from the page-aligned base.
+    size_t pageCount = (mBaseLength + mPageSize - 1) / mPageSize;
+    std::unique_ptr<unsigned char[]> vec(new unsigned char[pageCount]);
+    if (mincore(mBasePtr, mBaseLength, vec.get()) != 0) {
+        ALOGW("mincore(%p, %zu) failed: %s\n", mBasePtr, mBaseLength, strerror(errno));
+        return -1;
+    }
+
+    size_t adjust = (char*) mDataPtr - (char*) mBasePtr;
+    ssize_t resident = 0;
+    for (size_t i = 0; i < pageCount; i++) {
+        if (vec[i] & 1) {
+            // Only count the part of the page within the requested data.
+            size_t pageStart = i * mPageSize;
+            size_t pageEnd = pageStart + mPageSize;
+            size_t dataEnd = adjust + mDataLength;
+            resident += (pageEnd < dataEnd ? pageEnd : dataEnd) -
+                    (pageStart > adjust ? pageStart : adjust);
+        }
+    }
+    return resident;
+}
+
 #else
 int FileMap::advise(MapAdvice /* advice */)
 {
     return -1;
 }
+
+int FileMap::advise(MapAdvice /* advice */, size_t /* offset */, size_t /* length */)
+{
+    return -1;
+}
+
+ssize_t FileMap::getResidentLength(void) const
+{
+    return -1;
+}
 #endif
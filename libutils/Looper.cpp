@@ -16,6 +16,8 @@
 #include <utils/Looper.h>
 #include <sys/eventfd.h>
 
+#include <algorithm>
+
 namespace android {
 
 // --- WeakMessageHandler ---
@@ -61,8 +63,8 @@ static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
-        mPolling(false), mEpollFd(-1), mEpollRebuildRequired(false),
+        mAllowNonCallbacks(allowNonCallbacks), mPendingMessages(NULL), mNextMessageSeq(0),
+        mSendingMessage(false), mPolling(false), mEpollFd(-1), mEpollRebuildRequired(false),
         mNextRequestSeq(0), mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
     mWakeEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     LOG_ALWAYS_FATAL_IF(mWakeEventFd < 0, "Could not make wake event fd: %s",
@@ -78,6 +80,13 @@ Looper::~Looper() {
     if (mEpollFd >= 0) {
         close(mEpollFd);
     }
+
+    PendingMessage* pending = mPendingMessages.exchange(NULL);
+    while (pending != NULL) {
+        PendingMessage* next = pending->next;
+        delete pending;
+        pending = next;
+    }
 }
 
 void Looper::initTLSKey() {
@@ -152,8 +161,8 @@ void Looper::rebuildEpollLocked() {
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake event fd to epoll instance: %s",
                         strerror(errno));
 
-    for (size_t i = 0; i < mRequests.size(); i++) {
-        const Request& request = mRequests.valueAt(i);
+    for (const auto& it : mRequests) {
+        const Request& request = it.second;
         struct epoll_event eventItem;
         request.initEventItem(&eventItem);
 
@@ -288,14 +297,14 @@ int Looper::pollInner(int timeoutMillis) {
                 ALOGW("Ignoring unexpected epoll events 0x%x on wake event fd.", epollEvents);
             }
         } else {
-            ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            auto request = mRequests.find(fd);
+            if (request != mRequests.end()) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= EVENT_HANGUP;
-                pushResponse(events, mRequests.valueAt(requestIndex));
+                pushResponse(events, request->second);
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
@@ -306,18 +315,29 @@ Done: ;
 
     // Invoke pending message callbacks.
     mNextMessageUptime = LLONG_MAX;
-    while (mMessageEnvelopes.size() != 0) {
+    for (;;) {
+        takePendingMessagesLocked();
+        if (mMessageEnvelopes.empty()) {
+            // A message sent before the store of mNextMessageUptime is still pending
+            // here, and one sent after it wakes the poll.
+            if (mPendingMessages.load() == NULL) {
+                break;
+            }
+            continue;
+        }
+
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(0);
+        MessageEnvelope& messageEnvelope = mMessageEnvelopes.front();
         if (messageEnvelope.uptime <= now) {
-            // Remove the envelope from the list.
+            // Remove the envelope from the queue.
             // We keep a strong reference to the handler until the call to handleMessage
             // finishes.  Then we drop it so that the handler can be deleted *before*
             // we reacquire our lock.
             { // obtain handler
-                sp<MessageHandler> handler = messageEnvelope.handler;
+                sp<MessageHandler> handler = std::move(messageEnvelope.handler);
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                std::pop_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(), isLaterMessage);
+                mMessageEnvelopes.pop_back();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -334,7 +354,10 @@ Done: ;
         } else {
             // The last message left at the head of the queue determines the next wakeup time.
             mNextMessageUptime = messageEnvelope.uptime;
-            break;
+            if (mPendingMessages.load() == NULL) {
+                break;
+            }
+            mNextMessageUptime = LLONG_MAX;
         }
     }
 
@@ -419,6 +442,28 @@ void Looper::awoken() {
     TEMP_FAILURE_RETRY(read(mWakeEventFd, &counter, sizeof(uint64_t)));
 }
 
+void Looper::takePendingMessagesLocked() {
+    PendingMessage* pending = mPendingMessages.exchange(NULL);
+
+    // Reverse the list to get the messages in the order they were sent.
+    PendingMessage* sent = NULL;
+    while (pending != NULL) {
+        PendingMessage* next = pending->next;
+        pending->next = sent;
+        sent = pending;
+        pending = next;
+    }
+
+    while (sent != NULL) {
+        PendingMessage* next = sent->next;
+        sent->envelope.seq = mNextMessageSeq++;
+        mMessageEnvelopes.push_back(std::move(sent->envelope));
+        std::push_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(), isLaterMessage);
+        delete sent;
+        sent = next;
+    }
+}
+
 void Looper::pushResponse(int events, const Request& request) {
     Response response;
     response.events = events;
@@ -465,14 +510,14 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
         struct epoll_event eventItem;
         request.initEventItem(&eventItem);
 
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        auto requestIt = mRequests.find(fd);
+        if (requestIt == mRequests.end()) {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error adding epoll events for fd %d: %s", fd, strerror(errno));
                 return -1;
             }
-            mRequests.add(fd, request);
+            mRequests.emplace(fd, request);
         } else {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
             if (epollResult < 0) {
@@ -507,7 +552,7 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
                     return -1;
                 }
             }
-            mRequests.replaceValueAt(requestIndex, request);
+            requestIt->second = request;
         }
     } // release lock
     return 1;
@@ -524,23 +569,23 @@ int Looper::removeFd(int fd, int seq) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        auto requestIt = mRequests.find(fd);
+        if (requestIt == mRequests.end()) {
             return 0;
         }
 
         // Check the sequence number if one was given.
-        if (seq != -1 && mRequests.valueAt(requestIndex).seq != seq) {
+        if (seq != -1 && requestIt->second.seq != seq) {
 #if DEBUG_CALLBACKS
             ALOGD("%p ~ removeFd - sequence number mismatch, oldSeq=%d",
-                    this, mRequests.valueAt(requestIndex).seq);
+                    this, requestIt->second.seq);
 #endif
             return 0;
         }
 
         // Always remove the FD from the request map even if an error occurs while
         // updating the epoll set so that we avoid accidentally leaking callbacks.
-        mRequests.removeItemsAt(requestIndex);
+        mRequests.erase(requestIt);
 
         int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
         if (epollResult < 0) {
@@ -593,29 +638,26 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
-    { // acquire lock
-        AutoMutex _l(mLock);
-
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
-
-        // Optimization: If the Looper is currently sending a message, then we can skip
-        // the call to wake() because the next thing the Looper will do after processing
-        // messages is to decide when the next wakeup time should be.  In fact, it does
-        // not even matter whether this code is running on the Looper thread.
-        if (mSendingMessage) {
-            return;
-        }
-    } // release lock
+    // Push the message without taking the lock.  The looper moves it into the queue
+    // the next time it looks for messages to send.
+    PendingMessage* pending = new PendingMessage(uptime, handler, message);
+    PendingMessage* head = mPendingMessages.load(std::memory_order_relaxed);
+    do {
+        pending->next = head;
+    } while (!mPendingMessages.compare_exchange_weak(head, pending));
+
+    // Optimization: If the Looper is currently sending a message, then we can skip
+    // the call to wake() because the next thing the Looper will do after processing
+    // messages is to decide when the next wakeup time should be.  In fact, it does
+    // not even matter whether this code is running on the Looper thread.
+    if (mSendingMessage) {
+        return;
+    }
 
-    // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    // Wake the poll loop only when the message is due before the one it waits for.
+    // The looper looks for pending messages again after it sets that time, so a
+    // message it has not seen is either woken for here or found there.
+    if (uptime < mNextMessageUptime) {
         wake();
     }
 }
@@ -627,12 +669,15 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
+        takePendingMessagesLocked();
+
+        auto end = std::remove_if(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                [&handler](const MessageEnvelope& messageEnvelope) {
+                    return messageEnvelope.handler == handler;
+                });
+        if (end != mMessageEnvelopes.end()) {
+            mMessageEnvelopes.erase(end, mMessageEnvelopes.end());
+            std::make_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(), isLaterMessage);
         }
     } // release lock
 }
@@ -644,13 +689,16 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
-            }
+        takePendingMessagesLocked();
+
+        auto end = std::remove_if(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                [&handler, what](const MessageEnvelope& messageEnvelope) {
+                    return messageEnvelope.handler == handler
+                            && messageEnvelope.message.what == what;
+                });
+        if (end != mMessageEnvelopes.end()) {
+            mMessageEnvelopes.erase(end, mMessageEnvelopes.end());
+            std::make_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(), isLaterMessage);
         }
     } // release lock
 }
@@ -669,6 +717,11 @@ void Looper::Request::initEventItem(struct epoll_event* eventItem) const {
     eventItem->data.fd = fd;
 }
 
+// Orders the message queue as a min-heap of (uptime, seq).
+bool Looper::isLaterMessage(const MessageEnvelope& a, const MessageEnvelope& b) {
+    return a.uptime > b.uptime || (a.uptime == b.uptime && a.seq > b.seq);
+}
+
 MessageHandler::~MessageHandler() { }
 
 LooperCallback::~LooperCallback() { }
@@ -20,10 +20,16 @@
 #include <utils/ProcessCallStack.h>
 
 #include <dirent.h>
+#include <pthread.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <vector>
 
+#include <backtrace/BacktraceMap.h>
+#include <cutils/threads.h>
 #include <utils/Printer.h>
 
 namespace android {
@@ -35,6 +41,9 @@ enum {
 
     // Dump related prettiness constants
     IGNORE_DEPTH_CURRENT_THREAD = 2,
+
+    // Most threads the other threads are unwound by in parallel
+    MAX_UNWIND_THREADS = 4,
 };
 
 static const char* CALL_STACK_PREFIX = "  ";
@@ -126,6 +135,34 @@ void ProcessCallStack::clear() {
     mTimeUpdated = tm();
 }
 
+namespace {
+
+// The other threads of the process, unwound by a few workers pulling the next
+// one to do from a shared index.
+struct UnwindWork {
+    BacktraceMap* map;
+    std::vector<pid_t> tids;
+    std::vector<CallStack> callStacks;
+    std::vector<String8> threadNames;
+    std::atomic<size_t> next;
+};
+
+}  // namespace
+
+static void* unwindThreads(void* arg) {
+    UnwindWork* work = static_cast<UnwindWork*>(arg);
+    size_t i;
+    while ((i = work->next.fetch_add(1)) < work->tids.size()) {
+        pid_t tid = work->tids[i];
+        work->callStacks[i].update(0, tid, work->map);
+        work->threadNames[i] = getThreadName(tid);
+
+        ALOGV("%s: Got call stack for tid %d (size %zu)",
+              __FUNCTION__, tid, work->callStacks[i].size());
+    }
+    return NULL;
+}
+
 void ProcessCallStack::update() {
     std::unique_ptr<DIR, decltype(&closedir)> dp(opendir(PATH_SELF_TASK), closedir);
     if (dp == NULL) {
@@ -134,7 +171,7 @@ void ProcessCallStack::update() {
         return;
     }
 
-    pid_t selfPid = getpid();
+    pid_t selfTid = gettid();
 
     clear();
 
@@ -150,7 +187,10 @@ void ProcessCallStack::update() {
     /*
      * Each tid is a directory inside of /proc/self/task
      * - Read every file in directory => get every tid
+     * - Listed before any worker is started, so that those are not unwound
      */
+    UnwindWork work;
+    bool selfListed = false;
     dirent* ep;
     while ((ep = readdir(dp.get())) != NULL) {
         pid_t tid = -1;
@@ -163,29 +203,64 @@ void ProcessCallStack::update() {
             continue;
         }
 
-        ssize_t idx = mThreadMap.add(tid, ThreadInfo());
-        if (idx < 0) { // returns negative error value on error
-            ALOGE("%s: Failed to add new ThreadInfo: %s",
-                  __FUNCTION__, strerror(-idx));
-            continue;
+        if (tid == selfTid) {
+            selfListed = true;
+        } else {
+            work.tids.push_back(tid);
         }
+    }
+    dp.reset();
+
+    // Parse the maps once for all the threads, rather than once per thread.
+    std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(getpid()));
+    work.map = map.get();
+    work.callStacks.resize(work.tids.size());
+    work.threadNames.resize(work.tids.size());
+    work.next = 0;
+
+    // Only signalling a thread is serialized by libbacktrace, the unwinds
+    // themselves run in parallel. This thread does its share, so it also
+    // carries on alone if no worker could be started.
+    std::vector<pthread_t> workers;
+    size_t workerCount = std::min<size_t>(work.tids.size(), MAX_UNWIND_THREADS);
+    for (size_t i = 1; i < workerCount; ++i) {
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, unwindThreads, &work);
+        if (err) {
+            ALOGW("%s: Failed to start an unwind thread: %s", __FUNCTION__, strerror(err));
+            break;
+        }
+        workers.push_back(thread);
+    }
 
-        ThreadInfo& threadInfo = mThreadMap.editValueAt(static_cast<size_t>(idx));
-
-        /*
-         * Ignore CallStack::update and ProcessCallStack::update for current thread
-         * - Every other thread doesn't need this since we call update off-thread
-         */
-        int ignoreDepth = (selfPid == tid) ? IGNORE_DEPTH_CURRENT_THREAD : 0;
+    /*
+     * Ignore CallStack::update and ProcessCallStack::update for current thread
+     * - Every other thread doesn't need this since we call update off-thread
+     * - Unwound here rather than by a worker, which would have to signal it
+     */
+    if (selfListed) {
+        ThreadInfo threadInfo;
+        threadInfo.callStack.update(IGNORE_DEPTH_CURRENT_THREAD, selfTid, work.map);
+        threadInfo.threadName = getThreadName(selfTid);
+        mThreadMap.add(selfTid, threadInfo);
+    }
 
-        // Update thread's call stacks
-        threadInfo.callStack.update(ignoreDepth, tid);
+    unwindThreads(&work);
+    for (pthread_t thread : workers) {
+        pthread_join(thread, NULL);
+    }
 
-        // Read/save thread name
-        threadInfo.threadName = getThreadName(tid);
+    // The KeyedVector keeps the threads sorted by tid.
+    for (size_t i = 0; i < work.tids.size(); ++i) {
+        ThreadInfo threadInfo;
+        threadInfo.callStack = work.callStacks[i];
+        threadInfo.threadName = work.threadNames[i];
 
-        ALOGV("%s: Got call stack for tid %d (size %zu)",
-              __FUNCTION__, tid, threadInfo.callStack.size());
+        ssize_t idx = mThreadMap.add(work.tids[i], threadInfo);
+        if (idx < 0) { // returns negative error value on error
+            ALOGE("%s: Failed to add new ThreadInfo: %s",
+                  __FUNCTION__, strerror(-idx));
+        }
     }
 }
 
@@ -19,6 +19,10 @@
 
 #include <utils/RefBase.h>
 
+#include <stddef.h>
+
+#include <new>
+
 #include <utils/CallStack.h>
 
 #ifndef __unused
@@ -73,7 +77,14 @@ namespace android {
 // after the RefBase object has been destroyed.
 //
 // A weakref_impl is allocated as the value of mRefs in a RefBase object on
-// construction.
+// construction.  For CoallocatedRefs objects, it is placed in a refs_block at
+// the start of the heap block of the object instead, and the block is freed by
+// whichever of operator delete and the deallocation of the weakref_impl comes
+// last.  No atomics are needed to tell which: either the weakref_impl is
+// deallocated by the RefBase destructor, before operator delete on the same
+// thread, or by the final decWeak, which happens after the deletion of the
+// object as the strong reference whose release deletes it is also counted in
+// mWeak.
 // In the OBJECT_LIFETIME_STRONG case, it is normally deallocated in decWeak,
 // and hence lives as long as the last weak reference. (It can also be
 // deallocated in the RefBase destructor iff the strong reference count was
@@ -119,6 +130,9 @@ namespace android {
 
 #define MAX_COUNT 0xfffff
 
+// Set in mFlags when the weakref_impl lives in a refs_block.
+#define OBJECT_REFS_COALLOCATED 0x10000
+
 // Test whether the argument is a clearly invalid strong reference count.
 // Used only for error checking on the value before an atomic decrement.
 // Intended to be very cheap.
@@ -395,6 +409,47 @@ private:
 
 // ---------------------------------------------------------------------------
 
+// Head of the heap block of a CoallocatedRefs object, which follows it.
+struct RefBase::refs_block
+{
+    // Size of the object.
+    const size_t            mSize;
+    bool                    mObjectAlive;
+    bool                    mRefsAlive;
+    alignas(weakref_impl) unsigned char mRefs[sizeof(weakref_impl)];
+
+    explicit refs_block(size_t size) : mSize(size), mObjectAlive(true), mRefsAlive(false) { }
+
+    static constexpr size_t objectOffset() {
+        return (sizeof(refs_block) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    }
+
+    char* object() { return reinterpret_cast<char*>(this) + objectOffset(); }
+
+    static refs_block* fromObject(void* object) {
+        return reinterpret_cast<refs_block*>(static_cast<char*>(object) - objectOffset());
+    }
+
+    static refs_block* fromRefs(weakref_impl* refs) {
+        return reinterpret_cast<refs_block*>(
+                reinterpret_cast<char*>(refs) - offsetof(refs_block, mRefs));
+    }
+
+    void free() {
+        this->~refs_block();
+        ::operator delete(this);
+    }
+};
+
+// Block allocated by CoallocatedRefs::operator new on this thread, whose
+// RefBase constructor has not run yet.
+static thread_local void* gPendingRefsBlock = NULL;
+// Set once a CoallocatedRefs object is allocated, so that RefBase objects of
+// processes not using them are constructed without any TLS access.
+static std::atomic<bool> gRefsCoallocated(false);
+
+// ---------------------------------------------------------------------------
+
 void RefBase::incStrong(const void* id) const
 {
     weakref_impl* const refs = mRefs;
@@ -524,7 +579,7 @@ void RefBase::weakref_type::decWeak(const void* id)
                     "before it had a strong reference", impl->mBase);
         } else {
             // ALOGV("Freeing refs %p of old RefBase %p\n", this, impl->mBase);
-            delete impl;
+            destroyRefs(impl);
         }
     } else {
         // This is the OBJECT_LIFETIME_WEAK case. The last weak-reference
@@ -684,7 +739,7 @@ RefBase::weakref_type* RefBase::getWeakRefs() const
 }
 
 RefBase::RefBase()
-    : mRefs(new weakref_impl(this))
+    : mRefs(createRefs(this))
 {
 }
 
@@ -698,7 +753,7 @@ RefBase::~RefBase()
         // It's possible that the weak count is not 0 if the object
         // re-acquired a weak reference in its destructor
         if (mRefs->mWeak.load(std::memory_order_relaxed) == 0) {
-            delete mRefs;
+            destroyRefs(mRefs);
         }
     } else if (mRefs->mStrong.load(std::memory_order_relaxed)
             == INITIAL_STRONG_VALUE) {
@@ -709,7 +764,7 @@ RefBase::~RefBase()
         // TODO: Always report if we get here. Currently MediaMetadataRetriever
         // C++ objects are inconsistently managed and sometimes get here.
         // There may be other cases, but we believe they should all be fixed.
-        delete mRefs;
+        destroyRefs(mRefs);
     }
     // For debugging purposes, clear mRefs.  Ineffective against outstanding wp's.
     const_cast<weakref_impl*&>(mRefs) = NULL;
@@ -722,6 +777,70 @@ void RefBase::extendObjectLifetime(int32_t mode)
     mRefs->mFlags.fetch_or(mode, std::memory_order_relaxed);
 }
 
+void* RefBase::allocateWithRefs(size_t size)
+{
+    void* memory = ::operator new(refs_block::objectOffset() + size);
+    refs_block* block = new (memory) refs_block(size);
+    if (!gRefsCoallocated.load(std::memory_order_relaxed)) {
+        gRefsCoallocated.store(true, std::memory_order_relaxed);
+    }
+    gPendingRefsBlock = block;
+    return block->object();
+}
+
+void RefBase::freeWithRefs(void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    refs_block* block = refs_block::fromObject(ptr);
+    // The constructor may not have got as far as the RefBase one.
+    if (gPendingRefsBlock == block) {
+        gPendingRefsBlock = NULL;
+    }
+    block->mObjectAlive = false;
+    if (!block->mRefsAlive) {
+        block->free();
+    }
+}
+
+RefBase::weakref_impl* RefBase::createRefs(RefBase* base)
+{
+    // The thread's own store of gRefsCoallocated is always seen here.
+    refs_block* block = NULL;
+    if (gRefsCoallocated.load(std::memory_order_relaxed)) {
+        block = static_cast<refs_block*>(gPendingRefsBlock);
+    }
+    if (block != NULL) {
+        // Check that this is part of the object of the block, and not another
+        // RefBase allocated by one of its base class constructors, for instance.
+        char* object = block->object();
+        char* p = reinterpret_cast<char*>(base);
+        if (p >= object && p < object + block->mSize) {
+            gPendingRefsBlock = NULL;
+            block->mRefsAlive = true;
+            weakref_impl* refs = new (block->mRefs) weakref_impl(base);
+            refs->mFlags.fetch_or(OBJECT_REFS_COALLOCATED, std::memory_order_relaxed);
+            return refs;
+        }
+    }
+    return new weakref_impl(base);
+}
+
+void RefBase::destroyRefs(weakref_impl* refs)
+{
+    if (refs->mFlags.load(std::memory_order_relaxed) & OBJECT_REFS_COALLOCATED) {
+        refs_block* block = refs_block::fromRefs(refs);
+        refs->~weakref_impl();
+        block->mRefsAlive = false;
+        if (!block->mObjectAlive) {
+            block->free();
+        }
+    } else {
+        delete refs;
+    }
+}
+
 void RefBase::onFirstRef()
 {
 }
@@ -18,6 +18,7 @@
 
 #include <utils/Unicode.h>
 #include <limits.h>
+#include <string.h>
 
 #include <log/log.h>
 
@@ -65,6 +66,53 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// ASCII
+// --------------------------------------------------------------------------
+
+// Most strings converted are mostly ASCII, which the conversions below copy a
+// run at a time.  The runs are found a word at a time, which compilers turn
+// into vector code where available.
+
+static const uint64_t kUtf8NonAsciiMask = 0x8080808080808080ULL;
+static const uint64_t kUtf16NonAsciiMask = 0xFF80FF80FF80FF80ULL;
+
+/**
+ * Return the number of ASCII characters src starts with.
+ */
+static inline size_t utf8_ascii_run(const uint8_t* src, size_t src_len)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= src_len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, src + i, sizeof(word));
+        if (word & kUtf8NonAsciiMask) {
+            break;
+        }
+    }
+    while (i < src_len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+static inline size_t utf16_ascii_run(const char16_t* src, size_t src_len)
+{
+    const size_t kCharsPerWord = sizeof(uint64_t) / sizeof(char16_t);
+    size_t i = 0;
+    for (; i + kCharsPerWord <= src_len; i += kCharsPerWord) {
+        uint64_t word;
+        memcpy(&word, src + i, sizeof(word));
+        if (word & kUtf16NonAsciiMask) {
+            break;
+        }
+    }
+    while (i < src_len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -371,6 +419,18 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            const size_t len = utf16_ascii_run(cur_utf16, end_utf16 - cur_utf16);
+            LOG_ALWAYS_FATAL_IF(dst_len < len, "%zu < %zu", dst_len, len);
+            for (size_t i = 0; i < len; i++) {
+                cur[i] = (char) cur_utf16[i];
+            }
+            cur_utf16 += len;
+            cur += len;
+            dst_len -= len;
+            continue;
+        }
+
         char32_t utf32;
         // surrogate pairs
         if((*cur_utf16 & 0xFC00) == 0xD800 && (cur_utf16 + 1) < end_utf16
@@ -448,7 +508,11 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     const char16_t* const end = src + src_len;
     while (src < end) {
         size_t char_len;
-        if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
+        if (*src < 0x80) {
+            // ASCII characters are a byte each.
+            char_len = utf16_ascii_run(src, end - src);
+            src += char_len;
+        } else if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*(src + 1) & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
             char_len = 4;
@@ -568,6 +632,13 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len, bool overreadIs
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t asciiLen = utf8_ascii_run(u8cur, u8end - u8cur);
+            u16measuredLen += asciiLen;
+            u8cur += asciiLen;
+            continue;
+        }
+
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
         // Malformed utf8, some characters are beyond the end.
@@ -621,6 +692,20 @@ char16_t* utf8_to_utf16_no_null_terminator(
     char16_t* u16cur = dst;
 
     while (u8cur < u8end && u16cur < u16end) {
+        if (*u8cur < 0x80) {
+            size_t maxLen = u8end - u8cur;
+            if (maxLen > (size_t) (u16end - u16cur)) {
+                maxLen = u16end - u16cur;
+            }
+            const size_t asciiLen = utf8_ascii_run(u8cur, maxLen);
+            for (size_t i = 0; i < asciiLen; i++) {
+                u16cur[i] = (char16_t) u8cur[i];
+            }
+            u8cur += asciiLen;
+            u16cur += asciiLen;
+            continue;
+        }
+
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
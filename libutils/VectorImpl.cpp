@@ -408,31 +408,55 @@ void* VectorImpl::_grow(size_t where, size_t amount)
                             "new_alloc_size overflow");
 
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((mStorage) &&
+        const SharedBuffer* cur_sb = mStorage ? SharedBuffer::bufferFromData(mStorage) : NULL;
+        if ((cur_sb) &&
             (mCount==where) &&
             (mFlags & HAS_TRIVIAL_COPY) &&
             (mFlags & HAS_TRIVIAL_DTOR))
         {
-            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_alloc_size);
             if (sb) {
                 mStorage = sb->data();
             } else {
                 return NULL;
             }
+        } else if ((cur_sb) && cur_sb->onlyOwner() && (mFlags & HAS_TRIVIAL_MOVE)) {
+            // The items can be relocated by realloc(), then moved up in place.
+            SharedBuffer* sb = cur_sb->editResize(new_alloc_size);
+            if (!sb) {
+                return NULL;
+            }
+            mStorage = sb->data();
+            if (where != mCount) {
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* to = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                _do_move_forward(to, from, mCount - where);
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_alloc_size);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != mCount) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
+                if (cur_sb && cur_sb->onlyOwner()) {
+                    // Nobody else sees the items, so move them rather than copy
+                    // and destroy them.
+                    if (where != 0) {
+                        _do_move_backward(array, mStorage, where);
+                    }
+                    if (where != mCount) {
+                        _do_move_backward(dest, from, mCount-where);
+                    }
+                    SharedBuffer::dealloc(cur_sb);
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != mCount) {
+                        _do_copy(dest, from, mCount-where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else {
                 return NULL;
@@ -476,30 +500,56 @@ void VectorImpl::_shrink(size_t where, size_t amount)
         // we are always reducing the capacity of the underlying SharedBuffer.
         // In other words, (old_capacity * mItemSize) did not overflow, and
         // where < (where + amount) < new_capacity < old_capacity.
+        const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
         if ((where == new_size) &&
             (mFlags & HAS_TRIVIAL_COPY) &&
             (mFlags & HAS_TRIVIAL_DTOR))
         {
-            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             if (sb) {
                 mStorage = sb->data();
             } else {
                 return;
             }
+        } else if (cur_sb->onlyOwner() && (mFlags & HAS_TRIVIAL_MOVE)) {
+            // Remove the items in place, then let realloc() relocate the rest.
+            void* to = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+            _do_destroy(to, amount);
+            if (where != new_size) {
+                const void* from = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                _do_move_backward(to, from, new_size - where);
+            }
+            // Keep the larger buffer if it can't be shrunk.
+            SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
+            if (sb) {
+                mStorage = sb->data();
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != new_size) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
+                if (cur_sb->onlyOwner()) {
+                    // Nobody else sees the items, so move them rather than copy
+                    // and destroy them.
+                    _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
+                    if (where != 0) {
+                        _do_move_backward(array, mStorage, where);
+                    }
+                    if (where != new_size) {
+                        _do_move_backward(dest, from, new_size - where);
+                    }
+                    SharedBuffer::dealloc(cur_sb);
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != new_size) {
+                        _do_copy(dest, from, new_size - where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else{
                 return;
@@ -25,6 +25,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+class BacktraceMap;
+
 namespace android {
 
 class Printer;
@@ -45,6 +47,9 @@ public:
     // Immediately collect the stack traces for the specified thread.
     // The default is to dump the stack of the current call.
     void update(int32_t ignoreDepth=1, pid_t tid=BACKTRACE_CURRENT_THREAD);
+    // Same as above, but using the already built map of the current process,
+    // which multiple threads may share to unwind at the same time.
+    void update(int32_t ignoreDepth, pid_t tid, BacktraceMap* map);
 
     // Dump a stack trace to the log using the supplied logtag.
     void log(const char* logtag,
@@ -91,9 +91,13 @@ public:
     /*
      * This maps directly to madvise() values, but allows us to avoid
      * including <sys/mman.h> everywhere.
+     *
+     * HUGEPAGE asks for transparent huge pages, which only makes a
+     * difference for large read-only maps on kernels that can back file
+     * pages with them, and is otherwise ignored.
      */
     enum MapAdvice {
-        NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED
+        NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED, HUGEPAGE, NOHUGEPAGE
     };
 
     /*
@@ -103,6 +107,29 @@ public:
      */
     int advise(MapAdvice advice);
 
+    /*
+     * Apply an madvise() call to the pages holding "length" bytes at
+     * "offset" into the requested data.
+     *
+     * Returns 0 on success, -1 on failure.
+     */
+    int advise(MapAdvice advice, size_t offset, size_t length);
+
+    /*
+     * Start reading "length" bytes at "offset" into the requested data
+     * from the file, so that touching them later doesn't have to wait
+     * for the disk. This doesn't wait for the reads to complete.
+     *
+     * Returns 0 on success, -1 on failure.
+     */
+    int prefetch(size_t offset, size_t length) { return advise(WILLNEED, offset, length); }
+
+    /*
+     * Get the number of bytes of the requested data that are in memory,
+     * counted in whole pages, or -1 on failure.
+     */
+    ssize_t getResidentLength(void) const;
+
 protected:
 
 private:
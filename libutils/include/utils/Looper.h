@@ -24,6 +24,10 @@
 
 #include <sys/epoll.h>
 
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
 namespace android {
 
 /*
@@ -434,24 +438,41 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), seq(0) { }
 
         MessageEnvelope(nsecs_t u, const sp<MessageHandler> h,
-                const Message& m) : uptime(u), handler(h), message(m) {
+                const Message& m) : uptime(u), seq(0), handler(h), message(m) {
         }
 
         nsecs_t uptime;
+        // Orders the messages sent for the same time.
+        uint64_t seq;
         sp<MessageHandler> handler;
         Message message;
     };
 
+    // A message sent and not yet moved into the queue by the looper.
+    struct PendingMessage {
+        PendingMessage(nsecs_t u, const sp<MessageHandler> h, const Message& m) :
+                envelope(u, h, m), next(NULL) {
+        }
+
+        MessageEnvelope envelope;
+        PendingMessage* next;
+    };
+
     const bool mAllowNonCallbacks; // immutable
 
     int mWakeEventFd;  // immutable
     Mutex mLock;
 
-    Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
-    bool mSendingMessage; // guarded by mLock
+    // Messages are pushed here without taking the lock, most recent first, and
+    // moved into the queue in the order they were sent.
+    std::atomic<PendingMessage*> mPendingMessages;
+    // Min-heap of (uptime, seq).
+    std::vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    uint64_t mNextMessageSeq; // guarded by mLock
+    std::atomic<bool> mSendingMessage;
 
     // Whether we are currently waiting for work.  Not protected by a lock,
     // any use of it is racy anyway.
@@ -460,26 +481,30 @@ private:
     int mEpollFd; // guarded by mLock but only modified on the looper thread
     bool mEpollRebuildRequired; // guarded by mLock
 
-    // Locked list of file descriptor monitoring requests.
-    KeyedVector<int, Request> mRequests;  // guarded by mLock
+    // Locked map of file descriptor monitoring requests.
+    std::unordered_map<int, Request> mRequests;  // guarded by mLock
     int mNextRequestSeq;
 
     // This state is only used privately by pollOnce and does not require a lock since
     // it runs on a single thread.
     Vector<Response> mResponses;
     size_t mResponseIndex;
-    nsecs_t mNextMessageUptime; // set to LLONG_MAX when none
+
+    // Only written by pollOnce, and read by senders to know whether to wake it.
+    std::atomic<nsecs_t> mNextMessageUptime; // set to LLONG_MAX when none
 
     int pollInner(int timeoutMillis);
     int removeFd(int fd, int seq);
     void awoken();
     void pushResponse(int events, const Request& request);
+    void takePendingMessagesLocked();
     void rebuildEpollLocked();
     void scheduleEpollRebuildLocked();
 
     static void initTLSKey();
     static void threadDestructor(void *st);
     static void initEpollEvent(struct epoll_event* eventItem);
+    static bool isLaterMessage(const MessageEnvelope& a, const MessageEnvelope& b);
 };
 
 } // namespace android
@@ -327,11 +327,18 @@ protected:
 
 private:
     friend class weakref_type;
+    friend class CoallocatedRefs;
     class weakref_impl;
+    struct refs_block;
     
                             RefBase(const RefBase& o);
             RefBase&        operator=(const RefBase& o);
 
+    static void* allocateWithRefs(size_t size);
+    static void freeWithRefs(void* ptr);
+    static weakref_impl* createRefs(RefBase* base);
+    static void destroyRefs(weakref_impl* refs);
+
 private:
     friend class ReferenceMover;
 
@@ -348,6 +355,22 @@ private:
 
 // ---------------------------------------------------------------------------
 
+// Mixed into a class deriving from RefBase, as in
+//     class Foo : public RefBase, public CoallocatedRefs
+// allocates the reference counts of its objects in the same heap block as the
+// object, rather than in a block of their own.  The block is freed once both
+// the object and its reference counts are gone, so a wp<> outliving the object
+// keeps all of its memory allocated.
+
+class CoallocatedRefs
+{
+public:
+    static void* operator new(size_t size) { return RefBase::allocateWithRefs(size); }
+    static void operator delete(void* ptr) { RefBase::freeWithRefs(ptr); }
+};
+
+// ---------------------------------------------------------------------------
+
 template <typename T>
 class wp
 {
@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_SHARDED_LRU_CACHE_H
+#define ANDROID_UTILS_SHARDED_LRU_CACHE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <utils/LruCache.h>  // OnEntryRemoved
+#include <utils/Mutex.h>
+#include <utils/TypeHelpers.h>  // hash_t
+
+namespace android {
+
+/**
+ * Thread-safe LRU cache, split into shards by the hash of the keys. Each shard
+ * has its own lock and evicts its own least recently used entry when full, so
+ * the order of eviction is only LRU within a shard.
+ *
+ * All the entries are allocated up front: nothing is allocated or freed after
+ * construction, and the capacity is necessarily limited.
+ *
+ * Values are returned by copy, as another thread may evict an entry as soon as
+ * its shard is unlocked. The listener is called with the shard locked, and so
+ * must not use the cache.
+ */
+template <typename TKey, typename TValue>
+class ShardedLruCache {
+public:
+    enum {
+        kDefaultShardCount = 8,
+    };
+
+    // maxCapacity is split between the shards, and must not be 0.
+    explicit ShardedLruCache(uint32_t maxCapacity, uint32_t shardCount = kDefaultShardCount);
+    ~ShardedLruCache();
+
+    // Must be set before the cache is used by several threads.
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+    size_t size() const;
+    size_t capacity() const { return mCapacity; }
+    // Copies the value of key in outValue and makes it the most recently used.
+    bool get(const TKey& key, TValue* outValue);
+    // Returns false if key is already cached.
+    bool put(const TKey& key, const TValue& value);
+    bool remove(const TKey& key);
+    void clear();
+
+    // Number of get() that found, or did not find, their key.
+    uint64_t hitCount() const;
+    uint64_t missCount() const;
+
+private:
+    ShardedLruCache(const ShardedLruCache& that);  // disallow copy constructor
+
+    struct Item {
+        TKey key;
+        TValue value;
+
+        Item(const TKey& _key, const TValue& _value) : key(_key), value(_value) {
+        }
+    };
+
+    // The item is only constructed while the node is in use.
+    struct Node {
+        Node* parent;
+        Node* child;      // or the next free node
+        Node* hashNext;
+        uint32_t hash;
+        typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage;
+
+        Item& item() { return *reinterpret_cast<Item*>(&storage); }
+    };
+
+    struct Shard {
+        mutable Mutex lock;
+        std::unique_ptr<Node[]> nodes;
+        std::unique_ptr<Node*[]> buckets;
+        uint32_t bucketMask;
+        uint32_t capacity;
+        uint32_t size;
+        Node* freeList;
+        Node* oldest;
+        Node* youngest;
+        uint64_t hits;
+        uint64_t misses;
+
+        explicit Shard(uint32_t _capacity);
+    };
+
+    // Fibonacci hashing, as hash_type() is the identity for integers.
+#ifdef __clang__
+    __attribute__((no_sanitize("integer")))
+#endif
+    static uint32_t hashOf(const TKey& key) {
+        return uint32_t(hash_type(key)) * 0x9e3779b1U;
+    }
+
+    // The shard is picked by the high bits of the hash and the bucket by the others.
+    Shard& shardOf(uint32_t hash) const {
+        return *mShards[(uint64_t(hash) * mShards.size()) >> 32];
+    }
+    static Node** bucketOf(Shard& shard, uint32_t hash) {
+        return &shard.buckets[(hash ^ (hash >> 16)) & shard.bucketMask];
+    }
+
+    Node** findByKey(Shard& shard, uint32_t hash, const TKey& key) const;
+    void attachToShard(Shard& shard, Node* node);
+    void detachFromShard(Shard& shard, Node* node);
+    // Unlinks *link, which must point to node, and returns node to the free list.
+    void removeNode(Shard& shard, Node** link, Node* node);
+    void clearShard(Shard& shard);
+
+    std::vector<std::unique_ptr<Shard>> mShards;
+    uint32_t mCapacity;
+    OnEntryRemoved<TKey, TValue>* mListener;
+};
+
+// Implementation is here, because it's fully templated
+template <typename TKey, typename TValue>
+ShardedLruCache<TKey, TValue>::Shard::Shard(uint32_t _capacity)
+    : nodes(new Node[_capacity])
+    , bucketMask(0)
+    , capacity(_capacity)
+    , size(0)
+    , freeList(NULL)
+    , oldest(NULL)
+    , youngest(NULL)
+    , hits(0)
+    , misses(0) {
+    uint32_t bucketCount = 1;
+    while (bucketCount < capacity) {
+        bucketCount <<= 1;
+    }
+    buckets.reset(new Node*[bucketCount]());
+    bucketMask = bucketCount - 1;
+
+    for (uint32_t i = capacity; i > 0; i--) {
+        nodes[i - 1].child = freeList;
+        freeList = &nodes[i - 1];
+    }
+}
+
+template <typename TKey, typename TValue>
+ShardedLruCache<TKey, TValue>::ShardedLruCache(uint32_t maxCapacity, uint32_t shardCount)
+    : mCapacity(maxCapacity)
+    , mListener(NULL) {
+    if (shardCount > maxCapacity) {
+        shardCount = maxCapacity;
+    }
+    if (shardCount == 0) {
+        shardCount = 1;
+    }
+    mShards.reserve(shardCount);
+    for (uint32_t i = 0; i < shardCount; i++) {
+        uint32_t capacity = maxCapacity / shardCount + (i < maxCapacity % shardCount ? 1 : 0);
+        mShards.emplace_back(new Shard(capacity));
+    }
+}
+
+template <typename TKey, typename TValue>
+ShardedLruCache<TKey, TValue>::~ShardedLruCache() {
+    clear();
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::setOnEntryRemovedListener(
+        OnEntryRemoved<TKey, TValue>* listener) {
+    mListener = listener;
+}
+
+template <typename TKey, typename TValue>
+size_t ShardedLruCache<TKey, TValue>::size() const {
+    size_t size = 0;
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        size += shard->size;
+    }
+    return size;
+}
+
+template <typename TKey, typename TValue>
+bool ShardedLruCache<TKey, TValue>::get(const TKey& key, TValue* outValue) {
+    uint32_t hash = hashOf(key);
+    Shard& shard = shardOf(hash);
+    Mutex::Autolock _l(shard.lock);
+
+    Node* node = *findByKey(shard, hash, key);
+    if (node == NULL) {
+        shard.misses++;
+        return false;
+    }
+    shard.hits++;
+    if (node != shard.youngest) {
+        detachFromShard(shard, node);
+        attachToShard(shard, node);
+    }
+    *outValue = node->item().value;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ShardedLruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
+    uint32_t hash = hashOf(key);
+    Shard& shard = shardOf(hash);
+    Mutex::Autolock _l(shard.lock);
+
+    if (*findByKey(shard, hash, key) != NULL) {
+        return false;
+    }
+    if (shard.freeList == NULL) {
+        if (shard.oldest == NULL) {
+            return false;
+        }
+        Node* oldest = shard.oldest;
+        removeNode(shard, findByKey(shard, oldest->hash, oldest->item().key), oldest);
+    }
+
+    Node* node = shard.freeList;
+    new (&node->storage) Item(key, value);
+    shard.freeList = node->child;
+    node->hash = hash;
+    Node** bucket = bucketOf(shard, hash);
+    node->hashNext = *bucket;
+    *bucket = node;
+    attachToShard(shard, node);
+    shard.size++;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ShardedLruCache<TKey, TValue>::remove(const TKey& key) {
+    uint32_t hash = hashOf(key);
+    Shard& shard = shardOf(hash);
+    Mutex::Autolock _l(shard.lock);
+
+    Node** link = findByKey(shard, hash, key);
+    if (*link == NULL) {
+        return false;
+    }
+    removeNode(shard, link, *link);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::clear() {
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        clearShard(*shard);
+    }
+}
+
+template <typename TKey, typename TValue>
+uint64_t ShardedLruCache<TKey, TValue>::hitCount() const {
+    uint64_t hits = 0;
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        hits += shard->hits;
+    }
+    return hits;
+}
+
+template <typename TKey, typename TValue>
+uint64_t ShardedLruCache<TKey, TValue>::missCount() const {
+    uint64_t misses = 0;
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        misses += shard->misses;
+    }
+    return misses;
+}
+
+template <typename TKey, typename TValue>
+typename ShardedLruCache<TKey, TValue>::Node** ShardedLruCache<TKey, TValue>::findByKey(
+        Shard& shard, uint32_t hash, const TKey& key) const {
+    Node** link = bucketOf(shard, hash);
+    while (*link != NULL && ((*link)->hash != hash || !((*link)->item().key == key))) {
+        link = &(*link)->hashNext;
+    }
+    return link;
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::attachToShard(Shard& shard, Node* node) {
+    node->parent = shard.youngest;
+    node->child = NULL;
+    if (shard.youngest == NULL) {
+        shard.oldest = node;
+    } else {
+        shard.youngest->child = node;
+    }
+    shard.youngest = node;
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::detachFromShard(Shard& shard, Node* node) {
+    if (node->parent != NULL) {
+        node->parent->child = node->child;
+    } else {
+        shard.oldest = node->child;
+    }
+    if (node->child != NULL) {
+        node->child->parent = node->parent;
+    } else {
+        shard.youngest = node->parent;
+    }
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::removeNode(Shard& shard, Node** link, Node* node) {
+    *link = node->hashNext;
+    detachFromShard(shard, node);
+    if (mListener) {
+        (*mListener)(node->item().key, node->item().value);
+    }
+    node->item().~Item();
+    node->child = shard.freeList;
+    shard.freeList = node;
+    shard.size--;
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::clearShard(Shard& shard) {
+    Node* node = shard.oldest;
+    while (node != NULL) {
+        Node* child = node->child;
+        if (mListener) {
+            (*mListener)(node->item().key, node->item().value);
+        }
+        node->item().~Item();
+        node->child = shard.freeList;
+        shard.freeList = node;
+        node = child;
+    }
+    for (uint32_t i = 0; i <= shard.bucketMask; i++) {
+        shard.buckets[i] = NULL;
+    }
+    shard.oldest = NULL;
+    shard.youngest = NULL;
+    shard.size = 0;
+}
+
+}
+#endif // ANDROID_UTILS_SHARDED_LRU_CACHE_H
@@ -19,6 +19,7 @@
 
 #include <new>
 #include <type_traits>
+#include <utility>
 
 #include <stdint.h>
 #include <string.h>
@@ -207,8 +208,9 @@ move_forward_type(TYPE* d, const TYPE* s, size_t n = 1) {
     while (n > 0) {
         n--;
         --d, --s;
+        // The source is destroyed right after, so it can be moved from.
         if (!traits<TYPE>::has_trivial_copy) {
-            new(d) TYPE(*s);
+            new(d) TYPE(std::move(*const_cast<TYPE*>(s)));
         } else {
             *d = *s;
         }
@@ -232,7 +234,7 @@ move_backward_type(TYPE* d, const TYPE* s, size_t n = 1) {
     while (n > 0) {
         n--;
         if (!traits<TYPE>::has_trivial_copy) {
-            new(d) TYPE(*s);
+            new(d) TYPE(std::move(*const_cast<TYPE*>(s)));
         } else {
             *d = *s;
         }
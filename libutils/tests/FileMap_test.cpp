@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+#include <utils/FileMap.h>
+
+namespace android {
+
+class FileMapTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        mPageSize = sysconf(_SC_PAGESIZE);
+        // Four pages and a bit, so that maps can start and end within a page.
+        std::string data(mPageSize * 4 + 100, 'x');
+        ASSERT_TRUE(android::base::WriteStringToFd(data, mFile.fd));
+    }
+
+    TemporaryFile mFile;
+    size_t mPageSize;
+};
+
+TEST_F(FileMapTest, AdviseRange) {
+    FileMap map;
+    ASSERT_TRUE(map.create(mFile.path, mFile.fd, 10, mPageSize * 3, true));
+
+    EXPECT_EQ(0, map.advise(FileMap::SEQUENTIAL));
+    EXPECT_EQ(0, map.advise(FileMap::WILLNEED, 0, map.getDataLength()));
+    EXPECT_EQ(0, map.advise(FileMap::RANDOM, mPageSize - 20, 40));
+    EXPECT_EQ(0, map.advise(FileMap::HUGEPAGE, 0, 1));
+    EXPECT_EQ(0, map.advise(FileMap::NOHUGEPAGE));
+    EXPECT_EQ(0, map.prefetch(map.getDataLength() - 1, 1));
+
+    EXPECT_EQ(-1, map.advise(FileMap::NORMAL, map.getDataLength() + 1, 0));
+    EXPECT_EQ(-1, map.advise(FileMap::NORMAL, 1, map.getDataLength()));
+}
+
+TEST_F(FileMapTest, ResidentLength) {
+    FileMap map;
+    ASSERT_TRUE(map.create(mFile.path, mFile.fd, 10, mPageSize * 3, true));
+
+    // Touching every page brings in all of the data, and nothing around it.
+    volatile const char* data = static_cast<const char*>(map.getDataPtr());
+    for (size_t i = 0; i < map.getDataLength(); i += mPageSize) {
+        EXPECT_EQ('x', data[i]);
+    }
+    EXPECT_EQ('x', data[map.getDataLength() - 1]);
+    EXPECT_EQ(static_cast<ssize_t>(map.getDataLength()), map.getResidentLength());
+}
+
+}  // namespace android
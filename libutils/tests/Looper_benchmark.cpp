@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <utils/Looper.h>
+
+using namespace android;
+
+namespace {
+
+class NopHandler : public MessageHandler {
+public:
+    void handleMessage(const Message&) override {}
+};
+
+class NopCallback : public LooperCallback {
+public:
+    int handleEvent(int, int, void*) override { return 1; }
+};
+
+// Delays spread over a second, so that most messages land in the middle of the queue.
+nsecs_t delayFor(size_t i) {
+    return ((i * 7919) % 1000) * 1000000LL + 1000000000LL;
+}
+
+}  // namespace
+
+// Sends delayed messages to a looper already holding state.range(0) of them.
+static void BM_Looper_sendMessageDelayed(benchmark::State& state) {
+    sp<Looper> looper = new Looper(true);
+    sp<MessageHandler> handler = new NopHandler();
+    sp<MessageHandler> other = new NopHandler();
+    size_t queued = state.range(0);
+    for (size_t i = 0; i < queued; i++) {
+        looper->sendMessageDelayed(delayFor(i), other, Message(0));
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        looper->sendMessageDelayed(delayFor(i++), handler, Message(1));
+        if (i % 1024 == 0) {
+            state.PauseTiming();
+            looper->removeMessages(handler);
+            state.ResumeTiming();
+        }
+    }
+    looper->removeMessages(handler);
+    looper->removeMessages(other);
+}
+BENCHMARK(BM_Looper_sendMessageDelayed)->Arg(0)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Sends delayed messages from several threads at once. The looper of a run is
+// only replaced by the next one, as the other threads may still be using it
+// when thread 0 returns.
+static void BM_Looper_sendMessageDelayed_threads(benchmark::State& state) {
+    static sp<Looper> looper;
+    if (state.thread_index == 0) {
+        looper = new Looper(true);
+        sp<MessageHandler> other = new NopHandler();
+        for (size_t i = 0; i < 1000; i++) {
+            looper->sendMessageDelayed(delayFor(i), other, Message(0));
+        }
+    }
+
+    sp<MessageHandler> handler = new NopHandler();
+    size_t i = state.thread_index;
+    while (state.KeepRunning()) {
+        looper->sendMessageDelayed(delayFor(i++), handler, Message(1));
+        if (i % 1024 == 0) {
+            state.PauseTiming();
+            looper->removeMessages(handler);
+            state.ResumeTiming();
+        }
+    }
+    looper->removeMessages(handler);
+}
+BENCHMARK(BM_Looper_sendMessageDelayed_threads)->ThreadRange(1, 8)->UseRealTime();
+
+// Sends messages due now and delivers them.
+static void BM_Looper_sendAndPoll(benchmark::State& state) {
+    sp<Looper> looper = new Looper(true);
+    sp<MessageHandler> handler = new NopHandler();
+    size_t batch = state.range(0);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < batch; i++) {
+            looper->sendMessage(handler, Message(1));
+        }
+        looper->pollOnce(0);
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_Looper_sendAndPoll)->Arg(1)->Arg(64);
+
+// Adds and removes an fd while state.range(0) others are registered.
+static void BM_Looper_addRemoveFd(benchmark::State& state) {
+    sp<Looper> looper = new Looper(true);
+    sp<LooperCallback> callback = new NopCallback();
+    std::vector<int> fds;
+    for (int i = 0; i < state.range(0); i++) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        looper->addFd(fd, 0, Looper::EVENT_INPUT, callback, nullptr);
+        fds.push_back(fd);
+    }
+
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    while (state.KeepRunning()) {
+        looper->addFd(fd, 0, Looper::EVENT_INPUT, callback, nullptr);
+        looper->removeFd(fd);
+    }
+
+    close(fd);
+    for (int registered : fds) {
+        looper->removeFd(registered);
+        close(registered);
+    }
+}
+BENCHMARK(BM_Looper_addRemoveFd)->Arg(0)->Arg(100)->Arg(1000);
+
+BENCHMARK_MAIN();
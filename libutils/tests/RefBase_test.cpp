@@ -90,6 +90,70 @@ TEST(RefBase, WeakCopies) {
     ASSERT_FALSE(isDeleted) << "Deletion on wp destruction should no longer occur";
 }
 
+class CoallocatedFoo : public Foo, public CoallocatedRefs {
+public:
+    CoallocatedFoo(bool* deleted_check, bool weak_lifetime = false) : Foo(deleted_check) {
+        if (weak_lifetime) {
+            extendObjectLifetime(OBJECT_LIFETIME_WEAK);
+        }
+    }
+};
+
+TEST(RefBase, CoallocatedRefs) {
+    bool isDeleted;
+    CoallocatedFoo* foo = new CoallocatedFoo(&isDeleted);
+    // The reference counts are at the start of the block of the object.
+    const char* refs = reinterpret_cast<const char*>(foo->getWeakRefs());
+    ASSERT_LT(refs, reinterpret_cast<const char*>(foo));
+    ASSERT_GT(refs + 128, reinterpret_cast<const char*>(foo));
+
+    wp<CoallocatedFoo> wp1;
+    {
+        sp<CoallocatedFoo> sp1(foo);
+        wp1 = sp1;
+        ASSERT_EQ(1, foo->getStrongCount());
+        ASSERT_EQ(2, foo->getWeakRefs()->getWeakCount());
+    }
+    ASSERT_TRUE(isDeleted) << "foo was leaked!";
+    // The reference counts outlive the object.
+    ASSERT_EQ(1, wp1.get_refs()->getWeakCount());
+    ASSERT_TRUE(wp1.promote().get() == nullptr);
+}
+
+TEST(RefBase, CoallocatedRefsWeakLifetime) {
+    bool isDeleted;
+    wp<CoallocatedFoo> wp1;
+    {
+        sp<CoallocatedFoo> sp1 = new CoallocatedFoo(&isDeleted, true);
+        wp1 = sp1;
+    }
+    ASSERT_FALSE(isDeleted) << "deleted too early! still has a weak reference!";
+    ASSERT_TRUE(wp1.promote().get() != nullptr);
+    wp1.clear();
+    ASSERT_TRUE(isDeleted) << "foo was leaked!";
+}
+
+// Allocates another CoallocatedRefs object before the RefBase constructor of
+// the class deriving from it runs.
+class Allocating {
+public:
+    Allocating() : mFoo(new CoallocatedFoo(&mFooDeleted)) { }
+
+    sp<CoallocatedFoo> mFoo;
+    bool mFooDeleted;
+};
+
+class CoallocatedNested : public Allocating, public RefBase, public CoallocatedRefs {
+};
+
+TEST(RefBase, CoallocatedRefsNested) {
+    sp<CoallocatedNested> nested = new CoallocatedNested();
+    wp<CoallocatedNested> wp1(nested);
+    ASSERT_EQ(1, nested->getStrongCount());
+    ASSERT_EQ(1, nested->mFoo->getStrongCount());
+    nested.clear();
+    ASSERT_TRUE(wp1.promote().get() == nullptr);
+}
 
 // Set up a situation in which we race with visit2AndRremove() to delete
 // 2 strong references.  Bar destructor checks that there are no early
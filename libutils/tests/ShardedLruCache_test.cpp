@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/ShardedLruCache.h>
+
+namespace {
+
+typedef int SimpleKey;
+typedef const char* StringValue;
+
+struct ComplexValue {
+    int v;
+
+    explicit ComplexValue(int v) : v(v) {
+        instanceCount += 1;
+    }
+
+    ComplexValue(const ComplexValue& other) : v(other.v) {
+        instanceCount += 1;
+    }
+
+    ComplexValue& operator=(const ComplexValue& other) = default;
+
+    ~ComplexValue() {
+        instanceCount -= 1;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexValue::instanceCount = 0;
+
+} // namespace
+
+namespace android {
+
+typedef ShardedLruCache<SimpleKey, StringValue> SimpleCache;
+typedef ShardedLruCache<SimpleKey, ComplexValue> ComplexCache;
+
+class EntryRemovedCallback : public OnEntryRemoved<SimpleKey, StringValue> {
+public:
+    EntryRemovedCallback() : callbackCount(0), lastKey(-1), lastValue(NULL) { }
+    void operator()(SimpleKey& k, StringValue& v) {
+        callbackCount += 1;
+        lastKey = k;
+        lastValue = v;
+    }
+    ssize_t callbackCount;
+    SimpleKey lastKey;
+    StringValue lastValue;
+};
+
+class ShardedLruCacheTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        ComplexValue::instanceCount = 0;
+    }
+
+    virtual void TearDown() {
+        EXPECT_EQ(0, ComplexValue::instanceCount);
+    }
+};
+
+TEST_F(ShardedLruCacheTest, Empty) {
+    SimpleCache cache(100);
+    StringValue value = NULL;
+
+    EXPECT_FALSE(cache.get(0, &value));
+    EXPECT_FALSE(cache.get(1, &value));
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_EQ(100U, cache.capacity());
+}
+
+TEST_F(ShardedLruCacheTest, Simple) {
+    SimpleCache cache(100);
+    StringValue value = NULL;
+
+    EXPECT_TRUE(cache.put(1, "one"));
+    EXPECT_TRUE(cache.put(2, "two"));
+    EXPECT_TRUE(cache.put(3, "three"));
+    EXPECT_FALSE(cache.put(1, "uno"));
+    EXPECT_TRUE(cache.get(1, &value));
+    EXPECT_STREQ("one", value);
+    EXPECT_TRUE(cache.get(2, &value));
+    EXPECT_STREQ("two", value);
+    EXPECT_TRUE(cache.get(3, &value));
+    EXPECT_STREQ("three", value);
+    EXPECT_EQ(3U, cache.size());
+}
+
+TEST_F(ShardedLruCacheTest, MaxCapacity) {
+    SimpleCache cache(2, 1);
+    StringValue value = NULL;
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_FALSE(cache.get(1, &value));
+    EXPECT_TRUE(cache.get(2, &value));
+    EXPECT_TRUE(cache.get(3, &value));
+    EXPECT_EQ(2U, cache.size());
+}
+
+TEST_F(ShardedLruCacheTest, GetUpdatesLru) {
+    SimpleCache cache(2, 1);
+    StringValue value = NULL;
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    EXPECT_TRUE(cache.get(1, &value));
+    cache.put(3, "three");
+    EXPECT_TRUE(cache.get(1, &value));
+    EXPECT_FALSE(cache.get(2, &value));
+    EXPECT_TRUE(cache.get(3, &value));
+}
+
+TEST_F(ShardedLruCacheTest, CapacityIsSplitBetweenShards) {
+    SimpleCache cache(100, 8);
+
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, "value");
+    }
+    EXPECT_EQ(100U, cache.size());
+
+    SimpleCache small(3, 8);
+    for (int i = 0; i < 100; i++) {
+        small.put(i, "value");
+    }
+    EXPECT_EQ(3U, small.size());
+}
+
+TEST_F(ShardedLruCacheTest, Remove) {
+    SimpleCache cache(100);
+    StringValue value = NULL;
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    EXPECT_TRUE(cache.remove(1));
+    EXPECT_FALSE(cache.remove(1));
+    EXPECT_FALSE(cache.get(1, &value));
+    EXPECT_TRUE(cache.get(2, &value));
+    EXPECT_EQ(1U, cache.size());
+
+    EXPECT_TRUE(cache.put(1, "uno"));
+    EXPECT_TRUE(cache.get(1, &value));
+    EXPECT_STREQ("uno", value);
+}
+
+TEST_F(ShardedLruCacheTest, HitAndMissCounts) {
+    SimpleCache cache(100);
+    StringValue value = NULL;
+
+    cache.put(1, "one");
+    cache.get(1, &value);
+    cache.get(1, &value);
+    cache.get(2, &value);
+    EXPECT_EQ(2U, cache.hitCount());
+    EXPECT_EQ(1U, cache.missCount());
+}
+
+TEST_F(ShardedLruCacheTest, Callback) {
+    SimpleCache cache(2, 1);
+    EntryRemovedCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_EQ(1, callback.callbackCount);
+    EXPECT_EQ(1, callback.lastKey);
+    EXPECT_STREQ("one", callback.lastValue);
+
+    cache.remove(2);
+    EXPECT_EQ(2, callback.callbackCount);
+    EXPECT_EQ(2, callback.lastKey);
+
+    cache.clear();
+    EXPECT_EQ(3, callback.callbackCount);
+    EXPECT_EQ(3, callback.lastKey);
+    EXPECT_EQ(0U, cache.size());
+}
+
+TEST_F(ShardedLruCacheTest, NoLeak) {
+    {
+        ComplexCache cache(10);
+
+        for (int i = 0; i < 100; i++) {
+            cache.put(i, ComplexValue(i));
+        }
+        EXPECT_EQ(10, ComplexValue::instanceCount);
+        cache.remove(99);
+        EXPECT_EQ(ssize_t(cache.size()), ComplexValue::instanceCount);
+    }
+    EXPECT_EQ(0, ComplexValue::instanceCount);
+}
+
+TEST_F(ShardedLruCacheTest, ClearReuseOk) {
+    ComplexCache cache(10, 2);
+    ComplexValue value(0);
+
+    for (int i = 0; i < 10; i++) {
+        cache.put(i, ComplexValue(i));
+    }
+    cache.clear();
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_FALSE(cache.get(1, &value));
+
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(cache.put(i, ComplexValue(i * 2)));
+    }
+    EXPECT_TRUE(cache.get(4, &value));
+    EXPECT_EQ(8, value.v);
+    EXPECT_EQ(10U, cache.size());
+}
+
+TEST_F(ShardedLruCacheTest, Concurrent) {
+    const int kNumThreads = 8;
+    const int kNumKeys = 1024;
+    const int kNumIters = 20000;
+    SimpleCache cache(256);
+    static const char* const kValues[] = { "even", "odd" };
+    std::atomic<int> mismatches(0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+        threads.emplace_back([&cache, &mismatches, t]() {
+            std::minstd_rand random(t + 1);
+            for (int i = 0; i < kNumIters; i++) {
+                int key = random() % kNumKeys;
+                StringValue value = NULL;
+                if (cache.get(key, &value)) {
+                    if (value != kValues[key & 1]) {
+                        mismatches++;
+                    }
+                } else if (i % 16 == 0) {
+                    cache.remove(key);
+                } else {
+                    cache.put(key, kValues[key & 1]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(0, mismatches.load());
+    EXPECT_GE(256U, cache.size());
+    EXPECT_EQ(uint64_t(kNumThreads) * kNumIters, cache.hitCount() + cache.missCount());
+}
+
+}
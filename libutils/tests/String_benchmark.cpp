@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+
+using namespace android;
+
+namespace {
+
+// A property name, and a path long enough for the word at a time conversions
+// to matter.
+const char kShortAscii[] = "ro.build.id";
+const char kLongAscii[] = "/data/user/0/com.android.providers.settings/shared_prefs/prefs.xml";
+// Mostly ASCII with a multi-byte character in the middle.
+const char kLongMixed[] = "/data/media/0/Music/Bj\xC3\xB6rk/Homogenic/01 Hunter.flac";
+
+const char* const kStrings[] = { kShortAscii, kLongAscii, kLongMixed };
+
+}  // namespace
+
+static void BM_String8_String16(benchmark::State& state) {
+    String16 str(kStrings[state.range(0)]);
+    while (state.KeepRunning()) {
+        String8 converted(str);
+        benchmark::DoNotOptimize(converted.string());
+    }
+}
+BENCHMARK(BM_String8_String16)->DenseRange(0, 2);
+
+static void BM_String16_String8(benchmark::State& state) {
+    String8 str(kStrings[state.range(0)]);
+    while (state.KeepRunning()) {
+        String16 converted(str);
+        benchmark::DoNotOptimize(converted.string());
+    }
+}
+BENCHMARK(BM_String16_String8)->DenseRange(0, 2);
+
+static void BM_utf8_to_utf16_length(benchmark::State& state) {
+    const char* str = kStrings[state.range(0)];
+    size_t len = strlen(str);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(
+                utf8_to_utf16_length(reinterpret_cast<const uint8_t*>(str), len));
+    }
+}
+BENCHMARK(BM_utf8_to_utf16_length)->DenseRange(0, 2);
+
+static void BM_utf16_to_utf8_length(benchmark::State& state) {
+    String16 str(kStrings[state.range(0)]);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(utf16_to_utf8_length(str.string(), str.size()));
+    }
+}
+BENCHMARK(BM_utf16_to_utf8_length)->DenseRange(0, 2);
+
+BENCHMARK_MAIN();
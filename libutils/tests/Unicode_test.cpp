@@ -176,6 +176,52 @@ TEST_F(UnicodeTest, strstr16TargetNotPresent) {
     EXPECT_EQ(nullptr, result);
 }
 
+TEST_F(UnicodeTest, UTF8toUTF16AsciiRuns) {
+    // ASCII runs of various lengths around multi-byte characters.
+    const char* str = "0123456789abcdef\xC4\x80" "0123456789" "\xE2\x8C\xA3"
+            "0123\xF0\x90\x80\x80" "0123456789abcdefghij";
+    const char16_t* str16 = u"0123456789abcdef\u0100" "0123456789" "\u2323"
+            "0123\U00010000" "0123456789abcdefghij";
+    const size_t len = strlen(str);
+    const size_t len16 = strlen16(str16);
+
+    // Start at every offset, to cover runs crossing word boundaries.
+    for (size_t start = 0; start < 8; start++) {
+        const uint8_t* u8 = reinterpret_cast<const uint8_t*>(str) + start;
+        EXPECT_EQ(ssize_t(len16 - start), utf8_to_utf16_length(u8, len - start));
+
+        char16_t output[64];
+        utf8_to_utf16(u8, len - start, output, len16 - start + 1);
+        EXPECT_EQ(0, strcmp16(str16 + start, output));
+    }
+}
+
+TEST_F(UnicodeTest, UTF8toUTF16AsciiTruncated) {
+    const uint8_t str[] = "0123456789abcdefghij";
+    char16_t output[8];
+
+    char16_t* end = utf8_to_utf16_no_null_terminator(str, sizeof(str) - 1, output, 8);
+    EXPECT_EQ(output + 8, end);
+    EXPECT_EQ(0, strncmp16(u"01234567", output, 8));
+}
+
+TEST_F(UnicodeTest, UTF16toUTF8AsciiRuns) {
+    const char16_t* str16 = u"0123456789abcdef\u0100" "0123456789" "\u2323"
+            "0123\U00010000" "0123456789abcdefghij";
+    const char* str = "0123456789abcdef\xC4\x80" "0123456789" "\xE2\x8C\xA3"
+            "0123\xF0\x90\x80\x80" "0123456789abcdefghij";
+    const size_t len = strlen(str);
+    const size_t len16 = strlen16(str16);
+
+    for (size_t start = 0; start < 4; start++) {
+        EXPECT_EQ(ssize_t(len - start), utf16_to_utf8_length(str16 + start, len16 - start));
+
+        char output[64];
+        utf16_to_utf8(str16 + start, len16 - start, output, len - start + 1);
+        EXPECT_STREQ(str + start, output);
+    }
+}
+
 // http://b/29267949
 // Test that overreading in utf8_to_utf16_length is detected
 TEST_F(UnicodeTest, InvalidUtf8OverreadDetected) {
@@ -22,6 +22,7 @@
 
 #include <android/log.h>
 #include <gtest/gtest.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -136,4 +137,80 @@ TEST_F(VectorTest, editArray_Shared) {
   }
 }
 
+// Counts the copies and moves of its values.
+struct Counted {
+    static int copies;
+    static int moves;
+
+    explicit Counted(int v = 0) : value(v) { }
+    Counted(const Counted& o) : value(o.value) { copies++; }
+    Counted(Counted&& o) : value(o.value) { moves++; }
+    Counted& operator=(const Counted& o) { value = o.value; copies++; return *this; }
+
+    int value;
+};
+
+int Counted::copies;
+int Counted::moves;
+
+TEST_F(VectorTest, Grow_MovesItems) {
+  Vector<Counted> vector;
+  Counted::copies = 0;
+  for (int i = 0; i < 100; i++) {
+    vector.add(Counted(i));
+  }
+  // Only the items added are copied, the ones already there are moved as the
+  // vector grows.
+  EXPECT_EQ(100, Counted::copies);
+  EXPECT_LT(0, Counted::moves);
+
+  Counted::copies = 0;
+  vector.insertAt(Counted(-1), 50);
+  vector.removeItemsAt(0, 90);
+  EXPECT_EQ(1, Counted::copies);
+  ASSERT_EQ(11U, vector.size());
+  EXPECT_EQ(89, vector[0].value);
+  EXPECT_EQ(99, vector[10].value);
+}
+
+TEST_F(VectorTest, Grow_TriviallyMovable) {
+  Vector<String8> vector;
+  for (int i = 0; i < 100; i++) {
+    vector.add(String8::format("%d", i));
+  }
+  vector.insertAt(String8("middle"), 50);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_STREQ(String8::format("%d", i).string(), vector[i < 50 ? i : i + 1].string());
+  }
+  EXPECT_STREQ("middle", vector[50].string());
+
+  vector.removeItemsAt(10, 80);
+  ASSERT_EQ(21U, vector.size());
+  EXPECT_STREQ("9", vector[9].string());
+  EXPECT_STREQ("89", vector[10].string());
+  EXPECT_STREQ("99", vector[20].string());
+}
+
+TEST_F(VectorTest, Grow_SharedTriviallyMovable) {
+  Vector<String8> vector;
+  for (int i = 0; i < 10; i++) {
+    vector.add(String8::format("%d", i));
+  }
+  // Growing and shrinking copies of the vector must leave it alone.
+  Vector<String8> other(vector);
+  for (int i = 10; i < 100; i++) {
+    other.insertAt(String8::format("%d", i), 5);
+  }
+  Vector<String8> removed(vector);
+  removed.removeItemsAt(0, 9);
+
+  ASSERT_EQ(10U, vector.size());
+  for (int i = 0; i < 10; i++) {
+    EXPECT_STREQ(String8::format("%d", i).string(), vector[i].string());
+  }
+  ASSERT_EQ(100U, other.size());
+  ASSERT_EQ(1U, removed.size());
+  EXPECT_STREQ("9", removed[0].string());
+}
+
 } // namespace android
@@ -26,6 +26,8 @@
 #include <sys/types.h>
 #include <utils/Compat.h>
 
+#include <memory>
+
 /* Zip compression methods we support */
 enum {
   kCompressStored = 0,    // no compression
@@ -101,6 +103,12 @@ struct ZipEntry {
 
   // The offset to the start of data for this ZipEntry.
   off64_t offset;
+
+  // Returns whether the data starts at a multiple of `alignment` bytes into
+  // the archive, as zipalign arranges for stored entries. A stored entry
+  // aligned to the page size can be mapped straight from the archive's file
+  // descriptor at `offset`, see also MapStoredEntry.
+  bool IsAligned(size_t alignment) const { return (offset % alignment) == 0; }
 };
 
 typedef void* ZipArchiveHandle;
@@ -114,6 +122,25 @@ typedef void* ZipArchiveHandle;
  */
 int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle);
 
+/*
+ * Like OpenArchive, but caches the table of entries built from the central
+ * directory in the file at indexFileName. If that index was built from this
+ * same file (same device, inode, size and modification time, and the same
+ * central directory) it is mapped read-only instead of scanning the central
+ * directory, so opening is cheap and the table is shared by every process
+ * that opens the archive this way. Otherwise the archive is scanned as usual
+ * and the index is rewritten, atomically; failing to write it is not an
+ * error.
+ *
+ * The index must live somewhere only trusted processes can write. It can't
+ * make lookups read outside the central directory, but it can hide entries.
+ * On Windows the index is ignored.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle);
+
 /*
  * Like OpenArchive, but takes a file descriptor open for reading
  * at the start of the file.  The descriptor must be mappable (this does
@@ -137,6 +164,25 @@ int32_t OpenArchiveFd(const int fd, const char* debugFileName, ZipArchiveHandle*
 
 int32_t OpenArchiveFromMemory(void* address, size_t length, const char* debugFileName,
                               ZipArchiveHandle* handle);
+
+/*
+ * Like OpenArchive and OpenArchiveFd, but only maps the central directory
+ * instead of scanning it. FindEntry then validates and hashes entries just
+ * until it finds the one asked for, and iteration walks the central
+ * directory in order without building the table at all, so callers that
+ * only need a few entries from an archive don't pay for all of them.
+ *
+ * The catch is that a malformed or duplicate entry is only reported once a
+ * lookup or iteration reaches it, rather than by the open. Callers relying
+ * on the archive being well formed as a whole, such as signature
+ * verification, must use OpenArchive.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t OpenArchiveLazy(const char* fileName, ZipArchiveHandle* handle);
+
+int32_t OpenArchiveFdLazy(const int fd, const char* debugFileName, ZipArchiveHandle* handle,
+                          bool assume_ownership = true);
 /*
  * Close archive, releasing resources associated with it. This will
  * unmap the central directory of the zipfile and free all internal
@@ -217,6 +263,49 @@ int32_t ExtractToMemory(ZipArchiveHandle handle, ZipEntry* entry, uint8_t* begin
 
 int GetFileDescriptor(const ZipArchiveHandle handle);
 
+namespace android {
+class FileMap;
+}  // namespace android
+
+/*
+ * Read-only access to the data of a stored entry in place, see
+ * MapStoredEntry. The data stays valid for as long as this object does,
+ * even after the archive is closed, unless the archive was opened from
+ * memory, in which case the data is that memory.
+ */
+class MappedZipEntry {
+ public:
+  ~MappedZipEntry();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedZipEntry(std::unique_ptr<android::FileMap> map, const uint8_t* data, size_t size);
+
+  std::unique_ptr<android::FileMap> map_;
+  const uint8_t* data_;
+  size_t size_;
+
+  friend int32_t MapStoredEntry(ZipArchiveHandle, const ZipEntry*,
+                                std::unique_ptr<MappedZipEntry>*);
+};
+
+/*
+ * Maps the data of the stored (uncompressed) |entry| read-only, rather than
+ * copying it out like ExtractToMemory, so that processes mapping the same
+ * entry share clean pages. Entries that are also page aligned, see
+ * ZipEntry::IsAligned, don't share their first or last page with their
+ * neighbours.
+ *
+ * Empty entries map to no data at all.
+ *
+ * Returns 0 on success and negative values on failure, including for
+ * compressed entries.
+ */
+int32_t MapStoredEntry(ZipArchiveHandle handle, const ZipEntry* entry,
+                       std::unique_ptr<MappedZipEntry>* mapped_entry);
+
 const char* ErrorCodeString(int32_t error_code);
 
 #if !defined(_WIN32)
@@ -228,6 +317,30 @@ typedef bool (*ProcessZipEntryFunction)(const uint8_t* buf, size_t buf_size, voi
  */
 int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
                                 ProcessZipEntryFunction func, void* cookie);
+
+/*
+ * Returns a file descriptor open for writing at the offset where |entry|
+ * must be extracted, -1 to skip it, or another negative value to stop
+ * ExtractEntriesToFiles, which then returns that value.
+ */
+typedef int (*ExtractOpenFunction)(const ZipString& name, const ZipEntry& entry, void* cookie);
+
+/*
+ * Extracts every entry whose name starts with |optional_prefix|, or every
+ * entry with nullptr, with up to |num_threads| threads, or one per CPU if
+ * that is 0. The entries are extracted as if by ExtractEntryToFile.
+ *
+ * |open_func| is called, from the calling thread and in iteration order,
+ * to get the destination of each entry, including directory entries, and
+ * the descriptor it returns is closed once the entry is written. Only a
+ * few entries get ahead of the extraction, so the descriptors open at any
+ * one time and the memory used are both bounded by |num_threads|.
+ *
+ * Returns 0 once every entry has been extracted. On failure, no new
+ * extractions are started, and the first error is returned.
+ */
+int32_t ExtractEntriesToFiles(ZipArchiveHandle handle, const ZipString* optional_prefix,
+                              ExtractOpenFunction open_func, void* cookie, size_t num_threads);
 #endif
 
 namespace zip_archive {
@@ -235,6 +348,14 @@ namespace zip_archive {
 class Writer {
  public:
   virtual bool Append(uint8_t* buf, size_t buf_size) = 0;
+
+  /*
+   * Returns |length| bytes of the destination, for the caller to fill in
+   * as if it had been passed to Append, or nullptr if the writer can't hand
+   * out its storage. Extracting to memory uses this to decompress in place.
+   */
+  virtual uint8_t* GetBuffer(size_t length);
+
   virtual ~Writer();
 
  protected:
@@ -271,6 +392,51 @@ class Reader {
  */
 int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
                 const uint32_t uncompressed_length, Writer* writer, uint64_t* crc_out);
+
+/*
+ * A replacement for Inflate, for example one backed by a faster inflate
+ * implementation. It must honour the same contract as Inflate, and be safe
+ * to call from several threads at once if the archive is.
+ */
+class Decompressor {
+ public:
+  virtual int32_t Inflate(const Reader& reader, uint32_t compressed_length,
+                          uint32_t uncompressed_length, Writer* writer,
+                          uint64_t* crc_out) const = 0;
+  virtual ~Decompressor();
+
+ protected:
+  Decompressor() = default;
+
+ private:
+  Decompressor(const Decompressor&) = delete;
+  void operator=(const Decompressor&) = delete;
+};
 }  // namespace zip_archive
 
+/*
+ * Makes ExtractToMemory, ExtractEntryToFile and ProcessZipEntryContents
+ * inflate the entries of this archive with |decompressor| rather than
+ * zip_archive::Inflate, which nullptr restores.
+ * Call it right after opening the archive. |decompressor| is not owned and
+ * must outlive the handle.
+ */
+void SetDecompressor(ZipArchiveHandle handle, const zip_archive::Decompressor* decompressor);
+
+/*
+ * Makes this archive read entry data and local file headers through
+ * read-only mappings of |window_size| byte windows of the file rather than
+ * with pread. At most |max_windows| are kept mapped, the least recently used
+ * is unmapped to make room for new ones, so even an archive larger than a
+ * 32-bit address space reads at close to the speed of a mapped one from a
+ * bounded amount of address space. Reads fall back to pread where a window
+ * can't be mapped, and a |max_windows| of 0 goes back to pread altogether.
+ * Like the central directory, the windows fault if the file is truncated
+ * while they are mapped.
+ *
+ * Call it right after opening the archive. Returns 0 on success, and
+ * kInvalidHandle for an archive opened from memory.
+ */
+int32_t SetMappingWindows(ZipArchiveHandle handle, size_t window_size, size_t max_windows);
+
 #endif  // LIBZIPARCHIVE_ZIPARCHIVE_H_
@@ -24,6 +24,17 @@
 
 class ZipArchiveStreamEntry {
  public:
+  struct Options {
+    // Bytes read from the archive at a time, which is also the most Read
+    // returns at once. 0 picks the default of 64K.
+    size_t chunk_size = 0;
+    // When not 0, the kernel is asked to start reading up to this many bytes
+    // past the current position in the background, and asked again every
+    // time half of that has been consumed, so that reads of the next chunks
+    // find their data cached instead of stalling on the storage.
+    size_t read_ahead = 0;
+  };
+
   virtual ~ZipArchiveStreamEntry() {}
 
   virtual const std::vector<uint8_t>* Read() = 0;
@@ -32,16 +43,33 @@ class ZipArchiveStreamEntry {
 
   static ZipArchiveStreamEntry* Create(ZipArchiveHandle handle, const ZipEntry& entry);
   static ZipArchiveStreamEntry* CreateRaw(ZipArchiveHandle handle, const ZipEntry& entry);
+  static ZipArchiveStreamEntry* Create(ZipArchiveHandle handle, const ZipEntry& entry,
+                                       const Options& options);
+  static ZipArchiveStreamEntry* CreateRaw(ZipArchiveHandle handle, const ZipEntry& entry,
+                                          const Options& options);
 
  protected:
   ZipArchiveStreamEntry(ZipArchiveHandle handle) : handle_(handle) {}
 
   virtual bool Init(const ZipEntry& entry);
 
+  // Reads the next |len| bytes from the archive to |buf|, at offset_.
+  bool ReadChunk(uint8_t* buf, size_t len);
+
   ZipArchiveHandle handle_;
 
   off64_t offset_ = 0;
   uint32_t crc32_ = 0u;
+  size_t chunk_size_ = 0;
+
+ private:
+  void ReadAhead();
+
+  size_t read_ahead_ = 0;
+  // The end of the entry's data in the archive, and of what was requested
+  // to be read ahead so far.
+  off64_t end_ = 0;
+  off64_t read_ahead_end_ = 0;
 };
 
 #endif  // LIBZIPARCHIVE_ZIPARCHIVESTREAMENTRY_H_
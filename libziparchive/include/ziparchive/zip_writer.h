@@ -81,6 +81,29 @@ class ZipWriter {
     off64_t local_file_header_offset;
   };
 
+  /**
+   * Options for a ZipWriter that compresses in the background.
+   */
+  struct Options {
+    /**
+     * Number of threads deflating entries while the caller carries on with the next ones.
+     * 0 deflates on the caller's thread, within WriteBytes() and FinishEntry().
+     */
+    size_t compression_threads = 0;
+    /**
+     * With compression threads, entries are cut into blocks of this many bytes that are
+     * deflated independently, so that large entries are compressed concurrently too. Each
+     * block is primed with the end of the previous one, which keeps the ratio close to that
+     * of a single stream.
+     */
+    size_t block_size = 128 * 1024;
+    /**
+     * Bytes written to the zip are collected into a buffer of this size before being handed to
+     * fwrite(). 0 writes through the FILE stream's own buffering.
+     */
+    size_t output_buffer_size = 0;
+  };
+
   static const char* ErrorCodeString(int32_t error_code);
 
   /**
@@ -90,6 +113,20 @@ class ZipWriter {
    */
   explicit ZipWriter(FILE* f);
 
+  /**
+   * Same as ZipWriter(FILE*), with the given options.
+   *
+   * With compression threads, StartEntry(), WriteBytes() and FinishEntry() only queue the entry's
+   * data, which is copied, and the zip is written in order as the blocks have been deflated.
+   * The entries end up in the order they were started, and the same input always produces the
+   * same zip. An error writing out an entry is returned by whichever call is writing at the time,
+   * which may be a later one. GetLastEntry(), DiscardLastEntry() and Finish() wait for all
+   * the queued entries to be written first.
+   */
+  ZipWriter(FILE* f, const Options& options);
+
+  ~ZipWriter();
+
   // Move constructor.
   ZipWriter(ZipWriter&& zipWriter);
 
@@ -165,6 +202,15 @@ class ZipWriter {
   int32_t StoreBytes(FileEntry* file, const void* data, size_t len);
   int32_t CompressBytes(FileEntry* file, const void* data, size_t len);
   int32_t FlushCompressedBytes(FileEntry* file);
+  int32_t WriteLocalFileHeader(FileEntry* file, uint32_t alignment);
+  int32_t WriteEntryTrailer(FileEntry* file);
+  int32_t Write(const void* data, size_t len);
+  int32_t FlushOutput();
+
+  struct Pipeline;
+  int32_t QueueBytes(const void* data, size_t len);
+  int32_t QueueBlock(bool last);
+  int32_t WritePipeline(size_t max_pending_blocks);
 
   enum class State {
     kWritingZip,
@@ -182,6 +228,9 @@ class ZipWriter {
 
   std::unique_ptr<z_stream, void (*)(z_stream*)> z_stream_;
   std::vector<uint8_t> buffer_;
+  std::vector<uint8_t> output_;
+  size_t output_used_;
+  std::unique_ptr<Pipeline> pipeline_;
 };
 
 #endif /* LIBZIPARCHIVE_ZIPWRITER_H_ */
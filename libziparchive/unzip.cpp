@@ -148,7 +148,8 @@ static void ExtractToPipe(ZipArchiveHandle zah, ZipEntry& entry, const std::stri
   delete[] buffer;
 }
 
-static void ExtractOne(ZipArchiveHandle zah, ZipEntry& entry, const std::string& name) {
+// Creates the file for an entry, returning -1 if there's nothing to write.
+static int CreateOne(const ZipEntry& entry, const std::string& name) {
   // Bad filename?
   if (android::base::StartsWith(name, "/") || android::base::StartsWith(name, "../") ||
       name.find("/../") != std::string::npos) {
@@ -174,28 +175,33 @@ static void ExtractOne(ZipArchiveHandle zah, ZipEntry& entry, const std::string&
       // If the directory already exists, that's fine.
       if (errno == EEXIST) {
         struct stat sb;
-        if (stat(name.c_str(), &sb) != -1 && S_ISDIR(sb.st_mode)) return;
+        if (stat(name.c_str(), &sb) != -1 && S_ISDIR(sb.st_mode)) return -1;
       }
       error(1, errno, "couldn't extract directory %s", dst.c_str());
     }
-    return;
+    return -1;
   }
 
   // Create the file.
   int fd = open(name.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC | O_EXCL, entry.unix_mode);
   if (fd == -1 && errno == EEXIST) {
-    if (overwrite_mode == kNever) return;
-    if (overwrite_mode == kPrompt && !PromptOverwrite(dst)) return;
+    if (overwrite_mode == kNever) return -1;
+    if (overwrite_mode == kPrompt && !PromptOverwrite(dst)) return -1;
     // Either overwrite_mode is kAlways or the user consented to this specific case.
     fd = open(name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, entry.unix_mode);
   }
   if (fd == -1) error(1, errno, "couldn't create file %s", dst.c_str());
 
-  // Actually extract into the file.
   if (!flag_q) printf("  inflating: %s\n", dst.c_str());
-  int err = ExtractEntryToFile(zah, &entry, fd);
-  if (err < 0) error(1, 0, "failed to extract %s: %s", dst.c_str(), ErrorCodeString(err));
-  close(fd);
+  return fd;
+}
+
+// Called by ExtractEntriesToFiles, which does the actual extraction on
+// other threads while we create the next files here.
+static int ExtractOne(const ZipString& string, const ZipEntry& entry, void*) {
+  std::string name(string.name, string.name + string.name_length);
+  if (Filter(name)) return -1;
+  return CreateOne(entry, name);
 }
 
 static void ListOne(const ZipEntry& entry, const std::string& name) {
@@ -218,12 +224,7 @@ static void ProcessOne(ZipArchiveHandle zah, ZipEntry& entry, const std::string&
     // -l or -lv or -lq or -v.
     ListOne(entry, name);
   } else {
-    // Actually extract.
-    if (flag_p) {
-      ExtractToPipe(zah, entry, name);
-    } else {
-      ExtractOne(zah, entry, name);
-    }
+    ExtractToPipe(zah, entry, name);
   }
   total_uncompressed_length += entry.uncompressed_length;
   total_compressed_length += entry.compressed_length;
@@ -233,6 +234,12 @@ static void ProcessOne(ZipArchiveHandle zah, ZipEntry& entry, const std::string&
 static void ProcessAll(ZipArchiveHandle zah) {
   MaybeShowHeader();
 
+  if (!flag_l && !flag_v && !flag_p) {
+    int err = ExtractEntriesToFiles(zah, nullptr, ExtractOne, nullptr, 0);
+    if (err != 0) error(1, 0, "failed to extract %s: %s", archive_name, ErrorCodeString(err));
+    return;
+  }
+
   // libziparchive iteration order doesn't match the central directory.
   // We could sort, but that would cost extra and wouldn't match either.
   void* cookie;
@@ -27,16 +27,24 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>  // TEMP_FAILURE_RETRY may or may not be in unistd
 #include <android-base/memory.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <log/log.h>
 #include <utils/Compat.h>
 #include <utils/FileMap.h>
@@ -59,6 +67,10 @@ static const bool kCrcChecksEnabled = false;
 #define O_BINARY 0
 #endif
 
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
 // The maximum number of bytes to scan backwards for the EOCD start.
 static const uint32_t kMaxEOCDSearch = kMaxCommentLen + sizeof(EocdRecord);
 
@@ -99,36 +111,72 @@ static uint32_t RoundUpPower2(uint32_t val) {
   return val;
 }
 
-static uint32_t ComputeHash(const ZipString& name) {
-#if !defined(_WIN32)
-  return std::hash<std::string_view>{}(
-      std::string_view(reinterpret_cast<const char*>(name.name), name.name_length));
-#else
-  // Remove this code path once the windows compiler knows how to compile the above statement.
-  uint32_t hash = 0;
-  uint16_t len = name.name_length;
-  const uint8_t* str = name.name;
+/*
+ * MurmurHash64A, which takes the name eight bytes at a time. Unlike
+ * std::hash, it is the same in every process, which index files rely on.
+ */
+static uint64_t ComputeHash(const ZipString& name) {
+  static constexpr uint64_t kMultiplier = 0xc6a4a7935bd1e995ULL;
+  static constexpr int kShift = 47;
 
-  while (len--) {
-    hash = hash * 31 + *str++;
+  const uint8_t* str = name.name;
+  size_t len = name.name_length;
+  uint64_t hash = len * kMultiplier;
+
+  while (len >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, str, sizeof(word));
+    word *= kMultiplier;
+    word ^= word >> kShift;
+    word *= kMultiplier;
+    hash ^= word;
+    hash *= kMultiplier;
+    str += sizeof(word);
+    len -= sizeof(word);
+  }
+  if (len != 0) {
+    uint64_t word = 0;
+    memcpy(&word, str, len);
+    hash ^= word;
+    hash *= kMultiplier;
   }
 
+  hash ^= hash >> kShift;
+  hash *= kMultiplier;
+  hash ^= hash >> kShift;
   return hash;
-#endif
+}
+
+/*
+ * The fingerprint stored for a name alongside its slot: bits of its hash the
+ * slot index does not use. 0 is kept to mark free slots.
+ */
+static uint16_t HashFingerprint(uint64_t hash) {
+  const uint16_t fingerprint = static_cast<uint16_t>(hash >> 48);
+  return fingerprint != 0 ? fingerprint : 1;
+}
+
+static bool SlotHasName(const ZipStringOffset& slot, const ZipString& name,
+                        const uint8_t* start) {
+  return slot.name_length == name.name_length &&
+         memcmp(start + slot.name_offset, name.name, name.name_length) == 0;
 }
 
 /*
  * Convert a ZipEntry to a hash table index, verifying that it's in a
- * valid range.
+ * valid range. Probing only reads the names of slots whose fingerprint
+ * matches, so a miss rarely touches the central directory at all.
  */
-static int64_t EntryToIndex(const ZipString* hash_table, const uint32_t hash_table_size,
-                            const ZipString& name) {
-  const uint32_t hash = ComputeHash(name);
+static int64_t EntryToIndex(const ZipStringOffset* hash_table, const uint16_t* fingerprints,
+                            const uint32_t hash_table_size, const ZipString& name,
+                            const uint8_t* start) {
+  const uint64_t hash = ComputeHash(name);
+  const uint16_t fingerprint = HashFingerprint(hash);
 
   // NOTE: (hash_table_size - 1) is guaranteed to be non-negative.
   uint32_t ent = hash & (hash_table_size - 1);
-  while (hash_table[ent].name != NULL) {
-    if (hash_table[ent] == name) {
+  while (fingerprints[ent] != 0) {
+    if (fingerprints[ent] == fingerprint && SlotHasName(hash_table[ent], name, start)) {
       return ent;
     }
 
@@ -142,17 +190,19 @@ static int64_t EntryToIndex(const ZipString* hash_table, const uint32_t hash_tab
 /*
  * Add a new entry to the hash table.
  */
-static int32_t AddToHash(ZipString* hash_table, const uint64_t hash_table_size,
-                         const ZipString& name) {
+static int32_t AddToHash(ZipStringOffset* hash_table, uint16_t* fingerprints,
+                         const uint64_t hash_table_size, const ZipString& name,
+                         const uint8_t* start) {
   const uint64_t hash = ComputeHash(name);
+  const uint16_t fingerprint = HashFingerprint(hash);
   uint32_t ent = hash & (hash_table_size - 1);
 
   /*
    * We over-allocated the table, so we're guaranteed to find an empty slot.
    * Further, we guarantee that the hashtable size is not 0.
    */
-  while (hash_table[ent].name != NULL) {
-    if (hash_table[ent] == name) {
+  while (fingerprints[ent] != 0) {
+    if (fingerprints[ent] == fingerprint && SlotHasName(hash_table[ent], name, start)) {
       // We've found a duplicate entry. We don't accept it
       ALOGW("Zip: Found duplicate entry %.*s", name.name_length, name.name);
       return kDuplicateEntry;
@@ -160,8 +210,9 @@ static int32_t AddToHash(ZipString* hash_table, const uint64_t hash_table_size,
     ent = (ent + 1) & (hash_table_size - 1);
   }
 
-  hash_table[ent].name = name.name;
+  hash_table[ent].name_offset = static_cast<uint32_t>(name.name - start);
   hash_table[ent].name_length = name.name_length;
+  fingerprints[ent] = fingerprint;
   return 0;
 }
 
@@ -302,27 +353,130 @@ static int32_t MapCentralDirectory(const char* debug_file_name, ZipArchive* arch
 }
 
 /*
- * Parses the Zip archive's Central Directory.  Allocates and populates the
- * hash table.
+ * Validates the central directory record at *offset bytes into the central
+ * directory, which is entry number i, and advances *offset past it. The
+ * entry's name is returned in entry_name.
  *
  * Returns 0 on success.
  */
-static int32_t ParseZipArchive(ZipArchive* archive) {
+static int32_t ParseCentralDirectoryEntry(const ZipArchive* archive, const uint16_t i,
+                                          uint32_t* offset, ZipStringOffset* entry_name) {
   const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
   const size_t cd_length = archive->central_directory.GetMapLength();
-  const uint16_t num_entries = archive->num_entries;
+  const uint8_t* const cd_end = cd_ptr + cd_length;
+  const uint8_t* ptr = cd_ptr + *offset;
+
+  if (ptr > cd_end - sizeof(CentralDirectoryRecord)) {
+    ALOGW("Zip: ran off the end (at %" PRIu16 ")", i);
+#if defined(__ANDROID__)
+    android_errorWriteLog(0x534e4554, "36392138");
+#endif
+    return -1;
+  }
+
+  const CentralDirectoryRecord* cdr = reinterpret_cast<const CentralDirectoryRecord*>(ptr);
+  if (cdr->record_signature != CentralDirectoryRecord::kSignature) {
+    ALOGW("Zip: missed a central dir sig (at %" PRIu16 ")", i);
+    return -1;
+  }
+
+  const off64_t local_header_offset = cdr->local_file_header_offset;
+  if (local_header_offset >= archive->directory_offset) {
+    ALOGW("Zip: bad LFH offset %" PRId64 " at entry %" PRIu16,
+          static_cast<int64_t>(local_header_offset), i);
+    return -1;
+  }
 
+  const uint16_t file_name_length = cdr->file_name_length;
+  const uint16_t extra_length = cdr->extra_field_length;
+  const uint16_t comment_length = cdr->comment_length;
+  const uint8_t* file_name = ptr + sizeof(CentralDirectoryRecord);
+
+  if (file_name + file_name_length > cd_end) {
+    ALOGW(
+        "Zip: file name boundary exceeds the central directory range, file_name_length: "
+        "%" PRIx16 ", cd_length: %zu",
+        file_name_length, cd_length);
+    return -1;
+  }
+  /* check that file name is valid UTF-8 and doesn't contain NUL (U+0000) characters */
+  if (!IsValidEntryName(file_name, file_name_length)) {
+    return -1;
+  }
+
+  entry_name->name_offset = static_cast<uint32_t>(file_name - cd_ptr);
+  entry_name->name_length = file_name_length;
+
+  ptr += sizeof(CentralDirectoryRecord) + file_name_length + extra_length + comment_length;
+  if ((ptr - cd_ptr) > static_cast<int64_t>(cd_length)) {
+    ALOGW("Zip: bad CD advance (%tu vs %zu) at entry %" PRIu16, ptr - cd_ptr, cd_length, i);
+    return -1;
+  }
+  *offset = static_cast<uint32_t>(ptr - cd_ptr);
+  return 0;
+}
+
+/*
+ * Allocates an empty hash table for the archive's entries.
+ *
+ * Returns the table, or nullptr on failure.
+ */
+static ZipStringOffset* AllocateHashTable(ZipArchive* archive) {
   /*
    * Create hash table.  We have a minimum 75% load factor, possibly as
    * low as 50% after we round off to a power of 2.  There must be at
    * least one unused entry to avoid an infinite loop during creation.
    */
-  archive->hash_table_size = RoundUpPower2(1 + (num_entries * 4) / 3);
-  archive->hash_table =
-      reinterpret_cast<ZipString*>(calloc(archive->hash_table_size, sizeof(ZipString)));
-  if (archive->hash_table == nullptr) {
+  archive->hash_table_size = RoundUpPower2(1 + (archive->num_entries * 4) / 3);
+  ZipStringOffset* hash_table =
+      reinterpret_cast<ZipStringOffset*>(calloc(archive->hash_table_size, kHashSlotSize));
+  if (hash_table == nullptr) {
     ALOGW("Zip: unable to allocate the %u-entry hash_table, entry size: %zu",
-          archive->hash_table_size, sizeof(ZipString));
+          archive->hash_table_size, kHashSlotSize);
+    return nullptr;
+  }
+  archive->hash_table = hash_table;
+  archive->fingerprints = reinterpret_cast<uint16_t*>(hash_table + archive->hash_table_size);
+  return hash_table;
+}
+
+/*
+ * Checks that the archive starts with a local file header, rejecting files
+ * with data prepended to them.
+ *
+ * Returns 0 on success.
+ */
+static int32_t CheckFirstLocalFileHeader(ZipArchive* archive) {
+  uint32_t lfh_start_bytes;
+  if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
+                                        sizeof(uint32_t), 0)) {
+    ALOGW("Zip: Unable to read header for entry at offset == 0.");
+    return -1;
+  }
+
+  if (lfh_start_bytes != LocalFileHeader::kSignature) {
+    ALOGW("Zip: Entry at offset zero has invalid LFH signature %" PRIx32, lfh_start_bytes);
+#if defined(__ANDROID__)
+    android_errorWriteLog(0x534e4554, "64211847");
+#endif
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Parses the Zip archive's Central Directory.  Allocates and populates the
+ * hash table.
+ *
+ * Returns 0 on success.
+ */
+static int32_t ParseZipArchive(ZipArchive* archive) {
+  const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
+  const uint16_t num_entries = archive->num_entries;
+
+  ZipStringOffset* hash_table = AllocateHashTable(archive);
+  if (hash_table == nullptr) {
     return -1;
   }
 
@@ -330,94 +484,268 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
    * Walk through the central directory, adding entries to the hash
    * table and verifying values.
    */
-  const uint8_t* const cd_end = cd_ptr + cd_length;
-  const uint8_t* ptr = cd_ptr;
+  uint32_t offset = 0;
   for (uint16_t i = 0; i < num_entries; i++) {
-    if (ptr > cd_end - sizeof(CentralDirectoryRecord)) {
-      ALOGW("Zip: ran off the end (at %" PRIu16 ")", i);
-#if defined(__ANDROID__)
-      android_errorWriteLog(0x534e4554, "36392138");
-#endif
-      return -1;
+    ZipStringOffset entry_name;
+    const int32_t result = ParseCentralDirectoryEntry(archive, i, &offset, &entry_name);
+    if (result != 0) {
+      return result;
     }
 
-    const CentralDirectoryRecord* cdr = reinterpret_cast<const CentralDirectoryRecord*>(ptr);
-    if (cdr->record_signature != CentralDirectoryRecord::kSignature) {
-      ALOGW("Zip: missed a central dir sig (at %" PRIu16 ")", i);
-      return -1;
+    /* add the CDE filename to the hash table */
+    const int add_result =
+        AddToHash(hash_table, const_cast<uint16_t*>(archive->fingerprints),
+                  archive->hash_table_size, entry_name.GetZipString(cd_ptr), cd_ptr);
+    if (add_result != 0) {
+      ALOGW("Zip: Error adding entry to hash table %d", add_result);
+      return add_result;
     }
+  }
 
-    const off64_t local_header_offset = cdr->local_file_header_offset;
-    if (local_header_offset >= archive->directory_offset) {
-      ALOGW("Zip: bad LFH offset %" PRId64 " at entry %" PRIu16,
-            static_cast<int64_t>(local_header_offset), i);
-      return -1;
-    }
+  if (CheckFirstLocalFileHeader(archive) != 0) {
+    return -1;
+  }
 
-    const uint16_t file_name_length = cdr->file_name_length;
-    const uint16_t extra_length = cdr->extra_field_length;
-    const uint16_t comment_length = cdr->comment_length;
-    const uint8_t* file_name = ptr + sizeof(CentralDirectoryRecord);
+  ALOGV("+++ zip good scan %" PRIu16 " entries", num_entries);
 
-    if (file_name + file_name_length > cd_end) {
-      ALOGW(
-          "Zip: file name boundary exceeds the central directory range, file_name_length: "
-          "%" PRIx16 ", cd_length: %zu",
-          file_name_length, cd_length);
-      return -1;
+  return 0;
+}
+
+/*
+ * Hashes entries of a lazily opened archive until name is found, or every
+ * entry has been hashed, and returns the entry for name in entry_name.
+ *
+ * Returns 0 on success, and kEntryNotFound or the error met while parsing
+ * the central directory otherwise.
+ */
+static int32_t LazyFindEntryName(const ZipArchive* archive, const ZipString& name,
+                                 ZipStringOffset* entry_name) {
+  const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
+  // Lazily opened archives always own their table.
+  ZipStringOffset* hash_table = const_cast<ZipStringOffset*>(archive->hash_table);
+  uint16_t* fingerprints = const_cast<uint16_t*>(archive->fingerprints);
+
+  std::lock_guard<std::mutex> lock(archive->parse_lock);
+  const int64_t ent =
+      EntryToIndex(hash_table, fingerprints, archive->hash_table_size, name, cd_ptr);
+  if (ent >= 0) {
+    *entry_name = hash_table[ent];
+    return 0;
+  }
+  if (archive->parse_error != 0) {
+    return archive->parse_error;
+  }
+
+  while (archive->parsed_entries < archive->num_entries) {
+    ZipStringOffset parsed;
+    int32_t result = ParseCentralDirectoryEntry(archive, archive->parsed_entries,
+                                                &archive->parse_offset, &parsed);
+    if (result == 0) {
+      result = AddToHash(hash_table, fingerprints, archive->hash_table_size,
+                         parsed.GetZipString(cd_ptr), cd_ptr);
     }
-    /* check that file name is valid UTF-8 and doesn't contain NUL (U+0000) characters */
-    if (!IsValidEntryName(file_name, file_name_length)) {
-      return -1;
+    if (result != 0) {
+      ALOGW("Zip: Error parsing entry %" PRIu16 ": %d", archive->parsed_entries, result);
+      archive->parse_error = result;
+      return result;
     }
 
-    /* add the CDE filename to the hash table */
-    ZipString entry_name;
-    entry_name.name = file_name;
-    entry_name.name_length = file_name_length;
-    const int add_result = AddToHash(archive->hash_table, archive->hash_table_size, entry_name);
-    if (add_result != 0) {
-      ALOGW("Zip: Error adding entry to hash table %d", add_result);
-      return add_result;
+    ++archive->parsed_entries;
+    if (parsed.GetZipString(cd_ptr) == name) {
+      *entry_name = parsed;
+      return 0;
     }
+  }
 
-    ptr += sizeof(CentralDirectoryRecord) + file_name_length + extra_length + comment_length;
-    if ((ptr - cd_ptr) > static_cast<int64_t>(cd_length)) {
-      ALOGW("Zip: bad CD advance (%tu vs %zu) at entry %" PRIu16, ptr - cd_ptr, cd_length, i);
-      return -1;
+  return kEntryNotFound;
+}
+
+#if !defined(_WIN32)
+/*
+ * Fills in the header an index of this archive must have, given the stat of
+ * its file once the central directory has been mapped.
+ */
+static void InitIndexHeader(const ZipArchive* archive, const struct stat& sb,
+                            ZipIndexHeader* header) {
+  memset(header, 0, sizeof(*header));
+  header->magic = ZipIndexHeader::kMagic;
+  header->version = ZipIndexHeader::kVersion;
+  header->dev = sb.st_dev;
+  header->ino = sb.st_ino;
+  header->size = sb.st_size;
+  header->mtime_sec = sb.st_mtime;
+#if defined(__linux__)
+  header->mtime_nsec = sb.st_mtim.tv_nsec;
+#endif
+  header->cd_offset = static_cast<uint32_t>(archive->directory_offset);
+  header->cd_size = static_cast<uint32_t>(archive->central_directory.GetMapLength());
+  header->num_entries = archive->num_entries;
+  header->hash_table_size = RoundUpPower2(1 + (archive->num_entries * 4) / 3);
+  header->entry_size = kHashSlotSize;
+  header->hash_check = static_cast<uint32_t>(ComputeHash(ZipString("ziparchive index")));
+}
+
+/*
+ * Maps the hash table from index_file_name if it was built from this very
+ * archive. Every slot is checked to name a central directory record, so a
+ * corrupt index can at worst make lookups fail, never read out of bounds.
+ *
+ * Returns true if the archive now uses the mapped table.
+ */
+static bool LoadIndex(ZipArchive* archive, const char* index_file_name, const struct stat& sb) {
+  android::base::unique_fd fd(open(index_file_name, O_RDONLY | O_BINARY | O_CLOEXEC));
+  if (fd == -1) {
+    return false;
+  }
+
+  ZipIndexHeader expected;
+  InitIndexHeader(archive, sb, &expected);
+  ZipIndexHeader header;
+  if (!android::base::ReadFully(fd, &header, sizeof(header)) ||
+      memcmp(&header, &expected, sizeof(header)) != 0) {
+    ALOGV("Zip: index %s is stale", index_file_name);
+    return false;
+  }
+
+  // Mapping past the end of a truncated file would fault on access.
+  const size_t length = sizeof(header) + header.hash_table_size * kHashSlotSize;
+  struct stat index_sb;
+  if (fstat(fd, &index_sb) != 0 || index_sb.st_size != static_cast<off64_t>(length)) {
+    ALOGW("Zip: index %s has the wrong size", index_file_name);
+    return false;
+  }
+
+  std::unique_ptr<android::FileMap> index_map(new android::FileMap());
+  if (!index_map->create(index_file_name, fd, 0, length, true /* read only */)) {
+    return false;
+  }
+
+  const ZipStringOffset* hash_table = reinterpret_cast<const ZipStringOffset*>(
+      reinterpret_cast<const uint8_t*>(index_map->getDataPtr()) + sizeof(header));
+  const uint16_t* fingerprints =
+      reinterpret_cast<const uint16_t*>(hash_table + header.hash_table_size);
+  const uint8_t* cd_ptr = archive->central_directory.GetBasePtr();
+  uint32_t entries = 0;
+  for (uint32_t i = 0; i < header.hash_table_size; ++i) {
+    if ((hash_table[i].name_offset == 0) != (fingerprints[i] == 0)) {
+      ALOGW("Zip: index %s has an invalid fingerprint at %" PRIu32, index_file_name, i);
+      return false;
+    }
+    if (hash_table[i].name_offset == 0) {
+      continue;
     }
+    if (hash_table[i].name_offset < sizeof(CentralDirectoryRecord) ||
+        hash_table[i].name_offset + hash_table[i].name_length > header.cd_size) {
+      ALOGW("Zip: index %s has an invalid entry at %" PRIu32, index_file_name, i);
+      return false;
+    }
+    const CentralDirectoryRecord* cdr = reinterpret_cast<const CentralDirectoryRecord*>(
+        cd_ptr + hash_table[i].name_offset - sizeof(CentralDirectoryRecord));
+    if (cdr->record_signature != CentralDirectoryRecord::kSignature ||
+        cdr->file_name_length != hash_table[i].name_length) {
+      ALOGW("Zip: index %s entry %" PRIu32 " is not a central dir record", index_file_name, i);
+      return false;
+    }
+    ++entries;
+  }
+  // This also guarantees the free slot that terminates probing.
+  if (entries != header.num_entries) {
+    ALOGW("Zip: index %s has %" PRIu32 " entries, expected %" PRIu32, index_file_name, entries,
+          header.num_entries);
+    return false;
   }
 
-  uint32_t lfh_start_bytes;
-  if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
-                                        sizeof(uint32_t), 0)) {
-    ALOGW("Zip: Unable to read header for entry at offset == 0.");
-    return -1;
+  archive->hash_table_size = header.hash_table_size;
+  archive->hash_table = hash_table;
+  archive->fingerprints = fingerprints;
+  archive->index_map = std::move(index_map);
+  return true;
+}
+
+/*
+ * Writes the freshly built hash table to index_file_name. The index is a
+ * cache, so failures are only logged. It is written under a temporary name
+ * and renamed into place, so readers either see a complete index or none,
+ * and processes still mapping a previous one are unaffected.
+ */
+static void WriteIndex(const ZipArchive* archive, const char* index_file_name,
+                       const struct stat& sb) {
+  ZipIndexHeader header;
+  InitIndexHeader(archive, sb, &header);
+
+  const std::string temp_name =
+      android::base::StringPrintf("%s.%d.tmp", index_file_name, getpid());
+  android::base::unique_fd fd(
+      open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0644));
+  if (fd == -1) {
+    ALOGW("Zip: unable to create index %s: %s", temp_name.c_str(), strerror(errno));
+    return;
   }
 
-  if (lfh_start_bytes != LocalFileHeader::kSignature) {
-    ALOGW("Zip: Entry at offset zero has invalid LFH signature %" PRIx32, lfh_start_bytes);
-#if defined(__ANDROID__)
-    android_errorWriteLog(0x534e4554, "64211847");
+  if (!android::base::WriteFully(fd, &header, sizeof(header)) ||
+      !android::base::WriteFully(fd, archive->hash_table,
+                                 header.hash_table_size * kHashSlotSize)) {
+    ALOGW("Zip: unable to write index %s: %s", temp_name.c_str(), strerror(errno));
+    unlink(temp_name.c_str());
+    return;
+  }
+  fd.reset();
+
+  if (rename(temp_name.c_str(), index_file_name) != 0) {
+    ALOGW("Zip: unable to rename index to %s: %s", index_file_name, strerror(errno));
+    unlink(temp_name.c_str());
+  }
+}
+#endif  // !defined(_WIN32)
+
+static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name,
+                                   const char* index_file_name = nullptr) {
+  int32_t result = -1;
+  if ((result = MapCentralDirectory(debug_file_name, archive)) != 0) {
+    return result;
+  }
+
+#if !defined(_WIN32)
+  // The index stands in for the whole of ParseZipArchive, including the
+  // checks it made when the index was built from this same file.
+  struct stat sb;
+  const bool use_index =
+      index_file_name != nullptr && fstat(archive->mapped_zip.GetFileDescriptor(), &sb) == 0;
+  if (use_index && LoadIndex(archive, index_file_name, sb)) {
+    return 0;
+  }
+#else
+  UNUSED(index_file_name);
 #endif
-    return -1;
+
+  if ((result = ParseZipArchive(archive))) {
+    return result;
   }
 
-  ALOGV("+++ zip good scan %" PRIu16 " entries", num_entries);
+#if !defined(_WIN32)
+  if (use_index) {
+    WriteIndex(archive, index_file_name, sb);
+  }
+#endif
 
   return 0;
 }
 
-static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name) {
+/*
+ * Maps the central directory of an archive that will be parsed on demand, by
+ * FindEntry and Next, rather than up front.
+ */
+static int32_t OpenArchiveLazyInternal(ZipArchive* archive, const char* debug_file_name) {
   int32_t result = -1;
   if ((result = MapCentralDirectory(debug_file_name, archive)) != 0) {
     return result;
   }
 
-  if ((result = ParseZipArchive(archive))) {
-    return result;
+  if (AllocateHashTable(archive) == nullptr || CheckFirstLocalFileHeader(archive) != 0) {
+    return -1;
   }
 
+  archive->lazy = true;
   return 0;
 }
 
@@ -441,6 +769,40 @@ int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle) {
   return OpenArchiveInternal(archive, fileName);
 }
 
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle) {
+  const int fd = open(fileName, O_RDONLY | O_BINARY, 0);
+  ZipArchive* archive = new ZipArchive(fd, true);
+  *handle = archive;
+
+  if (fd < 0) {
+    ALOGW("Unable to open '%s': %s", fileName, strerror(errno));
+    return kIoError;
+  }
+
+  return OpenArchiveInternal(archive, fileName, indexFileName);
+}
+
+int32_t OpenArchiveLazy(const char* fileName, ZipArchiveHandle* handle) {
+  const int fd = open(fileName, O_RDONLY | O_BINARY, 0);
+  ZipArchive* archive = new ZipArchive(fd, true);
+  *handle = archive;
+
+  if (fd < 0) {
+    ALOGW("Unable to open '%s': %s", fileName, strerror(errno));
+    return kIoError;
+  }
+
+  return OpenArchiveLazyInternal(archive, fileName);
+}
+
+int32_t OpenArchiveFdLazy(int fd, const char* debug_file_name, ZipArchiveHandle* handle,
+                          bool assume_ownership) {
+  ZipArchive* archive = new ZipArchive(fd, assume_ownership);
+  *handle = archive;
+  return OpenArchiveLazyInternal(archive, debug_file_name);
+}
+
 int32_t OpenArchiveFromMemory(void* address, size_t length, const char* debug_file_name,
                               ZipArchiveHandle* handle) {
   ZipArchive* archive = new ZipArchive(address, length);
@@ -457,7 +819,7 @@ void CloseArchive(ZipArchiveHandle handle) {
   delete archive;
 }
 
-static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, ZipEntry* entry) {
+static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, const ZipEntry* entry) {
   uint8_t ddBuf[sizeof(DataDescriptor) + sizeof(DataDescriptor::kOptSignature)];
   off64_t offset = entry->offset;
   if (entry->method != kCompressStored) {
@@ -489,19 +851,19 @@ static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, ZipEntry* entry
   return 0;
 }
 
-static int32_t FindEntry(const ZipArchive* archive, const int ent, ZipEntry* data) {
-  const uint16_t nameLen = archive->hash_table[ent].name_length;
+static int32_t FindEntry(const ZipArchive* archive, const ZipStringOffset& entry_name,
+                         ZipEntry* data) {
+  const uint16_t nameLen = entry_name.name_length;
 
   // Recover the start of the central directory entry from the filename
-  // pointer.  The filename is the first entry past the fixed-size data,
+  // offset.  The filename is the first entry past the fixed-size data,
   // so we can just subtract back from that.
-  const uint8_t* ptr = archive->hash_table[ent].name;
-  ptr -= sizeof(CentralDirectoryRecord);
-
-  // This is the base of our mmapped region, we have to sanity check that
-  // the name that's in the hash table is a pointer to a location within
-  // this mapped region.
   const uint8_t* base_ptr = archive->central_directory.GetBasePtr();
+  const uint8_t* name_ptr = base_ptr + entry_name.name_offset;
+  const uint8_t* ptr = name_ptr - sizeof(CentralDirectoryRecord);
+
+  // We have to sanity check that the name that's in the hash table
+  // points to a location within the mapped central directory.
   if (ptr < base_ptr || ptr > base_ptr + archive->central_directory.GetMapLength()) {
     ALOGW("Zip: Invalid entry pointer");
     return kInvalidOffset;
@@ -606,7 +968,7 @@ static int32_t FindEntry(const ZipArchive* archive, const int ent, ZipEntry* dat
       return kIoError;
     }
 
-    if (memcmp(archive->hash_table[ent].name, name_buf.data(), nameLen)) {
+    if (memcmp(name_ptr, name_buf.data(), nameLen)) {
       return kInconsistentInformation;
     }
 
@@ -642,7 +1004,10 @@ static int32_t FindEntry(const ZipArchive* archive, const int ent, ZipEntry* dat
 }
 
 struct IterationHandle {
+  // The next hash table slot, or for lazily opened archives the number of
+  // central directory records walked and the offset of the next one.
   uint32_t position;
+  uint32_t cd_offset;
   // We're not using vector here because this code is used in the Windows SDK
   // where the STL is not available.
   ZipString prefix;
@@ -687,6 +1052,7 @@ int32_t StartIteration(ZipArchiveHandle handle, void** cookie_ptr, const ZipStri
 
   IterationHandle* cookie = new IterationHandle(optional_prefix, optional_suffix);
   cookie->position = 0;
+  cookie->cd_offset = 0;
   cookie->archive = archive;
 
   *cookie_ptr = cookie;
@@ -704,14 +1070,60 @@ int32_t FindEntry(const ZipArchiveHandle handle, const ZipString& entryName, Zip
     return kInvalidEntryName;
   }
 
-  const int64_t ent = EntryToIndex(archive->hash_table, archive->hash_table_size, entryName);
+  if (archive->lazy) {
+    ZipStringOffset entry_name;
+    const int32_t result = LazyFindEntryName(archive, entryName, &entry_name);
+    if (result != 0) {
+      ALOGV("Zip: Could not find entry %.*s", entryName.name_length, entryName.name);
+      return result;
+    }
+    return FindEntry(archive, entry_name, data);
+  }
+
+  const int64_t ent = EntryToIndex(archive->hash_table, archive->fingerprints,
+                                   archive->hash_table_size, entryName,
+                                   archive->central_directory.GetBasePtr());
 
   if (ent < 0) {
     ALOGV("Zip: Could not find entry %.*s", entryName.name_length, entryName.name);
     return ent;
   }
 
-  return FindEntry(archive, ent, data);
+  return FindEntry(archive, archive->hash_table[ent], data);
+}
+
+/*
+ * Iterates a lazily opened archive in central directory order, which needs
+ * no hash table, so a prefix scan doesn't hash every entry first.
+ */
+static int32_t NextLazy(IterationHandle* handle, ZipEntry* data, ZipString* name) {
+  const ZipArchive* archive = handle->archive;
+  const uint8_t* start = archive->central_directory.GetBasePtr();
+
+  while (handle->position < archive->num_entries) {
+    ZipStringOffset entry;
+    const int32_t result =
+        ParseCentralDirectoryEntry(archive, handle->position, &handle->cd_offset, &entry);
+    if (result != 0) {
+      return result;
+    }
+    ++handle->position;
+
+    const ZipString entry_name = entry.GetZipString(start);
+    if ((handle->prefix.name_length == 0 || entry_name.StartsWith(handle->prefix)) &&
+        (handle->suffix.name_length == 0 || entry_name.EndsWith(handle->suffix))) {
+      const int error = FindEntry(archive, entry, data);
+      if (!error) {
+        *name = entry_name;
+      }
+
+      return error;
+    }
+  }
+
+  handle->position = 0;
+  handle->cd_offset = 0;
+  return kIterationEnd;
 }
 
 int32_t Next(void* cookie, ZipEntry* data, ZipString* name) {
@@ -726,19 +1138,24 @@ int32_t Next(void* cookie, ZipEntry* data, ZipString* name) {
     return kInvalidHandle;
   }
 
+  if (archive->lazy) {
+    return NextLazy(handle, data, name);
+  }
+
   const uint32_t currentOffset = handle->position;
   const uint32_t hash_table_length = archive->hash_table_size;
-  const ZipString* hash_table = archive->hash_table;
+  const ZipStringOffset* hash_table = archive->hash_table;
+  const uint8_t* start = archive->central_directory.GetBasePtr();
 
   for (uint32_t i = currentOffset; i < hash_table_length; ++i) {
-    if (hash_table[i].name != NULL &&
-        (handle->prefix.name_length == 0 || hash_table[i].StartsWith(handle->prefix)) &&
-        (handle->suffix.name_length == 0 || hash_table[i].EndsWith(handle->suffix))) {
+    const ZipString entry_name = hash_table[i].GetZipString(start);
+    if (hash_table[i].name_offset != 0 &&
+        (handle->prefix.name_length == 0 || entry_name.StartsWith(handle->prefix)) &&
+        (handle->suffix.name_length == 0 || entry_name.EndsWith(handle->suffix))) {
       handle->position = (i + 1);
-      const int error = FindEntry(archive, i, data);
+      const int error = FindEntry(archive, hash_table[i], data);
       if (!error) {
-        name->name = hash_table[i].name;
-        name->name_length = hash_table[i].name_length;
+        *name = entry_name;
       }
 
       return error;
@@ -768,6 +1185,16 @@ class MemoryWriter : public zip_archive::Writer {
     return true;
   }
 
+  virtual uint8_t* GetBuffer(size_t length) override {
+    if (bytes_written_ + length > size_) {
+      return nullptr;
+    }
+
+    uint8_t* buf = buf_ + bytes_written_;
+    bytes_written_ += length;
+    return buf;
+  }
+
  private:
   uint8_t* const buf_;
   const size_t size_;
@@ -898,6 +1325,11 @@ namespace zip_archive {
 // Moved out of line to avoid -Wweak-vtables.
 Reader::~Reader() {}
 Writer::~Writer() {}
+Decompressor::~Decompressor() {}
+
+uint8_t* Writer::GetBuffer(size_t) {
+  return nullptr;
+}
 
 int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
                 const uint32_t uncompressed_length, Writer* writer, uint64_t* crc_out) {
@@ -916,10 +1348,20 @@ int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
   zstream.opaque = Z_NULL;
   zstream.next_in = NULL;
   zstream.avail_in = 0;
-  zstream.next_out = &write_buf[0];
-  zstream.avail_out = kBufSize;
   zstream.data_type = Z_UNKNOWN;
 
+  /*
+   * When the writer can take the whole entry at once, inflate straight into
+   * it: no bounce buffer, no Append per 32K and a single crc32 pass at the
+   * end. Otherwise inflate into write_buf and hand that over as it fills.
+   */
+  uint8_t* const direct_buf =
+      (uncompressed_length > 0) ? writer->GetBuffer(uncompressed_length) : nullptr;
+  uint8_t* const out_buf = (direct_buf != nullptr) ? direct_buf : &write_buf[0];
+  const size_t out_size = (direct_buf != nullptr) ? uncompressed_length : kBufSize;
+  zstream.next_out = out_buf;
+  zstream.avail_out = out_size;
+
   /*
    * Use the undocumented "negative window bits" feature to tell zlib
    * that there's no zlib header waiting for it.
@@ -963,6 +1405,10 @@ int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
 
     /* uncompress the data */
     zerr = inflate(&zstream, Z_NO_FLUSH);
+    if (zerr == Z_BUF_ERROR && direct_buf != nullptr && zstream.avail_out == 0) {
+      ALOGW("Zip: inflated file is larger than declared (%" PRIu32 ")", uncompressed_length);
+      return kInconsistentInformation;
+    }
     if (zerr != Z_OK && zerr != Z_STREAM_END) {
       ALOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr, zstream.next_in,
             zstream.avail_in, zstream.next_out, zstream.avail_out);
@@ -970,7 +1416,8 @@ int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
     }
 
     /* write when we're full or when we're done */
-    if (zstream.avail_out == 0 || (zerr == Z_STREAM_END && zstream.avail_out != kBufSize)) {
+    if (direct_buf == nullptr &&
+        (zstream.avail_out == 0 || (zerr == Z_STREAM_END && zstream.avail_out != kBufSize))) {
       const size_t write_size = zstream.next_out - &write_buf[0];
       if (!writer->Append(&write_buf[0], write_size)) {
         return kIoError;
@@ -985,6 +1432,10 @@ int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
 
   assert(zerr == Z_STREAM_END); /* other errors should've been caught */
 
+  if (direct_buf != nullptr && compute_crc) {
+    crc = crc32(crc, direct_buf, zstream.total_out);
+  }
+
   // NOTE: zstream.adler is always set to 0, because we're using the -MAX_WBITS
   // "feature" of zlib to tell it there won't be a zlib file header. zlib
   // doesn't bother calculating the checksum in that scenario. We just do
@@ -1005,10 +1456,14 @@ int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
 }
 }  // namespace zip_archive
 
-static int32_t InflateEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* entry,
+static int32_t InflateEntryToWriter(const ZipArchive* archive, const ZipEntry* entry,
                                     zip_archive::Writer* writer, uint64_t* crc_out) {
-  const EntryReader reader(mapped_zip, entry);
+  const EntryReader reader(archive->mapped_zip, entry);
 
+  if (archive->decompressor != nullptr) {
+    return archive->decompressor->Inflate(reader, entry->compressed_length,
+                                          entry->uncompressed_length, writer, crc_out);
+  }
   return zip_archive::Inflate(reader, entry->compressed_length, entry->uncompressed_length, writer,
                               crc_out);
 }
@@ -1057,7 +1512,7 @@ int32_t ExtractToWriter(ZipArchiveHandle handle, ZipEntry* entry, zip_archive::W
   if (method == kCompressStored) {
     return_value = CopyEntryToWriter(archive->mapped_zip, entry, writer, &crc);
   } else if (method == kCompressDeflated) {
-    return_value = InflateEntryToWriter(archive->mapped_zip, entry, writer, &crc);
+    return_value = InflateEntryToWriter(archive, entry, writer, &crc);
   }
 
   if (!return_value && entry->has_data_descriptor) {
@@ -1104,6 +1559,70 @@ const char* ErrorCodeString(int32_t error_code) {
   return "Unknown return code";
 }
 
+MappedZipEntry::MappedZipEntry(std::unique_ptr<android::FileMap> map, const uint8_t* data,
+                               size_t size)
+    : map_(std::move(map)), data_(data), size_(size) {}
+
+MappedZipEntry::~MappedZipEntry() {}
+
+int32_t MapStoredEntry(ZipArchiveHandle handle, const ZipEntry* entry,
+                       std::unique_ptr<MappedZipEntry>* mapped_entry) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle);
+  if (entry->method != kCompressStored) {
+    ALOGW("Zip: can't map an entry compressed with method %" PRIu16, entry->method);
+    return kUnsupportedCompressionMethod;
+  }
+
+  const size_t length = entry->uncompressed_length;
+  if (entry->offset < 0 ||
+      entry->offset + static_cast<off64_t>(length) > archive->directory_offset) {
+    ALOGW("Zip: entry at %" PRId64 " runs into the central directory",
+          static_cast<int64_t>(entry->offset));
+    return kInvalidOffset;
+  }
+
+  // Stored data must agree with a trailing data descriptor, as in ExtractToWriter.
+  if (entry->has_data_descriptor) {
+    const int32_t result = ValidateDataDescriptor(archive->mapped_zip, entry);
+    if (result != 0) {
+      return result;
+    }
+  }
+
+  if (length == 0) {
+    mapped_entry->reset(new MappedZipEntry(nullptr, nullptr, 0));
+    return 0;
+  }
+
+  if (!archive->mapped_zip.HasFd()) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(archive->mapped_zip.GetBasePtr());
+    mapped_entry->reset(new MappedZipEntry(nullptr, base + entry->offset, length));
+    return 0;
+  }
+
+  std::unique_ptr<android::FileMap> map(new android::FileMap());
+  if (!map->create(nullptr, archive->mapped_zip.GetFileDescriptor(), entry->offset, length,
+                   true /* read only */)) {
+    return kMmapFailed;
+  }
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(map->getDataPtr());
+  mapped_entry->reset(new MappedZipEntry(std::move(map), data, length));
+  return 0;
+}
+
+void SetDecompressor(ZipArchiveHandle handle, const zip_archive::Decompressor* decompressor) {
+  reinterpret_cast<ZipArchive*>(handle)->decompressor = decompressor;
+}
+
+int32_t SetMappingWindows(ZipArchiveHandle handle, size_t window_size, size_t max_windows) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle);
+  if (!archive->mapped_zip.HasFd()) {
+    return kInvalidHandle;
+  }
+  archive->mapped_zip.SetWindows(window_size, max_windows);
+  return 0;
+}
+
 int GetFileDescriptor(const ZipArchiveHandle handle) {
   return reinterpret_cast<ZipArchive*>(handle)->mapped_zip.GetFileDescriptor();
 }
@@ -1135,8 +1654,237 @@ int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
   return ExtractToWriter(handle, entry, &writer);
 }
 
+/*
+ * The entries handed from the iterating thread to the extracting ones. At
+ * most |capacity| are queued, which bounds both the output files held open
+ * and how far the iteration runs ahead of the writes.
+ */
+class ExtractionQueue {
+ public:
+  struct Job {
+    ZipEntry entry;
+    ZipString name;
+    int fd;
+  };
+
+  explicit ExtractionQueue(size_t capacity) : capacity_(capacity), done_(false), error_(0) {}
+
+  // Returns false, without queueing, once an extraction has failed.
+  bool Push(const Job& job) {
+    std::unique_lock<std::mutex> lock(lock_);
+    space_.wait(lock, [this] { return jobs_.size() < capacity_ || error_ != 0; });
+    if (error_ != 0) {
+      return false;
+    }
+    jobs_.push_back(job);
+    ready_.notify_one();
+    return true;
+  }
+
+  // Returns false when the queue is empty and Finish was called.
+  bool Pop(Job* job) {
+    std::unique_lock<std::mutex> lock(lock_);
+    ready_.wait(lock, [this] { return !jobs_.empty() || done_; });
+    if (jobs_.empty()) {
+      return false;
+    }
+    *job = jobs_.front();
+    jobs_.pop_front();
+    space_.notify_one();
+    return true;
+  }
+
+  void Finish() {
+    std::lock_guard<std::mutex> lock(lock_);
+    done_ = true;
+    ready_.notify_all();
+  }
+
+  void SetError(int32_t error) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (error_ == 0) {
+      error_ = error;
+    }
+    space_.notify_all();
+  }
+
+  int32_t GetError() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return error_;
+  }
+
+ private:
+  const size_t capacity_;
+  std::mutex lock_;
+  std::condition_variable ready_;
+  std::condition_variable space_;
+  std::deque<Job> jobs_;
+  bool done_;
+  int32_t error_;
+};
+
+static void ExtractQueuedEntries(ZipArchiveHandle handle, ExtractionQueue* queue) {
+  ExtractionQueue::Job job;
+  while (queue->Pop(&job)) {
+    // Once something failed, only close what's left.
+    int32_t error = queue->GetError();
+    if (error == 0) {
+      error = ExtractEntryToFile(handle, &job.entry, job.fd);
+      if (error != 0) {
+        ALOGW("Zip: failed to extract %.*s: %s", job.name.name_length, job.name.name,
+              ErrorCodeString(error));
+      }
+    }
+    if (close(job.fd) != 0 && error == 0) {
+      ALOGW("Zip: failed to close %.*s: %s", job.name.name_length, job.name.name,
+            strerror(errno));
+      error = kIoError;
+    }
+    if (error != 0) {
+      queue->SetError(error);
+    }
+  }
+}
+
+int32_t ExtractEntriesToFiles(ZipArchiveHandle handle, const ZipString* optional_prefix,
+                              ExtractOpenFunction open_func, void* cookie, size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  void* iteration_cookie;
+  int32_t result = StartIteration(handle, &iteration_cookie, optional_prefix, nullptr);
+  if (result != 0) {
+    return result;
+  }
+
+  ExtractionQueue queue(2 * num_threads);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back(ExtractQueuedEntries, handle, &queue);
+  }
+
+  ExtractionQueue::Job job;
+  while ((result = Next(iteration_cookie, &job.entry, &job.name)) == 0) {
+    job.fd = open_func(job.name, job.entry, cookie);
+    if (job.fd == -1) {
+      continue;
+    }
+    if (job.fd < 0) {
+      result = job.fd;
+      break;
+    }
+    if (!queue.Push(job)) {
+      close(job.fd);
+      break;
+    }
+  }
+  EndIteration(iteration_cookie);
+
+  queue.Finish();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // A failed extraction takes precedence, it's what stopped the iteration.
+  const int32_t error = queue.GetError();
+  if (error != 0) {
+    return error;
+  }
+  return (result == kIterationEnd) ? 0 : result;
+}
+
 #endif  //! defined(_WIN32)
 
+/*
+ * The windows of the file mapped for MappedZipFile::ReadAtOffset. Windows
+ * start at multiples of the window size, and are handed out as shared
+ * pointers so that one can be unmapped from the cache while another thread
+ * is still copying from it.
+ */
+class MappedZipFile::WindowCache {
+ public:
+  WindowCache(int fd, off64_t file_length, size_t window_size, size_t max_windows)
+      : fd_(fd), file_length_(file_length), window_size_(window_size), max_windows_(max_windows) {}
+
+  /*
+   * Returns the mapping of the window holding |off|, and where that window
+   * starts in the file, or nullptr if it couldn't be mapped.
+   */
+  std::shared_ptr<android::FileMap> Get(off64_t off, off64_t* window_start) {
+    if (off < 0 || off >= file_length_) {
+      return nullptr;
+    }
+    const off64_t start = off - off % window_size_;
+    *window_start = start;
+
+    std::lock_guard<std::mutex> lock(lock_);
+    Window* lru = nullptr;
+    for (Window& window : windows_) {
+      if (window.start == start) {
+        window.last_use = ++clock_;
+        return window.map;
+      }
+      if (lru == nullptr || window.last_use < lru->last_use) {
+        lru = &window;
+      }
+    }
+
+    const size_t length = static_cast<size_t>(
+        std::min(static_cast<off64_t>(window_size_), file_length_ - start));
+    std::shared_ptr<android::FileMap> map(new android::FileMap());
+    if (!map->create(nullptr, fd_, start, length, true /* read only */)) {
+      ALOGW("Zip: unable to map window at %" PRId64 " of fd %d", static_cast<int64_t>(start), fd_);
+      return nullptr;
+    }
+
+    if (windows_.size() < max_windows_) {
+      windows_.push_back(Window());
+      lru = &windows_.back();
+    }
+    lru->start = start;
+    lru->map = map;
+    lru->last_use = ++clock_;
+    return map;
+  }
+
+ private:
+  struct Window {
+    off64_t start;
+    std::shared_ptr<android::FileMap> map;
+    uint64_t last_use;
+  };
+
+  const int fd_;
+  const off64_t file_length_;
+  const size_t window_size_;
+  const size_t max_windows_;
+
+  std::mutex lock_;
+  // Few enough for the least recently used to be found by a linear scan.
+  std::vector<Window> windows_;
+  uint64_t clock_ = 0;
+};
+
+MappedZipFile::MappedZipFile(const int fd)
+    : has_fd_(true), fd_(fd), base_ptr_(nullptr), data_length_(0) {}
+
+MappedZipFile::MappedZipFile(void* address, size_t length)
+    : has_fd_(false), fd_(-1), base_ptr_(address), data_length_(static_cast<off64_t>(length)) {}
+
+MappedZipFile::~MappedZipFile() {}
+
+void MappedZipFile::SetWindows(size_t window_size, size_t max_windows) {
+  CHECK(has_fd_);
+  windows_.reset();
+  if (window_size != 0 && max_windows != 0) {
+    off64_t file_length = GetFileLength();
+    if (file_length != -1) {
+      windows_.reset(new WindowCache(fd_, file_length, window_size, max_windows));
+    }
+  }
+}
+
 int MappedZipFile::GetFileDescriptor() const {
   if (!has_fd_) {
     ALOGW("Zip: MappedZipFile doesn't have a file descriptor.");
@@ -1172,6 +1920,23 @@ off64_t MappedZipFile::GetFileLength() const {
 // Attempts to read |len| bytes into |buf| at offset |off|.
 bool MappedZipFile::ReadAtOffset(uint8_t* buf, size_t len, off64_t off) const {
   if (has_fd_) {
+    // Copy what the windows cover, and pread whatever is left.
+    while (windows_ && len > 0) {
+      off64_t window_start;
+      std::shared_ptr<android::FileMap> window = windows_->Get(off, &window_start);
+      if (window == nullptr) {
+        break;
+      }
+      const size_t window_offset = static_cast<size_t>(off - window_start);
+      const size_t count = std::min(len, window->getDataLength() - window_offset);
+      memcpy(buf, static_cast<const uint8_t*>(window->getDataPtr()) + window_offset, count);
+      buf += count;
+      len -= count;
+      off += count;
+    }
+    if (len == 0) {
+      return true;
+    }
     if (!android::base::ReadFullyAtOffset(fd_, buf, len, off)) {
       ALOGE("Zip: failed to read at offset %" PRId64 "\n", off);
       return false;
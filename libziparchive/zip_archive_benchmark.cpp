@@ -14,14 +14,19 @@
  * limitations under the License.
  */
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <vector>
 
+#include <android-base/macros.h>
 #include <android-base/test_utils.h>
 #include <benchmark/benchmark.h>
 #include <ziparchive/zip_archive.h>
@@ -84,4 +89,355 @@ static void Iterate_all_files(benchmark::State& state) {
 }
 BENCHMARK(Iterate_all_files);
 
+// The synthetic archives below stand in for the shapes that matter to lookups and extraction,
+// so that changes to the entry table or the decompressor can be measured without real APKs.
+enum TestZipKind {
+  // As many small entries as a zip without zip64 extensions can hold, in a few hundred
+  // directories, one in sixteen of them a ".png".
+  kManyEntries,
+  // Names a kilobyte long that only differ at their end, the worst case for comparing names.
+  kLongNames,
+  // Names that all start in the same slot of the entry table, so lookups walk the whole cluster.
+  kCollidingNames,
+  // A single large entry, stored or deflated.
+  kLargeStored,
+  kLargeDeflated,
+  kNumTestZipKinds,
+};
+
+// The most entries a zip without zip64 extensions can hold.
+static constexpr size_t kMaxEntries = UINT16_MAX;
+static constexpr size_t kLargeEntrySize = 16 * 1024 * 1024;
+
+struct TestZip {
+  ~TestZip() { unlink(index_path.c_str()); }
+
+  TemporaryFile file;
+  std::string index_path;
+  // The names in the archive, in a shuffled order to look them up in.
+  std::vector<std::string> names;
+  // A name that is not in the archive, but looked up the same way as those that are.
+  std::string missing;
+};
+
+// Mirrors how zip_archive.cc sizes its entry table and picks the slot a name goes into.
+static uint32_t EntryTableSlot(const std::string& name, size_t num_entries) {
+  uint32_t size = 1;
+  while (size < 1 + (num_entries * 4) / 3) {
+    size *= 2;
+  }
+
+  static constexpr uint64_t kMultiplier = 0xc6a4a7935bd1e995ULL;
+  const char* str = name.data();
+  size_t len = name.size();
+  uint64_t hash = len * kMultiplier;
+  for (; len >= sizeof(uint64_t); str += sizeof(uint64_t), len -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, str, sizeof(word));
+    word *= kMultiplier;
+    word ^= word >> 47;
+    word *= kMultiplier;
+    hash = (hash ^ word) * kMultiplier;
+  }
+  if (len != 0) {
+    uint64_t word = 0;
+    memcpy(&word, str, len);
+    hash = (hash ^ word) * kMultiplier;
+  }
+  hash ^= hash >> 47;
+  hash *= kMultiplier;
+  hash ^= hash >> 47;
+  return static_cast<uint32_t>(hash) & (size - 1);
+}
+
+static std::vector<std::string> TestZipNames(TestZipKind kind, std::string* missing) {
+  std::vector<std::string> names;
+  switch (kind) {
+    case kManyEntries:
+      for (size_t i = 0; i < kMaxEntries; i++) {
+        names.push_back("assets/dir" + std::to_string(i % 256) + "/entry" + std::to_string(i) +
+                        (i % 16 == 0 ? ".png" : ".txt"));
+      }
+      *missing = "assets/dir0/entry.txt";
+      break;
+    case kLongNames: {
+      const std::string prefix = "long/" + std::string(1000, 'x') + "/";
+      for (size_t i = 0; i < 4096; i++) {
+        names.push_back(prefix + std::to_string(i));
+      }
+      *missing = prefix + "missing";
+      break;
+    }
+    case kCollidingNames: {
+      constexpr size_t kNumNames = 1024;
+      for (size_t i = 0; names.size() <= kNumNames; i++) {
+        std::string name = "collide/" + std::to_string(i);
+        if (EntryTableSlot(name, kNumNames) == 0) {
+          names.push_back(name);
+        }
+      }
+      *missing = names.back();
+      names.pop_back();
+      break;
+    }
+    case kLargeStored:
+    case kLargeDeflated:
+      names.push_back("large.bin");
+      *missing = "large.txt";
+      break;
+    default:
+      abort();
+  }
+  return names;
+}
+
+static bool WriteTestZip(TestZipKind kind, const std::vector<std::string>& names, FILE* fp) {
+  ZipWriter::Options options;
+  options.output_buffer_size = 1024 * 1024;
+  ZipWriter writer(fp, options);
+
+  if (kind == kLargeStored || kind == kLargeDeflated) {
+    // Text from a small vocabulary, which deflates about as well as the usual resources.
+    static const char* kWords[] = {"zip ", "archive ", "entry ", "central ", "directory ",
+                                   "local ", "header ", "deflate ", "stored ", "\n"};
+    std::string data;
+    uint32_t seed = 1;
+    while (data.size() < kLargeEntrySize) {
+      seed = seed * 1103515245 + 12345;
+      data += kWords[(seed >> 16) % arraysize(kWords)];
+    }
+    data.resize(kLargeEntrySize);
+    return writer.StartEntry(names[0].c_str(),
+                             kind == kLargeDeflated ? ZipWriter::kCompress : 0) == 0 &&
+           writer.WriteBytes(data.data(), data.size()) == 0 && writer.FinishEntry() == 0 &&
+           writer.Finish() == 0;
+  }
+
+  for (const std::string& name : names) {
+    if (writer.StartEntry(name.c_str(), 0) != 0 || writer.WriteBytes("helo", 4) != 0 ||
+        writer.FinishEntry() != 0) {
+      return false;
+    }
+  }
+  return writer.Finish() == 0;
+}
+
+// Archives are only created the first time a benchmark asks for them, and then kept.
+static const TestZip& GetTestZip(TestZipKind kind) {
+  static std::unique_ptr<TestZip> zips[kNumTestZipKinds];
+  if (!zips[kind]) {
+    std::unique_ptr<TestZip> zip(new TestZip);
+    zip->index_path = std::string(zip->file.path) + ".index";
+    zip->names = TestZipNames(kind, &zip->missing);
+
+    FILE* fp = fdopen(dup(zip->file.fd), "w");
+    if (fp == nullptr || !WriteTestZip(kind, zip->names, fp) || fclose(fp) != 0) {
+      std::cerr << "failed to create test zip " << kind << std::endl;
+      abort();
+    }
+
+    uint32_t seed = 1;
+    for (size_t i = zip->names.size(); i > 1; i--) {
+      seed = seed * 1103515245 + 12345;
+      std::swap(zip->names[i - 1], zip->names[(seed >> 8) % i]);
+    }
+    zips[kind] = std::move(zip);
+  }
+  return *zips[kind];
+}
+
+static void OpenTestZip(const TestZip& zip, ZipArchiveHandle* handle) {
+  if (OpenArchive(zip.file.path, handle) != 0) {
+    std::cerr << "failed to open " << zip.file.path << std::endl;
+    abort();
+  }
+}
+
+static void BM_OpenArchive(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  while (state.KeepRunning()) {
+    OpenTestZip(zip, &handle);
+    CloseArchive(handle);
+  }
+}
+BENCHMARK_CAPTURE(BM_OpenArchive, many_entries, kManyEntries);
+BENCHMARK_CAPTURE(BM_OpenArchive, long_names, kLongNames);
+BENCHMARK_CAPTURE(BM_OpenArchive, colliding_names, kCollidingNames);
+
+static void BM_OpenArchiveWithIndex(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  while (state.KeepRunning()) {
+    OpenArchiveWithIndex(zip.file.path, zip.index_path.c_str(), &handle);
+    CloseArchive(handle);
+  }
+}
+BENCHMARK_CAPTURE(BM_OpenArchiveWithIndex, many_entries, kManyEntries);
+BENCHMARK_CAPTURE(BM_OpenArchiveWithIndex, long_names, kLongNames);
+
+// What it costs a process that only needs the one entry.
+static void BM_OpenArchiveLazyAndFindEntry(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  ZipEntry data;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    OpenArchiveLazy(zip.file.path, &handle);
+    FindEntry(handle, ZipString(zip.names[i++ % zip.names.size()].c_str()), &data);
+    CloseArchive(handle);
+  }
+}
+BENCHMARK_CAPTURE(BM_OpenArchiveLazyAndFindEntry, many_entries, kManyEntries);
+
+static void BM_FindEntry(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  ZipEntry data;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    if (FindEntry(handle, ZipString(zip.names[i++ % zip.names.size()].c_str()), &data) != 0) {
+      state.SkipWithError("entry not found");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  CloseArchive(handle);
+}
+BENCHMARK_CAPTURE(BM_FindEntry, many_entries, kManyEntries);
+BENCHMARK_CAPTURE(BM_FindEntry, long_names, kLongNames);
+BENCHMARK_CAPTURE(BM_FindEntry, colliding_names, kCollidingNames);
+
+static void BM_FindEntry_missing(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  ZipEntry data;
+  ZipString name(zip.missing.c_str());
+  while (state.KeepRunning()) {
+    FindEntry(handle, name, &data);
+  }
+  state.SetItemsProcessed(state.iterations());
+  CloseArchive(handle);
+}
+BENCHMARK_CAPTURE(BM_FindEntry_missing, many_entries, kManyEntries);
+BENCHMARK_CAPTURE(BM_FindEntry_missing, long_names, kLongNames);
+BENCHMARK_CAPTURE(BM_FindEntry_missing, colliding_names, kCollidingNames);
+
+static void BM_Iterate(benchmark::State& state, const char* prefix, const char* suffix) {
+  const TestZip& zip = GetTestZip(kManyEntries);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  ZipString prefix_string;
+  ZipString suffix_string;
+  if (prefix != nullptr) {
+    prefix_string = ZipString(prefix);
+  }
+  if (suffix != nullptr) {
+    suffix_string = ZipString(suffix);
+  }
+  void* cookie;
+  ZipEntry data;
+  ZipString name;
+  size_t entries = 0;
+  while (state.KeepRunning()) {
+    StartIteration(handle, &cookie, prefix ? &prefix_string : nullptr,
+                   suffix ? &suffix_string : nullptr);
+    while (Next(cookie, &data, &name) == 0) {
+      entries++;
+    }
+    EndIteration(cookie);
+  }
+  state.SetItemsProcessed(entries);
+  CloseArchive(handle);
+}
+BENCHMARK_CAPTURE(BM_Iterate, all, nullptr, nullptr);
+BENCHMARK_CAPTURE(BM_Iterate, prefix, "assets/dir7/", nullptr);
+BENCHMARK_CAPTURE(BM_Iterate, suffix, nullptr, ".png");
+BENCHMARK_CAPTURE(BM_Iterate, prefix_and_suffix, "assets/dir16/", ".png");
+
+static void BM_ExtractToMemory(benchmark::State& state, TestZipKind kind, size_t window_size) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  if (window_size != 0) {
+    SetMappingWindows(handle, window_size, 4);
+  }
+  ZipEntry data;
+  FindEntry(handle, ZipString(zip.names[0].c_str()), &data);
+  std::vector<uint8_t> buffer(data.uncompressed_length);
+  while (state.KeepRunning()) {
+    if (ExtractToMemory(handle, &data, buffer.data(), buffer.size()) != 0) {
+      state.SkipWithError("extraction failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+  CloseArchive(handle);
+}
+BENCHMARK_CAPTURE(BM_ExtractToMemory, stored, kLargeStored, 0);
+BENCHMARK_CAPTURE(BM_ExtractToMemory, deflated, kLargeDeflated, 0);
+BENCHMARK_CAPTURE(BM_ExtractToMemory, stored_windowed, kLargeStored, 1024 * 1024);
+BENCHMARK_CAPTURE(BM_ExtractToMemory, deflated_windowed, kLargeDeflated, 1024 * 1024);
+
+static void BM_ExtractToFile(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  ZipEntry data;
+  FindEntry(handle, ZipString(zip.names[0].c_str()), &data);
+  TemporaryFile output;
+  while (state.KeepRunning()) {
+    if (ftruncate(output.fd, 0) != 0 || lseek(output.fd, 0, SEEK_SET) != 0 ||
+        ExtractEntryToFile(handle, &data, output.fd) != 0) {
+      state.SkipWithError("extraction failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data.uncompressed_length);
+  CloseArchive(handle);
+}
+BENCHMARK_CAPTURE(BM_ExtractToFile, stored, kLargeStored);
+BENCHMARK_CAPTURE(BM_ExtractToFile, deflated, kLargeDeflated);
+
+static void BM_StreamEntry(benchmark::State& state, TestZipKind kind) {
+  const TestZip& zip = GetTestZip(kind);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  ZipEntry data;
+  FindEntry(handle, ZipString(zip.names[0].c_str()), &data);
+  while (state.KeepRunning()) {
+    std::unique_ptr<ZipArchiveStreamEntry> stream(ZipArchiveStreamEntry::Create(handle, data));
+    while (stream && stream->Read() != nullptr) {
+    }
+    if (!stream || !stream->Verify()) {
+      state.SkipWithError("stream failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data.uncompressed_length);
+  CloseArchive(handle);
+}
+BENCHMARK_CAPTURE(BM_StreamEntry, stored, kLargeStored);
+BENCHMARK_CAPTURE(BM_StreamEntry, deflated, kLargeDeflated);
+
+static void BM_MapStoredEntry(benchmark::State& state) {
+  const TestZip& zip = GetTestZip(kLargeStored);
+  ZipArchiveHandle handle;
+  OpenTestZip(zip, &handle);
+  ZipEntry data;
+  FindEntry(handle, ZipString(zip.names[0].c_str()), &data);
+  while (state.KeepRunning()) {
+    std::unique_ptr<MappedZipEntry> mapped;
+    if (MapStoredEntry(handle, &data, &mapped) != 0) {
+      state.SkipWithError("mapping failed");
+      break;
+    }
+    benchmark::DoNotOptimize(mapped->data());
+  }
+  CloseArchive(handle);
+}
+BENCHMARK(BM_MapStoredEntry);
+
 BENCHMARK_MAIN();
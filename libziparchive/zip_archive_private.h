@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <utils/FileMap.h>
@@ -42,6 +43,7 @@ static const char* kErrorMessages[] = {
     "Invalid entry name",
     "I/O error",
     "File mapping failed",
+    "Unsupported compression method",
 };
 
 enum ErrorCodes : int32_t {
@@ -87,16 +89,18 @@ enum ErrorCodes : int32_t {
   // We were not able to mmap the central directory or entry contents.
   kMmapFailed = -12,
 
-  kLastErrorCode = kMmapFailed,
+  // The entry's compression method doesn't allow the operation, e.g.
+  // mapping a compressed entry.
+  kUnsupportedCompressionMethod = -13,
+
+  kLastErrorCode = kUnsupportedCompressionMethod,
 };
 
 class MappedZipFile {
  public:
-  explicit MappedZipFile(const int fd)
-      : has_fd_(true), fd_(fd), base_ptr_(nullptr), data_length_(0) {}
+  explicit MappedZipFile(const int fd);
 
-  explicit MappedZipFile(void* address, size_t length)
-      : has_fd_(false), fd_(-1), base_ptr_(address), data_length_(static_cast<off64_t>(length)) {}
+  explicit MappedZipFile(void* address, size_t length);
 
   bool HasFd() const { return has_fd_; }
 
@@ -108,7 +112,14 @@ class MappedZipFile {
 
   bool ReadAtOffset(uint8_t* buf, size_t len, off64_t off) const;
 
+  // See SetMappingWindows. Only for archives with a file descriptor.
+  void SetWindows(size_t window_size, size_t max_windows);
+
+  ~MappedZipFile();
+
  private:
+  class WindowCache;
+
   // If has_fd_ is true, fd is valid and we'll read contents of a zip archive
   // from the file. Otherwise, we're opening the archive from a memory mapped
   // file. In that case, base_ptr_ points to the start of the memory region and
@@ -119,8 +130,65 @@ class MappedZipFile {
 
   void* const base_ptr_;
   const off64_t data_length_;
+
+  // Set by SetWindows, nullptr to pread.
+  std::unique_ptr<WindowCache> windows_;
+};
+
+// A hash table entry: the location of an entry name relative to the start of
+// the central directory, rather than a pointer, so that a table can be shared
+// across processes through an index file (see OpenArchiveWithIndex). Names
+// always follow a CentralDirectoryRecord, so an offset of 0 marks a free slot.
+struct ZipStringOffset {
+  uint32_t name_offset;
+  uint16_t name_length;
+
+  ZipString GetZipString(const uint8_t* start) const {
+    ZipString zip_string;
+    zip_string.name = start + name_offset;
+    zip_string.name_length = name_length;
+    return zip_string;
+  }
 };
 
+// A hash table is hash_table_size ZipStringOffset entries followed by as
+// many uint16_t fingerprints, in one allocation. Probes scan the compact
+// fingerprints and only look at the entries, and the names they point to,
+// for slots whose fingerprint matches; a fingerprint of 0 marks a free slot.
+static const size_t kHashSlotSize = sizeof(ZipStringOffset) + sizeof(uint16_t);
+
+/*
+ * The on-disk layout of an index written by OpenArchiveWithIndex: this
+ * header followed by the hash table, exactly as ParseZipArchive would have
+ * built it. It is native endian since it is
+ * only ever read back on the machine that wrote it.
+ */
+struct ZipIndexHeader {
+  static const uint32_t kMagic = 0x5844495a;  // "ZIDX"
+  static const uint32_t kVersion = 2;
+
+  uint32_t magic;
+  uint32_t version;
+  // Identity of the archive the index was built from.
+  uint64_t dev;
+  uint64_t ino;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  // The central directory as described by its EOCD record.
+  uint32_t cd_offset;
+  uint32_t cd_size;
+  uint32_t num_entries;
+  uint32_t hash_table_size;
+  uint32_t entry_size;
+  // The hash of a fixed string, so that an index built with another hash
+  // function is never used.
+  uint32_t hash_check;
+};
+
+// Headers are compared with memcmp, there must be no padding.
+static_assert(sizeof(ZipIndexHeader) == 72, "ZipIndexHeader has padding");
+
 class CentralDirectory {
  public:
   CentralDirectory(void) : base_ptr_(nullptr), length_(0) {}
@@ -154,7 +222,25 @@ struct ZipArchive {
   // allocate so the maximum number entries can never be higher than
   // ((4 * UINT16_MAX) / 3 + 1) which can safely fit into a uint32_t.
   uint32_t hash_table_size;
-  ZipString* hash_table;
+  const ZipStringOffset* hash_table;
+  const uint16_t* fingerprints;
+
+  // Set when hash_table points into a read-only mapping of an index file
+  // rather than to our own allocation.
+  std::unique_ptr<android::FileMap> index_map;
+
+  // Set for archives opened with OpenArchiveLazy, whose hash table is
+  // filled in by FindEntry as it goes: the first parsed_entries records
+  // have been added, and the next starts parse_offset bytes into the
+  // central directory. parse_error is the error that stopped parsing.
+  bool lazy;
+  mutable std::mutex parse_lock;
+  mutable uint16_t parsed_entries;
+  mutable uint32_t parse_offset;
+  mutable int32_t parse_error;
+
+  // Set by SetDecompressor, nullptr for zip_archive::Inflate.
+  const zip_archive::Decompressor* decompressor;
 
   ZipArchive(const int fd, bool assume_ownership)
       : mapped_zip(fd),
@@ -164,7 +250,13 @@ struct ZipArchive {
         directory_map(new android::FileMap()),
         num_entries(0),
         hash_table_size(0),
-        hash_table(nullptr) {}
+        hash_table(nullptr),
+        fingerprints(nullptr),
+        lazy(false),
+        parsed_entries(0),
+        parse_offset(0),
+        parse_error(0),
+        decompressor(nullptr) {}
 
   ZipArchive(void* address, size_t length)
       : mapped_zip(address, length),
@@ -174,14 +266,22 @@ struct ZipArchive {
         directory_map(new android::FileMap()),
         num_entries(0),
         hash_table_size(0),
-        hash_table(nullptr) {}
+        hash_table(nullptr),
+        fingerprints(nullptr),
+        lazy(false),
+        parsed_entries(0),
+        parse_offset(0),
+        parse_error(0),
+        decompressor(nullptr) {}
 
   ~ZipArchive() {
     if (close_file && mapped_zip.GetFileDescriptor() >= 0) {
       close(mapped_zip.GetFileDescriptor());
     }
 
-    free(hash_table);
+    if (index_map == nullptr) {
+      free(const_cast<ZipStringOffset*>(hash_table));
+    }
   }
 
   bool InitializeCentralDirectory(const char* debug_file_name, off64_t cd_start_offset,
@@ -18,11 +18,16 @@
 
 // Read-only stream access to Zip Archive entries.
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -40,6 +45,55 @@ static constexpr size_t kBufSize = 65535;
 bool ZipArchiveStreamEntry::Init(const ZipEntry& entry) {
   crc32_ = entry.crc32;
   offset_ = entry.offset;
+  end_ = entry.offset +
+         ((entry.method == kCompressStored) ? entry.uncompressed_length : entry.compressed_length);
+  read_ahead_end_ = offset_;
+  if (chunk_size_ == 0) {
+    chunk_size_ = kBufSize;
+  }
+  return true;
+}
+
+void ZipArchiveStreamEntry::ReadAhead() {
+  if (read_ahead_ == 0 || read_ahead_end_ >= end_ ||
+      read_ahead_end_ - offset_ > static_cast<off64_t>(read_ahead_ / 2)) {
+    return;
+  }
+
+  const off64_t start = std::max(read_ahead_end_, offset_);
+  const off64_t end = std::min(offset_ + static_cast<off64_t>(read_ahead_), end_);
+  read_ahead_end_ = end;
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+  if (archive->mapped_zip.HasFd()) {
+#if defined(__linux__)
+    // Only a hint, so failures don't matter.
+    posix_fadvise(archive->mapped_zip.GetFileDescriptor(), start, end - start,
+                  POSIX_FADV_WILLNEED);
+#endif
+  } else {
+#if !defined(_WIN32)
+    const uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+    const uintptr_t base = reinterpret_cast<uintptr_t>(archive->mapped_zip.GetBasePtr());
+    const uintptr_t aligned = (base + start) & ~page_mask;
+    madvise(reinterpret_cast<void*>(aligned), base + end - aligned, MADV_WILLNEED);
+#endif
+  }
+}
+
+bool ZipArchiveStreamEntry::ReadChunk(uint8_t* buf, size_t len) {
+  ReadAhead();
+
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+  errno = 0;
+  if (!archive->mapped_zip.ReadAtOffset(buf, len, offset_)) {
+    if (errno != 0) {
+      ALOGE("Error reading from archive fd: %s", strerror(errno));
+    } else {
+      ALOGE("Short read of zip file, possibly corrupted zip?");
+    }
+    return false;
+  }
+  offset_ += len;
   return true;
 }
 
@@ -70,7 +124,7 @@ bool ZipArchiveStreamEntryUncompressed::Init(const ZipEntry& entry) {
 
   length_ = entry.uncompressed_length;
 
-  data_.resize(kBufSize);
+  data_.resize(chunk_size_);
   computed_crc32_ = 0;
 
   return true;
@@ -82,14 +136,7 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryUncompressed::Read() {
   }
 
   size_t bytes = (length_ > data_.size()) ? data_.size() : length_;
-  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
-  errno = 0;
-  if (!archive->mapped_zip.ReadAtOffset(data_.data(), bytes, offset_)) {
-    if (errno != 0) {
-      ALOGE("Error reading from archive fd: %s", strerror(errno));
-    } else {
-      ALOGE("Short read of zip file, possibly corrupted zip?");
-    }
+  if (!ReadChunk(data_.data(), bytes)) {
     length_ = 0;
     return nullptr;
   }
@@ -99,7 +146,6 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryUncompressed::Read() {
   }
   computed_crc32_ = crc32(computed_crc32_, data_.data(), data_.size());
   length_ -= bytes;
-  offset_ += bytes;
   return &data_;
 }
 
@@ -171,8 +217,8 @@ bool ZipArchiveStreamEntryCompressed::Init(const ZipEntry& entry) {
   uncompressed_length_ = entry.uncompressed_length;
   compressed_length_ = entry.compressed_length;
 
-  out_.resize(kBufSize);
-  in_.resize(kBufSize);
+  out_.resize(chunk_size_);
+  in_.resize(chunk_size_);
 
   computed_crc32_ = 0;
 
@@ -204,19 +250,11 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryCompressed::Read() {
         return nullptr;
       }
       size_t bytes = (compressed_length_ > in_.size()) ? in_.size() : compressed_length_;
-      ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
-      errno = 0;
-      if (!archive->mapped_zip.ReadAtOffset(in_.data(), bytes, offset_)) {
-        if (errno != 0) {
-          ALOGE("Error reading from archive fd: %s", strerror(errno));
-        } else {
-          ALOGE("Short read of zip file, possibly corrupted zip?");
-        }
+      if (!ReadChunk(in_.data(), bytes)) {
         return nullptr;
       }
 
       compressed_length_ -= bytes;
-      offset_ += bytes;
       z_stream_.next_in = in_.data();
       z_stream_.avail_in = bytes;
     }
@@ -274,12 +312,27 @@ bool ZipArchiveStreamEntryRawCompressed::Verify() {
 
 ZipArchiveStreamEntry* ZipArchiveStreamEntry::Create(ZipArchiveHandle handle,
                                                      const ZipEntry& entry) {
+  return Create(handle, entry, Options());
+}
+
+ZipArchiveStreamEntry* ZipArchiveStreamEntry::CreateRaw(ZipArchiveHandle handle,
+                                                        const ZipEntry& entry) {
+  return CreateRaw(handle, entry, Options());
+}
+
+ZipArchiveStreamEntry* ZipArchiveStreamEntry::Create(ZipArchiveHandle handle,
+                                                     const ZipEntry& entry,
+                                                     const Options& options) {
   ZipArchiveStreamEntry* stream = nullptr;
   if (entry.method != kCompressStored) {
     stream = new ZipArchiveStreamEntryCompressed(handle);
   } else {
     stream = new ZipArchiveStreamEntryUncompressed(handle);
   }
+  if (stream) {
+    stream->chunk_size_ = options.chunk_size;
+    stream->read_ahead_ = options.read_ahead;
+  }
   if (stream && !stream->Init(entry)) {
     delete stream;
     stream = nullptr;
@@ -289,7 +342,8 @@ ZipArchiveStreamEntry* ZipArchiveStreamEntry::Create(ZipArchiveHandle handle,
 }
 
 ZipArchiveStreamEntry* ZipArchiveStreamEntry::CreateRaw(ZipArchiveHandle handle,
-                                                        const ZipEntry& entry) {
+                                                        const ZipEntry& entry,
+                                                        const Options& options) {
   ZipArchiveStreamEntry* stream = nullptr;
   if (entry.method == kCompressStored) {
     // Not compressed, don't need to do anything special.
@@ -297,6 +351,10 @@ ZipArchiveStreamEntry* ZipArchiveStreamEntry::CreateRaw(ZipArchiveHandle handle,
   } else {
     stream = new ZipArchiveStreamEntryRawCompressed(handle);
   }
+  if (stream) {
+    stream->chunk_size_ = options.chunk_size;
+    stream->read_ahead_ = options.read_ahead;
+  }
   if (stream && !stream->Init(entry)) {
     delete stream;
     stream = nullptr;
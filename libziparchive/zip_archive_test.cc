@@ -21,6 +21,7 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <memory>
@@ -211,6 +212,54 @@ TEST(ziparchive, FindEntry) {
   CloseArchive(handle);
 }
 
+TEST(ziparchive, FindEntryLazy) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveLazy((test_data_dir + "/" + kValidZip).c_str(), &handle));
+
+  ZipEntry data;
+  ZipString name;
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  ASSERT_EQ(63, data.offset);
+  ASSERT_EQ(static_cast<uint32_t>(17), data.uncompressed_length);
+  ASSERT_EQ(0x950821c5, data.crc32);
+
+  // A miss parses the rest of the directory, lookups still work after it.
+  ZipString absent_name;
+  SetZipString(&absent_name, kNonexistentTxtName);
+  ASSERT_EQ(-7, FindEntry(handle, absent_name, &data));
+  ASSERT_EQ(-7, FindEntry(handle, absent_name, &data));
+  ZipString b_name;
+  SetZipString(&b_name, kBTxtName);
+  ASSERT_EQ(0, FindEntry(handle, b_name, &data));
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  ASSERT_EQ(63, data.offset);
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, IterationLazy) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveLazy((test_data_dir + "/" + kValidZip).c_str(), &handle));
+
+  ZipString prefix("b");
+  ZipString suffix(".txt");
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, &prefix, &suffix));
+
+  ZipEntry data;
+  ZipString name;
+  std::vector<std::string> names;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    names.push_back(std::string(reinterpret_cast<const char*>(name.name), name.name_length));
+  }
+  EndIteration(iteration_cookie);
+  CloseArchive(handle);
+
+  std::sort(names.begin(), names.end());
+  ASSERT_EQ((std::vector<std::string>{"b.txt", "b/c.txt", "b/d.txt"}), names);
+}
+
 TEST(ziparchive, TestInvalidDeclaredLength) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper("declaredlength.zip", &handle));
@@ -407,6 +456,156 @@ TEST(ziparchive, ExtractToFile) {
             lseek64(tmp_file.fd, 0, SEEK_END));
 }
 
+static void AssertMapsLikeExtract(ZipArchiveHandle handle, const std::string& entry_name) {
+  ZipEntry entry;
+  ZipString name;
+  SetZipString(&name, entry_name);
+  ASSERT_EQ(0, FindEntry(handle, name, &entry));
+  ASSERT_EQ(kCompressStored, entry.method);
+  ASSERT_TRUE(entry.IsAligned(1));
+
+  std::vector<uint8_t> extracted(entry.uncompressed_length);
+  ASSERT_EQ(0, ExtractToMemory(handle, &entry, extracted.data(), extracted.size()));
+
+  std::unique_ptr<MappedZipEntry> mapped;
+  ASSERT_EQ(0, MapStoredEntry(handle, &entry, &mapped));
+  ASSERT_EQ(extracted.size(), mapped->size());
+  ASSERT_EQ(0, memcmp(extracted.data(), mapped->data(), extracted.size()));
+}
+
+TEST(ziparchive, MapStoredEntry) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &handle));
+  AssertMapsLikeExtract(handle, kLargeUncompressTxtName);
+
+  ZipEntry entry;
+  ZipString name;
+  SetZipString(&name, kLargeUncompressTxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &entry));
+  std::unique_ptr<MappedZipEntry> mapped;
+  ASSERT_EQ(0, MapStoredEntry(handle, &entry, &mapped));
+  std::vector<uint8_t> contents(mapped->data(), mapped->data() + mapped->size());
+
+  // Compressed entries can't be mapped.
+  ZipEntry compressed;
+  SetZipString(&name, kLargeCompressTxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &compressed));
+  std::unique_ptr<MappedZipEntry> not_mapped;
+  ASSERT_EQ(kUnsupportedCompressionMethod, MapStoredEntry(handle, &compressed, &not_mapped));
+  ASSERT_EQ(nullptr, not_mapped);
+
+  // The mapping outlives the archive.
+  CloseArchive(handle);
+  ASSERT_EQ(0, memcmp(contents.data(), mapped->data(), contents.size()));
+}
+
+TEST(ziparchive, MapStoredEntryFromMemory) {
+  const std::string zip_path = test_data_dir + "/" + kLargeZip;
+  std::string zip;
+  ASSERT_TRUE(android::base::ReadFileToString(zip_path, &zip));
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFromMemory(&zip[0], zip.size(), zip_path.c_str(), &handle));
+  AssertMapsLikeExtract(handle, kLargeUncompressTxtName);
+  CloseArchive(handle);
+}
+
+static std::vector<uint8_t> ExtractAll(ZipArchiveHandle handle, const std::string& entry_name) {
+  ZipEntry entry;
+  ZipString name;
+  SetZipString(&name, entry_name);
+  std::vector<uint8_t> contents;
+  if (FindEntry(handle, name, &entry) == 0) {
+    contents.resize(entry.uncompressed_length);
+    if (ExtractToMemory(handle, &entry, contents.data(), contents.size()) != 0) {
+      contents.clear();
+    }
+  }
+  return contents;
+}
+
+TEST(ziparchive, SetMappingWindows) {
+  ZipArchiveHandle expected_handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &expected_handle));
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &handle));
+
+  // Windows smaller than the entries, and not page aligned, so that reads span several of them
+  // and evict each other.
+  ASSERT_EQ(0, SetMappingWindows(handle, 10000, 3));
+  for (const std::string& name : {kLargeCompressTxtName, kLargeUncompressTxtName}) {
+    std::vector<uint8_t> expected = ExtractAll(expected_handle, name);
+    ASSERT_FALSE(expected.empty());
+    ASSERT_EQ(expected, ExtractAll(handle, name));
+  }
+  AssertMapsLikeExtract(handle, kLargeUncompressTxtName);
+
+  ASSERT_EQ(0, SetMappingWindows(handle, 0, 0));
+  ASSERT_EQ(ExtractAll(expected_handle, kLargeCompressTxtName),
+            ExtractAll(handle, kLargeCompressTxtName));
+
+  CloseArchive(handle);
+  CloseArchive(expected_handle);
+
+  std::string zip;
+  ASSERT_TRUE(android::base::ReadFileToString(test_data_dir + "/" + kLargeZip, &zip));
+  ASSERT_EQ(0, OpenArchiveFromMemory(&zip[0], zip.size(), kLargeZip.c_str(), &handle));
+  ASSERT_EQ(kInvalidHandle, SetMappingWindows(handle, 10000, 3));
+  CloseArchive(handle);
+}
+
+#if !defined(_WIN32)
+// Where OpenInDirectory puts an entry.
+static std::string FlatPath(const std::string& dir, std::string name) {
+  std::replace(name.begin(), name.end(), '/', '_');
+  return dir + "/" + name;
+}
+
+// Opens name in the directory in cookie, skipping directory entries.
+static int OpenInDirectory(const ZipString& name, const ZipEntry&, void* cookie) {
+  const std::string entry_name(reinterpret_cast<const char*>(name.name), name.name_length);
+  if (entry_name.back() == '/') {
+    return -1;
+  }
+  const std::string path = FlatPath(*reinterpret_cast<std::string*>(cookie), entry_name);
+  return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0600);
+}
+
+static int FailOpen(const ZipString&, const ZipEntry&, void* cookie) {
+  ++*reinterpret_cast<int*>(cookie);
+  return kIoError;
+}
+
+TEST(ziparchive, ExtractEntriesToFiles) {
+  TemporaryDir tmp_dir;
+  std::string dir(tmp_dir.path);
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+  ZipString prefix("b");
+  ASSERT_EQ(0, ExtractEntriesToFiles(handle, nullptr, OpenInDirectory, &dir, 4));
+  ASSERT_EQ(0, ExtractEntriesToFiles(handle, &prefix, OpenInDirectory, &dir, 1));
+
+  const std::string a_path = FlatPath(dir, kATxtName);
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(a_path, &contents));
+  ASSERT_EQ(std::string(kATxtContents.begin(), kATxtContents.end()), contents);
+  const std::string b_path = FlatPath(dir, kBTxtName);
+  ASSERT_TRUE(android::base::ReadFileToString(b_path, &contents));
+  ASSERT_EQ(std::string(kBTxtContents.begin(), kBTxtContents.end()), contents);
+
+  // An error from the open function stops the extraction and is returned.
+  int opens = 0;
+  ASSERT_EQ(kIoError, ExtractEntriesToFiles(handle, nullptr, FailOpen, &opens, 0));
+  ASSERT_EQ(1, opens);
+
+  CloseArchive(handle);
+
+  for (const std::string& name : {"a.txt", "b.txt", "b/c.txt", "b/d.txt"}) {
+    unlink(FlatPath(dir, name).c_str());
+  }
+}
+#endif
+
 #if !defined(_WIN32)
 TEST(ziparchive, OpenFromMemory) {
   const std::string zip_path = test_data_dir + "/" + kUpdateZip;
@@ -434,20 +633,21 @@ TEST(ziparchive, OpenFromMemory) {
 #endif
 
 static void ZipArchiveStreamTest(ZipArchiveHandle& handle, const std::string& entry_name, bool raw,
-                                 bool verified, ZipEntry* entry, std::vector<uint8_t>* read_data) {
+                                 bool verified, ZipEntry* entry, std::vector<uint8_t>* read_data,
+                                 const ZipArchiveStreamEntry::Options& options = {}) {
   ZipString name;
   SetZipString(&name, entry_name);
   ASSERT_EQ(0, FindEntry(handle, name, entry));
   std::unique_ptr<ZipArchiveStreamEntry> stream;
   if (raw) {
-    stream.reset(ZipArchiveStreamEntry::CreateRaw(handle, *entry));
+    stream.reset(ZipArchiveStreamEntry::CreateRaw(handle, *entry, options));
     if (entry->method == kCompressStored) {
       read_data->resize(entry->uncompressed_length);
     } else {
       read_data->resize(entry->compressed_length);
     }
   } else {
-    stream.reset(ZipArchiveStreamEntry::Create(handle, *entry));
+    stream.reset(ZipArchiveStreamEntry::Create(handle, *entry, options));
     read_data->resize(entry->uncompressed_length);
   }
   uint8_t* read_data_ptr = read_data->data();
@@ -455,6 +655,9 @@ static void ZipArchiveStreamTest(ZipArchiveHandle& handle, const std::string& en
   const std::vector<uint8_t>* data;
   uint64_t total_size = 0;
   while ((data = stream->Read()) != nullptr) {
+    if (options.chunk_size != 0) {
+      ASSERT_LE(data->size(), options.chunk_size);
+    }
     total_size += data->size();
     memcpy(read_data_ptr, data->data(), data->size());
     read_data_ptr += data->size();
@@ -480,13 +683,14 @@ static void ZipArchiveStreamTestUsingContents(const std::string& zip_file,
 }
 
 static void ZipArchiveStreamTestUsingMemory(const std::string& zip_file,
-                                            const std::string& entry_name) {
+                                            const std::string& entry_name,
+                                            const ZipArchiveStreamEntry::Options& options = {}) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper(zip_file, &handle));
 
   ZipEntry entry;
   std::vector<uint8_t> read_data;
-  ZipArchiveStreamTest(handle, entry_name, false, true, &entry, &read_data);
+  ZipArchiveStreamTest(handle, entry_name, false, true, &entry, &read_data, options);
 
   std::vector<uint8_t> cmp_data(entry.uncompressed_length);
   ASSERT_EQ(entry.uncompressed_length, read_data.size());
@@ -520,6 +724,14 @@ TEST(ziparchive, StreamLargeUncompressed) {
   ZipArchiveStreamTestUsingMemory(kLargeZip, kLargeUncompressTxtName);
 }
 
+TEST(ziparchive, StreamLargeWithReadAhead) {
+  ZipArchiveStreamEntry::Options options;
+  options.chunk_size = 4096;
+  options.read_ahead = 65536;
+  ZipArchiveStreamTestUsingMemory(kLargeZip, kLargeCompressTxtName, options);
+  ZipArchiveStreamTestUsingMemory(kLargeZip, kLargeUncompressTxtName, options);
+}
+
 TEST(ziparchive, StreamCompressedBadCrc) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper(kBadCrcZip, &handle));
@@ -638,9 +850,11 @@ TEST(ziparchive, ErrorCodeString) {
 
   // Out of bounds.
   ASSERT_STREQ("Unknown return code", ErrorCodeString(1));
-  ASSERT_STREQ("Unknown return code", ErrorCodeString(-13));
+  ASSERT_STREQ("Unknown return code", ErrorCodeString(kLastErrorCode - 1));
 
   ASSERT_STREQ("I/O error", ErrorCodeString(kIoError));
+  ASSERT_STREQ("Unsupported compression method",
+               ErrorCodeString(kUnsupportedCompressionMethod));
 }
 
 // A zip file whose local file header at offset zero is corrupted.
@@ -692,6 +906,105 @@ TEST(ziparchive, BrokenLfhSignature) {
   ASSERT_EQ(-1, OpenArchiveFd(tmp_file.fd, "LeadingNonZipBytes", &handle));
 }
 
+static void CopyValidZip(const std::string& path) {
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(test_data_dir + "/" + kValidZip, &contents));
+  ASSERT_TRUE(android::base::WriteStringToFile(contents, path));
+}
+
+// Opens path with index, checks it finds a.txt and whether the index was used.
+static void AssertOpenWithIndex(const std::string& path, const std::string& index,
+                                bool expect_mapped) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(path.c_str(), index.c_str(), &handle));
+  const ZipArchive* archive = reinterpret_cast<const ZipArchive*>(handle);
+  EXPECT_EQ(expect_mapped, archive->index_map != nullptr);
+
+  ZipEntry data;
+  ZipString name;
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  ASSERT_EQ(63, data.offset);
+  ASSERT_EQ(static_cast<uint32_t>(17), data.uncompressed_length);
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, OpenWithIndex) {
+  TemporaryDir tmp_dir;
+  const std::string path = std::string(tmp_dir.path) + "/valid.zip";
+  const std::string index = path + ".idx";
+  CopyValidZip(path);
+
+  AssertOpenWithIndex(path, index, false);
+  ASSERT_EQ(0, access(index.c_str(), F_OK));
+  AssertOpenWithIndex(path, index, true);
+
+  // Iteration and lookups see the same entries through the mapped table.
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(path.c_str(), index.c_str(), &handle));
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, nullptr, nullptr));
+  ZipEntry data;
+  ZipString name;
+  std::vector<std::string> names;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    names.push_back(std::string(reinterpret_cast<const char*>(name.name), name.name_length));
+  }
+  EndIteration(iteration_cookie);
+  CloseArchive(handle);
+  std::sort(names.begin(), names.end());
+  ASSERT_EQ((std::vector<std::string>{"a.txt", "b.txt", "b/", "b/c.txt", "b/d.txt"}), names);
+
+  unlink(index.c_str());
+  unlink(path.c_str());
+}
+
+TEST(ziparchive, OpenWithStaleIndex) {
+  TemporaryDir tmp_dir;
+  const std::string path = std::string(tmp_dir.path) + "/valid.zip";
+  const std::string index = path + ".idx";
+  CopyValidZip(path);
+  AssertOpenWithIndex(path, index, false);
+
+  // A new modification time makes the index stale, and it's rebuilt.
+  struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+  ASSERT_EQ(0, utimensat(AT_FDCWD, path.c_str(), times, 0));
+  AssertOpenWithIndex(path, index, false);
+  AssertOpenWithIndex(path, index, true);
+
+  // As is a truncated one.
+  ASSERT_EQ(0, truncate(index.c_str(), 80));
+  AssertOpenWithIndex(path, index, false);
+  AssertOpenWithIndex(path, index, true);
+
+  unlink(index.c_str());
+  unlink(path.c_str());
+}
+
+TEST(ziparchive, OpenWithCorruptIndex) {
+  TemporaryDir tmp_dir;
+  const std::string path = std::string(tmp_dir.path) + "/valid.zip";
+  const std::string index = path + ".idx";
+  CopyValidZip(path);
+  AssertOpenWithIndex(path, index, false);
+
+  // Point every used slot somewhere that isn't an entry name.
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(index, &contents));
+  ZipStringOffset* table = reinterpret_cast<ZipStringOffset*>(&contents[sizeof(ZipIndexHeader)]);
+  const size_t slots = (contents.size() - sizeof(ZipIndexHeader)) / sizeof(ZipStringOffset);
+  for (size_t i = 0; i < slots; ++i) {
+    if (table[i].name_offset != 0) table[i].name_offset += 1;
+  }
+  ASSERT_TRUE(android::base::WriteStringToFile(contents, index));
+
+  AssertOpenWithIndex(path, index, false);
+  AssertOpenWithIndex(path, index, true);
+
+  unlink(index.c_str());
+  unlink(path.c_str());
+}
+
 class VectorReader : public zip_archive::Reader {
  public:
   VectorReader(const std::vector<uint8_t>& input) : Reader(), input_(input) {}
@@ -724,6 +1037,21 @@ class VectorWriter : public zip_archive::Writer {
   std::vector<uint8_t> output_;
 };
 
+// A Writer that hands out its storage, like ExtractToMemory's.
+class BufferWriter : public zip_archive::Writer {
+ public:
+  explicit BufferWriter(size_t size) : Writer(), output_(size) {}
+
+  bool Append(uint8_t*, size_t) { return false; }
+
+  uint8_t* GetBuffer(size_t length) { return (length == output_.size()) ? output_.data() : nullptr; }
+
+  std::vector<uint8_t>& GetOutput() { return output_; }
+
+ private:
+  std::vector<uint8_t> output_;
+};
+
 class BadReader : public zip_archive::Reader {
  public:
   BadReader() : Reader() {}
@@ -779,6 +1107,64 @@ TEST(ziparchive, Inflate) {
   }
 }
 
+TEST(ziparchive, InflateToBuffer) {
+  const uint32_t compressed_length = kATxtContentsCompressed.size();
+  const uint32_t uncompressed_length = kATxtContents.size();
+  const VectorReader reader(kATxtContentsCompressed);
+
+  {
+    BufferWriter writer(uncompressed_length);
+    uint64_t crc_out = 0;
+    int32_t ret =
+        zip_archive::Inflate(reader, compressed_length, uncompressed_length, &writer, &crc_out);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(kATxtContents, writer.GetOutput());
+    ASSERT_EQ(0x950821C5u, crc_out);
+  }
+
+  // Data that doesn't fit the declared length can't overrun the buffer.
+  {
+    BufferWriter writer(uncompressed_length - 1);
+    int32_t ret =
+        zip_archive::Inflate(reader, compressed_length, uncompressed_length - 1, &writer, nullptr);
+    ASSERT_EQ(kInconsistentInformation, ret);
+  }
+}
+
+class CountingDecompressor : public zip_archive::Decompressor {
+ public:
+  int32_t Inflate(const zip_archive::Reader& reader, uint32_t compressed_length,
+                  uint32_t uncompressed_length, zip_archive::Writer* writer,
+                  uint64_t* crc_out) const {
+    ++calls;
+    return zip_archive::Inflate(reader, compressed_length, uncompressed_length, writer, crc_out);
+  }
+
+  mutable int calls = 0;
+};
+
+TEST(ziparchive, SetDecompressor) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+  CountingDecompressor decompressor;
+  SetDecompressor(handle, &decompressor);
+
+  ZipEntry data;
+  ZipString name;
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  std::vector<uint8_t> buffer(data.uncompressed_length);
+  ASSERT_EQ(0, ExtractToMemory(handle, &data, buffer.data(), buffer.size()));
+  ASSERT_EQ(kATxtContents, buffer);
+  ASSERT_EQ(1, decompressor.calls);
+
+  SetDecompressor(handle, nullptr);
+  ASSERT_EQ(0, ExtractToMemory(handle, &data, buffer.data(), buffer.size()));
+  ASSERT_EQ(1, decompressor.calls);
+
+  CloseArchive(handle);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
@@ -22,7 +22,12 @@
 #include <cstdio>
 #define DEF_MEM_LEVEL 8  // normally in zutil.h?
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "android-base/logging.h"
@@ -82,13 +87,211 @@ static void DeleteZStream(z_stream* stream) {
   delete stream;
 }
 
-ZipWriter::ZipWriter(FILE* f)
+static int InitDeflate(z_stream* stream) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+  int zerr = deflateInit2(stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                          Z_DEFAULT_STRATEGY);
+#pragma GCC diagnostic pop
+
+  if (zerr == Z_VERSION_ERROR) {
+    ALOGE("Installed zlib is not compatible with linked version (%s)", ZLIB_VERSION);
+  } else if (zerr != Z_OK) {
+    ALOGE("deflateInit2 failed (zerr=%d)", zerr);
+  }
+  return zerr;
+}
+
+/*
+ * The entries queued by a ZipWriter with compression threads, and the threads deflating them.
+ *
+ * The data of an entry is cut into blocks that are deflated independently, pigz style: every
+ * block but the last ends with a sync flush, which leaves the output on a byte boundary without
+ * ending the deflate stream, and is primed with the last 32KiB of the data before it. The blocks
+ * of an entry can then be written out one after the other as a single deflate stream, and their
+ * CRCs combined. Stored blocks go through the threads too, for their CRC.
+ *
+ * The queue is only ever touched from the ZipWriter's thread; the lock covers the blocks handed
+ * to the compression threads.
+ */
+struct ZipWriter::Pipeline {
+  // Size of the deflate window, the most of the previous block a block can refer to.
+  static constexpr size_t kDictionarySize = 32768u;
+
+  struct Block {
+    explicit Block(bool compress) : compress(compress) {}
+
+    const bool compress;
+    bool last = false;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> dictionary;
+
+    // Set by the compression thread, then |done| under the lock.
+    std::vector<uint8_t> output;
+    size_t input_size = 0;
+    uint32_t crc32 = 0;
+    bool ok = false;
+    bool done = false;
+  };
+
+  struct Entry {
+    Entry(FileEntry&& file, uint32_t alignment) : file(std::move(file)), alignment(alignment) {}
+
+    FileEntry file;
+    uint32_t alignment;
+    bool header_written = false;
+    bool finished = false;
+    // Queued blocks not written yet, in order.
+    std::deque<std::shared_ptr<Block>> blocks;
+  };
+
+  Pipeline(size_t num_threads, size_t block_size)
+      : block_size(block_size), max_pending_blocks(4 * num_threads) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads_.emplace_back(&Pipeline::Work, this);
+    }
+  }
+
+  ~Pipeline() {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stop_ = true;
+      queue_.clear();
+    }
+    work_cv_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(const std::shared_ptr<Block>& block) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      queue_.push_back(block);
+    }
+    work_cv_.notify_one();
+  }
+
+  bool IsDone(const Block& block) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return block.done;
+  }
+
+  void Wait(const Block& block) {
+    std::unique_lock<std::mutex> lock(lock_);
+    done_cv_.wait(lock, [&block] { return block.done; });
+  }
+
+  const size_t block_size;
+  // How many queued blocks the writer lets pile up before it waits for them. This bounds the
+  // memory held by the queue to a few blocks' worth per thread.
+  const size_t max_pending_blocks;
+  std::deque<Entry> entries;
+  // The block WriteBytes() is filling, not queued yet.
+  std::shared_ptr<Block> current;
+  size_t pending_blocks = 0;
+
+ private:
+  static bool Deflate(z_stream* stream, Block* block);
+  void Work();
+
+  std::mutex lock_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<std::shared_ptr<Block>> queue_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+
+bool ZipWriter::Pipeline::Deflate(z_stream* stream, Block* block) {
+  if (deflateReset(stream) != Z_OK) {
+    return false;
+  }
+  if (!block->dictionary.empty() &&
+      deflateSetDictionary(stream, block->dictionary.data(), block->dictionary.size()) != Z_OK) {
+    return false;
+  }
+
+  const int flush = block->last ? Z_FINISH : Z_SYNC_FLUSH;
+  stream->next_in = block->input.data();
+  stream->avail_in = block->input.size();
+  block->output.resize(deflateBound(stream, block->input.size()) + 16);
+  size_t used = 0;
+  while (true) {
+    stream->next_out = block->output.data() + used;
+    stream->avail_out = block->output.size() - used;
+    int zerr = deflate(stream, flush);
+    used = block->output.size() - stream->avail_out;
+    if (zerr == Z_STREAM_END) {
+      break;
+    }
+    if (zerr != Z_OK && zerr != Z_BUF_ERROR) {
+      ALOGE("deflate failed (zerr=%d)", zerr);
+      return false;
+    }
+    if (!block->last && stream->avail_in == 0 && stream->avail_out != 0) {
+      break;
+    }
+    block->output.resize(2 * block->output.size());
+  }
+  block->output.resize(used);
+  return true;
+}
+
+void ZipWriter::Pipeline::Work() {
+  z_stream stream = {};
+  const bool ready = (InitDeflate(&stream) == Z_OK);
+
+  while (true) {
+    std::shared_ptr<Block> block;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      work_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        break;
+      }
+      block = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    block->input_size = block->input.size();
+    block->crc32 = crc32(0, block->input.data(), block->input.size());
+    if (!block->compress) {
+      block->output = std::move(block->input);
+      block->ok = true;
+    } else {
+      block->ok = ready && Deflate(&stream, block.get());
+    }
+    std::vector<uint8_t>().swap(block->input);
+    std::vector<uint8_t>().swap(block->dictionary);
+
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      block->done = true;
+    }
+    done_cv_.notify_all();
+  }
+
+  if (ready) {
+    deflateEnd(&stream);
+  }
+}
+
+ZipWriter::ZipWriter(FILE* f) : ZipWriter(f, Options()) {}
+
+ZipWriter::ZipWriter(FILE* f, const Options& options)
     : file_(f),
       seekable_(false),
       current_offset_(0),
       state_(State::kWritingZip),
       z_stream_(nullptr, DeleteZStream),
-      buffer_(kBufSize) {
+      buffer_(kBufSize),
+      output_(options.output_buffer_size),
+      output_used_(0) {
+  if (options.compression_threads != 0) {
+    CHECK_GT(options.block_size, 0u);
+    pipeline_.reset(new Pipeline(options.compression_threads, options.block_size));
+  }
   // Check if the file is seekable (regular file). If fstat fails, that's fine, subsequent calls
   // will fail as well.
   struct stat file_stats;
@@ -104,7 +307,10 @@ ZipWriter::ZipWriter(ZipWriter&& writer)
       state_(writer.state_),
       files_(std::move(writer.files_)),
       z_stream_(std::move(writer.z_stream_)),
-      buffer_(std::move(writer.buffer_)) {
+      buffer_(std::move(writer.buffer_)),
+      output_(std::move(writer.output_)),
+      output_used_(writer.output_used_),
+      pipeline_(std::move(writer.pipeline_)) {
   writer.file_ = nullptr;
   writer.state_ = State::kError;
 }
@@ -117,11 +323,16 @@ ZipWriter& ZipWriter::operator=(ZipWriter&& writer) {
   files_ = std::move(writer.files_);
   z_stream_ = std::move(writer.z_stream_);
   buffer_ = std::move(writer.buffer_);
+  output_ = std::move(writer.output_);
+  output_used_ = writer.output_used_;
+  pipeline_ = std::move(writer.pipeline_);
   writer.file_ = nullptr;
   writer.state_ = State::kError;
   return *this;
 }
 
+ZipWriter::~ZipWriter() {}
+
 int32_t ZipWriter::HandleError(int32_t error_code) {
   state_ = State::kError;
   z_stream_.reset();
@@ -221,9 +432,11 @@ int32_t ZipWriter::StartAlignedEntryWithTime(const char* path, size_t flags, tim
   if (flags & ZipWriter::kCompress) {
     file_entry.compression_method = kCompressDeflated;
 
-    int32_t result = PrepareDeflate();
-    if (result != kNoError) {
-      return result;
+    if (!pipeline_) {
+      int32_t result = PrepareDeflate();
+      if (result != kNoError) {
+        return result;
+      }
     }
   } else {
     file_entry.compression_method = kCompressStored;
@@ -231,12 +444,34 @@ int32_t ZipWriter::StartAlignedEntryWithTime(const char* path, size_t flags, tim
 
   ExtractTimeAndDate(time, &file_entry.last_mod_time, &file_entry.last_mod_date);
 
-  off_t offset = current_offset_ + sizeof(LocalFileHeader) + file_entry.path.size();
+  if (pipeline_) {
+    // The header is written once the entries before it are, when its offset is known.
+    bool compress = (file_entry.compression_method == kCompressDeflated);
+    pipeline_->entries.emplace_back(std::move(file_entry), alignment);
+    pipeline_->current = std::make_shared<Pipeline::Block>(compress);
+    state_ = State::kWritingEntry;
+    return kNoError;
+  }
+
+  int32_t result = WriteLocalFileHeader(&file_entry, alignment);
+  if (result != kNoError) {
+    return result;
+  }
+
+  current_file_entry_ = std::move(file_entry);
+  state_ = State::kWritingEntry;
+  return kNoError;
+}
+
+int32_t ZipWriter::WriteLocalFileHeader(FileEntry* file, uint32_t alignment) {
+  file->local_file_header_offset = current_offset_;
+
+  off_t offset = current_offset_ + sizeof(LocalFileHeader) + file->path.size();
   std::vector<char> zero_padding;
   if (alignment != 0 && (offset & (alignment - 1))) {
     // Pad the extra field so the data will be aligned.
     uint16_t padding = alignment - (offset % alignment);
-    file_entry.padding_length = padding;
+    file->padding_length = padding;
     offset += padding;
     zero_padding.resize(padding, 0);
   }
@@ -244,29 +479,74 @@ int32_t ZipWriter::StartAlignedEntryWithTime(const char* path, size_t flags, tim
   LocalFileHeader header = {};
   // Always start expecting a data descriptor. When the data has finished being written,
   // if it is possible to seek back, the GPB flag will reset and the sizes written.
-  CopyFromFileEntry(file_entry, true /*use_data_descriptor*/, &header);
+  CopyFromFileEntry(*file, true /*use_data_descriptor*/, &header);
 
-  if (fwrite(&header, sizeof(header), 1, file_) != 1) {
-    return HandleError(kIoError);
+  int32_t result = Write(&header, sizeof(header));
+  if (result == kNoError) {
+    result = Write(file->path.data(), file->path.size());
+  }
+  if (result == kNoError) {
+    result = Write(zero_padding.data(), zero_padding.size());
+  }
+  if (result != kNoError) {
+    return result;
   }
 
-  if (fwrite(path, sizeof(*path), file_entry.path.size(), file_) != file_entry.path.size()) {
-    return HandleError(kIoError);
+  current_offset_ = offset;
+  return kNoError;
+}
+
+int32_t ZipWriter::Write(const void* data, size_t len) {
+  if (len == 0) {
+    return kNoError;
+  }
+  if (output_.empty()) {
+    if (fwrite(data, 1, len, file_) != len) {
+      return HandleError(kIoError);
+    }
+    return kNoError;
   }
 
-  if (file_entry.padding_length != 0 && fwrite(zero_padding.data(), 1, file_entry.padding_length,
-                                               file_) != file_entry.padding_length) {
-    return HandleError(kIoError);
+  if (output_used_ + len > output_.size()) {
+    int32_t result = FlushOutput();
+    if (result != kNoError) {
+      return result;
+    }
+  }
+  if (len >= output_.size()) {
+    if (fwrite(data, 1, len, file_) != len) {
+      return HandleError(kIoError);
+    }
+  } else {
+    memcpy(output_.data() + output_used_, data, len);
+    output_used_ += len;
   }
+  return kNoError;
+}
 
-  current_file_entry_ = std::move(file_entry);
-  current_offset_ = offset;
-  state_ = State::kWritingEntry;
+int32_t ZipWriter::FlushOutput() {
+  if (output_used_ != 0) {
+    if (fwrite(output_.data(), 1, output_used_, file_) != output_used_) {
+      return HandleError(kIoError);
+    }
+    output_used_ = 0;
+  }
   return kNoError;
 }
 
 int32_t ZipWriter::DiscardLastEntry() {
-  if (state_ != State::kWritingZip || files_.empty()) {
+  if (state_ != State::kWritingZip) {
+    return kInvalidState;
+  }
+
+  int32_t result = pipeline_ ? WritePipeline(0) : kNoError;
+  if (result == kNoError) {
+    result = FlushOutput();
+  }
+  if (result != kNoError) {
+    return result;
+  }
+  if (files_.empty()) {
     return kInvalidState;
   }
 
@@ -282,6 +562,12 @@ int32_t ZipWriter::DiscardLastEntry() {
 int32_t ZipWriter::GetLastEntry(FileEntry* out_entry) {
   CHECK(out_entry != nullptr);
 
+  if (pipeline_ && (state_ == State::kWritingZip || state_ == State::kWritingEntry)) {
+    int32_t result = WritePipeline(0);
+    if (result != kNoError) {
+      return result;
+    }
+  }
   if (files_.empty()) {
     return kInvalidState;
   }
@@ -295,20 +581,8 @@ int32_t ZipWriter::PrepareDeflate() {
   // Initialize the z_stream for compression.
   z_stream_ = std::unique_ptr<z_stream, void (*)(z_stream*)>(new z_stream(), DeleteZStream);
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wold-style-cast"
-  int zerr = deflateInit2(z_stream_.get(), Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
-                          DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-#pragma GCC diagnostic pop
-
-  if (zerr != Z_OK) {
-    if (zerr == Z_VERSION_ERROR) {
-      ALOGE("Installed zlib is not compatible with linked version (%s)", ZLIB_VERSION);
-      return HandleError(kZlibError);
-    } else {
-      ALOGE("deflateInit2 failed (zerr=%d)", zerr);
-      return HandleError(kZlibError);
-    }
+  if (InitDeflate(z_stream_.get()) != Z_OK) {
+    return HandleError(kZlibError);
   }
 
   z_stream_->next_out = buffer_.data();
@@ -321,6 +595,10 @@ int32_t ZipWriter::WriteBytes(const void* data, size_t len) {
     return HandleError(kInvalidState);
   }
 
+  if (pipeline_) {
+    return QueueBytes(data, len);
+  }
+
   int32_t result = kNoError;
   if (current_file_entry_.compression_method & kCompressDeflated) {
     result = CompressBytes(&current_file_entry_, data, len);
@@ -341,8 +619,9 @@ int32_t ZipWriter::WriteBytes(const void* data, size_t len) {
 int32_t ZipWriter::StoreBytes(FileEntry* file, const void* data, size_t len) {
   CHECK(state_ == State::kWritingEntry);
 
-  if (fwrite(data, 1, len, file_) != len) {
-    return HandleError(kIoError);
+  int32_t result = Write(data, len);
+  if (result != kNoError) {
+    return result;
   }
   file->compressed_size += len;
   current_offset_ += len;
@@ -369,8 +648,9 @@ int32_t ZipWriter::CompressBytes(FileEntry* file, const void* data, size_t len)
     if (z_stream_->avail_out == 0) {
       // The output is full, let's write it to disk.
       size_t write_bytes = z_stream_->next_out - buffer_.data();
-      if (fwrite(buffer_.data(), 1, write_bytes, file_) != write_bytes) {
-        return HandleError(kIoError);
+      int32_t result = Write(buffer_.data(), write_bytes);
+      if (result != kNoError) {
+        return result;
       }
       file->compressed_size += write_bytes;
       current_offset_ += write_bytes;
@@ -395,8 +675,9 @@ int32_t ZipWriter::FlushCompressedBytes(FileEntry* file) {
   while ((zerr = deflate(z_stream_.get(), Z_FINISH)) == Z_OK) {
     CHECK(z_stream_->avail_out == 0);
     size_t write_bytes = z_stream_->next_out - buffer_.data();
-    if (fwrite(buffer_.data(), 1, write_bytes, file_) != write_bytes) {
-      return HandleError(kIoError);
+    int32_t result = Write(buffer_.data(), write_bytes);
+    if (result != kNoError) {
+      return result;
     }
     file->compressed_size += write_bytes;
     current_offset_ += write_bytes;
@@ -410,8 +691,9 @@ int32_t ZipWriter::FlushCompressedBytes(FileEntry* file) {
 
   size_t write_bytes = z_stream_->next_out - buffer_.data();
   if (write_bytes != 0) {
-    if (fwrite(buffer_.data(), 1, write_bytes, file_) != write_bytes) {
-      return HandleError(kIoError);
+    int32_t result = Write(buffer_.data(), write_bytes);
+    if (result != kNoError) {
+      return result;
     }
     file->compressed_size += write_bytes;
     current_offset_ += write_bytes;
@@ -425,6 +707,16 @@ int32_t ZipWriter::FinishEntry() {
     return kInvalidState;
   }
 
+  if (pipeline_) {
+    int32_t result = QueueBlock(true /*last*/);
+    if (result != kNoError) {
+      return result;
+    }
+    pipeline_->entries.back().finished = true;
+    state_ = State::kWritingZip;
+    return WritePipeline(pipeline_->max_pending_blocks);
+  }
+
   if (current_file_entry_.compression_method & kCompressDeflated) {
     int32_t result = FlushCompressedBytes(&current_file_entry_);
     if (result != kNoError) {
@@ -432,42 +724,154 @@ int32_t ZipWriter::FinishEntry() {
     }
   }
 
-  if ((current_file_entry_.compression_method & kCompressDeflated) || !seekable_) {
+  int32_t result = WriteEntryTrailer(&current_file_entry_);
+  if (result != kNoError) {
+    return result;
+  }
+
+  files_.emplace_back(std::move(current_file_entry_));
+  state_ = State::kWritingZip;
+  return kNoError;
+}
+
+int32_t ZipWriter::WriteEntryTrailer(FileEntry* file) {
+  if ((file->compression_method & kCompressDeflated) || !seekable_) {
     // Some versions of ZIP don't allow STORED data to have a trailing DataDescriptor.
     // If this file is not seekable, or if the data is compressed, write a DataDescriptor.
     const uint32_t sig = DataDescriptor::kOptSignature;
-    if (fwrite(&sig, sizeof(sig), 1, file_) != 1) {
-      return HandleError(kIoError);
+    int32_t result = Write(&sig, sizeof(sig));
+    if (result != kNoError) {
+      return result;
     }
 
     DataDescriptor dd = {};
-    dd.crc32 = current_file_entry_.crc32;
-    dd.compressed_size = current_file_entry_.compressed_size;
-    dd.uncompressed_size = current_file_entry_.uncompressed_size;
-    if (fwrite(&dd, sizeof(dd), 1, file_) != 1) {
-      return HandleError(kIoError);
+    dd.crc32 = file->crc32;
+    dd.compressed_size = file->compressed_size;
+    dd.uncompressed_size = file->uncompressed_size;
+    result = Write(&dd, sizeof(dd));
+    if (result != kNoError) {
+      return result;
     }
     current_offset_ += sizeof(DataDescriptor::kOptSignature) + sizeof(dd);
-  } else {
-    // Seek back to the header and rewrite to include the size.
-    if (fseeko(file_, current_file_entry_.local_file_header_offset, SEEK_SET) != 0) {
-      return HandleError(kIoError);
-    }
+    return kNoError;
+  }
 
-    LocalFileHeader header = {};
-    CopyFromFileEntry(current_file_entry_, false /*use_data_descriptor*/, &header);
+  LocalFileHeader header = {};
+  CopyFromFileEntry(*file, false /*use_data_descriptor*/, &header);
 
-    if (fwrite(&header, sizeof(header), 1, file_) != 1) {
-      return HandleError(kIoError);
+  // If the header is still in the output buffer, rewrite it there.
+  off64_t output_offset = current_offset_ - output_used_;
+  if (file->local_file_header_offset >= output_offset) {
+    memcpy(output_.data() + (file->local_file_header_offset - output_offset), &header,
+           sizeof(header));
+    return kNoError;
+  }
+
+  // Seek back to the header and rewrite to include the size.
+  int32_t result = FlushOutput();
+  if (result != kNoError) {
+    return result;
+  }
+  if (fseeko(file_, file->local_file_header_offset, SEEK_SET) != 0) {
+    return HandleError(kIoError);
+  }
+
+  if (fwrite(&header, sizeof(header), 1, file_) != 1) {
+    return HandleError(kIoError);
+  }
+
+  if (fseeko(file_, current_offset_, SEEK_SET) != 0) {
+    return HandleError(kIoError);
+  }
+  return kNoError;
+}
+
+int32_t ZipWriter::QueueBytes(const void* data, size_t len) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  while (len > 0) {
+    std::vector<uint8_t>& input = pipeline_->current->input;
+    size_t count = std::min(len, pipeline_->block_size - input.size());
+    input.insert(input.end(), bytes, bytes + count);
+    bytes += count;
+    len -= count;
+
+    if (input.size() == pipeline_->block_size) {
+      int32_t result = QueueBlock(false /*last*/);
+      if (result != kNoError) {
+        return result;
+      }
     }
+  }
+  return kNoError;
+}
 
-    if (fseeko(file_, current_offset_, SEEK_SET) != 0) {
-      return HandleError(kIoError);
+int32_t ZipWriter::QueueBlock(bool last) {
+  std::shared_ptr<Pipeline::Block> block = std::move(pipeline_->current);
+  block->last = last;
+  if (!last) {
+    pipeline_->current = std::make_shared<Pipeline::Block>(block->compress);
+    if (block->compress) {
+      size_t dictionary_size = std::min(block->input.size(), Pipeline::kDictionarySize);
+      pipeline_->current->dictionary.assign(block->input.end() - dictionary_size,
+                                            block->input.end());
     }
   }
 
-  files_.emplace_back(std::move(current_file_entry_));
-  state_ = State::kWritingZip;
+  pipeline_->entries.back().blocks.push_back(block);
+  pipeline_->pending_blocks++;
+  pipeline_->Submit(block);
+  return WritePipeline(pipeline_->max_pending_blocks);
+}
+
+/*
+ * Writes out the queued entries, in order, as far as their blocks have been deflated. Waits for
+ * the blocks when more than |max_pending_blocks| are queued, so 0 writes everything queued.
+ */
+int32_t ZipWriter::WritePipeline(size_t max_pending_blocks) {
+  while (!pipeline_->entries.empty()) {
+    Pipeline::Entry& entry = pipeline_->entries.front();
+    if (!entry.header_written) {
+      int32_t result = WriteLocalFileHeader(&entry.file, entry.alignment);
+      if (result != kNoError) {
+        return result;
+      }
+      entry.header_written = true;
+    }
+
+    while (!entry.blocks.empty()) {
+      const Pipeline::Block& block = *entry.blocks.front();
+      if (!pipeline_->IsDone(block)) {
+        if (pipeline_->pending_blocks <= max_pending_blocks) {
+          return kNoError;
+        }
+        pipeline_->Wait(block);
+      }
+      if (!block.ok) {
+        return HandleError(kZlibError);
+      }
+
+      int32_t result = Write(block.output.data(), block.output.size());
+      if (result != kNoError) {
+        return result;
+      }
+      entry.file.crc32 = crc32_combine(entry.file.crc32, block.crc32, block.input_size);
+      entry.file.compressed_size += block.output.size();
+      entry.file.uncompressed_size += block.input_size;
+      current_offset_ += block.output.size();
+      entry.blocks.pop_front();
+      pipeline_->pending_blocks--;
+    }
+
+    if (!entry.finished) {
+      return kNoError;
+    }
+    int32_t result = WriteEntryTrailer(&entry.file);
+    if (result != kNoError) {
+      return result;
+    }
+    files_.emplace_back(std::move(entry.file));
+    pipeline_->entries.pop_front();
+  }
   return kNoError;
 }
 
@@ -476,6 +880,13 @@ int32_t ZipWriter::Finish() {
     return kInvalidState;
   }
 
+  if (pipeline_) {
+    int32_t result = WritePipeline(0);
+    if (result != kNoError) {
+      return result;
+    }
+  }
+
   off_t startOfCdr = current_offset_;
   for (FileEntry& file : files_) {
     CentralDirectoryRecord cdr = {};
@@ -491,12 +902,12 @@ int32_t ZipWriter::Finish() {
     cdr.uncompressed_size = file.uncompressed_size;
     cdr.file_name_length = file.path.size();
     cdr.local_file_header_offset = static_cast<uint32_t>(file.local_file_header_offset);
-    if (fwrite(&cdr, sizeof(cdr), 1, file_) != 1) {
-      return HandleError(kIoError);
+    int32_t result = Write(&cdr, sizeof(cdr));
+    if (result == kNoError) {
+      result = Write(file.path.data(), file.path.size());
     }
-
-    if (fwrite(file.path.data(), 1, file.path.size(), file_) != file.path.size()) {
-      return HandleError(kIoError);
+    if (result != kNoError) {
+      return result;
     }
 
     current_offset_ += sizeof(cdr) + file.path.size();
@@ -511,8 +922,12 @@ int32_t ZipWriter::Finish() {
   er.cd_size = current_offset_ - startOfCdr;
   er.cd_start_offset = startOfCdr;
 
-  if (fwrite(&er, sizeof(er), 1, file_) != 1) {
-    return HandleError(kIoError);
+  int32_t result = Write(&er, sizeof(er));
+  if (result == kNoError) {
+    result = FlushOutput();
+  }
+  if (result != kNoError) {
+    return result;
   }
 
   current_offset_ += sizeof(er);
@@ -17,10 +17,13 @@
 #include "ziparchive/zip_writer.h"
 #include "ziparchive/zip_archive.h"
 
+#include <android-base/file.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 #include <time.h>
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <vector>
 
 static ::testing::AssertionResult AssertFileEntryContentsEq(const std::string& expected,
@@ -378,6 +381,138 @@ TEST_F(zipwriter, TruncateFileAfterBackup) {
   ASSERT_GT(before_len, after_len);
 }
 
+static std::vector<uint8_t> CompressibleData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (i % 251) ^ (i / 4099);
+  }
+  return data;
+}
+
+static void WriteZipWithThreads(FILE* file, const ZipWriter::Options& options,
+                                const std::vector<uint8_t>& large) {
+  ZipWriter writer(file, options);
+
+  ASSERT_EQ(0, writer.StartEntry("small.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.WriteBytes("small", 5));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartEntry("large.bin", ZipWriter::kCompress));
+  for (size_t i = 0; i < large.size(); i += 10000) {
+    ASSERT_EQ(0, writer.WriteBytes(large.data() + i, std::min<size_t>(10000, large.size() - i)));
+  }
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartEntry("empty.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartAlignedEntry("stored.bin", 0, 4096));
+  ASSERT_EQ(0, writer.WriteBytes(large.data(), 50000));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.Finish());
+}
+
+TEST_F(zipwriter, WriteZipWithCompressionThreads) {
+  ZipWriter::Options options;
+  options.compression_threads = 3;
+  options.block_size = 16384;
+  options.output_buffer_size = 65536;
+  std::vector<uint8_t> large = CompressibleData(1000000);
+  WriteZipWithThreads(file_, options, large);
+  ASSERT_EQ(0, fflush(file_));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFd(fd_, "temp", &handle, false));
+
+  ZipEntry data;
+  ASSERT_EQ(0, FindEntry(handle, ZipString("small.txt"), &data));
+  EXPECT_EQ(kCompressDeflated, data.method);
+  ASSERT_TRUE(AssertFileEntryContentsEq("small", handle, &data));
+  off64_t previous_offset = data.offset;
+
+  ASSERT_EQ(0, FindEntry(handle, ZipString("large.bin"), &data));
+  EXPECT_EQ(kCompressDeflated, data.method);
+  EXPECT_GT(data.offset, previous_offset);
+  previous_offset = data.offset;
+  ASSERT_EQ(large.size(), data.uncompressed_length);
+  EXPECT_LT(data.compressed_length, large.size() / 4);
+  std::vector<uint8_t> decompress(large.size());
+  ASSERT_EQ(0, ExtractToMemory(handle, &data, decompress.data(), decompress.size()));
+  EXPECT_TRUE(decompress == large);
+
+  ASSERT_EQ(0, FindEntry(handle, ZipString("empty.txt"), &data));
+  EXPECT_GT(data.offset, previous_offset);
+  previous_offset = data.offset;
+  ASSERT_TRUE(AssertFileEntryContentsEq("", handle, &data));
+
+  ASSERT_EQ(0, FindEntry(handle, ZipString("stored.bin"), &data));
+  EXPECT_EQ(kCompressStored, data.method);
+  EXPECT_EQ(0u, data.has_data_descriptor);
+  EXPECT_GT(data.offset, previous_offset);
+  EXPECT_EQ(0, data.offset & 4095);
+  ASSERT_TRUE(AssertFileEntryContentsEq(
+      std::string(reinterpret_cast<const char*>(large.data()), 50000), handle, &data));
+
+  CloseArchive(handle);
+}
+
+TEST_F(zipwriter, WriteZipWithCompressionThreadsIsDeterministic) {
+  ZipWriter::Options options;
+  options.compression_threads = 4;
+  options.block_size = 4096;
+  std::vector<uint8_t> large = CompressibleData(300000);
+  WriteZipWithThreads(file_, options, large);
+  ASSERT_EQ(0, fflush(file_));
+
+  TemporaryFile other_file;
+  FILE* other = fdopen(other_file.fd, "w");
+  ASSERT_NE(other, nullptr);
+  options.compression_threads = 1;
+  WriteZipWithThreads(other, options, large);
+  ASSERT_EQ(0, fflush(other));
+
+  std::string expected;
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFileToString(temp_file_->path, &expected));
+  ASSERT_TRUE(android::base::ReadFileToString(other_file.path, &actual));
+  EXPECT_TRUE(expected == actual);
+  fclose(other);
+}
+
+TEST_F(zipwriter, BackupRemovesTheLastFileWithCompressionThreads) {
+  ZipWriter::Options options;
+  options.compression_threads = 2;
+  options.output_buffer_size = 4096;
+  ZipWriter writer(file_, options);
+
+  ASSERT_EQ(0, writer.StartEntry("keep.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.WriteBytes("keep this", 9));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartEntry("drop.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.WriteBytes("drop this", 9));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ZipWriter::FileEntry entry;
+  ASSERT_EQ(0, writer.GetLastEntry(&entry));
+  EXPECT_EQ("drop.txt", entry.path);
+  ASSERT_EQ(0, writer.DiscardLastEntry());
+  ASSERT_EQ(0, writer.GetLastEntry(&entry));
+  EXPECT_EQ("keep.txt", entry.path);
+  ASSERT_EQ(0, writer.Finish());
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFd(fd_, "temp", &handle, false));
+
+  ZipEntry data;
+  ASSERT_EQ(0, FindEntry(handle, ZipString("keep.txt"), &data));
+  ASSERT_TRUE(AssertFileEntryContentsEq("keep this", handle, &data));
+  ASSERT_NE(0, FindEntry(handle, ZipString("drop.txt"), &data));
+
+  CloseArchive(handle);
+}
+
 static ::testing::AssertionResult AssertFileEntryContentsEq(const std::string& expected,
                                                             ZipArchiveHandle handle,
                                                             ZipEntry* zip_entry) {
@@ -29,6 +29,7 @@
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -41,6 +42,8 @@
 #include <log/log.h>
 #include <system/thread_defs.h>
 
+#include "lmkd_policy.h"
+
 #ifdef LMKD_LOG_STATS
 #include "statslog.h"
 #endif
@@ -68,11 +71,24 @@
 #define __unused __attribute__((__unused__))
 #endif
 
+/* Same on all architectures, but missing from older kernel headers */
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+#ifndef __NR_process_mrelease
+#define __NR_process_mrelease 448
+#endif
+
 #define MEMCG_SYSFS_PATH "/dev/memcg/"
 #define MEMCG_MEMORY_USAGE "/dev/memcg/memory.usage_in_bytes"
 #define MEMCG_MEMORYSW_USAGE "/dev/memcg/memory.memsw.usage_in_bytes"
+#define MEMCG_PROC_MEMORY_STAT MEMCG_SYSFS_PATH "apps/uid_%u/pid_%d/memory.stat"
 #define ZONEINFO_PATH "/proc/zoneinfo"
 #define MEMINFO_PATH "/proc/meminfo"
+#define PSI_MEMORY_PATH "/proc/pressure/memory"
 #define LINE_MAX 128
 
 #define INKERNEL_MINFREE_PATH "/sys/module/lowmemorykiller/parameters/minfree"
@@ -86,40 +102,42 @@
 
 #define FAIL_REPORT_RLIMIT_MS 1000
 
+/* psi averages further apart than this are not compared to find a trend */
+#define PSI_TREND_MAX_INTERVAL_MS 10000
+
+/* most processes killed for one memory pressure event */
+#define MAX_KILL_BATCH 16
+
 /* default to old in-kernel interface if no memory pressure events */
 static int use_inkernel_interface = 1;
 static bool has_inkernel_module;
 
-/* memory pressure levels */
-enum vmpressure_level {
-    VMPRESS_LEVEL_LOW = 0,
-    VMPRESS_LEVEL_MEDIUM,
-    VMPRESS_LEVEL_CRITICAL,
-    VMPRESS_LEVEL_COUNT
-};
-
-static const char *level_name[] = {
-    "low",
-    "medium",
-    "critical"
-};
+static struct lmk_policy_params policy_params;
+static struct lmk_policy_state policy_state = LMK_POLICY_STATE_INIT;
 
-struct {
-    int64_t min_nr_free_pages; /* recorded but not used yet */
-    int64_t max_nr_free_pages;
-} low_pressure_mem = { -1, -1 };
-
-static int level_oomadj[VMPRESS_LEVEL_COUNT];
 static int mpevfd[VMPRESS_LEVEL_COUNT] = { -1, -1, -1 };
 static bool debug_process_killing;
-static bool enable_pressure_upgrade;
-static int64_t upgrade_pressure;
-static int64_t downgrade_pressure;
-static bool low_ram_device;
 static bool kill_heaviest_task;
 static unsigned long kill_timeout_ms;
-static bool use_minfree_levels;
 static bool per_app_memcg;
+static bool use_memcg_size;
+static int kill_batch_size;
+static bool use_mrelease;
+static bool use_psi_monitors;
+static int psi_window_ms;
+static int psi_trend_upgrade;
+
+/*
+ * psi monitors used in place of vmpressure events: the type of stall watched
+ * for each level and how long tasks must stall in a window to trigger it.
+ */
+static const char *psi_stall_type[VMPRESS_LEVEL_COUNT] = {
+    "some",
+    "some",
+    "full"
+};
+static int psi_threshold_ms[VMPRESS_LEVEL_COUNT];
+static int psifd[VMPRESS_LEVEL_COUNT] = { -1, -1, -1 };
 
 /* data required to handle events */
 struct event_handler_info {
@@ -140,22 +158,22 @@ struct sock_event_handler_info {
 static struct sock_event_handler_info ctrl_sock;
 static struct sock_event_handler_info data_sock[MAX_DATA_CONN];
 
-/* vmpressure event handler data */
+/* vmpressure or psi event handler data */
 static struct event_handler_info vmpressure_hinfo[VMPRESS_LEVEL_COUNT];
 
-/* 3 memory pressure levels, 1 ctrl listen socket, 2 ctrl data socket */
-#define MAX_EPOLL_EVENTS (1 + MAX_DATA_CONN + VMPRESS_LEVEL_COUNT)
+/* pidfd of the last killed process, readable once it has exited */
+static struct event_handler_info kill_done_hinfo;
+static int last_kill_pidfd = -1;
+static bool pidfd_supported;
+
+/*
+ * 3 memory pressure levels, 1 ctrl listen socket, 2 ctrl data socket,
+ * 1 killed process
+ */
+#define MAX_EPOLL_EVENTS (1 + MAX_DATA_CONN + VMPRESS_LEVEL_COUNT + 1)
 static int epollfd;
 static int maxevents;
 
-/* OOM score values used by both kernel and framework */
-#define OOM_SCORE_ADJ_MIN       (-1000)
-#define OOM_SCORE_ADJ_MAX       1000
-
-static int lowmem_adj[MAX_TARGETS];
-static int lowmem_minfree[MAX_TARGETS];
-static int lowmem_targets_size;
-
 /* Fields to parse in /proc/zoneinfo */
 enum zoneinfo_field {
     ZI_NR_FREE_PAGES = 0,
@@ -236,6 +254,21 @@ enum field_match_result {
     PARSE_SUCCESS
 };
 
+/*
+ * The lines of /proc/meminfo and /proc/zoneinfo keep their order while the
+ * system runs, so the field found on each line is remembered. Lines that hold
+ * none of the fields are then skipped without being tokenized, and a line
+ * that no longer holds its field makes the whole file be parsed again.
+ */
+#define MAX_CACHED_LINES 1024
+#define LINE_FIELD_NONE (-1)
+
+struct line_field_cache {
+    bool valid;
+    int line_count;
+    int8_t fields[MAX_CACHED_LINES];
+};
+
 struct adjslot_list {
     struct adjslot_list *next;
     struct adjslot_list *prev;
@@ -246,6 +279,18 @@ struct proc {
     int pid;
     uid_t uid;
     int oomadj;
+    /*
+     * size in pages when last read, to rank kill candidates: the rss, or
+     * anon + swap of the process memcg with ro.lmk.use_memcg_size
+     */
+    int size;
+    struct timeval size_tm;
+    /* pages of the process memcg when size was last read from it */
+    int64_t anon;
+    int64_t file;
+    int64_t swap;
+    /* chosen as a victim by the kill being planned */
+    bool planned;
     struct proc *pidhash_next;
 };
 
@@ -269,6 +314,18 @@ static struct adjslot_list procadjslot_list[ADJTOSLOT(OOM_SCORE_ADJ_MAX) + 1];
 /* PAGE_SIZE / 1024 */
 static long page_k;
 
+static inline unsigned long get_time_diff_ms(struct timeval *from,
+                                             struct timeval *to) {
+    return (to->tv_sec - from->tv_sec) * 1000 +
+           (to->tv_usec - from->tv_usec) / 1000;
+}
+
+static inline long get_time_diff_us(struct timespec *from,
+                                    struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000000 +
+           (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
 static bool parse_int64(const char* str, int64_t* ret) {
     char* endptr;
     long long val = strtoll(str, &endptr, 10);
@@ -467,7 +524,7 @@ static void cmd_procprio(LMKD_CTRL_PACKET packet) {
     if (use_inkernel_interface)
         return;
 
-    if (low_ram_device) {
+    if (policy_params.low_ram_device) {
         if (params.oomadj >= 900) {
             soft_limit_mult = 0;
         } else if (params.oomadj >= 800) {
@@ -514,6 +571,9 @@ static void cmd_procprio(LMKD_CTRL_PACKET packet) {
             procp->pid = params.pid;
             procp->uid = params.uid;
             procp->oomadj = params.oomadj;
+            procp->size = 0;
+            procp->anon = procp->file = procp->swap = 0;
+            procp->planned = false;
             proc_insert(procp);
     } else {
         proc_unslot(procp);
@@ -565,16 +625,16 @@ static void cmd_target(int ntargets, LMKD_CTRL_PACKET packet) {
     int i;
     struct lmk_target target;
 
-    if (ntargets > (int)ARRAY_SIZE(lowmem_adj))
+    if (ntargets > (int)ARRAY_SIZE(policy_params.lowmem_adj))
         return;
 
     for (i = 0; i < ntargets; i++) {
         lmkd_pack_get_target(packet, i, &target);
-        lowmem_minfree[i] = target.minfree;
-        lowmem_adj[i] = target.oom_adj_score;
+        policy_params.lowmem_minfree[i] = target.minfree;
+        policy_params.lowmem_adj[i] = target.oom_adj_score;
     }
 
-    lowmem_targets_size = ntargets;
+    policy_params.lowmem_targets_size = ntargets;
 
     if (has_inkernel_module) {
         char minfreestr[128];
@@ -583,7 +643,7 @@ static void cmd_target(int ntargets, LMKD_CTRL_PACKET packet) {
         minfreestr[0] = '\0';
         killpriostr[0] = '\0';
 
-        for (i = 0; i < lowmem_targets_size; i++) {
+        for (i = 0; i < policy_params.lowmem_targets_size; i++) {
             char val[40];
 
             if (i) {
@@ -591,9 +651,11 @@ static void cmd_target(int ntargets, LMKD_CTRL_PACKET packet) {
                 strlcat(killpriostr, ",", sizeof(killpriostr));
             }
 
-            snprintf(val, sizeof(val), "%d", use_inkernel_interface ? lowmem_minfree[i] : 0);
+            snprintf(val, sizeof(val), "%d",
+                     use_inkernel_interface ? policy_params.lowmem_minfree[i] : 0);
             strlcat(minfreestr, val, sizeof(minfreestr));
-            snprintf(val, sizeof(val), "%d", use_inkernel_interface ? lowmem_adj[i] : 0);
+            snprintf(val, sizeof(val), "%d",
+                     use_inkernel_interface ? policy_params.lowmem_adj[i] : 0);
             strlcat(killpriostr, val, sizeof(killpriostr));
         }
 
@@ -655,7 +717,7 @@ static void ctrl_command_handler(int dsock_idx) {
     switch(cmd) {
     case LMK_TARGET:
         targets = nargs / 2;
-        if (nargs & 0x1 || targets > (int)ARRAY_SIZE(lowmem_adj))
+        if (nargs & 0x1 || targets > (int)ARRAY_SIZE(policy_params.lowmem_adj))
             goto wronglen;
         cmd_target(targets, packet);
         break;
@@ -837,13 +899,17 @@ static int64_t zoneinfo_parse_protection(char *cp) {
     return max;
 }
 
-static bool zoneinfo_parse_line(char *line, union zoneinfo *zi) {
+/* Pseudo field of zoneinfo lines that hold the lowmem reserve protection. */
+#define ZI_PROTECTION ZI_FIELD_COUNT
+
+static bool zoneinfo_parse_line(char *line, union zoneinfo *zi, int *line_field) {
     char *cp = line;
     char *ap;
     char *save_ptr;
     int64_t val;
     int field_idx;
 
+    *line_field = LINE_FIELD_NONE;
     cp = strtok_r(line, " ", &save_ptr);
     if (!cp) {
         return true;
@@ -863,11 +929,13 @@ static bool zoneinfo_parse_line(char *line, union zoneinfo *zi) {
                         ZI_FIELD_COUNT, &val, &field_idx)) {
     case (PARSE_SUCCESS):
         zi->arr[field_idx] += val;
+        *line_field = field_idx;
         break;
     case (NO_MATCH):
         if (!strcmp(cp, "protection:")) {
             zi->field.totalreserve_pages +=
                 zoneinfo_parse_protection(ap);
+            *line_field = ZI_PROTECTION;
         }
         break;
     case (PARSE_FAIL):
@@ -877,14 +945,65 @@ static bool zoneinfo_parse_line(char *line, union zoneinfo *zi) {
     return true;
 }
 
+/*
+ * Calls parse_line on each line of buf, except for the lines that held no
+ * field in the previous parse. Returns 1 if the layout of the file changed
+ * since then, so that it must be parsed again without the cache.
+ */
+static int parse_lines(char *buf, struct line_field_cache *cache,
+                       bool (*parse_line)(char *line, void *data, int *line_field),
+                       void *data) {
+    char *line;
+    char *next;
+    int line_idx;
+    int line_field;
+    bool cached;
+
+    for (line = buf, line_idx = 0; *line; line = next, line_idx++) {
+        next = strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
+        }
+
+        cached = cache->valid && line_idx < cache->line_count;
+        if (cached && cache->fields[line_idx] == LINE_FIELD_NONE) {
+            continue;
+        }
+        if (*line == '\0') {
+            line_field = LINE_FIELD_NONE;
+        } else if (!parse_line(line, data, &line_field)) {
+            return -1;
+        }
+        if (cached && cache->fields[line_idx] != line_field) {
+            return 1;
+        }
+        if (line_idx < MAX_CACHED_LINES) {
+            cache->fields[line_idx] = line_field;
+        }
+    }
+
+    if (cache->valid && line_idx != cache->line_count) {
+        return 1;
+    }
+    cache->valid = line_idx <= MAX_CACHED_LINES;
+    cache->line_count = line_idx;
+    return 0;
+}
+
+static bool zoneinfo_parse_line_cb(char *line, void *data, int *line_field) {
+    return zoneinfo_parse_line(line, (union zoneinfo *)data, line_field);
+}
+
 static int zoneinfo_parse(union zoneinfo *zi) {
     static struct reread_data file_data = {
         .filename = ZONEINFO_PATH,
         .fd = -1,
     };
+    static struct line_field_cache cache;
     char buf[PAGE_SIZE];
-    char *save_ptr;
-    char *line;
+    int ret;
 
     memset(zi, 0, sizeof(union zoneinfo));
 
@@ -892,12 +1011,14 @@ static int zoneinfo_parse(union zoneinfo *zi) {
         return -1;
     }
 
-    for (line = strtok_r(buf, "\n", &save_ptr); line;
-         line = strtok_r(NULL, "\n", &save_ptr)) {
-        if (!zoneinfo_parse_line(line, zi)) {
-            ALOGE("%s parse error", file_data.filename);
-            return -1;
-        }
+    ret = parse_lines(buf, &cache, zoneinfo_parse_line_cb, zi);
+    if (ret > 0) {
+        cache.valid = false;
+        return zoneinfo_parse(zi);
+    }
+    if (ret < 0) {
+        ALOGE("%s parse error", file_data.filename);
+        return -1;
     }
     zi->field.totalreserve_pages += zi->field.high;
 
@@ -905,7 +1026,7 @@ static int zoneinfo_parse(union zoneinfo *zi) {
 }
 
 /* /prop/meminfo parsing routines */
-static bool meminfo_parse_line(char *line, union meminfo *mi) {
+static bool meminfo_parse_line(char *line, union meminfo *mi, int *line_field) {
     char *cp = line;
     char *ap;
     char *save_ptr;
@@ -913,6 +1034,7 @@ static bool meminfo_parse_line(char *line, union meminfo *mi) {
     int field_idx;
     enum field_match_result match_res;
 
+    *line_field = LINE_FIELD_NONE;
     cp = strtok_r(line, " ", &save_ptr);
     if (!cp) {
         return false;
@@ -927,18 +1049,23 @@ static bool meminfo_parse_line(char *line, union meminfo *mi) {
         &val, &field_idx);
     if (match_res == PARSE_SUCCESS) {
         mi->arr[field_idx] = val / page_k;
+        *line_field = field_idx;
     }
     return (match_res != PARSE_FAIL);
 }
 
+static bool meminfo_parse_line_cb(char *line, void *data, int *line_field) {
+    return meminfo_parse_line(line, (union meminfo *)data, line_field);
+}
+
 static int meminfo_parse(union meminfo *mi) {
     static struct reread_data file_data = {
         .filename = MEMINFO_PATH,
         .fd = -1,
     };
+    static struct line_field_cache cache;
     char buf[PAGE_SIZE];
-    char *save_ptr;
-    char *line;
+    int ret;
 
     memset(mi, 0, sizeof(union meminfo));
 
@@ -946,12 +1073,14 @@ static int meminfo_parse(union meminfo *mi) {
         return -1;
     }
 
-    for (line = strtok_r(buf, "\n", &save_ptr); line;
-         line = strtok_r(NULL, "\n", &save_ptr)) {
-        if (!meminfo_parse_line(line, mi)) {
-            ALOGE("%s parse error", file_data.filename);
-            return -1;
-        }
+    ret = parse_lines(buf, &cache, meminfo_parse_line_cb, mi);
+    if (ret > 0) {
+        cache.valid = false;
+        return meminfo_parse(mi);
+    }
+    if (ret < 0) {
+        ALOGE("%s parse error", file_data.filename);
+        return -1;
     }
     mi->field.nr_file_pages = mi->field.cached + mi->field.swap_cached +
         mi->field.buffers;
@@ -1008,7 +1137,68 @@ static char *proc_get_name(int pid) {
 }
 
 static struct proc *proc_adj_lru(int oomadj) {
-    return (struct proc *)adjslot_tail(&procadjslot_list[ADJTOSLOT(oomadj)]);
+    struct adjslot_list *head = &procadjslot_list[ADJTOSLOT(oomadj)];
+    struct adjslot_list *curr;
+
+    for (curr = head->prev; curr != head; curr = curr->prev) {
+        if (!((struct proc *)curr)->planned) {
+            return (struct proc *)curr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Sizes read within this long are reused to rank kill candidates, so killing
+ * several processes of one oom_adj level reads each /proc/<pid>/statm once.
+ */
+#define PROC_SIZE_CACHE_MS 1000
+
+/*
+ * Reads the anon, file and swap pages charged to the memcg of the process.
+ * Swapped out memory is freed by a kill too, and is missing from the rss.
+ * Returns anon + swap, or -1 if the process has no memcg.
+ */
+static int proc_get_memcg_size(struct proc *procp) {
+    char buf[PATH_MAX];
+    char key[LINE_MAX + 1];
+    int64_t value;
+    FILE *fp;
+
+    snprintf(buf, sizeof(buf), MEMCG_PROC_MEMORY_STAT, procp->uid, procp->pid);
+    fp = fopen(buf, "re");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    procp->anon = procp->file = procp->swap = 0;
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        if (sscanf(buf, "%" STRINGIFY(LINE_MAX) "s %" SCNd64, key, &value) != 2) {
+            continue;
+        }
+        if (!strcmp(key, "total_rss")) {
+            procp->anon = value / PAGE_SIZE;
+        } else if (!strcmp(key, "total_cache")) {
+            procp->file = value / PAGE_SIZE;
+        } else if (!strcmp(key, "total_swap")) {
+            procp->swap = value / PAGE_SIZE;
+        }
+    }
+    fclose(fp);
+
+    return procp->anon + procp->swap;
+}
+
+static int proc_get_cached_size(struct proc *procp, struct timeval *curr_tm) {
+    if (procp->size <= 0 ||
+        get_time_diff_ms(&procp->size_tm, curr_tm) >= PROC_SIZE_CACHE_MS) {
+        procp->size = use_memcg_size ? proc_get_memcg_size(procp) : -1;
+        if (procp->size < 0) {
+            procp->size = proc_get_size(procp->pid);
+        }
+        procp->size_tm = *curr_tm;
+    }
+    return procp->size;
 }
 
 static struct proc *proc_get_heaviest(int oomadj) {
@@ -1016,9 +1206,19 @@ static struct proc *proc_get_heaviest(int oomadj) {
     struct adjslot_list *curr = head->next;
     struct proc *maxprocp = NULL;
     int maxsize = 0;
+    struct timeval curr_tm;
+
+    gettimeofday(&curr_tm, NULL);
     while (curr != head) {
         int pid = ((struct proc *)curr)->pid;
-        int tasksize = proc_get_size(pid);
+        int tasksize;
+
+        /* Planned victims are freed by the kill, not here. */
+        if (((struct proc *)curr)->planned) {
+            curr = curr->next;
+            continue;
+        }
+        tasksize = proc_get_cached_size((struct proc *)curr, &curr_tm);
         if (tasksize <= 0) {
             struct adjslot_list *next = curr->next;
             pid_remove(pid);
@@ -1070,6 +1270,59 @@ static void set_process_group_and_prio(int pid, SchedPolicy sp, int prio) {
 
 static int last_killed_pid = -1;
 
+static int pidfd_open(int pid) {
+    return syscall(__NR_pidfd_open, pid, 0);
+}
+
+static void stop_kill_tracking(void) {
+    if (last_kill_pidfd < 0) {
+        return;
+    }
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, last_kill_pidfd, NULL);
+    close(last_kill_pidfd);
+    last_kill_pidfd = -1;
+    maxevents--;
+}
+
+static void kill_done_handler(int data __unused, uint32_t events __unused) {
+    if (debug_process_killing) {
+        ALOGI("Process %d was reaped", last_killed_pid);
+    }
+    stop_kill_tracking();
+    last_killed_pid = -1;
+}
+
+/*
+ * Watches for the exit of the process that was just killed through its pidfd,
+ * so that no later event has to poll /proc for it, and reaps its memory right
+ * away if ro.lmk.use_mrelease is set instead of leaving that to the victim's
+ * own exit path. Takes ownership of pidfd.
+ */
+static void start_kill_tracking(int pidfd) {
+    struct epoll_event epev;
+
+    stop_kill_tracking();
+
+    if (use_mrelease && syscall(__NR_process_mrelease, pidfd, 0) == -1 &&
+        debug_process_killing) {
+        ALOGI("process_mrelease failed; errno=%d", errno);
+    }
+
+    epev.events = EPOLLIN;
+    kill_done_hinfo.handler = kill_done_handler;
+    epev.data.ptr = (void *)&kill_done_hinfo;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pidfd, &epev) == -1) {
+        ALOGE("epoll_ctl for killed process pidfd failed; errno=%d", errno);
+        close(pidfd);
+        return;
+    }
+    maxevents++;
+    last_kill_pidfd = pidfd;
+}
+
+/* When the memory pressure event being handled was received */
+static struct timespec mp_event_tm;
+
 /* Kill one process specified by procp.  Returns the size of the process killed */
 static int kill_one_process(struct proc* procp) {
     int pid = procp->pid;
@@ -1078,6 +1331,8 @@ static int kill_one_process(struct proc* procp) {
     int tasksize;
     int r;
     int result = -1;
+    struct timespec kill_tm;
+    int pidfd = -1;
 
 #ifdef LMKD_LOG_STATS
     struct memory_stat mem_st = {};
@@ -1104,15 +1359,29 @@ static int kill_one_process(struct proc* procp) {
     }
 #endif
 
+    if (pidfd_supported) {
+        pidfd = pidfd_open(pid);
+    }
+
     TRACE_KILL_START(pid);
 
-    /* CAP_KILL required */
-    r = kill(pid, SIGKILL);
+    /* CAP_KILL required. The pidfd can't be signalled if the pid was reused. */
+    if (pidfd >= 0) {
+        r = syscall(__NR_pidfd_send_signal, pidfd, SIGKILL, NULL, 0);
+    } else {
+        r = kill(pid, SIGKILL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &kill_tm);
 
     set_process_group_and_prio(pid, SP_FOREGROUND, ANDROID_PRIORITY_HIGHEST);
 
-    ALOGI("Kill '%s' (%d), uid %d, oom_adj %d to free %ldkB",
-        taskname, pid, uid, procp->oomadj, tasksize * page_k);
+    ALOGI("Kill '%s' (%d), uid %d, oom_adj %d to free %ldkB, %ldus after the pressure event",
+        taskname, pid, uid, procp->oomadj, tasksize * page_k,
+        get_time_diff_us(&mp_event_tm, &kill_tm));
+    if (use_memcg_size && debug_process_killing) {
+        ALOGI("Memcg of '%s' (%d) had anon %" PRId64 "kB, file %" PRId64 "kB, swap %" PRId64 "kB",
+            taskname, pid, procp->anon * page_k, procp->file * page_k, procp->swap * page_k);
+    }
 
     TRACE_KILL_END();
 
@@ -1120,8 +1389,14 @@ static int kill_one_process(struct proc* procp) {
 
     if (r) {
         ALOGE("kill(%d): errno=%d", pid, errno);
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
         goto out;
     } else {
+        if (pidfd >= 0) {
+            start_kill_tracking(pidfd);
+        }
 #ifdef LMKD_LOG_STATS
         if (memory_stat_parse_result == 0) {
             stats_write_lmk_kill_occurred(log_ctx, LMK_KILL_OCCURRED, uid, taskname,
@@ -1145,51 +1420,81 @@ out:
 }
 
 /*
- * Find processes to kill to free required number of pages.
- * If pages_to_free is set to 0 only one process will be killed.
- * Returns the size of the killed processes.
+ * Choose up to max_victims processes, from the highest oom_adj down to
+ * min_score_adj, whose sizes add up to pages_to_free, without killing any
+ * yet. At least one is chosen if there is any. Returns the number chosen.
  */
-static int find_and_kill_processes(int min_score_adj, int pages_to_free) {
+static int plan_kills(int min_score_adj, int pages_to_free, struct proc **victims,
+                      int max_victims) {
     int i;
-    int killed_size;
-    int pages_freed = 0;
-
-#ifdef LMKD_LOG_STATS
-    bool lmk_state_change_start = false;
-#endif
+    int nr_victims = 0;
+    int planned_size = 0;
+    struct timeval curr_tm;
 
+    gettimeofday(&curr_tm, NULL);
     for (i = OOM_SCORE_ADJ_MAX; i >= min_score_adj; i--) {
-        struct proc *procp;
-
-        while (true) {
-            procp = kill_heaviest_task ?
+        while (nr_victims < max_victims &&
+               (nr_victims == 0 || planned_size < pages_to_free)) {
+            struct proc *procp = kill_heaviest_task ?
                 proc_get_heaviest(i) : proc_adj_lru(i);
 
             if (!procp)
                 break;
 
-            killed_size = kill_one_process(procp);
-            if (killed_size >= 0) {
-#ifdef LMKD_LOG_STATS
-                if (enable_stats_log && !lmk_state_change_start) {
-                    lmk_state_change_start = true;
-                    stats_write_lmk_state_changed(log_ctx, LMK_STATE_CHANGED,
-                                                  LMK_STATE_CHANGE_START);
-                }
-#endif
+            procp->planned = true;
+            victims[nr_victims++] = procp;
+            if (proc_get_cached_size(procp, &curr_tm) > 0) {
+                planned_size += procp->size;
+            }
+        }
+    }
 
-                pages_freed += killed_size;
-                if (pages_freed >= pages_to_free) {
+    if (nr_victims > 1) {
+        ALOGI("Planned %d kills to free %ldkB of %ldkB needed", nr_victims,
+              planned_size * page_k, pages_to_free * page_k);
+    }
+    return nr_victims;
+}
+
+/*
+ * Find processes to kill to free required number of pages, killing up to
+ * kill_batch_size of them at once. If pages_to_free is set to 0 only one
+ * process will be killed. Returns the size of the killed processes.
+ */
+static int find_and_kill_processes(int min_score_adj, int pages_to_free) {
+    struct proc *victims[MAX_KILL_BATCH];
+    int nr_victims;
+    int nr_kills = 0;
+    int i;
+    int killed_size;
+    int pages_freed = 0;
 
 #ifdef LMKD_LOG_STATS
-                    if (enable_stats_log && lmk_state_change_start) {
-                        stats_write_lmk_state_changed(log_ctx, LMK_STATE_CHANGED,
-                                LMK_STATE_CHANGE_STOP);
-                    }
+    bool lmk_state_change_start = false;
 #endif
-                    return pages_freed;
-                }
+
+    /* Victims that could not be killed are replaced by a new plan. */
+    while (nr_kills < kill_batch_size &&
+           (nr_victims = plan_kills(min_score_adj, pages_to_free - pages_freed, victims,
+                                    kill_batch_size - nr_kills)) > 0) {
+        for (i = 0; i < nr_victims; i++) {
+            killed_size = kill_one_process(victims[i]);
+            if (killed_size < 0) {
+                continue;
+            }
+            nr_kills++;
+#ifdef LMKD_LOG_STATS
+            if (enable_stats_log && !lmk_state_change_start) {
+                lmk_state_change_start = true;
+                stats_write_lmk_state_changed(log_ctx, LMK_STATE_CHANGED,
+                                              LMK_STATE_CHANGE_START);
             }
+#endif
+            pages_freed += killed_size;
+        }
+
+        if (nr_kills > 0 && pages_freed >= pages_to_free) {
+            break;
         }
     }
 
@@ -1222,55 +1527,17 @@ static int64_t get_memory_usage(struct reread_data *file_data) {
     return mem_usage;
 }
 
-void record_low_pressure_levels(union meminfo *mi) {
-    if (low_pressure_mem.min_nr_free_pages == -1 ||
-        low_pressure_mem.min_nr_free_pages > mi->field.nr_free_pages) {
-        if (debug_process_killing) {
-            ALOGI("Low pressure min memory update from %" PRId64 " to %" PRId64,
-                low_pressure_mem.min_nr_free_pages, mi->field.nr_free_pages);
-        }
-        low_pressure_mem.min_nr_free_pages = mi->field.nr_free_pages;
-    }
-    /*
-     * Free memory at low vmpressure events occasionally gets spikes,
-     * possibly a stale low vmpressure event with memory already
-     * freed up (no memory pressure should have been reported).
-     * Ignore large jumps in max_nr_free_pages that would mess up our stats.
-     */
-    if (low_pressure_mem.max_nr_free_pages == -1 ||
-        (low_pressure_mem.max_nr_free_pages < mi->field.nr_free_pages &&
-         mi->field.nr_free_pages - low_pressure_mem.max_nr_free_pages <
-         low_pressure_mem.max_nr_free_pages * 0.1)) {
-        if (debug_process_killing) {
-            ALOGI("Low pressure max memory update from %" PRId64 " to %" PRId64,
-                low_pressure_mem.max_nr_free_pages, mi->field.nr_free_pages);
-        }
-        low_pressure_mem.max_nr_free_pages = mi->field.nr_free_pages;
-    }
-}
-
-enum vmpressure_level upgrade_level(enum vmpressure_level level) {
-    return (enum vmpressure_level)((level < VMPRESS_LEVEL_CRITICAL) ?
-        level + 1 : level);
-}
-
-enum vmpressure_level downgrade_level(enum vmpressure_level level) {
-    return (enum vmpressure_level)((level > VMPRESS_LEVEL_LOW) ?
-        level - 1 : level);
-}
-
-static inline unsigned long get_time_diff_ms(struct timeval *from,
-                                             struct timeval *to) {
-    return (to->tv_sec - from->tv_sec) * 1000 +
-           (to->tv_usec - from->tv_usec) / 1000;
-}
-
 static bool is_kill_pending(void) {
     char buf[24];
     if (last_killed_pid < 0) {
         return false;
     }
 
+    /* The pidfd is closed as soon as the process has exited. */
+    if (last_kill_pidfd >= 0) {
+        return true;
+    }
+
     snprintf(buf, sizeof(buf), "/proc/%d/", last_killed_pid);
     if (access(buf, F_OK) == 0) {
         return true;
@@ -1281,22 +1548,53 @@ static bool is_kill_pending(void) {
     return false;
 }
 
+/*
+ * Tells whether the share of time some tasks stalled on memory over the last
+ * 10 seconds grew by at least psi_trend_upgrade percentage points since the
+ * previous psi event. Stalls that keep growing are about to reach the next
+ * level, so killing can start before they do.
+ */
+static bool is_psi_stall_growing(struct timeval *curr_tm) {
+    static struct reread_data psi_file_data = {
+        .filename = PSI_MEMORY_PATH,
+        .fd = -1,
+    };
+    static struct timeval last_psi_tm;
+    static float last_avg10 = -1;
+    char buf[256];
+    float avg10;
+    bool growing;
+
+    if (reread_file(&psi_file_data, buf, sizeof(buf)) < 0) {
+        return false;
+    }
+    if (sscanf(buf, "some avg10=%f", &avg10) != 1) {
+        ALOGE("%s parse error", PSI_MEMORY_PATH);
+        return false;
+    }
+
+    growing = last_avg10 >= 0 &&
+        get_time_diff_ms(&last_psi_tm, curr_tm) < PSI_TREND_MAX_INTERVAL_MS &&
+        avg10 - last_avg10 >= psi_trend_upgrade;
+    if (debug_process_killing) {
+        ALOGI("psi some avg10 %.2f%%, previous %.2f%%", avg10, last_avg10);
+    }
+    last_avg10 = avg10;
+    last_psi_tm = *curr_tm;
+    return growing;
+}
+
 static void mp_event_common(int data, uint32_t events __unused) {
-    int ret;
     unsigned long long evcount;
-    int64_t mem_usage, memsw_usage;
-    int64_t mem_pressure;
     enum vmpressure_level lvl;
     union meminfo mi;
     union zoneinfo zi;
+    struct lmk_mem_sample sample;
+    struct lmk_kill_decision decision;
     struct timeval curr_tm;
     static struct timeval last_kill_tm;
     static unsigned long kill_skip_count = 0;
     enum vmpressure_level level = (enum vmpressure_level)data;
-    long other_free = 0, other_file = 0;
-    int min_score_adj;
-    int pages_to_free = 0;
-    int minfree = 0;
     static struct reread_data mem_usage_file_data = {
         .filename = MEMCG_MEMORY_USAGE,
         .fd = -1,
@@ -1306,6 +1604,8 @@ static void mp_event_common(int data, uint32_t events __unused) {
         .fd = -1,
     };
 
+    clock_gettime(CLOCK_MONOTONIC, &mp_event_tm);
+
     /*
      * Check all event counters from low to critical
      * and upgrade to the highest priority one. By reading
@@ -1324,9 +1624,11 @@ static void mp_event_common(int data, uint32_t events __unused) {
     if (kill_timeout_ms) {
         // If we're within the timeout, see if there's pending reclaim work
         // from the last killed process. If there is (as evidenced by
-        // /proc/<pid> continuing to exist), skip killing for now.
+        // /proc/<pid> continuing to exist), skip killing for now. Low ram
+        // devices wait out the whole timeout unless pidfds tell exactly when
+        // the process has exited.
         if ((get_time_diff_ms(&last_kill_tm, &curr_tm) < kill_timeout_ms) &&
-            (low_ram_device || is_kill_pending())) {
+            ((policy_params.low_ram_device && !pidfd_supported) || is_kill_pending())) {
             kill_skip_count++;
             return;
         }
@@ -1338,96 +1640,40 @@ static void mp_event_common(int data, uint32_t events __unused) {
         kill_skip_count = 0;
     }
 
-    if (meminfo_parse(&mi) < 0 || zoneinfo_parse(&zi) < 0) {
-        ALOGE("Failed to get free memory!");
-        return;
-    }
-
-    if (use_minfree_levels) {
-        int i;
-
-        other_free = mi.field.nr_free_pages - zi.field.totalreserve_pages;
-        if (mi.field.nr_file_pages > (mi.field.shmem + mi.field.unevictable + mi.field.swap_cached)) {
-            other_file = (mi.field.nr_file_pages - mi.field.shmem -
-                          mi.field.unevictable - mi.field.swap_cached);
-        } else {
-            other_file = 0;
-        }
-
-        min_score_adj = OOM_SCORE_ADJ_MAX + 1;
-        for (i = 0; i < lowmem_targets_size; i++) {
-            minfree = lowmem_minfree[i];
-            if (other_free < minfree && other_file < minfree) {
-                min_score_adj = lowmem_adj[i];
-                break;
-            }
-        }
-
-        if (min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
-            if (debug_process_killing) {
-                ALOGI("Ignore %s memory pressure event "
-                      "(free memory=%ldkB, cache=%ldkB, limit=%ldkB)",
-                      level_name[level], other_free * page_k, other_file * page_k,
-                      (long)lowmem_minfree[lowmem_targets_size - 1] * page_k);
-            }
-            return;
+    if (use_psi_monitors && psi_trend_upgrade > 0 && level != VMPRESS_LEVEL_CRITICAL &&
+        is_psi_stall_growing(&curr_tm)) {
+        level = upgrade_level(level);
+        if (debug_process_killing) {
+            ALOGI("Growing memory stall, event upgraded to %s", level_name[level]);
         }
-
-        /* Free up enough pages to push over the highest minfree level */
-        pages_to_free = lowmem_minfree[lowmem_targets_size - 1] -
-            ((other_free < other_file) ? other_free : other_file);
-        goto do_kill;
     }
 
-    if (level == VMPRESS_LEVEL_LOW) {
-        record_low_pressure_levels(&mi);
-    }
-
-    if (level_oomadj[level] > OOM_SCORE_ADJ_MAX) {
-        /* Do not monitor this pressure level */
+    if (meminfo_parse(&mi) < 0 || zoneinfo_parse(&zi) < 0) {
+        ALOGE("Failed to get free memory!");
         return;
     }
 
-    if ((mem_usage = get_memory_usage(&mem_usage_file_data)) < 0) {
-        goto do_kill;
-    }
-    if ((memsw_usage = get_memory_usage(&memsw_usage_file_data)) < 0) {
-        goto do_kill;
+    sample.nr_free_pages = mi.field.nr_free_pages;
+    sample.nr_file_pages = mi.field.nr_file_pages;
+    sample.shmem = mi.field.shmem;
+    sample.unevictable = mi.field.unevictable;
+    sample.swap_cached = mi.field.swap_cached;
+    sample.free_swap = mi.field.free_swap;
+    sample.totalreserve_pages = zi.field.totalreserve_pages;
+    sample.mem_usage = -1;
+    sample.memsw_usage = -1;
+    if (lmk_policy_needs_mem_usage(&policy_params, level) &&
+        (sample.mem_usage = get_memory_usage(&mem_usage_file_data)) >= 0) {
+        sample.memsw_usage = get_memory_usage(&memsw_usage_file_data);
     }
 
-    // Calculate percent for swappinness.
-    mem_pressure = (mem_usage * 100) / memsw_usage;
-
-    if (enable_pressure_upgrade && level != VMPRESS_LEVEL_CRITICAL) {
-        // We are swapping too much.
-        if (mem_pressure < upgrade_pressure) {
-            level = upgrade_level(level);
-            if (debug_process_killing) {
-                ALOGI("Event upgraded to %s", level_name[level]);
-            }
-        }
-    }
-
-    // If the pressure is larger than downgrade_pressure lmk will not
-    // kill any process, since enough memory is available.
-    if (mem_pressure > downgrade_pressure) {
-        if (debug_process_killing) {
-            ALOGI("Ignore %s memory pressure", level_name[level]);
-        }
+    if (!lmk_policy_decide(&policy_params, &policy_state, level, &sample, &decision)) {
         return;
-    } else if (level == VMPRESS_LEVEL_CRITICAL &&
-               mem_pressure > upgrade_pressure) {
-        if (debug_process_killing) {
-            ALOGI("Downgrade critical memory pressure");
-        }
-        // Downgrade event, since enough memory available.
-        level = downgrade_level(level);
     }
 
-do_kill:
-    if (low_ram_device) {
+    if (policy_params.low_ram_device) {
         /* For Go devices kill only one task */
-        if (find_and_kill_processes(level_oomadj[level], 0) == 0) {
+        if (find_and_kill_processes(decision.min_score_adj, 0) == 0) {
             if (debug_process_killing) {
                 ALOGI("Nothing to kill");
             }
@@ -1437,33 +1683,7 @@ do_kill:
         static struct timeval last_report_tm;
         static unsigned long report_skip_count = 0;
 
-        if (!use_minfree_levels) {
-            /* If pressure level is less than critical and enough free swap then ignore */
-            if (level < VMPRESS_LEVEL_CRITICAL &&
-                mi.field.free_swap > low_pressure_mem.max_nr_free_pages) {
-                if (debug_process_killing) {
-                    ALOGI("Ignoring pressure since %" PRId64
-                          " swap pages are available ",
-                          mi.field.free_swap);
-                }
-                return;
-            }
-            /* Free up enough memory to downgrate the memory pressure to low level */
-            if (mi.field.nr_free_pages < low_pressure_mem.max_nr_free_pages) {
-                pages_to_free = low_pressure_mem.max_nr_free_pages -
-                    mi.field.nr_free_pages;
-            } else {
-                if (debug_process_killing) {
-                    ALOGI("Ignoring pressure since more memory is "
-                        "available (%" PRId64 ") than watermark (%" PRId64 ")",
-                        mi.field.nr_free_pages, low_pressure_mem.max_nr_free_pages);
-                }
-                return;
-            }
-            min_score_adj = level_oomadj[level];
-        }
-
-        pages_freed = find_and_kill_processes(min_score_adj, 0);
+        pages_freed = find_and_kill_processes(decision.min_score_adj, decision.pages_to_free);
 
         if (pages_freed == 0) {
             /* Rate limit kill reports when nothing was reclaimed */
@@ -1476,16 +1696,17 @@ do_kill:
             last_kill_tm = curr_tm;
         }
 
-        if (use_minfree_levels) {
+        if (policy_params.use_minfree_levels) {
             ALOGI("Killing to reclaim %ldkB, reclaimed %ldkB, cache(%ldkB) and "
                 "free(%" PRId64 "kB)-reserved(%" PRId64 "kB) below min(%ldkB) for oom_adj %d",
-                pages_to_free * page_k, pages_freed * page_k,
-                other_file * page_k, mi.field.nr_free_pages * page_k,
+                decision.pages_to_free * page_k, pages_freed * page_k,
+                decision.other_file * page_k, mi.field.nr_free_pages * page_k,
                 zi.field.totalreserve_pages * page_k,
-                minfree * page_k, min_score_adj);
+                decision.minfree * page_k, decision.min_score_adj);
         } else {
             ALOGI("Killing to reclaim %ldkB, reclaimed %ldkB at oom_adj %d",
-                pages_to_free * page_k, pages_freed * page_k, min_score_adj);
+                decision.pages_to_free * page_k, pages_freed * page_k,
+                decision.min_score_adj);
         }
 
         if (report_skip_count > 0) {
@@ -1563,6 +1784,77 @@ err_open_mpfd:
     return false;
 }
 
+static void destroy_psi_monitors(void) {
+    int level;
+
+    for (level = VMPRESS_LEVEL_LOW; level < VMPRESS_LEVEL_COUNT; level++) {
+        if (psifd[level] >= 0) {
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, psifd[level], NULL);
+            close(psifd[level]);
+            psifd[level] = -1;
+            maxevents--;
+        }
+    }
+}
+
+/*
+ * Asks the kernel to signal the level when tasks stalled on memory for
+ * psi_threshold_ms[level] within any psi_window_ms window. A threshold of 0
+ * leaves the level unmonitored.
+ */
+static bool init_psi_monitor(enum vmpressure_level level) {
+    int fd;
+    char buf[64];
+    struct epoll_event epev;
+    int ret;
+    const char *levelstr = level_name[level];
+
+    if (psi_threshold_ms[level] <= 0) {
+        return true;
+    }
+
+    fd = open(PSI_MEMORY_PATH, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGI("No kernel psi support (errno=%d)", errno);
+        return false;
+    }
+
+    snprintf(buf, sizeof(buf), "%s %d %d", psi_stall_type[level],
+             psi_threshold_ms[level] * 1000, psi_window_ms * 1000);
+    ret = TEMP_FAILURE_RETRY(write(fd, buf, strlen(buf) + 1));
+    if (ret == -1) {
+        ALOGE("psi monitor write failed for level %s; errno=%d", levelstr, errno);
+        goto err;
+    }
+
+    epev.events = EPOLLPRI;
+    vmpressure_hinfo[level].data = level;
+    vmpressure_hinfo[level].handler = mp_event_common;
+    epev.data.ptr = (void *)&vmpressure_hinfo[level];
+    ret = epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &epev);
+    if (ret == -1) {
+        ALOGE("epoll_ctl for psi level %s failed; errno=%d", levelstr, errno);
+        goto err;
+    }
+    maxevents++;
+    psifd[level] = fd;
+    return true;
+
+err:
+    close(fd);
+    return false;
+}
+
+static bool init_psi_monitors(void) {
+    if (!init_psi_monitor(VMPRESS_LEVEL_LOW) ||
+        !init_psi_monitor(VMPRESS_LEVEL_MEDIUM) ||
+        !init_psi_monitor(VMPRESS_LEVEL_CRITICAL)) {
+        destroy_psi_monitors();
+        return false;
+    }
+    return true;
+}
+
 static int init(void) {
     struct epoll_event epev;
     int i;
@@ -1572,6 +1864,7 @@ static int init(void) {
     if (page_k == -1)
         page_k = PAGE_SIZE;
     page_k /= 1024;
+    policy_params.page_k = page_k;
 
     epollfd = epoll_create(MAX_EPOLL_EVENTS);
     if (epollfd == -1) {
@@ -1605,12 +1898,23 @@ static int init(void) {
     }
     maxevents++;
 
+    ret = pidfd_open(getpid());
+    if (ret >= 0) {
+        close(ret);
+        pidfd_supported = true;
+    } else {
+        ALOGI("No kernel pidfd support (errno=%d)", errno);
+    }
+
     has_inkernel_module = !access(INKERNEL_MINFREE_PATH, W_OK);
     use_inkernel_interface = has_inkernel_module;
 
     if (use_inkernel_interface) {
         ALOGI("Using in-kernel low memory killer interface");
+    } else if (use_psi_monitors && init_psi_monitors()) {
+        ALOGI("Using psi monitors for memory pressure detection");
     } else {
+        use_psi_monitors = false;
         if (!init_mp_common(VMPRESS_LEVEL_LOW) ||
             !init_mp_common(VMPRESS_LEVEL_MEDIUM) ||
             !init_mp_common(VMPRESS_LEVEL_CRITICAL)) {
@@ -1627,6 +1931,12 @@ static int init(void) {
     return 0;
 }
 
+/* The pidfd of an exited process can report EPOLLHUP too. */
+static bool is_data_connection_dropped(struct epoll_event *evt) {
+    return (evt->events & EPOLLHUP) && evt->data.ptr &&
+        ((struct event_handler_info*)evt->data.ptr)->handler == ctrl_data_handler;
+}
+
 static void mainloop(void) {
     struct event_handler_info* handler_info;
     struct epoll_event *evt;
@@ -1653,7 +1963,7 @@ static void mainloop(void) {
          * In such cases it's essential to handle connection closures first.
          */
         for (i = 0, evt = &events[0]; i < nevents; ++i, evt++) {
-            if ((evt->events & EPOLLHUP) && evt->data.ptr) {
+            if (is_data_connection_dropped(evt)) {
                 ALOGI("lmkd data connection dropped");
                 handler_info = (struct event_handler_info*)evt->data.ptr;
                 ctrl_data_close(handler_info->data);
@@ -1664,7 +1974,7 @@ static void mainloop(void) {
         for (i = 0, evt = &events[0]; i < nevents; ++i, evt++) {
             if (evt->events & EPOLLERR)
                 ALOGD("EPOLLERR on event #%d", i);
-            if (evt->events & EPOLLHUP) {
+            if (is_data_connection_dropped(evt)) {
                 /* This case was handled in the first pass */
                 continue;
             }
@@ -1682,29 +1992,47 @@ int main(int argc __unused, char **argv __unused) {
     };
 
     /* By default disable low level vmpressure events */
-    level_oomadj[VMPRESS_LEVEL_LOW] =
+    policy_params.level_oomadj[VMPRESS_LEVEL_LOW] =
         property_get_int32("ro.lmk.low", OOM_SCORE_ADJ_MAX + 1);
-    level_oomadj[VMPRESS_LEVEL_MEDIUM] =
+    policy_params.level_oomadj[VMPRESS_LEVEL_MEDIUM] =
         property_get_int32("ro.lmk.medium", 800);
-    level_oomadj[VMPRESS_LEVEL_CRITICAL] =
+    policy_params.level_oomadj[VMPRESS_LEVEL_CRITICAL] =
         property_get_int32("ro.lmk.critical", 0);
     debug_process_killing = property_get_bool("ro.lmk.debug", false);
+    policy_params.debug = debug_process_killing;
 
     /* By default disable upgrade/downgrade logic */
-    enable_pressure_upgrade =
+    policy_params.enable_pressure_upgrade =
         property_get_bool("ro.lmk.critical_upgrade", false);
-    upgrade_pressure =
+    policy_params.upgrade_pressure =
         (int64_t)property_get_int32("ro.lmk.upgrade_pressure", 100);
-    downgrade_pressure =
+    policy_params.downgrade_pressure =
         (int64_t)property_get_int32("ro.lmk.downgrade_pressure", 100);
     kill_heaviest_task =
         property_get_bool("ro.lmk.kill_heaviest_task", false);
-    low_ram_device = property_get_bool("ro.config.low_ram", false);
+    policy_params.low_ram_device = property_get_bool("ro.config.low_ram", false);
     kill_timeout_ms =
         (unsigned long)property_get_int32("ro.lmk.kill_timeout_ms", 0);
-    use_minfree_levels =
+    policy_params.use_minfree_levels =
         property_get_bool("ro.lmk.use_minfree_levels", false);
-    per_app_memcg = property_get_bool("ro.config.per_app_memcg", low_ram_device);
+    per_app_memcg = property_get_bool("ro.config.per_app_memcg", policy_params.low_ram_device);
+    use_memcg_size = per_app_memcg && property_get_bool("ro.lmk.use_memcg_size", false);
+    kill_batch_size = property_get_int32("ro.lmk.kill_batch_size", 1);
+    if (kill_batch_size < 1) {
+        kill_batch_size = 1;
+    } else if (kill_batch_size > MAX_KILL_BATCH) {
+        kill_batch_size = MAX_KILL_BATCH;
+    }
+    use_mrelease = property_get_bool("ro.lmk.use_mrelease", false);
+    use_psi_monitors = property_get_bool("ro.lmk.use_psi", false);
+    psi_threshold_ms[VMPRESS_LEVEL_LOW] =
+        property_get_int32("ro.lmk.psi_low_stall_ms", 0);
+    psi_threshold_ms[VMPRESS_LEVEL_MEDIUM] =
+        property_get_int32("ro.lmk.psi_partial_stall_ms", 70);
+    psi_threshold_ms[VMPRESS_LEVEL_CRITICAL] =
+        property_get_int32("ro.lmk.psi_complete_stall_ms", 700);
+    psi_window_ms = property_get_int32("ro.lmk.psi_window_ms", 1000);
+    psi_trend_upgrade = property_get_int32("ro.lmk.psi_trend_upgrade", 0);
 #ifdef LMKD_LOG_STATS
     statslog_init(&log_ctx, &enable_stats_log);
 #endif
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "lowmemorykiller"
+
+#include <inttypes.h>
+
+#include <log/log.h>
+
+#include "lmkd_policy.h"
+
+const char *level_name[VMPRESS_LEVEL_COUNT] = {
+    "low",
+    "medium",
+    "critical"
+};
+
+enum vmpressure_level upgrade_level(enum vmpressure_level level) {
+    return (enum vmpressure_level)((level < VMPRESS_LEVEL_CRITICAL) ?
+        level + 1 : level);
+}
+
+enum vmpressure_level downgrade_level(enum vmpressure_level level) {
+    return (enum vmpressure_level)((level > VMPRESS_LEVEL_LOW) ?
+        level - 1 : level);
+}
+
+static void record_low_pressure_levels(const struct lmk_policy_params *params,
+                                       struct lmk_policy_state *state,
+                                       const struct lmk_mem_sample *sample) {
+    if (state->min_nr_free_pages == -1 ||
+        state->min_nr_free_pages > sample->nr_free_pages) {
+        if (params->debug) {
+            ALOGI("Low pressure min memory update from %" PRId64 " to %" PRId64,
+                state->min_nr_free_pages, sample->nr_free_pages);
+        }
+        state->min_nr_free_pages = sample->nr_free_pages;
+    }
+    /*
+     * Free memory at low vmpressure events occasionally gets spikes,
+     * possibly a stale low vmpressure event with memory already
+     * freed up (no memory pressure should have been reported).
+     * Ignore large jumps in max_nr_free_pages that would mess up our stats.
+     */
+    if (state->max_nr_free_pages == -1 ||
+        (state->max_nr_free_pages < sample->nr_free_pages &&
+         sample->nr_free_pages - state->max_nr_free_pages <
+         state->max_nr_free_pages * 0.1)) {
+        if (params->debug) {
+            ALOGI("Low pressure max memory update from %" PRId64 " to %" PRId64,
+                state->max_nr_free_pages, sample->nr_free_pages);
+        }
+        state->max_nr_free_pages = sample->nr_free_pages;
+    }
+}
+
+static bool decide_minfree(const struct lmk_policy_params *params,
+                           const struct lmk_mem_sample *sample,
+                           struct lmk_kill_decision *decision) {
+    long other_free;
+    long other_file;
+    int i;
+
+    other_free = sample->nr_free_pages - sample->totalreserve_pages;
+    if (sample->nr_file_pages > (sample->shmem + sample->unevictable + sample->swap_cached)) {
+        other_file = (sample->nr_file_pages - sample->shmem -
+                      sample->unevictable - sample->swap_cached);
+    } else {
+        other_file = 0;
+    }
+    decision->other_free = other_free;
+    decision->other_file = other_file;
+
+    decision->min_score_adj = OOM_SCORE_ADJ_MAX + 1;
+    for (i = 0; i < params->lowmem_targets_size; i++) {
+        decision->minfree = params->lowmem_minfree[i];
+        if (other_free < decision->minfree && other_file < decision->minfree) {
+            decision->min_score_adj = params->lowmem_adj[i];
+            break;
+        }
+    }
+
+    if (decision->min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
+        if (params->debug) {
+            ALOGI("Ignore %s memory pressure event "
+                  "(free memory=%ldkB, cache=%ldkB, limit=%ldkB)",
+                  level_name[decision->level], other_free * params->page_k,
+                  other_file * params->page_k,
+                  params->lowmem_targets_size > 0 ?
+                  (long)params->lowmem_minfree[params->lowmem_targets_size - 1] *
+                  params->page_k : 0);
+        }
+        return false;
+    }
+
+    /* Free up enough pages to push over the highest minfree level */
+    decision->pages_to_free = params->lowmem_minfree[params->lowmem_targets_size - 1] -
+        ((other_free < other_file) ? other_free : other_file);
+    return true;
+}
+
+/* Applies the memcg pressure, returns false if the event is to be ignored. */
+static bool adjust_level(const struct lmk_policy_params *params,
+                         const struct lmk_mem_sample *sample,
+                         struct lmk_kill_decision *decision) {
+    int64_t mem_pressure;
+
+    if (sample->mem_usage <= 0 || sample->memsw_usage <= 0) {
+        return true;
+    }
+
+    // Calculate percent for swappinness.
+    mem_pressure = (sample->mem_usage * 100) / sample->memsw_usage;
+
+    if (params->enable_pressure_upgrade && decision->level != VMPRESS_LEVEL_CRITICAL) {
+        // We are swapping too much.
+        if (mem_pressure < params->upgrade_pressure) {
+            decision->level = upgrade_level(decision->level);
+            if (params->debug) {
+                ALOGI("Event upgraded to %s", level_name[decision->level]);
+            }
+        }
+    }
+
+    // If the pressure is larger than downgrade_pressure lmk will not
+    // kill any process, since enough memory is available.
+    if (mem_pressure > params->downgrade_pressure) {
+        if (params->debug) {
+            ALOGI("Ignore %s memory pressure", level_name[decision->level]);
+        }
+        return false;
+    } else if (decision->level == VMPRESS_LEVEL_CRITICAL &&
+               mem_pressure > params->upgrade_pressure) {
+        if (params->debug) {
+            ALOGI("Downgrade critical memory pressure");
+        }
+        // Downgrade event, since enough memory available.
+        decision->level = downgrade_level(decision->level);
+    }
+    return true;
+}
+
+bool lmk_policy_needs_mem_usage(const struct lmk_policy_params *params,
+                                enum vmpressure_level level) {
+    return !params->use_minfree_levels && params->level_oomadj[level] <= OOM_SCORE_ADJ_MAX;
+}
+
+bool lmk_policy_decide(const struct lmk_policy_params *params,
+                       struct lmk_policy_state *state,
+                       enum vmpressure_level level,
+                       const struct lmk_mem_sample *sample,
+                       struct lmk_kill_decision *decision) {
+    decision->level = level;
+    decision->min_score_adj = 0;
+    decision->pages_to_free = 0;
+    decision->other_free = 0;
+    decision->other_file = 0;
+    decision->minfree = 0;
+
+    if (params->use_minfree_levels) {
+        if (!decide_minfree(params, sample, decision)) {
+            return false;
+        }
+    } else {
+        if (level == VMPRESS_LEVEL_LOW) {
+            record_low_pressure_levels(params, state, sample);
+        }
+
+        if (params->level_oomadj[level] > OOM_SCORE_ADJ_MAX) {
+            /* Do not monitor this pressure level */
+            return false;
+        }
+
+        if (!adjust_level(params, sample, decision)) {
+            return false;
+        }
+    }
+
+    if (params->low_ram_device) {
+        /* For Go devices kill only one task */
+        decision->min_score_adj = params->level_oomadj[decision->level];
+        decision->pages_to_free = 0;
+        return true;
+    }
+
+    if (!params->use_minfree_levels) {
+        /* If pressure level is less than critical and enough free swap then ignore */
+        if (decision->level < VMPRESS_LEVEL_CRITICAL &&
+            sample->free_swap > state->max_nr_free_pages) {
+            if (params->debug) {
+                ALOGI("Ignoring pressure since %" PRId64
+                      " swap pages are available ",
+                      sample->free_swap);
+            }
+            return false;
+        }
+        /* Free up enough memory to downgrate the memory pressure to low level */
+        if (sample->nr_free_pages < state->max_nr_free_pages) {
+            decision->pages_to_free = state->max_nr_free_pages - sample->nr_free_pages;
+        } else {
+            if (params->debug) {
+                ALOGI("Ignoring pressure since more memory is "
+                    "available (%" PRId64 ") than watermark (%" PRId64 ")",
+                    sample->nr_free_pages, state->max_nr_free_pages);
+            }
+            return false;
+        }
+        decision->min_score_adj = params->level_oomadj[decision->level];
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LMKD_POLICY_H_
+#define _LMKD_POLICY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include <lmkd.h>
+
+__BEGIN_DECLS
+
+/*
+ * The decision lmkd makes for one memory pressure event, from memory
+ * counters and tunables only. No files are read and nothing is killed here,
+ * so that recorded events can be replayed offline (see tests/lmkd_replay.c).
+ */
+
+/* OOM score values used by both kernel and framework */
+#define OOM_SCORE_ADJ_MIN       (-1000)
+#define OOM_SCORE_ADJ_MAX       1000
+
+/* memory pressure levels */
+enum vmpressure_level {
+    VMPRESS_LEVEL_LOW = 0,
+    VMPRESS_LEVEL_MEDIUM,
+    VMPRESS_LEVEL_CRITICAL,
+    VMPRESS_LEVEL_COUNT
+};
+
+extern const char *level_name[VMPRESS_LEVEL_COUNT];
+
+/* ro.lmk.* tunables and the targets set with LMK_TARGET */
+struct lmk_policy_params {
+    int level_oomadj[VMPRESS_LEVEL_COUNT];
+    bool enable_pressure_upgrade;
+    int64_t upgrade_pressure;
+    int64_t downgrade_pressure;
+    bool low_ram_device;
+    bool use_minfree_levels;
+    int lowmem_adj[MAX_TARGETS];
+    int lowmem_minfree[MAX_TARGETS];
+    int lowmem_targets_size;
+    bool debug;
+    long page_k;  /* only used for logging */
+};
+
+/* what is learned from past events */
+struct lmk_policy_state {
+    int64_t min_nr_free_pages; /* recorded but not used yet */
+    int64_t max_nr_free_pages;
+};
+
+#define LMK_POLICY_STATE_INIT { -1, -1 }
+
+/* memory counters at the time of an event, in pages unless noted otherwise */
+struct lmk_mem_sample {
+    int64_t nr_free_pages;
+    int64_t nr_file_pages;
+    int64_t shmem;
+    int64_t unevictable;
+    int64_t swap_cached;
+    int64_t free_swap;
+    int64_t totalreserve_pages;
+    /* memcg memory and memory+swap usage in bytes, -1 when unknown */
+    int64_t mem_usage;
+    int64_t memsw_usage;
+};
+
+struct lmk_kill_decision {
+    enum vmpressure_level level;  /* after any upgrade or downgrade */
+    int min_score_adj;
+    int pages_to_free;  /* 0 to kill a single process */
+    /* set with use_minfree_levels, for the kill report */
+    long other_free;
+    long other_file;
+    int minfree;
+};
+
+enum vmpressure_level upgrade_level(enum vmpressure_level level);
+enum vmpressure_level downgrade_level(enum vmpressure_level level);
+
+/*
+ * Tells whether the memcg usage is used to decide about an event at level,
+ * so that it is read only when needed.
+ */
+bool lmk_policy_needs_mem_usage(const struct lmk_policy_params *params,
+                                enum vmpressure_level level);
+
+/*
+ * Decides whether processes must be killed for an event at level. Returns
+ * true and fills in decision if they must. state is updated.
+ */
+bool lmk_policy_decide(const struct lmk_policy_params *params,
+                       struct lmk_policy_state *state,
+                       enum vmpressure_level level,
+                       const struct lmk_mem_sample *sample,
+                       struct lmk_kill_decision *decision);
+
+__END_DECLS
+
+#endif /* _LMKD_POLICY_H_ */
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lmkd_replay.h"
+
+#define MAX_TRACE_LINE 1024
+#define MAX_NAME_LEN 64
+#define MAX_KILL_BATCH 16
+
+struct replay_proc {
+    int pid;
+    int oomadj;
+    int64_t pages;
+    char name[MAX_NAME_LEN];
+    uint64_t lru_seq;  /* when lmkd last heard of it */
+    bool killed;
+    bool credited;  /* its pages are added to the free pages */
+    int64_t kill_ms;
+};
+
+struct replay {
+    const struct replay_options *options;
+    struct replay_report *report;
+    struct lmk_policy_params params;
+    struct lmk_policy_state state;
+    struct replay_proc *procs;
+    int nr_procs;
+    int max_procs;
+    uint64_t lru_seq;
+    int64_t pages_freed;  /* by the kills still in effect */
+    bool killed_any;
+    int64_t last_kill_ms;
+    bool under_pressure;
+    int64_t pressure_start_ms;
+};
+
+static bool parse_bool(const char *value, bool *ret) {
+    if (!strcmp(value, "1") || !strcmp(value, "y") || !strcmp(value, "yes") ||
+        !strcmp(value, "on") || !strcmp(value, "true")) {
+        *ret = true;
+        return true;
+    }
+    if (!strcmp(value, "0") || !strcmp(value, "n") || !strcmp(value, "no") ||
+        !strcmp(value, "off") || !strcmp(value, "false")) {
+        *ret = false;
+        return true;
+    }
+    return false;
+}
+
+static bool parse_long(const char *value, long *ret) {
+    char *end;
+
+    *ret = strtol(value, &end, 0);
+    return end != value && *end == '\0';
+}
+
+void replay_init_options(struct replay_options *options) {
+    memset(options, 0, sizeof(*options));
+    /* The lmkd defaults, see main() in lmkd.c */
+    options->params.level_oomadj[VMPRESS_LEVEL_LOW] = OOM_SCORE_ADJ_MAX + 1;
+    options->params.level_oomadj[VMPRESS_LEVEL_MEDIUM] = 800;
+    options->params.level_oomadj[VMPRESS_LEVEL_CRITICAL] = 0;
+    options->params.upgrade_pressure = 100;
+    options->params.downgrade_pressure = 100;
+    options->params.page_k = 4;
+    options->kill_batch_size = 1;
+    options->relaunch_ms = 10000;
+}
+
+bool replay_set_property(struct replay_options *options, const char *name, const char *value) {
+    struct lmk_policy_params *params = &options->params;
+    long val;
+
+    if (!strcmp(name, "ro.config.low_ram")) {
+        return parse_bool(value, &params->low_ram_device);
+    }
+    if (strncmp(name, "ro.lmk.", strlen("ro.lmk."))) {
+        return false;
+    }
+    name += strlen("ro.lmk.");
+
+    if (!strcmp(name, "critical_upgrade")) {
+        return parse_bool(value, &params->enable_pressure_upgrade);
+    }
+    if (!strcmp(name, "kill_heaviest_task")) {
+        return parse_bool(value, &options->kill_heaviest_task);
+    }
+    if (!strcmp(name, "use_minfree_levels")) {
+        return parse_bool(value, &params->use_minfree_levels);
+    }
+    if (!strcmp(name, "debug")) {
+        return parse_bool(value, &params->debug);
+    }
+
+    if (!parse_long(value, &val)) {
+        return false;
+    }
+    if (!strcmp(name, "low")) {
+        params->level_oomadj[VMPRESS_LEVEL_LOW] = val;
+    } else if (!strcmp(name, "medium")) {
+        params->level_oomadj[VMPRESS_LEVEL_MEDIUM] = val;
+    } else if (!strcmp(name, "critical")) {
+        params->level_oomadj[VMPRESS_LEVEL_CRITICAL] = val;
+    } else if (!strcmp(name, "upgrade_pressure")) {
+        params->upgrade_pressure = val;
+    } else if (!strcmp(name, "downgrade_pressure")) {
+        params->downgrade_pressure = val;
+    } else if (!strcmp(name, "kill_timeout_ms")) {
+        options->kill_timeout_ms = val;
+    } else if (!strcmp(name, "kill_batch_size")) {
+        if (val < 1) {
+            val = 1;
+        } else if (val > MAX_KILL_BATCH) {
+            val = MAX_KILL_BATCH;
+        }
+        options->kill_batch_size = val;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static struct replay_proc *find_proc(struct replay *r, int pid, const char *name) {
+    int i;
+
+    for (i = 0; i < r->nr_procs; i++) {
+        if (r->procs[i].pid == pid) {
+            return &r->procs[i];
+        }
+    }
+    /* A process launched again after a kill comes back with a new pid. */
+    if (name[0] == '\0') {
+        return NULL;
+    }
+    for (i = 0; i < r->nr_procs; i++) {
+        if (r->procs[i].killed && !strcmp(r->procs[i].name, name)) {
+            return &r->procs[i];
+        }
+    }
+    return NULL;
+}
+
+static bool grow_procs(struct replay *r) {
+    int max_procs = r->max_procs ? r->max_procs * 2 : 64;
+    struct replay_proc *procs = realloc(r->procs, max_procs * sizeof(*procs));
+
+    if (procs == NULL) {
+        return false;
+    }
+    r->procs = procs;
+    r->max_procs = max_procs;
+    return true;
+}
+
+static void uncredit_proc(struct replay *r, struct replay_proc *procp) {
+    if (procp->credited) {
+        r->pages_freed -= procp->pages;
+        procp->credited = false;
+    }
+}
+
+static void remove_proc(struct replay *r, struct replay_proc *procp) {
+    *procp = r->procs[--r->nr_procs];
+}
+
+static bool trace_proc(struct replay *r, int64_t time_ms, char *args) {
+    struct replay_proc *procp;
+    int pid;
+    int oomadj;
+    int64_t pages;
+    char name[MAX_NAME_LEN] = "";
+
+    if (sscanf(args, "%d %d %" SCNd64 " %63s", &pid, &oomadj, &pages, name) < 3 ||
+        oomadj < OOM_SCORE_ADJ_MIN || oomadj > OOM_SCORE_ADJ_MAX || pages < 0) {
+        return false;
+    }
+
+    procp = find_proc(r, pid, name);
+    if (procp == NULL) {
+        /* replay_trace() made room for one more */
+        procp = &r->procs[r->nr_procs++];
+        memset(procp, 0, sizeof(*procp));
+    } else if (procp->killed) {
+        /* Still in use, so the kill only cost a launch. */
+        uncredit_proc(r, procp);
+        if (time_ms - procp->kill_ms < (int64_t)r->options->relaunch_ms) {
+            r->report->false_kills++;
+        }
+        procp->killed = false;
+    }
+
+    procp->pid = pid;
+    procp->oomadj = oomadj;
+    procp->pages = pages;
+    strcpy(procp->name, name);
+    procp->lru_seq = ++r->lru_seq;
+    return true;
+}
+
+static bool trace_exit(struct replay *r, char *args) {
+    struct replay_proc *procp;
+    int pid;
+
+    if (sscanf(args, "%d", &pid) != 1) {
+        return false;
+    }
+    procp = find_proc(r, pid, "");
+    if (procp == NULL) {
+        return true;
+    }
+    if (procp->killed) {
+        /* The trace now has its memory free too. It stays known to find out if it comes back. */
+        uncredit_proc(r, procp);
+    } else {
+        remove_proc(r, procp);
+    }
+    return true;
+}
+
+static bool trace_target(struct replay *r, char *args) {
+    int minfree;
+    int oomadj;
+    int n;
+    int i = 0;
+
+    while (sscanf(args, "%d %d%n", &minfree, &oomadj, &n) == 2) {
+        if (i == MAX_TARGETS) {
+            return false;
+        }
+        r->params.lowmem_minfree[i] = minfree;
+        r->params.lowmem_adj[i] = oomadj;
+        i++;
+        args += n;
+    }
+    r->params.lowmem_targets_size = i;
+    return i > 0;
+}
+
+/* The same order as plan_kills() in lmkd.c */
+static struct replay_proc *next_victim(struct replay *r, int oomadj) {
+    struct replay_proc *victim = NULL;
+    int i;
+
+    for (i = 0; i < r->nr_procs; i++) {
+        struct replay_proc *procp = &r->procs[i];
+
+        if (procp->killed || procp->oomadj != oomadj) {
+            continue;
+        }
+        if (victim == NULL ||
+            (r->options->kill_heaviest_task ? procp->pages > victim->pages :
+             procp->lru_seq < victim->lru_seq)) {
+            victim = procp;
+        }
+    }
+    return victim;
+}
+
+static void kill_processes(struct replay *r, int64_t time_ms, int min_score_adj,
+                           int pages_to_free) {
+    int max_victims = r->params.low_ram_device ? 1 : r->options->kill_batch_size;
+    int nr_victims = 0;
+    int64_t freed = 0;
+    int i;
+
+    for (i = OOM_SCORE_ADJ_MAX; i >= min_score_adj; i--) {
+        while (nr_victims < max_victims && (nr_victims == 0 || freed < pages_to_free)) {
+            struct replay_proc *procp = next_victim(r, i);
+
+            if (procp == NULL) {
+                break;
+            }
+            procp->killed = true;
+            procp->credited = true;
+            procp->kill_ms = time_ms;
+            nr_victims++;
+            freed += procp->pages;
+            if (r->options->kill_log != NULL) {
+                fprintf(r->options->kill_log,
+                        "%" PRId64 "ms: kill '%s' (%d), adj %d, size %" PRId64 "kB\n",
+                        time_ms, procp->name, procp->pid, procp->oomadj,
+                        procp->pages * r->params.page_k);
+            }
+        }
+    }
+
+    if (nr_victims > 0) {
+        r->report->kills += nr_victims;
+        r->report->pages_freed += freed;
+        r->pages_freed += freed;
+        r->killed_any = true;
+        r->last_kill_ms = time_ms;
+    }
+}
+
+static bool parse_sample(char *args, struct lmk_mem_sample *sample) {
+    static const struct {
+        const char *name;
+        size_t offset;
+    } fields[] = {
+        { "nr_free_pages", offsetof(struct lmk_mem_sample, nr_free_pages) },
+        { "nr_file_pages", offsetof(struct lmk_mem_sample, nr_file_pages) },
+        { "shmem", offsetof(struct lmk_mem_sample, shmem) },
+        { "unevictable", offsetof(struct lmk_mem_sample, unevictable) },
+        { "swap_cached", offsetof(struct lmk_mem_sample, swap_cached) },
+        { "free_swap", offsetof(struct lmk_mem_sample, free_swap) },
+        { "totalreserve_pages", offsetof(struct lmk_mem_sample, totalreserve_pages) },
+        { "mem_usage", offsetof(struct lmk_mem_sample, mem_usage) },
+        { "memsw_usage", offsetof(struct lmk_mem_sample, memsw_usage) },
+    };
+    char *save_ptr;
+    char *field;
+
+    memset(sample, 0, sizeof(*sample));
+    sample->mem_usage = -1;
+    sample->memsw_usage = -1;
+    for (field = strtok_r(args, " \t\n", &save_ptr); field != NULL;
+         field = strtok_r(NULL, " \t\n", &save_ptr)) {
+        char *value = strchr(field, '=');
+        size_t i;
+
+        if (value == NULL) {
+            return false;
+        }
+        *value++ = '\0';
+        for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            if (!strcmp(field, fields[i].name)) {
+                break;
+            }
+        }
+        if (i == sizeof(fields) / sizeof(fields[0]) ||
+            sscanf(value, "%" SCNd64, (int64_t *)((char *)sample + fields[i].offset)) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool trace_event(struct replay *r, int64_t time_ms, char *args) {
+    enum vmpressure_level level;
+    struct lmk_mem_sample sample;
+    struct lmk_kill_decision decision;
+    char level_str[16];
+    int n;
+
+    if (sscanf(args, "%15s%n", level_str, &n) != 1) {
+        return false;
+    }
+    for (level = VMPRESS_LEVEL_LOW; level < VMPRESS_LEVEL_COUNT; level++) {
+        if (!strcmp(level_str, level_name[level])) {
+            break;
+        }
+    }
+    if (level == VMPRESS_LEVEL_COUNT || !parse_sample(args + n, &sample)) {
+        return false;
+    }
+
+    r->report->events++;
+    if (r->killed_any && r->options->kill_timeout_ms &&
+        time_ms - r->last_kill_ms < (int64_t)r->options->kill_timeout_ms) {
+        r->report->skipped_events++;
+        return true;
+    }
+
+    /* What the kills so far have freed is still free. */
+    sample.nr_free_pages += r->pages_freed;
+    if (sample.mem_usage > 0) {
+        sample.mem_usage -= r->pages_freed * r->params.page_k * 1024;
+        if (sample.mem_usage <= 0) {
+            sample.mem_usage = 1;
+        }
+    }
+
+    if (!lmk_policy_decide(&r->params, &r->state, level, &sample, &decision)) {
+        r->report->ignored_events++;
+        if (r->under_pressure) {
+            int64_t recovery_ms = time_ms - r->pressure_start_ms;
+
+            r->report->recoveries++;
+            r->report->total_recovery_ms += recovery_ms;
+            if (recovery_ms > r->report->max_recovery_ms) {
+                r->report->max_recovery_ms = recovery_ms;
+            }
+            r->under_pressure = false;
+        }
+        return true;
+    }
+
+    if (!r->under_pressure) {
+        r->under_pressure = true;
+        r->pressure_start_ms = time_ms;
+    }
+    kill_processes(r, time_ms, decision.min_score_adj, decision.pages_to_free);
+    return true;
+}
+
+int replay_trace(FILE *trace, const struct replay_options *options,
+                 struct replay_report *report) {
+    struct replay r;
+    char line[MAX_TRACE_LINE];
+    int line_nr = 0;
+    int ret = 0;
+
+    memset(report, 0, sizeof(*report));
+    memset(&r, 0, sizeof(r));
+    r.options = options;
+    r.report = report;
+    r.params = options->params;
+    r.state = (struct lmk_policy_state)LMK_POLICY_STATE_INIT;
+
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        int64_t time_ms;
+        char kind[16];
+        int n;
+        bool ok = false;
+
+        line_nr++;
+        n = strspn(line, " \t");
+        if (line[n] == '#' || line[n] == '\n' || line[n] == '\0') {
+            continue;
+        }
+        if (sscanf(line, "%" SCNd64 " %15s%n", &time_ms, kind, &n) == 2) {
+            if (!strcmp(kind, "event")) {
+                ok = trace_event(&r, time_ms, line + n);
+            } else if (!strcmp(kind, "proc")) {
+                if (r.nr_procs == r.max_procs && !grow_procs(&r)) {
+                    ret = -1;
+                    break;
+                }
+                ok = trace_proc(&r, time_ms, line + n);
+            } else if (!strcmp(kind, "exit")) {
+                ok = trace_exit(&r, line + n);
+            } else if (!strcmp(kind, "target")) {
+                ok = trace_target(&r, line + n);
+            }
+        }
+        if (!ok) {
+            ret = line_nr;
+            break;
+        }
+    }
+
+    report->unrecovered = r.under_pressure;
+    free(r.procs);
+    return ret;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LMKD_REPLAY_H_
+#define _LMKD_REPLAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/cdefs.h>
+
+#include <lmkd_policy.h>
+
+__BEGIN_DECLS
+
+/*
+ * Replays a recorded trace through the lmkd kill policy. A trace is a text
+ * file with one record per line, each starting with a time in milliseconds:
+ *
+ *   <ms> target <minfree> <oom_adj> [<minfree> <oom_adj>...]
+ *   <ms> proc <pid> <oom_adj> <pages> [<name>]
+ *   <ms> exit <pid>
+ *   <ms> event <low|medium|critical> [<field>=<value>...]
+ *
+ * target is the LMK_TARGET command, proc registers or updates a process like
+ * LMK_PROCPRIO, with its size, and exit unregisters it. event is a memory
+ * pressure event, the fields being those of struct lmk_mem_sample. Empty
+ * lines and lines starting with '#' are skipped.
+ *
+ * Victims are chosen the way lmkd does: from the highest oom_adj down, the
+ * least recently updated or the heaviest process first, up to
+ * kill_batch_size of them. Kills always succeed, and the pages they free are
+ * added to the free pages of every later event, until the trace has the
+ * process exit too. Events within kill_timeout_ms of a kill are skipped. A
+ * process the trace updates after it was killed, by pid or by name, is
+ * brought back as if it had been launched again, and counts as a false kill
+ * if that is within relaunch_ms of its kill.
+ */
+
+struct replay_options {
+    struct lmk_policy_params params;
+    bool kill_heaviest_task;
+    unsigned long kill_timeout_ms;
+    int kill_batch_size;
+    unsigned long relaunch_ms;
+    FILE *kill_log;  /* every kill is written here unless NULL */
+};
+
+struct replay_report {
+    int events;
+    int ignored_events;  /* the policy decided not to kill */
+    int skipped_events;  /* within kill_timeout_ms of a kill */
+    int kills;
+    int64_t pages_freed;
+    int false_kills;
+    /* from the first event that kills to the next one that doesn't */
+    int recoveries;
+    int64_t total_recovery_ms;
+    int64_t max_recovery_ms;
+    bool unrecovered;  /* the trace ended under pressure */
+};
+
+/* Sets the lmkd defaults of all the ro.lmk properties. */
+void replay_init_options(struct replay_options *options);
+
+/*
+ * Sets the option of a ro.lmk.* or ro.config.low_ram property. Returns false
+ * if the property is not known.
+ */
+bool replay_set_property(struct replay_options *options, const char *name, const char *value);
+
+/* Returns 0 on success, -1 if out of memory or the line number of the first bad record. */
+int replay_trace(FILE *trace, const struct replay_options *options,
+                 struct replay_report *report);
+
+__END_DECLS
+
+#endif /* _LMKD_REPLAY_H_ */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lmkd_replay.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-v] [-r <relaunch_ms>] <trace> [<property>=<value>...]\n"
+            "Replays a trace of memory pressure events through the lmkd kill policy\n"
+            "configured with the given ro.lmk.* properties.\n"
+            "  -v  print every kill\n"
+            "  -r  a process launched again this soon after its kill was a false kill\n"
+            "      (default 10000)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    struct replay_options options;
+    struct replay_report report;
+    FILE *trace;
+    int ret;
+    int i;
+
+    replay_init_options(&options);
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-v")) {
+            options.kill_log = stdout;
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            options.relaunch_ms = strtoul(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (i == argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    trace = fopen(argv[i], "re");
+    if (trace == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", argv[i], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (i++; i < argc; i++) {
+        char *value = strchr(argv[i], '=');
+
+        if (value != NULL) {
+            *value++ = '\0';
+        }
+        if (value == NULL || !replay_set_property(&options, argv[i], value)) {
+            fprintf(stderr, "Bad property %s\n", argv[i]);
+            fclose(trace);
+            return EXIT_FAILURE;
+        }
+    }
+
+    ret = replay_trace(trace, &options, &report);
+    fclose(trace);
+    if (ret != 0) {
+        if (ret < 0) {
+            fprintf(stderr, "Out of memory\n");
+        } else {
+            fprintf(stderr, "Bad record at line %d\n", ret);
+        }
+        return EXIT_FAILURE;
+    }
+
+    printf("events: %d, ignored %d, skipped after a kill %d\n",
+           report.events, report.ignored_events, report.skipped_events);
+    printf("kills: %d, freed %" PRId64 "kB\n",
+           report.kills, report.pages_freed * options.params.page_k);
+    printf("false kills: %d\n", report.false_kills);
+    if (report.recoveries > 0) {
+        printf("recoveries: %d, average %" PRId64 "ms, max %" PRId64 "ms\n",
+               report.recoveries, report.total_recovery_ms / report.recoveries,
+               report.max_recovery_ms);
+    } else {
+        printf("recoveries: 0\n");
+    }
+    if (report.unrecovered) {
+        printf("still under pressure at the end of the trace\n");
+    }
+    return EXIT_SUCCESS;
+}
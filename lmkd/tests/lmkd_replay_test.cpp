@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "lmkd_replay.h"
+
+// Two minfree levels, and two cached processes of the same oom_adj, 1 being
+// the least recently used.
+static const char kMinfreeTrace[] =
+    "# minfree levels of 1000 and 2000 pages\n"
+    "0 target 1000 0 2000 900\n"
+    "10 proc 1 900 300 app.one\n"
+    "20 proc 2 900 400 app.two\n"
+    "30 proc 3 0 1000 app.foreground\n"
+    "\n"
+    "1000 event medium nr_free_pages=1500 nr_file_pages=1500\n"
+    "1100 event medium nr_free_pages=1500 nr_file_pages=1500\n"
+    "1300 event medium nr_free_pages=1500 nr_file_pages=1500\n";
+
+class LmkdReplayTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    replay_init_options(&options_);
+    options_.params.use_minfree_levels = true;
+  }
+
+  int Replay(const std::string& trace) {
+    FILE* fp = fmemopen(const_cast<char*>(trace.data()), trace.size(), "r");
+    if (fp == nullptr) {
+      return -1;
+    }
+    int ret = replay_trace(fp, &options_, &report_);
+    fclose(fp);
+    return ret;
+  }
+
+  struct replay_options options_;
+  struct replay_report report_;
+};
+
+TEST_F(LmkdReplayTest, minfree_kills_until_recovered) {
+  ASSERT_EQ(0, Replay(kMinfreeTrace));
+  EXPECT_EQ(3, report_.events);
+  EXPECT_EQ(1, report_.ignored_events);
+  // One kill per event: the 1800 free pages after the first are still below 2000.
+  EXPECT_EQ(2, report_.kills);
+  EXPECT_EQ(700, report_.pages_freed);
+  EXPECT_EQ(0, report_.false_kills);
+  EXPECT_EQ(1, report_.recoveries);
+  EXPECT_EQ(300, report_.max_recovery_ms);
+  EXPECT_FALSE(report_.unrecovered);
+}
+
+TEST_F(LmkdReplayTest, batch_kills_recover_sooner) {
+  ASSERT_TRUE(replay_set_property(&options_, "ro.lmk.kill_batch_size", "4"));
+  ASSERT_EQ(0, Replay(kMinfreeTrace));
+  EXPECT_EQ(2, report_.kills);
+  EXPECT_EQ(1, report_.recoveries);
+  EXPECT_EQ(100, report_.max_recovery_ms);
+}
+
+TEST_F(LmkdReplayTest, heaviest_first) {
+  ASSERT_TRUE(replay_set_property(&options_, "ro.lmk.kill_heaviest_task", "true"));
+  std::string trace(kMinfreeTrace);
+  trace += "1400 proc 1 900 300 app.one\n";
+  ASSERT_EQ(0, Replay(trace));
+  // app.two went first, then app.one, which was used again 300ms later.
+  EXPECT_EQ(2, report_.kills);
+  EXPECT_EQ(1, report_.false_kills);
+}
+
+TEST_F(LmkdReplayTest, relaunch_with_new_pid) {
+  std::string trace(kMinfreeTrace);
+  trace += "5000 proc 10 0 300 app.one\n";
+  trace += "20000 proc 11 0 400 app.two\n";
+  ASSERT_EQ(0, Replay(trace));
+  // Only app.one came back within the default 10s.
+  EXPECT_EQ(1, report_.false_kills);
+}
+
+TEST_F(LmkdReplayTest, kill_timeout) {
+  ASSERT_TRUE(replay_set_property(&options_, "ro.lmk.kill_timeout_ms", "200"));
+  ASSERT_EQ(0, Replay(kMinfreeTrace));
+  EXPECT_EQ(1, report_.skipped_events);
+  EXPECT_EQ(2, report_.kills);
+  EXPECT_EQ(0, report_.ignored_events);
+  EXPECT_TRUE(report_.unrecovered);
+}
+
+TEST_F(LmkdReplayTest, exit_drops_the_freed_pages) {
+  std::string trace(
+      "0 target 1000 0 2000 900\n"
+      "10 proc 1 900 1000 app.one\n"
+      "1000 event medium nr_free_pages=1500 nr_file_pages=1500\n"
+      "1100 event medium nr_free_pages=1500 nr_file_pages=1500\n"
+      "1200 exit 1\n"
+      "1300 event medium nr_free_pages=1500 nr_file_pages=1500\n");
+  ASSERT_EQ(0, Replay(trace));
+  EXPECT_EQ(1, report_.kills);
+  EXPECT_EQ(1, report_.ignored_events);
+  EXPECT_TRUE(report_.unrecovered);
+}
+
+TEST_F(LmkdReplayTest, vmpressure_levels) {
+  options_.params.use_minfree_levels = false;
+  std::string trace(
+      "10 proc 1 900 300 app.one\n"
+      "20 proc 2 100 400 app.visible\n"
+      // Learns the free memory at low pressure.
+      "100 event low nr_free_pages=2000\n"
+      "1000 event medium nr_free_pages=1000\n"
+      "1100 event medium nr_free_pages=1000\n"
+      "1200 event critical nr_free_pages=1000\n");
+  ASSERT_EQ(0, Replay(trace));
+  EXPECT_EQ(4, report_.events);
+  // Medium only kills from oom_adj 800, critical from 0.
+  EXPECT_EQ(2, report_.kills);
+  EXPECT_EQ(1, report_.ignored_events);
+}
+
+TEST_F(LmkdReplayTest, bad_records) {
+  EXPECT_EQ(2, Replay("0 target 1000 0\n0 event huge nr_free_pages=1\n"));
+  EXPECT_EQ(1, Replay("0 event low free=1\n"));
+  EXPECT_EQ(1, Replay("0 proc 1 2000 10\n"));
+  EXPECT_EQ(1, Replay("proc 1 0 10\n"));
+}
+
+TEST(LmkdReplayOptionsTest, properties) {
+  struct replay_options options;
+  replay_init_options(&options);
+  EXPECT_EQ(800, options.params.level_oomadj[VMPRESS_LEVEL_MEDIUM]);
+
+  EXPECT_TRUE(replay_set_property(&options, "ro.lmk.medium", "700"));
+  EXPECT_EQ(700, options.params.level_oomadj[VMPRESS_LEVEL_MEDIUM]);
+  EXPECT_TRUE(replay_set_property(&options, "ro.config.low_ram", "true"));
+  EXPECT_TRUE(options.params.low_ram_device);
+  EXPECT_TRUE(replay_set_property(&options, "ro.lmk.kill_batch_size", "100"));
+  EXPECT_EQ(16, options.kill_batch_size);
+
+  EXPECT_FALSE(replay_set_property(&options, "ro.lmk.medium", "high"));
+  EXPECT_FALSE(replay_set_property(&options, "ro.lmk.unknown", "1"));
+  EXPECT_FALSE(replay_set_property(&options, "ro.config.per_app_memcg", "true"));
+}
@@ -36,8 +36,11 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
@@ -55,6 +58,8 @@
 
 #include <pcrecpp.h>
 
+#include "logcat_segment.h"
+
 #define DEFAULT_MAX_ROTATED_LOGS 4
 
 struct log_device_t {
@@ -76,6 +81,10 @@ struct log_device_t {
     }
 };
 
+namespace android {
+class DecodePool;
+}
+
 struct android_logcat_context_internal {
     // status
     volatile std::atomic_int retval;  // valid if thread_stopped set
@@ -109,13 +118,20 @@ struct android_logcat_context_internal {
     size_t maxRotatedLogs;
     size_t outByteCount;
     int printBinary;
+    // --compress, binary output packed into segments, see logcat_segment.h
+    android::SegmentWriter* segment;
+    // --input, read back segments rather than from logd
+    const char* inputFileName;
     int devCount;  // >1 means multiple
     pcrecpp::RE* regex;
     log_device_t* devices;
     EventTagMap* eventTagMap;
     // 0 means "infinite"
     size_t maxCount;
-    size_t printCount;
+    std::atomic<size_t> printCount;
+    // 0 means "decode on the reading thread"
+    size_t decodeThreads;
+    android::DecodePool* decodePool;
 
     bool printItAnyways;
     bool debug;
@@ -237,6 +253,7 @@ static void rotateLogs(android_logcat_context_internal* context) {
     // Can't rotate logs if we're not outputting to a file
     if (!context->outputFileName) return;
 
+    if (context->segment) context->segment->finish();
     close_output(context);
 
     // Compute the maximum number of digits needed to count up to
@@ -290,6 +307,7 @@ static void rotateLogs(android_logcat_context_internal* context) {
         context->error = context->output;
         context->error_fd = context->output_fd;
     }
+    if (context->segment) context->segment->reset(context->output_fd);
 
     context->outByteCount = 0;
 }
@@ -297,7 +315,22 @@ static void rotateLogs(android_logcat_context_internal* context) {
 void printBinary(android_logcat_context_internal* context, struct log_msg* buf) {
     size_t size = buf->len();
 
-    TEMP_FAILURE_RETRY(write(context->output_fd, buf, size));
+    if (!context->segment) {
+        TEMP_FAILURE_RETRY(write(context->output_fd, buf, size));
+        return;
+    }
+
+    ssize_t bytesWritten = context->segment->write(buf);
+    if (bytesWritten < 0) {
+        logcat_panic(context, HELP_FALSE, "output error");
+        return;
+    }
+    context->outByteCount += bytesWritten;
+
+    if (context->logRotateSizeKBytes > 0 &&
+        (context->outByteCount / 1024) >= context->logRotateSizeKBytes) {
+        rotateLogs(context);
+    }
 }
 
 static bool regexOk(android_logcat_context_internal* context,
@@ -309,27 +342,30 @@ static bool regexOk(android_logcat_context_internal* context,
     return context->regex->PartialMatch(messageString);
 }
 
-static void processBuffer(android_logcat_context_internal* context,
-                          log_device_t* dev, struct log_msg* buf) {
-    int bytesWritten = 0;
-    int err;
-    AndroidLogEntry entry;
-    char binaryMsgBuf[1024];
+static void openEventTagMap(android_logcat_context_internal* context) {
+    if (!context->eventTagMap && !context->hasOpenedEventTagMap) {
+        context->eventTagMap = android_openEventTagMap(nullptr);
+        context->hasOpenedEventTagMap = true;
+    }
+}
 
-    if (dev->binary) {
-        if (!context->eventTagMap && !context->hasOpenedEventTagMap) {
-            context->eventTagMap = android_openEventTagMap(nullptr);
-            context->hasOpenedEventTagMap = true;
-        }
-        err = android_log_processBinaryLogBuffer(
-            &buf->entry_v1, &entry, context->eventTagMap, binaryMsgBuf,
-            sizeof(binaryMsgBuf));
+// Safe to call from any thread once openEventTagMap() has been called.
+static int decodeBuffer(android_logcat_context_internal* context, bool binary,
+                        struct log_msg* buf, AndroidLogEntry* entry,
+                        char* binaryMsgBuf, size_t binaryMsgBufLen) {
+    if (binary) {
+        return android_log_processBinaryLogBuffer(
+            &buf->entry_v1, entry, context->eventTagMap, binaryMsgBuf,
+            binaryMsgBufLen);
         // printf(">>> pri=%d len=%d msg='%s'\n",
-        //    entry.priority, entry.messageLen, entry.message);
-    } else {
-        err = android_log_processLogBuffer(&buf->entry_v1, &entry);
+        //    entry->priority, entry->messageLen, entry->message);
     }
-    if ((err < 0) && !context->debug) return;
+    return android_log_processLogBuffer(&buf->entry_v1, entry);
+}
+
+static void printEntry(android_logcat_context_internal* context,
+                       const AndroidLogEntry& entry) {
+    int bytesWritten = 0;
 
     if (android_log_shouldPrintLine(
             context->logformat, std::string(entry.tag, entry.tagLen).c_str(),
@@ -356,6 +392,156 @@ static void processBuffer(android_logcat_context_internal* context,
     }
 }
 
+static void processBuffer(android_logcat_context_internal* context,
+                          log_device_t* dev, struct log_msg* buf) {
+    int err;
+    AndroidLogEntry entry;
+    char binaryMsgBuf[1024];
+
+    if (dev->binary) openEventTagMap(context);
+    err = decodeBuffer(context, dev->binary, buf, &entry, binaryMsgBuf,
+                       sizeof(binaryMsgBuf));
+    if ((err < 0) && !context->debug) return;
+
+    printEntry(context, entry);
+}
+
+// --decode-threads: entries are decoded on a pool of worker threads, the
+// binary buffers being the expensive ones, and written out strictly in the
+// order they were read. Slots form a ring filled by the reading thread;
+// whichever worker finds the oldest slot decoded takes over printing and
+// writes out every consecutive decoded slot, so output never waits on a
+// dedicated printing thread and nothing lingers when the reader blocks.
+// Dividers travel through the same ring to stay in sequence.
+class DecodePool {
+   public:
+    DecodePool(android_logcat_context_internal* context, size_t threads)
+        : mContext(context), mSlots(kSlots) {
+        for (size_t i = 0; i < threads; ++i) {
+            mThreads.emplace_back(&DecodePool::worker, this);
+        }
+    }
+
+    // Prints everything still queued before returning.
+    ~DecodePool() {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mStopping = true;
+        }
+        mWork.notify_all();
+        for (auto& thread : mThreads) thread.join();
+    }
+
+    void decode(log_device_t* dev, const struct log_msg& msg) {
+        if (dev->binary) openEventTagMap(mContext);
+        Slot& slot = acquire();
+        slot.divider = false;
+        slot.binary = dev->binary;
+        memcpy(&slot.msg, &msg, sizeof(slot.msg));
+        publish();
+    }
+
+    void write(const char* text) {
+        Slot& slot = acquire();
+        slot.divider = true;
+        slot.text = text;
+        publish();
+    }
+
+   private:
+    // Must be a power of two.
+    static constexpr size_t kSlots = 128;
+
+    struct Slot {
+        struct log_msg msg;
+        std::string text;  // written as is when divider is set
+        bool divider;
+        bool binary;
+        bool ready;  // decoded and waiting to be printed
+        int err;
+        AndroidLogEntry entry;
+        char binaryMsgBuf[1024];
+    };
+
+    android_logcat_context_internal* mContext;
+    std::vector<Slot> mSlots;
+    std::vector<std::thread> mThreads;
+    std::mutex mLock;
+    std::condition_variable mWork;   // mNext < mTail, or mStopping
+    std::condition_variable mSpace;  // mHead advanced
+    // Monotonic sequence numbers, mHead <= mNext <= mTail.
+    size_t mHead = 0;  // oldest slot not yet printed
+    size_t mNext = 0;  // oldest slot not yet picked up by a worker
+    size_t mTail = 0;  // next slot to fill
+    bool mPrinting = false;
+    bool mStopping = false;
+
+    // Only the reading thread fills slots, no lock held while it does so.
+    Slot& acquire() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mSpace.wait(lock, [this] { return (mTail - mHead) < kSlots; });
+        return mSlots[mTail & (kSlots - 1)];
+    }
+
+    void publish() {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mSlots[mTail & (kSlots - 1)].ready = false;
+            ++mTail;
+        }
+        mWork.notify_one();
+    }
+
+    void print(Slot& slot) {
+        if (mContext->stop) return;
+        if (slot.divider) {
+            if (::write(mContext->output_fd, slot.text.data(),
+                        slot.text.size()) < 0) {
+                logcat_panic(mContext, HELP_FALSE, "output error");
+            }
+            return;
+        }
+        if ((slot.err < 0) && !mContext->debug) return;
+        // the reader may have run ahead of --max-count
+        if (mContext->maxCount && (mContext->printCount >= mContext->maxCount)) {
+            return;
+        }
+        printEntry(mContext, slot.entry);
+    }
+
+    void worker() {
+        std::unique_lock<std::mutex> lock(mLock);
+        for (;;) {
+            mWork.wait(lock, [this] { return mStopping || (mNext < mTail); });
+            if (mNext == mTail) return;
+
+            Slot& slot = mSlots[mNext++ & (kSlots - 1)];
+            lock.unlock();
+            if (!slot.divider) {
+                slot.err = decodeBuffer(mContext, slot.binary, &slot.msg,
+                                        &slot.entry, slot.binaryMsgBuf,
+                                        sizeof(slot.binaryMsgBuf));
+            }
+            lock.lock();
+            slot.ready = true;
+
+            // Another worker is printing, it will pick this slot up in turn.
+            if (mPrinting) continue;
+            mPrinting = true;
+            while ((mHead < mNext) && mSlots[mHead & (kSlots - 1)].ready) {
+                Slot& out = mSlots[mHead & (kSlots - 1)];
+                lock.unlock();
+                print(out);
+                lock.lock();
+                out.ready = false;
+                ++mHead;
+                mSpace.notify_one();
+            }
+            mPrinting = false;
+        }
+    }
+};
+
 static void maybePrintStart(android_logcat_context_internal* context,
                             log_device_t* dev, bool printDividers) {
     if (!dev->printed || printDividers) {
@@ -363,7 +549,9 @@ static void maybePrintStart(android_logcat_context_internal* context,
             char buf[1024];
             snprintf(buf, sizeof(buf), "--------- %s %s\n",
                      dev->printed ? "switch to" : "beginning of", dev->device);
-            if (write(context->output_fd, buf, strlen(buf)) < 0) {
+            if (context->decodePool) {
+                context->decodePool->write(buf);
+            } else if (write(context->output_fd, buf, strlen(buf)) < 0) {
                 logcat_panic(context, HELP_FALSE, "output error");
                 return;
             }
@@ -452,6 +640,10 @@ static void show_help(android_logcat_context_internal* context) {
                     // private and undocumented nsec, no signal, too much noise
                     // useful for -T or -t <timestamp> accurate testing though.
                     "  -D, --dividers  Print dividers between each log buffer\n"
+                    "  --decode-threads=<N>\n"
+                    "                  Decode entries, binary events especially, on N worker\n"
+                    "                  threads. Output order is preserved. Default 0, decode\n"
+                    "                  on the reading thread.\n"
                     "  -c, --clear     Clear (flush) the entire log and exit\n"
                     "                  if Log to File specified, clear fileset instead\n"
                     "  -d              Dump the log and then exit (don't block)\n"
@@ -482,6 +674,11 @@ static void show_help(android_logcat_context_internal* context) {
                     "                  Multiple -b parameters or comma separated list of buffers are\n"
                     "                  allowed. Buffers interleaved. Default -b main,system,crash.\n"
                     "  -B, --binary    Output the log in binary.\n"
+                    "  --compress      Paired with -f, save the log in binary as compressed and\n"
+                    "                  indexed segments, -r then counts compressed kbytes.\n"
+                    "  --input=<file>  Read the log from a file saved with --compress rather\n"
+                    "                  than from the ring buffers. With -t '<time>', seeks\n"
+                    "                  straight to that time through the segment index.\n"
                     "  -S, --statistics                       Output statistics.\n"
                     "  -p, --prune     Print prune white and ~black list. Service is specified as\n"
                     "                  UID, UID/PID or /PID. Weighed for quicker pruning if prefix\n"
@@ -726,6 +923,65 @@ void reportErrorName(const char** current, const char* name,
     }
 }
 
+// --input, replay a file saved with --compress. Entries are filtered and
+// printed exactly as if logd had sent them.
+static void readSegments(android_logcat_context_internal* context,
+                         const log_time& start, bool printDividers) {
+    using namespace android;
+    int fd = open(context->inputFileName, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        logcat_panic(context, HELP_FALSE, "couldn't open input file %s\n",
+                     context->inputFileName);
+        return;
+    }
+
+    SegmentReader reader(fd);
+    if (start != log_time::EPOCH) reader.seek(start);
+
+    if (context->decodeThreads && !context->printBinary) {
+        context->decodePool = new DecodePool(context, context->decodeThreads);
+    }
+
+    log_device_t* dev = nullptr;
+    while (!context->stop &&
+           (!context->maxCount || (context->printCount < context->maxCount))) {
+        struct log_msg log_msg;
+        int ret = reader.read(&log_msg);
+        if (!ret) break;
+        if (ret < 0) {
+            logcat_panic(context, HELP_FALSE, "input file %s is corrupt\n",
+                         context->inputFileName);
+            break;
+        }
+        // seek lands on a block boundary
+        if (log_time(log_msg.entry.sec, log_msg.entry.nsec) < start) continue;
+
+        log_device_t* d;
+        for (d = context->devices; d; d = d->next) {
+            if (android_name_to_log_id(d->device) == log_msg.id()) break;
+        }
+        if (!d) continue;
+
+        if (dev != d) {
+            dev = d;
+            maybePrintStart(context, dev, printDividers);
+            if (context->stop) break;
+        }
+        if (context->printBinary) {
+            printBinary(context, &log_msg);
+        } else if (context->decodePool) {
+            context->decodePool->decode(dev, log_msg);
+        } else {
+            processBuffer(context, dev, &log_msg);
+        }
+    }
+
+    // before the input goes away
+    delete context->decodePool;
+    context->decodePool = nullptr;
+    close(fd);
+}
+
 static int __logcat(android_logcat_context_internal* context) {
     using namespace android;
     int err;
@@ -870,6 +1126,9 @@ static int __logcat(android_logcat_context_internal* context) {
         static const char id_str[] = "id";
         static const char wrap_str[] = "wrap";
         static const char print_str[] = "print";
+        static const char decode_threads_str[] = "decode-threads";
+        static const char compress_str[] = "compress";
+        static const char input_str[] = "input";
         // clang-format off
         static const struct option long_options[] = {
           { "binary",        no_argument,       nullptr, 'B' },
@@ -877,16 +1136,19 @@ static int __logcat(android_logcat_context_internal* context) {
           { "buffer-size",   optional_argument, nullptr, 'g' },
           { "clear",         no_argument,       nullptr, 'c' },
           { debug_str,       no_argument,       nullptr, 0 },
+          { decode_threads_str, required_argument, nullptr, 0 },
           { "dividers",      no_argument,       nullptr, 'D' },
           { "file",          required_argument, nullptr, 'f' },
           { "format",        required_argument, nullptr, 'v' },
           { "color",         no_argument,       NULL,   'C' },
+          { compress_str,    no_argument,       nullptr, 0 },
           // hidden and undocumented reserved alias for --regex
           { "grep",          required_argument, nullptr, 'e' },
           // hidden and undocumented reserved alias for --max-count
           { "head",          required_argument, nullptr, 'm' },
           { "help",          no_argument,       nullptr, 'h' },
           { id_str,          required_argument, nullptr, 0 },
+          { input_str,       required_argument, nullptr, 0 },
           { "last",          no_argument,       nullptr, 'L' },
           { "max-count",     required_argument, nullptr, 'm' },
           { pid_str,         required_argument, nullptr, 0 },
@@ -950,6 +1212,24 @@ static int __logcat(android_logcat_context_internal* context) {
                     context->debug = true;
                     break;
                 }
+                if (long_options[option_index].name == compress_str) {
+                    context->segment = new android::SegmentWriter();
+                    break;
+                }
+                if (long_options[option_index].name == input_str) {
+                    context->inputFileName = optctx.optarg;
+                    break;
+                }
+                if (long_options[option_index].name == decode_threads_str) {
+                    if (!getSizeTArg(optctx.optarg, &context->decodeThreads, 0,
+                                     64)) {
+                        logcat_panic(context, HELP_TRUE, "%s %s out of range\n",
+                                     long_options[option_index].name,
+                                     optctx.optarg);
+                        goto exit;
+                    }
+                    break;
+                }
                 if (long_options[option_index].name == id_str) {
                     setId = (optctx.optarg && optctx.optarg[0]) ? optctx.optarg
                                                                 : nullptr;
@@ -1358,6 +1638,15 @@ static int __logcat(android_logcat_context_internal* context) {
         goto exit;
     }
 
+    if (context->segment) {
+        if (!context->outputFileName) {
+            logcat_panic(context, HELP_TRUE, "--compress requires -f as well\n");
+            goto exit;
+        }
+        // segments hold the entries as -B would write them
+        context->printBinary = 1;
+    }
+
     if (!!setId) {
         if (!context->outputFileName) {
             logcat_panic(context, HELP_TRUE,
@@ -1437,12 +1726,27 @@ static int __logcat(android_logcat_context_internal* context) {
         }
     }
 
+    if (context->inputFileName) {
+        logger_list = nullptr;
+        setupOutputAndSchedulingPolicy(context, false);
+        if (!context->stop) readSegments(context, tail_time, printDividers);
+        goto close;
+    }
+
     dev = context->devices;
     if (tail_time != log_time::EPOCH) {
         logger_list = android_logger_list_alloc_time(mode, tail_time, pid);
     } else {
         logger_list = android_logger_list_alloc(mode, tail_lines, pid);
     }
+    // Let logd leave out what our filters would discard anyway, raw binary
+    // output bypasses the filters so must see everything.
+    if (logger_list && !context->printBinary) {
+        char tags[192];
+        android_LogPriority pri = android_log_getFilterHint(
+            context->logformat, tags, sizeof(tags));
+        __android_logger_list_set_filter(logger_list, pri, tags);
+    }
     // We have three orthogonal actions below to clear, set log size and
     // get log size. All sharing the same iteration loop.
     while (dev) {
@@ -1623,6 +1927,11 @@ static int __logcat(android_logcat_context_internal* context) {
 
     dev = nullptr;
 
+    if (context->decodeThreads && !context->printBinary) {
+        context->decodePool =
+            new android::DecodePool(context, context->decodeThreads);
+    }
+
     while (!context->stop &&
            (!context->maxCount || (context->printCount < context->maxCount))) {
         struct log_msg log_msg;
@@ -1664,12 +1973,19 @@ static int __logcat(android_logcat_context_internal* context) {
         }
         if (context->printBinary) {
             printBinary(context, &log_msg);
+        } else if (context->decodePool) {
+            context->decodePool->decode(dev, log_msg);
         } else {
             processBuffer(context, dev, &log_msg);
         }
     }
 
 close:
+    // drain before the output and devices go away
+    delete context->decodePool;
+    context->decodePool = nullptr;
+    if (context->segment) context->segment->finish();
+
     // Short and sweet. Implemented generic version in android_logcat_destroy.
     while (!!(dev = context->devices)) {
         context->devices = dev->next;
@@ -1828,6 +2144,7 @@ int android_logcat_destroy(android_logcat_context* ctx) {
     }
 
     delete context->regex;
+    delete context->segment;
     context->argv_hold.clear();
     context->args.clear();
     context->envp_hold.clear();
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "logcat_segment.h"
+
+namespace android {
+
+void SegmentWriter::reset(int fd) {
+    mFd = fd;
+    off_t end = (fd >= 0) ? lseek(fd, 0, SEEK_END) : -1;
+    mOffset = (end > 0) ? end : 0;
+    mBlock.clear();
+    mIds = 0;
+    mIndex.clear();
+}
+
+bool SegmentWriter::writeFully(const void* buf, size_t len) {
+    const char* cp = static_cast<const char*>(buf);
+    while (len) {
+        ssize_t ret = TEMP_FAILURE_RETRY(::write(mFd, cp, len));
+        if (ret <= 0) return false;
+        cp += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+ssize_t SegmentWriter::write(struct log_msg* msg) {
+    if (mFd < 0) return -1;
+
+    if (mBlock.empty()) {
+        mSec = msg->entry.sec;
+        mNsec = msg->entry.nsec;
+    }
+    log_id_t id = msg->id();
+    if (id < 32) mIds |= 1U << id;
+    mBlock.append(reinterpret_cast<const char*>(msg->buf), msg->len());
+
+    return (mBlock.size() >= kBlockSize) ? flushBlock() : 0;
+}
+
+ssize_t SegmentWriter::flushBlock() {
+    if (mBlock.empty()) return 0;
+
+    uLongf length = compressBound(mBlock.size());
+    std::string out(sizeof(segment_record) + length, '\0');
+    int ret = compress2(
+        reinterpret_cast<Bytef*>(&out[sizeof(segment_record)]), &length,
+        reinterpret_cast<const Bytef*>(mBlock.data()), mBlock.size(),
+        Z_DEFAULT_COMPRESSION);
+    if (ret != Z_OK) return -1;
+
+    segment_record* record = reinterpret_cast<segment_record*>(&out[0]);
+    record->magic = kBlockMagic;
+    record->length = length;
+    record->uncompressed = mBlock.size();
+    record->ids = mIds;
+    record->sec = mSec;
+    record->nsec = mNsec;
+    size_t total = sizeof(segment_record) + length;
+    if (!writeFully(out.data(), total)) return -1;
+
+    segment_index_entry entry = {};
+    entry.offset = mOffset;
+    entry.sec = mSec;
+    entry.nsec = mNsec;
+    entry.ids = mIds;
+    mIndex.push_back(entry);
+
+    mOffset += total;
+    mBlock.clear();
+    mIds = 0;
+    return total;
+}
+
+ssize_t SegmentWriter::finish() {
+    ssize_t total = flushBlock();
+    if ((total < 0) || mIndex.empty()) return total;
+
+    size_t length = mIndex.size() * sizeof(segment_index_entry) +
+                    sizeof(segment_trailer);
+    segment_record record = {};
+    record.magic = kIndexMagic;
+    record.length = length;
+    record.uncompressed = length;
+    for (const auto& entry : mIndex) record.ids |= entry.ids;
+    record.sec = mIndex.front().sec;
+    record.nsec = mIndex.front().nsec;
+    segment_trailer trailer;
+    trailer.length = sizeof(record) + length;
+    trailer.magic = kTrailerMagic;
+
+    if (!writeFully(&record, sizeof(record)) ||
+        !writeFully(mIndex.data(),
+                    mIndex.size() * sizeof(segment_index_entry)) ||
+        !writeFully(&trailer, sizeof(trailer))) {
+        return -1;
+    }
+
+    mOffset += trailer.length;
+    mIndex.clear();
+    return total + trailer.length;
+}
+
+static bool readFully(int fd, void* buf, size_t len, uint64_t offset) {
+    char* cp = static_cast<char*>(buf);
+    while (len) {
+        ssize_t ret = TEMP_FAILURE_RETRY(pread(fd, cp, len, offset));
+        if (ret <= 0) return false;
+        cp += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+// Binary searches the index at the end of the file, only when it covers
+// start do we trust it; blocks appended by an earlier session precede it.
+bool SegmentReader::seekIndex(const log_time& start) {
+    struct stat st;
+    if (fstat(mFd, &st) || (st.st_size < static_cast<off_t>(
+                                              sizeof(segment_record) +
+                                              sizeof(segment_trailer)))) {
+        return false;
+    }
+
+    segment_trailer trailer;
+    if (!readFully(mFd, &trailer, sizeof(trailer),
+                   st.st_size - sizeof(trailer)) ||
+        (trailer.magic != SegmentWriter::kTrailerMagic) ||
+        (trailer.length > static_cast<uint64_t>(st.st_size)) ||
+        (trailer.length < (sizeof(segment_record) + sizeof(trailer)))) {
+        return false;
+    }
+
+    uint64_t offset = st.st_size - trailer.length;
+    segment_record record;
+    if (!readFully(mFd, &record, sizeof(record), offset) ||
+        (record.magic != SegmentWriter::kIndexMagic) ||
+        ((sizeof(record) + record.length) != trailer.length)) {
+        return false;
+    }
+
+    size_t count = (record.length - sizeof(trailer)) /
+                   sizeof(segment_index_entry);
+    if (!count) return false;
+    std::vector<segment_index_entry> index(count);
+    if (!readFully(mFd, index.data(), count * sizeof(segment_index_entry),
+                   offset + sizeof(record))) {
+        return false;
+    }
+    if (start < log_time(index[0].sec, index[0].nsec)) return false;
+
+    size_t lo = 0, hi = count;  // index[lo] starts at or before start
+    while ((hi - lo) > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (start < log_time(index[mid].sec, index[mid].nsec)) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    mPos = index[lo].offset;
+    return true;
+}
+
+void SegmentReader::seek(const log_time& start) {
+    mData.clear();
+    mCursor = 0;
+    if (seekIndex(start)) return;
+
+    // No usable index, walk the record headers from the start of the file.
+    uint64_t pos = 0;
+    mPos = 0;
+    segment_record record;
+    while (readFully(mFd, &record, sizeof(record), pos)) {
+        if (record.magic == SegmentWriter::kBlockMagic) {
+            if (start < log_time(record.sec, record.nsec)) break;
+            mPos = pos;
+        } else if (record.magic != SegmentWriter::kIndexMagic) {
+            break;
+        }
+        pos += sizeof(record) + record.length;
+    }
+}
+
+int SegmentReader::nextBlock() {
+    for (;;) {
+        segment_record record;
+        // A short header is the torn tail of an interrupted segment.
+        if (!readFully(mFd, &record, sizeof(record), mPos)) return 0;
+        uint64_t payload = mPos + sizeof(record);
+        mPos = payload + record.length;
+
+        if (record.magic == SegmentWriter::kIndexMagic) continue;
+        if (record.magic != SegmentWriter::kBlockMagic) return -EINVAL;
+        // a block is closed by the entry that takes it past kBlockSize
+        static const size_t maxBlock =
+            SegmentWriter::kBlockSize + LOGGER_ENTRY_MAX_LEN;
+        if ((record.uncompressed > maxBlock) ||
+            (record.length > compressBound(maxBlock))) {
+            return -EINVAL;
+        }
+
+        std::string compressed(record.length, '\0');
+        if (!readFully(mFd, &compressed[0], record.length, payload)) return 0;
+        mData.resize(record.uncompressed);
+        uLongf length = record.uncompressed;
+        if ((uncompress(reinterpret_cast<Bytef*>(&mData[0]), &length,
+                        reinterpret_cast<const Bytef*>(compressed.data()),
+                        compressed.size()) != Z_OK) ||
+            (length != record.uncompressed)) {
+            return -EINVAL;
+        }
+        mCursor = 0;
+        return 1;
+    }
+}
+
+int SegmentReader::read(struct log_msg* msg) {
+    while (mCursor >= mData.size()) {
+        int ret = nextBlock();
+        if (ret <= 0) return ret;
+    }
+
+    size_t left = mData.size() - mCursor;
+    if (left < sizeof(msg->entry_v1)) return -EINVAL;
+    memcpy(msg->buf, &mData[mCursor], sizeof(msg->entry_v1));
+    size_t len = msg->len();
+    if ((len > left) || (len > sizeof(msg->buf)) || !msg->msg()) {
+        return -EINVAL;
+    }
+    memcpy(msg->buf, &mData[mCursor], len);
+    mCursor += len;
+    return len;
+}
+
+}  // namespace android
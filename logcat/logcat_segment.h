@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGCAT_SEGMENT_H__
+#define _LOGCAT_SEGMENT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include <log/log.h>
+
+// Compressed persistence format written by logcat --compress -f <file>.
+//
+// A segment is a sequence of records, each a segment_record header followed
+// by its payload. Block records carry up to kBlockSize bytes of raw
+// logger_entry records, exactly as logcat -B would have written them,
+// deflated as one unit. When a segment is finished, on rotation or exit, an
+// index record is appended listing the offset, first timestamp and log ids
+// of every block written since the segment was opened; it ends with a
+// segment_trailer so a reader can find it from the end of the file.
+//
+// Readers seek through the index when there is one, and otherwise walk the
+// record headers, which costs a read per block but no decompression, so a
+// segment cut short by a crash or power loss is still usable up to its last
+// complete block. Appending to an existing segment just adds more blocks and
+// a new index after the old one, which in turn is skipped like any other
+// record. The format is native endian, it is read back on the same device.
+
+namespace android {
+
+struct __attribute__((__packed__)) segment_record {
+    uint32_t magic;         // kBlockMagic or kIndexMagic
+    uint32_t length;        // payload bytes following this header
+    uint32_t uncompressed;  // block payload once inflated
+    uint32_t ids;           // bit mask of the log ids present
+    uint32_t sec;           // timestamp of the first entry
+    uint32_t nsec;
+};
+
+struct __attribute__((__packed__)) segment_index_entry {
+    uint64_t offset;  // of the block's segment_record in the file
+    uint32_t sec;
+    uint32_t nsec;
+    uint32_t ids;
+    uint32_t reserved;
+};
+
+struct __attribute__((__packed__)) segment_trailer {
+    uint32_t length;  // of the whole index record, header included
+    uint32_t magic;   // kTrailerMagic
+};
+
+class SegmentWriter {
+   public:
+    static constexpr uint32_t kBlockMagic = 0x4b4c4253;    // "SBLK"
+    static constexpr uint32_t kIndexMagic = 0x58444953;    // "SIDX"
+    static constexpr uint32_t kTrailerMagic = 0x4c525453;  // "STRL"
+    static constexpr size_t kBlockSize = 65536;
+
+    // Starts a new segment at the end of fd, which the caller owns. Call
+    // finish() first if a previous segment is still open.
+    void reset(int fd);
+
+    // Returns the number of bytes written to the file, zero while the entry
+    // is only buffered, or -1 on error.
+    ssize_t write(struct log_msg* msg);
+
+    // Writes out the pending block and the index.
+    ssize_t finish();
+
+   private:
+    int mFd = -1;
+    uint64_t mOffset = 0;
+    std::string mBlock;
+    uint32_t mIds = 0;
+    uint32_t mSec = 0;
+    uint32_t mNsec = 0;
+    std::vector<segment_index_entry> mIndex;
+
+    ssize_t flushBlock();
+    bool writeFully(const void* buf, size_t len);
+};
+
+class SegmentReader {
+   public:
+    // fd remains owned by the caller.
+    explicit SegmentReader(int fd) : mFd(fd) {
+    }
+
+    // Positions the reader at the last block starting at or before start,
+    // entries before start may still follow and are for the caller to skip.
+    void seek(const log_time& start);
+
+    // Returns the entry length, 0 at the end of the segment, or -EINVAL
+    // should the segment be corrupt.
+    int read(struct log_msg* msg);
+
+   private:
+    int mFd;
+    uint64_t mPos = 0;  // next record
+    std::string mData;  // inflated current block
+    size_t mCursor = 0;
+
+    bool seekIndex(const log_time& start);
+    int nextBlock();
+};
+
+}  // namespace android
+
+#endif  // _LOGCAT_SEGMENT_H__
@@ -906,6 +906,44 @@ TEST(logcat, logrotate_suffix) {
     EXPECT_FALSE(IsFalse(system(command), command));
 }
 
+TEST(logcat, logrotate_compress) {
+    static const char form[] = "/data/local/tmp/logcat.logrotate.XXXXXX";
+    char buf[sizeof(form)];
+    ASSERT_TRUE(NULL != mkdtemp(strcpy(buf, form)));
+
+    static const char comm[] = logcat_executable
+        " -b main -b system -d --compress -f %s/log.seg";
+    static const char input[] = logcat_executable
+        " -b main -b system --input=%s/log.seg -v threadtime";
+    char command[sizeof(buf) + sizeof(input)];
+    snprintf(command, sizeof(command), comm, buf);
+
+    int ret;
+    EXPECT_FALSE(IsFalse(ret = logcat_system(command), command));
+    if (!ret) {
+        snprintf(command, sizeof(command), input, buf);
+
+        FILE* fp;
+        EXPECT_TRUE(NULL != (fp = popen(command, "r")));
+        if (fp) {
+            char buffer[BIG_BUFFER];
+            int count = 0;
+
+            while (fgets(buffer, sizeof(buffer), fp)) {
+                log_time t(log_time::EPOCH);
+                // every entry replayed in the requested format
+                if (!strncmp(buffer, "--------- ", 10)) continue;
+                EXPECT_TRUE(NULL != t.strptime(buffer, "%m-%d %H:%M:%S.%q"));
+                ++count;
+            }
+            pclose(fp);
+            EXPECT_LT(0, count);
+        }
+    }
+    snprintf(command, sizeof(command), "rm -rf %s", buf);
+    EXPECT_FALSE(IsFalse(system(command), command));
+}
+
 TEST(logcat, logrotate_continue) {
     static const char tmp_out_dir_form[] =
         "/data/local/tmp/logcat.logrotate.XXXXXX";
@@ -35,6 +35,7 @@
 
 #include "CommandListener.h"
 #include "LogCommand.h"
+#include "LogListener.h"
 #include "LogUtils.h"
 
 CommandListener::CommandListener(LogBuffer* buf, LogReader* /*reader*/,
@@ -228,8 +229,11 @@ int CommandListener::GetStatisticsCmd::runCommand(SocketClient* cli, int argc,
         }
     }
 
-    cli->sendMsg(
-        package_string(mBuf.formatStatistics(uid, pid, logMask)).c_str());
+    std::string statistics = mBuf.formatStatistics(uid, pid, logMask);
+    if ((uid == AID_ROOT) && !pid) {
+        statistics += LogListener::formatStatistics();
+    }
+    cli->sendMsg(package_string(statistics).c_str());
     return 0;
 }
 
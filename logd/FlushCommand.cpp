@@ -62,7 +62,7 @@ void FlushCommand::runSocketCommand(SocketClient* client) {
                     return;
                 }
             }
-            entry->triggerReader_Locked();
+            entry->notifyReader_Locked();
             if (entry->runningReader_Locked()) {
                 LogTimeEntry::unlock();
                 return;
@@ -80,7 +80,8 @@ void FlushCommand::runSocketCommand(SocketClient* client) {
             return;
         }
         entry = new LogTimeEntry(mReader, client, mNonBlock, mTail, mLogMask,
-                                 mPid, mStart, mTimeout);
+                                 mPid, mPrio, mTags, mStart, mTimeout, mBatch,
+                                 mLatency);
         times.push_front(entry);
     }
 
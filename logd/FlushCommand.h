@@ -31,21 +31,31 @@ class FlushCommand : public SocketClientCommand {
     unsigned long mTail;
     log_mask_t mLogMask;
     pid_t mPid;
+    int mPrio;
+    std::vector<std::string> mTags;
     log_time mStart;
     uint64_t mTimeout;
+    unsigned long mBatch;
+    uint64_t mLatency;
 
    public:
     // for opening a reader
     explicit FlushCommand(LogReader& reader, bool nonBlock, unsigned long tail,
-                          log_mask_t logMask, pid_t pid, log_time start,
-                          uint64_t timeout)
+                          log_mask_t logMask, pid_t pid, int prio,
+                          const std::vector<std::string>& tags, log_time start,
+                          uint64_t timeout, unsigned long batch,
+                          uint64_t latency)
         : mReader(reader),
           mNonBlock(nonBlock),
           mTail(tail),
           mLogMask(logMask),
           mPid(pid),
+          mPrio(prio),
+          mTags(tags),
           mStart(start),
-          mTimeout((start != log_time::EPOCH) ? timeout : 0) {
+          mTimeout((start != log_time::EPOCH) ? timeout : 0),
+          mBatch(batch),
+          mLatency(latency) {
     }
 
     // for notification of an update
@@ -55,8 +65,11 @@ class FlushCommand : public SocketClientCommand {
           mTail(-1),
           mLogMask(logMask),
           mPid(0),
+          mPrio(ANDROID_LOG_DEFAULT),
           mStart(log_time::EPOCH),
-          mTimeout(0) {
+          mTimeout(0),
+          mBatch(0),
+          mLatency(0) {
     }
 
     virtual void runSocketCommand(SocketClient* client);
@@ -25,10 +25,12 @@
 #include <sys/uio.h>
 #include <syslog.h>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
 #include <android-base/macros.h>
+#include <android-base/stringprintf.h>
 #include <log/log_properties.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
@@ -53,7 +55,10 @@ LogAudit::LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg)
                                               BOOL_DEFAULT_TRUE)),
       events(__android_logger_property_get_bool("ro.logd.auditd.events",
                                                 BOOL_DEFAULT_TRUE)),
-      initialized(false) {
+      initialized(false),
+      coalesce(__android_logger_property_get_bool("ro.logd.auditd.coalesce",
+                                                  BOOL_DEFAULT_TRUE)),
+      lastSweep(CLOCK_MONOTONIC) {
     static const char auditd_message[] = { KMSG_PRIORITY(LOG_INFO),
                                            'l',
                                            'o',
@@ -164,6 +169,112 @@ void LogAudit::logParse(const std::string& string, std::string* bug_num) {
     }
 }
 
+// Logs that the denial described by key repeated count times since it was
+// last logged.
+void LogAudit::logSummary(const std::string& key, unsigned count) {
+    std::string summary = android::base::StringPrintf(
+        "avc: denied %s repeated %u times", key.c_str(), count);
+    log_time now(isMonotonic() ? CLOCK_MONOTONIC : CLOCK_REALTIME);
+    pid_t pid = getpid();
+    pid_t tid = gettid();
+    log_mask_t notify = 0;
+
+    if (events) {
+        size_t str_len = std::min(summary.length(),
+                                  (size_t)LOGGER_ENTRY_MAX_PAYLOAD -
+                                      sizeof(android_log_event_string_t));
+        size_t message_len = str_len + sizeof(android_log_event_string_t);
+        uint32_t buffer[(message_len + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+
+        android_log_event_string_t* event =
+            reinterpret_cast<android_log_event_string_t*>(buffer);
+        event->header.tag = htole32(AUDITD_LOG_TAG);
+        event->type = EVENT_TYPE_STRING;
+        event->length = htole32(str_len);
+        memcpy(event->data, summary.data(), str_len);
+
+        if (logbuf->log(LOG_ID_EVENTS, now, AID_LOGD, pid, tid,
+                        reinterpret_cast<char*>(event), message_len) >= 0) {
+            notify |= 1 << LOG_ID_EVENTS;
+        }
+    }
+
+    if (main) {
+        static const char tag[] = "auditd";
+        size_t str_len = std::min(summary.length() + 1,
+                                  (size_t)LOGGER_ENTRY_MAX_PAYLOAD -
+                                      sizeof(tag) - 1);
+        size_t message_len = 1 + sizeof(tag) + str_len;
+        char newstr[message_len];
+
+        *newstr = ANDROID_LOG_WARN;
+        memcpy(newstr + 1, tag, sizeof(tag));
+        memcpy(newstr + 1 + sizeof(tag), summary.c_str(), str_len);
+        newstr[message_len - 1] = '\0';
+
+        if (logbuf->log(LOG_ID_MAIN, now, AID_LOGD, pid, tid, newstr,
+                        message_len) >= 0) {
+            notify |= 1 << LOG_ID_MAIN;
+        }
+    }
+
+    if (notify) {
+        reader->notifyNewLog(notify);
+    }
+}
+
+// Returns false if str repeats an avc denial logged less than kDenialWindow
+// ago. The first denial to arrive after the window has passed is preceded by
+// a summary of how many were suppressed; summaries for denials that stopped
+// repeating are flushed by the next sweep.
+bool LogAudit::coalesceDenial(const char* str) {
+    if (!strstr(str, "): avc: denied ")) return true;
+
+    std::string denial(str);
+    std::string key = "{ " + denialParse(denial, '}', "{ ") + "} for" +
+                      " scontext=" + denialParse(denial, ' ', " scontext=") +
+                      " tcontext=" + denialParse(denial, ' ', " tcontext=") +
+                      " tclass=" + denialParse(denial, ' ', " tclass=");
+
+    log_time now(CLOCK_MONOTONIC);
+    if ((now.nsec() - lastSweep.nsec()) >= kDenialWindow) {
+        lastSweep = now;
+        for (auto it = denials.begin(); it != denials.end();) {
+            if ((now.nsec() - it->second.logged.nsec()) < kDenialWindow) {
+                ++it;
+                continue;
+            }
+            if (it->second.suppressed) {
+                logSummary(it->first, it->second.suppressed);
+            }
+            it = denials.erase(it);
+        }
+    }
+
+    bool suppress = false;
+    auto it = denials.find(key);
+    if (it == denials.end()) {
+        if (denials.size() < kDenialsMax) {
+            denials.emplace(key, Denial{ now, 0 });
+        }
+    } else if ((now.nsec() - it->second.logged.nsec()) < kDenialWindow) {
+        ++it->second.suppressed;
+        suppress = true;
+    } else {
+        if (it->second.suppressed) {
+            logSummary(it->first, it->second.suppressed);
+        }
+        it->second.logged = now;
+        it->second.suppressed = 0;
+    }
+
+    logbuf->wrlock();
+    logbuf->addAuditDenial(suppress);
+    logbuf->unlock();
+
+    return !suppress;
+}
+
 int LogAudit::logPrint(const char* fmt, ...) {
     if (fmt == NULL) {
         return -EINVAL;
@@ -264,7 +375,7 @@ int LogAudit::logPrint(const char* fmt, ...) {
         }
     }
 
-    if (!main && !events) {
+    if ((!main && !events) || (coalesce && !coalesceDenial(str))) {
         free(str);
         return 0;
     }
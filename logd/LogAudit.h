@@ -18,6 +18,8 @@
 #define _LOGD_LOG_AUDIT_H__
 
 #include <map>
+#include <string>
+#include <unordered_map>
 
 #include <sysutils/SocketListener.h>
 
@@ -32,6 +34,18 @@ class LogAudit : public SocketListener {
     bool main;
     bool events;
     bool initialized;
+    bool coalesce;
+
+    // Identical avc denials, keyed by permissions, contexts and class, seen
+    // within kDenialWindow of the last one logged are only counted.
+    static const uint64_t kDenialWindow = 5 * NS_PER_SEC;
+    static const size_t kDenialsMax = 256;
+    struct Denial {
+        log_time logged;  // CLOCK_MONOTONIC
+        unsigned suppressed;
+    };
+    std::unordered_map<std::string, Denial> denials;
+    log_time lastSweep;
 
    public:
     LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg);
@@ -49,6 +63,8 @@ class LogAudit : public SocketListener {
     std::string denialParse(const std::string& denial, char terminator,
                             const std::string& search_term);
     void logParse(const std::string& string, std::string* bug_num);
+    bool coalesceDenial(const char* str);
+    void logSummary(const std::string& key, unsigned count);
     int logPrint(const char* fmt, ...)
         __attribute__((__format__(__printf__, 2, 3)));
 };
@@ -32,6 +32,7 @@
 #include <private/android_logger.h>
 
 #include "LogBuffer.h"
+#include "LogFlushBatch.h"
 #include "LogKlog.h"
 #include "LogReader.h"
 #include "LogUtils.h"
@@ -47,9 +48,6 @@ const log_time LogBuffer::pruneMargin(3, 0);
 
 void LogBuffer::init() {
     log_id_for_each(i) {
-        mLastSet[i] = false;
-        mLast[i] = mLogElements.begin();
-
         if (setSize(i, __android_logger_get_buffer_size(i))) {
             setSize(i, LOG_BUFFER_MIN_SIZE);
         }
@@ -72,28 +70,30 @@ void LogBuffer::init() {
         // as the act of mounting /data would trigger persist.logd.timestamp to
         // be corrected. 1/30 corner case YMMV.
         //
-        rdlock();
-        LogBufferElementCollection::iterator it = mLogElements.begin();
-        while ((it != mLogElements.end())) {
-            LogBufferElement* e = *it;
-            if (monotonic) {
-                if (!android::isMonotonic(e->mRealTime)) {
-                    LogKlog::convertRealToMonotonic(e->mRealTime);
-                    if ((e->mRealTime.tv_nsec % 1000) == 0) {
-                        e->mRealTime.tv_nsec++;
+        log_id_for_each(i) {
+            rdlock(i);
+            LogBufferElementCollection::iterator it = mLogElements[i].begin();
+            while ((it != mLogElements[i].end())) {
+                LogBufferElement* e = *it;
+                if (monotonic) {
+                    if (!android::isMonotonic(e->mRealTime)) {
+                        LogKlog::convertRealToMonotonic(e->mRealTime);
+                        if ((e->mRealTime.tv_nsec % 1000) == 0) {
+                            e->mRealTime.tv_nsec++;
+                        }
                     }
-                }
-            } else {
-                if (android::isMonotonic(e->mRealTime)) {
-                    LogKlog::convertMonotonicToReal(e->mRealTime);
-                    if ((e->mRealTime.tv_nsec % 1000) == 0) {
-                        e->mRealTime.tv_nsec++;
+                } else {
+                    if (android::isMonotonic(e->mRealTime)) {
+                        LogKlog::convertMonotonicToReal(e->mRealTime);
+                        if ((e->mRealTime.tv_nsec % 1000) == 0) {
+                            e->mRealTime.tv_nsec++;
+                        }
                     }
                 }
+                ++it;
             }
-            ++it;
+            unlock(i);
         }
-        unlock();
     }
 
     // We may have been triggered by a SIGHUP. Release any sleeping reader
@@ -117,9 +117,10 @@ void LogBuffer::init() {
 
 LogBuffer::LogBuffer(LastLogTimes* times)
     : monotonic(android_log_clockid() == CLOCK_MONOTONIC), mTimes(*times) {
-    pthread_rwlock_init(&mLogElementsLock, nullptr);
+    pthread_rwlock_init(&mStatsLock, nullptr);
 
     log_id_for_each(i) {
+        pthread_rwlock_init(&mLogElementsLock[i], nullptr);
         lastLoggedElements[i] = nullptr;
         droppedElements[i] = nullptr;
     }
@@ -198,19 +199,17 @@ static enum match_type identical(LogBufferElement* elem,
     return SAME;
 }
 
-int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
-                   pid_t tid, const char* msg, unsigned short len) {
-    if (log_id >= LOG_ID_MAX) {
-        return -EINVAL;
-    }
-
+// Returns nullptr, having accounted for it, if the entry is not loggable.
+LogBufferElement* LogBuffer::prepare(log_id_t log_id, log_time realtime,
+                                     uid_t uid, pid_t pid, pid_t tid,
+                                     const char* msg, unsigned short len) {
     // Slip the time by 1 nsec if the incoming lands on xxxxxx000 ns.
     // This prevents any chance that an outside source can request an
     // exact entry with time specified in ms or us precision.
     if ((realtime.tv_nsec % 1000) == 0) ++realtime.tv_nsec;
 
-    LogBufferElement* elem =
-        new LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
+    LogBufferElement* elem = new (log_id)
+        LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
     if (log_id != LOG_ID_SECURITY) {
         int prio = ANDROID_LOG_INFO;
         const char* tag = nullptr;
@@ -232,11 +231,63 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
             stats.addTotal(elem);
             unlock();
             delete elem;
-            return -EACCES;
+            return nullptr;
         }
     }
 
-    wrlock();
+    return elem;
+}
+
+int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+                   pid_t tid, const char* msg, unsigned short len) {
+    if (log_id >= LOG_ID_MAX) {
+        return -EINVAL;
+    }
+
+    LogBufferElement* elem =
+        prepare(log_id, realtime, uid, pid, tid, msg, len);
+    if (!elem) return -EACCES;
+
+    wrlock(log_id);
+    int rc = logLocked(elem, len);
+    unlock(log_id);
+
+    return rc;
+}
+
+// Takes the lock of log_id once for all of the entries, for sources such
+// as the kernel log that deliver lines in bursts. Returns the number of
+// entries logged.
+int LogBuffer::log(log_id_t log_id, const LogBufferEntry* entries,
+                   size_t count) {
+    if (log_id >= LOG_ID_MAX) {
+        return -EINVAL;
+    }
+
+    LogBufferElement* elems[count];
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const LogBufferEntry& e = entries[i];
+        LogBufferElement* elem = prepare(log_id, e.realtime, e.uid, e.pid,
+                                         e.tid, e.msg, e.len);
+        if (elem) elems[n++] = elem;
+    }
+    if (!n) return 0;
+
+    wrlock(log_id);
+    for (size_t i = 0; i < n; ++i) {
+        logLocked(elems[i], elems[i]->getMsgLen());
+    }
+    unlock(log_id);
+
+    return n;
+}
+
+// LogBuffer::wrlock(elem->getLogId()) must be held when this function is
+// called, owns elem.
+int LogBuffer::logLocked(LogBufferElement* elem, unsigned short len) {
+    log_id_t log_id = elem->getLogId();
+
     LogBufferElement* currentLast = lastLoggedElements[log_id];
     if (currentLast) {
         LogBufferElement* dropped = droppedElements[log_id];
@@ -337,14 +388,14 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                     // check for overflow
                     if (total >= UINT32_MAX) {
                         log(currentLast);
-                        unlock();
                         return len;
                     }
+                    wrlock();
                     stats.addTotal(currentLast);
+                    unlock();
                     delete currentLast;
                     swab = total;
                     event->payload.data = htole32(swab);
-                    unlock();
                     return len;
                 }
                 if (count == USHRT_MAX) {
@@ -356,12 +407,13 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                 }
             }
             if (count) {
+                wrlock();
                 stats.addTotal(currentLast);
+                unlock();
                 currentLast->setDropped(count);
             }
             droppedElements[log_id] = currentLast;
             lastLoggedElements[log_id] = elem;
-            unlock();
             return len;
         }
         if (dropped) {         // State 1 or 2
@@ -376,30 +428,32 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
             delete currentLast;
         }
     }
-    lastLoggedElements[log_id] = new LogBufferElement(*elem);
+    lastLoggedElements[log_id] = new (log_id) LogBufferElement(*elem);
 
     log(elem);
-    unlock();
 
     return len;
 }
 
-// assumes LogBuffer::wrlock() held, owns elem, look after garbage collection
+// assumes LogBuffer::wrlock(elem->getLogId()) held, owns elem, look after
+// garbage collection
 void LogBuffer::log(LogBufferElement* elem) {
     // cap on how far back we will sort in-place, otherwise append
     static uint32_t too_far_back = 5;  // five seconds
+    log_id_t id = elem->getLogId();
+    LogBufferElementCollection& elements = mLogElements[id];
     // Insert elements in time sorted order if possible
     //  NB: if end is region locked, place element at end of list
-    LogBufferElementCollection::iterator it = mLogElements.end();
+    LogBufferElementCollection::iterator it = elements.end();
     LogBufferElementCollection::iterator last = it;
-    if (__predict_true(it != mLogElements.begin())) --it;
-    if (__predict_false(it == mLogElements.begin()) ||
+    if (__predict_true(it != elements.begin())) --it;
+    if (__predict_false(it == elements.begin()) ||
         __predict_true((*it)->getRealTime() <= elem->getRealTime()) ||
         __predict_false((((*it)->getRealTime().tv_sec - too_far_back) >
                          elem->getRealTime().tv_sec) &&
-                        (elem->getLogId() != LOG_ID_KERNEL) &&
-                        ((*it)->getLogId() != LOG_ID_KERNEL))) {
-        mLogElements.push_back(elem);
+                        (id != LOG_ID_KERNEL))) {
+        elements.push_back(elem);
+        it = --elements.end();
     } else {
         log_time end = log_time::EPOCH;
         bool end_set = false;
@@ -425,35 +479,44 @@ void LogBuffer::log(LogBufferElement* elem) {
         }
 
         if (end_always || (end_set && (end > (*it)->getRealTime()))) {
-            mLogElements.push_back(elem);
+            elements.push_back(elem);
+            it = --elements.end();
         } else {
             // should be short as timestamps are localized near end()
             do {
                 last = it;
-                if (__predict_false(it == mLogElements.begin())) {
+                if (__predict_false(it == elements.begin())) {
                     break;
                 }
                 --it;
             } while (((*it)->getRealTime() > elem->getRealTime()) &&
                      (!end_set || (end <= (*it)->getRealTime())));
-            mLogElements.insert(last, elem);
+            it = elements.insert(last, elem);
         }
         LogTimeEntry::unlock();
     }
 
+    if (!elem->getDropped()) {
+        index(it);
+    }
+
+    wrlock();
     stats.add(elem);
-    maybePrune(elem->getLogId());
+    unlock();
+    maybePrune(id);
 }
 
 // Prune at most 10% of the log entries or maxPrune, whichever is less.
 //
-// LogBuffer::wrlock() must be held when this function is called.
+// LogBuffer::wrlock(id) must be held when this function is called.
 void LogBuffer::maybePrune(log_id_t id) {
+    rdlock();
     size_t sizes = stats.sizes(id);
+    size_t elements = stats.realElements(id);
+    unlock();
     unsigned long maxSize = log_buffer_size(id);
     if (sizes > maxSize) {
         size_t sizeOver = sizes - ((maxSize * 9) / 10);
-        size_t elements = stats.realElements(id);
         size_t minElements = elements / 100;
         if (minElements < minPrune) {
             minElements = minPrune;
@@ -477,6 +540,10 @@ LogBufferElementCollection::iterator LogBuffer::erase(
     // Remove iterator references in the various lists that will become stale
     // after the element is erased from the main logging list.
 
+    if (!element->getDropped()) {
+        unindex(it);
+    }
+
     {  // start of scope for found iterator
         int key = ((id == LOG_ID_EVENTS) || (id == LOG_ID_SECURITY))
                       ? element->getTag()
@@ -499,30 +566,13 @@ LogBufferElementCollection::iterator LogBuffer::erase(
         }
     }
 
-    bool setLast[LOG_ID_MAX];
-    bool doSetLast = false;
-    log_id_for_each(i) {
-        doSetLast |= setLast[i] = mLastSet[i] && (it == mLast[i]);
-    }
 #ifdef DEBUG_CHECK_FOR_STALE_ENTRIES
     LogBufferElementCollection::iterator bad = it;
     int key = ((id == LOG_ID_EVENTS) || (id == LOG_ID_SECURITY))
                   ? element->getTag()
                   : element->getUid();
 #endif
-    it = mLogElements.erase(it);
-    if (doSetLast) {
-        log_id_for_each(i) {
-            if (setLast[i]) {
-                if (__predict_false(it == mLogElements.end())) {  // impossible
-                    mLastSet[i] = false;
-                    mLast[i] = mLogElements.begin();
-                } else {
-                    mLast[i] = it;  // push down the road as next-best-watermark
-                }
-            }
-        }
-    }
+    it = mLogElements[id].erase(it);
 #ifdef DEBUG_CHECK_FOR_STALE_ENTRIES
     log_id_for_each(i) {
         for (auto b : mLastWorst[i]) {
@@ -537,23 +587,72 @@ LogBufferElementCollection::iterator LogBuffer::erase(
                                  b.first);
             }
         }
-        if (mLastSet[i] && (bad == mLast[i])) {
-            android::prdebug("stale mLast[%d]\n", i);
-            mLastSet[i] = false;
-            mLast[i] = mLogElements.begin();
-        }
     }
 #endif
+    wrlock();
     if (coalesce) {
         stats.erase(element);
     } else {
         stats.subtract(element);
     }
+    unlock();
     delete element;
 
     return it;
 }
 
+static int pruneKey(const LogBufferElement* element) {
+    log_id_t id = element->getLogId();
+    return ((id == LOG_ID_EVENTS) || (id == LOG_ID_SECURITY))
+               ? element->getTag()
+               : element->getUid();
+}
+
+// Add a freshly logged entry to the worst offender index.
+//
+// LogBuffer::wrlock(id) must be held when this function is called.
+void LogBuffer::index(LogBufferElementCollection::iterator it) {
+    LogBufferElement* element = *it;
+    std::deque<LogBufferElementCollection::iterator>& entries =
+        mKeyIndex[element->getLogId()][pruneKey(element)];
+
+    // should be short as timestamps are localized near end()
+    std::deque<LogBufferElementCollection::iterator>::iterator pos =
+        entries.end();
+    while ((pos != entries.begin()) &&
+           ((**(pos - 1))->getRealTime() > element->getRealTime())) {
+        --pos;
+    }
+    entries.insert(pos, it);
+}
+
+// Remove an entry that is about to be erased or dropped from the worst
+// offender index.
+//
+// LogBuffer::wrlock(id) must be held when this function is called.
+void LogBuffer::unindex(LogBufferElementCollection::iterator it) {
+    LogBufferElement* element = *it;
+    LogBufferKeyIndex& index = mKeyIndex[element->getLogId()];
+    LogBufferKeyIndex::iterator found = index.find(pruneKey(element));
+    if (found == index.end()) {
+        return;
+    }
+
+    // Pruning is oldest first, expect to hit the front of the queue.
+    std::deque<LogBufferElementCollection::iterator>& entries = found->second;
+    for (std::deque<LogBufferElementCollection::iterator>::iterator pos =
+             entries.begin();
+         pos != entries.end(); ++pos) {
+        if (*pos == it) {
+            entries.erase(pos);
+            break;
+        }
+    }
+    if (entries.empty()) {
+        index.erase(found);
+    }
+}
+
 // Define a temporary mechanism to report the last LogBufferElement pointer
 // for the specified uid, pid and tid. Used below to help merge-sort when
 // pruning for worst UID.
@@ -630,16 +729,19 @@ class LogBufferElementLast {
 // the caller will use this result to set an internal busy flag indicating
 // the prune operation could not be completed because a reader is blocking
 // the request.
-bool LogBuffer::isBusy(log_time watermark) {
-    LogBufferElementCollection::iterator ei = mLogElements.end();
-    --ei;
-    return watermark < ((*ei)->getRealTime() - pruneMargin - log_time(1, 0));
+bool LogBuffer::isBusy(log_id_t id, log_time watermark) {
+    return watermark <
+           (mLogElements[id].back()->getRealTime() - pruneMargin -
+            log_time(1, 0));
 }
 
 // If the selected reader is blocking our pruning progress, decide on
 // what kind of mitigation is necessary to unblock the situation.
 void LogBuffer::kickMe(LogTimeEntry* me, log_id_t id, unsigned long pruneRows) {
-    if (stats.sizes(id) > (2 * log_buffer_size(id))) {  // +100%
+    rdlock();
+    size_t sizes = stats.sizes(id);
+    unlock();
+    if (sizes > (2 * log_buffer_size(id))) {  // +100%
         // A misbehaving or slow reader has its connection
         // dropped if we hit too much memory pressure.
         me->release_Locked();
@@ -698,12 +800,17 @@ void LogBuffer::kickMe(LogTimeEntry* me, log_id_t id, unsigned long pruneRows) {
 // The third thread is optional, and only gets hit if there was a whitelist
 // and more needs to be pruned against the backstop of the region lock.
 //
-// LogBuffer::wrlock() must be held when this function is called.
+// LogBuffer::wrlock(id) must be held when this function is called.
 //
 bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
     LogTimeEntry* oldest = nullptr;
     bool busy = false;
     bool clearAll = pruneRows == ULONG_MAX;
+    LogBufferElementCollection& elements = mLogElements[id];
+
+    if (elements.empty()) {
+        return false;
+    }
 
     LogTimeEntry::rdlock();
 
@@ -727,23 +834,17 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
     if (__predict_false(caller_uid != AID_ROOT)) {  // unlikely
         // Only here if clear all request from non system source, so chatty
         // filter logistics is not required.
-        it = mLastSet[id] ? mLast[id] : mLogElements.begin();
-        while (it != mLogElements.end()) {
+        it = elements.begin();
+        while (it != elements.end()) {
             LogBufferElement* element = *it;
 
-            if ((element->getLogId() != id) ||
-                (element->getUid() != caller_uid)) {
+            if (element->getUid() != caller_uid) {
                 ++it;
                 continue;
             }
 
-            if (!mLastSet[id] || ((*mLast[id])->getLogId() != id)) {
-                mLast[id] = it;
-                mLastSet[id] = true;
-            }
-
             if (oldest && (watermark <= element->getRealTime())) {
-                busy = isBusy(watermark);
+                busy = isBusy(id, watermark);
                 if (busy) kickMe(oldest, id, pruneRows);
                 break;
             }
@@ -770,6 +871,8 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
             // Calculate threshold as 12.5% of available storage
             size_t threshold = log_buffer_size(id) / 8;
 
+            rdlock();
+
             if ((id == LOG_ID_EVENTS) || (id == LOG_ID_SECURITY)) {
                 stats.sortTags(AID_ROOT, (pid_t)0, 2, id)
                     .findWorst(worst, worst_sizes, second_worst_sizes,
@@ -785,6 +888,7 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                         .findWorst(worstPid, worst_sizes, second_worst_sizes);
                 }
             }
+            unlock();
         }
 
         // skip if we have neither worst nor naughty filters
@@ -792,9 +896,20 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
             break;
         }
 
+        // Without a blacklist or a worst pid of system to honour, and outside
+        // of the mandatory garbage collection cycle, visit the entries of the
+        // worst offender directly rather than walking the entire log.
+        if (!hasBlacklist && !worstPid && (worst != -1) && (pruneRows > 1)) {
+            if (!pruneWorst(id, worst, worst_sizes, second_worst_sizes, oldest,
+                            watermark, pruneRows, busy)) {
+                break;
+            }
+            continue;
+        }
+
         bool kick = false;
         bool leading = true;
-        it = mLastSet[id] ? mLast[id] : mLogElements.begin();
+        it = elements.begin();
         // Perform at least one mandatory garbage collection cycle in following
         // - clear leading chatty tags
         // - coalesce chatty tags
@@ -805,7 +920,7 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                 LogBufferIteratorMap::iterator found =
                     mLastWorst[id].find(worst);
                 if ((found != mLastWorst[id].end()) &&
-                    (found->second != mLogElements.end())) {
+                    (found->second != elements.end())) {
                     leading = false;
                     it = found->second;
                 }
@@ -816,7 +931,7 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                 LogBufferPidIteratorMap::iterator found =
                     mLastWorstPidOfSystem[id].find(worstPid);
                 if ((found != mLastWorstPidOfSystem[id].end()) &&
-                    (found->second != mLogElements.end())) {
+                    (found->second != elements.end())) {
                     leading = false;
                     it = found->second;
                 }
@@ -824,29 +939,18 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
         }
         static const timespec too_old = { EXPIRE_HOUR_THRESHOLD * 60 * 60, 0 };
         LogBufferElementCollection::iterator lastt;
-        lastt = mLogElements.end();
+        lastt = elements.end();
         --lastt;
         LogBufferElementLast last;
-        while (it != mLogElements.end()) {
+        while (it != elements.end()) {
             LogBufferElement* element = *it;
 
             if (oldest && (watermark <= element->getRealTime())) {
-                busy = isBusy(watermark);
+                busy = isBusy(id, watermark);
                 // Do not let chatty eliding trigger any reader mitigation
                 break;
             }
 
-            if (element->getLogId() != id) {
-                ++it;
-                continue;
-            }
-            // below this point element->getLogId() == id
-
-            if (leading && (!mLastSet[id] || ((*mLast[id])->getLogId() != id))) {
-                mLast[id] = it;
-                mLastSet[id] = true;
-            }
-
             unsigned short dropped = element->getDropped();
 
             // remove any leading drops
@@ -933,7 +1037,10 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
             if (leading) {
                 it = erase(it);
             } else {
+                unindex(it);
+                wrlock();
                 stats.drop(element);
+                unlock();
                 element->setDropped(1);
                 if (last.coalesce(element, 1)) {
                     it = erase(it, true);
@@ -968,22 +1075,12 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
 
     bool whitelist = false;
     bool hasWhitelist = (id != LOG_ID_SECURITY) && mPrune.nice() && !clearAll;
-    it = mLastSet[id] ? mLast[id] : mLogElements.begin();
-    while ((pruneRows > 0) && (it != mLogElements.end())) {
+    it = elements.begin();
+    while ((pruneRows > 0) && (it != elements.end())) {
         LogBufferElement* element = *it;
 
-        if (element->getLogId() != id) {
-            it++;
-            continue;
-        }
-
-        if (!mLastSet[id] || ((*mLast[id])->getLogId() != id)) {
-            mLast[id] = it;
-            mLastSet[id] = true;
-        }
-
         if (oldest && (watermark <= element->getRealTime())) {
-            busy = isBusy(watermark);
+            busy = isBusy(id, watermark);
             if (!whitelist && busy) kickMe(oldest, id, pruneRows);
             break;
         }
@@ -1001,22 +1098,12 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
 
     // Do not save the whitelist if we are reader range limited
     if (whitelist && (pruneRows > 0)) {
-        it = mLastSet[id] ? mLast[id] : mLogElements.begin();
-        while ((it != mLogElements.end()) && (pruneRows > 0)) {
+        it = elements.begin();
+        while ((it != elements.end()) && (pruneRows > 0)) {
             LogBufferElement* element = *it;
 
-            if (element->getLogId() != id) {
-                ++it;
-                continue;
-            }
-
-            if (!mLastSet[id] || ((*mLast[id])->getLogId() != id)) {
-                mLast[id] = it;
-                mLastSet[id] = true;
-            }
-
             if (oldest && (watermark <= element->getRealTime())) {
-                busy = isBusy(watermark);
+                busy = isBusy(id, watermark);
                 if (busy) kickMe(oldest, id, pruneRows);
                 break;
             }
@@ -1031,6 +1118,83 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
     return (pruneRows > 0) && busy;
 }
 
+// Fast path of the worst offender pass. The entries of the worst key are
+// visited oldest first by means of mKeyIndex: a leading entry is erased, any
+// other becomes a chatty entry, merged with the chatty entry immediately in
+// front of it should that one report the same source. Returns true if any
+// row was pruned.
+//
+// LogBuffer::wrlock(id) must be held when this function is called.
+bool LogBuffer::pruneWorst(log_id_t id, int worst, size_t worst_sizes,
+                           size_t second_worst_sizes, LogTimeEntry* oldest,
+                           const log_time& watermark, unsigned long& pruneRows,
+                           bool& busy) {
+    static const timespec too_old = { EXPIRE_HOUR_THRESHOLD * 60 * 60, 0 };
+    LogBufferElementCollection& elements = mLogElements[id];
+    bool kick = false;
+
+    // remove any leading drops
+    while (!elements.empty() && elements.front()->getDropped() &&
+           (!oldest || (watermark > elements.front()->getRealTime()))) {
+        erase(elements.begin());
+    }
+    if (elements.empty()) {
+        return false;
+    }
+    log_time newest = elements.back()->getRealTime();
+
+    while (pruneRows > 0) {
+        LogBufferKeyIndex::iterator found = mKeyIndex[id].find(worst);
+        if (found == mKeyIndex[id].end()) {
+            break;
+        }
+        LogBufferElementCollection::iterator it = found->second.front();
+        LogBufferElement* element = *it;
+
+        if (oldest && (watermark <= element->getRealTime())) {
+            busy = isBusy(id, watermark);
+            // Do not let chatty eliding trigger any reader mitigation
+            break;
+        }
+
+        if ((element->getRealTime() < (newest - too_old)) ||
+            (element->getRealTime() > newest)) {
+            break;
+        }
+
+        kick = true;
+        pruneRows--;
+
+        unsigned short len = element->getMsgLen();
+
+        // do not create any leading drops
+        if (it == elements.begin()) {
+            erase(it);
+        } else {
+            LogBufferElement* before = *std::prev(it);
+            unindex(it);
+            wrlock();
+            stats.drop(element);
+            unlock();
+            element->setDropped(1);
+            unsigned short dropped = before->getDropped();
+            if (dropped && (dropped < USHRT_MAX) &&
+                (before->getUid() == element->getUid()) &&
+                (before->getPid() == element->getPid()) &&
+                (before->getTid() == element->getTid())) {
+                before->setDropped(dropped + 1);
+                erase(it, true);
+            }
+        }
+        if (worst_sizes < second_worst_sizes) {
+            break;
+        }
+        worst_sizes -= len;
+    }
+
+    return kick;
+}
+
 // clear all rows of type "id" from the buffer.
 bool LogBuffer::clear(log_id_t id, uid_t uid) {
     bool busy = true;
@@ -1041,9 +1205,9 @@ bool LogBuffer::clear(log_id_t id, uid_t uid) {
             // one entry, not another clear run, so we are looking for
             // the quick side effect of the return value to tell us if
             // we have a _blocked_ reader.
-            wrlock();
+            wrlock(id);
             busy = prune(id, 1, uid);
-            unlock();
+            unlock(id);
             // It is still busy, blocked reader(s), lets kill them all!
             // otherwise, lets be a good citizen and preserve the slow
             // readers and let the clear run (below) deal with determining
@@ -1062,9 +1226,9 @@ bool LogBuffer::clear(log_id_t id, uid_t uid) {
                 LogTimeEntry::unlock();
             }
         }
-        wrlock();
+        wrlock(id);
         busy = prune(id, ULONG_MAX, uid);
-        unlock();
+        unlock(id);
         if (!busy || !--retry) {
             break;
         }
@@ -1087,54 +1251,76 @@ int LogBuffer::setSize(log_id_t id, unsigned long size) {
     if (!__android_logger_valid_buffer_size(size)) {
         return -1;
     }
-    wrlock();
+    wrlock(id);
     log_buffer_size(id) = size;
-    unlock();
+    unlock(id);
     return 0;
 }
 
 // get the total space allocated to "id"
 unsigned long LogBuffer::getSize(log_id_t id) {
-    rdlock();
+    rdlock(id);
     size_t retval = log_buffer_size(id);
-    unlock();
+    unlock(id);
     return retval;
 }
 
+// Locate the first element of log id "id" that follows start, chances are we
+// are better off starting from the end of the time sorted list.
+//
+// LogBuffer::rdlock(id) must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::findStart(
+    log_id_t id, const log_time& start) {
+    LogBufferElementCollection& elements = mLogElements[id];
+
+    if (start == log_time::EPOCH) {
+        // client wants to start from the beginning
+        return elements.begin();
+    }
+
+    // Cap to 300 iterations we look back for out-of-order entries.
+    size_t count = 300;
+
+    LogBufferElementCollection::iterator it;
+    LogBufferElementCollection::iterator last;
+    for (last = it = elements.end(); it != elements.begin();
+         /* do nothing */) {
+        --it;
+        LogBufferElement* element = *it;
+        if (element->getRealTime() > start) {
+            last = it;
+        } else if (element->getRealTime() == start) {
+            last = ++it;
+            break;
+        } else if (!--count) {
+            break;
+        }
+    }
+    return last;
+}
+
 log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
                             pid_t* lastTid, bool privileged, bool security,
                             int (*filter)(const LogBufferElement* element,
                                           void* arg),
                             void* arg) {
-    LogBufferElementCollection::iterator it;
+    // Each log id is walked under its own lock, the oldest of the heads is
+    // the next one reported. A log id that has run dry is looked at again
+    // on every pass as new content may arrive at any time.
+    LogBufferElementCollection::iterator it[LOG_ID_MAX];
+    bool more[LOG_ID_MAX];
     uid_t uid = reader->getUid();
+    LogFlushBatch batch(reader);
 
-    rdlock();
-
-    if (start == log_time::EPOCH) {
-        // client wants to start from the beginning
-        it = mLogElements.begin();
-    } else {
-        // Cap to 300 iterations we look back for out-of-order entries.
-        size_t count = 300;
-
-        // Client wants to start from some specified time. Chances are
-        // we are better off starting from the end of the time sorted list.
-        LogBufferElementCollection::iterator last;
-        for (last = it = mLogElements.end(); it != mLogElements.begin();
-             /* do nothing */) {
-            --it;
-            LogBufferElement* element = *it;
-            if (element->getRealTime() > start) {
-                last = it;
-            } else if (element->getRealTime() == start) {
-                last = ++it;
-                break;
-            } else if (!--count) {
-                break;
-            }
+    log_id_for_each(i) {
+        more[i] = false;
+        if (!security && (i == LOG_ID_SECURITY)) {
+            continue;
         }
-        it = last;
+        rdlock(i);
+        it[i] = findStart(i, start);
+        more[i] = it[i] != mLogElements[i].end();
+        unlock(i);
     }
 
     log_time curr = start;
@@ -1142,64 +1328,91 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
     LogBufferElement* lastElement = nullptr;  // iterator corruption paranoia
     static const size_t maxSkip = 4194304;    // maximum entries to skip
     size_t skip = maxSkip;
-    for (; it != mLogElements.end(); ++it) {
-        LogBufferElement* element = *it;
+    for (;;) {
+        LogBufferElement* element = nullptr;
+        log_id_t id = LOG_ID_MAX;
+
+        log_id_for_each(i) {
+            if (!security && (i == LOG_ID_SECURITY)) {
+                continue;
+            }
+            rdlock(i);
+            if (!more[i] && !mLogElements[i].empty() &&
+                (mLogElements[i].back()->getRealTime() > curr)) {
+                it[i] = findStart(i, curr);
+                more[i] = it[i] != mLogElements[i].end();
+            }
+            if (more[i] && (!element ||
+                            ((*it[i])->getRealTime() < element->getRealTime()))) {
+                element = *it[i];
+                id = i;
+            }
+            unlock(i);
+        }
+        if (!element) {
+            break;
+        }
+
+        rdlock(id);
+        more[id] = ++it[id] != mLogElements[id].end();
 
         if (!--skip) {
             android::prdebug("reader.per: too many elements skipped");
+            unlock(id);
             break;
         }
         if (element == lastElement) {
             android::prdebug("reader.per: identical elements");
+            unlock(id);
             break;
         }
         lastElement = element;
 
         if (!privileged && (element->getUid() != uid)) {
+            unlock(id);
             continue;
         }
 
-        if (!security && (element->getLogId() == LOG_ID_SECURITY)) {
-            continue;
-        }
-
-        // NB: calling out to another object with wrlock() held (safe)
+        // NB: calling out to another object with rdlock(id) held (safe)
         if (filter) {
             int ret = (*filter)(element, arg);
             if (ret == false) {
+                unlock(id);
                 continue;
             }
             if (ret != true) {
+                unlock(id);
                 break;
             }
         }
 
         bool sameTid = false;
         if (lastTid) {
-            sameTid = lastTid[element->getLogId()] == element->getTid();
+            sameTid = lastTid[id] == element->getTid();
             // Dropped (chatty) immediately following a valid log from the
             // same source in the same log buffer indicates we have a
             // multiple identical squash.  chatty that differs source
             // is due to spam filter.  chatty to chatty of different
             // source is also due to spam filter.
-            lastTid[element->getLogId()] =
+            lastTid[id] =
                 (element->getDropped() && !sameTid) ? 0 : element->getTid();
         }
 
-        unlock();
+        unlock(id);
 
         // range locking in LastLogTimes looks after us
-        curr = element->flushTo(reader, this, privileged, sameTid);
+        curr = element->flushTo(batch, this, privileged, sameTid);
 
         if (curr == element->FLUSH_ERROR) {
             return curr;
         }
 
         skip = maxSkip;
-        rdlock();
     }
-    unlock();
 
+    if (!batch.flush()) {
+        return LogBufferElement::FLUSH_ERROR;
+    }
     return curr;
 }
 
@@ -19,8 +19,10 @@
 
 #include <sys/types.h>
 
+#include <deque>
 #include <list>
 #include <string>
+#include <unordered_map>
 
 #include <android/log.h>
 #include <private/android_filesystem_config.h>
@@ -75,16 +77,30 @@ static bool isMonotonic(const log_time& mono) {
 
 typedef std::list<LogBufferElement*> LogBufferElementCollection;
 
-class LogBuffer : public LogBufferInterface {
-    LogBufferElementCollection mLogElements;
-    pthread_rwlock_t mLogElementsLock;
+// An entry of a batch handed to LogBuffer::log(log_id, entries, count),
+// msg must remain valid for the duration of the call.
+struct LogBufferEntry {
+    log_time realtime;
+    uid_t uid;
+    pid_t pid;
+    pid_t tid;
+    const char* msg;
+    unsigned short len;
+};
 
+class LogBuffer : public LogBufferInterface {
+    // One time sorted collection per log id, each behind its own lock so
+    // that writers and readers of different log ids never contend. Readers
+    // interested in multiple log ids merge the collections in flushTo().
+    LogBufferElementCollection mLogElements[LOG_ID_MAX];
+    pthread_rwlock_t mLogElementsLock[LOG_ID_MAX];
+
+    // Statistics are shared by all log ids. mStatsLock is always the
+    // innermost lock, it is never held while acquiring another one.
     LogStatistics stats;
+    pthread_rwlock_t mStatsLock;
 
     PruneList mPrune;
-    // watermark for last per log id
-    LogBufferElementCollection::iterator mLast[LOG_ID_MAX];
-    bool mLastSet[LOG_ID_MAX];
     // watermark of any worst/chatty uid processing
     typedef std::unordered_map<uid_t, LogBufferElementCollection::iterator>
         LogBufferIteratorMap;
@@ -93,6 +109,13 @@ class LogBuffer : public LogBufferInterface {
     typedef std::unordered_map<pid_t, LogBufferElementCollection::iterator>
         LogBufferPidIteratorMap;
     LogBufferPidIteratorMap mLastWorstPidOfSystem[LOG_ID_MAX];
+    // age ordered index of the entries that have not yet been dropped, per
+    // worst offender key (tag for binary logs, uid for the rest), lets the
+    // worst uid prune visit its victims without walking the others.
+    typedef std::unordered_map<
+        int, std::deque<LogBufferElementCollection::iterator>>
+        LogBufferKeyIndex;
+    LogBufferKeyIndex mKeyIndex[LOG_ID_MAX];
 
     unsigned long mMaxSize[LOG_ID_MAX];
 
@@ -103,6 +126,10 @@ class LogBuffer : public LogBufferInterface {
     LogBufferElement* lastLoggedElements[LOG_ID_MAX];
     LogBufferElement* droppedElements[LOG_ID_MAX];
     void log(LogBufferElement* elem);
+    LogBufferElement* prepare(log_id_t log_id, log_time realtime, uid_t uid,
+                              pid_t pid, pid_t tid, const char* msg,
+                              unsigned short len);
+    int logLocked(LogBufferElement* elem, unsigned short len);
 
    public:
     LastLogTimes& mTimes;
@@ -116,6 +143,7 @@ class LogBuffer : public LogBufferInterface {
 
     int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
             const char* msg, unsigned short len) override;
+    int log(log_id_t log_id, const LogBufferEntry* entries, size_t count);
     // lastTid is an optional context to help detect if the last previous
     // valid message was from the same source so we can differentiate chatty
     // filter types (identical or expired)
@@ -168,14 +196,18 @@ class LogBuffer : public LogBufferInterface {
     const char* uidToName(uid_t uid) {
         return stats.uidToName(uid);
     }
+    void addAuditDenial(bool coalesced) {
+        stats.addAuditDenial(coalesced);
+    }
+    // wrlock()/rdlock()/unlock() protect the statistics and helpers above
     void wrlock() {
-        pthread_rwlock_wrlock(&mLogElementsLock);
+        pthread_rwlock_wrlock(&mStatsLock);
     }
     void rdlock() {
-        pthread_rwlock_rdlock(&mLogElementsLock);
+        pthread_rwlock_rdlock(&mStatsLock);
     }
     void unlock() {
-        pthread_rwlock_unlock(&mLogElementsLock);
+        pthread_rwlock_unlock(&mStatsLock);
     }
 
    private:
@@ -183,13 +215,31 @@ class LogBuffer : public LogBufferInterface {
     static constexpr size_t maxPrune = 256;
     static const log_time pruneMargin;
 
+    void wrlock(log_id_t id) {
+        pthread_rwlock_wrlock(&mLogElementsLock[id]);
+    }
+    void rdlock(log_id_t id) {
+        pthread_rwlock_rdlock(&mLogElementsLock[id]);
+    }
+    void unlock(log_id_t id) {
+        pthread_rwlock_unlock(&mLogElementsLock[id]);
+    }
+
     void maybePrune(log_id_t id);
-    bool isBusy(log_time watermark);
+    bool isBusy(log_id_t id, log_time watermark);
     void kickMe(LogTimeEntry* me, log_id_t id, unsigned long pruneRows);
 
     bool prune(log_id_t id, unsigned long pruneRows, uid_t uid = AID_ROOT);
+    bool pruneWorst(log_id_t id, int worst, size_t worst_sizes,
+                    size_t second_worst_sizes, LogTimeEntry* oldest,
+                    const log_time& watermark, unsigned long& pruneRows,
+                    bool& busy);
+    void index(LogBufferElementCollection::iterator it);
+    void unindex(LogBufferElementCollection::iterator it);
     LogBufferElementCollection::iterator erase(
         LogBufferElementCollection::iterator it, bool coalesce = false);
+    LogBufferElementCollection::iterator findStart(log_id_t id,
+                                                   const log_time& start);
 };
 
 #endif  // _LOGD_LOG_BUFFER_H__
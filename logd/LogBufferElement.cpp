@@ -26,8 +26,11 @@
 
 #include "LogBuffer.h"
 #include "LogBufferElement.h"
+#include "LogChunkAllocator.h"
 #include "LogCommand.h"
+#include "LogFlushBatch.h"
 #include "LogReader.h"
+#include "LogSlabAllocator.h"
 #include "LogUtils.h"
 
 const log_time LogBufferElement::FLUSH_ERROR((uint32_t)-1, (uint32_t)-1);
@@ -43,7 +46,7 @@ LogBufferElement::LogBufferElement(log_id_t log_id, log_time realtime,
       mMsgLen(len),
       mLogId(log_id),
       mDropped(false) {
-    mMsg = new char[len];
+    mMsg = LogChunkAllocator::get(log_id).allocate(len);
     memcpy(mMsg, msg, len);
 }
 
@@ -55,12 +58,24 @@ LogBufferElement::LogBufferElement(const LogBufferElement& elem)
       mMsgLen(elem.mMsgLen),
       mLogId(elem.mLogId),
       mDropped(elem.mDropped) {
-    mMsg = new char[mMsgLen];
+    mMsg = LogChunkAllocator::get(getLogId()).allocate(mMsgLen);
     memcpy(mMsg, elem.mMsg, mMsgLen);
 }
 
 LogBufferElement::~LogBufferElement() {
-    delete[] mMsg;
+    LogChunkAllocator::get(getLogId()).release(mMsg);
+}
+
+void* LogBufferElement::operator new(size_t size, log_id_t log_id) {
+    return LogSlabAllocator::get(log_id).allocate(size);
+}
+
+void LogBufferElement::operator delete(void* ptr, log_id_t /* log_id */) {
+    LogSlabAllocator::release(ptr);
+}
+
+void LogBufferElement::operator delete(void* ptr) {
+    LogSlabAllocator::release(ptr);
 }
 
 uint32_t LogBufferElement::getTag() const {
@@ -76,13 +91,15 @@ unsigned short LogBufferElement::setDropped(unsigned short value) {
     // save only the information needed to get the tag.
     if (getTag() != 0) {
         if (mMsgLen > sizeof(android_event_header_t)) {
-            char* truncated_msg = new char[sizeof(android_event_header_t)];
+            LogChunkAllocator& allocator = LogChunkAllocator::get(getLogId());
+            char* truncated_msg =
+                allocator.allocate(sizeof(android_event_header_t));
             memcpy(truncated_msg, mMsg, sizeof(android_event_header_t));
-            delete[] mMsg;
+            allocator.release(mMsg);
             mMsg = truncated_msg;
         }  // mMsgLen == sizeof(android_event_header_t), already at minimum.
     } else {
-        delete[] mMsg;
+        LogChunkAllocator::get(getLogId()).release(mMsg);
         mMsg = nullptr;
     }
     mDropped = true;
@@ -228,7 +245,7 @@ size_t LogBufferElement::populateDroppedMessage(char*& buffer, LogBuffer* parent
     return retval;
 }
 
-log_time LogBufferElement::flushTo(SocketClient* reader, LogBuffer* parent,
+log_time LogBufferElement::flushTo(LogFlushBatch& batch, LogBuffer* parent,
                                    bool privileged, bool lastSame) {
     struct logger_entry_v4 entry;
 
@@ -259,9 +276,8 @@ log_time LogBufferElement::flushTo(SocketClient* reader, LogBuffer* parent,
     }
     iovec[1].iov_len = entry.len;
 
-    log_time retval = reader->sendDatav(iovec, 1 + (entry.len != 0))
-                          ? FLUSH_ERROR
-                          : mRealTime;
+    log_time retval =
+        batch.add(iovec, 1 + (entry.len != 0)) ? mRealTime : FLUSH_ERROR;
 
     if (buffer) free(buffer);
 
@@ -25,6 +25,7 @@
 #include <sysutils/SocketClient.h>
 
 class LogBuffer;
+class LogFlushBatch;
 
 #define EXPIRE_HOUR_THRESHOLD 24  // Only expire chatty UID logs to preserve
                                   // non-chatty UIDs less than this age in hours
@@ -60,6 +61,11 @@ class __attribute__((packed)) LogBufferElement {
     LogBufferElement(const LogBufferElement& elem);
     ~LogBufferElement();
 
+    // Elements live in the LogSlabAllocator of their log id.
+    static void* operator new(size_t size, log_id_t log_id);
+    static void operator delete(void* ptr, log_id_t log_id);
+    static void operator delete(void* ptr);
+
     bool isBinary(void) const {
         return (mLogId == LOG_ID_EVENTS) || (mLogId == LOG_ID_SECURITY);
     }
@@ -92,7 +98,7 @@ class __attribute__((packed)) LogBufferElement {
     }
 
     static const log_time FLUSH_ERROR;
-    log_time flushTo(SocketClient* writer, LogBuffer* parent, bool privileged,
+    log_time flushTo(LogFlushBatch& batch, LogBuffer* parent, bool privileged,
                      bool lastSame);
 };
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <log/log.h>
+
+#include "LogChunkAllocator.h"
+
+static_assert((LogChunkAllocator::kChunkSize &
+               (LogChunkAllocator::kChunkSize - 1)) == 0,
+              "kChunkSize must be a power of two");
+static_assert(LogChunkAllocator::kChunkSize > (2 * LOGGER_ENTRY_MAX_PAYLOAD),
+              "kChunkSize must hold several maximum sized payloads");
+
+// payloads are held at this alignment, keeps the binary event headers
+// friendly to the cpu without costing much space for text logs.
+static constexpr size_t alignment = sizeof(uint32_t);
+
+LogChunkAllocator& LogChunkAllocator::get(log_id_t id) {
+    static LogChunkAllocator allocators[LOG_ID_MAX];
+    return allocators[(id < LOG_ID_MAX) ? id : LOG_ID_MAIN];
+}
+
+// LogChunkAllocator::mLock must be held when this function is called.
+LogChunkAllocator::Chunk* LogChunkAllocator::newChunk() {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kChunkSize, kChunkSize)) {
+        return nullptr;
+    }
+    Chunk* chunk = static_cast<Chunk*>(memory);
+    chunk->used = (sizeof(Chunk) + alignment - 1) & ~(alignment - 1);
+    chunk->live = 0;
+    ++mChunks;
+    return chunk;
+}
+
+char* LogChunkAllocator::allocate(size_t len) {
+    len = (len + alignment - 1) & ~(alignment - 1);
+    if (!len) len = alignment;
+
+    pthread_mutex_lock(&mLock);
+    Chunk* chunk = mCurrent;
+    if (!chunk || ((kChunkSize - chunk->used) < len)) {
+        // Seal the current chunk, it is released by its last payload.
+        if (chunk && !chunk->live) {
+            free(chunk);
+            --mChunks;
+        }
+        chunk = mCurrent = newChunk();
+        // Out of memory, fail exactly as operator new[] would have.
+        if (!chunk) abort();
+    }
+    char* msg = reinterpret_cast<char*>(chunk) + chunk->used;
+    chunk->used += len;
+    ++chunk->live;
+    pthread_mutex_unlock(&mLock);
+
+    return msg;
+}
+
+void LogChunkAllocator::release(char* msg) {
+    if (!msg) return;
+
+    Chunk* chunk = chunkOf(msg);
+    pthread_mutex_lock(&mLock);
+    if (!--chunk->live) {
+        if (chunk == mCurrent) {
+            // Rewind rather than hand back the chunk we are filling.
+            chunk->used = (sizeof(Chunk) + alignment - 1) & ~(alignment - 1);
+        } else {
+            free(chunk);
+            --mChunks;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_CHUNK_ALLOCATOR_H__
+#define _LOGD_LOG_CHUNK_ALLOCATOR_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <log/log_id.h>
+
+// Packs log message payloads contiguously into fixed-size, naturally aligned
+// chunks. Payloads are bump allocated from the current chunk of the log id
+// and a chunk is handed back to the system as soon as the last payload it
+// holds is released. Since pruning expires oldest entries first, chunks are
+// emptied and released in roughly the order they were filled, and readers
+// walking the buffer touch sequential memory rather than scattered heap
+// allocations.
+//
+// One allocator exists per log id so an active buffer never pins chunks on
+// behalf of a quiet one.
+class LogChunkAllocator {
+   public:
+    // Must be a power of two. Every payload up to LOGGER_ENTRY_MAX_PAYLOAD
+    // fits in a chunk with room to spare.
+    static constexpr size_t kChunkSize = 32768;
+
+    static LogChunkAllocator& get(log_id_t id);
+
+    char* allocate(size_t len);
+    void release(char* msg);
+
+    // Statistics, bytes of chunk memory held by this log id.
+    size_t sizes() const {
+        return mChunks * kChunkSize;
+    }
+    size_t chunks() const {
+        return mChunks;
+    }
+
+   private:
+    struct Chunk {
+        size_t used;  // bump offset, including this header
+        size_t live;  // number of payloads not yet released
+    };
+
+    pthread_mutex_t mLock = PTHREAD_MUTEX_INITIALIZER;
+    Chunk* mCurrent = nullptr;
+    std::atomic<size_t> mChunks{ 0 };
+
+    static Chunk* chunkOf(const char* msg) {
+        return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(msg) &
+                                        ~(kChunkSize - 1));
+    }
+    Chunk* newChunk();
+};
+
+#endif  // _LOGD_LOG_CHUNK_ALLOCATOR_H__
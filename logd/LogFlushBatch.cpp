@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "LogFlushBatch.h"
+
+static_assert(LogFlushBatch::kBufferSize >=
+                  (sizeof(struct logger_entry_v4) + LOGGER_ENTRY_MAX_PAYLOAD),
+              "kBufferSize must hold a maximum sized record");
+
+bool LogFlushBatch::add(const struct iovec* iov, int iovcnt) {
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+
+    if (((kBufferSize - mUsed) < len) || (mRecords >= kMaxRecords)) {
+        if (!flush()) {
+            return false;
+        }
+    }
+    if (!mBuffer) {
+        mBuffer.reset(new char[kBufferSize]);
+    }
+
+    char* record = mBuffer.get() + mUsed;
+    char* cp = record;
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(cp, iov[i].iov_base, iov[i].iov_len);
+        cp += iov[i].iov_len;
+    }
+    mUsed += len;
+
+    mIovecs[mRecords].iov_base = record;
+    mIovecs[mRecords].iov_len = len;
+    memset(&mMessages[mRecords], 0, sizeof(mMessages[mRecords]));
+    mMessages[mRecords].msg_hdr.msg_iov = &mIovecs[mRecords];
+    mMessages[mRecords].msg_hdr.msg_iovlen = 1;
+    ++mRecords;
+
+    return true;
+}
+
+bool LogFlushBatch::flush() {
+    if (!mRecords) {
+        return true;
+    }
+    int ret = mReader->sendDatamv(mMessages, mRecords);
+    mUsed = 0;
+    mRecords = 0;
+    return ret == 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_FLUSH_BATCH_H__
+#define _LOGD_LOG_FLUSH_BATCH_H__
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <memory>
+
+#include <log/log.h>
+#include <sysutils/SocketClient.h>
+
+// Collects the records LogBuffer::flushTo() reports to one reader and hands
+// them to the socket in as few sendmmsg() calls as possible. Every record
+// keeps its own packet on the reader socket, so the wire protocol is
+// unchanged. Records are copied in: the element they came from may be pruned
+// as soon as the reader moves past it, long before the batch is sent.
+class LogFlushBatch {
+   public:
+    static constexpr size_t kMaxRecords = 64;
+    static constexpr size_t kBufferSize = 65536;
+
+    explicit LogFlushBatch(SocketClient* reader) : mReader(reader) {
+    }
+
+    // Returns false if the batch could not be sent to make room.
+    bool add(const struct iovec* iov, int iovcnt);
+    // Returns false on socket error, the reader should be dropped.
+    bool flush();
+
+   private:
+    SocketClient* mReader;
+    std::unique_ptr<char[]> mBuffer;
+    size_t mUsed = 0;
+    size_t mRecords = 0;
+    struct iovec mIovecs[kMaxRecords];
+    struct mmsghdr mMessages[kMaxRecords];
+};
+
+#endif  // _LOGD_LOG_FLUSH_BATCH_H__
@@ -210,7 +210,10 @@ LogKlog::LogKlog(LogBuffer* buf, LogReader* reader, int fdWrite, int fdRead,
       signature(CLOCK_MONOTONIC),
       initialized(false),
       enableLogging(true),
-      auditd(auditd) {
+      auditd(auditd),
+      batchCount(0),
+      batchUsed(0) {
+    memset(uidCache, 0, sizeof(uidCache));
     static const char klogd_message[] = "%s%s%" PRIu64 "\n";
     char buffer[strlen(priority_message) + strlen(klogdStr) +
                 strlen(klogd_message) + 20];
@@ -255,9 +258,10 @@ bool LogKlog::onDataAvailable(SocketClient* cli) {
                 break;
             }
             if ((sublen > 0) && *tok) {
-                log(tok, sublen);
+                queue(tok, sublen);
             }
         }
+        flush();
     }
 
     return true;
@@ -545,6 +549,51 @@ static const char* strnrchr(const char* s, ssize_t len, char c) {
 // return -1 if message logd.klogd: <signature>
 //
 int LogKlog::log(const char* buf, ssize_t len) {
+    int rc = queue(buf, len);
+    if (rc <= 0) return rc;
+    return flush();
+}
+
+// Returns the number of entries inserted by LogBuffer::log() for a batch,
+// or what LogBuffer::log() returned for a lone entry.
+int LogKlog::flush() {
+    memset(uidCache, 0, sizeof(uidCache));
+    if (!batchCount) return 0;
+
+    int rc;
+    if (batchCount == 1) {
+        const LogBufferEntry& e = batch[0];
+        rc = logbuf->log(LOG_ID_KERNEL, e.realtime, e.uid, e.pid, e.tid, e.msg,
+                         e.len);
+    } else {
+        rc = logbuf->log(LOG_ID_KERNEL, batch, batchCount);
+    }
+    batchCount = 0;
+    batchUsed = 0;
+
+    // notify readers, once for the whole batch
+    if (rc > 0) {
+        reader->notifyNewLog(static_cast<log_mask_t>(1 << LOG_ID_KERNEL));
+    }
+
+    return rc;
+}
+
+// Kernel log storms come from a handful of pids, spare the statistics lock.
+uid_t LogKlog::pidToUid(pid_t pid) {
+    auto& entry = uidCache[pid & (kUidCacheSize - 1)];
+    if (entry.pid != pid) {
+        logbuf->wrlock();
+        entry.uid = logbuf->pidToUid(pid);
+        logbuf->unlock();
+        entry.pid = pid;
+    }
+    return entry.uid;
+}
+
+// Parses a line and appends it to the batch, returns the length queued, 0
+// when the line is dropped, negative on error or at the klogd start marker.
+int LogKlog::queue(const char* buf, ssize_t len) {
     if (auditd && android::strnstr(buf, len, auditStr)) {
         return 0;
     }
@@ -579,9 +628,7 @@ int LogKlog::log(const char* buf, ssize_t len) {
     const pid_t tid = pid;
     uid_t uid = AID_ROOT;
     if (pid) {
-        logbuf->wrlock();
-        uid = logbuf->pidToUid(pid);
-        logbuf->unlock();
+        uid = pidToUid(pid);
     }
 
     // Parse (rules at top) to pull out a tag from the incoming kernel message.
@@ -773,12 +820,18 @@ int LogKlog::log(const char* buf, ssize_t len) {
     }
 
     // Careful.
-    // We are using the stack to house the log buffer for speed reasons.
+    // We are using batchData to house the log buffer for speed reasons.
     // If we malloc'd this buffer, we could get away without n's USHRT_MAX
     // test above, but we would then required a max(n, USHRT_MAX) as
-    // truncating length argument to logbuf->log() below. Gain is protection
-    // of stack sanity and speedup, loss is truncated long-line content.
-    char newstr[n];
+    // truncating length argument to logbuf->log() below. Gain is speedup,
+    // loss is truncated long-line content.
+    if ((batchCount >= kBatchMax) || (n > (ssize_t)(kBatchData - batchUsed))) {
+        flush();
+    }
+    if (n > (ssize_t)kBatchData) {
+        return -EINVAL;
+    }
+    char* newstr = batchData + batchUsed;
     char* np = newstr;
 
     // Convert priority into single-byte Android logger priority
@@ -820,14 +873,15 @@ int LogKlog::log(const char* buf, ssize_t len) {
         }
     }
 
-    // Log message
-    int rc = logbuf->log(LOG_ID_KERNEL, now, uid, pid, tid, newstr,
-                         (unsigned short)n);
-
-    // notify readers
-    if (rc > 0) {
-        reader->notifyNewLog(static_cast<log_mask_t>(1 << LOG_ID_KERNEL));
-    }
+    // Queue message
+    LogBufferEntry& e = batch[batchCount++];
+    e.realtime = now;
+    e.uid = uid;
+    e.pid = pid;
+    e.tid = tid;
+    e.msg = newstr;
+    e.len = n;
+    batchUsed += n;
 
-    return rc;
+    return n;
 }
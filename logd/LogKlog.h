@@ -20,7 +20,8 @@
 #include <private/android_logger.h>
 #include <sysutils/SocketListener.h>
 
-class LogBuffer;
+#include "LogBuffer.h"
+
 class LogReader;
 
 class LogKlog : public SocketListener {
@@ -38,6 +39,26 @@ class LogKlog : public SocketListener {
 
     static log_time correction;
 
+    // Lines parsed out of a read from the kernel, inserted into logbuf with
+    // a single acquisition of its lock. Messages are packed in batchData.
+    static constexpr size_t kBatchMax = 64;
+    static constexpr size_t kBatchData = 4 * LOGGER_ENTRY_MAX_PAYLOAD;
+    LogBufferEntry batch[kBatchMax];
+    size_t batchCount;
+    char batchData[kBatchData];
+    size_t batchUsed;
+
+    // Uids of the pids sniffed so far this batch, direct mapped.
+    static constexpr size_t kUidCacheSize = 16;
+    struct {
+        pid_t pid;
+        uid_t uid;
+    } uidCache[kUidCacheSize];
+
+    int queue(const char* buf, ssize_t len);
+    int flush();
+    uid_t pidToUid(pid_t pid);
+
    public:
     LogKlog(LogBuffer* buf, LogReader* reader, int fdWrite, int fdRead,
             bool auditd);
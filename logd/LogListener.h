@@ -17,7 +17,15 @@
 #ifndef _LOGD_LOG_LISTENER_H__
 #define _LOGD_LOG_LISTENER_H__
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <string>
+
+#include <private/android_logger.h>
 #include <sysutils/SocketListener.h>
+#include "LogRateLimit.h"
 #include "LogReader.h"
 
 // DEFAULT_OVERFLOWUID is defined in linux/highuid.h, which is not part of
@@ -34,13 +42,33 @@ class LogListener : public SocketListener {
     LogBufferInterface* logbuf;
     LogReader* reader;
 
+    // maximum number of datagrams received per wakeup
+    static const unsigned int maxBatch = 16;
+    // histogram of the number of datagrams received per wakeup
+    static std::atomic<unsigned long> batches[maxBatch];
+    // per uid limit on what is accepted into the log buffers
+    static LogRateLimit rateLimit;
+
+    // + 1 to ensure null terminator if MAX_PAYLOAD buffer is received
+    char mBuffers[maxBatch][sizeof_log_id_t + sizeof(uint16_t) +
+                            sizeof(log_time) + LOGGER_ENTRY_MAX_PAYLOAD + 1];
+    alignas(struct cmsghdr)
+        char mControls[maxBatch][CMSG_SPACE(sizeof(struct ucred))];
+    struct iovec mIovecs[maxBatch];
+    struct mmsghdr mMessages[maxBatch];
+
    public:
     LogListener(LogBufferInterface* buf, LogReader* reader /* nullable */);
 
+    static std::string formatStatistics();
+    // (Re)reads the rate limit properties
+    static void initRateLimit();
+
    protected:
     virtual bool onDataAvailable(SocketClient* cli);
 
    private:
+    log_mask_t logMessage(char* buffer, ssize_t n, struct msghdr* hdr);
     static int getLogSocket();
 };
 
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <cutils/properties.h>
+#include <private/android_filesystem_config.h>
+
+#include "LogRateLimit.h"
+
+// Default bytes per second an app uid may log.
+static const uint64_t default_rate = 128 * 1024;
+
+// Reads a number with an optional K or M multiplier, like persist.logd.size.
+static bool property_get_size(const char* key, uint64_t* value) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(key, property, "") <= 0) {
+        return false;
+    }
+
+    char* cp;
+    uint64_t size = strtoull(property, &cp, 10);
+    switch (toupper(*cp)) {
+        case 'M':
+            size *= 1024;
+        /* FALLTHRU */
+        case 'K':
+            size *= 1024;
+            ++cp;
+            break;
+    }
+    if (*cp) {
+        return false;
+    }
+    *value = size;
+    return true;
+}
+
+LogRateLimit::LogRateLimit() {
+}
+
+void LogRateLimit::init() {
+    uint64_t rate;
+    if (!property_get_size("persist.logd.ratelimit", &rate) &&
+        !property_get_size("ro.logd.ratelimit", &rate)) {
+        rate = default_rate;
+    }
+    uint64_t burst;
+    if (!property_get_size("persist.logd.ratelimit.burst", &burst) &&
+        !property_get_size("ro.logd.ratelimit.burst", &burst)) {
+        burst = rate * 4;
+    }
+    setLimit(rate, burst);
+}
+
+void LogRateLimit::setLimit(uint64_t rate, uint64_t burst) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mRate = rate;
+    // An entry larger than the burst could never be logged.
+    mBurst = std::max<uint64_t>(burst, LOGGER_ENTRY_MAX_PAYLOAD);
+    // Keep the statistics, but start afresh with full buckets.
+    for (auto& it : mBuckets) {
+        it.second.tokens = mBurst;
+    }
+}
+
+bool LogRateLimit::allow(log_id_t id, uid_t uid, size_t len, uint64_t now) {
+    if ((id == LOG_ID_CRASH) || (id == LOG_ID_SECURITY) ||
+        ((uid % AID_USER_OFFSET) < AID_APP_START)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mRate) {
+        return true;
+    }
+
+    auto it = mBuckets.find(uid);
+    if (it == mBuckets.end()) {
+        it = mBuckets.emplace(uid, Bucket{ mBurst, now, 0, 0 }).first;
+    }
+    Bucket& bucket = it->second;
+
+    // Refill for the time since the last entry, without overflowing.
+    uint64_t elapsed = (now > bucket.last) ? (now - bucket.last) : 0;
+    bucket.last = now;
+    if (elapsed >= (mBurst - bucket.tokens) * NS_PER_SEC / mRate) {
+        bucket.tokens = mBurst;
+    } else {
+        bucket.tokens += elapsed * mRate / NS_PER_SEC;
+    }
+
+    if (bucket.tokens >= len) {
+        bucket.tokens -= len;
+        return true;
+    }
+    bucket.throttledBytes += len;
+    ++bucket.throttledCount;
+    return false;
+}
+
+std::string LogRateLimit::formatStatistics() const {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::vector<std::pair<uid_t, const Bucket*>> throttled;
+    for (const auto& it : mBuckets) {
+        if (it.second.throttledCount) {
+            throttled.emplace_back(it.first, &it.second);
+        }
+    }
+    if (throttled.empty()) {
+        return "";
+    }
+    std::sort(throttled.begin(), throttled.end(),
+              [](const std::pair<uid_t, const Bucket*>& a,
+                 const std::pair<uid_t, const Bucket*>& b) {
+                  return a.second->throttledBytes > b.second->throttledBytes;
+              });
+
+    std::string output = android::base::StringPrintf(
+        "\n\nLog writers throttled at %" PRIu64 "B/s, %" PRIu64
+        "B burst:\nUID       Entries   Bytes\n",
+        mRate, mBurst);
+    for (const auto& it : throttled) {
+        output += android::base::StringPrintf(
+            "%-9u %-9" PRIu64 " %" PRIu64 "\n", it.first,
+            it.second->throttledCount, it.second->throttledBytes);
+    }
+    return output;
+}
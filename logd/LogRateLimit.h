@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_RATE_LIMIT_H__
+#define _LOGD_LOG_RATE_LIMIT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <log/log.h>
+
+// Token bucket per app uid, so that one app spamming the logs can not keep
+// the writer thread and LogBuffer busy at the expense of everyone else. Each
+// uid may log a burst of bytes at once, refilled at a steady rate; entries
+// over that are dropped before any LogBufferElement is allocated. System
+// uids, and the crash and security buffers, are never limited.
+class LogRateLimit {
+   public:
+    LogRateLimit();
+
+    // (Re)reads persist.logd.ratelimit and persist.logd.ratelimit.burst.
+    void init();
+    // Configures the limit directly, rate 0 disables it.
+    void setLimit(uint64_t rate, uint64_t burst);
+
+    // Returns false if the entry must be dropped. now is CLOCK_MONOTONIC ns.
+    bool allow(log_id_t id, uid_t uid, size_t len, uint64_t now);
+
+    std::string formatStatistics() const;
+
+   private:
+    struct Bucket {
+        uint64_t tokens;
+        uint64_t last;
+        uint64_t throttledBytes;
+        uint64_t throttledCount;
+    };
+
+    mutable std::mutex mLock;
+    uint64_t mRate = 0;   // bytes per second
+    uint64_t mBurst = 0;  // bytes
+    std::unordered_map<uid_t, Bucket> mBuckets;
+};
+
+#endif  // _LOGD_LOG_RATE_LIMIT_H__
@@ -107,6 +107,49 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
         pid = atol(cp + sizeof(_pid) - 1);
     }
 
+    // Reader side filters, text logs below prio and, if any are listed,
+    // text logs not carrying one of the tags are not sent.
+    int prio = ANDROID_LOG_DEFAULT;
+    static const char _prio[] = " prio=";
+    cp = strstr(buffer, _prio);
+    if (cp) {
+        prio = atol(cp + sizeof(_prio) - 1);
+    }
+
+    std::vector<std::string> tags;
+    static const char _tags[] = " tags=";
+    cp = strstr(buffer, _tags);
+    if (cp) {
+        cp += sizeof(_tags) - 1;
+        while (*cp && !isspace(*cp)) {
+            size_t len = strcspn(cp, ", \t\n");
+            if (len) {
+                tags.emplace_back(cp, len);
+            }
+            cp += len;
+            if (*cp != ',') {
+                break;
+            }
+            ++cp;
+        }
+    }
+
+    // Wake the reader once per batch of notifications, or once the latency
+    // budget in milliseconds expires, rather than for every new entry.
+    unsigned long batch = 0;
+    static const char _batch[] = " batch=";
+    cp = strstr(buffer, _batch);
+    if (cp) {
+        batch = atol(cp + sizeof(_batch) - 1);
+    }
+
+    uint64_t latency = 0;
+    static const char _latency[] = " latency=";
+    cp = strstr(buffer, _latency);
+    if (cp) {
+        latency = atol(cp + sizeof(_latency) - 1) * (NS_PER_SEC / MS_PER_SEC);
+    }
+
     bool nonBlock = false;
     if (!fastcmp<strncmp>(buffer, "dumpAndClose", 12)) {
         // Allow writer to get some cycles, and wait for pending notifications
@@ -195,11 +238,14 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
 
     android::prdebug(
         "logdr: UID=%d GID=%d PID=%d %c tail=%lu logMask=%x pid=%d "
-        "start=%" PRIu64 "ns timeout=%" PRIu64 "ns\n",
+        "prio=%d tags=%zu start=%" PRIu64 "ns timeout=%" PRIu64 "ns "
+        "batch=%lu latency=%" PRIu64 "ns\n",
         cli->getUid(), cli->getGid(), cli->getPid(), nonBlock ? 'n' : 'b', tail,
-        logMask, (int)pid, sequence.nsec(), timeout);
+        logMask, (int)pid, prio, tags.size(), sequence.nsec(), timeout, batch,
+        latency);
 
-    FlushCommand command(*this, nonBlock, tail, logMask, pid, sequence, timeout);
+    FlushCommand command(*this, nonBlock, tail, logMask, pid, prio, tags,
+                         sequence, timeout, batch, latency);
 
     // Set acceptable upper limit to wait for slow reader processing b/27242723
     struct timeval t = { LOGD_SNDTIMEO, 0 };
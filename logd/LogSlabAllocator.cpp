@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "LogSlabAllocator.h"
+
+static_assert((LogSlabAllocator::kSlabSize &
+               (LogSlabAllocator::kSlabSize - 1)) == 0,
+              "kSlabSize must be a power of two");
+
+static constexpr size_t alignment = sizeof(uint64_t);
+
+static size_t align(size_t len) {
+    return (len + alignment - 1) & ~(alignment - 1);
+}
+
+LogSlabAllocator& LogSlabAllocator::get(log_id_t id) {
+    static LogSlabAllocator allocators[LOG_ID_MAX];
+    return allocators[(id < LOG_ID_MAX) ? id : LOG_ID_MAIN];
+}
+
+// LogSlabAllocator::mLock must be held when this function is called.
+LogSlabAllocator::Slab* LogSlabAllocator::newSlab() {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kSlabSize, kSlabSize)) {
+        return nullptr;
+    }
+    Slab* slab = static_cast<Slab*>(memory);
+    slab->owner = this;
+    slab->prev = slab->next = nullptr;
+    slab->free = nullptr;
+    slab->used = align(sizeof(Slab));
+    slab->live = 0;
+    ++mSlabs;
+    return slab;
+}
+
+// LogSlabAllocator::mLock must be held when this function is called.
+void LogSlabAllocator::link(Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = mPartial;
+    if (mPartial) mPartial->prev = slab;
+    mPartial = slab;
+}
+
+// LogSlabAllocator::mLock must be held when this function is called.
+void LogSlabAllocator::unlink(Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        mPartial = slab->next;
+    }
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->prev = slab->next = nullptr;
+}
+
+void* LogSlabAllocator::allocate(size_t len) {
+    len = align(std::max(len, sizeof(Slot)));
+
+    pthread_mutex_lock(&mLock);
+    // Every element of a log id has the same size, the first caller sets it.
+    if (!mSlotSize) {
+        mSlotSize = len;
+        mSlotsPerSlab = (kSlabSize - align(sizeof(Slab))) / len;
+    }
+    if (len != mSlotSize) {
+        pthread_mutex_unlock(&mLock);
+        abort();
+    }
+
+    Slab* slab = mPartial;
+    if (!slab) {
+        slab = newSlab();
+        // Out of memory, fail exactly as operator new would have.
+        if (!slab) abort();
+        link(slab);
+    }
+
+    void* slot;
+    if (slab->free) {
+        slot = slab->free;
+        slab->free = slab->free->next;
+    } else {
+        slot = reinterpret_cast<char*>(slab) + slab->used;
+        slab->used += mSlotSize;
+    }
+    ++slab->live;
+    ++mLive;
+    if (!slab->free && ((kSlabSize - slab->used) < mSlotSize)) {
+        unlink(slab);  // full
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return slot;
+}
+
+void LogSlabAllocator::release(void* slot) {
+    if (!slot) return;
+
+    Slab* slab = slabOf(slot);
+    slab->owner->free(slab, static_cast<Slot*>(slot));
+}
+
+void LogSlabAllocator::free(Slab* slab, Slot* slot) {
+    pthread_mutex_lock(&mLock);
+    bool full = !slab->free && ((kSlabSize - slab->used) < mSlotSize);
+    slot->next = slab->free;
+    slab->free = slot;
+    --mLive;
+    if (!--slab->live) {
+        // Keep one slab around so a buffer hovering at the edge of a slab
+        // does not allocate and free it on every entry.
+        if (full || (mPartial != slab) || slab->next) {
+            if (!full) unlink(slab);
+            ::free(slab);
+            --mSlabs;
+        } else {
+            slab->free = nullptr;
+            slab->used = align(sizeof(Slab));
+        }
+    } else if (full) {
+        link(slab);
+    }
+    pthread_mutex_unlock(&mLock);
+}
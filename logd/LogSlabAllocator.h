@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_SLAB_ALLOCATOR_H__
+#define _LOGD_LOG_SLAB_ALLOCATOR_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <log/log_id.h>
+
+// Fixed size slots carved out of naturally aligned slabs, used for the
+// LogBufferElement objects themselves while LogChunkAllocator holds their
+// payloads. Slots are recycled within their slab, and a slab is handed back
+// to the system once its last slot is released, so the memory held follows
+// the buffer size up and down instead of fragmenting the heap.
+//
+// One allocator exists per log id, elements of a buffer are pruned together
+// and empty their slabs together.
+class LogSlabAllocator {
+   public:
+    // Must be a power of two.
+    static constexpr size_t kSlabSize = 16384;
+
+    static LogSlabAllocator& get(log_id_t id);
+
+    void* allocate(size_t len);
+    static void release(void* slot);
+
+    // Statistics
+    size_t sizes() const {
+        return mSlabs * kSlabSize;
+    }
+    size_t slabs() const {
+        return mSlabs;
+    }
+    // slots handed out
+    size_t live() const {
+        return mLive;
+    }
+    // slots the current slabs can hold
+    size_t capacity() const {
+        return mSlabs * mSlotsPerSlab;
+    }
+
+   private:
+    struct Slot {
+        Slot* next;
+    };
+    struct Slab {
+        LogSlabAllocator* owner;
+        Slab* prev;  // on mPartial while it has free slots
+        Slab* next;
+        Slot* free;
+        size_t used;  // bump offset, including this header
+        size_t live;
+    };
+
+    pthread_mutex_t mLock = PTHREAD_MUTEX_INITIALIZER;
+    Slab* mPartial = nullptr;
+    size_t mSlotSize = 0;
+    size_t mSlotsPerSlab = 0;
+    std::atomic<size_t> mSlabs{ 0 };
+    std::atomic<size_t> mLive{ 0 };
+
+    static Slab* slabOf(const void* slot) {
+        return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(slot) &
+                                       ~(kSlabSize - 1));
+    }
+    Slab* newSlab();
+    void link(Slab* slab);
+    void unlink(Slab* slab);
+    void free(Slab* slab, Slot* slot);
+};
+
+#endif  // _LOGD_LOG_SLAB_ALLOCATOR_H__
@@ -27,6 +27,8 @@
 
 #include <private/android_logger.h>
 
+#include "LogChunkAllocator.h"
+#include "LogSlabAllocator.h"
 #include "LogStatistics.h"
 
 static const uint64_t hourSec = 60 * 60;
@@ -34,7 +36,8 @@ static const uint64_t monthSec = 31 * 24 * hourSec;
 
 size_t LogStatistics::SizesTotal;
 
-LogStatistics::LogStatistics() : enable(false) {
+LogStatistics::LogStatistics()
+    : enable(false), mAuditDenials(0), mAuditCoalesced(0) {
     log_time now(CLOCK_REALTIME);
     log_id_for_each(id) {
         mSizes[id] = 0;
@@ -769,6 +772,44 @@ std::string LogStatistics::format(uid_t uid, pid_t pid,
     if (spaces < 0) spaces = 0;
     output += android::base::StringPrintf("%*s%zu", spaces, "", totalSize);
 
+    // Memory held by the chunk and slab allocators, and the percentage of it
+    // holding live payloads and elements.
+    static const char AllocatedStr[] = "\nAllocated";
+    spaces = 10 - strlen(AllocatedStr);
+    output += AllocatedStr;
+
+    totalSize = 0;
+    size_t totalUsed = 0;
+    log_id_for_each(id) {
+        if (!(logMask & (1 << id))) continue;
+
+        LogSlabAllocator& slabs = LogSlabAllocator::get(id);
+        size_t held = LogChunkAllocator::get(id).sizes() + slabs.sizes();
+        if (held) {
+            size_t used = sizes(id) + slabs.live() * sizeof(LogBufferElement);
+            totalSize += held;
+            totalUsed += used;
+            oldLength = output.length();
+            if (spaces < 0) spaces = 0;
+            output += android::base::StringPrintf("%*s%zu(%zu%%)", spaces, "",
+                                                  held, used * 100 / held);
+            spaces -= output.length() - oldLength;
+        }
+        spaces += spaces_total;
+    }
+    if (totalSize) {
+        if (spaces < 0) spaces = 0;
+        output += android::base::StringPrintf("%*s%zu(%zu%%)", spaces, "",
+                                              totalSize,
+                                              totalUsed * 100 / totalSize);
+    }
+
+    if (mAuditDenials) {
+        output += android::base::StringPrintf(
+            "\nAvc denials %zu, %zu coalesced", mAuditDenials,
+            mAuditCoalesced);
+    }
+
     // Report on Chattiest
 
     std::string name;
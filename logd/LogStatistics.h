@@ -48,6 +48,23 @@ template <typename TKey, typename TEntry>
 class LogHashtable {
     std::unordered_map<TKey, TEntry> map;
 
+   public:
+    typedef typename std::unordered_map<TKey, TEntry>::iterator iterator;
+    typedef
+        typename std::unordered_map<TKey, TEntry>::const_iterator const_iterator;
+
+   private:
+    // The largest entries, kept in order as they grow and shrink so that
+    // the unfiltered sort() prune asks for on every pass does not walk the
+    // whole table. top is exact while topValid, and topBound is no less
+    // than the size of any entry outside of it; an entry in top shrinking
+    // below topBound means an outsider may have overtaken it, forcing a
+    // walk on the next sort().
+    static const size_t top_len = 2;
+    mutable const TEntry* top[top_len];
+    mutable size_t topBound;
+    mutable bool topValid;
+
     size_t bucket_size() const {
         size_t count = 0;
         for (size_t idx = 0; idx < map.bucket_count(); ++idx) {
@@ -63,32 +80,8 @@ class LogHashtable {
     static const size_t unordered_map_per_entry_overhead = sizeof(void*);
     static const size_t unordered_map_bucket_overhead = sizeof(void*);
 
-   public:
-    size_t size() const {
-        return map.size();
-    }
-
-    // Estimate unordered_map memory usage.
-    size_t sizeOf() const {
-        return sizeof(*this) +
-               (size() * (sizeof(TEntry) + unordered_map_per_entry_overhead)) +
-               (bucket_size() * sizeof(size_t) + unordered_map_bucket_overhead);
-    }
-
-    typedef typename std::unordered_map<TKey, TEntry>::iterator iterator;
-    typedef
-        typename std::unordered_map<TKey, TEntry>::const_iterator const_iterator;
-
-    std::unique_ptr<const TEntry* []> sort(uid_t uid, pid_t pid,
-                                           size_t len) const {
-        if (!len) {
-            std::unique_ptr<const TEntry* []> sorted(nullptr);
-            return sorted;
-        }
-
-        const TEntry** retval = new const TEntry*[len];
-        memset(retval, 0, sizeof(*retval) * len);
-
+    void sortInto(const TEntry** retval, size_t len, uid_t uid,
+                  pid_t pid) const {
         for (const_iterator it = map.begin(); it != map.end(); ++it) {
             const TEntry& entry = it->second;
 
@@ -113,6 +106,111 @@ class LogHashtable {
                 retval[index] = &entry;
             }
         }
+    }
+
+    void retop() const {
+        const TEntry* sorted[top_len + 1] = {};
+        sortInto(sorted, top_len + 1, AID_ROOT, (pid_t)0);
+        memcpy(top, sorted, sizeof(top));
+        topBound = sorted[top_len] ? sorted[top_len]->getSizes() : 0;
+        topValid = true;
+    }
+
+    size_t findTop(const TEntry* entry) const {
+        size_t index = 0;
+        while ((index < top_len) && (top[index] != entry)) ++index;
+        return index;
+    }
+
+    // entry has grown
+    void promote(const TEntry* entry) {
+        if (!topValid) return;
+
+        size_t sizes = entry->getSizes();
+        size_t index = findTop(entry);
+        if (index >= top_len) {
+            index = top_len - 1;
+            const TEntry* last = top[index];
+            if (last) {
+                if (sizes <= last->getSizes()) {
+                    topBound = std::max(topBound, sizes);
+                    return;
+                }
+                topBound = std::max(topBound, last->getSizes());
+            }
+            top[index] = entry;
+        }
+        while (index &&
+               (!top[index - 1] || (top[index - 1]->getSizes() < sizes))) {
+            top[index] = top[index - 1];
+            top[--index] = entry;
+        }
+    }
+
+    // entry has shrunk
+    void demote(const TEntry* entry) {
+        if (!topValid) return;
+
+        size_t index = findTop(entry);
+        if (index >= top_len) return;
+
+        size_t sizes = entry->getSizes();
+        while (((index + 1) < top_len) && top[index + 1] &&
+               (top[index + 1]->getSizes() > sizes)) {
+            top[index] = top[index + 1];
+            top[++index] = entry;
+        }
+        const TEntry* last = top[top_len - 1];
+        if (last && (last->getSizes() < topBound)) {
+            topValid = false;
+        }
+    }
+
+    void subtract(iterator it, const LogBufferElement* element) {
+        if (!it->second.subtract(element)) {
+            demote(&it->second);
+            return;
+        }
+        if (findTop(&it->second) < top_len) {
+            topValid = false;
+        }
+        map.erase(it);
+    }
+
+   public:
+    LogHashtable() : top(), topBound(0), topValid(false) {
+    }
+
+    size_t size() const {
+        return map.size();
+    }
+
+    // Estimate unordered_map memory usage.
+    size_t sizeOf() const {
+        return sizeof(*this) +
+               (size() * (sizeof(TEntry) + unordered_map_per_entry_overhead)) +
+               (bucket_size() * sizeof(size_t) + unordered_map_bucket_overhead);
+    }
+
+    std::unique_ptr<const TEntry* []> sort(uid_t uid, pid_t pid,
+                                           size_t len) const {
+        if (!len) {
+            std::unique_ptr<const TEntry* []> sorted(nullptr);
+            return sorted;
+        }
+
+        const TEntry** retval = new const TEntry*[len];
+        memset(retval, 0, sizeof(*retval) * len);
+
+        if ((uid == AID_ROOT) && !pid && (len <= top_len)) {
+            if (!topValid) {
+                retop();
+            }
+            memcpy(retval, top, sizeof(*retval) * len);
+        } else {
+            sortInto(retval, len, uid, pid);
+        }
+
         std::unique_ptr<const TEntry* []> sorted(retval);
         return sorted;
     }
@@ -124,6 +222,7 @@ class LogHashtable {
         } else {
             it->second.add(element);
         }
+        promote(&it->second);
         return it;
     }
 
@@ -131,6 +230,7 @@ class LogHashtable {
         iterator it = map.find(key);
         if (it == map.end()) {
             it = map.insert(std::make_pair(key, TEntry(key))).first;
+            promote(&it->second);
         } else {
             it->second.add(key);
         }
@@ -139,15 +239,15 @@ class LogHashtable {
 
     void subtract(TKey&& key, const LogBufferElement* element) {
         iterator it = map.find(std::move(key));
-        if ((it != map.end()) && it->second.subtract(element)) {
-            map.erase(it);
+        if (it != map.end()) {
+            subtract(it, element);
         }
     }
 
     void subtract(const TKey& key, const LogBufferElement* element) {
         iterator it = map.find(key);
-        if ((it != map.end()) && it->second.subtract(element)) {
-            map.erase(it);
+        if (it != map.end()) {
+            subtract(it, element);
         }
     }
 
@@ -155,6 +255,7 @@ class LogHashtable {
         iterator it = map.find(key);
         if (it != map.end()) {
             it->second.drop(element);
+            demote(&it->second);
         }
     }
 
@@ -679,6 +780,8 @@ class LogStatistics {
     log_time mNewestDropped[LOG_ID_MAX];
     static size_t SizesTotal;
     bool enable;
+    size_t mAuditDenials;
+    size_t mAuditCoalesced;
 
     // uid to size list
     typedef LogHashtable<uid_t, UidEntry> uidTable_t;
@@ -739,6 +842,12 @@ class LogStatistics {
         enable = true;
     }
 
+    // Count of avc denials seen by LogAudit, and how many were coalesced.
+    void addAuditDenial(bool coalesced) {
+        ++mAuditDenials;
+        if (coalesced) ++mAuditCoalesced;
+    }
+
     void addTotal(LogBufferElement* entry);
     void add(LogBufferElement* entry);
     void subtract(LogBufferElement* entry);
@@ -27,6 +27,7 @@
 #include <unistd.h>
 
 #include <string>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/macros.h>
@@ -345,8 +346,30 @@ void LogTags::ReadPersistEventLogTags() {
     android_logger_list_free(logger_list);
 }
 
+void LogTags::FreezeStaticEventLogTags() {
+    std::vector<std::pair<uint32_t, StaticTag>> entries;
+
+    android::RWLock::AutoRLock readLock(rwlock);
+
+    for (const auto& it : tag2name) {
+        if ((tag2total.find(it.first) != tag2total.end()) ||
+            (tag2uid.find(it.first) != tag2uid.end())) {
+            continue;
+        }
+        tag2format_const_iterator iform = tag2format.find(it.first);
+        entries.emplace_back(
+            it.first,
+            StaticTag{ it.second,
+                       (iform != tag2format.end()) ? iform->second : "" });
+    }
+    if (!staticTags.build(entries)) {
+        android::prdebug("%s not frozen", system_event_log_tags);
+    }
+}
+
 LogTags::LogTags() {
     ReadFileEventLogTags(system_event_log_tags);
+    FreezeStaticEventLogTags();
     // Following will likely fail on boot, but is required if logd restarts
     ReadFileEventLogTags(dynamic_event_log_tags, false);
     if (__android_log_is_debuggable()) {
@@ -359,6 +382,11 @@ LogTags::LogTags() {
 
 // Converts an event tag into a name
 const char* LogTags::tagToName(uint32_t tag) const {
+    const StaticTag* found = staticTags.find(tag);
+    if (found) {
+        return found->name.length() ? found->name.c_str() : NULL;
+    }
+
     tag2name_const_iterator it;
 
     android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
@@ -407,6 +435,11 @@ void android::ReReadEventLogTags() {
 
 // converts an event tag into a format
 const char* LogTags::tagToFormat(uint32_t tag) const {
+    const StaticTag* found = staticTags.find(tag);
+    if (found) {
+        return found->format.length() ? found->format.c_str() : NULL;
+    }
+
     tag2format_const_iterator iform;
 
     android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
@@ -500,6 +533,8 @@ static int openFile(const char* name, int mode, bool warning) {
 }
 
 void LogTags::WritePmsgEventLogTags(uint32_t tag, uid_t uid) {
+    if (staticTags.find(tag)) return;  // source is a static entry
+
     android::RWLock::AutoRLock readLock(rwlock);
 
     tag2total_const_iterator itot = tag2total.find(tag);
@@ -21,6 +21,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include <private/android_logger_tag_hash.h>
 #include <utils/RWLock.h>
 
 class LogTags {
@@ -33,6 +34,17 @@ class LogTags {
     // mutex to protect the other entities.
     android::RWLock rwlock;
 
+    // Content of the system event-log-tags file, frozen in the constructor
+    // before the object is shared and consulted without taking rwlock. The
+    // unordered_maps below remain the database of record, with everything
+    // registered later only found there.
+    struct StaticTag {
+        std::string name;
+        std::string format;
+    };
+    android::EventTagHash<StaticTag> staticTags;
+    void FreezeStaticEventLogTags();
+
     // key is Name + "+" + Format
     std::unordered_map<std::string, uint32_t> key2tag;
     typedef std::unordered_map<std::string, uint32_t>::const_iterator
@@ -22,14 +22,21 @@
 
 #include "FlushCommand.h"
 #include "LogBuffer.h"
+#include "LogBufferElement.h"
 #include "LogReader.h"
 #include "LogTimes.h"
 
 pthread_mutex_t LogTimeEntry::timesLock = PTHREAD_MUTEX_INITIALIZER;
 
+// Latency budget used when a reader only asks for a batch count.
+static const uint64_t defaultLatency = 100 * (NS_PER_SEC / MS_PER_SEC);
+
 LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
                            bool nonBlock, unsigned long tail, log_mask_t logMask,
-                           pid_t pid, log_time start, uint64_t timeout)
+                           pid_t pid, int prio,
+                           const std::vector<std::string>& tags,
+                           log_time start, uint64_t timeout,
+                           unsigned long batch, uint64_t latency)
     : mRefCount(1),
       mRelease(false),
       mError(false),
@@ -38,9 +45,14 @@ LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
       mReader(reader),
       mLogMask(logMask),
       mPid(pid),
+      mPrio(prio),
+      mTags(tags),
       mCount(0),
       mTail(tail),
       mIndex(0),
+      mBatch(batch),
+      mLatency((batch && !latency) ? defaultLatency : latency),
+      mPending(0),
       mClient(client),
       mStart(start),
       mNonBlock(nonBlock),
@@ -175,7 +187,26 @@ void* LogTimeEntry::threadStart(void* obj) {
         me->cleanSkip_Locked();
 
         if (!me->mTimeout.tv_sec && !me->mTimeout.tv_nsec) {
-            pthread_cond_wait(&me->threadTriggeredCondition, &timesLock);
+            if (!me->mPending) {
+                pthread_cond_wait(&me->threadTriggeredCondition, &timesLock);
+            }
+            // Woken by the first of a batch, wait out the latency budget
+            // unless the batch completes or the reader is released first.
+            if (me->mLatency && me->threadRunning && !me->isError_Locked() &&
+                (!me->mBatch || (me->mPending < me->mBatch))) {
+                log_time deadline(CLOCK_REALTIME);
+                deadline += log_time(me->mLatency / NS_PER_SEC,
+                                     me->mLatency % NS_PER_SEC);
+                struct timespec ts = { deadline.tv_sec, deadline.tv_nsec };
+                while (me->threadRunning && !me->isError_Locked() &&
+                       (!me->mBatch || (me->mPending < me->mBatch))) {
+                    if (pthread_cond_timedwait(&me->threadTriggeredCondition,
+                                               &timesLock, &ts) == ETIMEDOUT) {
+                        break;
+                    }
+                }
+            }
+            me->mPending = 0;
         }
     }
 
@@ -205,7 +236,7 @@ int LogTimeEntry::FilterFirstPass(const LogBufferElement* element, void* obj) {
     }
 
     if ((!me->mPid || (me->mPid == element->getPid())) &&
-        (me->isWatching(element->getLogId()))) {
+        (me->isWatching(element->getLogId())) && !me->isFiltered(element)) {
         ++me->mCount;
     }
 
@@ -247,6 +278,10 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement* element, void* obj) {
         goto skip;
     }
 
+    if (me->isFiltered(element)) {
+        goto skip;
+    }
+
     if (me->isError_Locked()) {
         goto stop;
     }
@@ -281,6 +316,40 @@ stop:
     return -1;
 }
 
+// True if the reader asked for content of this element to be left out.
+// Only text logs have a priority and tag to match against, binary and
+// chatty entries are always sent and left to the reader to sort out.
+bool LogTimeEntry::isFiltered(const LogBufferElement* element) const {
+    if ((mPrio <= ANDROID_LOG_VERBOSE) && mTags.empty()) {
+        return false;
+    }
+
+    log_id_t id = element->getLogId();
+    if ((id == LOG_ID_EVENTS) || (id == LOG_ID_STATS) ||
+        (id == LOG_ID_SECURITY)) {
+        return false;
+    }
+    const char* msg = element->getMsg();
+    unsigned short len = element->getMsgLen();
+    if (!msg || (len < 2)) {
+        return false;
+    }
+
+    if (msg[0] < mPrio) {
+        return true;
+    }
+    if (mTags.empty()) {
+        return false;
+    }
+    size_t tagLen = strnlen(msg + 1, len - 1);
+    for (const std::string& tag : mTags) {
+        if ((tag.length() == tagLen) && !memcmp(tag.data(), msg + 1, tagLen)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void LogTimeEntry::cleanSkip_Locked(void) {
     memset(skipAhead, 0, sizeof(skipAhead));
 }
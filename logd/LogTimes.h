@@ -22,6 +22,8 @@
 #include <time.h>
 
 #include <list>
+#include <string>
+#include <vector>
 
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
@@ -45,16 +47,23 @@ class LogTimeEntry {
     static void threadStop(void* me);
     const log_mask_t mLogMask;
     const pid_t mPid;
+    const int mPrio;                      // minimum text log priority
+    const std::vector<std::string> mTags;  // text log tags, empty for all
     unsigned int skipAhead[LOG_ID_MAX];
     pid_t mLastTid[LOG_ID_MAX];
     unsigned long mCount;
     unsigned long mTail;
     unsigned long mIndex;
+    // Wakeup batching, zero for both wakes the reader for every notification
+    const unsigned long mBatch;  // notifications to wait for
+    const uint64_t mLatency;     // nanoseconds to wait for them
+    unsigned long mPending;      // notifications since the last flush
 
    public:
     LogTimeEntry(LogReader& reader, SocketClient* client, bool nonBlock,
-                 unsigned long tail, log_mask_t logMask, pid_t pid,
-                 log_time start, uint64_t timeout);
+                 unsigned long tail, log_mask_t logMask, pid_t pid, int prio,
+                 const std::vector<std::string>& tags, log_time start,
+                 uint64_t timeout, unsigned long batch, uint64_t latency);
 
     SocketClient* mClient;
     log_time mStart;
@@ -81,6 +90,15 @@ class LogTimeEntry {
     void triggerReader_Locked(void) {
         pthread_cond_signal(&threadTriggeredCondition);
     }
+    // New content. With batching only the first notification, which starts
+    // the latency budget, and the one completing the batch wake the reader.
+    void notifyReader_Locked(void) {
+        ++mPending;
+        if ((!mBatch && !mLatency) || (mPending == 1) ||
+            (mBatch && (mPending >= mBatch))) {
+            pthread_cond_signal(&threadTriggeredCondition);
+        }
+    }
 
     void triggerSkip_Locked(log_id_t id, unsigned int skip) {
         skipAhead[id] = skip;
@@ -141,6 +159,7 @@ class LogTimeEntry {
     bool isWatchingMultiple(log_mask_t logMask) const {
         return mLogMask & logMask;
     }
+    bool isFiltered(const LogBufferElement* element) const;
     // flushTo filter callbacks
     static int FilterFirstPass(const LogBufferElement* element, void* me);
     static int FilterSecondPass(const LogBufferElement* element, void* me);
@@ -306,6 +306,7 @@ static void* reinit_thread_start(void* /*obj*/) {
             logBuf->init();
             logBuf->initPrune(nullptr);
         }
+        LogListener::initRateLimit();
         android::ReReadEventLogTags();
     }
 
@@ -509,6 +510,7 @@ int main(int argc, char* argv[]) {
     // initiated log messages. New log entries are added to LogBuffer
     // and LogReader is notified to send updates to connected clients.
 
+    LogListener::initRateLimit();
     LogListener* swl = new LogListener(logBuf, reader);
     // Backlog and /proc/sys/net/unix/max_dgram_qlen set to large value
     if (swl->startListener(600)) {
@@ -23,6 +23,26 @@ LOCAL_PATH := $(call my-dir)
 test_module_prefix := logd-
 test_tags := tests
 
+benchmark_c_flags := \
+    -Wall \
+    -Wextra \
+    -Werror \
+    -fno-builtin \
+
+benchmark_src_files := \
+    logd_benchmark.cpp
+
+# Build benchmarks for the device. Run with:
+#   adb shell /data/benchmarktest/logd-benchmarks/logd-benchmarks
+include $(CLEAR_VARS)
+LOCAL_MODULE := $(test_module_prefix)benchmarks
+LOCAL_MODULE_TAGS := $(test_tags)
+LOCAL_CFLAGS += $(benchmark_c_flags)
+LOCAL_STATIC_LIBRARIES := liblogd
+LOCAL_SHARED_LIBRARIES := libbase libcutils liblog libsysutils
+LOCAL_SRC_FILES := $(benchmark_src_files)
+include $(BUILD_NATIVE_BENCHMARK)
+
 # -----------------------------------------------------------------------------
 # Unit tests.
 # -----------------------------------------------------------------------------
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <sysutils/SocketClient.h>
+
+#include <benchmark/benchmark.h>
+#include <private/android_filesystem_config.h>
+#include <private/android_logger.h>
+
+#include "../LogBuffer.h"
+#include "../LogTimes.h"
+
+BENCHMARK_MAIN();
+
+// Furnished in logd main.cpp, which is not part of liblogd.
+namespace android {
+void prdebug(const char* /* fmt */, ...) {
+}
+char* uidToName(uid_t /* uid */) {
+  return nullptr;
+}
+}
+
+static const uid_t chatty_uid = AID_APP + 42;
+
+// Build a main buffer text payload: priority, tag and message.
+static size_t make_message(char* buffer, size_t size, size_t n) {
+  static const char tag[] = "logd_benchmark";
+  buffer[0] = ANDROID_LOG_INFO;
+  memcpy(buffer + 1, tag, sizeof(tag));
+  size_t len = 1 + sizeof(tag);
+  len += snprintf(buffer + len, size - len,
+                  "a representative log message, number %zu", n) +
+         1;
+  return len;
+}
+
+static size_t log_one(LogBuffer* logbuf, size_t n,
+                      unsigned int chatty_percent) {
+  char msg[256];
+  size_t len = make_message(msg, sizeof(msg), n);
+  bool chatty = (n % 100) < chatty_percent;
+  uid_t uid = chatty ? chatty_uid : (AID_APP + (n % 17));
+  pid_t pid = chatty ? 4242 : 1000 + (n % 17);
+  logbuf->log(LOG_ID_MAIN, log_time(CLOCK_REALTIME), uid, pid, pid, msg, len);
+  return len;
+}
+
+/*
+ *	Measure the cost of logging into a minimum sized main buffer that is
+ * kept full, so that every few entries trigger a prune. The chatty uid is
+ * the worst offender and takes the brunt of the pruning. state.range(0) is
+ * the percentage of the traffic coming from the chatty uid, with zero as the
+ * reference point of plain expiration without any worst offender.
+ */
+static void BM_prune_chatty_uid(benchmark::State& state) {
+  LastLogTimes times;
+  LogBuffer* logbuf = new LogBuffer(&times);
+  logbuf->setSize(LOG_ID_MAIN, LOG_BUFFER_MIN_SIZE);
+
+  // Overfill the buffer so we start in steady state pruning.
+  size_t n = 0;
+  for (size_t total = 0; total < (2 * LOG_BUFFER_MIN_SIZE);) {
+    total += log_one(logbuf, n++, state.range(0));
+  }
+
+  while (state.KeepRunning()) {
+    log_one(logbuf, n++, state.range(0));
+  }
+
+  delete logbuf;
+}
+BENCHMARK(BM_prune_chatty_uid)->Arg(0)->Arg(50)->Arg(90)->Arg(99);
+
+// Build a main buffer text payload whose message is padded out to size.
+static size_t make_sized_message(char* buffer, size_t size) {
+  static const char tag[] = "logd_benchmark";
+  size_t len = 1 + sizeof(tag);
+  if (size < (len + 1)) size = len + 1;
+  if (size > LOGGER_ENTRY_MAX_PAYLOAD) size = LOGGER_ENTRY_MAX_PAYLOAD;
+  buffer[0] = ANDROID_LOG_INFO;
+  memcpy(buffer + 1, tag, sizeof(tag));
+  memset(buffer + len, 'x', size - len - 1);
+  buffer[size - 1] = '\0';
+  return size;
+}
+
+/*
+ *	Measure the cost of logging a state.range(0) byte payload into a
+ * default sized main buffer, pruning included once it fills.
+ */
+static void BM_log_payload(benchmark::State& state) {
+  LastLogTimes times;
+  LogBuffer* logbuf = new LogBuffer(&times);
+
+  char msg[LOGGER_ENTRY_MAX_PAYLOAD];
+  size_t len = make_sized_message(msg, state.range(0));
+  pid_t pid = getpid();
+
+  while (state.KeepRunning()) {
+    logbuf->log(LOG_ID_MAIN, log_time(CLOCK_REALTIME), AID_APP, pid, pid, msg,
+                len);
+  }
+  state.SetBytesProcessed(state.iterations() * len);
+
+  delete logbuf;
+}
+BENCHMARK(BM_log_payload)->Arg(16)->Arg(128)->Arg(1024)->Arg(4000);
+
+/*
+ *	Measure the cost of logging with statistics enabled when the traffic is
+ * spread across state.range(0) uids, each with its own pid, so that the
+ * statistics tables grow with the range.
+ */
+static void BM_log_uids(benchmark::State& state) {
+  LastLogTimes times;
+  LogBuffer* logbuf = new LogBuffer(&times);
+  logbuf->enableStatistics();
+
+  char msg[256];
+  size_t n = 0;
+  size_t uids = state.range(0);
+
+  while (state.KeepRunning()) {
+    size_t len = make_message(msg, sizeof(msg), n);
+    uid_t uid = AID_APP + (n % uids);
+    pid_t pid = 1000 + (n % uids);
+    logbuf->log(LOG_ID_MAIN, log_time(CLOCK_REALTIME), uid, pid, pid, msg,
+                len);
+    ++n;
+  }
+
+  delete logbuf;
+}
+BENCHMARK(BM_log_uids)->Arg(1)->Arg(16)->Arg(256)->Arg(4096);
+
+/*
+ *	Measure the cost per entry of inserting state.range(0) entries at a
+ * time through the batch interface used by klogd.
+ */
+static void BM_log_batch(benchmark::State& state) {
+  LastLogTimes times;
+  LogBuffer* logbuf = new LogBuffer(&times);
+
+  static const size_t batch_max = 64;
+  char msgs[batch_max][256];
+  LogBufferEntry entries[batch_max];
+  size_t count = state.range(0);
+  pid_t pid = getpid();
+  for (size_t i = 0; i < count; ++i) {
+    entries[i].uid = AID_ROOT;
+    entries[i].pid = pid;
+    entries[i].tid = pid;
+    entries[i].msg = msgs[i];
+    entries[i].len = make_message(msgs[i], sizeof(msgs[i]), i);
+  }
+
+  while (state.KeepRunning()) {
+    log_time now(CLOCK_REALTIME);
+    for (size_t i = 0; i < count; ++i) entries[i].realtime = now;
+    logbuf->log(LOG_ID_KERNEL, entries, count);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+
+  delete logbuf;
+}
+BENCHMARK(BM_log_batch)->Arg(2)->Arg(8)->Arg(64);
+
+// A full default sized main buffer, shared by the read side benchmarks.
+static LogBuffer* filled_buffer() {
+  static LastLogTimes times;
+  static LogBuffer* logbuf = [] {
+    LogBuffer* buf = new LogBuffer(&times);
+    buf->enableStatistics();
+    for (size_t n = 0, total = 0; total < (2 * LOG_BUFFER_SIZE); ++n) {
+      total += log_one(buf, n, 10);
+    }
+    return buf;
+  }();
+  return logbuf;
+}
+
+/*
+ *	Measure the cost of a reader dumping the whole buffer, to /dev/null so
+ * that only the logd side is measured. Run against a growing number of
+ * concurrent readers.
+ */
+static void BM_flushTo(benchmark::State& state) {
+  LogBuffer* logbuf = filled_buffer();
+  SocketClient* client =
+      new SocketClient(open("/dev/null", O_WRONLY | O_CLOEXEC), true);
+
+  while (state.KeepRunning()) {
+    logbuf->flushTo(client, log_time::EPOCH, nullptr, true, false);
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          logbuf->getSizeUsed(LOG_ID_MAIN));
+
+  client->decRef();
+}
+BENCHMARK(BM_flushTo)->ThreadRange(1, 16)->UseRealTime();
+
+/*
+ *	Measure the cost of logcat -S against a full buffer.
+ */
+static void BM_formatStatistics(benchmark::State& state) {
+  LogBuffer* logbuf = filled_buffer();
+
+  while (state.KeepRunning()) {
+    std::string stats =
+        logbuf->formatStatistics(AID_ROOT, 0, (1 << LOG_ID_MAX) - 1);
+    benchmark::DoNotOptimize(stats);
+  }
+}
+BENCHMARK(BM_formatStatistics);
@@ -49,6 +49,12 @@ __BEGIN_DECLS
  *           log), or LOG_FILE (and you need to specify a pathname in the
  *           file_path argument, otherwise pass NULL).  These are bit fields,
  *           and can be OR'ed together to log to multiple places.
+ *           LOG_FILE can also be OR'ed with LOG_FILE_RAW when it is the only
+ *           target and abbreviated is false: the output of the child is then
+ *           copied to the file as is, through a pipe rather than a pty, and
+ *           spliced into the file by the kernel rather than read and written
+ *           one line at a time. This suits chatty children, but their stdout
+ *           is then block buffered, and carriage returns are kept.
  *   abbreviated: If true, capture up to the first 100 lines and last 4K of
  *           output from the child.  The abbreviated output is not dumped to
  *           the specified log until the child has exited.
@@ -70,6 +76,7 @@ __BEGIN_DECLS
 #define LOG_ALOG        1
 #define LOG_KLOG        2
 #define LOG_FILE        4
+#define LOG_FILE_RAW    8
 
 // TODO: Remove unused_opts / unused_opts_len in a followup change.
 int android_fork_execvp_ext(int argc, char* argv[], int *status, bool ignore_int_quit,
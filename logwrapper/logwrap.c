@@ -51,6 +51,12 @@ do {                                                                          \
 
 #define MAX_KLOG_TAG 16
 
+/* stdio buffer of the LOG_FILE file, so that lines are written in batches */
+#define FILE_BUF_SIZE 0x10000
+
+/* Size asked for the pipe of LOG_FILE_RAW, and copied by each splice */
+#define RAW_PIPE_SIZE 0x40000
+
 /* This is a simple buffer that holds up to the first beginning_buf->buf_size
  * bytes of output from a command.
  */
@@ -289,6 +295,60 @@ static void print_abbr_buf(struct log_info *log_info) {
     }
 }
 
+static bool write_fully(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, buf, len));
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Copy the output of the child as is from parent_read to fd, until the child
+ * closes its end of the pipe. The output is spliced into the file, without
+ * going through logwrap, unless the file doesn't support it. If fd is -1, or
+ * writing it fails, the output is drained and dropped so that the child
+ * doesn't block. Return 0 on success, and -1 when reading fails.
+ */
+static int copy_raw_output(int parent_read, int fd) {
+    char buffer[4096];
+    bool use_splice = fd >= 0;
+
+    while (true) {
+        ssize_t sz;
+        if (use_splice) {
+            sz = TEMP_FAILURE_RETRY(splice(parent_read, NULL, fd, NULL, RAW_PIPE_SIZE,
+                                           SPLICE_F_MOVE | SPLICE_F_MORE));
+            if (sz >= 0) {
+                if (sz == 0) {
+                    return 0;
+                }
+                continue;
+            }
+            /* EINVAL means the file doesn't support splice before anything was
+             * moved, so whatever the error, fall back to copying. */
+            if (errno != EINVAL) {
+                ERROR("Cannot write to log file: %s\n", strerror(errno));
+                fd = -1;
+            }
+            use_splice = false;
+            continue;
+        }
+
+        sz = TEMP_FAILURE_RETRY(read(parent_read, buffer, sizeof(buffer)));
+        if (sz <= 0) {
+            return sz;
+        }
+        if (fd >= 0 && !write_fully(fd, buffer, sz)) {
+            ERROR("Cannot write to log file: %s\n", strerror(errno));
+            fd = -1;
+        }
+    }
+}
+
 static int parent(const char *tag, int parent_read, pid_t pid,
         int *chld_sts, int log_target, bool abbreviated, char *file_path) {
     int status = 0;
@@ -300,7 +360,7 @@ static int parent(const char *tag, int parent_read, pid_t pid,
         },
     };
     int rc = 0;
-    int fd;
+    int fd = -1;
 
     struct log_info log_info;
 
@@ -310,6 +370,8 @@ static int parent(const char *tag, int parent_read, pid_t pid,
     bool found_child = false;
     char tmpbuf[256];
 
+    log_info.fp = NULL;
+
     log_info.btag = basename(tag);
     if (!log_info.btag) {
         log_info.btag = (char*) tag;
@@ -339,13 +401,43 @@ static int parent(const char *tag, int parent_read, pid_t pid,
             log_target &= ~LOG_FILE;
         } else {
             lseek(fd, 0, SEEK_END);
-            log_info.fp = fdopen(fd, "a");
+            /* splice() can't write to an O_APPEND file, which fdopen() makes
+             * it, so the raw output is copied first. */
+            if (!(log_target & LOG_FILE_RAW)) {
+                log_info.fp = fdopen(fd, "a");
+                if (log_info.fp) {
+                    setvbuf(log_info.fp, NULL, _IOFBF, FILE_BUF_SIZE);
+                }
+            }
         }
     }
 
     log_info.log_target = log_target;
     log_info.abbreviated = abbreviated;
 
+    if (log_target & LOG_FILE_RAW) {
+        int ret;
+
+        if (copy_raw_output(parent_read, fd) < 0) {
+            ERROR("read failed: %s\n", strerror(errno));
+            rc = -1;
+            goto err_poll;
+        }
+        ret = TEMP_FAILURE_RETRY(waitpid(pid, &status, 0));
+        if (ret < 0) {
+            rc = errno;
+            ALOG(LOG_ERROR, "logwrap", "waitpid failed with %s\n", strerror(errno));
+            goto err_waitpid;
+        }
+        found_child = true;
+        if (log_target & LOG_FILE) {
+            log_info.fp = fdopen(fd, "a");
+            if (!log_info.fp) {
+                log_info.log_target &= ~LOG_FILE;
+            }
+        }
+    }
+
     while (!found_child) {
         if (TEMP_FAILURE_RETRY(poll(poll_fds, ARRAY_SIZE(poll_fds), -1)) < 0) {
             ERROR("poll failed\n");
@@ -451,8 +543,10 @@ static int parent(const char *tag, int parent_read, pid_t pid,
 
 err_waitpid:
 err_poll:
-    if (log_target & LOG_FILE) {
+    if (log_info.fp) {
         fclose(log_info.fp); /* Also closes underlying fd */
+    } else if (fd >= 0) {
+        close(fd);
     }
     if (abbreviated) {
         free_abbr_buf(&log_info.a_buf);
@@ -487,33 +581,53 @@ int android_fork_execvp_ext(int argc, char* argv[], int *status, bool ignore_int
     LOG_ALWAYS_FATAL_IF(unused_opts != NULL);
     LOG_ALWAYS_FATAL_IF(unused_opts_len != 0);
 
+    /* Raw output is only for a file, as is, without anything else to log it to */
+    if ((log_target & ~LOG_FILE_RAW) != LOG_FILE || !file_path || abbreviated) {
+        log_target &= ~LOG_FILE_RAW;
+    }
+
     rc = pthread_mutex_lock(&fd_mutex);
     if (rc) {
         ERROR("failed to lock signal_fd mutex\n");
         goto err_lock;
     }
 
-    /* Use ptty instead of socketpair so that STDOUT is not buffered */
-    parent_ptty = TEMP_FAILURE_RETRY(open("/dev/ptmx", O_RDWR));
-    if (parent_ptty < 0) {
-        ERROR("Cannot create parent ptty\n");
-        rc = -1;
-        goto err_open;
-    }
+    if (log_target & LOG_FILE_RAW) {
+        int pipe_fds[2];
 
-    char child_devname[64];
-    if (grantpt(parent_ptty) || unlockpt(parent_ptty) ||
-            ptsname_r(parent_ptty, child_devname, sizeof(child_devname)) != 0) {
-        ERROR("Problem with /dev/ptmx\n");
-        rc = -1;
-        goto err_ptty;
-    }
+        if (pipe2(pipe_fds, O_CLOEXEC)) {
+            ERROR("Cannot create pipe\n");
+            rc = -1;
+            goto err_open;
+        }
+        /* A larger pipe lets the child run ahead of the copy. This is only
+         * a hint, and fails above /proc/sys/fs/pipe-max-size. */
+        fcntl(pipe_fds[0], F_SETPIPE_SZ, RAW_PIPE_SIZE);
+        parent_ptty = pipe_fds[0];
+        child_ptty = pipe_fds[1];
+    } else {
+        /* Use ptty instead of socketpair so that STDOUT is not buffered */
+        parent_ptty = TEMP_FAILURE_RETRY(open("/dev/ptmx", O_RDWR));
+        if (parent_ptty < 0) {
+            ERROR("Cannot create parent ptty\n");
+            rc = -1;
+            goto err_open;
+        }
 
-    child_ptty = TEMP_FAILURE_RETRY(open(child_devname, O_RDWR));
-    if (child_ptty < 0) {
-        ERROR("Cannot open child_ptty\n");
-        rc = -1;
-        goto err_child_ptty;
+        char child_devname[64];
+        if (grantpt(parent_ptty) || unlockpt(parent_ptty) ||
+                ptsname_r(parent_ptty, child_devname, sizeof(child_devname)) != 0) {
+            ERROR("Problem with /dev/ptmx\n");
+            rc = -1;
+            goto err_ptty;
+        }
+
+        child_ptty = TEMP_FAILURE_RETRY(open(child_devname, O_RDWR));
+        if (child_ptty < 0) {
+            ERROR("Cannot open child_ptty\n");
+            rc = -1;
+            goto err_child_ptty;
+        }
     }
 
     sigemptyset(&blockset);
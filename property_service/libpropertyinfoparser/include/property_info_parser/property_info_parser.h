@@ -114,6 +114,7 @@ class TrieNode {
   }
 
   bool FindChildForString(const char* input, uint32_t namelen, TrieNode* child) const;
+  const PropertyEntry* FindExactMatch(const char* name) const;
 
   uint32_t num_prefixes() const { return trie_node_base_->num_prefixes; }
   const PropertyEntry* prefix(int n) const {
@@ -172,8 +173,9 @@ class PropertyInfoArea : private SerializedData {
   TrieNode root_node() const { return trie(header()->root_offset); }
 
  private:
-  void CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
-                        uint32_t* context_index, uint32_t* type_index) const;
+  void CheckPrefixMatch(const char* remaining_name, uint32_t remaining_name_size,
+                        const TrieNode& trie_node, uint32_t* context_index,
+                        uint32_t* type_index) const;
 
   const PropertyInfoAreaHeader* header() const {
     return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base());
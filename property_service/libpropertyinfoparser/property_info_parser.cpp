@@ -88,9 +88,17 @@ bool TrieNode::FindChildForString(const char* name, uint32_t namelen, TrieNode*
   return true;
 }
 
-void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
-                                        uint32_t* context_index, uint32_t* type_index) const {
-  const uint32_t remaining_name_size = strlen(remaining_name);
+// Binary search the exact matches of a node, which are sorted alphabetically, for a given name.
+const PropertyEntry* TrieNode::FindExactMatch(const char* name) const {
+  auto index = Find(trie_node_base_->num_exact_matches, [this, name](auto array_offset) {
+    return strcmp(serialized_data_->c_string(exact_match(array_offset)->name_offset), name);
+  });
+  return index == -1 ? nullptr : exact_match(index);
+}
+
+void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, uint32_t remaining_name_size,
+                                        const TrieNode& trie_node, uint32_t* context_index,
+                                        uint32_t* type_index) const {
   for (uint32_t i = 0; i < trie_node.num_prefixes(); ++i) {
     auto prefix_len = trie_node.prefix(i)->namelen;
     if (prefix_len > remaining_name_size) continue;
@@ -112,6 +120,7 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
   uint32_t return_context_index = ~0u;
   uint32_t return_type_index = ~0u;
   const char* remaining_name = name;
+  const char* name_end = name + strlen(name);
   auto trie_node = root_node();
   while (true) {
     const char* sep = strchr(remaining_name, '.');
@@ -126,7 +135,8 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
 
     // Check prefixes at this node.  This comes after the node check since these prefixes are by
     // definition longer than the node itself.
-    CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
+    CheckPrefixMatch(remaining_name, name_end - remaining_name, trie_node, &return_context_index,
+                     &return_type_index);
 
     if (sep == nullptr) {
       break;
@@ -144,27 +154,27 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
 
   // We've made it to a leaf node, so check contents and return appropriately.
   // Check exact matches
-  for (uint32_t i = 0; i < trie_node.num_exact_matches(); ++i) {
-    if (!strcmp(c_string(trie_node.exact_match(i)->name_offset), remaining_name)) {
-      if (context_index != nullptr) {
-        if (trie_node.exact_match(i)->context_index != ~0u) {
-          *context_index = trie_node.exact_match(i)->context_index;
-        } else {
-          *context_index = return_context_index;
-        }
+  const PropertyEntry* exact_match = trie_node.FindExactMatch(remaining_name);
+  if (exact_match != nullptr) {
+    if (context_index != nullptr) {
+      if (exact_match->context_index != ~0u) {
+        *context_index = exact_match->context_index;
+      } else {
+        *context_index = return_context_index;
       }
-      if (type_index != nullptr) {
-        if (trie_node.exact_match(i)->type_index != ~0u) {
-          *type_index = trie_node.exact_match(i)->type_index;
-        } else {
-          *type_index = return_type_index;
-        }
+    }
+    if (type_index != nullptr) {
+      if (exact_match->type_index != ~0u) {
+        *type_index = exact_match->type_index;
+      } else {
+        *type_index = return_type_index;
       }
-      return;
     }
+    return;
   }
   // Check prefix matches for prefixes not deliminated with '.'
-  CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
+  CheckPrefixMatch(remaining_name, name_end - remaining_name, trie_node, &return_context_index,
+                   &return_type_index);
   // Return previously found prefix match.
   if (context_index != nullptr) *context_index = return_context_index;
   if (type_index != nullptr) *type_index = return_type_index;
@@ -885,5 +885,36 @@ TEST(propertyinfoserializer, GetPropertyInfo_empty_context_and_type) {
   EXPECT_STREQ("5th", type);
 }
 
+TEST(propertyinfoserializer, GetPropertyInfo_many_exact_matches) {
+  auto property_info = std::vector<PropertyInfoEntry>();
+  for (int i = 0; i < 100; i += 2) {
+    auto name = "exact.match" + std::to_string(i);
+    property_info.emplace_back(name, "ctx" + std::to_string(i), "", true);
+  }
+
+  auto serialized_trie = std::string();
+  auto build_trie_error = std::string();
+  ASSERT_TRUE(BuildTrie(property_info, "default", "default", &serialized_trie, &build_trie_error))
+      << build_trie_error;
+
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
+
+  for (int i = 0; i < 100; ++i) {
+    auto name = "exact.match" + std::to_string(i);
+    const char* context;
+    property_info_area->GetPropertyInfo(name.c_str(), &context, nullptr);
+    if (i % 2 == 0) {
+      EXPECT_EQ("ctx" + std::to_string(i), context) << name;
+    } else {
+      EXPECT_STREQ("default", context) << name;
+    }
+  }
+  const char* context;
+  property_info_area->GetPropertyInfo("exact.match", &context, nullptr);
+  EXPECT_STREQ("default", context);
+  property_info_area->GetPropertyInfo("exact.match00", &context, nullptr);
+  EXPECT_STREQ("default", context);
+}
+
 }  // namespace properties
 }  // namespace android
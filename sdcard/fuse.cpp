@@ -14,14 +14,19 @@
  * limitations under the License.
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define LOG_TAG "sdcard"
 
 #include "fuse.h"
 
+#include <string>
+#include <unordered_map>
+
 #include <android-base/logging.h>
 
 /* FUSE_CANONICAL_PATH is not currently upstreamed */
@@ -33,6 +38,22 @@
  * or that a reply has already been written. */
 #define NO_STATUS 1
 
+/* A directory modified less than this long ago may still change without its
+ * mtime changing, as mtimes are only accurate to 2 seconds on FAT. */
+#define NAME_INDEX_MIN_AGE_SEC 2
+
+/* Names of a directory in the underlying storage, by case-folded name, so
+ * that case-insensitive searches don't read the whole directory each time.
+ * The index is only trusted while the directory keeps the same mtime. */
+struct name_index {
+    pthread_mutex_t lock;
+    bool valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    std::unordered_map<std::string, std::string> names;
+};
+
 static inline void *id_to_ptr(__u64 nid)
 {
     return (void *) (uintptr_t) nid;
@@ -50,6 +71,15 @@ static void acquire_node_locked(struct node* node)
                << " (" << node->name << ") rc=" << node->refcount;
 }
 
+/* Same as acquire_node_locked(), with the lock only held for reading: references
+ * are only dropped, and nodes freed, with the lock held for writing. */
+static void acquire_node_shared_locked(struct node* node)
+{
+    __u32 refcount = __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
+    DLOG(INFO) << "ACQUIRE " << std::hex << node << std::dec
+               << " (" << node->name << ") rc=" << refcount;
+}
+
 static void remove_node_from_parent_locked(struct node* node);
 
 static void release_node_locked(struct node* node)
@@ -66,6 +96,11 @@ static void release_node_locked(struct node* node)
             memset(node->name, 0xef, node->namelen);
             free(node->name);
             free(node->actual_name);
+            free(node->path);
+            if (node->name_index) {
+                pthread_mutex_destroy(&node->name_index->lock);
+                delete node->name_index;
+            }
             memset(node, 0xfc, sizeof(*node));
             free(node);
         }
@@ -105,6 +140,14 @@ static void remove_node_from_parent_locked(struct node* node)
  * or returns -1 if the path is too long for the provided buffer.
  */
 static ssize_t get_node_path_locked(struct node* node, char* buf, size_t bufsize) {
+    if (node->path) {
+        if (bufsize < node->pathlen + 1) {
+            return -1;
+        }
+        memcpy(buf, node->path, node->pathlen + 1);
+        return node->pathlen;
+    }
+
     const char* name;
     size_t namelen;
     if (node->graft_path) {
@@ -135,6 +178,94 @@ static ssize_t get_node_path_locked(struct node* node, char* buf, size_t bufsize
     return pathlen + namelen;
 }
 
+/* Caches the path of a node, from the path of its parent. The lock must be
+ * held for writing. */
+static void update_node_path_locked(struct node* node) {
+    char buf[PATH_MAX];
+    free(node->path);
+    node->path = NULL;
+    ssize_t pathlen = get_node_path_locked(node, buf, sizeof(buf));
+    if (pathlen >= 0) {
+        node->path = strdup(buf);
+        node->pathlen = pathlen;
+    }
+}
+
+static void update_node_paths_recursive_locked(struct node* parent) {
+    struct node* node;
+    for (node = parent->child; node; node = node->next) {
+        update_node_path_locked(node);
+        if (node->child) {
+            update_node_paths_recursive_locked(node);
+        }
+    }
+}
+
+static std::string fold_case(const char* name) {
+    std::string folded(name);
+    for (char& c : folded) {
+        c = tolower(static_cast<unsigned char>(c));
+    }
+    return folded;
+}
+
+/* Looks for name in the directory of parent at path, ignoring case, and
+ * replaces it with the first match, if any. */
+static void find_name_within(struct node* parent, const char* path, char* name) {
+    struct name_index* index = __atomic_load_n(&parent->name_index, __ATOMIC_ACQUIRE);
+    if (!index) {
+        struct name_index* new_index = new name_index();
+        pthread_mutex_init(&new_index->lock, NULL);
+        if (__atomic_compare_exchange_n(&parent->name_index, &index, new_index, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            index = new_index;
+        } else {
+            pthread_mutex_destroy(&new_index->lock);
+            delete new_index;
+        }
+    }
+
+    pthread_mutex_lock(&index->lock);
+    struct stat s;
+    bool has_stat = stat(path, &s) == 0;
+    if (!has_stat || !index->valid || s.st_dev != index->dev || s.st_ino != index->ino
+            || s.st_mtim.tv_sec != index->mtime.tv_sec
+            || s.st_mtim.tv_nsec != index->mtime.tv_nsec) {
+        index->valid = false;
+        index->names.clear();
+        DIR* dir = opendir(path);
+        if (!dir) {
+            PLOG(ERROR) << "opendir(" << path << ") failed";
+            pthread_mutex_unlock(&index->lock);
+            return;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir))) {
+            index->names.emplace(fold_case(entry->d_name), entry->d_name);
+        }
+        closedir(dir);
+
+        if (has_stat) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            index->valid = now.tv_sec - s.st_mtim.tv_sec > NAME_INDEX_MIN_AGE_SEC;
+            index->dev = s.st_dev;
+            index->ino = s.st_ino;
+            index->mtime = s.st_mtim;
+        }
+    }
+
+    const auto& iter = index->names.find(fold_case(name));
+    if (iter != index->names.end()) {
+        /* we have a match - replace the name, don't need to copy the null again */
+        memcpy(name, iter->second.c_str(), iter->second.size());
+    }
+    if (!index->valid) {
+        index->names.clear();
+    }
+    pthread_mutex_unlock(&index->lock);
+}
+
 /* Finds the absolute path of a file within a given directory.
  * Performs a case-insensitive search for the file and sets the buffer to the path
  * of the first matching file.  If 'search' is zero or if no match is found, sets
@@ -143,7 +274,7 @@ static ssize_t get_node_path_locked(struct node* node, char* buf, size_t bufsize
  * Populates 'buf' with the path and returns the actual name (within 'buf') on success,
  * or returns NULL if the path is too long for the provided buffer.
  */
-static char* find_file_within(const char* path, const char* name,
+static char* find_file_within(struct node* parent, const char* path, const char* name,
         char* buf, size_t bufsize, int search)
 {
     size_t pathlen = strlen(path);
@@ -161,20 +292,7 @@ static char* find_file_within(const char* path, const char* name,
     memcpy(actual, name, namelen + 1);
 
     if (search && access(buf, F_OK)) {
-        struct dirent* entry;
-        DIR* dir = opendir(path);
-        if (!dir) {
-            PLOG(ERROR) << "opendir(" << path << ") failed";
-            return actual;
-        }
-        while ((entry = readdir(dir))) {
-            if (!strcasecmp(entry->d_name, name)) {
-                /* we have a match - replace the name, don't need to copy the null again */
-                memcpy(actual, entry->d_name, namelen);
-                break;
-            }
-        }
-        closedir(dir);
+        find_name_within(parent, path, actual);
     }
     return actual;
 }
@@ -378,6 +496,7 @@ struct node *create_node_locked(struct fuse* fuse,
     derive_permissions_locked(fuse, parent, node);
     acquire_node_locked(node);
     add_node_to_parent_locked(node, parent);
+    update_node_path_locked(node);
     return node;
 }
 
@@ -517,11 +636,20 @@ static int fuse_reply_entry(struct fuse* fuse, __u64 unique,
         return -errno;
     }
 
-    pthread_mutex_lock(&fuse->global->lock);
-    node = acquire_or_create_child_locked(fuse, parent, name, actual_name);
-    if (!node) {
-        pthread_mutex_unlock(&fuse->global->lock);
-        return -ENOMEM;
+    /* Most lookups are for nodes that already exist, which the lock only
+     * needs to be held for reading to find. */
+    pthread_rwlock_rdlock(&fuse->global->lock);
+    node = lookup_child_by_name_locked(parent, name);
+    if (node) {
+        acquire_node_shared_locked(node);
+    } else {
+        pthread_rwlock_unlock(&fuse->global->lock);
+        pthread_rwlock_wrlock(&fuse->global->lock);
+        node = acquire_or_create_child_locked(fuse, parent, name, actual_name);
+        if (!node) {
+            pthread_rwlock_unlock(&fuse->global->lock);
+            return -ENOMEM;
+        }
     }
     memset(&out, 0, sizeof(out));
     attr_from_stat(fuse, &out.attr, &s, node);
@@ -529,7 +657,7 @@ static int fuse_reply_entry(struct fuse* fuse, __u64 unique,
     out.entry_valid = 10;
     out.nodeid = node->nid;
     out.generation = node->gen;
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     fuse_reply(fuse, unique, &out, sizeof(out));
     return NO_STATUS;
 }
@@ -544,7 +672,9 @@ static int fuse_reply_attr(struct fuse* fuse, __u64 unique, const struct node* n
         return -errno;
     }
     memset(&out, 0, sizeof(out));
+    pthread_rwlock_rdlock(&fuse->global->lock);
     attr_from_stat(fuse, &out.attr, &s, node);
+    pthread_rwlock_unlock(&fuse->global->lock);
     out.attr_valid = 10;
     fuse_reply(fuse, unique, &out, sizeof(out));
     return NO_STATUS;
@@ -592,18 +722,20 @@ static int handle_lookup(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] LOOKUP " << name << " @ " << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = parent_node &&
+            check_caller_access_to_name(fuse, hdr, parent_node, name, R_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
-    if (!parent_node || !(actual_name = find_file_within(parent_path, name,
+    if (!parent_node || !(actual_name = find_file_within(parent_node, parent_path, name,
             child_path, sizeof(child_path), 1))) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_name(fuse, hdr, parent_node, name, R_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
 
@@ -615,7 +747,7 @@ static int handle_forget(struct fuse* fuse, struct fuse_handler* handler,
 {
     struct node* node;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     node = lookup_node_by_id_locked(fuse, hdr->nodeid);
     DLOG(INFO) << "[" << handler->token << "] FORGET #" << req->nlookup
                << " @ " << std::hex << hdr->nodeid
@@ -627,7 +759,7 @@ static int handle_forget(struct fuse* fuse, struct fuse_handler* handler,
             release_node_locked(node);
         }
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     return NO_STATUS; /* no reply */
 }
 
@@ -637,17 +769,18 @@ static int handle_getattr(struct fuse* fuse, struct fuse_handler* handler,
     struct node* node;
     char path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] GETATTR flags=" << req->getattr_flags
                << " fh=" << std::hex << req->fh << " @ " << hdr->nodeid << std::dec
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = node && check_caller_access_to_node(fuse, hdr, node, R_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_node(fuse, hdr, node, R_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
 
@@ -661,19 +794,20 @@ static int handle_setattr(struct fuse* fuse, struct fuse_handler* handler,
     char path[PATH_MAX];
     struct timespec times[2];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] SETATTR fh=" << std::hex << req->fh
                << " valid=" << std::hex << req->valid << " @ " << hdr->nodeid << std::dec
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = node && ((req->valid & FATTR_FH) ||
+            check_caller_access_to_node(fuse, hdr, node, W_OK));
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
     }
 
-    if (!(req->valid & FATTR_FH) &&
-            !check_caller_access_to_node(fuse, hdr, node, W_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
 
@@ -726,19 +860,21 @@ static int handle_mknod(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] MKNOD " << name << " 0" << std::oct << req->mode
                << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = parent_node &&
+            check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
-    if (!parent_node || !(actual_name = find_file_within(parent_path, name,
+    if (!parent_node || !(actual_name = find_file_within(parent_node, parent_path, name,
             child_path, sizeof(child_path), 1))) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
     __u32 mode = (req->mode & (~0777)) | 0664;
@@ -756,19 +892,22 @@ static int handle_mkdir(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] MKDIR " << name << " 0" << std::oct << req->mode
                << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = parent_node &&
+            check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK);
+    perm_t parent_perm = parent_node ? parent_node->perm : PERM_INHERIT;
+    pthread_rwlock_unlock(&fuse->global->lock);
 
-    if (!parent_node || !(actual_name = find_file_within(parent_path, name,
+    if (!parent_node || !(actual_name = find_file_within(parent_node, parent_path, name,
             child_path, sizeof(child_path), 1))) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
     __u32 mode = (req->mode & (~0777)) | 0775;
@@ -777,7 +916,7 @@ static int handle_mkdir(struct fuse* fuse, struct fuse_handler* handler,
     }
 
     /* When creating /Android/data and /Android/obb, mark them as .nomedia */
-    if (parent_node->perm == PERM_ANDROID && !strcasecmp(name, "data")) {
+    if (parent_perm == PERM_ANDROID && !strcasecmp(name, "data")) {
         char nomedia[PATH_MAX];
         snprintf(nomedia, PATH_MAX, "%s/.nomedia", child_path);
         if (touch(nomedia, 0664) != 0) {
@@ -785,7 +924,7 @@ static int handle_mkdir(struct fuse* fuse, struct fuse_handler* handler,
             return -ENOENT;
         }
     }
-    if (parent_node->perm == PERM_ANDROID && !strcasecmp(name, "obb")) {
+    if (parent_perm == PERM_ANDROID && !strcasecmp(name, "obb")) {
         char nomedia[PATH_MAX];
         snprintf(nomedia, PATH_MAX, "%s/.nomedia", fuse->global->obb_path);
         if (touch(nomedia, 0664) != 0) {
@@ -805,29 +944,31 @@ static int handle_unlink(struct fuse* fuse, struct fuse_handler* handler,
     char parent_path[PATH_MAX];
     char child_path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] UNLINK " << name << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = parent_node &&
+            check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
-    if (!parent_node || !find_file_within(parent_path, name,
+    if (!parent_node || !find_file_within(parent_node, parent_path, name,
             child_path, sizeof(child_path), 1)) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
     if (unlink(child_path) == -1) {
         return -errno;
     }
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     child_node = lookup_child_by_name_locked(parent_node, name);
     if (child_node) {
         child_node->deleted = true;
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (parent_node && child_node) {
         /* Tell all other views that node is gone */
         DLOG(INFO) << "[" << handler->token << "] fuse_notify_delete"
@@ -855,29 +996,31 @@ static int handle_rmdir(struct fuse* fuse, struct fuse_handler* handler,
     char parent_path[PATH_MAX];
     char child_path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] UNLINK " << name << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = parent_node &&
+            check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
-    if (!parent_node || !find_file_within(parent_path, name,
+    if (!parent_node || !find_file_within(parent_node, parent_path, name,
             child_path, sizeof(child_path), 1)) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_name(fuse, hdr, parent_node, name, W_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
     if (rmdir(child_path) == -1) {
         return -errno;
     }
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     child_node = lookup_child_by_name_locked(parent_node, name);
     if (child_node) {
         child_node->deleted = true;
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (parent_node && child_node) {
         /* Tell all other views that node is gone */
         DLOG(INFO) << "[" << handler->token << "] fuse_notify_delete"
@@ -912,7 +1055,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
     int search;
     int res;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     old_parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             old_parent_path, sizeof(old_parent_path));
     new_parent_node = lookup_node_and_path_by_id_locked(fuse, req->newdir,
@@ -941,7 +1084,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
         goto lookup_error;
     }
     acquire_node_locked(child_node);
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     /* Special case for renaming a file where destination is same path
      * differing only by case.  In this case we don't want to look for a case
@@ -949,7 +1092,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
      */
     search = old_parent_node != new_parent_node
             || strcasecmp(old_name, new_name);
-    if (!(new_actual_name = find_file_within(new_parent_path, new_name,
+    if (!(new_actual_name = find_file_within(new_parent_node, new_parent_path, new_name,
             new_child_path, sizeof(new_child_path), search))) {
         res = -ENOENT;
         goto io_error;
@@ -962,22 +1105,24 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
         goto io_error;
     }
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     res = rename_node_locked(child_node, new_name, new_actual_name);
     if (!res) {
         remove_node_from_parent_locked(child_node);
         derive_permissions_locked(fuse, new_parent_node, child_node);
         derive_permissions_recursive_locked(fuse, child_node);
         add_node_to_parent_locked(child_node, new_parent_node);
+        update_node_path_locked(child_node);
+        update_node_paths_recursive_locked(child_node);
     }
     goto done;
 
 io_error:
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
 done:
     release_node_locked(child_node);
 lookup_error:
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     return res;
 }
 
@@ -1000,18 +1145,19 @@ static int handle_open(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_open_out out = {};
     struct handle *h;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] OPEN 0" << std::oct << req->flags
                << " @ " << std::hex << hdr->nodeid << std::dec
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = node && check_caller_access_to_node(fuse, hdr, node,
+            open_flags_to_access_mode(req->flags));
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_node(fuse, hdr, node,
-            open_flags_to_access_mode(req->flags))) {
+    if (!has_access) {
         return -EACCES;
     }
     h = static_cast<struct handle*>(malloc(sizeof(*h)));
@@ -1030,6 +1176,86 @@ static int handle_open(struct fuse* fuse, struct fuse_handler* handler,
     return NO_STATUS;
 }
 
+/* Empties the splice pipe of the handler, or closes it so that splicing isn't
+ * attempted again if that fails. Anything read from it lands in the read buffer. */
+static void drain_splice_pipe(struct fuse_handler* handler)
+{
+    for (;;) {
+        ssize_t ret = read(handler->splice_pipe[0], handler->read_buffer,
+                sizeof(handler->read_buffer));
+        if (ret > 0 || (ret == -1 && errno == EINTR)) {
+            continue;
+        }
+        if (ret == -1 && errno != EAGAIN) {
+            PLOG(ERROR) << "[" << handler->token << "] draining splice pipe";
+            close(handler->splice_pipe[0]);
+            close(handler->splice_pipe[1]);
+            handler->splice_pipe[0] = handler->splice_pipe[1] = -1;
+        }
+        return;
+    }
+}
+
+/* Replies to a read with data moved from fd to the FUSE device through the
+ * splice pipe, rather than copied in and out of the read buffer. Returns
+ * NO_STATUS if a reply was sent, or -errno if the caller must reply instead. */
+static int fuse_reply_read_splice(struct fuse* fuse, struct fuse_handler* handler,
+        __u64 unique, int fd, __u32 size, __u64 offset)
+{
+    struct fuse_out_header hdr;
+    hdr.len = sizeof(hdr) + size;
+    hdr.error = 0;
+    hdr.unique = unique;
+
+    /* The header has to go first, so it claims the whole size and gets fixed
+     * up below if the file turns out to be shorter. */
+    if (TEMP_FAILURE_RETRY(write(handler->splice_pipe[1], &hdr, sizeof(hdr))) != sizeof(hdr)) {
+        drain_splice_pipe(handler);
+        return -EAGAIN;
+    }
+    loff_t pos = offset;
+    __u32 spliced = 0;
+    ssize_t ret = 0;
+    while (spliced < size) {
+        ret = TEMP_FAILURE_RETRY(splice(fd, &pos, handler->splice_pipe[1], NULL,
+                size - spliced, SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+        if (ret <= 0) {
+            break;
+        }
+        spliced += ret;
+    }
+
+    if (spliced == size) {
+        ret = TEMP_FAILURE_RETRY(splice(handler->splice_pipe[0], NULL, fuse->fd, NULL,
+                hdr.len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+        if (ret == static_cast<ssize_t>(hdr.len)) {
+            return NO_STATUS;
+        }
+        if (ret == -1) {
+            PLOG(ERROR) << "*** REPLY FAILED ***";
+        } else {
+            LOG(ERROR) << "*** REPLY FAILED: spliced " << ret << " expected " << hdr.len << " ***";
+        }
+        drain_splice_pipe(handler);
+        return NO_STATUS;
+    }
+
+    /* A short read, at the end of the file: take the data back out of the pipe
+     * and reply the usual way. */
+    int err = (ret == -1) ? errno : 0;
+    if (TEMP_FAILURE_RETRY(read(handler->splice_pipe[0], &hdr, sizeof(hdr))) == sizeof(hdr)
+            && TEMP_FAILURE_RETRY(read(handler->splice_pipe[0], handler->read_buffer,
+                    spliced)) == static_cast<ssize_t>(spliced)) {
+        if (spliced == 0 && err != 0) {
+            return -err;
+        }
+        fuse_reply(fuse, unique, handler->read_buffer, spliced);
+        return NO_STATUS;
+    }
+    drain_splice_pipe(handler);
+    return -EAGAIN;
+}
+
 static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
         const struct fuse_in_header* hdr, const struct fuse_read_in* req)
 {
@@ -1038,7 +1264,6 @@ static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
     __u32 size = req->size;
     __u64 offset = req->offset;
     int res;
-    __u8 *read_buffer = (__u8 *) ((uintptr_t)(handler->read_buffer + PAGE_SIZE) & ~((uintptr_t)PAGE_SIZE-1));
 
     /* Don't access any other fields of hdr or req beyond this point, the read buffer
      * overlaps the request buffer and will clobber data in the request.  This
@@ -1049,11 +1274,18 @@ static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
     if (size > MAX_READ) {
         return -EINVAL;
     }
-    res = TEMP_FAILURE_RETRY(pread64(h->fd, read_buffer, size, offset));
+    if (handler->splice_pipe[0] != -1) {
+        res = fuse_reply_read_splice(fuse, handler, unique, h->fd, size, offset);
+        /* Some filesystems can't splice, which is only found out by trying. */
+        if (res != -EINVAL && res != -EAGAIN) {
+            return res;
+        }
+    }
+    res = TEMP_FAILURE_RETRY(pread64(h->fd, handler->read_buffer, size, offset));
     if (res == -1) {
         return -errno;
     }
-    fuse_reply(fuse, unique, read_buffer, res);
+    fuse_reply(fuse, unique, handler->read_buffer, res);
     return NO_STATUS;
 }
 
@@ -1064,13 +1296,8 @@ static int handle_write(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_write_out out;
     struct handle *h = static_cast<struct handle*>(id_to_ptr(req->fh));
     int res;
-    __u8 aligned_buffer[req->size] __attribute__((__aligned__(PAGE_SIZE)));
-
-    if (req->flags & O_DIRECT) {
-        memcpy(aligned_buffer, buffer, req->size);
-        buffer = (const __u8*) aligned_buffer;
-    }
 
+    /* The data is already page-aligned for O_DIRECT, see REQUEST_OFFSET. */
     DLOG(INFO) << "[" << handler->token << "] WRITE " << std::hex << h << std::dec
                << "(" << h->fd << ") " << req->size << "@" << req->offset;
     res = TEMP_FAILURE_RETRY(pwrite64(h->fd, buffer, req->size, req->offset));
@@ -1091,10 +1318,10 @@ static int handle_statfs(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_statfs_out out;
     int res;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     DLOG(INFO) << "[" << handler->token << "] STATFS";
     res = get_node_path_locked(&fuse->global->root, path, sizeof(path));
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (res < 0) {
         return -ENOENT;
     }
@@ -1165,16 +1392,17 @@ static int handle_opendir(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_open_out out = {};
     struct dirhandle *h;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] OPENDIR @ " << std::hex << hdr->nodeid
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = node && check_caller_access_to_node(fuse, hdr, node, R_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_node(fuse, hdr, node, R_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
     h = static_cast<struct dirhandle*>(malloc(sizeof(*h)));
@@ -1282,17 +1510,18 @@ static int handle_canonical_path(struct fuse* fuse, struct fuse_handler* handler
     char path[PATH_MAX];
     int len;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] CANONICAL_PATH @ " << std::hex << hdr->nodeid
                << std::dec << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    bool has_access = node && check_caller_access_to_node(fuse, hdr, node, R_OK);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
     }
-    if (!check_caller_access_to_node(fuse, hdr, node, R_OK)) {
+    if (!has_access) {
         return -EACCES;
     }
     len = strlen(path);
@@ -1433,9 +1662,22 @@ static int handle_fuse_request(struct fuse *fuse, struct fuse_handler* handler,
 void handle_fuse_requests(struct fuse_handler* handler)
 {
     struct fuse* fuse = handler->fuse;
+    __u8* request = handler->request_buffer + REQUEST_OFFSET;
+
+    /* The pipe has to hold a whole read reply. */
+    if (pipe2(handler->splice_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        PLOG(WARNING) << "[" << handler->token << "] no splice pipe";
+        handler->splice_pipe[0] = handler->splice_pipe[1] = -1;
+    } else if (fcntl(handler->splice_pipe[0], F_SETPIPE_SZ,
+            sizeof(struct fuse_out_header) + MAX_READ) == -1) {
+        PLOG(WARNING) << "[" << handler->token << "] can't resize splice pipe";
+        close(handler->splice_pipe[0]);
+        close(handler->splice_pipe[1]);
+        handler->splice_pipe[0] = handler->splice_pipe[1] = -1;
+    }
+
     for (;;) {
-        ssize_t len = TEMP_FAILURE_RETRY(read(fuse->fd,
-                handler->request_buffer, sizeof(handler->request_buffer)));
+        ssize_t len = TEMP_FAILURE_RETRY(read(fuse->fd, request, MAX_REQUEST_SIZE));
         if (len == -1) {
             if (errno == ENODEV) {
                 LOG(ERROR) << "[" << handler->token << "] someone stole our marbles!";
@@ -1451,14 +1693,14 @@ void handle_fuse_requests(struct fuse_handler* handler)
         }
 
         const struct fuse_in_header* hdr =
-            reinterpret_cast<const struct fuse_in_header*>(handler->request_buffer);
+            reinterpret_cast<const struct fuse_in_header*>(request);
         if (hdr->len != static_cast<size_t>(len)) {
             LOG(ERROR) << "[" << handler->token << "] malformed header: len=" << len
                        << ", hdr->len=" << hdr->len;
             continue;
         }
 
-        const void *data = handler->request_buffer + sizeof(struct fuse_in_header);
+        const void *data = request + sizeof(struct fuse_in_header);
         size_t data_len = len - sizeof(struct fuse_in_header);
         __u64 unique = hdr->unique;
         int res = handle_fuse_request(fuse, handler, hdr, data, data_len);
@@ -63,6 +63,10 @@ static constexpr bool kEnableDLog = false;
  * the largest possible data payload. */
 #define MAX_REQUEST_SIZE (sizeof(struct fuse_in_header) + sizeof(struct fuse_write_in) + MAX_WRITE)
 
+/* Requests are read this far into the request buffer, so that the data of
+ * FUSE_WRITE requests starts on a page boundary, as O_DIRECT needs. */
+#define REQUEST_OFFSET (PAGE_SIZE - sizeof(struct fuse_in_header) - sizeof(struct fuse_write_in))
+
 namespace {
 struct CaseInsensitiveCompare {
     bool operator()(const std::string& lhs, const std::string& rhs) const {
@@ -135,12 +139,24 @@ struct node {
     char* graft_path;
     size_t graft_pathlen;
 
+    /* If non-null, the absolute path of this node in the underlying storage,
+     * cached by update_node_path_locked() when the node is created or moved. */
+    char* path;
+    size_t pathlen;
+
+    /* Index of the names in this directory in the underlying storage, built
+     * by the first case-insensitive search in it. */
+    struct name_index* name_index;
+
     bool deleted;
 };
 
 /* Global data for all FUSE mounts */
 struct fuse_global {
-    pthread_mutex_t lock;
+    /* Guards the node tree. Functions suffixed _locked need it held, for
+     * writing if they change the tree or drop references, else for reading
+     * so that the requests that only resolve nodes run in parallel. */
+    pthread_rwlock_t lock;
 
     uid_t uid;
     gid_t gid;
@@ -169,7 +185,7 @@ struct fuse_global {
      * inode numbers into 32 bit values on 64 bit kernels (see fuse_squash_ino
      * in fs/fuse/inode.c).
      *
-     * Accesses must be guarded by |lock|.
+     * Accesses must be guarded by |lock|, held for writing.
      */
     __u32 inode_ctr;
 
@@ -190,17 +206,21 @@ struct fuse {
     mode_t mask;
 };
 
-/* Private data used by a single FUSE handler */
+/* Private data used by a single FUSE handler. Handlers must be page-aligned. */
 struct fuse_handler {
     struct fuse* fuse;
     int token;
 
+    /* Pipe through which read replies are spliced from the file to the FUSE
+     * device, set up by handle_fuse_requests(), or -1 if unavailable. */
+    int splice_pipe[2];
+
     /* To save memory, we never use the contents of the request buffer and the read
      * buffer at the same time.  This allows us to share the underlying storage. */
     union {
-        __u8 request_buffer[MAX_REQUEST_SIZE];
-        __u8 read_buffer[MAX_READ + PAGE_SIZE];
-    };
+        __u8 request_buffer[REQUEST_OFFSET + MAX_REQUEST_SIZE];
+        __u8 read_buffer[MAX_READ];
+    } __attribute__((__aligned__(PAGE_SIZE)));
 };
 
 void handle_fuse_requests(struct fuse_handler* handler);
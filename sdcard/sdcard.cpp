@@ -137,7 +137,7 @@ static bool package_parse_callback(pkg_info *info, void *userdata) {
 }
 
 static bool read_package_list(struct fuse_global* global) {
-    pthread_mutex_lock(&global->lock);
+    pthread_rwlock_wrlock(&global->lock);
 
     global->package_to_appid->clear();
     bool rc = packagelist_parse(package_parse_callback, global);
@@ -146,7 +146,7 @@ static bool read_package_list(struct fuse_global* global) {
     // Regenerate ownership details using newly loaded mapping.
     derive_permissions_recursive_locked(global->fuse_default, &global->root);
 
-    pthread_mutex_unlock(&global->lock);
+    pthread_rwlock_unlock(&global->lock);
 
     return rc;
 }
@@ -250,6 +250,11 @@ static void drop_privs(uid_t uid, gid_t gid) {
     minijail_enter(j.get());
 }
 
+/* Number of threads handling the requests of each mount. The kernel hands
+ * each request to a single reader of /dev/fuse, so a slow request on a
+ * mount doesn't hold up the others. */
+#define HANDLERS_PER_MOUNT 4
+
 static void* start_handler(void* data) {
     struct fuse_handler* handler = static_cast<fuse_handler*>(data);
     handle_fuse_requests(handler);
@@ -262,22 +267,14 @@ static void run(const char* source_path, const char* label, uid_t uid,
     struct fuse fuse_default;
     struct fuse fuse_read;
     struct fuse fuse_write;
-    struct fuse_handler handler_default;
-    struct fuse_handler handler_read;
-    struct fuse_handler handler_write;
-    pthread_t thread_default;
-    pthread_t thread_read;
-    pthread_t thread_write;
+    struct fuse* fuses[] = { &fuse_default, &fuse_read, &fuse_write };
 
     memset(&global, 0, sizeof(global));
     memset(&fuse_default, 0, sizeof(fuse_default));
     memset(&fuse_read, 0, sizeof(fuse_read));
     memset(&fuse_write, 0, sizeof(fuse_write));
-    memset(&handler_default, 0, sizeof(handler_default));
-    memset(&handler_read, 0, sizeof(handler_read));
-    memset(&handler_write, 0, sizeof(handler_write));
 
-    pthread_mutex_init(&global.lock, NULL);
+    pthread_rwlock_init(&global.lock, NULL);
     global.package_to_appid = new AppIdMap;
     global.uid = uid;
     global.gid = gid;
@@ -318,14 +315,6 @@ static void run(const char* source_path, const char* label, uid_t uid,
     snprintf(fuse_read.dest_path, PATH_MAX, "/mnt/runtime/read/%s", label);
     snprintf(fuse_write.dest_path, PATH_MAX, "/mnt/runtime/write/%s", label);
 
-    handler_default.fuse = &fuse_default;
-    handler_read.fuse = &fuse_read;
-    handler_write.fuse = &fuse_write;
-
-    handler_default.token = 0;
-    handler_read.token = 1;
-    handler_write.token = 2;
-
     umask(0);
 
     if (multi_user) {
@@ -354,10 +343,22 @@ static void run(const char* source_path, const char* label, uid_t uid,
         fs_prepare_dir(global.obb_path, 0775, uid, gid);
     }
 
-    if (pthread_create(&thread_default, NULL, start_handler, &handler_default)
-            || pthread_create(&thread_read, NULL, start_handler, &handler_read)
-            || pthread_create(&thread_write, NULL, start_handler, &handler_write)) {
-        LOG(FATAL) << "failed to pthread_create";
+    /* The handlers are too large for the stack, and are never freed. Their
+     * buffers must be page-aligned. */
+    size_t handler_count = arraysize(fuses) * HANDLERS_PER_MOUNT;
+    void* handler_memory;
+    if (posix_memalign(&handler_memory, PAGE_SIZE, handler_count * sizeof(struct fuse_handler))) {
+        LOG(FATAL) << "failed to allocate handlers";
+    }
+    memset(handler_memory, 0, handler_count * sizeof(struct fuse_handler));
+    struct fuse_handler* handlers = static_cast<struct fuse_handler*>(handler_memory);
+    for (size_t i = 0; i < handler_count; i++) {
+        pthread_t thread;
+        handlers[i].fuse = fuses[i / HANDLERS_PER_MOUNT];
+        handlers[i].token = i;
+        if (pthread_create(&thread, NULL, start_handler, &handlers[i])) {
+            LOG(FATAL) << "failed to pthread_create";
+        }
     }
 
     watch_package_list(&global);
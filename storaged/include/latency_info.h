@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LATENCY_INFO_H_
+#define _LATENCY_INFO_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include <binder/Parcelable.h>
+
+namespace android {
+namespace os {
+namespace storaged {
+
+// uids whose I/O latency is kept apart
+enum uid_bucket_t {
+    UID_BUCKET_SYSTEM = 0,          // below AID_APP_START, kernel threads and writeback
+    UID_BUCKET_APP = 1,
+    UID_BUCKETS = 2
+};
+
+class LatencyInfo : public Parcelable {
+public:
+    std::string device;             // block device name
+    uint32_t uid_bucket;            // uid_bucket_t
+    uint32_t io_type;               // io_type_t
+    uint64_t count;                 // number of requests completed
+    uint64_t p50_us;                // latency percentiles, in microseconds
+    uint64_t p99_us;
+    uint64_t p999_us;
+    uint64_t max_us;
+
+    status_t writeToParcel(Parcel* parcel) const override;
+    status_t readFromParcel(const Parcel* parcel) override;
+};
+
+} // namespace storaged
+} // namespace os
+} // namespace android
+
+#endif /*  _LATENCY_INFO_H_ */
@@ -50,7 +50,9 @@ friend class test_case_name##_##test_name##_Test
 #define YEAR_TO_WEEKS ( 52 )
 
 #include "storaged_diskstats.h"
+#include "storaged_history.h"
 #include "storaged_info.h"
+#include "storaged_latency.h"
 #include "storaged_uid_monitor.h"
 #include "storaged.pb.h"
 #include "uid_info.h"
@@ -83,11 +85,16 @@ class storaged_t : public android::hardware::health::V2_0::IHealthInfoCallback,
     storaged_config mConfig;
     unique_ptr<disk_stats_monitor> mDsm;
     uid_monitor mUidm;
+    disk_latency_monitor mDlm;
     time_t mStarttime;
     sp<android::hardware::health::V2_0::IHealth> health;
     unique_ptr<storage_info_t> storage_info;
     static const uint32_t current_version;
     unordered_map<userid_t, bool> proto_loaded;
+    // uid io history of every user whose proto was loaded
+    unordered_map<userid_t, unique_ptr<uid_io_history_log>> uid_io_logs;
+    // set while a user's uid io history is only in the proto of an older version
+    unordered_map<userid_t, bool> legacy_uid_io_proto;
     void load_proto(userid_t user_id);
     char* prepare_proto(userid_t user_id, StoragedProto* proto);
     void flush_proto(userid_t user_id, StoragedProto* proto);
@@ -96,6 +103,11 @@ class storaged_t : public android::hardware::health::V2_0::IHealthInfoCallback,
         return string("/data/misc_ce/") + to_string(user_id) +
                "/storaged/storaged.proto";
     }
+    string uid_io_history_path(userid_t user_id) {
+        return string("/data/misc_ce/") + to_string(user_id) +
+               "/storaged/uid_io_history";
+    }
+    bool flush_uid_io_history(userid_t user_id, const UidIOUsage& usage);
     void init_health_service();
 
   public:
@@ -121,6 +133,10 @@ class storaged_t : public android::hardware::health::V2_0::IHealthInfoCallback,
 
     uint32_t get_recent_perf(void) { return storage_info->get_recent_perf(); }
 
+    vector<LatencyInfo> get_latency(void) {
+        return mDlm.get_latency();
+    }
+
     map<uint64_t, struct uid_records> get_uid_records(
             double hours, uint64_t threshold, bool force_report) {
         return mUidm.dump(hours, threshold, force_report);
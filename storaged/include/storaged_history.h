@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STORAGED_HISTORY_H_
+#define _STORAGED_HISTORY_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+#include "storaged.pb.h"
+
+#define FRIEND_TEST(test_case_name, test_name) \
+friend class test_case_name##_##test_name##_Test
+
+using namespace std;
+using namespace storaged_proto;
+
+/*
+ * Append-only file of the uid io history of one user. Each record is one
+ * UidIOItem, that is the records of one report, with its size and crc, so a
+ * flush only writes the items reported since the last one. The file is
+ * rewritten once most of its items have left the history.
+ */
+class uid_io_history_log {
+  private:
+    FRIEND_TEST(storaged_test, uid_io_history_log);
+    const string path;
+    // end_ts of the last item in the file
+    uint64_t last_end_ts;
+    // number of items in the file and its size up to the last valid one
+    uint32_t nr_items;
+    off_t size;
+    // the file is missing, from another version or ends with a torn record
+    bool rewrite_needed;
+
+    bool append(const UidIOUsage& usage, int first_item);
+
+  public:
+    explicit uid_io_history_log(const string& path);
+    // Maps the file and adds its items to usage. Returns false if there is
+    // no valid file.
+    bool load(UidIOUsage* usage);
+    // Appends the items of usage that end after the last one in the file,
+    // or rewrites it if it would hold too many stale items.
+    bool flush(const UidIOUsage& usage);
+    // Rewrites the file with the items of usage only.
+    bool compact(const UidIOUsage& usage);
+};
+
+#endif /* _STORAGED_HISTORY_H_ */
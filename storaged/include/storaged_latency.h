@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STORAGED_LATENCY_H_
+#define _STORAGED_LATENCY_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <utils/Mutex.h>
+
+#include "latency_info.h"
+#include "uid_info.h"
+
+#define FRIEND_TEST(test_case_name, test_name) \
+friend class test_case_name##_##test_name##_Test
+
+using namespace std;
+using namespace android;
+using namespace android::os::storaged;
+
+/*
+ * Log-linear histogram of latencies in microseconds, as in HdrHistogram:
+ * values below 32us have a bucket each, and every power of two above is
+ * split into 16 buckets, so any value is known within 1/16th of it.
+ */
+class latency_histogram {
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    // values of a bucket each
+    static constexpr uint64_t LINEAR_BUCKETS = 2 * SUB_BUCKETS;
+    // larger values are counted as this
+    static constexpr uint64_t MAX_VALUE = (1ULL << 32) - 1;
+    static constexpr size_t NR_BUCKETS =
+        LINEAR_BUCKETS + (32 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+    uint64_t mCounts[NR_BUCKETS];
+    uint64_t mCount;
+    uint64_t mMax;
+
+    static size_t bucket_index(uint64_t value);
+    // highest value counted in the bucket
+    static uint64_t bucket_upper(size_t index);
+
+public:
+    latency_histogram() : mCounts(), mCount(0), mMax(0) {}
+    void add(uint64_t value_us);
+    // Returns the latency below which fraction of the requests completed.
+    uint64_t percentile(double fraction) const;
+    uint64_t count() const { return mCount; }
+    uint64_t max() const { return mMax; }
+    latency_histogram& operator+= (const latency_histogram& hist);
+};
+
+/*
+ * Times every request to the block devices from the block_rq_issue and
+ * block_rq_complete tracepoints, in a tracefs instance of its own, and keeps
+ * their latencies per device, uid bucket and io type. The uid is that of the
+ * task issuing the request, so writeback counts as system.
+ */
+class disk_latency_monitor {
+private:
+    FRIEND_TEST(storaged_test, disk_latency_monitor);
+
+    struct inflight_io {
+        uint64_t issue_us;
+        uid_bucket_t uid_bucket;
+        io_type_t io_type;
+    };
+
+    struct disk_latency {
+        string name;
+        // requests issued and not yet completed, mapped from sector
+        unordered_map<uint64_t, inflight_io> inflight;
+        latency_histogram hists[UID_BUCKETS][IO_TYPES];
+    };
+
+    bool enable;
+    string mInstance;
+    android::base::unique_fd mPipe;
+    // partial line left from the last read
+    string mLine;
+    // mapped from dev_t
+    unordered_map<uint64_t, disk_latency> mDisks;
+    // uid of the tasks that issued requests, cleared once it grows too large
+    unordered_map<pid_t, uid_t> mTaskUids;
+    // protects mDisks
+    Mutex mLock;
+
+    bool setup_instance();
+    static void* thread_main(void* monitor);
+    void read_events();
+    void handle_event(char* line);
+    uid_bucket_t get_uid_bucket(pid_t pid);
+    disk_latency& get_disk(uint64_t dev);
+
+public:
+    disk_latency_monitor() : enable(false) {}
+    // Starts tracing the requests if ro.storaged.latency_trace is set.
+    void start();
+    bool enabled() { return enable; }
+    vector<LatencyInfo> get_latency();
+};
+
+#endif /* _STORAGED_LATENCY_H_ */
@@ -49,6 +49,7 @@ public:
 
     binder::Status dumpUids(vector<UidInfo>* _aidl_return);
     binder::Status dumpPerfHistory(vector<int32_t>* _aidl_return);
+    binder::Status dumpLatency(vector<LatencyInfo>* _aidl_return);
 };
 
 sp<IStoragedPrivate> get_storaged_pri_service();
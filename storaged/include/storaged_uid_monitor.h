@@ -23,6 +23,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include <android-base/unique_fd.h>
 #include <cutils/multiuser.h>
 #include <utils/Mutex.h>
 
@@ -42,6 +43,30 @@ public:
     bool parse_uid_io_stats(string&& s);
 };
 
+// counters of a task in the last read of /proc/uid_io/stats
+struct task_io_state {
+    string comm;
+    io_stats io[UID_STATS];
+    // bytes read and written since the read before
+    uint64_t delta[IO_TYPES][UID_STATS];
+    // last read that listed the task
+    uint64_t seq;
+};
+
+// counters of a uid in the last read of /proc/uid_io/stats, updated in place
+struct uid_io_state {
+    string name;
+    // false until the package manager named the uid
+    bool named;
+    io_stats io[UID_STATS];
+    // bytes read and written since the read before
+    uint64_t delta[IO_TYPES][UID_STATS];
+    // last read that listed the uid
+    uint64_t seq;
+    // mapped from pid
+    unordered_map<pid_t, task_io_state> tasks;
+};
+
 class io_usage {
 public:
     io_usage() : bytes{{{0}}} {};
@@ -79,23 +104,35 @@ struct uid_records {
 class uid_monitor {
 private:
     FRIEND_TEST(storaged_test, uid_monitor);
-    // last dump from /proc/uid_io/stats, uid -> uid_info
-    unordered_map<uint32_t, uid_info> last_uid_io_stats;
+    FRIEND_TEST(storaged_test, uid_monitor_io_stats);
+    // last dump from /proc/uid_io/stats, uid -> uid_io_state
+    unordered_map<uint32_t, uid_io_state> last_uid_io_stats;
+    // number of dumps parsed into last_uid_io_stats
+    uint64_t io_stats_seq;
+    // UID_IO_STATS_PATH, kept open, and the buffer of its last dump
+    android::base::unique_fd io_stats_fd;
+    string io_stats_buffer;
     // current io usage for next report, app name -> uid_io_usage
     unordered_map<string, struct uid_io_usage> curr_io_stats;
     // io usage records, end timestamp -> {start timestamp, vector of records}
     map<uint64_t, struct uid_records> io_history;
     // charger ON/OFF
     charger_stat_t charger_stat;
-    // protects curr_io_stats, last_uid_io_stats, records and charger_stat
+    // protects curr_io_stats, last_uid_io_stats, io_stats_buffer, records and charger_stat
     Mutex uidm_mutex;
     // start time for IO records
     uint64_t start_ts;
     // true if UID_IO_STATS_PATH is accessible
     const bool enable;
 
-    // reads from /proc/uid_io/stats
+    // reads from /proc/uid_io/stats into io_stats_buffer
+    bool read_uid_io_stats_locked();
+    // parses io_stats_buffer into a new map
     unordered_map<uint32_t, uid_info> get_uid_io_stats_locked();
+    // parses io_stats_buffer into last_uid_io_stats, and sets the deltas
+    void update_last_io_stats_locked();
+    // asks the package manager for the names of the new uids
+    void update_uid_names_locked();
     // flushes curr_io_stats to records
     void add_records_locked(uint64_t curr_ts);
     // updates curr_io_stats and set last_uid_io_stats
@@ -39,5 +39,6 @@ void sort_running_uids_info(std::vector<UidInfo> &uids);
 // Logging
 void log_console_running_uids_info(const std::vector<UidInfo>& uids, bool flag_dump_task);
 void log_console_perf_history(const vector<int>& perf_history);
+void log_console_latency(const vector<LatencyInfo>& latency);
 
 #endif /* _STORAGED_UTILS_H_ */
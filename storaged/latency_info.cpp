@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <binder/Parcel.h>
+
+#include "latency_info.h"
+
+using namespace android;
+using namespace android::os::storaged;
+
+status_t LatencyInfo::writeToParcel(Parcel* parcel) const {
+    parcel->writeCString(device.c_str());
+    parcel->writeUint32(uid_bucket);
+    parcel->writeUint32(io_type);
+    parcel->writeUint64(count);
+    parcel->writeUint64(p50_us);
+    parcel->writeUint64(p99_us);
+    parcel->writeUint64(p999_us);
+    parcel->writeUint64(max_us);
+    return NO_ERROR;
+}
+
+status_t LatencyInfo::readFromParcel(const Parcel* parcel) {
+    device = parcel->readCString();
+    uid_bucket = parcel->readUint32();
+    io_type = parcel->readUint32();
+    count = parcel->readUint64();
+    p50_us = parcel->readUint64();
+    p99_us = parcel->readUint64();
+    p999_us = parcel->readUint64();
+    max_us = parcel->readUint64();
+    return NO_ERROR;
+}
@@ -68,6 +68,7 @@ void help_message(void) {
     printf("  -u    --uid                   Dump uid I/O usage to stdout\n");
     printf("  -t    --task                  Dump task I/O usage to stdout\n");
     printf("  -p    --perf                  Dump I/O perf history to stdout\n");
+    printf("  -l    --latency               Dump I/O latency percentiles to stdout\n");
     printf("  -s    --start                 Start storaged (default)\n");
     fflush(stdout);
 }
@@ -77,23 +78,28 @@ int main(int argc, char** argv) {
     bool flag_dump_uid = false;
     bool flag_dump_task = false;
     bool flag_dump_perf = false;
+    bool flag_dump_latency = false;
     int opt;
 
     for (;;) {
         int opt_idx = 0;
         static struct option long_options[] = {
+            {"latency",     no_argument,    nullptr, 'l'},
             {"perf",        no_argument,    nullptr, 'p'},
             {"start",       no_argument,    nullptr, 's'},
             {"task",        no_argument,    nullptr, 't'},
             {"uid",         no_argument,    nullptr, 'u'},
             {nullptr,       0,              nullptr,  0}
         };
-        opt = getopt_long(argc, argv, ":pstu", long_options, &opt_idx);
+        opt = getopt_long(argc, argv, ":lpstu", long_options, &opt_idx);
         if (opt == -1) {
             break;
         }
 
         switch (opt) {
+        case 'l':
+            flag_dump_latency = true;
+            break;
         case 'p':
             flag_dump_perf = true;
             break;
@@ -173,5 +179,16 @@ int main(int argc, char** argv) {
         log_console_perf_history(perf_history);
     }
 
+    if (flag_dump_latency) {
+        vector<LatencyInfo> latency;
+        binder::Status status = storaged_service->dumpLatency(&latency);
+        if (!status.isOk() || latency.size() == 0) {
+            fprintf(stderr, "I/O latency is not available.\n");
+            return 0;
+        }
+
+        log_console_latency(latency);
+    }
+
     return 0;
 }
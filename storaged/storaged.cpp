@@ -88,6 +88,7 @@ void storaged_t::init() {
     init_health_service();
     mDsm = std::make_unique<disk_stats_monitor>(health);
     storage_info.reset(storage_info_t::get_storage_info(health));
+    mDlm.start();
 }
 
 void storaged_t::init_health_service() {
@@ -170,10 +171,22 @@ void storaged_t::add_user_ce(userid_t user_id) {
 void storaged_t::remove_user_ce(userid_t user_id) {
     proto_loaded[user_id] = false;
     mUidm.clear_user_history(user_id);
+    uid_io_logs.erase(user_id);
+    legacy_uid_io_proto.erase(user_id);
     RemoveFileIfExists(proto_path(user_id), nullptr);
+    RemoveFileIfExists(uid_io_history_path(user_id), nullptr);
 }
 
 void storaged_t::load_proto(userid_t user_id) {
+    unique_ptr<uid_io_history_log>& uid_io_log = uid_io_logs[user_id];
+    uid_io_log.reset(new uid_io_history_log(uid_io_history_path(user_id)));
+
+    UidIOUsage uid_io_history;
+    bool uid_io_history_loaded = uid_io_log->load(&uid_io_history);
+    if (uid_io_history_loaded) {
+        mUidm.load_uid_io_proto(uid_io_history);
+    }
+
     string proto_file = proto_path(user_id);
     ifstream in(proto_file, ofstream::in | ofstream::binary);
 
@@ -193,7 +206,14 @@ void storaged_t::load_proto(userid_t user_id) {
         return;
     }
 
-    mUidm.load_uid_io_proto(proto.uid_io_usage());
+    /*
+     * Older versions kept the uid io history in the proto. It is moved to
+     * the history log on the next flush.
+     */
+    if (!uid_io_history_loaded && proto.uid_io_usage().uid_io_items_size() > 0) {
+        mUidm.load_uid_io_proto(proto.uid_io_usage());
+        legacy_uid_io_proto[user_id] = true;
+    }
 
     if (user_id == USER_SYSTEM) {
         storage_info->load_perf_history_proto(proto.perf_history());
@@ -297,12 +317,40 @@ void storaged_t::flush_proto(userid_t user_id, StoragedProto* proto) {
     flush_proto_data(user_id, proto_data.get(), proto->ByteSize());
 }
 
+bool storaged_t::flush_uid_io_history(userid_t user_id, const UidIOUsage& usage) {
+    const unique_ptr<uid_io_history_log>& uid_io_log = uid_io_logs[user_id];
+    if (uid_io_log == nullptr || !uid_io_log->flush(usage)) return false;
+
+    if (legacy_uid_io_proto[user_id]) {
+        // The system user proto is rewritten without it on every flush.
+        if (user_id != USER_SYSTEM) {
+            RemoveFileIfExists(proto_path(user_id), nullptr);
+        }
+        legacy_uid_io_proto.erase(user_id);
+    }
+    return true;
+}
+
 void storaged_t::flush_protos(unordered_map<int, StoragedProto>* protos) {
     for (auto& it : *protos) {
         /*
          * Don't flush proto if we haven't attempted to load it from file.
          */
-        if (proto_loaded[it.first]) {
+        if (!proto_loaded[it.first]) {
+            continue;
+        }
+
+        /*
+         * The uid io history goes to its own log, and only the system user
+         * still rewrites its proto, for the perf history and the write
+         * benchmark. That proto keeps the history until it is in the log.
+         */
+        if (it.second.has_uid_io_usage() &&
+            (flush_uid_io_history(it.first, it.second.uid_io_usage()) ||
+             !legacy_uid_io_proto[it.first])) {
+            it.second.clear_uid_io_usage();
+        }
+        if (it.first == USER_SYSTEM) {
             flush_proto(it.first, &it.second);
         }
     }
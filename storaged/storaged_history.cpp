@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "storaged"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "storaged_history.h"
+
+using namespace android::base;
+using namespace storaged_proto;
+
+namespace {
+
+struct log_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+// precedes every serialized UidIOItem
+struct record_header {
+    uint32_t size;
+    uint32_t crc;
+};
+
+constexpr uint32_t log_magic = 0x48495553;  // "SUIH"
+constexpr uint32_t log_version = 1;
+
+// the file is not rewritten before it holds that many items
+constexpr uint32_t compact_min_items = 64;
+
+void add_records(const UidIOUsage& usage, int first_item, string* buf)
+{
+    for (int i = first_item; i < usage.uid_io_items_size(); i++) {
+        string data = usage.uid_io_items(i).SerializeAsString();
+        struct record_header rec = {
+            static_cast<uint32_t>(data.size()),
+            static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                                        data.size())),
+        };
+        buf->append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        buf->append(data);
+    }
+}
+
+} // namespace
+
+uid_io_history_log::uid_io_history_log(const string& path)
+    : path(path), last_end_ts(0), nr_items(0), size(0), rewrite_needed(true) {
+}
+
+bool uid_io_history_log::load(UidIOUsage* usage)
+{
+    last_end_ts = 0;
+    nr_items = 0;
+    size = 0;
+    rewrite_needed = true;
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            PLOG_TO(SYSTEM, WARNING) << "Failed to open " << path;
+        }
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(log_header))) {
+        LOG_TO(SYSTEM, WARNING) << "No valid header in " << path;
+        return false;
+    }
+
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        PLOG_TO(SYSTEM, WARNING) << "Failed to map " << path;
+        return false;
+    }
+    const char* data = static_cast<const char*>(map);
+
+    struct log_header header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != log_magic || header.version != log_version) {
+        LOG_TO(SYSTEM, WARNING) << "Unknown format of " << path;
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    off_t off = sizeof(header);
+    while (st.st_size - off >= static_cast<off_t>(sizeof(record_header))) {
+        struct record_header rec;
+        memcpy(&rec, data + off, sizeof(rec));
+        const char* item_data = data + off + sizeof(rec);
+        if (rec.size > st.st_size - off - sizeof(rec) ||
+            crc32(0, reinterpret_cast<const Bytef*>(item_data), rec.size) != rec.crc) {
+            break;
+        }
+
+        UidIOItem* item = usage->add_uid_io_items();
+        if (!item->ParseFromArray(item_data, rec.size)) {
+            usage->mutable_uid_io_items()->RemoveLast();
+            break;
+        }
+        last_end_ts = item->end_ts();
+        nr_items++;
+        off += sizeof(rec) + rec.size;
+    }
+    munmap(map, st.st_size);
+
+    size = off;
+    rewrite_needed = off != st.st_size;
+    if (rewrite_needed) {
+        LOG_TO(SYSTEM, WARNING) << "Dropping " << st.st_size - off
+                                << " bytes of bad records at the end of " << path;
+    }
+    return true;
+}
+
+bool uid_io_history_log::append(const UidIOUsage& usage, int first_item)
+{
+    string buf;
+    add_records(usage, first_item, &buf);
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to open " << path;
+        rewrite_needed = true;
+        return false;
+    }
+    if (lseek(fd, size, SEEK_SET) != size || !WriteFully(fd, buf.data(), buf.size())) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to append to " << path;
+        rewrite_needed = true;
+        return false;
+    }
+    if (fdatasync(fd)) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to sync " << path;
+        rewrite_needed = true;
+        return false;
+    }
+
+    size += buf.size();
+    nr_items += usage.uid_io_items_size() - first_item;
+    last_end_ts = usage.uid_io_items(usage.uid_io_items_size() - 1).end_ts();
+    return true;
+}
+
+bool uid_io_history_log::compact(const UidIOUsage& usage)
+{
+    struct log_header header = { log_magic, log_version };
+    string buf(reinterpret_cast<const char*>(&header), sizeof(header));
+    add_records(usage, 0, &buf);
+
+    string tmp_file = path + "_tmp";
+    unique_fd fd(TEMP_FAILURE_RETRY(open(tmp_file.c_str(),
+                 O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR)));
+    if (fd == -1) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to open tmp file: " << tmp_file;
+        return false;
+    }
+    if (!WriteFully(fd, buf.data(), buf.size()) || fsync(fd)) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to write tmp file: " << tmp_file;
+        return false;
+    }
+    fd.reset(-1);
+    if (rename(tmp_file.c_str(), path.c_str())) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to rename " << tmp_file;
+        return false;
+    }
+
+    int n = usage.uid_io_items_size();
+    size = buf.size();
+    nr_items = n;
+    last_end_ts = n > 0 ? usage.uid_io_items(n - 1).end_ts() : 0;
+    rewrite_needed = false;
+    return true;
+}
+
+bool uid_io_history_log::flush(const UidIOUsage& usage)
+{
+    int n = usage.uid_io_items_size();
+    // the clock went back, or items were left out of the file
+    if (rewrite_needed || (n > 0 && usage.uid_io_items(n - 1).end_ts() < last_end_ts)) {
+        return compact(usage);
+    }
+
+    int first_item = n;
+    while (first_item > 0 && usage.uid_io_items(first_item - 1).end_ts() > last_end_ts) {
+        first_item--;
+    }
+    if (first_item == n) {
+        return true;
+    }
+
+    if (nr_items + (n - first_item) > max(2 * static_cast<uint32_t>(n), compact_min_items)) {
+        return compact(usage);
+    }
+    return append(usage, first_item);
+}
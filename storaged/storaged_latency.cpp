@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "storaged"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <cutils/multiuser.h>
+#include <cutils/properties.h>
+#include <private/android_filesystem_config.h>
+
+#include "storaged.h"
+#include "storaged_latency.h"
+
+using namespace android::base;
+
+namespace {
+
+const char* const TRACEFS_PATHS[] = {
+    "/sys/kernel/tracing",
+    "/sys/kernel/debug/tracing",
+};
+
+const char* const TRACE_EVENTS[] = {
+    "block/block_rq_issue",
+    "block/block_rq_complete",
+};
+
+constexpr char ISSUE_MARKER[] = ": block_rq_issue: ";
+constexpr char COMPLETE_MARKER[] = ": block_rq_complete: ";
+
+// Completions can be lost when the trace buffer overflows, so the requests
+// still in flight and the task uids are dropped beyond these.
+constexpr size_t MAX_INFLIGHT_IOS = 4096;
+constexpr size_t MAX_TASK_UIDS = 1024;
+
+constexpr size_t READ_SIZE = 16 * 1024;
+
+// Returns the pid in the "<comm>-<pid> [<cpu>]" that starts a trace line.
+pid_t parse_trace_pid(const char* line, const char* end)
+{
+    for (const char* p = strstr(line, " ["); p != nullptr && p < end; p = strstr(p + 1, " [")) {
+        const char* cpu = p + 2;
+        while (isdigit(*cpu)) cpu++;
+        if (cpu == p + 2 || *cpu != ']') continue;
+
+        while (p > line && *(p - 1) == ' ') p--;
+        const char* pid = p;
+        while (pid > line && isdigit(*(pid - 1))) pid--;
+        if (pid == p || pid == line || *(pid - 1) != '-') return 0;
+        return strtol(pid, nullptr, 10);
+    }
+    return 0;
+}
+
+} // namespace
+
+size_t latency_histogram::bucket_index(uint64_t value)
+{
+    value = std::min(value, MAX_VALUE);
+    if (value < LINEAR_BUCKETS) {
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+    return LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t latency_histogram::bucket_upper(size_t index)
+{
+    if (index < LINEAR_BUCKETS) {
+        return index;
+    }
+    index -= LINEAR_BUCKETS;
+    int shift = index / SUB_BUCKETS + 1;
+    uint64_t sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void latency_histogram::add(uint64_t value_us)
+{
+    mCounts[bucket_index(value_us)]++;
+    mCount++;
+    mMax = std::max(mMax, value_us);
+}
+
+uint64_t latency_histogram::percentile(double fraction) const
+{
+    if (mCount == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, ceil(fraction * mCount));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NR_BUCKETS; i++) {
+        seen += mCounts[i];
+        if (seen >= rank) {
+            return std::min(bucket_upper(i), mMax);
+        }
+    }
+    return mMax;
+}
+
+latency_histogram& latency_histogram::operator+= (const latency_histogram& hist)
+{
+    for (size_t i = 0; i < NR_BUCKETS; i++) {
+        mCounts[i] += hist.mCounts[i];
+    }
+    mCount += hist.mCount;
+    mMax = std::max(mMax, hist.mMax);
+    return *this;
+}
+
+bool disk_latency_monitor::setup_instance()
+{
+    for (const char* tracefs : TRACEFS_PATHS) {
+        string instances = string(tracefs) + "/instances";
+        if (access(instances.c_str(), F_OK)) {
+            continue;
+        }
+
+        mInstance = instances + "/storaged";
+        if (mkdir(mInstance.c_str(), 0700) && errno != EEXIST) {
+            PLOG_TO(SYSTEM, ERROR) << "Failed to create " << mInstance;
+            return false;
+        }
+        for (const char* event : TRACE_EVENTS) {
+            string enable_file = mInstance + "/events/" + event + "/enable";
+            if (!WriteStringToFile("1", enable_file)) {
+                PLOG_TO(SYSTEM, ERROR) << "Failed to enable " << enable_file;
+                return false;
+            }
+        }
+
+        string pipe_file = mInstance + "/trace_pipe";
+        mPipe.reset(TEMP_FAILURE_RETRY(open(pipe_file.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (mPipe == -1) {
+            PLOG_TO(SYSTEM, ERROR) << "Failed to open " << pipe_file;
+            return false;
+        }
+        return true;
+    }
+
+    LOG_TO(SYSTEM, ERROR) << "No tracefs instances to trace block requests";
+    return false;
+}
+
+void disk_latency_monitor::start()
+{
+    if (!property_get_bool("ro.storaged.latency_trace", false) || !setup_instance()) {
+        return;
+    }
+
+    enable = true;
+    pthread_t thread;
+    errno = pthread_create(&thread, nullptr, thread_main, this);
+    if (errno != 0) {
+        PLOG_TO(SYSTEM, ERROR) << "Failed to create latency thread";
+        enable = false;
+        return;
+    }
+    pthread_detach(thread);
+}
+
+void* disk_latency_monitor::thread_main(void* monitor)
+{
+    static_cast<disk_latency_monitor*>(monitor)->read_events();
+    return nullptr;
+}
+
+void disk_latency_monitor::read_events()
+{
+    char buf[READ_SIZE];
+
+    for (;;) {
+        ssize_t ret = TEMP_FAILURE_RETRY(read(mPipe, buf, sizeof(buf)));
+        if (ret <= 0) {
+            PLOG_TO(SYSTEM, ERROR) << "Stopped reading block requests from " << mInstance;
+            return;
+        }
+
+        mLine.append(buf, ret);
+        size_t start = 0;
+        size_t end;
+        while ((end = mLine.find('\n', start)) != string::npos) {
+            mLine[end] = '\0';
+            handle_event(&mLine[start]);
+            start = end + 1;
+        }
+        mLine.erase(0, start);
+    }
+}
+
+uid_bucket_t disk_latency_monitor::get_uid_bucket(pid_t pid)
+{
+    auto it = mTaskUids.find(pid);
+    if (it == mTaskUids.end()) {
+        if (mTaskUids.size() >= MAX_TASK_UIDS) {
+            mTaskUids.clear();
+        }
+
+        struct stat st;
+        uid_t uid = 0;
+        if (pid > 0 && !stat(StringPrintf("/proc/%d", pid).c_str(), &st)) {
+            uid = st.st_uid;
+        }
+        it = mTaskUids.emplace(pid, uid).first;
+    }
+    return multiuser_get_app_id(it->second) >= AID_APP_START ?
+        UID_BUCKET_APP : UID_BUCKET_SYSTEM;
+}
+
+disk_latency_monitor::disk_latency& disk_latency_monitor::get_disk(uint64_t dev)
+{
+    auto it = mDisks.find(dev);
+    if (it != mDisks.end()) {
+        return it->second;
+    }
+
+    disk_latency& disk = mDisks[dev];
+    string dev_num = StringPrintf("%u:%u", major(dev), minor(dev));
+    char path[PATH_MAX];
+    ssize_t len = readlink(("/sys/dev/block/" + dev_num).c_str(), path, sizeof(path) - 1);
+    if (len > 0) {
+        path[len] = '\0';
+        const char* name = strrchr(path, '/');
+        disk.name = name ? name + 1 : path;
+    } else {
+        disk.name = dev_num;
+    }
+    return disk;
+}
+
+/*
+ * Handles a line of trace_pipe, as in
+ *   kworker/u16:2-145 [001] ...1  1236.061105: block_rq_issue: 179,0 WS 4096 () 2049 + 8 [kworker]
+ *   <idle>-0 [000] d.h1  1236.061450: block_rq_complete: 179,0 WS () 2049 + 8 [0]
+ */
+void disk_latency_monitor::handle_event(char* line)
+{
+    bool issue = true;
+    char* event = strstr(line, ISSUE_MARKER);
+    const char* body;
+    if (event != nullptr) {
+        body = event + sizeof(ISSUE_MARKER) - 1;
+    } else if ((event = strstr(line, COMPLETE_MARKER)) != nullptr) {
+        issue = false;
+        body = event + sizeof(COMPLETE_MARKER) - 1;
+    } else {
+        return;
+    }
+
+    // the timestamp is the last field before the event name
+    *event = '\0';
+    const char* ts = strrchr(line, ' ');
+    ts = ts ? ts + 1 : line;
+    uint64_t sec, usec;
+    if (sscanf(ts, "%" SCNu64 ".%" SCNu64, &sec, &usec) != 2) {
+        return;
+    }
+    uint64_t now_us = sec * SEC_TO_USEC + usec;
+
+    unsigned int dev_major, dev_minor;
+    char rwbs[16];
+    if (sscanf(body, "%u,%u %15s", &dev_major, &dev_minor, rwbs) != 3) {
+        return;
+    }
+    io_type_t io_type;
+    if (strchr(rwbs, 'W')) {
+        io_type = WRITE;
+    } else if (strchr(rwbs, 'R')) {
+        io_type = READ;
+    } else {
+        // flushes and discards
+        return;
+    }
+
+    // the sectors follow the command, which is usually empty
+    const char* range = strstr(body, ") ");
+    uint64_t sector;
+    unsigned int nr_sectors;
+    if (range == nullptr ||
+        sscanf(range + 2, "%" SCNu64 " + %u", &sector, &nr_sectors) != 2 || nr_sectors == 0) {
+        return;
+    }
+
+    uid_bucket_t uid_bucket = UID_BUCKET_SYSTEM;
+    if (issue) {
+        uid_bucket = get_uid_bucket(parse_trace_pid(line, ts));
+    }
+
+    Mutex::Autolock _l(mLock);
+
+    disk_latency& disk = get_disk(makedev(dev_major, dev_minor));
+    if (issue) {
+        if (disk.inflight.size() >= MAX_INFLIGHT_IOS) {
+            disk.inflight.clear();
+        }
+        disk.inflight[sector] = { now_us, uid_bucket, io_type };
+        return;
+    }
+
+    auto it = disk.inflight.find(sector);
+    if (it == disk.inflight.end()) {
+        return;
+    }
+    const inflight_io& io = it->second;
+    if (now_us >= io.issue_us) {
+        disk.hists[io.uid_bucket][io.io_type].add(now_us - io.issue_us);
+    }
+    disk.inflight.erase(it);
+}
+
+vector<LatencyInfo> disk_latency_monitor::get_latency()
+{
+    vector<LatencyInfo> infos;
+
+    Mutex::Autolock _l(mLock);
+
+    for (const auto& it : mDisks) {
+        const disk_latency& disk = it.second;
+        for (int i = 0; i < UID_BUCKETS; i++) {
+            for (int j = 0; j < IO_TYPES; j++) {
+                const latency_histogram& hist = disk.hists[i][j];
+                if (hist.count() == 0) {
+                    continue;
+                }
+
+                LatencyInfo info;
+                info.device = disk.name;
+                info.uid_bucket = i;
+                info.io_type = j;
+                info.count = hist.count();
+                info.p50_us = hist.percentile(0.5);
+                info.p99_us = hist.percentile(0.99);
+                info.p999_us = hist.percentile(0.999);
+                info.max_us = hist.max();
+                infos.push_back(info);
+            }
+        }
+    }
+    stable_sort(infos.begin(), infos.end(), [](const LatencyInfo& a, const LatencyInfo& b) {
+        return a.device < b.device;
+    });
+    return infos;
+}
@@ -209,6 +209,12 @@ binder::Status StoragedPrivateService::dumpPerfHistory(
     return binder::Status::ok();
 }
 
+binder::Status StoragedPrivateService::dumpLatency(
+        vector<LatencyInfo>* _aidl_return) {
+    *_aidl_return = storaged_sp->get_latency();
+    return binder::Status::ok();
+}
+
 sp<IStoragedPrivate> get_storaged_pri_service() {
     sp<IServiceManager> sm = defaultServiceManager();
     if (sm == NULL) return NULL;
@@ -16,17 +16,19 @@
 
 #define LOG_TAG "storaged"
 
+#include <fcntl.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <string>
 #include <unordered_map>
 
 #include <android/content/pm/IPackageManagerNative.h>
-#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
-#include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 #include <binder/IServiceManager.h>
@@ -43,33 +45,148 @@ using namespace storaged_proto;
 
 namespace {
 
-bool refresh_uid_names;
 const char* UID_IO_STATS_PATH = "/proc/uid_io/stats";
 
+// The dump is read in one go into a buffer that starts this large and grows.
+const size_t MIN_IO_STATS_BUFFER_SIZE = 64 * 1024;
+
+bool parse_uint64(const char* begin, const char* end, uint64_t* value)
+{
+    if (begin == end) {
+        return false;
+    }
+    uint64_t result = 0;
+    for (const char* p = begin; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        result = result * 10 + (*p - '0');
+    }
+    *value = result;
+    return true;
+}
+
+// The order of the 10 counters after the uid or the pid.
+inline void io_stats_fields(io_stats* io, uint64_t* fields[10])
+{
+    fields[0] = &io[FOREGROUND].rchar;
+    fields[1] = &io[FOREGROUND].wchar;
+    fields[2] = &io[FOREGROUND].read_bytes;
+    fields[3] = &io[FOREGROUND].write_bytes;
+    fields[4] = &io[BACKGROUND].rchar;
+    fields[5] = &io[BACKGROUND].wchar;
+    fields[6] = &io[BACKGROUND].read_bytes;
+    fields[7] = &io[BACKGROUND].write_bytes;
+    fields[8] = &io[FOREGROUND].fsync;
+    fields[9] = &io[BACKGROUND].fsync;
+}
+
+// Parses "<uid> <10 counters>", ignoring any field after them.
+bool parse_uid_line(const char* begin, const char* end, uint32_t* uid, io_stats* io)
+{
+    uint64_t* fields[10];
+    io_stats_fields(io, fields);
+
+    const char* p = begin;
+    for (int i = 0; i < 11; i++) {
+        const char* field_end = static_cast<const char*>(memchr(p, ' ', end - p));
+        if (field_end == nullptr) {
+            if (i < 10) {
+                return false;
+            }
+            field_end = end;
+        }
+        uint64_t value;
+        if (!parse_uint64(p, field_end, &value)) {
+            return false;
+        }
+        if (i == 0) {
+            if (value > UINT32_MAX) {
+                return false;
+            }
+            *uid = value;
+        } else {
+            *fields[i - 1] = value;
+        }
+        p = field_end + 1;
+    }
+    return true;
+}
+
+// Parses "task,<comm>,<pid>,<10 counters>", where comm may hold commas.
+bool parse_task_line(const char* begin, const char* end, const char** comm,
+                     size_t* comm_len, pid_t* pid, io_stats* io)
+{
+    uint64_t* fields[10];
+    io_stats_fields(io, fields);
+
+    const char* commas[11];
+    const char* p = end;
+    for (int i = 10; i >= 0; i--) {
+        p = static_cast<const char*>(memrchr(begin, ',', p - begin));
+        if (p == nullptr) {
+            return false;
+        }
+        commas[i] = p;
+    }
+    const char* comm_begin = static_cast<const char*>(memchr(begin, ',', commas[0] - begin));
+    if (comm_begin == nullptr) {
+        return false;
+    }
+
+    uint64_t value;
+    if (!parse_uint64(commas[0] + 1, commas[1], &value) || value > INT32_MAX) {
+        return false;
+    }
+    *pid = value;
+    for (int i = 1; i <= 10; i++) {
+        if (!parse_uint64(commas[i] + 1, i < 10 ? commas[i + 1] : end, fields[i - 1])) {
+            return false;
+        }
+    }
+    *comm = comm_begin + 1;
+    *comm_len = commas[0] - *comm;
+    return true;
+}
+
+inline bool is_task_line(const char* begin, const char* end)
+{
+    return end - begin >= 4 && !memcmp(begin, "task", 4);
+}
+
+// Calls on_line for each non empty line of the buffer.
+template <typename F>
+void for_each_line(const std::string& buffer, F on_line)
+{
+    const char* p = buffer.data();
+    const char* end = p + buffer.size();
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        if (line_end != p) {
+            on_line(p, line_end);
+        }
+        p = line_end + 1;
+    }
+}
+
 } // namepsace
 
 std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats()
 {
     Mutex::Autolock _l(uidm_mutex);
+    if (!read_uid_io_stats_locked()) {
+        return {};
+    }
     return get_uid_io_stats_locked();
 };
 
 /* return true on parse success and false on failure */
 bool uid_info::parse_uid_io_stats(std::string&& s)
 {
-    std::vector<std::string> fields = Split(s, " ");
-    if (fields.size() < 11 ||
-        !ParseUint(fields[0],  &uid) ||
-        !ParseUint(fields[1],  &io[FOREGROUND].rchar) ||
-        !ParseUint(fields[2],  &io[FOREGROUND].wchar) ||
-        !ParseUint(fields[3],  &io[FOREGROUND].read_bytes) ||
-        !ParseUint(fields[4],  &io[FOREGROUND].write_bytes) ||
-        !ParseUint(fields[5],  &io[BACKGROUND].rchar) ||
-        !ParseUint(fields[6],  &io[BACKGROUND].wchar) ||
-        !ParseUint(fields[7],  &io[BACKGROUND].read_bytes) ||
-        !ParseUint(fields[8],  &io[BACKGROUND].write_bytes) ||
-        !ParseUint(fields[9],  &io[FOREGROUND].fsync) ||
-        !ParseUint(fields[10], &io[BACKGROUND].fsync)) {
+    if (!parse_uid_line(s.data(), s.data() + s.size(), &uid, io)) {
         LOG_TO(SYSTEM, WARNING) << "Invalid uid I/O stats: \""
                                 << s << "\"";
         return false;
@@ -80,26 +197,14 @@ bool uid_info::parse_uid_io_stats(std::string&& s)
 /* return true on parse success and false on failure */
 bool task_info::parse_task_io_stats(std::string&& s)
 {
-    std::vector<std::string> fields = Split(s, ",");
-    size_t size = fields.size();
-    if (size < 13 ||
-        !ParseInt(fields[size - 11],  &pid) ||
-        !ParseUint(fields[size - 10],  &io[FOREGROUND].rchar) ||
-        !ParseUint(fields[size - 9],  &io[FOREGROUND].wchar) ||
-        !ParseUint(fields[size - 8],  &io[FOREGROUND].read_bytes) ||
-        !ParseUint(fields[size - 7],  &io[FOREGROUND].write_bytes) ||
-        !ParseUint(fields[size - 6],  &io[BACKGROUND].rchar) ||
-        !ParseUint(fields[size - 5],  &io[BACKGROUND].wchar) ||
-        !ParseUint(fields[size - 4],  &io[BACKGROUND].read_bytes) ||
-        !ParseUint(fields[size - 3], &io[BACKGROUND].write_bytes) ||
-        !ParseUint(fields[size - 2], &io[FOREGROUND].fsync) ||
-        !ParseUint(fields[size - 1], &io[BACKGROUND].fsync)) {
+    const char* task_comm;
+    size_t task_comm_len;
+    if (!parse_task_line(s.data(), s.data() + s.size(), &task_comm, &task_comm_len, &pid, io)) {
         LOG_TO(SYSTEM, WARNING) << "Invalid task I/O stats: \""
                                 << s << "\"";
         return false;
     }
-    comm = Join(std::vector<std::string>(
-                fields.begin() + 1, fields.end() - 11), ',');
+    comm.assign(task_comm, task_comm_len);
     return true;
 }
 
@@ -118,84 +223,213 @@ bool io_usage::is_zero() const
 
 namespace {
 
-void get_uid_names(const vector<int>& uids, const vector<std::string*>& uid_names)
+// Returns false if the package manager could not be asked. Names it did not
+// find are left empty.
+bool get_uid_names(const vector<int>& uids, std::vector<std::string>* names)
 {
     sp<IServiceManager> sm = defaultServiceManager();
     if (sm == NULL) {
         LOG_TO(SYSTEM, ERROR) << "defaultServiceManager failed";
-        return;
+        return false;
     }
 
     sp<IBinder> binder = sm->getService(String16("package_native"));
     if (binder == NULL) {
         LOG_TO(SYSTEM, ERROR) << "getService package_native failed";
-        return;
+        return false;
     }
 
     sp<IPackageManagerNative> package_mgr = interface_cast<IPackageManagerNative>(binder);
-    std::vector<std::string> names;
-    binder::Status status = package_mgr->getNamesForUids(uids, &names);
+    binder::Status status = package_mgr->getNamesForUids(uids, names);
     if (!status.isOk()) {
         LOG_TO(SYSTEM, ERROR) << "package_native::getNamesForUids failed: "
                               << status.exceptionMessage();
-        return;
+        return false;
     }
+    names->resize(uids.size());
+    return true;
+}
 
-    for (uint32_t i = 0; i < uid_names.size(); i++) {
-        if (!names[i].empty()) {
-            *uid_names[i] = names[i];
-        }
+void set_io_delta(uint64_t delta[IO_TYPES][UID_STATS], const io_stats* last,
+                  const io_stats* curr)
+{
+    for (int i = 0; i < UID_STATS; i++) {
+        delta[READ][i] = curr[i].read_bytes > last[i].read_bytes ?
+            curr[i].read_bytes - last[i].read_bytes : 0;
+        delta[WRITE][i] = curr[i].write_bytes > last[i].write_bytes ?
+            curr[i].write_bytes - last[i].write_bytes : 0;
     }
+}
 
-    refresh_uid_names = false;
+void add_io_delta(io_usage* usage, const uint64_t delta[IO_TYPES][UID_STATS],
+                  charger_stat_t charger_stat)
+{
+    for (int i = 0; i < IO_TYPES; i++) {
+        for (int j = 0; j < UID_STATS; j++) {
+            usage->bytes[i][j][charger_stat] += delta[i][j];
+        }
+    }
 }
 
 } // namespace
 
+bool uid_monitor::read_uid_io_stats_locked()
+{
+    if (io_stats_fd == -1) {
+        io_stats_fd.reset(TEMP_FAILURE_RETRY(open(UID_IO_STATS_PATH, O_RDONLY | O_CLOEXEC)));
+        if (io_stats_fd == -1) {
+            PLOG_TO(SYSTEM, ERROR) << UID_IO_STATS_PATH << ": open failed";
+            return false;
+        }
+    }
+
+    // The buffer keeps the capacity of the largest dump so far.
+    size_t size = 0;
+    io_stats_buffer.resize(std::max(io_stats_buffer.capacity(), MIN_IO_STATS_BUFFER_SIZE));
+    while (true) {
+        if (size == io_stats_buffer.size()) {
+            io_stats_buffer.resize(size * 2);
+        }
+        ssize_t n = TEMP_FAILURE_RETRY(pread(io_stats_fd, &io_stats_buffer[size],
+                                             io_stats_buffer.size() - size, size));
+        if (n < 0) {
+            PLOG_TO(SYSTEM, ERROR) << UID_IO_STATS_PATH << ": read failed";
+            io_stats_fd.reset();
+            io_stats_buffer.clear();
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        size += n;
+    }
+    io_stats_buffer.resize(size);
+    return true;
+}
+
 std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats_locked()
 {
     std::unordered_map<uint32_t, uid_info> uid_io_stats;
-    std::string buffer;
-    if (!ReadFileToString(UID_IO_STATS_PATH, &buffer)) {
-        PLOG_TO(SYSTEM, ERROR) << UID_IO_STATS_PATH << ": ReadFileToString failed";
-        return uid_io_stats;
+    uid_info* u = nullptr;
+    vector<int> uids;
+
+    for_each_line(io_stats_buffer, [&](const char* begin, const char* end) {
+        if (!is_task_line(begin, end)) {
+            uid_info parsed;
+            if (!parsed.parse_uid_io_stats(std::string(begin, end))) {
+                u = nullptr;
+                return;
+            }
+            u = &uid_io_stats[parsed.uid];
+            *u = parsed;
+            auto last = last_uid_io_stats.find(u->uid);
+            if (last != last_uid_io_stats.end()) {
+                u->name = last->second.name;
+            } else {
+                u->name = std::to_string(u->uid);
+                uids.push_back(u->uid);
+            }
+        } else if (u != nullptr) {
+            task_info t;
+            if (!t.parse_task_io_stats(std::string(begin, end)))
+                return;
+            u->tasks[t.pid] = t;
+        }
+    });
+
+    std::vector<std::string> names;
+    if (!uids.empty() && get_uid_names(uids, &names)) {
+        for (size_t i = 0; i < uids.size(); i++) {
+            if (!names[i].empty()) {
+                uid_io_stats[uids[i]].name = names[i];
+            }
+        }
     }
 
-    std::vector<std::string> io_stats = Split(std::move(buffer), "\n");
-    uid_info u;
-    vector<int> uids;
-    vector<std::string*> uid_names;
+    return uid_io_stats;
+}
 
-    for (uint32_t i = 0; i < io_stats.size(); i++) {
-        if (io_stats[i].empty()) {
-            continue;
+void uid_monitor::update_last_io_stats_locked()
+{
+    uint64_t seq = ++io_stats_seq;
+    uid_io_state* state = nullptr;
+
+    for_each_line(io_stats_buffer, [&](const char* begin, const char* end) {
+        io_stats io[UID_STATS];
+        if (!is_task_line(begin, end)) {
+            uint32_t uid;
+            if (!parse_uid_line(begin, end, &uid, io)) {
+                LOG_TO(SYSTEM, WARNING) << "Invalid uid I/O stats: \""
+                                        << std::string(begin, end) << "\"";
+                state = nullptr;
+                return;
+            }
+            state = &last_uid_io_stats[uid];
+            if (state->seq == 0) {
+                state->name = std::to_string(uid);
+            }
+            set_io_delta(state->delta, state->io, io);
+            memcpy(state->io, io, sizeof(io));
+            state->seq = seq;
+        } else if (state != nullptr) {
+            const char* comm;
+            size_t comm_len;
+            pid_t pid;
+            if (!parse_task_line(begin, end, &comm, &comm_len, &pid, io)) {
+                LOG_TO(SYSTEM, WARNING) << "Invalid task I/O stats: \""
+                                        << std::string(begin, end) << "\"";
+                return;
+            }
+            task_io_state& task = state->tasks[pid];
+            task.comm.assign(comm, comm_len);
+            set_io_delta(task.delta, task.io, io);
+            memcpy(task.io, io, sizeof(io));
+            task.seq = seq;
         }
+    });
 
-        if (io_stats[i].compare(0, 4, "task")) {
-            if (!u.parse_uid_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid] = u;
-            uid_io_stats[u.uid].name = std::to_string(u.uid);
-            uids.push_back(u.uid);
-            uid_names.push_back(&uid_io_stats[u.uid].name);
-            if (last_uid_io_stats.find(u.uid) == last_uid_io_stats.end()) {
-                refresh_uid_names = true;
+    // Forget the uids and tasks that are gone.
+    for (auto it = last_uid_io_stats.begin(); it != last_uid_io_stats.end();) {
+        if (it->second.seq != seq) {
+            it = last_uid_io_stats.erase(it);
+            continue;
+        }
+        auto& tasks = it->second.tasks;
+        for (auto task_it = tasks.begin(); task_it != tasks.end();) {
+            if (task_it->second.seq != seq) {
+                task_it = tasks.erase(task_it);
             } else {
-                uid_io_stats[u.uid].name = last_uid_io_stats[u.uid].name;
+                ++task_it;
             }
-        } else {
-            task_info t;
-            if (!t.parse_task_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid].tasks[t.pid] = t;
         }
+        ++it;
     }
+}
 
-    if (!uids.empty() && refresh_uid_names) {
-        get_uid_names(uids, uid_names);
+void uid_monitor::update_uid_names_locked()
+{
+    vector<int> uids;
+    for (const auto& it : last_uid_io_stats) {
+        if (!it.second.named) {
+            uids.push_back(it.first);
+        }
+    }
+    if (uids.empty()) {
+        return;
     }
 
-    return uid_io_stats;
+    // Uids without a package keep their number as name, and are not asked for again.
+    std::vector<std::string> names;
+    if (!get_uid_names(uids, &names)) {
+        return;
+    }
+    for (size_t i = 0; i < uids.size(); i++) {
+        uid_io_state& state = last_uid_io_stats[uids[i]];
+        if (!names[i].empty()) {
+            state.name = names[i];
+        }
+        state.named = true;
+    }
 }
 
 namespace {
@@ -303,65 +537,23 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
 
 void uid_monitor::update_curr_io_stats_locked()
 {
-    std::unordered_map<uint32_t, uid_info> uid_io_stats =
-        get_uid_io_stats_locked();
-    if (uid_io_stats.empty()) {
+    if (!read_uid_io_stats_locked()) {
         return;
     }
+    update_last_io_stats_locked();
+    update_uid_names_locked();
 
-    for (const auto& it : uid_io_stats) {
-        const uid_info& uid = it.second;
-        if (curr_io_stats.find(uid.name) == curr_io_stats.end()) {
-            curr_io_stats[uid.name] = {};
-        }
-
+    for (const auto& it : last_uid_io_stats) {
+        const uid_io_state& uid = it.second;
         struct uid_io_usage& usage = curr_io_stats[uid.name];
-        usage.user_id = multiuser_get_user_id(uid.uid);
-
-        int64_t fg_rd_delta = uid.io[FOREGROUND].read_bytes -
-            last_uid_io_stats[uid.uid].io[FOREGROUND].read_bytes;
-        int64_t bg_rd_delta = uid.io[BACKGROUND].read_bytes -
-            last_uid_io_stats[uid.uid].io[BACKGROUND].read_bytes;
-        int64_t fg_wr_delta = uid.io[FOREGROUND].write_bytes -
-            last_uid_io_stats[uid.uid].io[FOREGROUND].write_bytes;
-        int64_t bg_wr_delta = uid.io[BACKGROUND].write_bytes -
-            last_uid_io_stats[uid.uid].io[BACKGROUND].write_bytes;
-
-        usage.uid_ios.bytes[READ][FOREGROUND][charger_stat] +=
-            (fg_rd_delta < 0) ? 0 : fg_rd_delta;
-        usage.uid_ios.bytes[READ][BACKGROUND][charger_stat] +=
-            (bg_rd_delta < 0) ? 0 : bg_rd_delta;
-        usage.uid_ios.bytes[WRITE][FOREGROUND][charger_stat] +=
-            (fg_wr_delta < 0) ? 0 : fg_wr_delta;
-        usage.uid_ios.bytes[WRITE][BACKGROUND][charger_stat] +=
-            (bg_wr_delta < 0) ? 0 : bg_wr_delta;
+        usage.user_id = multiuser_get_user_id(it.first);
+        add_io_delta(&usage.uid_ios, uid.delta, charger_stat);
 
         for (const auto& task_it : uid.tasks) {
-            const task_info& task = task_it.second;
-            const pid_t pid = task_it.first;
-            const std::string& comm = task_it.second.comm;
-            int64_t task_fg_rd_delta = task.io[FOREGROUND].read_bytes -
-                last_uid_io_stats[uid.uid].tasks[pid].io[FOREGROUND].read_bytes;
-            int64_t task_bg_rd_delta = task.io[BACKGROUND].read_bytes -
-                last_uid_io_stats[uid.uid].tasks[pid].io[BACKGROUND].read_bytes;
-            int64_t task_fg_wr_delta = task.io[FOREGROUND].write_bytes -
-                last_uid_io_stats[uid.uid].tasks[pid].io[FOREGROUND].write_bytes;
-            int64_t task_bg_wr_delta = task.io[BACKGROUND].write_bytes -
-                last_uid_io_stats[uid.uid].tasks[pid].io[BACKGROUND].write_bytes;
-
-            io_usage& task_usage = usage.task_ios[comm];
-            task_usage.bytes[READ][FOREGROUND][charger_stat] +=
-                (task_fg_rd_delta < 0) ? 0 : task_fg_rd_delta;
-            task_usage.bytes[READ][BACKGROUND][charger_stat] +=
-                (task_bg_rd_delta < 0) ? 0 : task_bg_rd_delta;
-            task_usage.bytes[WRITE][FOREGROUND][charger_stat] +=
-                (task_fg_wr_delta < 0) ? 0 : task_fg_wr_delta;
-            task_usage.bytes[WRITE][BACKGROUND][charger_stat] +=
-                (task_bg_wr_delta < 0) ? 0 : task_bg_wr_delta;
+            const task_io_state& task = task_it.second;
+            add_io_delta(&usage.task_ios[task.comm], task.delta, charger_stat);
         }
     }
-
-    last_uid_io_stats = uid_io_stats;
 }
 
 void uid_monitor::report(unordered_map<int, StoragedProto>* protos)
@@ -509,12 +701,17 @@ void uid_monitor::set_charger_state(charger_stat_t stat)
 
 void uid_monitor::init(charger_stat_t stat)
 {
+    Mutex::Autolock _l(uidm_mutex);
+
     charger_stat = stat;
 
     start_ts = time(NULL);
-    last_uid_io_stats = get_uid_io_stats();
+    if (read_uid_io_stats_locked()) {
+        update_last_io_stats_locked();
+        update_uid_names_locked();
+    }
 }
 
 uid_monitor::uid_monitor()
-    : enable(!access(UID_IO_STATS_PATH, R_OK)) {
+    : io_stats_seq(0), enable(!access(UID_IO_STATS_PATH, R_OK)) {
 }
@@ -123,6 +123,24 @@ void log_console_perf_history(const vector<int>& perf_history) {
     printf("last 52 weeks : %s\n", line.str().c_str());
 }
 
+void log_console_latency(const vector<LatencyInfo>& latency) {
+    static const char* const uid_bucket_names[UID_BUCKETS] = { "system", "app" };
+    static const char* const io_type_names[IO_TYPES] = { "read", "write" };
+
+    printf("\nI/O latency (us) :\n");
+    printf("device uids type count p50 p99 p99.9 max\n");
+    for (const auto& info : latency) {
+        if (info.uid_bucket >= UID_BUCKETS || info.io_type >= IO_TYPES) {
+            continue;
+        }
+        printf("%s %s %s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+               info.device.c_str(), uid_bucket_names[info.uid_bucket],
+               io_type_names[info.io_type], info.count,
+               info.p50_us, info.p99_us, info.p999_us, info.max_us);
+    }
+    fflush(stdout);
+}
+
 map<string, io_usage> merge_io_usage(const vector<uid_record>& entries) {
     map<string, io_usage> merged_entries;
     for (const auto& record : entries) {
@@ -23,6 +23,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
 #include <healthhalutils/HealthHalUtils.h>
@@ -626,3 +627,197 @@ TEST(storaged_test, uid_monitor) {
 
     EXPECT_EQ(uidm.io_history.size(), 0UL);
 }
+
+TEST(storaged_test, uid_monitor_io_stats) {
+    uid_monitor uidm;
+
+    uidm.io_stats_buffer =
+        "10001 0 0 100 200 0 0 10 20 0 0\n"
+        "task,com.app,worker,1234,0,0,60,0,0,0,5,0,0,0\n"
+        "10002 0 0 1000 0 0 0 0 0 0 0\n";
+    uidm.update_last_io_stats_locked();
+
+    ASSERT_EQ(uidm.last_uid_io_stats.size(), 2UL);
+    uid_io_state& app1 = uidm.last_uid_io_stats[10001];
+    EXPECT_EQ(app1.name, "10001");
+    EXPECT_FALSE(app1.named);
+    // The counters of a new uid are all new.
+    EXPECT_EQ(app1.delta[READ][FOREGROUND], 100UL);
+    EXPECT_EQ(app1.delta[WRITE][BACKGROUND], 20UL);
+    ASSERT_EQ(app1.tasks.count(1234), 1UL);
+    EXPECT_EQ(app1.tasks[1234].comm, "com.app,worker");
+    EXPECT_EQ(app1.tasks[1234].delta[READ][FOREGROUND], 60UL);
+    EXPECT_EQ(app1.tasks[1234].delta[READ][BACKGROUND], 5UL);
+
+    app1.name = "com.app";
+    app1.named = true;
+    uidm.io_stats_buffer =
+        "10001 0 0 150 200 0 0 10 50 0 0\n"
+        "10003 0 0 0 7 0 0 0 0 0 0\n"
+        "task,other,1,0,0,0,0,0,0,0,0,0,0\n";
+    uidm.update_last_io_stats_locked();
+
+    // 10002 and the task of 10001 are gone, and the state of 10001 was kept.
+    ASSERT_EQ(uidm.last_uid_io_stats.size(), 2UL);
+    EXPECT_EQ(uidm.last_uid_io_stats.count(10002), 0UL);
+    uid_io_state& app1_again = uidm.last_uid_io_stats[10001];
+    EXPECT_EQ(&app1_again, &app1);
+    EXPECT_EQ(app1_again.name, "com.app");
+    EXPECT_EQ(app1_again.delta[READ][FOREGROUND], 50UL);
+    EXPECT_EQ(app1_again.delta[WRITE][FOREGROUND], 0UL);
+    EXPECT_EQ(app1_again.delta[WRITE][BACKGROUND], 30UL);
+    EXPECT_TRUE(app1_again.tasks.empty());
+    EXPECT_EQ(uidm.last_uid_io_stats[10003].delta[WRITE][FOREGROUND], 7UL);
+    EXPECT_EQ(uidm.last_uid_io_stats[10003].tasks.size(), 1UL);
+
+    // Counters going backwards do not count.
+    uidm.io_stats_buffer = "10001 0 0 10 200 0 0 10 50 0 0\n";
+    uidm.update_last_io_stats_locked();
+    EXPECT_EQ(uidm.last_uid_io_stats[10001].delta[READ][FOREGROUND], 0UL);
+    EXPECT_EQ(uidm.last_uid_io_stats[10001].io[FOREGROUND].read_bytes, 10UL);
+}
+
+namespace {
+
+void add_uid_io_item(UidIOUsage* usage, uint64_t end_ts, const string& name) {
+    UidIOItem* item = usage->add_uid_io_items();
+    item->set_end_ts(end_ts);
+    item->mutable_records()->set_start_ts(end_ts - 1);
+    UidRecord* rec = item->mutable_records()->add_entries();
+    rec->set_uid_name(name);
+    rec->mutable_uid_io()->set_wr_fg_chg_on(end_ts);
+}
+
+} // namespace
+
+TEST(storaged_test, uid_io_history_log) {
+    TemporaryDir tmp_dir;
+    string path = string(tmp_dir.path) + "/uid_io_history";
+    UidIOUsage usage;
+    add_uid_io_item(&usage, 100, "app1");
+    add_uid_io_item(&usage, 200, "app2");
+
+    uid_io_history_log log(path);
+    UidIOUsage loaded;
+    EXPECT_FALSE(log.load(&loaded));
+    ASSERT_TRUE(log.flush(usage));
+    EXPECT_EQ(log.nr_items, 2U);
+    off_t size = log.size;
+
+    // Only the new item is written.
+    add_uid_io_item(&usage, 300, "app3");
+    ASSERT_TRUE(log.flush(usage));
+    EXPECT_EQ(log.nr_items, 3U);
+    EXPECT_GT(log.size, size);
+    ASSERT_TRUE(log.flush(usage));
+    EXPECT_EQ(log.nr_items, 3U);
+
+    uid_io_history_log log2(path);
+    ASSERT_TRUE(log2.load(&loaded));
+    ASSERT_EQ(loaded.uid_io_items_size(), 3);
+    EXPECT_EQ(loaded.uid_io_items(2).end_ts(), 300UL);
+    EXPECT_EQ(loaded.uid_io_items(2).records().entries(0).uid_name(), "app3");
+    EXPECT_EQ(loaded.uid_io_items(2).records().entries(0).uid_io().wr_fg_chg_on(), 300UL);
+    EXPECT_EQ(log2.last_end_ts, 300UL);
+    EXPECT_FALSE(log2.rewrite_needed);
+
+    // A torn record at the end is dropped, and the file rewritten on the next flush.
+    ASSERT_EQ(truncate(path.c_str(), log2.size - 1), 0);
+    loaded.Clear();
+    uid_io_history_log log3(path);
+    ASSERT_TRUE(log3.load(&loaded));
+    EXPECT_EQ(loaded.uid_io_items_size(), 2);
+    EXPECT_TRUE(log3.rewrite_needed);
+    ASSERT_TRUE(log3.flush(usage));
+    EXPECT_EQ(log3.nr_items, 3U);
+    EXPECT_FALSE(log3.rewrite_needed);
+
+    // Only the last 10 items stay in the history, the others are compacted away.
+    for (uint64_t end_ts = 400; end_ts < 600; end_ts++) {
+        UidIOUsage recent;
+        for (uint64_t ts = end_ts - 9; ts <= end_ts; ts++) {
+            add_uid_io_item(&recent, ts, "app");
+        }
+        ASSERT_TRUE(log3.flush(recent));
+        EXPECT_LE(log3.nr_items, 64U);
+    }
+    loaded.Clear();
+    uid_io_history_log log4(path);
+    ASSERT_TRUE(log4.load(&loaded));
+    EXPECT_EQ(static_cast<uint32_t>(loaded.uid_io_items_size()), log3.nr_items);
+    EXPECT_EQ(log4.last_end_ts, 599UL);
+
+    // The clock went back.
+    usage.Clear();
+    add_uid_io_item(&usage, 50, "app1");
+    ASSERT_TRUE(log4.flush(usage));
+    EXPECT_EQ(log4.nr_items, 1U);
+    EXPECT_EQ(log4.last_end_ts, 50UL);
+
+    unlink(path.c_str());
+}
+
+TEST(storaged_test, latency_histogram) {
+    latency_histogram hist;
+    EXPECT_EQ(hist.percentile(0.5), 0UL);
+
+    // 100us to 100ms
+    for (uint64_t i = 1; i <= 1000; i++) {
+        hist.add(i * 100);
+    }
+    EXPECT_EQ(hist.count(), 1000UL);
+    EXPECT_EQ(hist.max(), 100000UL);
+    // within 1/16th
+    EXPECT_GE(hist.percentile(0.5), 50000UL);
+    EXPECT_LE(hist.percentile(0.5), 50000UL * 17 / 16);
+    EXPECT_GE(hist.percentile(0.99), 99000UL);
+    EXPECT_LE(hist.percentile(0.99), 100000UL);
+    EXPECT_EQ(hist.percentile(1), 100000UL);
+
+    // Small values are exact, and large ones are capped.
+    latency_histogram small;
+    small.add(3);
+    small.add(5);
+    EXPECT_EQ(small.percentile(0.5), 3UL);
+    EXPECT_EQ(small.percentile(1), 5UL);
+    small.add(1ULL << 40);
+    EXPECT_EQ(small.max(), 1ULL << 40);
+    EXPECT_EQ(small.percentile(1), (1ULL << 32) - 1);
+
+    hist += small;
+    EXPECT_EQ(hist.count(), 1003UL);
+    EXPECT_EQ(hist.max(), 1ULL << 40);
+    EXPECT_EQ(hist.percentile(0.001), 5UL);
+}
+
+TEST(storaged_test, disk_latency_monitor) {
+    disk_latency_monitor dlm;
+    vector<string> lines = {
+        "kworker/u16:2-145 [001] ...1  100.000100: block_rq_issue: 179,0 WS 4096 () 2049 + 8 [kw]",
+        "fio-1234 [002] ...1  100.001000: block_rq_issue: 179,0 R 8192 () 4096 + 16 [fio]",
+        "fio-1234 [002] ...1  100.001000: block_rq_issue: 179,0 FF 0 () 0 + 0 [fio]",
+        "fio-1234 [002] ...1  100.001000: block_rq_insert: 179,0 R 8192 () 8192 + 16 [fio]",
+        "<idle>-0 [000] d.h1  100.000600: block_rq_complete: 179,0 WS () 2049 + 8 [0]",
+        "<idle>-0 [000] d.h1  100.003000: block_rq_complete: 179,0 R () 4096 + 16 [0]",
+        // never issued
+        "<idle>-0 [000] d.h1  100.004000: block_rq_complete: 179,0 R () 9999 + 16 [0]",
+    };
+    for (auto& line : lines) {
+        dlm.handle_event(&line[0]);
+    }
+
+    vector<LatencyInfo> latency = dlm.get_latency();
+    ASSERT_EQ(latency.size(), 2UL);
+    for (const auto& info : latency) {
+        EXPECT_EQ(info.count, 1UL);
+        if (info.io_type == WRITE) {
+            EXPECT_EQ(info.p50_us, 500UL);
+            EXPECT_EQ(info.max_us, 500UL);
+        } else {
+            EXPECT_EQ(info.io_type, static_cast<uint32_t>(READ));
+            EXPECT_EQ(info.p999_us, 2000UL);
+            EXPECT_EQ(info.max_us, 2000UL);
+        }
+    }
+    EXPECT_TRUE(dlm.mDisks.begin()->second.inflight.empty());
+}
@@ -76,6 +76,7 @@ static const char rcsid[] =
 #define MAXCLS12  0xfed     /* maximum FAT12 clusters */
 #define MAXCLS16  0xfff5    /* maximum FAT16 clusters */
 #define MAXCLS32  0xffffff5 /* maximum FAT32 clusters */
+#define WRBUFSZ   (1 << 20) /* bytes of sectors written at once */
 
 #define mincls(fat)  ((fat) == 12 ? MINCLS12 :    \
                       (fat) == 16 ? MINCLS16 :    \
@@ -173,6 +174,27 @@ struct bpb {
 
 #define BPBGAP 0, 0, 0, 0, 0, 0
 
+/*
+ * Sectors are written in runs of up to WRBUFSZ bytes. Runs of zero sectors
+ * are zeroed by the device where it can (ZERO_IOCTL), or not written at all
+ * to a file that was just created (ZERO_SKIP).
+ */
+enum { ZERO_WRITE, ZERO_IOCTL, ZERO_SKIP };
+
+struct wrbuf {
+    int fd;
+    const char *fname;
+    off_t ofs;          /* offset of sector 0 */
+    u_int bps;          /* bytes per sector */
+    u_int8_t *buf;
+    u_int size;         /* sectors in buf */
+    u_int lsn;          /* first sector of the pending run */
+    u_int len;          /* sectors of data in buf */
+    u_int zeros;        /* sectors in the pending run of zeros */
+    int zero_mode;
+    uintmax_t bytes;    /* bytes of file system written so far */
+};
+
 static struct {
     const char *name;
     struct bpb bpb;
@@ -231,6 +253,10 @@ static off_t argtooff(const char *, const char *);
 static int oklabel(const char *);
 static void mklabel(u_int8_t *, const char *);
 static void setstr(u_int8_t *, const char *, size_t);
+static void discard_range(int, off_t, off_t);
+static void wr_init(struct wrbuf *, int, const char *, off_t, u_int, int);
+static void wr_sector(struct wrbuf *, const u_int8_t *, u_int);
+static void wr_finish(struct wrbuf *);
 static void usage(void);
 
 /*
@@ -257,13 +283,16 @@ int newfs_msdos_main(int argc, char *argv[])
     struct bsx *bsx;
     struct de *de;
     u_int8_t *img;
+    struct wrbuf wr;
+    struct timespec start, end;
     const char *fname, *dtype, *bname;
     ssize_t n;
     time_t now;
     u_int fat, bss, rds, cls, dir, lsn, x, x1, x2;
     u_int extra_res, alignment=0, set_res, set_spf, set_spc, tempx, attempts=0;
-    int ch, fd, fd1;
+    int ch, fd, fd1, blkdev;
     off_t opt_create = 0, opt_ofs = 0;
+    long ms;
 
     while ((ch = getopt(argc, argv, opts)) != -1)
         switch (ch) {
@@ -382,6 +411,7 @@ int newfs_msdos_main(int argc, char *argv[])
         err(1, "%s", fname);
     if (fstat(fd, &sb))
         err(1, "%s", fname);
+    blkdev = S_ISBLK(sb.st_mode);
     if (opt_create) {
         if (!S_ISREG(sb.st_mode))
             warnx("warning, %s is not a regular file", fname);
@@ -641,6 +671,20 @@ int newfs_msdos_main(int argc, char *argv[])
         if (!(img = malloc(bpb.bps)))
             err(1, "%u", bpb.bps);
         dir = bpb.res + (bpb.spf ? bpb.spf : bpb.bspf) * bpb.nft;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        /*
+         * Nothing in the data area needs to survive, so let the device
+         * forget it. The FAT32 root directory cluster is written below.
+         */
+        if (blkdev) {
+            x = dir + (fat == 32 ? 0 : rds);
+            x1 = bpb.sec ? bpb.sec : bpb.bsec;
+            if (x < x1)
+                discard_range(fd, opt_ofs + (off_t)x * bpb.bps,
+                              (off_t)(x1 - x) * bpb.bps);
+        }
+        wr_init(&wr, fd, fname, opt_ofs, bpb.bps,
+                blkdev ? ZERO_IOCTL : opt_create ? ZERO_SKIP : ZERO_WRITE);
         for (lsn = 0; lsn < dir + (fat == 32 ? bpb.spc : rds); lsn++) {
             x = lsn;
             if (opt_B && fat == 32 && bpb.bkbs != MAXU16 && bss <= bpb.bkbs && x >= bpb.bkbs) {
@@ -734,14 +778,16 @@ int newfs_msdos_main(int argc, char *argv[])
                         (u_int)tm->tm_mday;
                 mk2(de->date, x);
             }
-            if ((n = write(fd, img, bpb.bps)) == -1)
-                err(1, "%s", fname);
-            if ((unsigned)n != bpb.bps) {
-                errx(1, "%s: can't write sector %u", fname, lsn);
-                exit(1);
-            }
+            wr_sector(&wr, img, lsn);
         }
+        wr_finish(&wr);
         free(img);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ms = (end.tv_sec - start.tv_sec) * 1000 +
+                (end.tv_nsec - start.tv_nsec) / 1000000;
+        printf("%s: %ju bytes formatted in %ld.%03lds (%ju KiB/s)\n",
+               fname, wr.bytes, ms / 1000, ms % 1000,
+               wr.bytes * 1000 / 1024 / (ms ? (uintmax_t)ms : 1));
     }
     return 0;
 }
@@ -923,6 +969,115 @@ static void getdiskinfo(int fd, const char *fname, const char *dtype,
 }
 #endif
 
+/*
+ * Discard a byte range of a block device, ignoring devices without support.
+ */
+static void discard_range(int fd, off_t ofs, off_t len)
+{
+#ifdef ANDROID
+    u_int64_t range[2];
+
+    range[0] = ofs;
+    range[1] = len;
+    if (ioctl(fd, BLKDISCARD, range) && errno != EOPNOTSUPP)
+        warn("warning: discard failed");
+#endif
+}
+
+static void wr_init(struct wrbuf *wr, int fd, const char *fname, off_t ofs,
+                    u_int bps, int zero_mode)
+{
+    memset(wr, 0, sizeof(*wr));
+    wr->fd = fd;
+    wr->fname = fname;
+    wr->ofs = ofs;
+    wr->bps = bps;
+    wr->size = MAX(1, WRBUFSZ / bps);
+    wr->zero_mode = zero_mode;
+    if ((errno = posix_memalign((void **)&wr->buf, getpagesize(),
+                                (size_t)wr->size * bps)))
+        err(1, "%u", wr->size * bps);
+}
+
+static void wr_write(struct wrbuf *wr, u_int lsn, u_int count)
+{
+    ssize_t n;
+    size_t len = (size_t)count * wr->bps;
+
+    n = pwrite(wr->fd, wr->buf, len, wr->ofs + (off_t)lsn * wr->bps);
+    if (n == -1)
+        err(1, "%s", wr->fname);
+    if ((size_t)n != len)
+        errx(1, "%s: can't write sector %u", wr->fname, lsn + (u_int)(n / wr->bps));
+}
+
+static void wr_flush_zeros(struct wrbuf *wr)
+{
+    u_int lsn, count;
+
+    if (!wr->zeros)
+        return;
+#ifdef ANDROID
+    if (wr->zero_mode == ZERO_IOCTL) {
+        u_int64_t range[2];
+
+        range[0] = wr->ofs + (off_t)wr->lsn * wr->bps;
+        range[1] = (u_int64_t)wr->zeros * wr->bps;
+        /* Not for all devices, and not at any offset: write them then. */
+        if (ioctl(wr->fd, BLKZEROOUT, range))
+            wr->zero_mode = ZERO_WRITE;
+    }
+#endif
+    if (wr->zero_mode == ZERO_WRITE) {
+        memset(wr->buf, 0, (size_t)wr->size * wr->bps);
+        for (lsn = wr->lsn; lsn < wr->lsn + wr->zeros; lsn += count) {
+            count = MIN(wr->size, wr->lsn + wr->zeros - lsn);
+            wr_write(wr, lsn, count);
+        }
+    }
+    wr->bytes += (uintmax_t)wr->zeros * wr->bps;
+    wr->zeros = 0;
+}
+
+static void wr_flush_data(struct wrbuf *wr)
+{
+    if (!wr->len)
+        return;
+    wr_write(wr, wr->lsn, wr->len);
+    wr->bytes += (uintmax_t)wr->len * wr->bps;
+    wr->len = 0;
+}
+
+/*
+ * Queue sector lsn, which must follow the one queued before.
+ */
+static void wr_sector(struct wrbuf *wr, const u_int8_t *img, u_int lsn)
+{
+    u_int i;
+
+    for (i = 0; i < wr->bps && !img[i]; i++);
+    if (i == wr->bps && wr->zero_mode != ZERO_WRITE) {
+        wr_flush_data(wr);
+        if (!wr->zeros)
+            wr->lsn = lsn;
+        wr->zeros++;
+        return;
+    }
+    wr_flush_zeros(wr);
+    if (!wr->len)
+        wr->lsn = lsn;
+    memcpy(wr->buf + (size_t)wr->len * wr->bps, img, wr->bps);
+    if (++wr->len == wr->size)
+        wr_flush_data(wr);
+}
+
+static void wr_finish(struct wrbuf *wr)
+{
+    wr_flush_data(wr);
+    wr_flush_zeros(wr);
+    free(wr->buf);
+}
+
 /*
  * Print out BPB values.
  */
@@ -32,6 +32,9 @@
 
 static int tipc_fd = -1;
 
+/* first error of the messages of the current batch */
+static enum storage_err batch_result = STORAGE_NO_ERROR;
+
 int ipc_connect(const char *device, const char *port)
 {
     int rc;
@@ -100,6 +103,22 @@ int ipc_respond(struct storage_msg *msg, void *out, size_t out_size)
 
     assert(tipc_fd >=  0);
 
+    /*
+     * The messages of a batch get a single response, sent for the first
+     * message without STORAGE_MSG_FLAG_BATCH. This lets the server send
+     * them without waiting for each to be handled.
+     */
+    if (msg->flags & STORAGE_MSG_FLAG_BATCH) {
+        if (batch_result == STORAGE_NO_ERROR)
+            batch_result = msg->result;
+        return 0;
+    }
+    if (batch_result != STORAGE_NO_ERROR) {
+        msg->result = batch_result;
+        batch_result = STORAGE_NO_ERROR;
+        out = NULL;
+    }
+
     msg->cmd |= STORAGE_RESP_BIT;
 
     rc = writev(tipc_fd, iovs, out ? 2 : 1);
@@ -83,10 +83,14 @@ static int lookup_fd(uint32_t handle, bool dirty)
     return handle;
 }
 
-static int remove_fd(uint32_t handle)
+static int remove_fd(uint32_t handle, bool *dirty)
 {
     if (handle < FD_TBL_SIZE) {
+        *dirty = fd_state[handle] == SS_DIRTY;
         fd_state[handle] = SS_UNUSED; /* set to uninstalled */
+    } else {
+        /* untracked fd: might be dirty */
+        *dirty = true;
     }
     return handle;
 }
@@ -307,10 +311,12 @@ int storage_file_close(struct storage_msg *msg,
         goto err_response;
     }
 
-    int fd = remove_fd(req->handle);
+    bool dirty;
+    int fd = remove_fd(req->handle, &dirty);
     ALOGV("%s: handle = %u: fd = %u\n", __func__, req->handle, fd);
 
-    int rc = fsync(fd);
+    /* files that were only read, or already synced by a checkpoint, are clean */
+    int rc = dirty ? fsync(fd) : 0;
     if (rc < 0) {
         rc = errno;
         ALOGE("%s: fsync failed for fd=%u: %s\n",